@@ -18,12 +18,15 @@ include $(CLEAR_VARS)
 
 LOCAL_MODULE := libalsautils
 LOCAL_SRC_FILES := \
+	alsa_adapter.c \
 	alsa_device_profile.c \
 	alsa_device_proxy.c \
 	alsa_logging.c \
-	alsa_format.c
+	alsa_format.c \
+	alsa_timestamp.c
 LOCAL_C_INCLUDES += \
-	external/tinyalsa/include
+	external/tinyalsa/include \
+	$(call include-path-for, audio-utils)
 LOCAL_EXPORT_C_INCLUDE_DIRS := system/media/alsa_utils/include
 LOCAL_SHARED_LIBRARIES := liblog libcutils libtinyalsa libaudioutils
 LOCAL_MODULE_TAGS := optional
@@ -32,3 +35,4 @@ LOCAL_CFLAGS += -Wno-unused-parameter
 
 include $(BUILD_SHARED_LIBRARY)
 
+include $(call all-makefiles-under,$(LOCAL_PATH))
@@ -0,0 +1,262 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "alsa_adapter"
+/*#define LOG_NDEBUG 0*/
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <log/log.h>
+
+#include <audio_utils/channels.h>
+#include <audio_utils/format.h>
+#include <audio_utils/resampler.h>
+
+#include "include/alsa_adapter.h"
+
+/* frames the resampler may produce beyond the nominal ratio in one call */
+#define RESAMPLER_MARGIN_FRAMES 16
+
+struct alsa_adapter {
+    alsa_adapter_config src;
+    alsa_adapter_config dst;
+    size_t max_src_frames;
+
+    /*
+     * The pipeline: to float, channels, resampler, from float, with the channel stage
+     * before the resampler when that reduces the channels it resamples.
+     * A conversion with no channel or rate change is done in one pass by direct.
+     */
+    memcpy_by_audio_format_t direct;
+    memcpy_by_audio_format_t to_float;      /* NULL if the source is float */
+    memcpy_by_audio_format_t from_float;    /* NULL if the destination is float */
+    struct resampler_itfe * resampler;      /* NULL if the rates are the same */
+    bool channels_first;
+
+    void * src_buffer;
+    float * buffers[2];
+};
+
+audio_format_t audio_format_from_pcm_format(enum pcm_format format)
+{
+    switch (format) {
+    case PCM_FORMAT_S16_LE:
+        return AUDIO_FORMAT_PCM_16_BIT;
+    case PCM_FORMAT_S32_LE:
+        return AUDIO_FORMAT_PCM_32_BIT;
+    case PCM_FORMAT_S8:
+        return AUDIO_FORMAT_PCM_8_BIT;
+    case PCM_FORMAT_S24_LE:
+        return AUDIO_FORMAT_PCM_8_24_BIT;
+    case PCM_FORMAT_S24_3LE:
+        return AUDIO_FORMAT_PCM_24_BIT_PACKED;
+    default:
+        return AUDIO_FORMAT_INVALID;
+    }
+}
+
+static size_t config_frame_size(const alsa_adapter_config * config)
+{
+    return audio_bytes_per_sample(config->format) * config->channels;
+}
+
+int adapter_create(const alsa_adapter_config * src, const alsa_adapter_config * dst,
+                   size_t max_src_frames, alsa_adapter ** adapter)
+{
+    *adapter = NULL;
+    if (src->channels == 0 || dst->channels == 0 || src->rate == 0 || dst->rate == 0
+            || max_src_frames == 0 || audio_bytes_per_sample(src->format) == 0
+            || audio_bytes_per_sample(dst->format) == 0) {
+        return -EINVAL;
+    }
+
+    alsa_adapter * a = calloc(1, sizeof(*a));
+    if (a == NULL) {
+        return -ENOMEM;
+    }
+    a->src = *src;
+    a->dst = *dst;
+    a->max_src_frames = max_src_frames;
+
+    int ret = -EINVAL;
+    if (src->channels == dst->channels && src->rate == dst->rate) {
+        a->direct = memcpy_by_audio_format_get_converter(dst->format, src->format);
+    }
+    if (a->direct == NULL) {
+        if (src->format != AUDIO_FORMAT_PCM_FLOAT) {
+            a->to_float = memcpy_by_audio_format_get_converter(AUDIO_FORMAT_PCM_FLOAT,
+                                                               src->format);
+            if (a->to_float == NULL) {
+                goto fail;
+            }
+        }
+        if (dst->format != AUDIO_FORMAT_PCM_FLOAT) {
+            a->from_float = memcpy_by_audio_format_get_converter(dst->format,
+                                                                 AUDIO_FORMAT_PCM_FLOAT);
+            if (a->from_float == NULL) {
+                goto fail;
+            }
+        }
+        a->channels_first = dst->channels < src->channels;
+    }
+
+    size_t max_dst_frames = max_src_frames;
+    if (src->rate != dst->rate) {
+        max_dst_frames = (uint64_t)max_src_frames * dst->rate / src->rate + 1
+                + RESAMPLER_MARGIN_FRAMES;
+
+        struct resampler_config config;
+        memset(&config, 0, sizeof(config));
+        config.in_sample_rate = src->rate;
+        config.out_sample_rate = dst->rate;
+        config.channel_count = a->channels_first ? dst->channels : src->channels;
+        config.quality = RESAMPLER_QUALITY_DEFAULT;
+        config.engine = RESAMPLER_ENGINE_POLYPHASE;
+        /* the polyphase engine only handles simple ratios */
+        ret = create_resampler_from_config(&config, NULL, &a->resampler);
+        if (ret != 0) {
+            config.engine = RESAMPLER_ENGINE_SPEEX;
+            ret = create_resampler_from_config(&config, NULL, &a->resampler);
+        }
+        if (ret != 0) {
+            goto fail;
+        }
+    }
+
+    const size_t max_channels = src->channels > dst->channels ? src->channels : dst->channels;
+    const size_t max_frames = max_src_frames > max_dst_frames ? max_src_frames : max_dst_frames;
+    ret = -ENOMEM;
+    a->src_buffer = malloc(max_src_frames * config_frame_size(src));
+    a->buffers[0] = malloc(max_frames * max_channels * sizeof(float));
+    a->buffers[1] = malloc(max_frames * max_channels * sizeof(float));
+    if (a->src_buffer == NULL || a->buffers[0] == NULL || a->buffers[1] == NULL) {
+        goto fail;
+    }
+
+    ALOGV("adapter_create() %#x/%u/%u -> %#x/%u/%u%s", src->format, src->channels, src->rate,
+          dst->format, dst->channels, dst->rate, a->direct != NULL ? " direct" : "");
+    *adapter = a;
+    return 0;
+
+fail:
+    adapter_destroy(a);
+    return ret;
+}
+
+void adapter_destroy(alsa_adapter * adapter)
+{
+    if (adapter == NULL) {
+        return;
+    }
+    if (adapter->resampler != NULL) {
+        release_resampler(adapter->resampler);
+    }
+    free(adapter->src_buffer);
+    free(adapter->buffers[0]);
+    free(adapter->buffers[1]);
+    free(adapter);
+}
+
+void adapter_reset(alsa_adapter * adapter)
+{
+    if (adapter->resampler != NULL) {
+        adapter->resampler->reset(adapter->resampler);
+    }
+}
+
+size_t adapter_process(alsa_adapter * adapter, const void * src, size_t frames,
+                       const void ** dst)
+{
+    if (frames > adapter->max_src_frames) {
+        frames = adapter->max_src_frames;
+    }
+    if (adapter->direct != NULL) {
+        adapter->direct(adapter->buffers[0], src, frames * adapter->src.channels);
+        *dst = adapter->buffers[0];
+        return frames;
+    }
+
+    /* each stage reads from in and writes to out, then they swap */
+    const float * in = src;
+    float * out = adapter->buffers[0];
+    unsigned channels = adapter->src.channels;
+
+    if (adapter->to_float != NULL) {
+        adapter->to_float(out, in, frames * channels);
+        in = out;
+        out = adapter->buffers[1];
+    }
+    if (adapter->channels_first) {
+        /* contraction can be done in place */
+        float * target = in == (const float *)src ? out : (float *)in;
+        adjust_channels_float(in, channels, target, adapter->dst.channels,
+                              frames * channels * sizeof(float));
+        channels = adapter->dst.channels;
+        if (target == out) {
+            in = out;
+            out = adapter->buffers[1];
+        }
+    }
+    if (adapter->resampler != NULL) {
+        size_t in_frames = frames;
+        size_t out_frames = (uint64_t)frames * adapter->dst.rate / adapter->src.rate + 1
+                + RESAMPLER_MARGIN_FRAMES;
+        adapter->resampler->resample_from_input_float(adapter->resampler, in, &in_frames,
+                                                      out, &out_frames);
+        ALOGW_IF(in_frames != frames, "adapter_process() resampler left %zu frames",
+                 frames - in_frames);
+        frames = out_frames;
+        in = out;
+        out = in == adapter->buffers[0] ? adapter->buffers[1] : adapter->buffers[0];
+    }
+    if (channels != adapter->dst.channels) {
+        adjust_channels_float(in, channels, out, adapter->dst.channels,
+                              frames * channels * sizeof(float));
+        channels = adapter->dst.channels;
+        in = out;
+    }
+    if (adapter->from_float != NULL) {
+        /* narrowing from float can be done in place */
+        float * target = in == (const float *)src ? adapter->buffers[0] : (float *)in;
+        adapter->from_float(target, in, frames * channels);
+        in = target;
+    }
+    *dst = in;
+    return frames;
+}
+
+void * adapter_get_src_buffer(alsa_adapter * adapter)
+{
+    return adapter->src_buffer;
+}
+
+size_t adapter_get_src_frame_size(const alsa_adapter * adapter)
+{
+    return config_frame_size(&adapter->src);
+}
+
+size_t adapter_get_dst_frame_size(const alsa_adapter * adapter)
+{
+    return config_frame_size(&adapter->dst);
+}
+
+size_t adapter_get_max_src_frames(const alsa_adapter * adapter)
+{
+    return adapter->max_src_frames;
+}
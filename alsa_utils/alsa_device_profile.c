@@ -18,10 +18,17 @@
 /*#define LOG_NDEBUG 0*/
 /*#define LOG_PCM_PARAMS 0*/
 
+#include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <inttypes.h>
+#include <limits.h>
+#include <pthread.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 #include <cutils/properties.h>
 
 #include <log/log.h>
@@ -29,6 +36,7 @@
 #include "include/alsa_device_profile.h"
 #include "include/alsa_format.h"
 #include "include/alsa_logging.h"
+#include "private/alsa_device_profile_cache.h"
 
 #define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
 
@@ -36,6 +44,9 @@
 
 #define DEFAULT_PERIOD_SIZE 1024
 
+#define PROFILE_CACHE_MAGIC     0x46505341  /* "ASPF" */
+#define PROFILE_CACHE_VERSION   1
+
 static const char * const format_string_map[] = {
     "AUDIO_FORMAT_PCM_16_BIT",      /* "PCM_FORMAT_S16_LE", */
     "AUDIO_FORMAT_PCM_32_BIT",      /* "PCM_FORMAT_S32_LE", */
@@ -58,6 +69,8 @@ extern int8_t const pcm_format_value_map[50];
 static const unsigned std_sample_rates[] =
     {96000, 88200, 192000, 176400, 48000, 44100, 32000, 24000, 22050, 16000, 12000, 11025, 8000};
 
+static void profile_update_capabilities(alsa_device_profile* profile);
+
 static void profile_reset(alsa_device_profile* profile)
 {
     profile->card = profile->device = -1;
@@ -68,11 +81,34 @@ static void profile_reset(alsa_device_profile* profile)
     profile->channel_counts[0] = 0;
 
     profile->min_period_size = profile->max_period_size = 0;
+    profile->min_period_count = profile->max_period_count = 0;
     profile->min_channel_count = profile->max_channel_count = DEFAULT_CHANNEL_COUNT;
 
+    profile->format_mask = 0;
+    profile->sample_rate_mask = 0;
+
     profile->is_valid = false;
 }
 
+/*
+ * Returns the bit of a rate in sample_rate_mask, or 0 for a non-standard rate.
+ */
+static uint32_t sample_rate_bit(unsigned rate)
+{
+    size_t index;
+    for (index = 0; index < ARRAY_SIZE(std_sample_rates); index++) {
+        if (std_sample_rates[index] == rate) {
+            return 1u << index;
+        }
+    }
+    return 0;
+}
+
+static uint32_t format_bit(enum pcm_format fmt)
+{
+    return fmt >= 0 && fmt < 32 ? 1u << fmt : 0;
+}
+
 void profile_init(alsa_device_profile* profile, int direction)
 {
     profile->direction = direction;
@@ -145,14 +181,7 @@ unsigned profile_get_default_sample_rate(alsa_device_profile* profile)
 bool profile_is_sample_rate_valid(alsa_device_profile* profile, unsigned rate)
 {
     if (profile_is_valid(profile)) {
-        size_t index;
-        for (index = 0; profile->sample_rates[index] != 0; index++) {
-            if (profile->sample_rates[index] == rate) {
-                return true;
-            }
-        }
-
-        return false;
+        return (profile->sample_rate_mask & sample_rate_bit(rate)) != 0;
     } else {
         return rate == DEFAULT_SAMPLE_RATE;
     }
@@ -171,14 +200,7 @@ enum pcm_format profile_get_default_format(alsa_device_profile* profile)
 
 bool profile_is_format_valid(alsa_device_profile* profile, enum pcm_format fmt) {
     if (profile_is_valid(profile)) {
-        size_t index;
-        for (index = 0; profile->formats[index] != PCM_FORMAT_INVALID; index++) {
-            if (profile->formats[index] == fmt) {
-                return true;
-            }
-        }
-
-        return false;
+        return (profile->format_mask & format_bit(fmt)) != 0;
     } else {
         return fmt == DEFAULT_SAMPLE_FORMAT;
     }
@@ -336,6 +358,9 @@ static int read_alsa_device_config(alsa_device_profile * profile, struct pcm_con
     profile->min_period_size = pcm_params_get_min(alsa_hw_params, PCM_PARAM_PERIOD_SIZE);
     profile->max_period_size = pcm_params_get_max(alsa_hw_params, PCM_PARAM_PERIOD_SIZE);
 
+    profile->min_period_count = pcm_params_get_min(alsa_hw_params, PCM_PARAM_PERIODS);
+    profile->max_period_count = pcm_params_get_max(alsa_hw_params, PCM_PARAM_PERIODS);
+
     profile->min_channel_count = pcm_params_get_min(alsa_hw_params, PCM_PARAM_CHANNELS);
     profile->max_channel_count = pcm_params_get_max(alsa_hw_params, PCM_PARAM_CHANNELS);
 
@@ -413,20 +438,422 @@ bool profile_read_device_info(alsa_device_profile* profile)
             profile, pcm_params_get_min(alsa_hw_params, PCM_PARAM_RATE),
             pcm_params_get_max(alsa_hw_params, PCM_PARAM_RATE));
 
+    pcm_params_free(alsa_hw_params);
+
+    profile_update_capabilities(profile);
     profile->is_valid = true;
 
     return true;
 }
 
-char * profile_get_sample_rate_strs(alsa_device_profile* profile)
+/*
+ * Profile cache
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t descriptor_hash;
+    int32_t formats[MAX_PROFILE_FORMATS];
+    uint32_t sample_rates[MAX_PROFILE_SAMPLE_RATES];
+    uint32_t channel_counts[MAX_PROFILE_CHANNEL_COUNTS];
+    uint32_t default_channels;
+    uint32_t default_rate;
+    uint32_t default_period_count;
+    int32_t default_format;
+    uint32_t min_period_size;
+    uint32_t max_period_size;
+    uint32_t min_period_count;
+    uint32_t max_period_count;
+    uint32_t min_channel_count;
+    uint32_t max_channel_count;
+} profile_cache_entry;
+
+/*
+ * Returns the FNV-1a hash of the descriptor lines of a /proc/asound/cardN/streamD file,
+ * or 0 if it can't be read.
+ * Each direction has a "Status:" line followed, while the stream is running, by more indented
+ * lines of its state, such as "Momentary freq = 47999 Hz".  These are left out, so that the
+ * hash only depends on the interfaces, with their formats, channels and rates.
+ */
+uint32_t profile_hash_stream_file(const char* path)
+{
+    uint32_t hash = 2166136261u;
+    char* line = NULL;
+    size_t line_size = 0;
+    ssize_t length;
+    ssize_t status_indent = -1;     /* indent of the current Status: line, or -1 */
+
+    FILE* file = fopen(path, "re");
+    if (file == NULL) {
+        return 0;
+    }
+    while ((length = getline(&line, &line_size, file)) > 0) {
+        ssize_t indent = strspn(line, " \t");
+        if (status_indent >= 0 && indent > status_indent && indent < length - 1) {
+            continue;
+        }
+        status_indent = -1;
+        if (strncmp(&line[indent], "Status:", strlen("Status:")) == 0) {
+            status_indent = indent;
+            continue;
+        }
+        for (ssize_t i = 0; i < length; i++) {
+            hash = (hash ^ (unsigned char)line[i]) * 16777619u;
+        }
+    }
+    bool error = ferror(file);
+    free(line);
+    fclose(file);
+    return error ? 0 : hash;
+}
+
+/*
+ * Builds the cache file name of a USB device, and the hash of its stream descriptors.
+ * Returns false for devices which aren't USB.
+ */
+static bool profile_get_cache_path(const alsa_device_profile* profile, const char* cache_dir,
+                                   char* path, size_t path_size, uint32_t* descriptor_hash)
+{
+    char proc_path[64];
+    char usb_id[16] = "";
+
+    snprintf(proc_path, sizeof(proc_path), "/proc/asound/card%d/usbid", profile->card);
+    FILE* file = fopen(proc_path, "re");
+    if (file == NULL) {
+        return false;
+    }
+    bool is_usb = fscanf(file, "%15s", usb_id) == 1;
+    fclose(file);
+    if (!is_usb || cache_dir == NULL) {
+        return false;
+    }
+
+    /* the stream file lists the formats, rates and channels of each USB interface */
+    snprintf(proc_path, sizeof(proc_path), "/proc/asound/card%d/stream%d",
+             profile->card, profile->device);
+    *descriptor_hash = profile_hash_stream_file(proc_path);
+
+    /* usbid is "vvvv:pppp" */
+    char* colon = strchr(usb_id, ':');
+    if (colon != NULL) {
+        *colon = '-';
+    }
+    return snprintf(path, path_size, "%s/usb-%s-%08" PRIx32 "-%d-%s.profile", cache_dir,
+                    usb_id, *descriptor_hash, profile->device,
+                    profile->direction == PCM_OUT ? "out" : "in") < (int)path_size;
+}
+
+static void profile_to_cache_entry(const alsa_device_profile* profile, uint32_t descriptor_hash,
+                                   profile_cache_entry* entry)
+{
+    size_t index;
+
+    memset(entry, 0, sizeof(*entry));
+    entry->magic = PROFILE_CACHE_MAGIC;
+    entry->version = PROFILE_CACHE_VERSION;
+    entry->descriptor_hash = descriptor_hash;
+    /* unlike the other arrays, formats are terminated by PCM_FORMAT_INVALID rather than 0 */
+    for (index = 0; index < MAX_PROFILE_FORMATS; index++) {
+        entry->formats[index] = PCM_FORMAT_INVALID;
+    }
+    for (index = 0; index < MAX_PROFILE_FORMATS
+            && profile->formats[index] != PCM_FORMAT_INVALID; index++) {
+        entry->formats[index] = profile->formats[index];
+    }
+    for (index = 0; index < MAX_PROFILE_SAMPLE_RATES && profile->sample_rates[index] != 0;
+            index++) {
+        entry->sample_rates[index] = profile->sample_rates[index];
+    }
+    for (index = 0; index < MAX_PROFILE_CHANNEL_COUNTS && profile->channel_counts[index] != 0;
+            index++) {
+        entry->channel_counts[index] = profile->channel_counts[index];
+    }
+    entry->default_channels = profile->default_config.channels;
+    entry->default_rate = profile->default_config.rate;
+    entry->default_period_count = profile->default_config.period_count;
+    entry->default_format = profile->default_config.format;
+    entry->min_period_size = profile->min_period_size;
+    entry->max_period_size = profile->max_period_size;
+    entry->min_period_count = profile->min_period_count;
+    entry->max_period_count = profile->max_period_count;
+    entry->min_channel_count = profile->min_channel_count;
+    entry->max_channel_count = profile->max_channel_count;
+}
+
+static bool profile_from_cache_entry(alsa_device_profile* profile,
+                                     const profile_cache_entry* entry)
+{
+    size_t index;
+
+    /* the arrays must be terminated, as profile_read_device_info() leaves them */
+    if (entry->formats[MAX_PROFILE_FORMATS - 1] != PCM_FORMAT_INVALID
+            || entry->sample_rates[MAX_PROFILE_SAMPLE_RATES - 1] != 0
+            || entry->channel_counts[MAX_PROFILE_CHANNEL_COUNTS - 1] != 0) {
+        return false;
+    }
+    for (index = 0; entry->formats[index] != PCM_FORMAT_INVALID; index++) {
+        if (entry->formats[index] < 0 || entry->formats[index] >= PCM_FORMAT_MAX) {
+            return false;
+        }
+    }
+    /* the profile is only modified once the entry is known to be valid */
+    for (index = 0; index < MAX_PROFILE_FORMATS; index++) {
+        profile->formats[index] = entry->formats[index];
+    }
+    for (index = 0; index < MAX_PROFILE_SAMPLE_RATES; index++) {
+        profile->sample_rates[index] = entry->sample_rates[index];
+    }
+    for (index = 0; index < MAX_PROFILE_CHANNEL_COUNTS; index++) {
+        profile->channel_counts[index] = entry->channel_counts[index];
+    }
+    profile->default_config.channels = entry->default_channels;
+    profile->default_config.rate = entry->default_rate;
+    profile->default_config.period_count = entry->default_period_count;
+    profile->default_config.format = entry->default_format;
+    profile->min_period_size = entry->min_period_size;
+    profile->max_period_size = entry->max_period_size;
+    profile->min_period_count = entry->min_period_count;
+    profile->max_period_count = entry->max_period_count;
+    profile->min_channel_count = entry->min_channel_count;
+    profile->max_channel_count = entry->max_channel_count;
+    /* this depends on a system property rather than the device */
+    profile->default_config.period_size =
+            profile_calc_min_period_size(profile, profile->default_config.rate);
+    profile_update_capabilities(profile);
+    profile->is_valid = true;
+    return true;
+}
+
+void profile_write_cache(const alsa_device_profile* profile, const char* path,
+                         uint32_t descriptor_hash)
+{
+    profile_cache_entry entry;
+    char temp_path[PATH_MAX];
+
+    profile_to_cache_entry(profile, descriptor_hash, &entry);
+    if (snprintf(temp_path, sizeof(temp_path), "%s.tmp", path) >= (int)sizeof(temp_path)) {
+        return;
+    }
+    int fd = open(temp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        ALOGW("profile_write_cache() can't create %s: %s", temp_path, strerror(errno));
+        return;
+    }
+    bool written = write(fd, &entry, sizeof(entry)) == (ssize_t)sizeof(entry);
+    close(fd);
+    if (!written || rename(temp_path, path) != 0) {
+        ALOGW("profile_write_cache() can't write %s: %s", path, strerror(errno));
+        unlink(temp_path);
+    }
+}
+
+bool profile_read_cache(alsa_device_profile* profile, const char* path, uint32_t descriptor_hash)
+{
+    profile_cache_entry entry;
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    bool hit = read(fd, &entry, sizeof(entry)) == (ssize_t)sizeof(entry)
+            && entry.magic == PROFILE_CACHE_MAGIC
+            && entry.version == PROFILE_CACHE_VERSION
+            && entry.descriptor_hash == descriptor_hash;
+    close(fd);
+    return hit && profile_from_cache_entry(profile, &entry);
+}
+
+/*
+ * Removes the cache files of the same device and direction as path, written for other
+ * descriptors, e.g. before a firmware update.  Names end with "-hhhhhhhh-D-dir.profile",
+ * where hhhhhhhh is the descriptor hash.
+ */
+void profile_remove_stale_caches(const char* path)
+{
+    static const char suffix[] = ".profile";
+    const char* slash = strrchr(path, '/');
+    if (slash == NULL) {
+        return;
+    }
+    const char* name = slash + 1;
+    const size_t length = strlen(name);
+    if (length < strlen(suffix) || strcmp(&name[length - strlen(suffix)], suffix) != 0) {
+        return;
+    }
+    /* back over "-dir.profile" and "-D" to the hash */
+    const char* tail = &name[length - strlen(suffix)];
+    int dashes = 0;
+    while (tail > name && dashes < 2) {
+        if (*--tail == '-') {
+            dashes++;
+        }
+    }
+    if (dashes < 2 || tail - name < 9 || tail[-9] != '-') {
+        return;
+    }
+    const size_t hash_offset = tail - name - 8;
+
+    char dir_path[PATH_MAX];
+    if ((size_t)(slash - path) >= sizeof(dir_path)) {
+        return;
+    }
+    memcpy(dir_path, path, slash - path);
+    dir_path[slash - path] = '\0';
+    DIR* dir = opendir(dir_path);
+    if (dir == NULL) {
+        return;
+    }
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        const char* other = entry->d_name;
+        if (strlen(other) != length || strcmp(other, name) == 0
+                || strncmp(other, name, hash_offset) != 0
+                || strcmp(&other[hash_offset + 8], &name[hash_offset + 8]) != 0
+                || strspn(&other[hash_offset], "0123456789abcdef") < 8) {
+            continue;
+        }
+        if (unlinkat(dirfd(dir), other, 0) == 0) {
+            ALOGV("profile_remove_stale_caches() removed %s", other);
+        }
+    }
+    closedir(dir);
+}
+
+bool profile_read_device_info_cached(alsa_device_profile* profile, const char* cache_dir)
+{
+    char path[PATH_MAX];
+    uint32_t descriptor_hash;
+
+    if (!profile_is_initialized(profile)) {
+        return false;
+    }
+    if (!profile_get_cache_path(profile, cache_dir, path, sizeof(path), &descriptor_hash)) {
+        return profile_read_device_info(profile);
+    }
+
+    if (profile_read_cache(profile, path, descriptor_hash)) {
+        ALOGV("profile_read_device_info_cached() loaded %s", path);
+        return true;
+    }
+
+    if (!profile_read_device_info(profile)) {
+        return false;
+    }
+    profile_write_cache(profile, path, descriptor_hash);
+    profile_remove_stale_caches(path);
+    return true;
+}
+
+bool profile_refresh_cache(alsa_device_profile* profile, const char* cache_dir)
+{
+    char path[PATH_MAX];
+    uint32_t descriptor_hash;
+    profile_cache_entry before;
+    profile_cache_entry after;
+
+    if (!profile_is_initialized(profile)) {
+        return false;
+    }
+    profile_to_cache_entry(profile, 0, &before);
+    if (!profile_read_device_info(profile)) {
+        return false;
+    }
+    profile_to_cache_entry(profile, 0, &after);
+    if (profile_get_cache_path(profile, cache_dir, path, sizeof(path), &descriptor_hash)) {
+        profile_write_cache(profile, path, descriptor_hash);
+        profile_remove_stale_caches(path);
+    }
+    return memcmp(&before, &after, sizeof(before)) != 0;
+}
+
+/*
+ * Parallel probing
+ */
+typedef struct {
+    alsa_device_profile* const* profiles;
+    size_t count;
+    const char* cache_dir;
+    profile_read_callback on_complete;
+    void* cookie;
+
+    pthread_mutex_t lock;
+    size_t next;        /* index of the next profile to read, protected by lock */
+    size_t num_valid;   /* protected by lock */
+} profile_probe_work;
+
+static void* profile_probe_worker(void* arg)
+{
+    profile_probe_work* work = arg;
+
+    for (;;) {
+        pthread_mutex_lock(&work->lock);
+        size_t index = work->next < work->count ? work->next++ : work->count;
+        pthread_mutex_unlock(&work->lock);
+        if (index == work->count) {
+            break;
+        }
+
+        alsa_device_profile* profile = work->profiles[index];
+        bool valid = profile_read_device_info_cached(profile, work->cache_dir);
+        if (valid) {
+            pthread_mutex_lock(&work->lock);
+            work->num_valid++;
+            pthread_mutex_unlock(&work->lock);
+        }
+        if (work->on_complete != NULL) {
+            work->on_complete(profile, valid, work->cookie);
+        }
+    }
+    return NULL;
+}
+
+size_t profile_read_device_info_parallel(alsa_device_profile* const profiles[], size_t count,
+                                         unsigned max_threads, const char* cache_dir,
+                                         profile_read_callback on_complete, void* cookie)
+{
+    profile_probe_work work = {
+        .profiles = profiles,
+        .count = count,
+        .cache_dir = cache_dir,
+        .on_complete = on_complete,
+        .cookie = cookie,
+        .next = 0,
+        .num_valid = 0,
+    };
+    pthread_t threads[8];
+    size_t num_threads = 0;
+
+    pthread_mutex_init(&work.lock, NULL);
+
+    /* the caller is one of the workers, so the work is done even if no thread starts */
+    size_t max_extra = max_threads > 1 ? max_threads - 1 : 0;
+    if (max_extra > ARRAY_SIZE(threads)) {
+        max_extra = ARRAY_SIZE(threads);
+    }
+    if (max_extra > count - (count != 0)) {
+        max_extra = count - (count != 0);
+    }
+    while (num_threads < max_extra
+            && pthread_create(&threads[num_threads], NULL, profile_probe_worker, &work) == 0) {
+        num_threads++;
+    }
+    profile_probe_worker(&work);
+    while (num_threads > 0) {
+        pthread_join(threads[--num_threads], NULL);
+    }
+
+    pthread_mutex_destroy(&work.lock);
+    return work.num_valid;
+}
+
+static void profile_build_sample_rate_strs(const alsa_device_profile* profile, char* buffer)
 {
     /* if we assume that rate strings are about 5 characters (48000 is 5), plus ~1 for a
      * delimiter "|" this buffer has room for about 22 rate strings which seems like
-     * way too much, but it's a stack variable so only temporary.
+     * way too much.
      */
-    char buffer[128];
     buffer[0] = '\0';
-    size_t buffSize = ARRAY_SIZE(buffer);
+    size_t buffSize = PROFILE_SAMPLE_RATE_STRS_SIZE;
     size_t curStrLen = 0;
 
     char numBuffer[32];
@@ -447,19 +874,16 @@ char * profile_get_sample_rate_strs(alsa_device_profile* profile)
         }
         curStrLen = strlcat(buffer, numBuffer, buffSize);
     }
-
-    return strdup(buffer);
 }
 
-char * profile_get_format_strs(alsa_device_profile* profile)
+static void profile_build_format_strs(const alsa_device_profile* profile, char* buffer)
 {
     /* if we assume that format strings are about 24 characters (AUDIO_FORMAT_PCM_16_BIT is 23),
      * plus ~1 for a delimiter "|" this buffer has room for about 10 format strings which seems
-     *  like way too much, but it's a stack variable so only temporary.
+     *  like way too much.
      */
-    char buffer[256];
     buffer[0] = '\0';
-    size_t buffSize = ARRAY_SIZE(buffer);
+    size_t buffSize = PROFILE_FORMAT_STRS_SIZE;
     size_t curStrLen = 0;
 
     size_t numEntries = 0;
@@ -478,11 +902,9 @@ char * profile_get_format_strs(alsa_device_profile* profile)
         }
         curStrLen = strlcat(buffer, format_string_map[profile->formats[index]], buffSize);
     }
-
-    return strdup(buffer);
 }
 
-char * profile_get_channel_count_strs(alsa_device_profile* profile)
+static void profile_build_channel_count_strs(const alsa_device_profile* profile, char* buffer)
 {
     // FIXME implicit fixed channel count assumption here (FCC_8).
     // we use only the canonical even number channel position masks.
@@ -528,9 +950,8 @@ char * profile_get_channel_count_strs(alsa_device_profile* profile)
      * If we assume each channel string is 26 chars ("AUDIO_CHANNEL_INDEX_MASK_8" is 26) + 1 for,
      * the "|" delimiter, then we allocate room for 16 strings.
      */
-    char buffer[27 * 16 + 1]; /* caution, may need to be expanded */
     buffer[0] = '\0';
-    size_t buffSize = ARRAY_SIZE(buffer);
+    size_t buffSize = PROFILE_CHANNEL_COUNT_STRS_SIZE; /* caution, may need to be expanded */
     size_t curStrLen = 0;
 
     /* We currently support MONO and STEREO, and always report STEREO but some (many)
@@ -578,7 +999,58 @@ char * profile_get_channel_count_strs(alsa_device_profile* profile)
          strlcat(buffer, "|", buffSize);
          curStrLen = strlcat(buffer, index_chans_strs[channel_count], buffSize);
     }
+}
+
+/*
+ * Builds the capability masks and strings from the attribute arrays.
+ */
+static void profile_update_capabilities(alsa_device_profile* profile)
+{
+    size_t index;
+
+    profile->format_mask = 0;
+    for (index = 0; index < MAX_PROFILE_FORMATS && profile->formats[index] != PCM_FORMAT_INVALID;
+            index++) {
+        profile->format_mask |= format_bit(profile->formats[index]);
+    }
+    profile->sample_rate_mask = 0;
+    for (index = 0; index < MAX_PROFILE_SAMPLE_RATES && profile->sample_rates[index] != 0;
+            index++) {
+        profile->sample_rate_mask |= sample_rate_bit(profile->sample_rates[index]);
+    }
+
+    profile_build_sample_rate_strs(profile, profile->sample_rate_strs);
+    profile_build_format_strs(profile, profile->format_strs);
+    profile_build_channel_count_strs(profile, profile->channel_count_strs);
+}
+
+char * profile_get_sample_rate_strs(alsa_device_profile* profile)
+{
+    if (profile_is_valid(profile)) {
+        return strdup(profile->sample_rate_strs);
+    }
+    char buffer[PROFILE_SAMPLE_RATE_STRS_SIZE];
+    profile_build_sample_rate_strs(profile, buffer);
+    return strdup(buffer);
+}
 
+char * profile_get_format_strs(alsa_device_profile* profile)
+{
+    if (profile_is_valid(profile)) {
+        return strdup(profile->format_strs);
+    }
+    char buffer[PROFILE_FORMAT_STRS_SIZE];
+    profile_build_format_strs(profile, buffer);
+    return strdup(buffer);
+}
+
+char * profile_get_channel_count_strs(alsa_device_profile* profile)
+{
+    if (profile_is_valid(profile)) {
+        return strdup(profile->channel_count_strs);
+    }
+    char buffer[PROFILE_CHANNEL_COUNT_STRS_SIZE];
+    profile_build_channel_count_strs(profile, buffer);
     return strdup(buffer);
 }
 
@@ -626,6 +1098,8 @@ void profile_dump(const alsa_device_profile* profile, int fd)
 
     dprintf(fd, "  min/max period size [%u : %u]\n",
             profile->min_period_size,profile-> max_period_size);
+    dprintf(fd, "  min/max period count [%u : %u]\n",
+            profile->min_period_count, profile->max_period_count);
     dprintf(fd, "  min/max channel count [%u : %u]\n",
             profile->min_channel_count, profile->max_channel_count);
 
@@ -21,6 +21,8 @@
 #include <log/log.h>
 
 #include <errno.h>
+#include <string.h>
+#include <time.h>
 
 #include "include/alsa_device_proxy.h"
 
@@ -29,6 +31,9 @@
 #define DEFAULT_PERIOD_SIZE     1024
 #define DEFAULT_PERIOD_COUNT    2
 
+/* how old the last measurement may be before the tracked position takes a new one */
+#define TRACKER_REFRESH_NS      (50 * 1000000LL)
+
 #define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
 
 static const unsigned format_byte_size_map[] = {
@@ -44,6 +49,9 @@ void proxy_prepare(alsa_device_proxy * proxy, alsa_device_profile* profile,
 {
     ALOGV("proxy_prepare(c:%d, d:%d)", profile->card, profile->device);
 
+    /* the proxy may not be initialized, so there is no conversion to release */
+    proxy->adapter = NULL;
+    proxy->adapter_pending = 0;
     proxy->profile = profile;
 
 #ifdef LOG_PCM_PARAMS
@@ -85,7 +93,12 @@ void proxy_prepare(alsa_device_proxy * proxy, alsa_device_profile* profile,
         proxy->alsa_config.period_count = 4;
     }
 
+    proxy->alsa_config.avail_min = 0;
+
     proxy->pcm = NULL;
+    proxy->flags = 0;
+    timestamp_tracker_init(&proxy->tracker, proxy->alsa_config.rate);
+    proxy->tracked_frames = 0;
     // config format should be checked earlier against profile.
     if (config->format >= 0 && (size_t)config->format < ARRAY_SIZE(format_byte_size_map)) {
         proxy->frame_size = format_byte_size_map[config->format] * proxy->alsa_config.channels;
@@ -94,18 +107,87 @@ void proxy_prepare(alsa_device_proxy * proxy, alsa_device_profile* profile,
     }
 }
 
+unsigned int proxy_prepare_for_latency(alsa_device_proxy * proxy, alsa_device_profile * profile,
+                                       struct pcm_config * config, unsigned int latency_us)
+{
+    proxy_prepare(proxy, profile, config);
+
+    const unsigned int rate = proxy->alsa_config.rate;
+    const unsigned int frames = ((uint64_t)rate * latency_us + 999999) / 1000000;
+
+    unsigned int period_count = profile->min_period_count > 2 ? profile->min_period_count : 2;
+    if (profile->max_period_count != 0 && period_count > profile->max_period_count) {
+        period_count = profile->max_period_count;
+    }
+
+    /* a multiple of 16 frames, as profile_get_period_size() gives, within the device limits */
+    unsigned int period_size = ((frames + period_count - 1) / period_count + 15) & ~15;
+    if (period_size < profile->min_period_size) {
+        period_size = profile->min_period_size;
+    }
+    if (profile->max_period_size != 0 && period_size > profile->max_period_size) {
+        period_size = profile->max_period_size;
+        /* the longest periods are too short, so use more of them */
+        while ((uint64_t)period_size * period_count < frames
+                && (profile->max_period_count == 0 || period_count < profile->max_period_count)) {
+            period_count++;
+        }
+    }
+    if (period_size == 0) {
+        period_size = profile_get_period_size(profile, rate);
+    }
+
+    proxy->alsa_config.period_size = period_size;
+    proxy->alsa_config.period_count = period_count;
+    ALOGV("proxy_prepare_for_latency(%u us) period_size:%u period_count:%u",
+          latency_us, period_size, period_count);
+
+    return (uint64_t)period_size * period_count * 1000000 / rate;
+}
+
 int proxy_open(alsa_device_proxy * proxy)
+{
+    return proxy_open_with_flags(proxy, 0);
+}
+
+int proxy_open_with_flags(alsa_device_proxy * proxy, unsigned int flags)
 {
     alsa_device_profile* profile = proxy->profile;
-    ALOGV("proxy_open(card:%d device:%d %s)", profile->card, profile->device,
-          profile->direction == PCM_OUT ? "PCM_OUT" : "PCM_IN");
+    ALOGV("proxy_open(card:%d device:%d %s flags:%#x)", profile->card, profile->device,
+          profile->direction == PCM_OUT ? "PCM_OUT" : "PCM_IN", flags);
 
     if (profile->card < 0 || profile->device < 0) {
         return -EINVAL;
     }
+    if ((flags & PROXY_OPEN_NOIRQ) && !(flags & PROXY_OPEN_MMAP)) {
+        return -EINVAL;
+    }
+    if (flags & PROXY_OPEN_NONBLOCK) {
+        flags |= PROXY_OPEN_MMAP;
+    }
 
-    proxy->pcm = pcm_open(profile->card, profile->device,
-            profile->direction | PCM_MONOTONIC, &proxy->alsa_config);
+    unsigned int pcm_flags = profile->direction | PCM_MONOTONIC;
+    if (flags & PROXY_OPEN_MMAP) {
+        pcm_flags |= PCM_MMAP;
+    } else {
+        /* pcm_write() and pcm_read() would otherwise recover from xruns without saying so */
+        pcm_flags |= PCM_NORESTART;
+    }
+    if (flags & PROXY_OPEN_NOIRQ) {
+        proxy->pcm = pcm_open(profile->card, profile->device, pcm_flags | PCM_NOIRQ,
+                &proxy->alsa_config);
+        if (proxy->pcm != NULL && !pcm_is_ready(proxy->pcm)) {
+            ALOGW("  proxy_open() PCM_NOIRQ not supported: %s", pcm_get_error(proxy->pcm));
+            pcm_close(proxy->pcm);
+            proxy->pcm = NULL;
+            flags &= ~PROXY_OPEN_NOIRQ;
+        } else {
+            pcm_flags |= PCM_NOIRQ;
+        }
+    }
+    if (!(pcm_flags & PCM_NOIRQ)) {
+        proxy->pcm = pcm_open(profile->card, profile->device, pcm_flags, &proxy->alsa_config);
+    }
     if (proxy->pcm == NULL) {
         return -ENOMEM;
     }
@@ -120,6 +202,13 @@ int proxy_open(alsa_device_proxy * proxy)
         return -ENOMEM;
     }
 
+    proxy->flags = flags;
+    proxy->mmap_started = false;
+    timestamp_tracker_reset(&proxy->tracker);
+    if (proxy->adapter != NULL) {
+        adapter_reset(proxy->adapter);
+        proxy->adapter_pending = 0;
+    }
     return 0;
 }
 
@@ -131,6 +220,52 @@ void proxy_close(alsa_device_proxy * proxy)
         pcm_close(proxy->pcm);
         proxy->pcm = NULL;
     }
+    proxy->flags = 0;
+    timestamp_tracker_reset(&proxy->tracker);
+    proxy_clear_client_config(proxy);
+}
+
+/*
+ * Client config
+ */
+int proxy_set_client_config(alsa_device_proxy * proxy, audio_format_t format, unsigned channels,
+                            unsigned rate, size_t max_frames)
+{
+    proxy_clear_client_config(proxy);
+
+    const alsa_adapter_config client = { format, channels, rate };
+    const alsa_adapter_config device = {
+        audio_format_from_pcm_format(proxy->alsa_config.format),
+        proxy->alsa_config.channels,
+        proxy->alsa_config.rate,
+    };
+    if (client.format == device.format && client.channels == device.channels
+            && client.rate == device.rate) {
+        return 0;
+    }
+
+    int ret;
+    if (proxy->profile->direction == PCM_OUT) {
+        ret = adapter_create(&client, &device, max_frames, &proxy->adapter);
+    } else {
+        const size_t max_device_frames = (uint64_t)max_frames * device.rate / client.rate + 1;
+        ret = adapter_create(&device, &client, max_device_frames, &proxy->adapter);
+    }
+    if (ret != 0) {
+        ALOGE("proxy_set_client_config() can't convert %#x/%u/%u to %#x/%u/%u: %d",
+              client.format, client.channels, client.rate,
+              device.format, device.channels, device.rate, ret);
+        return ret;
+    }
+    proxy->client_config = client;
+    return 0;
+}
+
+void proxy_clear_client_config(alsa_device_proxy * proxy)
+{
+    adapter_destroy(proxy->adapter);
+    proxy->adapter = NULL;
+    proxy->adapter_pending = 0;
 }
 
 /*
@@ -201,21 +336,365 @@ int proxy_get_presentation_position(const alsa_device_proxy * proxy,
     return ret;
 }
 
+int proxy_get_tracked_presentation_position(alsa_device_proxy * proxy,
+        uint64_t *frames, struct timespec *timestamp)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    const int64_t now_ns = now.tv_sec * 1000000000LL + now.tv_nsec;
+
+    const int64_t last_ns = timestamp_tracker_get_last_time_ns(&proxy->tracker);
+    if (last_ns < 0 || now_ns - last_ns > TRACKER_REFRESH_NS) {
+        uint64_t measured;
+        struct timespec measured_time;
+        if (proxy_get_presentation_position(proxy, &measured, &measured_time) == 0) {
+            timestamp_tracker_add(&proxy->tracker, measured, &measured_time);
+        } else if (last_ns < 0) {
+            return -EPERM;
+        }
+    }
+
+    int64_t position;
+    if (timestamp_tracker_get_position(&proxy->tracker, &now, &position) != 0) {
+        return -EPERM;
+    }
+    /* the model can't run ahead of what was written, nor back behind what it said before */
+    if (position > (int64_t)proxy->transferred) {
+        position = proxy->transferred;
+    }
+    if (position < (int64_t)proxy->tracked_frames) {
+        position = proxy->tracked_frames;
+    }
+    proxy->tracked_frames = position;
+    *frames = position;
+    *timestamp = now;
+    return 0;
+}
+
+int proxy_get_drift_ppm(const alsa_device_proxy * proxy, double *ppm)
+{
+    return timestamp_tracker_get_drift_ppm(&proxy->tracker, ppm);
+}
+
 /*
  * I/O
  */
-int proxy_write(alsa_device_proxy * proxy, const void *data, unsigned int count)
+static int64_t proxy_now_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+/*
+ * Account for a transfer started at start_ns, which returned ret.
+ */
+static void proxy_update_stats(alsa_device_proxy * proxy, int64_t start_ns, int ret)
+{
+    proxy_stats * stats = &proxy->stats;
+    const int64_t now_ns = proxy_now_ns();
+
+    stats->transfers++;
+    if (ret < 0 && ret != -EAGAIN) {
+        stats->errors++;
+        if (ret == -EPIPE) {
+            stats->xruns++;
+        }
+        if (stats->error_time_ns == 0) {
+            stats->error_time_ns = now_ns;
+        }
+    } else if (ret >= 0 && stats->error_time_ns != 0) {
+        const uint64_t recovery_ns = now_ns - stats->error_time_ns;
+        stats->recoveries++;
+        stats->recovery_ns_total += recovery_ns;
+        if (recovery_ns > stats->recovery_ns_max) {
+            stats->recovery_ns_max = recovery_ns;
+        }
+        stats->error_time_ns = 0;
+    }
+
+    /* bucket 0 is under 0.5 ms, each next one twice as long */
+    int64_t limit_ns = 500000;
+    unsigned int bucket = 0;
+    while (bucket < PROXY_LATENCY_BUCKETS - 1 && now_ns - start_ns >= limit_ns) {
+        limit_ns *= 2;
+        bucket++;
+    }
+    stats->latency_histogram[bucket]++;
+}
+static int proxy_write_device(alsa_device_proxy * proxy, const void *data, unsigned int count)
 {
-    int ret = pcm_write(proxy->pcm, data, count);
+    const int64_t start_ns = proxy_now_ns();
+    int ret;
+    if (proxy->flags & PROXY_OPEN_MMAP) {
+        ret = pcm_mmap_write(proxy->pcm, data, count);
+        if (ret > 0) {
+            ret = 0;
+        }
+    } else {
+        ret = pcm_write(proxy->pcm, data, count);
+        if (ret == -EPIPE) {
+            /* count the underrun, then restart as tinyalsa would without PCM_NORESTART */
+            proxy->stats.xruns++;
+            ret = pcm_write(proxy->pcm, data, count);
+        }
+    }
     if (ret == 0) {
         proxy->transferred += count / proxy->frame_size;
     }
+    proxy_update_stats(proxy, start_ns, ret);
+    return ret;
+}
+
+static int proxy_read_device(alsa_device_proxy * proxy, void *data, unsigned int count)
+{
+    const int64_t start_ns = proxy_now_ns();
+    int ret;
+    if (proxy->flags & PROXY_OPEN_MMAP) {
+        ret = pcm_mmap_read(proxy->pcm, data, count);
+        if (ret > 0) {
+            ret = 0;
+        }
+    } else {
+        ret = pcm_read(proxy->pcm, data, count);
+        if (ret == -EPIPE) {
+            proxy->stats.xruns++;
+            ret = pcm_read(proxy->pcm, data, count);
+        }
+    }
+    proxy_update_stats(proxy, start_ns, ret);
+    return ret;
+}
+
+int proxy_write(alsa_device_proxy * proxy, const void *data, unsigned int count)
+{
+    if (proxy->adapter == NULL) {
+        return proxy_write_device(proxy, data, count);
+    }
+
+    const size_t frame_size = adapter_get_src_frame_size(proxy->adapter);
+    const size_t max_frames = adapter_get_max_src_frames(proxy->adapter);
+    const char *in = data;
+    size_t frames = count / frame_size;
+    while (frames > 0) {
+        const size_t chunk = frames < max_frames ? frames : max_frames;
+        const void *out;
+        const size_t out_frames = adapter_process(proxy->adapter, in, chunk, &out);
+        if (out_frames > 0) {
+            int ret = proxy_write_device(proxy, out,
+                    out_frames * adapter_get_dst_frame_size(proxy->adapter));
+            if (ret != 0) {
+                return ret;
+            }
+        }
+        in += chunk * frame_size;
+        frames -= chunk;
+    }
+    return 0;
+}
+
+int proxy_read(alsa_device_proxy * proxy, void *data, unsigned int count)
+{
+    if (proxy->adapter == NULL) {
+        return proxy_read_device(proxy, data, count);
+    }
+
+    const size_t frame_size = adapter_get_dst_frame_size(proxy->adapter);
+    char *out = data;
+    size_t frames = count / frame_size;
+    while (frames > 0) {
+        if (proxy->adapter_pending == 0) {
+            /* read about what converts to the frames still wanted */
+            size_t device_frames = ((uint64_t)frames * proxy->alsa_config.rate
+                    + proxy->client_config.rate - 1) / proxy->client_config.rate;
+            if (device_frames > adapter_get_max_src_frames(proxy->adapter)) {
+                device_frames = adapter_get_max_src_frames(proxy->adapter);
+            }
+            void *in = adapter_get_src_buffer(proxy->adapter);
+            int ret = proxy_read_device(proxy, in,
+                    device_frames * adapter_get_src_frame_size(proxy->adapter));
+            if (ret != 0) {
+                return ret;
+            }
+            const void *converted;
+            proxy->adapter_pending = adapter_process(proxy->adapter, in, device_frames,
+                                                     &converted);
+            proxy->adapter_pending_data = converted;
+        }
+        const size_t chunk = frames < proxy->adapter_pending ? frames : proxy->adapter_pending;
+        memcpy(out, proxy->adapter_pending_data, chunk * frame_size);
+        proxy->adapter_pending_data += chunk * frame_size;
+        proxy->adapter_pending -= chunk;
+        out += chunk * frame_size;
+        frames -= chunk;
+    }
+    return 0;
+}
+
+int proxy_mmap_begin(alsa_device_proxy * proxy, void **buffer, unsigned int *frames)
+{
+    if (proxy->pcm == NULL || !(proxy->flags & PROXY_OPEN_MMAP)) {
+        return -EINVAL;
+    }
+
+    /* an overrun or underrun leaves more than the buffer available, and needs a restart */
+    int avail = pcm_mmap_avail(proxy->pcm);
+    if (avail < 0) {
+        return avail;
+    }
+    if ((unsigned int)avail > pcm_get_buffer_size(proxy->pcm)) {
+        ALOGW("proxy_mmap_begin() xrun, avail %d", avail);
+        proxy->stats.xruns++;
+        int ret = pcm_prepare(proxy->pcm);
+        if (ret < 0) {
+            return ret;
+        }
+        proxy->mmap_started = false;
+    }
+
+    /* capture has to run before there is anything to read */
+    if (proxy->profile->direction == PCM_IN && !proxy->mmap_started) {
+        int ret = pcm_start(proxy->pcm);
+        if (ret < 0) {
+            return ret;
+        }
+        proxy->mmap_started = true;
+    }
+
+    void *areas;
+    int ret = pcm_mmap_begin(proxy->pcm, &areas, &proxy->mmap_offset, frames);
+    if (ret < 0) {
+        return ret;
+    }
+    *buffer = (char *)areas + pcm_frames_to_bytes(proxy->pcm, proxy->mmap_offset);
+    return 0;
+}
+
+int proxy_mmap_commit(alsa_device_proxy * proxy, unsigned int frames)
+{
+    if (proxy->pcm == NULL || !(proxy->flags & PROXY_OPEN_MMAP)) {
+        return -EINVAL;
+    }
+
+    int ret = pcm_mmap_commit(proxy->pcm, proxy->mmap_offset, frames);
+    if (ret < 0) {
+        return ret;
+    }
+    proxy->transferred += frames;
+
+    if (proxy->profile->direction == PCM_OUT && !proxy->mmap_started) {
+        int avail = pcm_mmap_avail(proxy->pcm);
+        if (avail >= 0 && pcm_get_buffer_size(proxy->pcm) - avail
+                >= proxy->alsa_config.period_size) {
+            ret = pcm_start(proxy->pcm);
+            if (ret < 0) {
+                return ret;
+            }
+            proxy->mmap_started = true;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Moves up to frames through the DMA buffer without waiting for room, returns the frames moved.
+ */
+static int proxy_mmap_transfer(alsa_device_proxy * proxy, void *data, unsigned int frames)
+{
+    unsigned int done = 0;
+    while (done < frames) {
+        void *area;
+        unsigned int count = frames - done;
+        int ret = proxy_mmap_begin(proxy, &area, &count);
+        if (ret < 0) {
+            return done > 0 ? (int)done : ret;
+        }
+        if (count == 0) {
+            break;
+        }
+        const unsigned int offset = pcm_frames_to_bytes(proxy->pcm, done);
+        const unsigned int bytes = pcm_frames_to_bytes(proxy->pcm, count);
+        if (proxy->profile->direction == PCM_OUT) {
+            memcpy(area, (char *)data + offset, bytes);
+        } else {
+            memcpy((char *)data + offset, area, bytes);
+        }
+        ret = proxy_mmap_commit(proxy, count);
+        if (ret < 0) {
+            return done > 0 ? (int)done : ret;
+        }
+        done += count;
+    }
+    return done;
+}
+
+static int proxy_transfer_nonblock(alsa_device_proxy * proxy, void *data, unsigned int count)
+{
+    if (proxy->pcm == NULL || !(proxy->flags & PROXY_OPEN_NONBLOCK)) {
+        return -EINVAL;
+    }
+    const int64_t start_ns = proxy_now_ns();
+    const unsigned int frames = pcm_bytes_to_frames(proxy->pcm, count);
+    int ret = proxy_mmap_transfer(proxy, data, frames);
+    if (ret == 0) {
+        ret = -EAGAIN;
+    } else if (ret > 0) {
+        if ((unsigned int)ret < frames) {
+            proxy->stats.short_transfers++;
+        }
+        ret = pcm_frames_to_bytes(proxy->pcm, ret);
+    }
+    proxy_update_stats(proxy, start_ns, ret);
     return ret;
 }
 
-int proxy_read(const alsa_device_proxy * proxy, void *data, unsigned int count)
+int proxy_write_nonblock(alsa_device_proxy * proxy, const void *data, unsigned int count)
+{
+    return proxy_transfer_nonblock(proxy, (void *)data, count);
+}
+
+int proxy_read_nonblock(alsa_device_proxy * proxy, void *data, unsigned int count)
+{
+    return proxy_transfer_nonblock(proxy, data, count);
+}
+
+int proxy_get_poll_fd(const alsa_device_proxy * proxy)
+{
+    return proxy->pcm != NULL ? pcm_get_poll_fd(proxy->pcm) : -EINVAL;
+}
+
+void proxy_set_avail_min(alsa_device_proxy * proxy, unsigned int frames)
+{
+    proxy->alsa_config.avail_min = frames;
+}
+
+int proxy_get_avail(const alsa_device_proxy * proxy)
+{
+    if (proxy->pcm == NULL) {
+        return -EINVAL;
+    }
+    if (proxy->flags & PROXY_OPEN_MMAP) {
+        return pcm_mmap_avail(proxy->pcm);
+    }
+    unsigned int avail;
+    struct timespec timestamp;
+    if (pcm_get_htimestamp(proxy->pcm, &avail, &timestamp) != 0) {
+        return -EPERM;
+    }
+    return avail;
+}
+
+/*
+ * Statistics
+ */
+void proxy_get_stats(const alsa_device_proxy * proxy, proxy_stats * stats)
 {
-    return pcm_read(proxy->pcm, data, count);
+    *stats = proxy->stats;
+}
+
+void proxy_reset_stats(alsa_device_proxy * proxy)
+{
+    memset(&proxy->stats, 0, sizeof(proxy->stats));
 }
 
 /*
@@ -229,5 +708,25 @@ void proxy_dump(const alsa_device_proxy* proxy, int fd)
         dprintf(fd, "  period_size: %d\n", proxy->alsa_config.period_size);
         dprintf(fd, "  period_count: %d\n", proxy->alsa_config.period_count);
         dprintf(fd, "  format: %d\n", proxy->alsa_config.format);
+        dprintf(fd, "  flags: %#x\n", proxy->flags);
+        double ppm;
+        if (proxy_get_drift_ppm(proxy, &ppm) == 0) {
+            dprintf(fd, "  drift: %.1f ppm\n", ppm);
+        }
+
+        const proxy_stats * stats = &proxy->stats;
+        dprintf(fd, "  transfers: %llu errors: %llu xruns: %llu short: %llu\n",
+                (unsigned long long)stats->transfers, (unsigned long long)stats->errors,
+                (unsigned long long)stats->xruns, (unsigned long long)stats->short_transfers);
+        if (stats->recoveries > 0) {
+            dprintf(fd, "  recovery: mean %llu us max %llu us\n",
+                    (unsigned long long)(stats->recovery_ns_total / stats->recoveries / 1000),
+                    (unsigned long long)(stats->recovery_ns_max / 1000));
+        }
+        dprintf(fd, "  latency:");
+        for (unsigned int i = 0; i < PROXY_LATENCY_BUCKETS; i++) {
+            dprintf(fd, " %u", stats->latency_histogram[i]);
+        }
+        dprintf(fd, "\n");
     }
 }
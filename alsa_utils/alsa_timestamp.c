@@ -0,0 +1,150 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "alsa_timestamp"
+/*#define LOG_NDEBUG 0*/
+
+#include <errno.h>
+#include <math.h>
+
+#include <log/log.h>
+
+#include "include/alsa_timestamp.h"
+
+#define NS_PER_SEC 1000000000LL
+
+/* positions further than this from the model are a discontinuity */
+#define MAX_ERROR_MS 5
+
+/* samples spanning less than this don't give a useful drift estimate */
+#define MIN_DRIFT_SPAN_NS (500 * 1000000LL)
+
+static int64_t timespec_to_ns(const struct timespec * timestamp)
+{
+    return timestamp->tv_sec * NS_PER_SEC + timestamp->tv_nsec;
+}
+
+void timestamp_tracker_init(alsa_timestamp_tracker * tracker, unsigned sample_rate)
+{
+    tracker->sample_rate = sample_rate;
+    timestamp_tracker_reset(tracker);
+}
+
+void timestamp_tracker_reset(alsa_timestamp_tracker * tracker)
+{
+    tracker->count = 0;
+    tracker->next = 0;
+    tracker->base_time_ns = 0;
+    tracker->base_frames = 0;
+    tracker->rate = tracker->sample_rate;
+}
+
+/*
+ * Least squares fit of the samples, relative to the newest one to keep the sums small.
+ */
+static void timestamp_tracker_fit(alsa_timestamp_tracker * tracker)
+{
+    const unsigned newest = (tracker->next + TIMESTAMP_TRACKER_SAMPLES - 1)
+            % TIMESTAMP_TRACKER_SAMPLES;
+    double sum_x = 0, sum_y = 0, sum_xx = 0, sum_xy = 0;
+    unsigned i;
+
+    tracker->base_time_ns = tracker->time_ns[newest];
+    tracker->base_frames = tracker->frames[newest];
+    tracker->rate = tracker->sample_rate;
+    if (tracker->count < 2) {
+        return;
+    }
+
+    for (i = 0; i < tracker->count; i++) {
+        const double x = (double)(tracker->time_ns[i] - tracker->base_time_ns) / NS_PER_SEC;
+        const double y = (double)(tracker->frames[i] - tracker->frames[newest]);
+        sum_x += x;
+        sum_y += y;
+        sum_xx += x * x;
+        sum_xy += x * y;
+    }
+    const double n = tracker->count;
+    const double denominator = n * sum_xx - sum_x * sum_x;
+    /* samples too close together in time give no rate */
+    if (denominator <= 1e-12 * n * n) {
+        return;
+    }
+    tracker->rate = (n * sum_xy - sum_x * sum_y) / denominator;
+    tracker->base_frames += (sum_y - tracker->rate * sum_x) / n;
+}
+
+bool timestamp_tracker_add(alsa_timestamp_tracker * tracker, int64_t frames,
+                           const struct timespec * timestamp)
+{
+    const int64_t time_ns = timespec_to_ns(timestamp);
+    bool continuous = true;
+
+    if (tracker->count > 0) {
+        const int64_t last_time_ns = timestamp_tracker_get_last_time_ns(tracker);
+        const double predicted = tracker->base_frames
+                + tracker->rate * (time_ns - tracker->base_time_ns) / NS_PER_SEC;
+        if (time_ns < last_time_ns || fabs(frames - predicted)
+                > (double)tracker->sample_rate * MAX_ERROR_MS / 1000) {
+            ALOGV("timestamp_tracker_add() discontinuity of %.0f frames", frames - predicted);
+            timestamp_tracker_reset(tracker);
+            continuous = false;
+        }
+    }
+
+    tracker->time_ns[tracker->next] = time_ns;
+    tracker->frames[tracker->next] = frames;
+    tracker->next = (tracker->next + 1) % TIMESTAMP_TRACKER_SAMPLES;
+    if (tracker->count < TIMESTAMP_TRACKER_SAMPLES) {
+        tracker->count++;
+    }
+    timestamp_tracker_fit(tracker);
+    return continuous;
+}
+
+int64_t timestamp_tracker_get_last_time_ns(const alsa_timestamp_tracker * tracker)
+{
+    if (tracker->count == 0) {
+        return -1;
+    }
+    return tracker->time_ns[(tracker->next + TIMESTAMP_TRACKER_SAMPLES - 1)
+            % TIMESTAMP_TRACKER_SAMPLES];
+}
+
+int timestamp_tracker_get_position(const alsa_timestamp_tracker * tracker,
+                                   const struct timespec * timestamp, int64_t * frames)
+{
+    if (tracker->count == 0) {
+        return -EAGAIN;
+    }
+    *frames = llround(tracker->base_frames + tracker->rate
+            * (timespec_to_ns(timestamp) - tracker->base_time_ns) / NS_PER_SEC);
+    return 0;
+}
+
+int timestamp_tracker_get_drift_ppm(const alsa_timestamp_tracker * tracker, double * ppm)
+{
+    /* with a full ring, the oldest sample is the next one to be replaced */
+    const unsigned oldest = tracker->count < TIMESTAMP_TRACKER_SAMPLES ? 0 : tracker->next;
+
+    if (tracker->count < 3 || tracker->sample_rate == 0 ||
+            timestamp_tracker_get_last_time_ns(tracker) - tracker->time_ns[oldest]
+                    < MIN_DRIFT_SPAN_NS) {
+        return -EAGAIN;
+    }
+    *ppm = (tracker->rate / tracker->sample_rate - 1.) * 1e6;
+    return 0;
+}
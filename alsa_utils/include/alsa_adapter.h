@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SYSTEM_MEDIA_ALSA_UTILS_ALSA_ADAPTER_H
+#define ANDROID_SYSTEM_MEDIA_ALSA_UTILS_ALSA_ADAPTER_H
+
+#include <stddef.h>
+
+#include <system/audio.h>
+
+#include <tinyalsa/asoundlib.h>
+
+/*
+ * Converts interleaved audio between two combinations of sample format, channel count and
+ * sample rate, e.g. between what a HAL stream was asked for and what the device supports.
+ * The stages needed are chosen and their buffers allocated once, at creation.
+ */
+typedef struct alsa_adapter alsa_adapter;
+
+typedef struct {
+    audio_format_t format;
+    unsigned channels;
+    unsigned rate;
+} alsa_adapter_config;
+
+/* Returns the audio format of a pcm format, or AUDIO_FORMAT_INVALID */
+audio_format_t audio_format_from_pcm_format(enum pcm_format format);
+
+/*
+ * Creates an adapter processing at most max_src_frames per adapter_process().
+ * Returns 0, -EINVAL if a conversion isn't supported, or -ENOMEM.
+ */
+int adapter_create(const alsa_adapter_config * src, const alsa_adapter_config * dst,
+                   size_t max_src_frames, alsa_adapter ** adapter);
+void adapter_destroy(alsa_adapter * adapter);
+
+/* Clears the resampler history, e.g. after standby */
+void adapter_reset(alsa_adapter * adapter);
+
+/*
+ * Converts frames of src, at most max_src_frames.  *dst is set to the converted frames in
+ * a buffer of the adapter, valid until the next call, and their number is returned.
+ */
+size_t adapter_process(alsa_adapter * adapter, const void * src, size_t frames,
+                       const void ** dst);
+
+/* A buffer of max_src_frames in the source format, for callers which fill it in place */
+void * adapter_get_src_buffer(alsa_adapter * adapter);
+
+size_t adapter_get_src_frame_size(const alsa_adapter * adapter);
+size_t adapter_get_dst_frame_size(const alsa_adapter * adapter);
+size_t adapter_get_max_src_frames(const alsa_adapter * adapter);
+
+#endif /* ANDROID_SYSTEM_MEDIA_ALSA_UTILS_ALSA_ADAPTER_H */
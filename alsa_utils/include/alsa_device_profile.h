@@ -18,6 +18,7 @@
 #define ANDROID_SYSTEM_MEDIA_ALSA_UTILS_ALSA_DEVICE_PROFILE_H
 
 #include <stdbool.h>
+#include <stdint.h>
 
 #include <tinyalsa/asoundlib.h>
 
@@ -31,6 +32,11 @@
                                         * standard channel formats in std_channel_counts[]
                                         * (in alsa_device_profile.c) */
 
+/* sizes of the capability strings kept in the profile */
+#define PROFILE_SAMPLE_RATE_STRS_SIZE   128
+#define PROFILE_FORMAT_STRS_SIZE        256
+#define PROFILE_CHANNEL_COUNT_STRS_SIZE (27 * 16 + 1)
+
 #define DEFAULT_SAMPLE_RATE         44100
 #define DEFAULT_SAMPLE_FORMAT       PCM_FORMAT_S16_LE
 #define DEFAULT_CHANNEL_COUNT       2
@@ -54,8 +60,21 @@ typedef struct  {
     unsigned min_period_size;
     unsigned max_period_size;
 
+    unsigned min_period_count;
+    unsigned max_period_count;
+
     unsigned min_channel_count;
     unsigned max_channel_count;
+
+    /*
+     * Built from the arrays above when the profile becomes valid, so the queries below
+     * don't have to scan them or format strings each time.
+     */
+    uint32_t format_mask;       /* bit n set for enum pcm_format n */
+    uint32_t sample_rate_mask;  /* bit n set for entry n of the standard rates */
+    char sample_rate_strs[PROFILE_SAMPLE_RATE_STRS_SIZE];
+    char format_strs[PROFILE_FORMAT_STRS_SIZE];
+    char channel_count_strs[PROFILE_CHANNEL_COUNT_STRS_SIZE];
 } alsa_device_profile;
 
 void profile_init(alsa_device_profile* profile, int direction);
@@ -66,6 +85,30 @@ void profile_decache(alsa_device_profile* profile);
 
 bool profile_read_device_info(alsa_device_profile* profile);
 
+/*
+ * Persisted profile cache for USB devices, one file in cache_dir per device, keyed by the
+ * USB vendor and product id and a hash of the stream descriptors the kernel reports.
+ * Writing the file of a device removes those written for its previous descriptors.
+ * profile_read_device_info_cached() fills in the profile from the cache if the device is
+ * known, without opening it, and otherwise reads the device and caches what it finds.
+ * profile_refresh_cache() reads the device again and updates the cache, and is meant to be
+ * called when the device is idle, e.g. from a background thread after the first playback;
+ * it returns true if the profile changed.
+ */
+bool profile_read_device_info_cached(alsa_device_profile* profile, const char* cache_dir);
+bool profile_refresh_cache(alsa_device_profile* profile, const char* cache_dir);
+
+/*
+ * Reads the device info of several initialized profiles concurrently, e.g. for all the
+ * cards of a dock at hotplug, on up to max_threads threads including the caller's.
+ * on_complete, if not NULL, is called on a worker thread as each profile is done, with its
+ * result.  Returns the number of valid profiles when all are done.
+ */
+typedef void (*profile_read_callback)(alsa_device_profile* profile, bool valid, void* cookie);
+size_t profile_read_device_info_parallel(alsa_device_profile* const profiles[], size_t count,
+                                         unsigned max_threads, const char* cache_dir,
+                                         profile_read_callback on_complete, void* cookie);
+
 /* Audio Config Strings Methods */
 char * profile_get_sample_rate_strs(alsa_device_profile* profile);
 char * profile_get_format_strs(alsa_device_profile* profile);
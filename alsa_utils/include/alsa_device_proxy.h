@@ -19,7 +19,32 @@
 
 #include <tinyalsa/asoundlib.h>
 
+#include "alsa_adapter.h"
 #include "alsa_device_profile.h"
+#include "alsa_timestamp.h"
+
+/* proxy_open_with_flags() flags */
+#define PROXY_OPEN_MMAP     0x1 /* map the DMA buffer, see proxy_mmap_begin() */
+#define PROXY_OPEN_NOIRQ    0x2 /* with PROXY_OPEN_MMAP, ask for no period interrupts,
+                                 * the caller then schedules its transfers by time */
+#define PROXY_OPEN_NONBLOCK 0x4 /* for proxy_write_nonblock() and proxy_read_nonblock(),
+                                 * implies PROXY_OPEN_MMAP */
+
+/* buckets of proxy_stats.latency_histogram, for transfers taking < 0.5, 1, 2 ... 32 ms and more */
+#define PROXY_LATENCY_BUCKETS 8
+
+/* Transfer statistics, not cleared on standby, see proxy_reset_stats() */
+typedef struct {
+    uint64_t transfers;         /* calls to proxy_write() and the other transfer functions */
+    uint64_t errors;            /* transfers that failed */
+    uint64_t xruns;             /* underruns and overruns, also those the transfer recovered from */
+    uint64_t short_transfers;   /* non-blocking transfers that moved less than asked */
+    uint64_t recoveries;        /* successful transfers after an error */
+    uint64_t recovery_ns_total; /* time from the first error to the next success, summed */
+    uint64_t recovery_ns_max;
+    uint64_t error_time_ns;     /* the CLOCK_MONOTONIC time of the first unrecovered error, or 0 */
+    uint32_t latency_histogram[PROXY_LATENCY_BUCKETS];
+} proxy_stats;
 
 typedef struct {
     alsa_device_profile* profile;
@@ -30,27 +55,112 @@ typedef struct {
 
     size_t frame_size;    /* valid after proxy_prepare(), the frame size in bytes */
     uint64_t transferred; /* the total frames transferred, not cleared on standby */
+
+    unsigned int flags;         /* PROXY_OPEN_* flags the pcm was actually opened with */
+    unsigned int mmap_offset;   /* frame offset of the area returned by proxy_mmap_begin() */
+    bool mmap_started;          /* whether the pcm was started after proxy_mmap_commit() */
+
+    alsa_timestamp_tracker tracker; /* models the positions read by the tracked query */
+    uint64_t tracked_frames;    /* the last position returned by the tracked query */
+
+    proxy_stats stats;
+
+    /* see proxy_set_client_config() */
+    alsa_adapter * adapter;             /* NULL if the client uses the device config */
+    alsa_adapter_config client_config;
+    const char * adapter_pending_data;  /* capture frames converted but not yet read */
+    size_t adapter_pending;
 } alsa_device_proxy;
 
 
 /* State */
 void proxy_prepare(alsa_device_proxy * proxy, alsa_device_profile * profile,
                    struct pcm_config * config);
+/*
+ * As proxy_prepare(), but size the buffer for latency_us microseconds: the fewest periods
+ * the device allows (at least 2), each as short as the device allows.  Returns the buffer
+ * latency actually configured in microseconds, which is more than asked for if the device
+ * periods can't be that short; proxy_get_period_size() and proxy_get_period_count() give
+ * the configuration.
+ */
+unsigned int proxy_prepare_for_latency(alsa_device_proxy * proxy, alsa_device_profile * profile,
+                                       struct pcm_config * config, unsigned int latency_us);
 int proxy_open(alsa_device_proxy * proxy);
+/* PROXY_OPEN_NOIRQ is dropped if the driver doesn't support it, see proxy->flags */
+int proxy_open_with_flags(alsa_device_proxy * proxy, unsigned int flags);
 void proxy_close(alsa_device_proxy * proxy);
 int proxy_get_presentation_position(const alsa_device_proxy * proxy,
         uint64_t *frames, struct timespec *timestamp);
+/*
+ * As proxy_get_presentation_position(), but the position at the current CLOCK_MONOTONIC time
+ * as modelled from recent measurements, so it is free of scheduling jitter and only queries
+ * the kernel every few tens of milliseconds.  Successive positions never decrease.
+ */
+int proxy_get_tracked_presentation_position(alsa_device_proxy * proxy,
+        uint64_t *frames, struct timespec *timestamp);
+/*
+ * The device clock drift relative to its nominal rate in parts per million, as measured by
+ * proxy_get_tracked_presentation_position(); -EAGAIN until there are enough measurements.
+ */
+int proxy_get_drift_ppm(const alsa_device_proxy * proxy, double *ppm);
+
+/*
+ * Converts between the device config chosen by proxy_prepare() and the one used by the
+ * client, so that proxy_write() and proxy_read() take and give data in the client format,
+ * channel count and rate.  The conversion is set up once: its buffers are allocated for
+ * max_frames client frames per transfer, and longer transfers are split.
+ * Positions and proxy->transferred remain in device frames.
+ * Returns 0, also when no conversion is needed, -EINVAL if it's not supported, or -ENOMEM.
+ * proxy_prepare() starts without a conversion, and proxy_close() releases it, so it is set
+ * again after a proxy_open() that follows standby.
+ */
+int proxy_set_client_config(alsa_device_proxy * proxy, audio_format_t format, unsigned channels,
+                            unsigned rate, size_t max_frames);
+void proxy_clear_client_config(alsa_device_proxy * proxy);
 
 /* Attributes */
 unsigned proxy_get_sample_rate(const alsa_device_proxy * proxy);
 enum pcm_format proxy_get_format(const alsa_device_proxy * proxy);
 unsigned proxy_get_channel_count(const alsa_device_proxy * proxy);
 unsigned int proxy_get_period_size(const alsa_device_proxy * proxy);
+unsigned int proxy_get_period_count(const alsa_device_proxy * proxy);
 unsigned proxy_get_latency(const alsa_device_proxy * proxy);
 
 /* I/O */
 int proxy_write(alsa_device_proxy * proxy, const void *data, unsigned int count);
-int proxy_read(const alsa_device_proxy * proxy, void *data, unsigned int count);
+int proxy_read(alsa_device_proxy * proxy, void *data, unsigned int count);
+
+/*
+ * Direct access to the DMA buffer of a proxy opened with PROXY_OPEN_MMAP.
+ * proxy_mmap_begin() returns the contiguous area at the application pointer, limited to
+ * *frames and to the frames available; proxy_mmap_commit() then hands over the frames
+ * written (or read) there.  Playback starts once a period has been committed.
+ */
+int proxy_mmap_begin(alsa_device_proxy * proxy, void **buffer, unsigned int *frames);
+int proxy_mmap_commit(alsa_device_proxy * proxy, unsigned int frames);
+
+/*
+ * Non-blocking I/O on a proxy opened with PROXY_OPEN_NONBLOCK, so that one thread can drive
+ * several proxies: wait for the poll fd to be readable (capture) or writable (playback),
+ * which it is once avail_min frames can be transferred, then transfer what fits.
+ * Returns the bytes transferred, which may be less than count, or -EAGAIN if there is no
+ * room (or nothing to read) at all.
+ */
+int proxy_write_nonblock(alsa_device_proxy * proxy, const void *data, unsigned int count);
+int proxy_read_nonblock(alsa_device_proxy * proxy, void *data, unsigned int count);
+/* The fd to poll, or -EINVAL if the proxy isn't open */
+int proxy_get_poll_fd(const alsa_device_proxy * proxy);
+/*
+ * Set the frames that must be available before the poll fd is ready, 0 for a period.
+ * Call before proxy_open_with_flags().
+ */
+void proxy_set_avail_min(alsa_device_proxy * proxy, unsigned int frames);
+/* The frames that can be transferred now without blocking, or a negative errno */
+int proxy_get_avail(const alsa_device_proxy * proxy);
+
+/* Statistics */
+void proxy_get_stats(const alsa_device_proxy * proxy, proxy_stats * stats);
+void proxy_reset_stats(alsa_device_proxy * proxy);
 
 /* Debugging */
 void proxy_dump(const alsa_device_proxy * proxy, int fd);
@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SYSTEM_MEDIA_ALSA_UTILS_ALSA_TIMESTAMP_H
+#define ANDROID_SYSTEM_MEDIA_ALSA_UTILS_ALSA_TIMESTAMP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#define TIMESTAMP_TRACKER_SAMPLES 32
+
+/*
+ * Fits a line through the recent (time, frame position) pairs measured from a device, so
+ * positions can be interpolated between measurements without their jitter, and the device
+ * clock can be compared to the nominal sample rate.
+ */
+typedef struct {
+    unsigned sample_rate;   /* nominal frames per second */
+
+    unsigned count;         /* number of valid samples */
+    unsigned next;          /* index of the next sample to replace */
+    int64_t time_ns[TIMESTAMP_TRACKER_SAMPLES];
+    int64_t frames[TIMESTAMP_TRACKER_SAMPLES];
+
+    /* the model: frames = base_frames + rate * (time_ns - base_time_ns) / 1e9 */
+    int64_t base_time_ns;
+    double base_frames;
+    double rate;            /* measured frames per second */
+} alsa_timestamp_tracker;
+
+void timestamp_tracker_init(alsa_timestamp_tracker * tracker, unsigned sample_rate);
+
+/* Forget all samples, e.g. when the stream stops */
+void timestamp_tracker_reset(alsa_timestamp_tracker * tracker);
+
+/*
+ * Add a measured position.  A position more than a few milliseconds from the model, as after
+ * an underrun, restarts the model from it, in which case false is returned.
+ */
+bool timestamp_tracker_add(alsa_timestamp_tracker * tracker, int64_t frames,
+                           const struct timespec * timestamp);
+
+/* Returns the time of the last sample in ns, or -1 if there is none */
+int64_t timestamp_tracker_get_last_time_ns(const alsa_timestamp_tracker * tracker);
+
+/* Returns 0 and the modelled position at the given time, or -EAGAIN if there are no samples */
+int timestamp_tracker_get_position(const alsa_timestamp_tracker * tracker,
+                                   const struct timespec * timestamp, int64_t * frames);
+
+/*
+ * Returns 0 and the measured device clock drift relative to the nominal sample rate in parts
+ * per million, positive if the device is fast, or -EAGAIN if the samples don't yet span
+ * long enough for a useful estimate.
+ */
+int timestamp_tracker_get_drift_ppm(const alsa_timestamp_tracker * tracker, double * ppm);
+
+#endif /* ANDROID_SYSTEM_MEDIA_ALSA_UTILS_ALSA_TIMESTAMP_H */
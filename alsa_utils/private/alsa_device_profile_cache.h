@@ -0,0 +1,43 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SYSTEM_MEDIA_ALSA_UTILS_ALSA_DEVICE_PROFILE_CACHE_H
+#define ANDROID_SYSTEM_MEDIA_ALSA_UTILS_ALSA_DEVICE_PROFILE_CACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "../include/alsa_device_profile.h"
+
+/*
+ * The cache file of a single profile, as used by profile_read_device_info_cached(),
+ * exposed to the tests.  descriptor_hash must match between the write and the read.
+ * profile_read_cache() leaves the profile unchanged and returns false if the file is missing,
+ * was written for other descriptors, or is invalid.
+ */
+void profile_write_cache(const alsa_device_profile* profile, const char* path,
+                         uint32_t descriptor_hash);
+bool profile_read_cache(alsa_device_profile* profile, const char* path, uint32_t descriptor_hash);
+
+/*
+ * The descriptor hash of a /proc/asound/cardN/streamD file, which ignores the running state
+ * of the streams, and the removal of the other cache files of a device and direction, which
+ * profile_read_device_info_cached() and profile_refresh_cache() do after a write.
+ */
+uint32_t profile_hash_stream_file(const char* path);
+void profile_remove_stale_caches(const char* path);
+
+#endif /* ANDROID_SYSTEM_MEDIA_ALSA_UTILS_ALSA_DEVICE_PROFILE_CACHE_H */
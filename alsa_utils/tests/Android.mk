@@ -0,0 +1,81 @@
+# Build the unit tests for alsa_utils
+
+LOCAL_PATH:= $(call my-dir)
+
+include $(CLEAR_VARS)
+LOCAL_SHARED_LIBRARIES := \
+	liblog \
+	libcutils \
+	libtinyalsa \
+	libalsautils
+LOCAL_C_INCLUDES := \
+	external/tinyalsa/include
+LOCAL_SRC_FILES := \
+	alsa_device_profile_tests.cpp
+LOCAL_MODULE := alsa_device_profile_tests
+LOCAL_MODULE_TAGS := tests
+LOCAL_CFLAGS := -Werror -Wall
+include $(BUILD_NATIVE_TEST)
+
+include $(CLEAR_VARS)
+LOCAL_SHARED_LIBRARIES := \
+	liblog \
+	libcutils \
+	libtinyalsa \
+	libaudioutils \
+	libalsautils
+LOCAL_C_INCLUDES := \
+	external/tinyalsa/include \
+	$(call include-path-for, audio-utils)
+LOCAL_SRC_FILES := \
+	alsa_adapter_tests.cpp
+LOCAL_MODULE := alsa_adapter_tests
+LOCAL_MODULE_TAGS := tests
+LOCAL_CFLAGS := -Werror -Wall
+include $(BUILD_NATIVE_TEST)
+
+# the proxy is built with a fake tinyalsa device in the test, rather than with libtinyalsa
+include $(CLEAR_VARS)
+LOCAL_SHARED_LIBRARIES := \
+	liblog \
+	libcutils \
+	libaudioutils
+LOCAL_C_INCLUDES := \
+	external/tinyalsa/include \
+	$(call include-path-for, audio-utils)
+LOCAL_SRC_FILES := \
+	../alsa_adapter.c \
+	../alsa_device_profile.c \
+	../alsa_device_proxy.c \
+	../alsa_format.c \
+	../alsa_logging.c \
+	../alsa_timestamp.c \
+	alsa_device_proxy_tests.cpp
+LOCAL_MODULE := alsa_device_proxy_tests
+LOCAL_MODULE_TAGS := tests
+LOCAL_CFLAGS := -Werror -Wall
+LOCAL_CFLAGS += -Wno-unused-parameter
+include $(BUILD_NATIVE_TEST)
+
+include $(CLEAR_VARS)
+LOCAL_SHARED_LIBRARIES := \
+	liblog \
+	libalsautils
+LOCAL_SRC_FILES := \
+	alsa_timestamp_tests.cpp
+LOCAL_MODULE := alsa_timestamp_tests
+LOCAL_MODULE_TAGS := tests
+LOCAL_CFLAGS := -Werror -Wall
+include $(BUILD_NATIVE_TEST)
+
+# the timestamp tracker has no dependency on the device, so it is also tested on the host
+include $(CLEAR_VARS)
+LOCAL_SHARED_LIBRARIES := \
+	liblog
+LOCAL_SRC_FILES := \
+	../alsa_timestamp.c \
+	alsa_timestamp_tests.cpp
+LOCAL_MODULE := alsa_timestamp_tests
+LOCAL_MODULE_TAGS := tests
+LOCAL_CFLAGS := -Werror -Wall
+include $(BUILD_HOST_NATIVE_TEST)
@@ -0,0 +1,237 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "alsa_adapter_tests"
+
+#include <errno.h>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include <gtest/gtest.h>
+
+extern "C" {
+#include "../include/alsa_adapter.h"
+}
+
+static alsa_adapter *createAdapter(audio_format_t srcFormat, unsigned srcChannels,
+                                   unsigned srcRate, audio_format_t dstFormat,
+                                   unsigned dstChannels, unsigned dstRate, size_t maxFrames)
+{
+    const alsa_adapter_config src = { srcFormat, srcChannels, srcRate };
+    const alsa_adapter_config dst = { dstFormat, dstChannels, dstRate };
+    alsa_adapter *adapter = nullptr;
+    EXPECT_EQ(0, adapter_create(&src, &dst, maxFrames, &adapter));
+    return adapter;
+}
+
+// converts all of in, a chunk of at most the adapter maximum at a time
+template <typename S, typename D>
+static std::vector<D> process(alsa_adapter *adapter, const std::vector<S> &in,
+                              unsigned srcChannels, unsigned dstChannels)
+{
+    std::vector<D> out;
+    const size_t frames = in.size() / srcChannels;
+    const size_t maxFrames = adapter_get_max_src_frames(adapter);
+    for (size_t done = 0; done < frames; ) {
+        const size_t chunk = frames - done < maxFrames ? frames - done : maxFrames;
+        const void *converted;
+        const size_t count = adapter_process(adapter, &in[done * srcChannels], chunk, &converted);
+        const D *samples = (const D *)converted;
+        out.insert(out.end(), samples, samples + count * dstChannels);
+        done += chunk;
+    }
+    return out;
+}
+
+TEST(alsa_adapter, create) {
+    const alsa_adapter_config good = { AUDIO_FORMAT_PCM_16_BIT, 2, 48000 };
+    // not null, to check that a failure clears it
+    alsa_adapter *adapter = (alsa_adapter *)&good;
+    alsa_adapter_config bad = good;
+    bad.channels = 0;
+    EXPECT_EQ(-EINVAL, adapter_create(&good, &bad, 480, &adapter));
+    EXPECT_EQ(nullptr, adapter);
+    bad = good;
+    bad.rate = 0;
+    EXPECT_EQ(-EINVAL, adapter_create(&bad, &good, 480, &adapter));
+    bad = good;
+    bad.format = AUDIO_FORMAT_MP3;
+    EXPECT_EQ(-EINVAL, adapter_create(&good, &bad, 480, &adapter));
+    EXPECT_EQ(-EINVAL, adapter_create(&good, &good, 0, &adapter));
+    EXPECT_EQ(nullptr, adapter);
+
+    adapter = createAdapter(AUDIO_FORMAT_PCM_16_BIT, 2, 48000,
+                            AUDIO_FORMAT_PCM_24_BIT_PACKED, 1, 44100, 480);
+    ASSERT_NE(nullptr, adapter);
+    EXPECT_EQ(4u, adapter_get_src_frame_size(adapter));
+    EXPECT_EQ(3u, adapter_get_dst_frame_size(adapter));
+    EXPECT_EQ(480u, adapter_get_max_src_frames(adapter));
+    EXPECT_NE(nullptr, adapter_get_src_buffer(adapter));
+    adapter_destroy(adapter);
+    adapter_destroy(nullptr);
+
+    EXPECT_EQ(AUDIO_FORMAT_PCM_16_BIT, audio_format_from_pcm_format(PCM_FORMAT_S16_LE));
+    EXPECT_EQ(AUDIO_FORMAT_PCM_32_BIT, audio_format_from_pcm_format(PCM_FORMAT_S32_LE));
+    EXPECT_EQ(AUDIO_FORMAT_PCM_8_BIT, audio_format_from_pcm_format(PCM_FORMAT_S8));
+    EXPECT_EQ(AUDIO_FORMAT_PCM_8_24_BIT, audio_format_from_pcm_format(PCM_FORMAT_S24_LE));
+    EXPECT_EQ(AUDIO_FORMAT_PCM_24_BIT_PACKED, audio_format_from_pcm_format(PCM_FORMAT_S24_3LE));
+    EXPECT_EQ(AUDIO_FORMAT_INVALID, audio_format_from_pcm_format(PCM_FORMAT_INVALID));
+}
+
+TEST(alsa_adapter, format) {
+    // only the format changes, in one pass
+    alsa_adapter *adapter = createAdapter(AUDIO_FORMAT_PCM_16_BIT, 2, 48000,
+                                          AUDIO_FORMAT_PCM_24_BIT_PACKED, 2, 48000, 4);
+    ASSERT_NE(nullptr, adapter);
+    const std::vector<int16_t> in = { 0, 1, -1, 0x1234, -0x8000, 0x7fff, 0x0102, -0x0102, 5, 6 };
+    const std::vector<uint8_t> out = process<int16_t, uint8_t>(adapter, in, 2, 6);
+    const uint8_t expected[] = {
+        0x00, 0x00, 0x00,  0x00, 0x01, 0x00,  0x00, 0xff, 0xff,  0x00, 0x34, 0x12,
+        0x00, 0x00, 0x80,  0x00, 0xff, 0x7f,  0x00, 0x02, 0x01,  0x00, 0xfe, 0xfe,
+        0x00, 0x05, 0x00,  0x00, 0x06, 0x00 };
+    ASSERT_EQ(sizeof(expected), out.size());
+    EXPECT_EQ(0, memcmp(expected, out.data(), sizeof(expected)));
+
+    // and no more than the maximum at a time
+    const void *converted;
+    EXPECT_EQ(4u, adapter_process(adapter, in.data(), 5, &converted));
+    adapter_destroy(adapter);
+
+    adapter = createAdapter(AUDIO_FORMAT_PCM_FLOAT, 1, 48000,
+                            AUDIO_FORMAT_PCM_16_BIT, 1, 48000, 8);
+    ASSERT_NE(nullptr, adapter);
+    const std::vector<float> floats = { 0.f, 0.5f, -0.5f, 1.f, -1.f, 2.f, -2.f, 1.f / 32768 };
+    const std::vector<int16_t> shorts = process<float, int16_t>(adapter, floats, 1, 1);
+    const std::vector<int16_t> expectedShorts =
+            { 0, 16384, -16384, 32767, -32768, 32767, -32768, 1 };
+    EXPECT_EQ(expectedShorts, shorts);
+    adapter_destroy(adapter);
+}
+
+TEST(alsa_adapter, channels) {
+    // contraction averages the first two channels, and drops the others
+    alsa_adapter *adapter = createAdapter(AUDIO_FORMAT_PCM_16_BIT, 2, 48000,
+                                          AUDIO_FORMAT_PCM_16_BIT, 1, 48000, 16);
+    ASSERT_NE(nullptr, adapter);
+    const std::vector<int16_t> stereo = { 1000, 3000, -1000, -3000, 0x7ffe, 0x7ffe, -20, 20 };
+    EXPECT_EQ(std::vector<int16_t>({ 2000, -2000, 0x7ffe, 0 }),
+              (process<int16_t, int16_t>(adapter, stereo, 2, 1)));
+    adapter_destroy(adapter);
+
+    adapter = createAdapter(AUDIO_FORMAT_PCM_FLOAT, 4, 48000,
+                            AUDIO_FORMAT_PCM_FLOAT, 2, 48000, 16);
+    ASSERT_NE(nullptr, adapter);
+    const std::vector<float> quad = { .1f, .2f, .3f, .4f, -.1f, -.2f, -.3f, -.4f };
+    EXPECT_EQ(std::vector<float>({ .1f, .2f, -.1f, -.2f }),
+              (process<float, float>(adapter, quad, 4, 2)));
+    adapter_destroy(adapter);
+
+    adapter = createAdapter(AUDIO_FORMAT_PCM_FLOAT, 2, 48000,
+                            AUDIO_FORMAT_PCM_16_BIT, 1, 48000, 16);
+    ASSERT_NE(nullptr, adapter);
+    EXPECT_EQ(std::vector<int16_t>({ 16384, -8192 }),
+              (process<float, int16_t>(adapter, { .25f, .75f, -.5f, 0.f }, 2, 1)));
+    adapter_destroy(adapter);
+
+    // expansion duplicates mono to the first two channels, and zero fills the others
+    adapter = createAdapter(AUDIO_FORMAT_PCM_16_BIT, 1, 48000,
+                            AUDIO_FORMAT_PCM_32_BIT, 4, 48000, 16);
+    ASSERT_NE(nullptr, adapter);
+    EXPECT_EQ(std::vector<int32_t>({ 0x10000, 0x10000, 0, 0, INT32_MIN, INT32_MIN, 0, 0 }),
+              (process<int16_t, int32_t>(adapter, { 1, -0x8000 }, 1, 4)));
+    adapter_destroy(adapter);
+}
+
+// a 1 kHz sine of amplitude, in channels identical channels
+static std::vector<int16_t> sine(unsigned rate, size_t frames, unsigned channels,
+                                 double amplitude)
+{
+    std::vector<int16_t> samples;
+    for (size_t i = 0; i < frames; ++i) {
+        const int16_t sample = lround(amplitude * sin(2 * M_PI * 1000 * i / rate));
+        samples.insert(samples.end(), channels, sample);
+    }
+    return samples;
+}
+
+// the amplitude of the 1 kHz sine best fitting a channel of samples, from frame start on,
+// and the rms of what remains once it is subtracted
+template <typename T>
+static void fitSine(const std::vector<T> &samples, unsigned rate, unsigned channels,
+                    unsigned channel, size_t start, double *amplitude, double *residual)
+{
+    const size_t frames = samples.size() / channels;
+    // a whole number of periods
+    const size_t count = (frames - start) / (rate / 1000) * (rate / 1000);
+    double a = 0, b = 0;
+    for (size_t i = 0; i < count; ++i) {
+        const double phase = 2 * M_PI * 1000 * (start + i) / rate;
+        a += samples[(start + i) * channels + channel] * sin(phase);
+        b += samples[(start + i) * channels + channel] * cos(phase);
+    }
+    a *= 2. / count;
+    b *= 2. / count;
+    double energy = 0;
+    for (size_t i = 0; i < count; ++i) {
+        const double phase = 2 * M_PI * 1000 * (start + i) / rate;
+        const double error = samples[(start + i) * channels + channel]
+                - a * sin(phase) - b * cos(phase);
+        energy += error * error;
+    }
+    *amplitude = hypot(a, b);
+    *residual = sqrt(energy / count);
+}
+
+TEST(alsa_adapter, round_trip) {
+    const double amplitude = 16000;
+    const std::vector<int16_t> in = sine(48000, 48000, 2, amplitude);
+
+    // to the device: mixed to mono, then resampled and widened
+    alsa_adapter *to = createAdapter(AUDIO_FORMAT_PCM_16_BIT, 2, 48000,
+                                     AUDIO_FORMAT_PCM_FLOAT, 1, 44100, 480);
+    ASSERT_NE(nullptr, to);
+    const std::vector<float> device = process<int16_t, float>(to, in, 2, 1);
+    EXPECT_LE(device.size(), 44100u);
+    EXPECT_GE(device.size(), 44100u - 64);
+    double fitted, residual;
+    fitSine(device, 44100, 1, 0, 4410, &fitted, &residual);
+    EXPECT_NEAR(amplitude / 32768, fitted, amplitude / 32768 * 0.01);
+    EXPECT_LT(residual, amplitude / 32768 * 0.01);
+
+    // and back: resampled, then copied to both channels and narrowed
+    alsa_adapter *from = createAdapter(AUDIO_FORMAT_PCM_FLOAT, 1, 44100,
+                                       AUDIO_FORMAT_PCM_16_BIT, 2, 48000, 480);
+    ASSERT_NE(nullptr, from);
+    const std::vector<int16_t> out = process<float, int16_t>(from, device, 1, 2);
+    EXPECT_LE(out.size() / 2, 48000u);
+    EXPECT_GE(out.size() / 2, 48000u - 128);
+    for (unsigned channel = 0; channel < 2; ++channel) {
+        fitSine(out, 48000, 2, channel, 4800, &fitted, &residual);
+        EXPECT_NEAR(amplitude, fitted, amplitude * 0.01) << channel;
+        EXPECT_LT(residual, amplitude * 0.01) << channel;
+    }
+    for (size_t i = 0; i < out.size(); i += 2) {
+        ASSERT_EQ(out[i], out[i + 1]) << i;
+    }
+
+    // after a reset, the same input is converted as by a new adapter
+    adapter_reset(to);
+    EXPECT_EQ(device, (process<int16_t, float>(to, in, 2, 1)));
+    adapter_destroy(to);
+    adapter_destroy(from);
+}
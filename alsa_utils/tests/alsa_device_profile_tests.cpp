@@ -0,0 +1,321 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "alsa_device_profile_tests"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <string>
+#include <gtest/gtest.h>
+
+extern "C" {
+#include "../include/alsa_device_profile.h"
+#include "../private/alsa_device_profile_cache.h"
+}
+
+// a profile as profile_read_device_info() leaves it for a USB headset
+static void initProfile(alsa_device_profile *profile, size_t formatCount, size_t rateCount)
+{
+    static const enum pcm_format formats[] = { PCM_FORMAT_S16_LE, PCM_FORMAT_S24_3LE,
+            PCM_FORMAT_S32_LE, PCM_FORMAT_S24_LE, PCM_FORMAT_S8 };
+    static const unsigned rates[] = { 96000, 88200, 192000, 176400, 48000, 44100, 32000, 24000,
+            22050, 16000, 12000, 11025, 8000 };
+
+    memset(profile, 0, sizeof(*profile));
+    profile_init(profile, PCM_OUT);
+    profile->card = 1;
+    profile->device = 0;
+    for (size_t i = 0; i < formatCount; ++i) {
+        profile->formats[i] = formats[i];
+    }
+    profile->formats[formatCount] = PCM_FORMAT_INVALID;
+    for (size_t i = 0; i < rateCount; ++i) {
+        profile->sample_rates[i] = rates[i];
+    }
+    profile->sample_rates[rateCount] = 0;
+    profile->channel_counts[0] = 2;
+    profile->channel_counts[1] = 1;
+    profile->channel_counts[2] = 0;
+    profile->default_config.channels = 2;
+    profile->default_config.rate = rates[0];
+    profile->default_config.period_count = 2;
+    profile->default_config.format = formats[0];
+    profile->min_period_size = 16;
+    profile->max_period_size = 8192;
+    profile->min_period_count = 2;
+    profile->max_period_count = 32;
+    profile->min_channel_count = 1;
+    profile->max_channel_count = 2;
+}
+
+static void expectSameProfile(const alsa_device_profile &expected,
+                              const alsa_device_profile &actual)
+{
+    for (size_t i = 0; i < MAX_PROFILE_FORMATS; ++i) {
+        EXPECT_EQ(expected.formats[i], actual.formats[i]) << "format " << i;
+        if (expected.formats[i] == PCM_FORMAT_INVALID) {
+            break;
+        }
+    }
+    for (size_t i = 0; i < MAX_PROFILE_SAMPLE_RATES; ++i) {
+        EXPECT_EQ(expected.sample_rates[i], actual.sample_rates[i]) << "rate " << i;
+        if (expected.sample_rates[i] == 0) {
+            break;
+        }
+    }
+    for (size_t i = 0; i < MAX_PROFILE_CHANNEL_COUNTS; ++i) {
+        EXPECT_EQ(expected.channel_counts[i], actual.channel_counts[i]) << "channels " << i;
+        if (expected.channel_counts[i] == 0) {
+            break;
+        }
+    }
+    EXPECT_EQ(expected.default_config.channels, actual.default_config.channels);
+    EXPECT_EQ(expected.default_config.rate, actual.default_config.rate);
+    EXPECT_EQ(expected.default_config.period_count, actual.default_config.period_count);
+    EXPECT_EQ(expected.default_config.format, actual.default_config.format);
+    EXPECT_EQ(expected.min_period_size, actual.min_period_size);
+    EXPECT_EQ(expected.max_period_size, actual.max_period_size);
+    EXPECT_EQ(expected.min_period_count, actual.min_period_count);
+    EXPECT_EQ(expected.max_period_count, actual.max_period_count);
+    EXPECT_EQ(expected.min_channel_count, actual.min_channel_count);
+    EXPECT_EQ(expected.max_channel_count, actual.max_channel_count);
+}
+
+static std::string cachePath()
+{
+    const char *tmp = getenv("TMPDIR");
+#ifdef __ANDROID__
+    std::string path = tmp != nullptr ? tmp : "/data/local/tmp";
+#else
+    std::string path = tmp != nullptr ? tmp : "/tmp";
+#endif
+    return path + "/alsa_device_profile_tests.profile";
+}
+
+TEST(alsa_device_profile, cache_round_trip) {
+    const std::string path = cachePath();
+    // from one format and rate to full arrays, which leave only their terminator
+    for (size_t formatCount : { 1, 2, MAX_PROFILE_FORMATS - 1 }) {
+        for (size_t rateCount : { 1, 6, MAX_PROFILE_SAMPLE_RATES - 1 }) {
+            alsa_device_profile written;
+            initProfile(&written, formatCount, rateCount);
+            unlink(path.c_str());
+            profile_write_cache(&written, path.c_str(), 0x12345678);
+
+            alsa_device_profile read;
+            profile_init(&read, PCM_OUT);
+            read.card = 1;
+            read.device = 0;
+            ASSERT_TRUE(profile_read_cache(&read, path.c_str(), 0x12345678))
+                    << formatCount << " formats " << rateCount << " rates";
+            expectSameProfile(written, read);
+            EXPECT_TRUE(profile_is_valid(&read));
+            EXPECT_TRUE(profile_is_sample_rate_valid(&read, written.sample_rates[0]));
+            EXPECT_EQ(rateCount > 5, profile_is_sample_rate_valid(&read, 44100));
+            EXPECT_TRUE(profile_is_format_valid(&read, PCM_FORMAT_S16_LE));
+            EXPECT_EQ(formatCount > 1, profile_is_format_valid(&read, PCM_FORMAT_S24_3LE));
+        }
+    }
+    unlink(path.c_str());
+}
+
+TEST(alsa_device_profile, cache_miss) {
+    const std::string path = cachePath();
+    alsa_device_profile written;
+    initProfile(&written, 2, 6);
+    unlink(path.c_str());
+
+    alsa_device_profile read;
+    profile_init(&read, PCM_OUT);
+    read.card = 1;
+    read.device = 0;
+    EXPECT_FALSE(profile_read_cache(&read, path.c_str(), 0x12345678));
+
+    profile_write_cache(&written, path.c_str(), 0x12345678);
+    // the descriptors of the device have changed
+    EXPECT_FALSE(profile_read_cache(&read, path.c_str(), 0x87654321));
+    EXPECT_FALSE(profile_is_valid(&read));
+    EXPECT_EQ(PCM_FORMAT_INVALID, read.formats[0]);
+
+    // a truncated file
+    ASSERT_EQ(0, truncate(path.c_str(), 16));
+    EXPECT_FALSE(profile_read_cache(&read, path.c_str(), 0x12345678));
+    EXPECT_FALSE(profile_is_valid(&read));
+    unlink(path.c_str());
+}
+
+// reads written back through the cache, which makes it valid as the device would
+static void readProfile(const alsa_device_profile &written, alsa_device_profile *read)
+{
+    const std::string path = cachePath();
+    unlink(path.c_str());
+    profile_write_cache(&written, path.c_str(), 0x12345678);
+    profile_init(read, written.direction);
+    read->card = written.card;
+    read->device = written.device;
+    ASSERT_TRUE(profile_read_cache(read, path.c_str(), 0x12345678));
+    unlink(path.c_str());
+}
+
+static std::string takeString(char *string)
+{
+    std::string copy(string);
+    free(string);
+    return copy;
+}
+
+TEST(alsa_device_profile, capabilities) {
+    static const char * const formatNames[] = { "AUDIO_FORMAT_PCM_16_BIT",
+            "AUDIO_FORMAT_PCM_24_BIT_PACKED", "AUDIO_FORMAT_PCM_32_BIT",
+            "AUDIO_FORMAT_PCM_8_24_BIT", "AUDIO_FORMAT_PCM_8_BIT" };
+    static const unsigned rates[] = { 96000, 88200, 192000, 176400, 48000, 44100, 32000, 24000,
+            22050, 16000, 12000, 11025, 8000, 0, 1, 44101, 64000, 384000 };
+
+    for (size_t formatCount : { 1, 3, MAX_PROFILE_FORMATS - 1 }) {
+        for (size_t rateCount : { 1, 5, MAX_PROFILE_SAMPLE_RATES - 1 }) {
+            alsa_device_profile written;
+            initProfile(&written, formatCount, rateCount);
+            alsa_device_profile profile;
+            readProfile(written, &profile);
+
+            // the masks agree with the arrays they were built from
+            for (unsigned rate : rates) {
+                bool found = false;
+                for (size_t i = 0; profile.sample_rates[i] != 0; ++i) {
+                    found = found || profile.sample_rates[i] == rate;
+                }
+                EXPECT_EQ(found, profile_is_sample_rate_valid(&profile, rate)) << rate;
+            }
+            for (int format = PCM_FORMAT_INVALID - 1; format <= 33; ++format) {
+                bool found = false;
+                for (size_t i = 0; profile.formats[i] != PCM_FORMAT_INVALID; ++i) {
+                    found = found || profile.formats[i] == format;
+                }
+                EXPECT_EQ(found, profile_is_format_valid(&profile, (enum pcm_format)format))
+                        << format;
+            }
+
+            std::string rateStrs;
+            for (size_t i = 0; i < rateCount; ++i) {
+                rateStrs += (i > 0 ? "|" : "") + std::to_string(profile.sample_rates[i]);
+            }
+            EXPECT_EQ(rateStrs, takeString(profile_get_sample_rate_strs(&profile)));
+            std::string formatStrs;
+            for (size_t i = 0; i < formatCount; ++i) {
+                formatStrs += std::string(i > 0 ? "|" : "") + formatNames[i];
+            }
+            EXPECT_EQ(formatStrs, takeString(profile_get_format_strs(&profile)));
+            EXPECT_EQ("AUDIO_CHANNEL_OUT_STEREO|AUDIO_CHANNEL_INDEX_MASK_2"
+                    "|AUDIO_CHANNEL_OUT_MONO|AUDIO_CHANNEL_INDEX_MASK_1",
+                    takeString(profile_get_channel_count_strs(&profile)));
+        }
+    }
+
+    // before the device is read, only the defaults are valid
+    alsa_device_profile profile;
+    profile_init(&profile, PCM_IN);
+    EXPECT_TRUE(profile_is_sample_rate_valid(&profile, 44100));
+    EXPECT_FALSE(profile_is_sample_rate_valid(&profile, 48000));
+    EXPECT_TRUE(profile_is_format_valid(&profile, PCM_FORMAT_S16_LE));
+    EXPECT_FALSE(profile_is_format_valid(&profile, PCM_FORMAT_S24_3LE));
+    EXPECT_EQ("", takeString(profile_get_sample_rate_strs(&profile)));
+    EXPECT_EQ("", takeString(profile_get_format_strs(&profile)));
+    EXPECT_EQ("AUDIO_CHANNEL_IN_STEREO", takeString(profile_get_channel_count_strs(&profile)));
+}
+
+static std::string tempDir()
+{
+    const std::string path = cachePath();
+    return path.substr(0, path.rfind('/'));
+}
+
+static void writeFile(const std::string &path, const std::string &contents)
+{
+    FILE *file = fopen(path.c_str(), "w");
+    ASSERT_TRUE(file != nullptr) << path;
+    fputs(contents.c_str(), file);
+    fclose(file);
+}
+
+TEST(alsa_device_profile, stream_hash) {
+    static const char kStopped[] =
+            "USB Audio at usb-xhci-hcd.0.auto-1, high speed : USB Audio\n"
+            "\n"
+            "Playback:\n"
+            "  Status: Stop\n"
+            "  Interface 1\n"
+            "    Altset 1\n"
+            "    Format: S16_LE\n"
+            "    Channels: 2\n"
+            "    Endpoint: 1 OUT (ASYNC)\n"
+            "    Rates: 44100, 48000\n"
+            "\n"
+            "Capture:\n"
+            "  Status: Stop\n"
+            "  Interface 2\n"
+            "    Altset 1\n"
+            "    Format: S16_LE\n"
+            "    Channels: 1\n"
+            "    Rates: 48000\n";
+    // the state of a running stream, between its Status: line and the interfaces
+    const std::string running = std::string(kStopped).replace(
+            std::string(kStopped).find("  Status: Stop\n"), strlen("  Status: Stop\n"),
+            "  Status: Running\n"
+            "    Interface = 1\n"
+            "    Altset = 1\n"
+            "    Packet Size = 200\n"
+            "    Momentary freq = 47999 Hz (0x5.fffc)\n"
+            "    Feedback Format = 16.16\n");
+    std::string rates(kStopped);
+    rates.replace(rates.find("44100, 48000"), strlen("44100, 48000"), "48000");
+
+    const std::string path = tempDir() + "/alsa_device_profile_tests.stream";
+    writeFile(path, kStopped);
+    const uint32_t hash = profile_hash_stream_file(path.c_str());
+    EXPECT_NE(0u, hash);
+    writeFile(path, running);
+    EXPECT_EQ(hash, profile_hash_stream_file(path.c_str()));
+    writeFile(path, rates);
+    EXPECT_NE(hash, profile_hash_stream_file(path.c_str()));
+    unlink(path.c_str());
+    EXPECT_EQ(0u, profile_hash_stream_file(path.c_str()));
+}
+
+TEST(alsa_device_profile, stale_caches) {
+    const std::string dir = tempDir() + "/alsa_device_profile_tests.cache";
+    mkdir(dir.c_str(), 0700);
+    const char * const names[] = {
+        "usb-0bda-4014-11111111-0-out.profile",     // previous descriptors of the device
+        "usb-0bda-4014-22222222-0-out.profile",     // the current ones
+        "usb-0bda-4014-11111111-0-in.profile",      // other direction
+        "usb-0bda-4014-11111111-1-out.profile",     // other device
+        "usb-0bda-4015-11111111-0-out.profile",     // other product
+        "usb-0bda-4014-1111111x-0-out.profile",     // not written by the cache
+    };
+    for (const char *name : names) {
+        writeFile(dir + "/" + name, "");
+    }
+    profile_remove_stale_caches((dir + "/" + names[1]).c_str());
+    for (const char *name : names) {
+        const bool removed = name == names[0];
+        EXPECT_EQ(removed, access((dir + "/" + name).c_str(), F_OK) != 0) << name;
+        unlink((dir + "/" + name).c_str());
+    }
+    EXPECT_EQ(0, rmdir(dir.c_str()));
+}
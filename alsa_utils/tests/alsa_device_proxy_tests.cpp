@@ -0,0 +1,433 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "alsa_device_proxy_tests"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <deque>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+
+extern "C" {
+#include "../include/alsa_device_proxy.h"
+}
+
+/*
+ * A fake USB device, standing in for the tinyalsa pcm that the proxy is built with here.
+ * pcm_params_get() describes gDevice, pcm_open() accepts the configs it supports, and
+ * gPcm is the pcm open for transfers.  Blocking transfers behave as tinyalsa's: they fail
+ * with the errnos queued in gPcm->errors, and restart after an xrun unless the pcm was
+ * opened with PCM_NORESTART.
+ */
+struct FakeDevice {
+    unsigned formatBits;    // bit n for SNDRV_PCM_FORMAT n
+    unsigned minChannels;
+    unsigned maxChannels;
+    std::vector<unsigned> rates;
+};
+
+struct pcm_params {
+    struct pcm_mask formats;
+};
+
+struct pcm {
+    unsigned int flags;
+    struct pcm_config config;
+    bool ready;
+    std::deque<int> errors;
+    unsigned int xruns;
+    std::vector<char> written;  // playback data
+    std::deque<char> capture;   // capture data, silence once it runs out
+};
+
+static FakeDevice gDevice;
+static struct pcm *gPcm;
+
+static const unsigned kSndrvFormatS16Le = 2;
+
+static unsigned bytesPerSample(enum pcm_format format)
+{
+    switch (format) {
+    case PCM_FORMAT_S8:
+        return 1;
+    case PCM_FORMAT_S16_LE:
+        return 2;
+    case PCM_FORMAT_S24_3LE:
+        return 3;
+    default:
+        return 4;
+    }
+}
+
+extern "C" {
+
+struct pcm_params *pcm_params_get(unsigned int card, unsigned int device, unsigned int flags)
+{
+    (void)flags;
+    if (card != 1 || device != 0) {
+        return NULL;
+    }
+    struct pcm_params *params = new pcm_params;
+    memset(&params->formats, 0, sizeof(params->formats));
+    params->formats.bits[0] = gDevice.formatBits;
+    return params;
+}
+
+void pcm_params_free(struct pcm_params *pcm_params)
+{
+    delete pcm_params;
+}
+
+struct pcm_mask *pcm_params_get_mask(struct pcm_params *pcm_params, enum pcm_param param)
+{
+    return param == PCM_PARAM_FORMAT ? &pcm_params->formats : NULL;
+}
+
+unsigned int pcm_params_get_min(struct pcm_params *pcm_params, enum pcm_param param)
+{
+    (void)pcm_params;
+    switch (param) {
+    case PCM_PARAM_CHANNELS:
+        return gDevice.minChannels;
+    case PCM_PARAM_RATE:
+        return *std::min_element(gDevice.rates.begin(), gDevice.rates.end());
+    case PCM_PARAM_PERIOD_SIZE:
+        return 16;
+    case PCM_PARAM_PERIODS:
+        return 2;
+    default:
+        return 0;
+    }
+}
+
+unsigned int pcm_params_get_max(struct pcm_params *pcm_params, enum pcm_param param)
+{
+    (void)pcm_params;
+    switch (param) {
+    case PCM_PARAM_CHANNELS:
+        return gDevice.maxChannels;
+    case PCM_PARAM_RATE:
+        return *std::max_element(gDevice.rates.begin(), gDevice.rates.end());
+    case PCM_PARAM_PERIOD_SIZE:
+        return 8192;
+    case PCM_PARAM_PERIODS:
+        return 8;
+    default:
+        return 0;
+    }
+}
+
+struct pcm *pcm_open(unsigned int card, unsigned int device, unsigned int flags,
+                     struct pcm_config *config)
+{
+    struct pcm *pcm = new struct pcm;
+    pcm->flags = flags;
+    pcm->config = *config;
+    pcm->ready = card == 1 && device == 0 && !(flags & PCM_MMAP)
+            && std::find(gDevice.rates.begin(), gDevice.rates.end(), config->rate)
+                    != gDevice.rates.end()
+            && config->channels >= gDevice.minChannels && config->channels <= gDevice.maxChannels;
+    pcm->xruns = 0;
+    if (pcm->ready) {
+        gPcm = pcm;
+    }
+    return pcm;
+}
+
+int pcm_close(struct pcm *pcm)
+{
+    if (pcm == gPcm) {
+        gPcm = NULL;
+    }
+    delete pcm;
+    return 0;
+}
+
+int pcm_is_ready(struct pcm *pcm)
+{
+    return pcm->ready;
+}
+
+const char *pcm_get_error(struct pcm *pcm)
+{
+    (void)pcm;
+    return "not supported by the fake device";
+}
+
+unsigned int pcm_get_buffer_size(struct pcm *pcm)
+{
+    return pcm->config.period_size * pcm->config.period_count;
+}
+
+unsigned int pcm_frames_to_bytes(struct pcm *pcm, unsigned int frames)
+{
+    return frames * pcm->config.channels * bytesPerSample(pcm->config.format);
+}
+
+unsigned int pcm_bytes_to_frames(struct pcm *pcm, unsigned int bytes)
+{
+    return bytes / (pcm->config.channels * bytesPerSample(pcm->config.format));
+}
+
+int pcm_get_htimestamp(struct pcm *pcm, unsigned int *avail, struct timespec *tstamp)
+{
+    *avail = pcm_get_buffer_size(pcm);
+    return clock_gettime(CLOCK_MONOTONIC, tstamp);
+}
+
+// the errno of the next blocking transfer, restarting after xruns as tinyalsa does
+static int transferError(struct pcm *pcm)
+{
+    while (!pcm->errors.empty()) {
+        const int error = pcm->errors.front();
+        pcm->errors.pop_front();
+        if (error != EPIPE) {
+            return error;
+        }
+        pcm->xruns++;
+        if (pcm->flags & PCM_NORESTART) {
+            return EPIPE;
+        }
+    }
+    return 0;
+}
+
+int pcm_write(struct pcm *pcm, const void *data, unsigned int count)
+{
+    const int error = transferError(pcm);
+    if (error == EPIPE) {
+        return -EPIPE;
+    } else if (error != 0) {
+        errno = error;
+        return -1;
+    }
+    pcm->written.insert(pcm->written.end(), (const char *)data, (const char *)data + count);
+    return 0;
+}
+
+int pcm_read(struct pcm *pcm, void *data, unsigned int count)
+{
+    const int error = transferError(pcm);
+    if (error == EPIPE) {
+        return -EPIPE;
+    } else if (error != 0) {
+        errno = error;
+        return -1;
+    }
+    for (unsigned int i = 0; i < count; ++i) {
+        if (pcm->capture.empty()) {
+            ((char *)data)[i] = 0;
+        } else {
+            ((char *)data)[i] = pcm->capture.front();
+            pcm->capture.pop_front();
+        }
+    }
+    return 0;
+}
+
+// the fake device has no mmap mode
+int pcm_mmap_write(struct pcm *, const void *, unsigned int) { return -EINVAL; }
+int pcm_mmap_read(struct pcm *, void *, unsigned int) { return -EINVAL; }
+int pcm_mmap_begin(struct pcm *, void **, unsigned int *, unsigned int *) { return -EINVAL; }
+int pcm_mmap_commit(struct pcm *, unsigned int, unsigned int) { return -EINVAL; }
+int pcm_mmap_avail(struct pcm *) { return -EINVAL; }
+int pcm_prepare(struct pcm *) { return 0; }
+int pcm_start(struct pcm *) { return 0; }
+int pcm_get_poll_fd(struct pcm *) { return -1; }
+
+} // extern "C"
+
+// a stereo 16 bit USB headset at 44.1 and 48 kHz
+static void initProfile(alsa_device_profile *profile, int direction)
+{
+    gDevice.formatBits = 1u << kSndrvFormatS16Le;
+    gDevice.minChannels = 1;
+    gDevice.maxChannels = 2;
+    gDevice.rates = { 44100, 48000 };
+    profile_init(profile, direction);
+    profile->card = 1;
+    profile->device = 0;
+    ASSERT_TRUE(profile_read_device_info(profile));
+}
+
+static void openProxy(alsa_device_proxy *proxy, alsa_device_profile *profile)
+{
+    struct pcm_config config;
+    memset(&config, 0, sizeof(config));
+    config.format = PCM_FORMAT_S16_LE;
+    config.channels = 2;
+    config.rate = 48000;
+    memset(proxy, 0, sizeof(*proxy));
+    proxy_prepare(proxy, profile, &config);
+    ASSERT_EQ(0, proxy_open(proxy));
+    ASSERT_NE(nullptr, gPcm);
+}
+
+static uint64_t histogramTotal(const proxy_stats &stats)
+{
+    uint64_t total = 0;
+    for (uint32_t count : stats.latency_histogram) {
+        total += count;
+    }
+    return total;
+}
+
+TEST(alsa_device_proxy, write_stats) {
+    alsa_device_profile profile;
+    initProfile(&profile, PCM_OUT);
+    alsa_device_proxy proxy;
+    openProxy(&proxy, &profile);
+    // the blocking pcm reports its xruns
+    EXPECT_NE(0u, gPcm->flags & PCM_NORESTART);
+
+    std::vector<int16_t> buffer(480 * 2);
+    const unsigned int bytes = buffer.size() * sizeof(buffer[0]);
+    for (int i = 0; i < 10; ++i) {
+        ASSERT_EQ(0, proxy_write(&proxy, buffer.data(), bytes));
+    }
+    proxy_stats stats;
+    proxy_get_stats(&proxy, &stats);
+    EXPECT_EQ(10u, stats.transfers);
+    EXPECT_EQ(0u, stats.errors);
+    EXPECT_EQ(0u, stats.xruns);
+    EXPECT_EQ(10u, histogramTotal(stats));
+    EXPECT_EQ(4800u, proxy.transferred);
+
+    // an underrun is counted, and the data written once the pcm restarts
+    gPcm->errors = { EPIPE };
+    EXPECT_EQ(0, proxy_write(&proxy, buffer.data(), bytes));
+    proxy_get_stats(&proxy, &stats);
+    EXPECT_EQ(11u, stats.transfers);
+    EXPECT_EQ(0u, stats.errors);
+    EXPECT_EQ(1u, stats.xruns);
+    EXPECT_EQ(1u, gPcm->xruns);
+    EXPECT_EQ(11u * bytes, gPcm->written.size());
+    EXPECT_EQ(5280u, proxy.transferred);
+
+    // another error is not an xrun, and counts until the next successful transfer
+    gPcm->errors = { EIO };
+    EXPECT_EQ(-1, proxy_write(&proxy, buffer.data(), bytes));
+    gPcm->errors = { EPIPE, EPIPE };
+    EXPECT_EQ(-EPIPE, proxy_write(&proxy, buffer.data(), bytes));
+    proxy_get_stats(&proxy, &stats);
+    EXPECT_EQ(13u, stats.transfers);
+    EXPECT_EQ(2u, stats.errors);
+    EXPECT_EQ(3u, stats.xruns);
+    EXPECT_EQ(0u, stats.recoveries);
+    EXPECT_NE(0u, stats.error_time_ns);
+    EXPECT_EQ(5280u, proxy.transferred);
+    EXPECT_EQ(0, proxy_write(&proxy, buffer.data(), bytes));
+    proxy_get_stats(&proxy, &stats);
+    EXPECT_EQ(1u, stats.recoveries);
+    EXPECT_EQ(0u, stats.error_time_ns);
+    EXPECT_EQ(stats.recovery_ns_total, stats.recovery_ns_max);
+    EXPECT_EQ(14u, histogramTotal(stats));
+
+    // the statistics are kept across standby
+    proxy_close(&proxy);
+    ASSERT_EQ(0, proxy_open(&proxy));
+    proxy_get_stats(&proxy, &stats);
+    EXPECT_EQ(14u, stats.transfers);
+
+    FILE *file = tmpfile();
+    ASSERT_NE(nullptr, file);
+    proxy_dump(&proxy, fileno(file));
+    rewind(file);
+    char line[256];
+    bool found = false;
+    while (fgets(line, sizeof(line), file) != NULL) {
+        found = found || strstr(line, "transfers: 14 errors: 2 xruns: 3 short: 0") != NULL;
+    }
+    fclose(file);
+    EXPECT_TRUE(found);
+
+    proxy_reset_stats(&proxy);
+    proxy_get_stats(&proxy, &stats);
+    EXPECT_EQ(0u, stats.transfers);
+    EXPECT_EQ(0u, stats.xruns);
+    EXPECT_EQ(0u, histogramTotal(stats));
+    proxy_close(&proxy);
+}
+
+TEST(alsa_device_proxy, client_config) {
+    alsa_device_profile profile;
+    initProfile(&profile, PCM_OUT);
+    struct pcm_config config;
+    memset(&config, 0, sizeof(config));
+    config.format = PCM_FORMAT_S16_LE;
+    config.channels = 2;
+    config.rate = 48000;
+    // as a HAL allocates it, without initializing it
+    alsa_device_proxy proxy;
+    memset(&proxy, 0xA5, sizeof(proxy));
+    proxy_prepare(&proxy, &profile, &config);
+    EXPECT_EQ(nullptr, proxy.adapter);
+    ASSERT_EQ(0, proxy_open(&proxy));
+
+    // mono float in, stereo 16-bit out
+    ASSERT_EQ(0, proxy_set_client_config(&proxy, AUDIO_FORMAT_PCM_FLOAT, 1, 48000, 4));
+    ASSERT_NE(nullptr, proxy.adapter);
+    const float samples[] = { 0.f, .5f, -.5f, -1.f, .25f, 1.f };
+    const uint64_t transferred = proxy.transferred;
+    ASSERT_EQ(0, proxy_write(&proxy, samples, sizeof(samples)));
+    const int16_t expected[] = { 0, 0, 16384, 16384, -16384, -16384, -32768, -32768,
+            8192, 8192, 32767, 32767 };
+    ASSERT_EQ(sizeof(expected), gPcm->written.size());
+    EXPECT_EQ(0, memcmp(expected, gPcm->written.data(), sizeof(expected)));
+    EXPECT_EQ(transferred + 6, proxy.transferred);
+
+    // standby releases the conversion
+    proxy_close(&proxy);
+    EXPECT_EQ(nullptr, proxy.adapter);
+    ASSERT_EQ(0, proxy_open(&proxy));
+    ASSERT_EQ(0, proxy_set_client_config(&proxy, AUDIO_FORMAT_PCM_16_BIT, 2, 48000, 480));
+    EXPECT_EQ(nullptr, proxy.adapter);
+    proxy_close(&proxy);
+}
+
+TEST(alsa_device_proxy, read_stats) {
+    alsa_device_profile profile;
+    initProfile(&profile, PCM_IN);
+    alsa_device_proxy proxy;
+    openProxy(&proxy, &profile);
+    EXPECT_NE(0u, gPcm->flags & PCM_NORESTART);
+
+    std::vector<int16_t> buffer(480 * 2);
+    const unsigned int bytes = buffer.size() * sizeof(buffer[0]);
+    gPcm->capture.assign(bytes, 1);
+    gPcm->errors = { EPIPE };
+    EXPECT_EQ(0, proxy_read(&proxy, buffer.data(), bytes));
+    EXPECT_TRUE(gPcm->capture.empty());
+    gPcm->errors = { EBADFD };
+    EXPECT_EQ(-1, proxy_read(&proxy, buffer.data(), bytes));
+    EXPECT_EQ(0, proxy_read(&proxy, buffer.data(), bytes));
+
+    proxy_stats stats;
+    proxy_get_stats(&proxy, &stats);
+    EXPECT_EQ(3u, stats.transfers);
+    EXPECT_EQ(1u, stats.errors);
+    EXPECT_EQ(1u, stats.xruns);
+    EXPECT_EQ(1u, stats.recoveries);
+    EXPECT_EQ(3u, histogramTotal(stats));
+    proxy_close(&proxy);
+}
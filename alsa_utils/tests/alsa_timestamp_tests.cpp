@@ -0,0 +1,152 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "alsa_timestamp_tests"
+
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+#include <gtest/gtest.h>
+
+extern "C" {
+#include "../include/alsa_timestamp.h"
+}
+
+static const unsigned kSampleRate = 48000;
+static const int64_t kStartNs = 100 * 1000000000LL;
+
+static struct timespec toTimespec(int64_t ns)
+{
+    struct timespec timestamp;
+    timestamp.tv_sec = ns / 1000000000LL;
+    timestamp.tv_nsec = ns % 1000000000LL;
+    return timestamp;
+}
+
+// the position of a device running ppm fast, at ns after kStartNs
+static double devicePosition(int64_t ns, double ppm)
+{
+    return (double)ns * kSampleRate * (1. + ppm * 1e-6) / 1e9;
+}
+
+static int64_t position(const alsa_timestamp_tracker *tracker, int64_t ns)
+{
+    const struct timespec timestamp = toTimespec(kStartNs + ns);
+    int64_t frames = -1;
+    EXPECT_EQ(0, timestamp_tracker_get_position(tracker, &timestamp, &frames));
+    return frames;
+}
+
+static bool add(alsa_timestamp_tracker *tracker, int64_t frames, int64_t ns)
+{
+    const struct timespec timestamp = toTimespec(kStartNs + ns);
+    return timestamp_tracker_add(tracker, frames, &timestamp);
+}
+
+TEST(alsa_timestamp, empty) {
+    alsa_timestamp_tracker tracker;
+    timestamp_tracker_init(&tracker, kSampleRate);
+    const struct timespec timestamp = toTimespec(kStartNs);
+    int64_t frames;
+    double ppm;
+    EXPECT_EQ(-EAGAIN, timestamp_tracker_get_position(&tracker, &timestamp, &frames));
+    EXPECT_EQ(-1, timestamp_tracker_get_last_time_ns(&tracker));
+    EXPECT_EQ(-EAGAIN, timestamp_tracker_get_drift_ppm(&tracker, &ppm));
+
+    // a single position is extrapolated at the nominal rate
+    EXPECT_TRUE(add(&tracker, 1000, 0));
+    EXPECT_EQ(kStartNs, timestamp_tracker_get_last_time_ns(&tracker));
+    EXPECT_EQ(1000, position(&tracker, 0));
+    EXPECT_EQ(1000 + 480, position(&tracker, 10000000));
+    EXPECT_EQ(-EAGAIN, timestamp_tracker_get_drift_ppm(&tracker, &ppm));
+
+    timestamp_tracker_reset(&tracker);
+    EXPECT_EQ(-EAGAIN, timestamp_tracker_get_position(&tracker, &timestamp, &frames));
+    EXPECT_EQ(-1, timestamp_tracker_get_last_time_ns(&tracker));
+}
+
+TEST(alsa_timestamp, drift) {
+    const int64_t periodNs = 20000000;
+    for (double ppm : { 0., 100., -250., 1000. }) {
+        alsa_timestamp_tracker tracker;
+        timestamp_tracker_init(&tracker, kSampleRate);
+        // several times around the ring of samples, with whole frames as a device reports
+        for (int i = 0; i < 4 * TIMESTAMP_TRACKER_SAMPLES; ++i) {
+            const int64_t ns = i * periodNs;
+            ASSERT_TRUE(add(&tracker, (int64_t)devicePosition(ns, ppm), ns)) << i;
+            double measured;
+            if ((i + 1) * periodNs <= 500000000) {
+                EXPECT_EQ(-EAGAIN, timestamp_tracker_get_drift_ppm(&tracker, &measured)) << i;
+                continue;
+            }
+            ASSERT_EQ(0, timestamp_tracker_get_drift_ppm(&tracker, &measured)) << i;
+            // within a frame over the half second the samples span at least
+            EXPECT_NEAR(ppm, measured, 1e6 / kSampleRate * 2) << i;
+            // between and just after the measurements
+            EXPECT_NEAR(devicePosition(ns + periodNs / 2, ppm),
+                    position(&tracker, ns + periodNs / 2), 1.5) << i;
+        }
+    }
+}
+
+TEST(alsa_timestamp, jitter) {
+    const int64_t periodNs = 10000000;
+    const double noise = 24; // 0.5 ms of scheduling jitter either way
+    alsa_timestamp_tracker tracker;
+    timestamp_tracker_init(&tracker, kSampleRate);
+    srand(42);
+    double maxError = 0;
+    for (int i = 0; i < 3 * TIMESTAMP_TRACKER_SAMPLES; ++i) {
+        const int64_t ns = i * periodNs;
+        const double jitter = noise * (2. * rand() / RAND_MAX - 1.);
+        ASSERT_TRUE(add(&tracker, llround(devicePosition(ns, 0) + jitter), ns)) << i;
+        if (i >= TIMESTAMP_TRACKER_SAMPLES) {
+            maxError = fmax(maxError, fabs(position(&tracker, ns) - devicePosition(ns, 0)));
+        }
+    }
+    // a fit of the last samples is much closer than any one measurement
+    EXPECT_LT(maxError, noise / 2);
+}
+
+TEST(alsa_timestamp, discontinuity) {
+    const int64_t periodNs = 20000000;
+    alsa_timestamp_tracker tracker;
+    timestamp_tracker_init(&tracker, kSampleRate);
+    int i = 0;
+    for (; i < 10; ++i) {
+        ASSERT_TRUE(add(&tracker, (int64_t)devicePosition(i * periodNs, 0), i * periodNs));
+    }
+
+    // an underrun stops the position for 10 ms, beyond the 5 ms allowed
+    const int64_t lost = kSampleRate / 100;
+    EXPECT_FALSE(add(&tracker, (int64_t)devicePosition(i * periodNs, 0) - lost, i * periodNs));
+    double ppm;
+    EXPECT_EQ(-EAGAIN, timestamp_tracker_get_drift_ppm(&tracker, &ppm));
+    EXPECT_EQ((int64_t)devicePosition(i * periodNs, 0) - lost, position(&tracker, i * periodNs));
+    ++i;
+    EXPECT_TRUE(add(&tracker, (int64_t)devicePosition(i * periodNs, 0) - lost, i * periodNs));
+    EXPECT_EQ((int64_t)devicePosition(i * periodNs, 0) - lost, position(&tracker, i * periodNs));
+
+    // 4 ms is within the jitter allowed
+    ++i;
+    EXPECT_TRUE(add(&tracker, (int64_t)devicePosition(i * periodNs, 0) - lost + 192,
+            i * periodNs));
+
+    // but a time earlier than the last is not
+    EXPECT_FALSE(add(&tracker, (int64_t)devicePosition(i * periodNs, 0), (i - 1) * periodNs));
+    EXPECT_EQ(kStartNs + (i - 1) * periodNs, timestamp_tracker_get_last_time_ns(&tracker));
+}
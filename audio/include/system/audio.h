@@ -1467,40 +1467,23 @@ static inline audio_channel_mask_t audio_channel_mask_for_index_assignment_from_
  */
 static inline audio_channel_mask_t audio_channel_out_mask_from_count(uint32_t channel_count)
 {
-    uint32_t bits;
-    switch (channel_count) {
-    case 0:
-        return AUDIO_CHANNEL_NONE;
-    case 1:
-        bits = AUDIO_CHANNEL_OUT_MONO;
-        break;
-    case 2:
-        bits = AUDIO_CHANNEL_OUT_STEREO;
-        break;
-    case 3:
-        bits = AUDIO_CHANNEL_OUT_STEREO | AUDIO_CHANNEL_OUT_FRONT_CENTER;
-        break;
-    case 4: // 4.0
-        bits = AUDIO_CHANNEL_OUT_QUAD;
-        break;
-    case 5: // 5.0
-        bits = AUDIO_CHANNEL_OUT_QUAD | AUDIO_CHANNEL_OUT_FRONT_CENTER;
-        break;
-    case 6: // 5.1
-        bits = AUDIO_CHANNEL_OUT_5POINT1;
-        break;
-    case 7: // 6.1
-        bits = AUDIO_CHANNEL_OUT_5POINT1 | AUDIO_CHANNEL_OUT_BACK_CENTER;
-        break;
-    case 8:
-        bits = AUDIO_CHANNEL_OUT_7POINT1;
-        break;
+    /* Indexed by channel count.  The position representation is 0, so each mask is its bits. */
+    static const audio_channel_mask_t kMasks[] = {
+        AUDIO_CHANNEL_NONE,
+        AUDIO_CHANNEL_OUT_MONO,
+        AUDIO_CHANNEL_OUT_STEREO,
+        AUDIO_CHANNEL_OUT_STEREO | AUDIO_CHANNEL_OUT_FRONT_CENTER,
+        AUDIO_CHANNEL_OUT_QUAD,                                     /* 4.0 */
+        AUDIO_CHANNEL_OUT_QUAD | AUDIO_CHANNEL_OUT_FRONT_CENTER,    /* 5.0 */
+        AUDIO_CHANNEL_OUT_5POINT1,                                  /* 5.1 */
+        AUDIO_CHANNEL_OUT_5POINT1 | AUDIO_CHANNEL_OUT_BACK_CENTER,  /* 6.1 */
+        AUDIO_CHANNEL_OUT_7POINT1,
+    };
     // FIXME FCC_8
-    default:
+    if (channel_count >= sizeof(kMasks) / sizeof(kMasks[0])) {
         return AUDIO_CHANNEL_INVALID;
     }
-    return audio_channel_mask_from_representation_and_bits(
-            AUDIO_CHANNEL_REPRESENTATION_POSITION, bits);
+    return kMasks[channel_count];
 }
 
 /* Derive a default input channel mask from a channel count.
@@ -1537,60 +1520,71 @@ static inline audio_channel_mask_t audio_channel_in_mask_from_count(uint32_t cha
             AUDIO_CHANNEL_REPRESENTATION_POSITION, bits);
 }
 
+/* Bytes per sample of a linear PCM format, or 0 if the format is not a valid linear PCM format.
+ * A table lookup on the sub-format, shared by audio_is_valid_format() and audio_bytes_per_sample().
+ */
+static inline size_t audio_bytes_per_sample_linear_pcm(audio_format_t format)
+{
+    static const uint8_t kBytesPerSample[8] = {
+        0,                  /* no sub-format */
+        sizeof(int16_t),    /* AUDIO_FORMAT_PCM_SUB_16_BIT */
+        sizeof(uint8_t),    /* AUDIO_FORMAT_PCM_SUB_8_BIT */
+        sizeof(int32_t),    /* AUDIO_FORMAT_PCM_SUB_32_BIT */
+        sizeof(int32_t),    /* AUDIO_FORMAT_PCM_SUB_8_24_BIT */
+        sizeof(float),      /* AUDIO_FORMAT_PCM_SUB_FLOAT */
+        sizeof(uint8_t) * 3, /* AUDIO_FORMAT_PCM_SUB_24_BIT_PACKED */
+        0,
+    };
+    return (format & ~(uint32_t)0x7) == AUDIO_FORMAT_PCM ? kBytesPerSample[format & 0x7] : 0;
+}
+
+/* Bit of a main format in a 64-bit set of main formats */
+#define AUDIO_FORMAT_MAIN_BIT(format) (1ULL << ((uint32_t)(format) >> 24))
+
+/* The main formats other than PCM and PCM offload that are valid with any sub-format */
+#define AUDIO_FORMAT_VALID_MAIN_FORMATS ( \
+        AUDIO_FORMAT_MAIN_BIT(AUDIO_FORMAT_MP3) | \
+        AUDIO_FORMAT_MAIN_BIT(AUDIO_FORMAT_AMR_NB) | \
+        AUDIO_FORMAT_MAIN_BIT(AUDIO_FORMAT_AMR_WB) | \
+        AUDIO_FORMAT_MAIN_BIT(AUDIO_FORMAT_AAC) | \
+        AUDIO_FORMAT_MAIN_BIT(AUDIO_FORMAT_AAC_ADTS) | \
+        AUDIO_FORMAT_MAIN_BIT(AUDIO_FORMAT_HE_AAC_V1) | \
+        AUDIO_FORMAT_MAIN_BIT(AUDIO_FORMAT_HE_AAC_V2) | \
+        AUDIO_FORMAT_MAIN_BIT(AUDIO_FORMAT_VORBIS) | \
+        AUDIO_FORMAT_MAIN_BIT(AUDIO_FORMAT_OPUS) | \
+        AUDIO_FORMAT_MAIN_BIT(AUDIO_FORMAT_AC3) | \
+        AUDIO_FORMAT_MAIN_BIT(AUDIO_FORMAT_E_AC3) | \
+        AUDIO_FORMAT_MAIN_BIT(AUDIO_FORMAT_DTS) | \
+        AUDIO_FORMAT_MAIN_BIT(AUDIO_FORMAT_DTS_HD) | \
+        AUDIO_FORMAT_MAIN_BIT(AUDIO_FORMAT_IEC61937) | \
+        AUDIO_FORMAT_MAIN_BIT(AUDIO_FORMAT_QCELP) | \
+        AUDIO_FORMAT_MAIN_BIT(AUDIO_FORMAT_EVRC) | \
+        AUDIO_FORMAT_MAIN_BIT(AUDIO_FORMAT_EVRCB) | \
+        AUDIO_FORMAT_MAIN_BIT(AUDIO_FORMAT_EVRCWB) | \
+        AUDIO_FORMAT_MAIN_BIT(AUDIO_FORMAT_AAC_ADIF) | \
+        AUDIO_FORMAT_MAIN_BIT(AUDIO_FORMAT_AMR_WB_PLUS) | \
+        AUDIO_FORMAT_MAIN_BIT(AUDIO_FORMAT_MP2) | \
+        AUDIO_FORMAT_MAIN_BIT(AUDIO_FORMAT_EVRCNW) | \
+        AUDIO_FORMAT_MAIN_BIT(AUDIO_FORMAT_FLAC) | \
+        AUDIO_FORMAT_MAIN_BIT(AUDIO_FORMAT_ALAC) | \
+        AUDIO_FORMAT_MAIN_BIT(AUDIO_FORMAT_APE) | \
+        AUDIO_FORMAT_MAIN_BIT(AUDIO_FORMAT_WMA) | \
+        AUDIO_FORMAT_MAIN_BIT(AUDIO_FORMAT_WMA_PRO) | \
+        AUDIO_FORMAT_MAIN_BIT(AUDIO_FORMAT_DSD) | \
+        AUDIO_FORMAT_MAIN_BIT(AUDIO_FORMAT_DOLBY_TRUEHD))
+
 static inline bool audio_is_valid_format(audio_format_t format)
 {
-    switch (format & AUDIO_FORMAT_MAIN_MASK) {
-    case AUDIO_FORMAT_PCM:
-        switch (format) {
-        case AUDIO_FORMAT_PCM_16_BIT:
-        case AUDIO_FORMAT_PCM_8_BIT:
-        case AUDIO_FORMAT_PCM_32_BIT:
-        case AUDIO_FORMAT_PCM_8_24_BIT:
-        case AUDIO_FORMAT_PCM_FLOAT:
-        case AUDIO_FORMAT_PCM_24_BIT_PACKED:
-            return true;
-        default:
-            return false;
-        }
-        /* not reached */
-    case AUDIO_FORMAT_MP3:
-    case AUDIO_FORMAT_AMR_NB:
-    case AUDIO_FORMAT_AMR_WB:
-    case AUDIO_FORMAT_AAC:
-    case AUDIO_FORMAT_AAC_ADTS:
-    case AUDIO_FORMAT_HE_AAC_V1:
-    case AUDIO_FORMAT_HE_AAC_V2:
-    case AUDIO_FORMAT_VORBIS:
-    case AUDIO_FORMAT_OPUS:
-    case AUDIO_FORMAT_AC3:
-    case AUDIO_FORMAT_E_AC3:
-    case AUDIO_FORMAT_DTS:
-    case AUDIO_FORMAT_DTS_HD:
-    case AUDIO_FORMAT_IEC61937:
-    case AUDIO_FORMAT_QCELP:
-    case AUDIO_FORMAT_EVRC:
-    case AUDIO_FORMAT_EVRCB:
-    case AUDIO_FORMAT_EVRCWB:
-    case AUDIO_FORMAT_AAC_ADIF:
-    case AUDIO_FORMAT_AMR_WB_PLUS:
-    case AUDIO_FORMAT_MP2:
-    case AUDIO_FORMAT_EVRCNW:
-    case AUDIO_FORMAT_FLAC:
-    case AUDIO_FORMAT_ALAC:
-    case AUDIO_FORMAT_APE:
-    case AUDIO_FORMAT_WMA:
-    case AUDIO_FORMAT_WMA_PRO:
-    case AUDIO_FORMAT_DSD:
-        return true;
-    case AUDIO_FORMAT_PCM_OFFLOAD:
-        if (format != AUDIO_FORMAT_PCM_16_BIT_OFFLOAD &&
-                format != AUDIO_FORMAT_PCM_24_BIT_OFFLOAD) {
-            return false;
-        }
-    case AUDIO_FORMAT_DOLBY_TRUEHD:
-        return true;
+    const uint32_t main_format = (uint32_t)format >> 24;
+    switch (main_format) {
+    case AUDIO_FORMAT_PCM >> 24:
+        return audio_bytes_per_sample_linear_pcm(format) != 0;
+    case AUDIO_FORMAT_PCM_OFFLOAD >> 24:
+        return format == AUDIO_FORMAT_PCM_16_BIT_OFFLOAD ||
+                format == AUDIO_FORMAT_PCM_24_BIT_OFFLOAD;
     default:
-        return false;
+        return main_format < 64 &&
+                (AUDIO_FORMAT_VALID_MAIN_FORMATS & AUDIO_FORMAT_MAIN_BIT(format)) != 0;
     }
 }
 
@@ -1629,28 +1623,19 @@ static inline bool audio_has_proportional_frames(audio_format_t format)
 
 static inline size_t audio_bytes_per_sample(audio_format_t format)
 {
-    size_t size = 0;
+    size_t size = audio_bytes_per_sample_linear_pcm(format);
+    if (size != 0) {
+        return size;
+    }
 
     switch (format) {
-    case AUDIO_FORMAT_PCM_32_BIT:
-    case AUDIO_FORMAT_PCM_8_24_BIT:
     case AUDIO_FORMAT_PCM_24_BIT_OFFLOAD:
         size = sizeof(int32_t);
         break;
-    case AUDIO_FORMAT_PCM_24_BIT_PACKED:
-        size = sizeof(uint8_t) * 3;
-        break;
-    case AUDIO_FORMAT_PCM_16_BIT:
     case AUDIO_FORMAT_IEC61937:
     case AUDIO_FORMAT_PCM_16_BIT_OFFLOAD:
         size = sizeof(int16_t);
         break;
-    case AUDIO_FORMAT_PCM_8_BIT:
-        size = sizeof(uint8_t);
-        break;
-    case AUDIO_FORMAT_PCM_FLOAT:
-        size = sizeof(float);
-        break;
     default:
         break;
     }
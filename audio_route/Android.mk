@@ -10,3 +10,5 @@ LOCAL_SHARED_LIBRARIES:= liblog libcutils libutils libexpat libtinyalsa
 LOCAL_MODULE_TAGS := optional
 LOCAL_CFLAGS := -Werror -Wall
 include $(BUILD_SHARED_LIBRARY)
+
+include $(call all-makefiles-under,$(LOCAL_PATH))
@@ -20,9 +20,15 @@
 
 #include <errno.h>
 #include <expat.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include <cutils/log.h>
 
@@ -31,6 +37,12 @@
 #define BUF_SIZE 1024
 #define MIXER_XML_PATH "/system/etc/mixer_paths.xml"
 #define INITIAL_MIXER_PATH_SIZE 8
+#define INVALID_INDEX ((unsigned int)-1)
+
+/* compiled mixer_paths cache, see cache_save() */
+#define CACHE_MAGIC 0x43524150 /* "PARC" */
+#define CACHE_VERSION 1
+#define CACHE_ALIGN 8
 
 union ctl_values {
     int *enumerated;
@@ -45,6 +57,13 @@ struct mixer_state {
     union ctl_values old_value;
     union ctl_values new_value;
     union ctl_values reset_value;
+    /* setting of this ctl in the last path that was given one, for lookups while parsing */
+    unsigned int last_path;
+    unsigned int last_setting;
+    /* in update_order, waiting for the end of a deferred update */
+    bool queued;
+    /* in the path being switched to, see audio_route_switch_path_id() */
+    bool switching;
 };
 
 struct mixer_setting {
@@ -67,22 +86,146 @@ struct mixer_path {
     struct mixer_setting *setting;
 };
 
+struct name_index {
+    unsigned int size;      /* a power of 2, or 0 if not allocated */
+    unsigned int *slot;     /* index + 1 of the named item, or 0 if empty */
+};
+
 struct audio_route {
     struct mixer *mixer;
     unsigned int num_mixer_ctls;
     struct mixer_state *mixer_state;
+    /* bitmap of ctls whose new_value may differ from old_value */
+    uint32_t *dirty_ctls;
+
+    /* nesting of audio_route_begin_update(), and the ctls to write when it ends */
+    unsigned int update_depth;
+    bool update_mixer_pending;
+    unsigned int num_queued_ctls;
+    unsigned int *update_order;
 
     unsigned int mixer_path_size;
     unsigned int num_mixer_paths;
     struct mixer_path *mixer_path;
+
+    /* open addressing hash tables of path and ctl indices by name */
+    struct name_index path_names;
+    struct name_index ctl_names;
+
+    /* mapped cache holding the path names and values, if the paths were loaded from one */
+    void *cache_map;
+    size_t cache_size;
 };
 
 struct config_parse_state {
     struct audio_route *ar;
     struct mixer_path *path;
     int level;
+
+    /* top level ctl settings, in the order they were applied */
+    unsigned int initial_value_size;
+    unsigned int num_initial_values;
+    struct mixer_value *initial_value;
+    bool initial_value_error;
 };
 
+/* name index functions */
+
+/* FNV-1a */
+#define HASH_INIT 2166136261u
+
+static uint32_t hash_update(uint32_t hash, const void *data, size_t size)
+{
+    const unsigned char *bytes = data;
+
+    while (size--) {
+        hash ^= *bytes++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static unsigned int name_hash(const char *name)
+{
+    return hash_update(HASH_INIT, name, strlen(name));
+}
+
+static const char *path_name(struct audio_route *ar, unsigned int index)
+{
+    return ar->mixer_path[index].name;
+}
+
+static const char *ctl_name(struct audio_route *ar, unsigned int index)
+{
+    return mixer_ctl_get_name(ar->mixer_state[index].ctl);
+}
+
+/* returns the first index added with this name, or INVALID_INDEX */
+static unsigned int name_index_find(struct audio_route *ar, const struct name_index *ni,
+        const char *(*get_name)(struct audio_route *, unsigned int), const char *name)
+{
+    unsigned int mask = ni->size - 1;
+    unsigned int i;
+
+    if (ni->size == 0 || name == NULL)
+        return INVALID_INDEX;
+
+    for (i = name_hash(name) & mask; ni->slot[i]; i = (i + 1) & mask)
+        if (strcmp(get_name(ar, ni->slot[i] - 1), name) == 0)
+            return ni->slot[i] - 1;
+
+    return INVALID_INDEX;
+}
+
+/* (re)builds the index of items [0, count) with room for size / 2 items */
+static int name_index_build(struct audio_route *ar, struct name_index *ni,
+        const char *(*get_name)(struct audio_route *, unsigned int),
+        unsigned int count, unsigned int size)
+{
+    unsigned int *slot;
+    unsigned int index;
+    unsigned int mask;
+    unsigned int i;
+
+    slot = calloc(size, sizeof(*slot));
+    if (!slot)
+        return -1;
+
+    free(ni->slot);
+    ni->slot = slot;
+    ni->size = size;
+    mask = size - 1;
+    for (index = 0; index < count; index++) {
+        const char *name = get_name(ar, index);
+
+        /* keep the first of any duplicate names, as a linear search would */
+        if (name_index_find(ar, ni, get_name, name) != INVALID_INDEX)
+            continue;
+        for (i = name_hash(name) & mask; slot[i]; i = (i + 1) & mask)
+            ;
+        slot[i] = index + 1;
+    }
+
+    return 0;
+}
+
+/* a size that keeps an index of count items at most half full */
+static unsigned int name_index_size(unsigned int count)
+{
+    unsigned int size;
+
+    for (size = 1; size < count * 2; size *= 2)
+        ;
+    return size;
+}
+
+static void name_index_free(struct name_index *ni)
+{
+    free(ni->slot);
+    ni->slot = NULL;
+    ni->size = 0;
+}
+
 /* path functions */
 
 static bool is_supported_ctl_type(enum mixer_ctl_type type)
@@ -123,6 +266,16 @@ static inline struct mixer_ctl *index_to_ctl(struct audio_route *ar,
     return ar->mixer_state[ctl_index].ctl;
 }
 
+static inline void mark_ctl_dirty(struct audio_route *ar, unsigned int ctl_index)
+{
+    ar->dirty_ctls[ctl_index / 32] |= 1u << (ctl_index % 32);
+}
+
+static inline void clear_ctl_dirty(struct audio_route *ar, unsigned int ctl_index)
+{
+    ar->dirty_ctls[ctl_index / 32] &= ~(1u << (ctl_index % 32));
+}
+
 #if 0
 static void path_print(struct audio_route *ar, struct mixer_path *path)
 {
@@ -151,31 +304,42 @@ static void path_print(struct audio_route *ar, struct mixer_path *path)
 static void path_free(struct audio_route *ar)
 {
     unsigned int i;
+    unsigned int j;
 
     for (i = 0; i < ar->num_mixer_paths; i++) {
-        if (ar->mixer_path[i].name)
+        /* names and values loaded from a cache are in its mapping */
+        if (ar->mixer_path[i].name && !ar->cache_map)
             free(ar->mixer_path[i].name);
         if (ar->mixer_path[i].setting) {
-            if (ar->mixer_path[i].setting->value.ptr)
-                free(ar->mixer_path[i].setting->value.ptr);
+            for (j = 0; j < ar->mixer_path[i].length && !ar->cache_map; j++)
+                free(ar->mixer_path[i].setting[j].value.ptr);
             free(ar->mixer_path[i].setting);
         }
     }
     free(ar->mixer_path);
+    if (ar->cache_map) {
+        munmap(ar->cache_map, ar->cache_size);
+        ar->cache_map = NULL;
+    }
     ar->mixer_path = NULL;
     ar->mixer_path_size = 0;
+    ar->num_mixer_paths = 0;
+    name_index_free(&ar->path_names);
+}
+
+static int path_get_id_by_name(struct audio_route *ar, const char *name)
+{
+    unsigned int index = name_index_find(ar, &ar->path_names, path_name, name);
+
+    return index == INVALID_INDEX ? -1 : (int)index;
 }
 
 static struct mixer_path *path_get_by_name(struct audio_route *ar,
                                            const char *name)
 {
-    unsigned int i;
+    int path_id = path_get_id_by_name(ar, name);
 
-    for (i = 0; i < ar->num_mixer_paths; i++)
-        if (strcmp(ar->mixer_path[i].name, name) == 0)
-            return &ar->mixer_path[i];
-
-    return NULL;
+    return path_id < 0 ? NULL : &ar->mixer_path[path_id];
 }
 
 static struct mixer_path *path_create(struct audio_route *ar, const char *name)
@@ -209,16 +373,46 @@ static struct mixer_path *path_create(struct audio_route *ar, const char *name)
     ar->mixer_path[ar->num_mixer_paths].size = 0;
     ar->mixer_path[ar->num_mixer_paths].length = 0;
     ar->mixer_path[ar->num_mixer_paths].setting = NULL;
+    if (ar->mixer_path[ar->num_mixer_paths].name == NULL)
+        return NULL;
+    ar->num_mixer_paths++;
+
+    /* keep the name index at most half full */
+    if (ar->path_names.size < ar->num_mixer_paths * 2) {
+        if (name_index_build(ar, &ar->path_names, path_name, ar->num_mixer_paths,
+                             ar->mixer_path_size * 2) < 0) {
+            ALOGE("Unable to allocate path index");
+            free(ar->mixer_path[--ar->num_mixer_paths].name);
+            return NULL;
+        }
+    } else {
+        unsigned int mask = ar->path_names.size - 1;
+        unsigned int i;
+
+        for (i = name_hash(name) & mask; ar->path_names.slot[i]; i = (i + 1) & mask)
+            ;
+        ar->path_names.slot[i] = ar->num_mixer_paths;
+    }
 
-    /* return the mixer path just added, then increment number of them */
-    return &ar->mixer_path[ar->num_mixer_paths++];
+    return &ar->mixer_path[ar->num_mixer_paths - 1];
 }
 
-static int find_ctl_index_in_path(struct mixer_path *path,
+/*
+ * Each ctl remembers its setting in the last path that was given one, so the newest path,
+ * which is the one being built while parsing, is searched in constant time.
+ */
+static int find_ctl_index_in_path(struct audio_route *ar, struct mixer_path *path,
                                   unsigned int ctl_index)
 {
+    struct mixer_state *ms = &ar->mixer_state[ctl_index];
+    unsigned int path_index = path - ar->mixer_path;
     unsigned int i;
 
+    if (ms->last_path == path_index)
+        return ms->last_setting;
+    if (path_index == ar->num_mixer_paths - 1)
+        return -1;
+
     for (i = 0; i < path->length; i++)
         if (path->setting[i].ctl_index == ctl_index)
             return i;
@@ -226,7 +420,8 @@ static int find_ctl_index_in_path(struct mixer_path *path,
     return -1;
 }
 
-static int alloc_path_setting(struct mixer_path *path)
+static int alloc_path_setting(struct audio_route *ar, struct mixer_path *path,
+                              unsigned int ctl_index)
 {
     struct mixer_setting *new_path_setting;
     int path_index;
@@ -251,6 +446,10 @@ static int alloc_path_setting(struct mixer_path *path)
     path_index = path->length;
     path->length++;
 
+    path->setting[path_index].ctl_index = ctl_index;
+    ar->mixer_state[ctl_index].last_path = path - ar->mixer_path;
+    ar->mixer_state[ctl_index].last_setting = path_index;
+
     return path_index;
 }
 
@@ -259,7 +458,7 @@ static int path_add_setting(struct audio_route *ar, struct mixer_path *path,
 {
     int path_index;
 
-    if (find_ctl_index_in_path(path, setting->ctl_index) != -1) {
+    if (find_ctl_index_in_path(ar, path, setting->ctl_index) != -1) {
         struct mixer_ctl *ctl = index_to_ctl(ar, setting->ctl_index);
 
         ALOGE("Control '%s' already exists in path '%s'",
@@ -272,11 +471,10 @@ static int path_add_setting(struct audio_route *ar, struct mixer_path *path,
         return -1;
     }
 
-    path_index = alloc_path_setting(path);
+    path_index = alloc_path_setting(ar, path, setting->ctl_index);
     if (path_index < 0)
         return -1;
 
-    path->setting[path_index].ctl_index = setting->ctl_index;
     path->setting[path_index].type = setting->type;
     path->setting[path_index].num_values = setting->num_values;
 
@@ -307,7 +505,7 @@ static int path_add_value(struct audio_route *ar, struct mixer_path *path,
         return -1;
     }
 
-    path_index = find_ctl_index_in_path(path, mixer_value->ctl_index);
+    path_index = find_ctl_index_in_path(ar, path, mixer_value->ctl_index);
     if (path_index < 0) {
         /* New path */
 
@@ -316,12 +514,11 @@ static int path_add_value(struct audio_route *ar, struct mixer_path *path,
             ALOGE("unsupported type %d", (int)type);
             return -1;
         }
-        path_index = alloc_path_setting(path);
+        path_index = alloc_path_setting(ar, path, mixer_value->ctl_index);
         if (path_index < 0)
             return -1;
 
         /* initialise the new path setting */
-        path->setting[path_index].ctl_index = mixer_value->ctl_index;
         path->setting[path_index].num_values = num_values;
         path->setting[path_index].type = type;
 
@@ -388,6 +585,7 @@ static int path_apply(struct audio_route *ar, struct mixer_path *path)
         size_t value_sz = sizeof_ctl_type(type);
         memcpy(ar->mixer_state[ctl_index].new_value.ptr, path->setting[i].value.ptr,
                    path->setting[i].num_values * value_sz);
+        mark_ctl_dirty(ar, ctl_index);
     }
 
     return 0;
@@ -411,6 +609,7 @@ static int path_reset(struct audio_route *ar, struct mixer_path *path)
         memcpy(ar->mixer_state[ctl_index].new_value.ptr,
                ar->mixer_state[ctl_index].reset_value.ptr,
                ar->mixer_state[ctl_index].num_values * value_sz);
+        mark_ctl_dirty(ar, ctl_index);
     }
 
     return 0;
@@ -441,6 +640,58 @@ static int mixer_enum_string_to_value(struct mixer_ctl *ctl, const char *string)
     return i;
 }
 
+/* set the new value of one or, if the index is -1, all values of a ctl */
+static void mixer_state_set_value(struct audio_route *ar, const struct mixer_value *mixer_value)
+{
+    struct mixer_state *ms = &ar->mixer_state[mixer_value->ctl_index];
+    enum mixer_ctl_type type = mixer_ctl_get_type(ms->ctl);
+    unsigned int first = mixer_value->index;
+    unsigned int end = mixer_value->index + 1;
+    unsigned int i;
+
+    if (!is_supported_ctl_type(type))
+        return;
+
+    if (mixer_value->index == -1) {
+        first = 0;
+        end = ms->num_values;
+    } else if (first >= ms->num_values) {
+        ALOGE("value id out of range for mixer ctl '%s'", mixer_ctl_get_name(ms->ctl));
+        return;
+    }
+
+    mark_ctl_dirty(ar, mixer_value->ctl_index);
+    for (i = first; i < end; i++)
+        if (type == MIXER_CTL_TYPE_BYTE)
+            ms->new_value.bytes[i] = mixer_value->value;
+        else if (type == MIXER_CTL_TYPE_ENUM)
+            ms->new_value.enumerated[i] = mixer_value->value;
+        else
+            ms->new_value.integer[i] = mixer_value->value;
+}
+
+/* keep the initial ctl settings in order, for writing the compiled cache */
+static void config_add_initial_value(struct config_parse_state *state,
+                                     const struct mixer_value *mixer_value)
+{
+    struct mixer_value *new_value;
+
+    if (state->num_initial_values >= state->initial_value_size) {
+        state->initial_value_size = state->initial_value_size ?
+                state->initial_value_size * 2 : INITIAL_MIXER_PATH_SIZE;
+        new_value = realloc(state->initial_value,
+                            state->initial_value_size * sizeof(struct mixer_value));
+        if (new_value == NULL) {
+            ALOGE("Unable to allocate more initial values");
+            state->initial_value_size = state->num_initial_values;
+            state->initial_value_error = true;
+            return;
+        }
+        state->initial_value = new_value;
+    }
+    state->initial_value[state->num_initial_values++] = *mixer_value;
+}
+
 static void start_tag(void *data, const XML_Char *tag_name,
                       const XML_Char **attr)
 {
@@ -453,9 +704,7 @@ static void start_tag(void *data, const XML_Char *tag_name,
     unsigned int ctl_index;
     struct mixer_ctl *ctl;
     long value;
-    unsigned int id;
     struct mixer_value mixer_value;
-    enum mixer_ctl_type type;
 
     /* Get name, id and value attributes (these may be empty) */
     for (i = 0; attr[i]; i += 2) {
@@ -478,18 +727,22 @@ static void start_tag(void *data, const XML_Char *tag_name,
             } else {
                 /* nested path */
                 struct mixer_path *sub_path = path_get_by_name(ar, attr_name);
-                path_add_path(ar, state->path, sub_path);
+                if (!sub_path || !state->path)
+                    ALOGE("unable to add path '%s'", attr_name);
+                else
+                    path_add_path(ar, state->path, sub_path);
             }
         }
     }
 
     else if (strcmp(tag_name, "ctl") == 0) {
         /* Obtain the mixer ctl and value */
-        ctl = mixer_get_ctl_by_name(ar->mixer, attr_name);
-        if (ctl == NULL) {
+        ctl_index = name_index_find(ar, &ar->ctl_names, ctl_name, attr_name);
+        if (ctl_index == INVALID_INDEX) {
             ALOGE("Control '%s' doesn't exist - skipping", attr_name);
             goto done;
         }
+        ctl = index_to_ctl(ar, ctl_index);
 
         switch (mixer_ctl_get_type(ctl)) {
         case MIXER_CTL_TYPE_BOOL:
@@ -507,41 +760,16 @@ static void start_tag(void *data, const XML_Char *tag_name,
             break;
         }
 
-        /* locate the mixer ctl in the list */
-        for (ctl_index = 0; ctl_index < ar->num_mixer_ctls; ctl_index++) {
-            if (ar->mixer_state[ctl_index].ctl == ctl)
-                break;
-        }
-
         if (state->level == 1) {
             /* top level ctl (initial setting) */
-
-            type = mixer_ctl_get_type(ctl);
-            if (is_supported_ctl_type(type)) {
-                /* apply the new value */
-                if (attr_id) {
-                    /* set only one value */
-                    id = atoi((char *)attr_id);
-                    if (id < ar->mixer_state[ctl_index].num_values)
-                        if (type == MIXER_CTL_TYPE_BYTE)
-                            ar->mixer_state[ctl_index].new_value.bytes[id] = value;
-                        else if (type == MIXER_CTL_TYPE_ENUM)
-                            ar->mixer_state[ctl_index].new_value.enumerated[id] = value;
-                        else
-                            ar->mixer_state[ctl_index].new_value.integer[id] = value;
-                    else
-                        ALOGE("value id out of range for mixer ctl '%s'",
-                              mixer_ctl_get_name(ctl));
-                } else {
-                    /* set all values the same */
-                    for (i = 0; i < ar->mixer_state[ctl_index].num_values; i++)
-                        if (type == MIXER_CTL_TYPE_BYTE)
-                            ar->mixer_state[ctl_index].new_value.bytes[i] = value;
-                        else if (type == MIXER_CTL_TYPE_ENUM)
-                            ar->mixer_state[ctl_index].new_value.enumerated[i] = value;
-                        else
-                            ar->mixer_state[ctl_index].new_value.integer[i] = value;
-                }
+            mixer_value.ctl_index = ctl_index;
+            mixer_value.value = value;
+            mixer_value.index = attr_id ? atoi((char *)attr_id) : -1;
+            if (attr_id && mixer_value.index < 0) {
+                ALOGE("value id out of range for mixer ctl '%s'", mixer_ctl_get_name(ctl));
+            } else {
+                mixer_state_set_value(ar, &mixer_value);
+                config_add_initial_value(state, &mixer_value);
             }
         } else {
             /* nested ctl (within a path) */
@@ -567,6 +795,30 @@ static void end_tag(void *data, const XML_Char *tag_name)
     state->level--;
 }
 
+static void free_mixer_state(struct audio_route *ar)
+{
+    unsigned int i;
+    enum mixer_ctl_type type;
+
+    for (i = 0; i < ar->num_mixer_ctls; i++) {
+        type = mixer_ctl_get_type(ar->mixer_state[i].ctl);
+        if (!is_supported_ctl_type(type))
+            continue;
+
+        free(ar->mixer_state[i].old_value.ptr);
+        free(ar->mixer_state[i].new_value.ptr);
+        free(ar->mixer_state[i].reset_value.ptr);
+    }
+
+    free(ar->mixer_state);
+    ar->mixer_state = NULL;
+    free(ar->dirty_ctls);
+    ar->dirty_ctls = NULL;
+    free(ar->update_order);
+    ar->update_order = NULL;
+    name_index_free(&ar->ctl_names);
+}
+
 static int alloc_mixer_state(struct audio_route *ar)
 {
     unsigned int i;
@@ -578,6 +830,15 @@ static int alloc_mixer_state(struct audio_route *ar)
     ar->mixer_state = calloc(ar->num_mixer_ctls, sizeof(struct mixer_state));
     if (!ar->mixer_state)
         return -1;
+    ar->dirty_ctls = calloc((ar->num_mixer_ctls + 31) / 32, sizeof(uint32_t));
+    ar->update_order = calloc(ar->num_mixer_ctls, sizeof(unsigned int));
+    if (!ar->dirty_ctls || !ar->update_order) {
+        free(ar->dirty_ctls);
+        free(ar->update_order);
+        free(ar->mixer_state);
+        ar->mixer_state = NULL;
+        return -1;
+    }
 
     for (i = 0; i < ar->num_mixer_ctls; i++) {
         ctl = mixer_get_ctl(ar->mixer, i);
@@ -585,6 +846,7 @@ static int alloc_mixer_state(struct audio_route *ar)
 
         ar->mixer_state[i].ctl = ctl;
         ar->mixer_state[i].num_values = num_values;
+        ar->mixer_state[i].last_path = INVALID_INDEX;
 
         /* Skip unsupported types that are not supported yet in XML */
         type = mixer_ctl_get_type(ctl);
@@ -606,81 +868,88 @@ static int alloc_mixer_state(struct audio_route *ar)
                num_values * value_sz);
     }
 
+    if (name_index_build(ar, &ar->ctl_names, ctl_name, ar->num_mixer_ctls,
+                         name_index_size(ar->num_mixer_ctls)) < 0) {
+        free_mixer_state(ar);
+        return -1;
+    }
+
     return 0;
 }
 
-static void free_mixer_state(struct audio_route *ar)
+/* Write a ctl to the mixer if its new value differs from the last one written */
+static void mixer_state_update(struct audio_route *ar, unsigned int ctl_index)
 {
-    unsigned int i;
+    struct mixer_state *ms = &ar->mixer_state[ctl_index];
     enum mixer_ctl_type type;
+    size_t value_sz;
 
-    for (i = 0; i < ar->num_mixer_ctls; i++) {
-        type = mixer_ctl_get_type(ar->mixer_state[i].ctl);
-        if (!is_supported_ctl_type(type))
-            continue;
+    clear_ctl_dirty(ar, ctl_index);
 
-        free(ar->mixer_state[i].old_value.ptr);
-        free(ar->mixer_state[i].new_value.ptr);
-        free(ar->mixer_state[i].reset_value.ptr);
-    }
+    /* Skip unsupported types */
+    type = mixer_ctl_get_type(ms->ctl);
+    if (!is_supported_ctl_type(type))
+        return;
 
-    free(ar->mixer_state);
-    ar->mixer_state = NULL;
+    value_sz = sizeof_ctl_type(type);
+    if (memcmp(ms->old_value.ptr, ms->new_value.ptr, ms->num_values * value_sz) == 0)
+        return;
+
+    if (type == MIXER_CTL_TYPE_ENUM)
+        mixer_ctl_set_value(ms->ctl, 0, ms->new_value.enumerated[0]);
+    else
+        mixer_ctl_set_array(ms->ctl, ms->new_value.ptr, ms->num_values);
+
+    memcpy(ms->old_value.ptr, ms->new_value.ptr, ms->num_values * value_sz);
 }
 
-/* Update the mixer with any changed values */
+/* Update the mixer with any changed values, visiting only the dirty ctls in index order */
 int audio_route_update_mixer(struct audio_route *ar)
 {
-    unsigned int i;
-    unsigned int j;
-    struct mixer_ctl *ctl;
+    unsigned int w;
+    uint32_t dirty;
 
-    for (i = 0; i < ar->num_mixer_ctls; i++) {
-        unsigned int num_values = ar->mixer_state[i].num_values;
-        enum mixer_ctl_type type;
+    if (ar->update_depth > 0) {
+        ar->update_mixer_pending = true;
+        return 0;
+    }
 
-        ctl = ar->mixer_state[i].ctl;
+    for (w = 0; w < (ar->num_mixer_ctls + 31) / 32; w++) {
+        for (dirty = ar->dirty_ctls[w]; dirty; dirty &= dirty - 1)
+            mixer_state_update(ar, w * 32 + __builtin_ctz(dirty));
+    }
 
-        /* Skip unsupported types */
-        type = mixer_ctl_get_type(ctl);
-        if (!is_supported_ctl_type(type))
-            continue;
+    return 0;
+}
 
-        /* if the value has changed, update the mixer */
-        bool changed = false;
-        if (type == MIXER_CTL_TYPE_BYTE) {
-            for (j = 0; j < num_values; j++) {
-                if (ar->mixer_state[i].old_value.bytes[j] != ar->mixer_state[i].new_value.bytes[j]) {
-                    changed = true;
-                    break;
-                }
-            }
-         } else if (type == MIXER_CTL_TYPE_ENUM) {
-             for (j = 0; j < num_values; j++) {
-                 if (ar->mixer_state[i].old_value.enumerated[j]
-                         != ar->mixer_state[i].new_value.enumerated[j]) {
-                     changed = true;
-                     break;
-                 }
-             }
-         } else {
-            for (j = 0; j < num_values; j++) {
-                if (ar->mixer_state[i].old_value.integer[j] != ar->mixer_state[i].new_value.integer[j]) {
-                    changed = true;
-                    break;
-                }
-            }
-        }
-        if (changed) {
-            if (type == MIXER_CTL_TYPE_ENUM)
-                mixer_ctl_set_value(ctl, 0, ar->mixer_state[i].new_value.enumerated[0]);
-            else
-                mixer_ctl_set_array(ctl, ar->mixer_state[i].new_value.ptr, num_values);
+/* Defer writes to the mixer until the matching audio_route_end_update() */
+void audio_route_begin_update(struct audio_route *ar)
+{
+    ar->update_depth++;
+}
 
-            size_t value_sz = sizeof_ctl_type(type);
-            memcpy(ar->mixer_state[i].old_value.ptr, ar->mixer_state[i].new_value.ptr,
-                   num_values * value_sz);
-        }
+/* Write the net result of the updates requested since audio_route_begin_update() */
+int audio_route_end_update(struct audio_route *ar)
+{
+    unsigned int i;
+
+    if (ar->update_depth == 0) {
+        ALOGE("audio_route_end_update() without audio_route_begin_update()");
+        return -1;
+    }
+    if (--ar->update_depth > 0)
+        return 0;
+
+    /* ctls of updated paths first, in the order they were first updated */
+    for (i = 0; i < ar->num_queued_ctls; i++) {
+        ar->mixer_state[ar->update_order[i]].queued = false;
+        mixer_state_update(ar, ar->update_order[i]);
+    }
+    ar->num_queued_ctls = 0;
+
+    if (ar->update_mixer_pending) {
+        ar->update_mixer_pending = false;
+        audio_route_update_mixer(ar);
     }
 
     return 0;
@@ -718,169 +987,523 @@ void audio_route_reset(struct audio_route *ar)
         size_t value_sz = sizeof_ctl_type(type);
         memcpy(ar->mixer_state[i].new_value.ptr, ar->mixer_state[i].reset_value.ptr,
             ar->mixer_state[i].num_values * value_sz);
+        mark_ctl_dirty(ar, i);
     }
 }
 
-/* Apply an audio route path by name */
-int audio_route_apply_path(struct audio_route *ar, const char *name)
+/* Look up the id of an audio route path, for use with the functions taking a path id */
+int audio_route_get_path_id(struct audio_route *ar, const char *name)
 {
-    struct mixer_path *path;
+    int path_id;
 
     if (!ar) {
         ALOGE("invalid audio_route");
         return -1;
     }
 
-    path = path_get_by_name(ar, name);
-    if (!path) {
+    path_id = path_get_id_by_name(ar, name);
+    if (path_id < 0)
         ALOGE("unable to find path '%s'", name);
-        return -1;
+
+    return path_id;
+}
+
+static struct mixer_path *path_get_by_id(struct audio_route *ar, int path_id)
+{
+    if (!ar) {
+        ALOGE("invalid audio_route");
+        return NULL;
     }
 
+    if (path_id < 0 || (unsigned int)path_id >= ar->num_mixer_paths) {
+        ALOGE("invalid path id %d", path_id);
+        return NULL;
+    }
+
+    return &ar->mixer_path[path_id];
+}
+
+/* Apply an audio route path by id */
+int audio_route_apply_path_id(struct audio_route *ar, int path_id)
+{
+    struct mixer_path *path = path_get_by_id(ar, path_id);
+
+    if (!path)
+        return -1;
+
     path_apply(ar, path);
 
     return 0;
 }
 
-/* Reset an audio route path by name */
-int audio_route_reset_path(struct audio_route *ar, const char *name)
+/* Apply an audio route path by name */
+int audio_route_apply_path(struct audio_route *ar, const char *name)
 {
-    struct mixer_path *path;
+    return audio_route_apply_path_id(ar, audio_route_get_path_id(ar, name));
+}
 
-    if (!ar) {
-        ALOGE("invalid audio_route");
-        return -1;
-    }
+/* Reset an audio route path by id */
+int audio_route_reset_path_id(struct audio_route *ar, int path_id)
+{
+    struct mixer_path *path = path_get_by_id(ar, path_id);
 
-    path = path_get_by_name(ar, name);
-    if (!path) {
-        ALOGE("unable to find path '%s'", name);
+    if (!path)
         return -1;
-    }
 
     path_reset(ar, path);
 
     return 0;
 }
 
+/* Reset an audio route path by name */
+int audio_route_reset_path(struct audio_route *ar, const char *name)
+{
+    return audio_route_reset_path_id(ar, audio_route_get_path_id(ar, name));
+}
+
+/* Write a ctl now, or when the current deferred update ends */
+static void mixer_state_request_update(struct audio_route *ar, unsigned int ctl_index)
+{
+    if (ar->update_depth == 0) {
+        mixer_state_update(ar, ctl_index);
+    } else if (!ar->mixer_state[ctl_index].queued) {
+        ar->mixer_state[ctl_index].queued = true;
+        ar->update_order[ar->num_queued_ctls++] = ctl_index;
+    }
+}
+
 /*
  * Operates on the specified path .. controls will be updated in the
  * order listed in the XML file
  */
-static int audio_route_update_path(struct audio_route *ar, const char *name, bool reverse)
+static int audio_route_update_path(struct audio_route *ar, int path_id, bool reverse)
 {
     struct mixer_path *path;
     int32_t i, end;
-    unsigned int j;
 
-    if (!ar) {
-        ALOGE("invalid audio_route");
+    path = path_get_by_id(ar, path_id);
+    if (!path)
         return -1;
+
+    i = reverse ? (path->length - 1) : 0;
+    end = reverse ? -1 : (int32_t)path->length;
+
+    while (i != end) {
+        mixer_state_request_update(ar, path->setting[i].ctl_index);
+        i = reverse ? (i - 1) : (i + 1);
     }
+    return 0;
+}
 
-    path = path_get_by_name(ar, name);
-    if (!path) {
-        ALOGE("unable to find path '%s'", name);
+int audio_route_apply_and_update_path_id(struct audio_route *ar, int path_id)
+{
+    if (audio_route_apply_path_id(ar, path_id) < 0) {
         return -1;
     }
+    return audio_route_update_path(ar, path_id, false /*reverse*/);
+}
 
-    i = reverse ? (path->length - 1) : 0;
-    end = reverse ? -1 : (int32_t)path->length;
+int audio_route_apply_and_update_path(struct audio_route *ar, const char *name)
+{
+    return audio_route_apply_and_update_path_id(ar, audio_route_get_path_id(ar, name));
+}
 
-    while (i != end) {
-        unsigned int ctl_index;
-        enum mixer_ctl_type type;
 
-        ctl_index = path->setting[i].ctl_index;
+int audio_route_reset_and_update_path_id(struct audio_route *ar, int path_id)
+{
+    if (audio_route_reset_path_id(ar, path_id) < 0) {
+        return -1;
+    }
+    return audio_route_update_path(ar, path_id, true /*reverse*/);
+}
 
-        struct mixer_state * ms = &ar->mixer_state[ctl_index];
+int audio_route_reset_and_update_path(struct audio_route *ar, const char *name)
+{
+    return audio_route_reset_and_update_path_id(ar, audio_route_get_path_id(ar, name));
+}
 
-        type = mixer_ctl_get_type(ms->ctl);
-        if (!is_supported_ctl_type(type)) {
-            i = reverse ? (i - 1) : (i + 1);
-            continue;
-        }
 
-       size_t value_sz = sizeof_ctl_type(type);
-        /* if any value has changed, update the mixer */
-        for (j = 0; j < ms->num_values; j++) {
-            if (type == MIXER_CTL_TYPE_BYTE) {
-                if (ms->old_value.bytes[j] != ms->new_value.bytes[j]) {
-                    mixer_ctl_set_array(ms->ctl, ms->new_value.bytes, ms->num_values);
-                    memcpy(ms->old_value.bytes, ms->new_value.bytes, ms->num_values * value_sz);
-                    break;
-                }
-            } else if (type == MIXER_CTL_TYPE_ENUM) {
-                if (ms->old_value.enumerated[j] != ms->new_value.enumerated[j]) {
-                    mixer_ctl_set_value(ms->ctl, 0, ms->new_value.enumerated[0]);
-                    memcpy(ms->old_value.enumerated, ms->new_value.enumerated,
-                            ms->num_values * value_sz);
-                    break;
-                }
-            } else if (ms->old_value.integer[j] != ms->new_value.integer[j]) {
-                mixer_ctl_set_array(ms->ctl, ms->new_value.integer, ms->num_values);
-                memcpy(ms->old_value.integer, ms->new_value.integer, ms->num_values * value_sz);
-                break;
-            }
-        }
+/*
+ * Reset one path and apply another, then update the mixer with the net change: the ctls
+ * only in the old path in reverse order, as audio_route_reset_and_update_path() would,
+ * followed by the ctls of the new path in order.  A ctl in both paths is written at most
+ * once, with the value of the new path, and none is written if its value doesn't change.
+ */
+int audio_route_switch_path_id(struct audio_route *ar, int from_path_id, int to_path_id)
+{
+    struct mixer_path *from = path_get_by_id(ar, from_path_id);
+    struct mixer_path *to = path_get_by_id(ar, to_path_id);
+    unsigned int i;
 
-        i = reverse ? (i - 1) : (i + 1);
+    if (!from || !to)
+        return -1;
+
+    path_reset(ar, from);
+    path_apply(ar, to);
+
+    for (i = 0; i < to->length; i++)
+        ar->mixer_state[to->setting[i].ctl_index].switching = true;
+    for (i = from->length; i-- > 0; ) {
+        if (!ar->mixer_state[from->setting[i].ctl_index].switching)
+            mixer_state_request_update(ar, from->setting[i].ctl_index);
+    }
+    for (i = 0; i < to->length; i++) {
+        ar->mixer_state[to->setting[i].ctl_index].switching = false;
+        mixer_state_request_update(ar, to->setting[i].ctl_index);
     }
+
     return 0;
 }
 
-int audio_route_apply_and_update_path(struct audio_route *ar, const char *name)
+int audio_route_switch_path(struct audio_route *ar, const char *from_name, const char *to_name)
 {
-    if (audio_route_apply_path(ar, name) < 0) {
+    int from_path_id = audio_route_get_path_id(ar, from_name);
+
+    if (from_path_id < 0)
         return -1;
+    return audio_route_switch_path_id(ar, from_path_id, audio_route_get_path_id(ar, to_name));
+}
+
+/*
+ * Compiled cache of mixer_paths.xml, with ctl indices and enum values resolved.
+ * It is written in native byte order on the device that uses it, as
+ *   struct cache_header
+ *   struct cache_value[num_initial_values]  top level ctl settings, in XML order
+ *   struct cache_path[num_paths]
+ *   struct cache_setting[num_settings]      the settings of every path, one after the other
+ *   path names and CACHE_ALIGN aligned setting values, referenced by offset
+ * and is only used if the XML file and the card's controls are the same as when it was built.
+ */
+struct cache_header {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t file_size;
+    int64_t xml_size;
+    int64_t xml_mtime;
+    uint32_t mixer_hash;
+    uint32_t num_mixer_ctls;
+    uint32_t num_initial_values;
+    uint32_t num_paths;
+    uint32_t num_settings;
+    uint32_t reserved;
+};
+
+struct cache_value {
+    uint32_t ctl_index;
+    int32_t index;
+    int64_t value;
+};
+
+struct cache_path {
+    uint32_t name_offset;
+    uint32_t first_setting;
+    uint32_t num_settings;
+    uint32_t reserved;
+};
+
+struct cache_setting {
+    uint32_t ctl_index;
+    uint32_t type;
+    uint32_t num_values;
+    uint32_t value_offset;
+};
+
+static size_t cache_align(size_t offset)
+{
+    return (offset + CACHE_ALIGN - 1) & ~(size_t)(CACHE_ALIGN - 1);
+}
+
+/* fingerprint of the names, types and sizes of the card's ctls */
+static uint32_t mixer_hash(struct audio_route *ar)
+{
+    uint32_t hash = HASH_INIT;
+    unsigned int i;
+    unsigned int j;
+
+    for (i = 0; i < ar->num_mixer_ctls; i++) {
+        struct mixer_ctl *ctl = ar->mixer_state[i].ctl;
+        uint32_t info[3] = { mixer_ctl_get_type(ctl), ar->mixer_state[i].num_values, 0 };
+        const char *name = mixer_ctl_get_name(ctl);
+
+        if (info[0] == MIXER_CTL_TYPE_ENUM)
+            info[2] = mixer_ctl_get_num_enums(ctl);
+        hash = hash_update(hash, name, strlen(name) + 1);
+        hash = hash_update(hash, info, sizeof(info));
+        for (j = 0; j < info[2]; j++) {
+            name = mixer_ctl_get_enum_string(ctl, j);
+            hash = hash_update(hash, name, strlen(name) + 1);
+        }
     }
-    return audio_route_update_path(ar, name, false /*reverse*/);
+    return hash;
 }
 
-int audio_route_reset_and_update_path(struct audio_route *ar, const char *name)
+static void cache_init_header(struct audio_route *ar, const struct stat *xml_stat,
+                              struct cache_header *header)
 {
-    if (audio_route_reset_path(ar, name) < 0) {
+    memset(header, 0, sizeof(*header));
+    header->magic = CACHE_MAGIC;
+    header->version = CACHE_VERSION;
+    header->xml_size = xml_stat->st_size;
+    header->xml_mtime = xml_stat->st_mtime;
+    header->mixer_hash = mixer_hash(ar);
+    header->num_mixer_ctls = ar->num_mixer_ctls;
+}
+
+/* Load the paths and initial settings from a cache, or return -1 if it is missing or stale */
+static int cache_load(struct audio_route *ar, const char *xml_path, const char *cache_path)
+{
+    struct cache_header header;
+    const struct cache_header *file_header;
+    const struct cache_value *values;
+    const struct cache_path *paths;
+    const struct cache_setting *settings;
+    const unsigned char *map;
+    struct stat xml_stat;
+    struct stat cache_stat;
+    struct mixer_value mixer_value;
+    uint64_t data_offset;
+    unsigned int i;
+    unsigned int j;
+    int fd;
+
+    if (stat(xml_path, &xml_stat) < 0)
         return -1;
+
+    fd = open(cache_path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    if (fstat(fd, &cache_stat) < 0 || cache_stat.st_size < (off_t)sizeof(header)) {
+        close(fd);
+        return -1;
+    }
+    map = mmap(NULL, cache_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return -1;
+
+    /* check that the cache matches the XML file and the card */
+    file_header = (const struct cache_header *)map;
+    cache_init_header(ar, &xml_stat, &header);
+    header.file_size = cache_stat.st_size;
+    header.num_initial_values = file_header->num_initial_values;
+    header.num_paths = file_header->num_paths;
+    header.num_settings = file_header->num_settings;
+    if (memcmp(&header, file_header, sizeof(header)) != 0) {
+        ALOGV("cache %s is out of date", cache_path);
+        goto err_stale;
     }
-    return audio_route_update_path(ar, name, true /*reverse*/);
+
+    values = (const struct cache_value *)(file_header + 1);
+    paths = (const struct cache_path *)(values + header.num_initial_values);
+    settings = (const struct cache_setting *)(paths + header.num_paths);
+    data_offset = sizeof(header) +
+            (uint64_t)header.num_initial_values * sizeof(struct cache_value) +
+            (uint64_t)header.num_paths * sizeof(struct cache_path) +
+            (uint64_t)header.num_settings * sizeof(struct cache_setting);
+    if (data_offset > header.file_size)
+        goto err_invalid;
+
+    /* check every index and offset before using any */
+    for (i = 0; i < header.num_initial_values; i++) {
+        if (values[i].ctl_index >= ar->num_mixer_ctls || values[i].index < -1)
+            goto err_invalid;
+    }
+    for (i = 0; i < header.num_paths; i++) {
+        if (paths[i].name_offset < data_offset || paths[i].name_offset >= header.file_size ||
+                !memchr(map + paths[i].name_offset, 0, header.file_size - paths[i].name_offset) ||
+                paths[i].first_setting > header.num_settings ||
+                paths[i].num_settings > header.num_settings - paths[i].first_setting)
+            goto err_invalid;
+    }
+    for (i = 0; i < header.num_settings; i++) {
+        const struct cache_setting *setting = &settings[i];
+        struct mixer_state *ms;
+
+        if (setting->ctl_index >= ar->num_mixer_ctls)
+            goto err_invalid;
+        ms = &ar->mixer_state[setting->ctl_index];
+        if (setting->type != (uint32_t)mixer_ctl_get_type(ms->ctl) ||
+                !is_supported_ctl_type(setting->type) ||
+                setting->num_values != ms->num_values ||
+                setting->value_offset < data_offset ||
+                setting->value_offset % CACHE_ALIGN != 0 ||
+                setting->value_offset + (uint64_t)setting->num_values *
+                        sizeof_ctl_type(setting->type) > header.file_size)
+            goto err_invalid;
+    }
+
+    /* the paths point into the mapping, which stays until path_free() */
+    ar->mixer_path = calloc(header.num_paths ? header.num_paths : 1, sizeof(struct mixer_path));
+    if (!ar->mixer_path)
+        goto err_stale;
+    ar->cache_map = (void *)map;
+    ar->cache_size = header.file_size;
+    ar->mixer_path_size = header.num_paths;
+    for (i = 0; i < header.num_paths; i++) {
+        struct mixer_path *path = &ar->mixer_path[ar->num_mixer_paths];
+
+        path->name = (char *)map + paths[i].name_offset;
+        if (paths[i].num_settings) {
+            path->setting = calloc(paths[i].num_settings, sizeof(struct mixer_setting));
+            if (!path->setting)
+                goto err_path;
+        }
+        path->size = path->length = paths[i].num_settings;
+        ar->num_mixer_paths++;
+        for (j = 0; j < path->length; j++) {
+            const struct cache_setting *setting = &settings[paths[i].first_setting + j];
+
+            path->setting[j].ctl_index = setting->ctl_index;
+            path->setting[j].num_values = setting->num_values;
+            path->setting[j].type = setting->type;
+            path->setting[j].value.ptr = (void *)(map + setting->value_offset);
+        }
+    }
+    if (name_index_build(ar, &ar->path_names, path_name, ar->num_mixer_paths,
+                         name_index_size(ar->num_mixer_paths)) < 0)
+        goto err_path;
+
+    for (i = 0; i < header.num_initial_values; i++) {
+        mixer_value.ctl_index = values[i].ctl_index;
+        mixer_value.index = values[i].index;
+        mixer_value.value = values[i].value;
+        mixer_state_set_value(ar, &mixer_value);
+    }
+
+    return 0;
+
+err_path:
+    ALOGE("Unable to allocate paths from cache %s", cache_path);
+    path_free(ar);
+    return -1;
+err_invalid:
+    ALOGE("cache %s is corrupt", cache_path);
+err_stale:
+    munmap((void *)map, cache_stat.st_size);
+    return -1;
 }
 
-struct audio_route *audio_route_init(unsigned int card, const char *xml_path)
+/* Write the paths and initial settings just parsed from the XML file to a new cache */
+static int cache_save(struct config_parse_state *state, const char *xml_path,
+                      const char *cache_path)
 {
-    struct config_parse_state state;
-    XML_Parser parser;
-    FILE *file;
-    int bytes_read;
-    void *buf;
-    struct audio_route *ar;
+    struct audio_route *ar = state->ar;
+    struct cache_header *header;
+    struct cache_value *values;
+    struct cache_path *paths;
+    struct cache_setting *settings;
+    unsigned char *buf;
+    char temp_path[PATH_MAX];
+    struct stat xml_stat;
+    size_t num_settings = 0;
+    size_t size;
+    size_t offset;
+    unsigned int i;
+    unsigned int j;
+    int fd;
+    int ret = -1;
 
-    ar = calloc(1, sizeof(struct audio_route));
-    if (!ar)
-        goto err_calloc;
+    if (state->initial_value_error || stat(xml_path, &xml_stat) < 0)
+        return -1;
 
-    ar->mixer = mixer_open(card);
-    if (!ar->mixer) {
-        ALOGE("Unable to open the mixer, aborting.");
-        goto err_mixer_open;
+    /* size the file, then fill it in */
+    for (i = 0; i < ar->num_mixer_paths; i++)
+        num_settings += ar->mixer_path[i].length;
+    size = sizeof(*header) + state->num_initial_values * sizeof(*values) +
+            ar->num_mixer_paths * sizeof(*paths) + num_settings * sizeof(*settings);
+    for (i = 0; i < ar->num_mixer_paths; i++) {
+        struct mixer_path *path = &ar->mixer_path[i];
+
+        size += strlen(path->name) + 1;
+        for (j = 0; j < path->length; j++)
+            size = cache_align(size) +
+                    path->setting[j].num_values * sizeof_ctl_type(path->setting[j].type);
+    }
+    if (size > UINT32_MAX)
+        return -1;
+
+    buf = calloc(1, size);
+    if (!buf)
+        return -1;
+    header = (struct cache_header *)buf;
+    values = (struct cache_value *)(header + 1);
+    paths = (struct cache_path *)(values + state->num_initial_values);
+    settings = (struct cache_setting *)(paths + ar->num_mixer_paths);
+    cache_init_header(ar, &xml_stat, header);
+    header->file_size = size;
+    header->num_initial_values = state->num_initial_values;
+    header->num_paths = ar->num_mixer_paths;
+    header->num_settings = num_settings;
+
+    for (i = 0; i < state->num_initial_values; i++) {
+        values[i].ctl_index = state->initial_value[i].ctl_index;
+        values[i].index = state->initial_value[i].index;
+        values[i].value = state->initial_value[i].value;
+    }
+    offset = (unsigned char *)(settings + num_settings) - buf;
+    num_settings = 0;
+    for (i = 0; i < ar->num_mixer_paths; i++) {
+        struct mixer_path *path = &ar->mixer_path[i];
+
+        paths[i].name_offset = offset;
+        paths[i].first_setting = num_settings;
+        paths[i].num_settings = path->length;
+        strcpy((char *)buf + offset, path->name);
+        offset += strlen(path->name) + 1;
+        for (j = 0; j < path->length; j++) {
+            struct cache_setting *setting = &settings[num_settings++];
+            size_t value_sz = path->setting[j].num_values * sizeof_ctl_type(path->setting[j].type);
+
+            offset = cache_align(offset);
+            setting->ctl_index = path->setting[j].ctl_index;
+            setting->type = path->setting[j].type;
+            setting->num_values = path->setting[j].num_values;
+            setting->value_offset = offset;
+            memcpy(buf + offset, path->setting[j].value.ptr, value_sz);
+            offset += value_sz;
+        }
     }
 
-    ar->mixer_path = NULL;
-    ar->mixer_path_size = 0;
-    ar->num_mixer_paths = 0;
+    /* replace any old cache atomically */
+    if (snprintf(temp_path, sizeof(temp_path), "%s.tmp", cache_path) >= (int)sizeof(temp_path))
+        goto done;
+    fd = open(temp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        ALOGW("Unable to create cache %s: %s", temp_path, strerror(errno));
+        goto done;
+    }
+    if (write(fd, buf, size) != (ssize_t)size || fsync(fd) < 0) {
+        ALOGW("Unable to write cache %s: %s", temp_path, strerror(errno));
+        close(fd);
+        unlink(temp_path);
+        goto done;
+    }
+    close(fd);
+    if (rename(temp_path, cache_path) < 0) {
+        ALOGW("Unable to rename cache %s: %s", temp_path, strerror(errno));
+        unlink(temp_path);
+        goto done;
+    }
+    ret = 0;
 
-    /* allocate space for and read current mixer settings */
-    if (alloc_mixer_state(ar) < 0)
-        goto err_mixer_state;
+done:
+    free(buf);
+    return ret;
+}
 
-    /* use the default XML path if none is provided */
-    if (xml_path == NULL)
-        xml_path = MIXER_XML_PATH;
+static int config_parse(struct config_parse_state *state, const char *xml_path)
+{
+    XML_Parser parser;
+    FILE *file;
+    int bytes_read;
+    void *buf;
+    int ret = -1;
 
     file = fopen(xml_path, "r");
 
     if (!file) {
         ALOGE("Failed to open %s", xml_path);
-        goto err_fopen;
+        return -1;
     }
 
     parser = XML_ParserCreate(NULL);
@@ -889,9 +1512,7 @@ struct audio_route *audio_route_init(unsigned int card, const char *xml_path)
         goto err_parser_create;
     }
 
-    memset(&state, 0, sizeof(state));
-    state.ar = ar;
-    XML_SetUserData(parser, &state);
+    XML_SetUserData(parser, state);
     XML_SetElementHandler(parser, start_tag, end_tag);
 
     for (;;) {
@@ -912,22 +1533,64 @@ struct audio_route *audio_route_init(unsigned int card, const char *xml_path)
         if (bytes_read == 0)
             break;
     }
+    ret = 0;
+
+err_parse:
+    XML_ParserFree(parser);
+err_parser_create:
+    fclose(file);
+    return ret;
+}
+
+struct audio_route *audio_route_init_cached(unsigned int card, const char *xml_path,
+                                            const char *cache_path)
+{
+    struct config_parse_state state;
+    struct audio_route *ar;
+
+    ar = calloc(1, sizeof(struct audio_route));
+    if (!ar)
+        goto err_calloc;
+
+    ar->mixer = mixer_open(card);
+    if (!ar->mixer) {
+        ALOGE("Unable to open the mixer, aborting.");
+        goto err_mixer_open;
+    }
+
+    ar->mixer_path = NULL;
+    ar->mixer_path_size = 0;
+    ar->num_mixer_paths = 0;
+
+    /* allocate space for and read current mixer settings */
+    if (alloc_mixer_state(ar) < 0)
+        goto err_mixer_state;
+
+    /* use the default XML path if none is provided */
+    if (xml_path == NULL)
+        xml_path = MIXER_XML_PATH;
+
+    memset(&state, 0, sizeof(state));
+    state.ar = ar;
+
+    if (cache_path == NULL || cache_load(ar, xml_path, cache_path) < 0) {
+        if (config_parse(&state, xml_path) < 0)
+            goto err_parse;
+        if (cache_path != NULL && cache_save(&state, xml_path, cache_path) < 0)
+            ALOGW("Unable to save cache %s", cache_path);
+    }
+    free(state.initial_value);
 
     /* apply the initial mixer values, and save them so we can reset the
        mixer to the original values */
     audio_route_update_mixer(ar);
     save_mixer_state(ar);
 
-    XML_ParserFree(parser);
-    fclose(file);
     return ar;
 
 err_parse:
+    free(state.initial_value);
     path_free(ar);
-    XML_ParserFree(parser);
-err_parser_create:
-    fclose(file);
-err_fopen:
     free_mixer_state(ar);
 err_mixer_state:
     mixer_close(ar->mixer);
@@ -938,6 +1601,11 @@ err_calloc:
     return NULL;
 }
 
+struct audio_route *audio_route_init(unsigned int card, const char *xml_path)
+{
+    return audio_route_init_cached(card, xml_path, NULL);
+}
+
 void audio_route_free(struct audio_route *ar)
 {
     free_mixer_state(ar);
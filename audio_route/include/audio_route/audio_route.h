@@ -25,6 +25,14 @@ extern "C" {
 struct audio_route *audio_route_init(unsigned int card, const char *xml_path);
 void audio_route_free(struct audio_route *ar);
 
+/*
+ * Initialize the audio routes from a compiled cache of the XML file at cache_path, which
+ * is loaded with mmap and used only if it was built from the same XML file for the same
+ * mixer controls.  Otherwise the XML file is parsed, and the cache is rewritten.
+ */
+struct audio_route *audio_route_init_cached(unsigned int card, const char *xml_path,
+                                            const char *cache_path);
+
 /* Apply an audio route path by name */
 int audio_route_apply_path(struct audio_route *ar, const char *name);
 
@@ -37,12 +45,53 @@ int audio_route_reset_path(struct audio_route *ar, const char *name);
 /* Reset and update mixer with audio route path by name */
 int audio_route_reset_and_update_path(struct audio_route *ar, const char *name);
 
+/*
+ * Look up the id of an audio route path by name, or return -1 if there is none.
+ * Ids stay valid until audio_route_free(), so a path can be resolved once and then
+ * applied or reset without a lookup by name.
+ */
+int audio_route_get_path_id(struct audio_route *ar, const char *name);
+
+/* Apply an audio route path by id */
+int audio_route_apply_path_id(struct audio_route *ar, int path_id);
+
+/* Apply and update mixer with audio route path by id */
+int audio_route_apply_and_update_path_id(struct audio_route *ar, int path_id);
+
+/* Reset an audio route path by id */
+int audio_route_reset_path_id(struct audio_route *ar, int path_id);
+
+/* Reset and update mixer with audio route path by id */
+int audio_route_reset_and_update_path_id(struct audio_route *ar, int path_id);
+
+/*
+ * Switch from one audio route path to another and update the mixer, writing only the
+ * controls whose final value differs: the controls only in the old path are reset first,
+ * in reverse order, then the controls of the new path are written in order.
+ */
+int audio_route_switch_path(struct audio_route *ar, const char *from_name, const char *to_name);
+
+/* Switch from one audio route path to another by id and update the mixer */
+int audio_route_switch_path_id(struct audio_route *ar, int from_path_id, int to_path_id);
+
 /* Reset the audio routes back to the initial state */
 void audio_route_reset(struct audio_route *ar);
 
 /* Update the mixer with any changed values */
 int audio_route_update_mixer(struct audio_route *ar);
 
+/*
+ * Defer the mixer writes of audio_route_update_mixer() and the *_and_update_path functions
+ * until the matching audio_route_end_update().  Calls may be nested.
+ */
+void audio_route_begin_update(struct audio_route *ar);
+
+/*
+ * End a deferred update.  Each control is written at most once, with its final value and
+ * only if that differs from the mixer, in the order the paths were updated.
+ */
+int audio_route_end_update(struct audio_route *ar);
+
 #if defined(__cplusplus)
 }  /* extern "C" */
 #endif
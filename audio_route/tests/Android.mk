@@ -0,0 +1,16 @@
+# Build the unit tests for audio_route, with a fake mixer in place of tinyalsa
+LOCAL_PATH:= $(call my-dir)
+
+include $(CLEAR_VARS)
+LOCAL_C_INCLUDES += \
+	$(LOCAL_PATH)/../include \
+	external/tinyalsa/include \
+	external/expat/lib
+LOCAL_SRC_FILES := \
+	../audio_route.c \
+	audio_route_tests.cpp
+LOCAL_MODULE := audio_route_tests
+LOCAL_MODULE_TAGS := tests
+LOCAL_SHARED_LIBRARIES := liblog libcutils libexpat
+LOCAL_CFLAGS := -Werror -Wall
+include $(BUILD_NATIVE_TEST)
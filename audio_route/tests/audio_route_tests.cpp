@@ -0,0 +1,605 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "audio_route_tests"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+#include <audio_route/audio_route.h>
+#include <tinyalsa/asoundlib.h>
+
+/*
+ * A fake mixer, standing in for the tinyalsa one that audio_route.c is built with here.
+ * mixer_open() copies the controls of gCard, and every write is recorded in gWrites.
+ */
+struct mixer_ctl {
+    std::string name;
+    enum mixer_ctl_type type;
+    std::vector<long> values;
+    std::vector<std::string> enums;
+};
+
+struct mixer {
+    std::vector<mixer_ctl> ctls;
+};
+
+struct Write {
+    std::string name;
+    std::vector<long> values;
+};
+
+static std::vector<mixer_ctl> gCard;
+static struct mixer *gMixer;
+static std::vector<Write> gWrites;
+
+static void recordWrite(struct mixer_ctl *ctl)
+{
+    gWrites.push_back(Write{ ctl->name, ctl->values });
+}
+
+extern "C" {
+
+struct mixer *mixer_open(unsigned int card)
+{
+    if (card != 0) {
+        return NULL;
+    }
+    gMixer = new mixer{ gCard };
+    return gMixer;
+}
+
+void mixer_close(struct mixer *mixer)
+{
+    if (mixer == gMixer) {
+        gMixer = NULL;
+    }
+    delete mixer;
+}
+
+unsigned int mixer_get_num_ctls(struct mixer *mixer)
+{
+    return mixer->ctls.size();
+}
+
+struct mixer_ctl *mixer_get_ctl(struct mixer *mixer, unsigned int id)
+{
+    return id < mixer->ctls.size() ? &mixer->ctls[id] : NULL;
+}
+
+const char *mixer_ctl_get_name(struct mixer_ctl *ctl)
+{
+    return ctl->name.c_str();
+}
+
+enum mixer_ctl_type mixer_ctl_get_type(struct mixer_ctl *ctl)
+{
+    return ctl->type;
+}
+
+unsigned int mixer_ctl_get_num_values(struct mixer_ctl *ctl)
+{
+    return ctl->values.size();
+}
+
+unsigned int mixer_ctl_get_num_enums(struct mixer_ctl *ctl)
+{
+    return ctl->enums.size();
+}
+
+const char *mixer_ctl_get_enum_string(struct mixer_ctl *ctl, unsigned int enum_id)
+{
+    return enum_id < ctl->enums.size() ? ctl->enums[enum_id].c_str() : NULL;
+}
+
+int mixer_ctl_get_value(struct mixer_ctl *ctl, unsigned int id)
+{
+    return id < ctl->values.size() ? ctl->values[id] : -EINVAL;
+}
+
+int mixer_ctl_get_array(struct mixer_ctl *ctl, void *array, size_t count)
+{
+    if (count > ctl->values.size()) {
+        return -EINVAL;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        switch (ctl->type) {
+        case MIXER_CTL_TYPE_BYTE:
+            ((unsigned char *)array)[i] = ctl->values[i];
+            break;
+        case MIXER_CTL_TYPE_ENUM:
+            ((int *)array)[i] = ctl->values[i];
+            break;
+        default:
+            ((long *)array)[i] = ctl->values[i];
+            break;
+        }
+    }
+    return 0;
+}
+
+int mixer_ctl_set_value(struct mixer_ctl *ctl, unsigned int id, int value)
+{
+    if (id >= ctl->values.size()) {
+        return -EINVAL;
+    }
+    ctl->values[id] = value;
+    recordWrite(ctl);
+    return 0;
+}
+
+int mixer_ctl_set_array(struct mixer_ctl *ctl, const void *array, size_t count)
+{
+    if (count > ctl->values.size()) {
+        return -EINVAL;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        switch (ctl->type) {
+        case MIXER_CTL_TYPE_BYTE:
+            ctl->values[i] = ((const unsigned char *)array)[i];
+            break;
+        case MIXER_CTL_TYPE_ENUM:
+            ctl->values[i] = ((const int *)array)[i];
+            break;
+        default:
+            ctl->values[i] = ((const long *)array)[i];
+            break;
+        }
+    }
+    recordWrite(ctl);
+    return 0;
+}
+
+} // extern "C"
+
+static std::string tempPath(const char *name)
+{
+#ifdef __ANDROID__
+    std::string path("/data/local/tmp/");
+#else
+    std::string path("/tmp/");
+#endif
+    return path + name + "_" + std::to_string(getpid());
+}
+
+static void writeFile(const std::string &path, const std::string &contents)
+{
+    FILE *file = fopen(path.c_str(), "w");
+    ASSERT_NE(nullptr, file);
+    EXPECT_EQ(contents.size(), fwrite(contents.data(), 1, contents.size(), file));
+    fclose(file);
+}
+
+// a card with a control of each supported type
+static void setUpCard()
+{
+    gCard = {
+        { "Switch", MIXER_CTL_TYPE_BOOL, { 0 }, {} },
+        { "Volume", MIXER_CTL_TYPE_INT, { 10, 10 }, {} },
+        { "Mux", MIXER_CTL_TYPE_ENUM, { 0 }, { "Off", "ADC", "DMIC" } },
+        { "Coeffs", MIXER_CTL_TYPE_BYTE, { 0, 0, 0, 0 }, {} },
+        { "Gain", MIXER_CTL_TYPE_INT, { 0 }, {} },
+    };
+    gWrites.clear();
+}
+
+static const char *kPaths =
+        "<mixer>\n"
+        "  <ctl name=\"Volume\" value=\"20\" />\n"
+        "  <path name=\"speaker\">\n"
+        "    <ctl name=\"Switch\" value=\"1\" />\n"
+        "    <ctl name=\"Volume\" value=\"25\" />\n"
+        "    <ctl name=\"Volume\" id=\"1\" value=\"30\" />\n"
+        "  </path>\n"
+        "  <path name=\"mic\">\n"
+        "    <ctl name=\"Mux\" value=\"DMIC\" />\n"
+        "    <ctl name=\"Coeffs\" value=\"a5\" />\n"
+        "    <ctl name=\"Coeffs\" id=\"2\" value=\"3c\" />\n"
+        "  </path>\n"
+        "  <path name=\"speaker-and-mic\">\n"
+        "    <path name=\"speaker\" />\n"
+        "    <path name=\"mic\" />\n"
+        "    <ctl name=\"Gain\" value=\"4\" />\n"
+        "  </path>\n"
+        "</mixer>\n";
+
+static struct audio_route *initRoute(const std::string &xml)
+{
+    const std::string path = tempPath("audio_route_tests.xml");
+    writeFile(path, xml);
+    struct audio_route *ar = audio_route_init(0, path.c_str());
+    unlink(path.c_str());
+    return ar;
+}
+
+static const mixer_ctl &ctl(const char *name)
+{
+    for (const mixer_ctl &ctl : gMixer->ctls) {
+        if (ctl.name == name) {
+            return ctl;
+        }
+    }
+    ADD_FAILURE() << "no ctl " << name;
+    return gMixer->ctls[0];
+}
+
+TEST(audio_route, init) {
+    setUpCard();
+    ASSERT_EQ(nullptr, audio_route_init(1, NULL));
+
+    struct audio_route *ar = initRoute(kPaths);
+    ASSERT_NE(nullptr, ar);
+    // only the top level setting is written
+    ASSERT_EQ(1u, gWrites.size());
+    EXPECT_EQ("Volume", gWrites[0].name);
+    EXPECT_EQ((std::vector<long>{ 20, 20 }), ctl("Volume").values);
+    EXPECT_EQ((std::vector<long>{ 0 }), ctl("Switch").values);
+    audio_route_free(ar);
+
+    EXPECT_EQ(nullptr, initRoute("<mixer><path name=\"unterminated\"></mixer>"));
+    EXPECT_EQ(nullptr, gMixer);
+}
+
+TEST(audio_route, apply_and_reset_path) {
+    setUpCard();
+    struct audio_route *ar = initRoute(kPaths);
+    ASSERT_NE(nullptr, ar);
+
+    EXPECT_EQ(0, audio_route_apply_path(ar, "speaker-and-mic"));
+    EXPECT_EQ(0, audio_route_update_mixer(ar));
+    EXPECT_EQ((std::vector<long>{ 1 }), ctl("Switch").values);
+    EXPECT_EQ((std::vector<long>{ 25, 30 }), ctl("Volume").values);
+    EXPECT_EQ((std::vector<long>{ 2 }), ctl("Mux").values);
+    EXPECT_EQ((std::vector<long>{ 0xa5, 0xa5, 0x3c, 0xa5 }), ctl("Coeffs").values);
+    EXPECT_EQ((std::vector<long>{ 4 }), ctl("Gain").values);
+
+    // back to the values after init
+    EXPECT_EQ(0, audio_route_reset_path(ar, "speaker-and-mic"));
+    EXPECT_EQ(0, audio_route_update_mixer(ar));
+    EXPECT_EQ((std::vector<long>{ 0 }), ctl("Switch").values);
+    EXPECT_EQ((std::vector<long>{ 20, 20 }), ctl("Volume").values);
+    EXPECT_EQ((std::vector<long>{ 0 }), ctl("Mux").values);
+    EXPECT_EQ((std::vector<long>{ 0, 0, 0, 0 }), ctl("Coeffs").values);
+    EXPECT_EQ((std::vector<long>{ 0 }), ctl("Gain").values);
+
+    EXPECT_EQ(-1, audio_route_apply_path(ar, "headphones"));
+    EXPECT_EQ(-1, audio_route_reset_path(ar, "headphones"));
+    audio_route_free(ar);
+}
+
+TEST(audio_route, path_id) {
+    // enough paths to grow the name index several times
+    const size_t count = 300;
+    std::string xml("<mixer>\n");
+    for (size_t i = 0; i < count; ++i) {
+        xml += "<path name=\"path" + std::to_string(i) + "\">"
+                "<ctl name=\"Gain\" value=\"" + std::to_string(i) + "\" /></path>\n";
+    }
+    xml += "</mixer>\n";
+    setUpCard();
+    struct audio_route *ar = initRoute(xml);
+    ASSERT_NE(nullptr, ar);
+
+    std::vector<int> ids(count);
+    for (size_t i = 0; i < count; ++i) {
+        ids[i] = audio_route_get_path_id(ar, ("path" + std::to_string(i)).c_str());
+        ASSERT_GE(ids[i], 0) << "path" << i;
+        for (size_t j = 0; j < i; ++j) {
+            ASSERT_NE(ids[j], ids[i]) << "path" << j << " path" << i;
+        }
+    }
+    EXPECT_EQ(-1, audio_route_get_path_id(ar, "path"));
+    EXPECT_EQ(-1, audio_route_get_path_id(ar, "path300"));
+    EXPECT_EQ(-1, audio_route_get_path_id(NULL, "path0"));
+
+    // by id, in an order unrelated to the XML
+    for (size_t i = 0; i < count; ++i) {
+        const size_t k = (i * 7) % count;
+        ASSERT_EQ(0, audio_route_apply_path_id(ar, ids[k]));
+        ASSERT_EQ(0, audio_route_update_mixer(ar));
+        ASSERT_EQ((std::vector<long>{ (long)k }), ctl("Gain").values) << "path" << k;
+    }
+    EXPECT_EQ(0, audio_route_reset_path_id(ar, ids[0]));
+    EXPECT_EQ(-1, audio_route_apply_path_id(ar, -1));
+    EXPECT_EQ(-1, audio_route_apply_path_id(ar, count));
+    EXPECT_EQ(-1, audio_route_reset_path_id(ar, count));
+    EXPECT_EQ(-1, audio_route_apply_path_id(NULL, ids[0]));
+    audio_route_free(ar);
+}
+
+static std::vector<std::string> writtenNames()
+{
+    std::vector<std::string> names;
+    for (const Write &write : gWrites) {
+        names.push_back(write.name);
+    }
+    gWrites.clear();
+    return names;
+}
+
+// enough ctls to span several words of the dirty set
+static struct audio_route *initLargeRoute()
+{
+    setUpCard();
+    for (size_t i = 0; i < 100; ++i) {
+        gCard.push_back({ "Ctl" + std::to_string(i), MIXER_CTL_TYPE_INT, { 0 }, {} });
+    }
+    return initRoute(
+            "<mixer>\n"
+            "  <path name=\"high\">\n"
+            "    <ctl name=\"Ctl70\" value=\"1\" />\n"
+            "    <ctl name=\"Ctl33\" value=\"1\" />\n"
+            "    <ctl name=\"Ctl95\" value=\"0\" />\n"
+            "  </path>\n"
+            "  <path name=\"low\">\n"
+            "    <ctl name=\"Switch\" value=\"1\" />\n"
+            "    <ctl name=\"Ctl33\" value=\"2\" />\n"
+            "  </path>\n"
+            "</mixer>\n");
+}
+
+TEST(audio_route, update_mixer) {
+    struct audio_route *ar = initLargeRoute();
+    ASSERT_NE(nullptr, ar);
+    EXPECT_TRUE(gWrites.empty());
+
+    // only the ctls that change are written, in index order
+    EXPECT_EQ(0, audio_route_apply_path(ar, "high"));
+    EXPECT_EQ(0, audio_route_update_mixer(ar));
+    EXPECT_EQ((std::vector<std::string>{ "Ctl33", "Ctl70" }), writtenNames());
+    EXPECT_EQ(0, audio_route_update_mixer(ar));
+    EXPECT_TRUE(gWrites.empty());
+
+    EXPECT_EQ(0, audio_route_apply_path(ar, "low"));
+    EXPECT_EQ(0, audio_route_update_mixer(ar));
+    EXPECT_EQ((std::vector<std::string>{ "Switch", "Ctl33" }), writtenNames());
+    EXPECT_EQ((std::vector<long>{ 2 }), ctl("Ctl33").values);
+
+    // back to the initial values
+    audio_route_reset(ar);
+    EXPECT_EQ(0, audio_route_update_mixer(ar));
+    EXPECT_EQ((std::vector<std::string>{ "Switch", "Ctl33", "Ctl70" }), writtenNames());
+    EXPECT_EQ((std::vector<long>{ 0 }), ctl("Ctl33").values);
+
+    // by path, in the XML order, or its reverse to reset
+    EXPECT_EQ(0, audio_route_apply_and_update_path(ar, "high"));
+    EXPECT_EQ((std::vector<std::string>{ "Ctl70", "Ctl33" }), writtenNames());
+    EXPECT_EQ(0, audio_route_reset_and_update_path(ar, "high"));
+    EXPECT_EQ((std::vector<std::string>{ "Ctl33", "Ctl70" }), writtenNames());
+    EXPECT_EQ(-1, audio_route_apply_and_update_path(ar, "none"));
+    EXPECT_EQ(-1, audio_route_reset_and_update_path(ar, "none"));
+    EXPECT_EQ(0, audio_route_update_mixer(ar));
+    EXPECT_TRUE(gWrites.empty());
+    audio_route_free(ar);
+}
+
+TEST(audio_route, deferred_update) {
+    struct audio_route *ar = initLargeRoute();
+    ASSERT_NE(nullptr, ar);
+    EXPECT_EQ(-1, audio_route_end_update(ar));
+
+    // each ctl is written once with its final value, in the order the paths were updated
+    audio_route_begin_update(ar);
+    EXPECT_EQ(0, audio_route_apply_and_update_path(ar, "high"));
+    EXPECT_EQ(0, audio_route_reset_and_update_path(ar, "high"));
+    audio_route_begin_update(ar);
+    EXPECT_EQ(0, audio_route_apply_and_update_path(ar, "low"));
+    EXPECT_EQ(0, audio_route_end_update(ar));
+    EXPECT_TRUE(gWrites.empty());
+    EXPECT_EQ(0, audio_route_end_update(ar));
+    ASSERT_EQ(2u, gWrites.size());
+    EXPECT_EQ("Ctl33", gWrites[0].name);
+    EXPECT_EQ((std::vector<long>{ 2 }), gWrites[0].values);
+    EXPECT_EQ("Switch", gWrites[1].name);
+    gWrites.clear();
+
+    // a deferred audio_route_update_mixer() follows the ctls of the updated paths
+    audio_route_begin_update(ar);
+    EXPECT_EQ(0, audio_route_apply_path(ar, "high"));
+    EXPECT_EQ(0, audio_route_update_mixer(ar));
+    EXPECT_EQ(0, audio_route_reset_and_update_path(ar, "low"));
+    EXPECT_TRUE(gWrites.empty());
+    EXPECT_EQ(0, audio_route_end_update(ar));
+    EXPECT_EQ((std::vector<std::string>{ "Ctl33", "Switch", "Ctl70" }), writtenNames());
+    EXPECT_EQ((std::vector<long>{ 0 }), ctl("Ctl33").values);
+    EXPECT_EQ((std::vector<long>{ 1 }), ctl("Ctl70").values);
+    EXPECT_EQ(-1, audio_route_end_update(ar));
+    audio_route_free(ar);
+}
+
+static bool isCache(const std::string &path)
+{
+    FILE *file = fopen(path.c_str(), "r");
+    if (file == nullptr) {
+        return false;
+    }
+    char magic[4];
+    const bool ok = fread(magic, 1, sizeof(magic), file) == sizeof(magic) &&
+            memcmp(magic, "PARC", sizeof(magic)) == 0;
+    fclose(file);
+    return ok;
+}
+
+static void patchCache(const std::string &path, off_t offset, uint32_t value)
+{
+    int fd = open(path.c_str(), O_WRONLY);
+    ASSERT_GE(fd, 0);
+    EXPECT_EQ((ssize_t)sizeof(value), pwrite(fd, &value, sizeof(value), offset));
+    close(fd);
+}
+
+// the values that the paths of kPaths set, for comparing a cached route with a parsed one
+static std::vector<std::vector<long>> applyAll(struct audio_route *ar)
+{
+    std::vector<std::vector<long>> values;
+    for (const char *name : { "speaker", "mic", "speaker-and-mic" }) {
+        EXPECT_EQ(0, audio_route_apply_and_update_path(ar, name));
+        for (const mixer_ctl &ctl : gMixer->ctls) {
+            values.push_back(ctl.values);
+        }
+        EXPECT_EQ(0, audio_route_reset_and_update_path(ar, name));
+    }
+    return values;
+}
+
+TEST(audio_route, cache) {
+    const std::string xmlPath = tempPath("audio_route_tests_cache.xml");
+    const std::string cachePath = tempPath("audio_route_tests.cache");
+    unlink(cachePath.c_str());
+    setUpCard();
+    writeFile(xmlPath, kPaths);
+
+    // parsed, then written to the cache
+    struct audio_route *ar = audio_route_init_cached(0, xmlPath.c_str(), cachePath.c_str());
+    ASSERT_NE(nullptr, ar);
+    EXPECT_TRUE(isCache(cachePath));
+    const std::vector<std::vector<long>> expected = applyAll(ar);
+    audio_route_free(ar);
+
+    // an XML file of the same size and time is not parsed again
+    struct stat xmlStat;
+    ASSERT_EQ(0, stat(xmlPath.c_str(), &xmlStat));
+    std::string changed(kPaths);
+    changed.replace(changed.find("value=\"20\""), 10, "value=\"21\"");
+    writeFile(xmlPath, changed);
+    struct timespec times[2] = { xmlStat.st_atim, xmlStat.st_mtim };
+    ASSERT_EQ(0, utimensat(AT_FDCWD, xmlPath.c_str(), times, 0));
+    setUpCard();
+    ar = audio_route_init_cached(0, xmlPath.c_str(), cachePath.c_str());
+    ASSERT_NE(nullptr, ar);
+    EXPECT_EQ((std::vector<long>{ 20, 20 }), ctl("Volume").values);
+    EXPECT_EQ(expected, applyAll(ar));
+    EXPECT_EQ(-1, audio_route_get_path_id(ar, "headphones"));
+    audio_route_free(ar);
+
+    // nor is it without a cache
+    setUpCard();
+    ar = audio_route_init_cached(0, xmlPath.c_str(), NULL);
+    ASSERT_NE(nullptr, ar);
+    EXPECT_EQ((std::vector<long>{ 21, 21 }), ctl("Volume").values);
+    audio_route_free(ar);
+
+    // a card with other controls makes the cache stale, and it is rebuilt
+    setUpCard();
+    gCard[2].enums[2] = "AMIC";
+    ar = audio_route_init_cached(0, xmlPath.c_str(), cachePath.c_str());
+    ASSERT_NE(nullptr, ar);
+    EXPECT_EQ((std::vector<long>{ 21, 21 }), ctl("Volume").values);
+    audio_route_free(ar);
+    writeFile(xmlPath, kPaths);
+    setUpCard();
+    ar = audio_route_init_cached(0, xmlPath.c_str(), cachePath.c_str());
+    ASSERT_NE(nullptr, ar);
+    EXPECT_EQ((std::vector<long>{ 20, 20 }), ctl("Volume").values);
+    EXPECT_EQ(expected, applyAll(ar));
+    audio_route_free(ar);
+
+    // a corrupt cache is not used: too many settings for the file size, or a setting of a
+    // ctl that doesn't exist.  The fields are those of struct cache_header and cache_value.
+    const off_t numSettingsOffset = 48;
+    const off_t firstValueOffset = 56;
+    for (auto patch : { std::make_pair(numSettingsOffset, 0xffffffffu),
+            std::make_pair(firstValueOffset, 1000u) }) {
+        patchCache(cachePath, patch.first, patch.second);
+        setUpCard();
+        ar = audio_route_init_cached(0, xmlPath.c_str(), cachePath.c_str());
+        ASSERT_NE(nullptr, ar);
+        EXPECT_EQ((std::vector<long>{ 20, 20 }), ctl("Volume").values);
+        EXPECT_EQ(expected, applyAll(ar));
+        audio_route_free(ar);
+    }
+
+    unlink(cachePath.c_str());
+    unlink(xmlPath.c_str());
+}
+
+TEST(audio_route, value_id_out_of_range) {
+    const std::string xmlPath = tempPath("audio_route_tests_range.xml");
+    const std::string cachePath = tempPath("audio_route_tests_range.cache");
+    unlink(cachePath.c_str());
+    writeFile(xmlPath,
+            "<mixer>\n"
+            "  <ctl name=\"Gain\" id=\"1\" value=\"7\" />\n"
+            "  <ctl name=\"Gain\" id=\"-2\" value=\"7\" />\n"
+            "  <ctl name=\"Volume\" id=\"1\" value=\"5\" />\n"
+            "  <path name=\"bad\">\n"
+            "    <ctl name=\"Coeffs\" id=\"4\" value=\"ff\" />\n"
+            "  </path>\n"
+            "</mixer>\n");
+
+    // the same from the XML file and from the cache written the first time
+    for (int i = 0; i < 2; ++i) {
+        setUpCard();
+        struct audio_route *ar = audio_route_init_cached(0, xmlPath.c_str(), cachePath.c_str());
+        ASSERT_NE(nullptr, ar);
+        EXPECT_TRUE(isCache(cachePath));
+        EXPECT_EQ((std::vector<long>{ 0 }), ctl("Gain").values);
+        EXPECT_EQ((std::vector<long>{ 10, 5 }), ctl("Volume").values);
+        EXPECT_EQ((std::vector<std::string>{ "Volume" }), writtenNames());
+        EXPECT_EQ(0, audio_route_apply_and_update_path(ar, "bad"));
+        EXPECT_TRUE(gWrites.empty());
+        audio_route_free(ar);
+    }
+
+    unlink(cachePath.c_str());
+    unlink(xmlPath.c_str());
+}
+
+TEST(audio_route, switch_path) {
+    setUpCard();
+    struct audio_route *ar = initRoute(kPaths);
+    ASSERT_NE(nullptr, ar);
+    gWrites.clear();
+    EXPECT_EQ(0, audio_route_apply_and_update_path(ar, "speaker"));
+    EXPECT_EQ((std::vector<std::string>{ "Switch", "Volume" }), writtenNames());
+
+    // the ctls in both paths keep their values, so only the new ones are written
+    EXPECT_EQ(0, audio_route_switch_path(ar, "speaker", "speaker-and-mic"));
+    EXPECT_EQ((std::vector<std::string>{ "Mux", "Coeffs", "Gain" }), writtenNames());
+
+    // the ctls only in the old path are reset in reverse order
+    EXPECT_EQ(0, audio_route_switch_path(ar, "speaker-and-mic", "mic"));
+    EXPECT_EQ((std::vector<std::string>{ "Gain", "Volume", "Switch" }), writtenNames());
+    EXPECT_EQ((std::vector<long>{ 20, 20 }), ctl("Volume").values);
+    EXPECT_EQ((std::vector<long>{ 2 }), ctl("Mux").values);
+
+    // and the ones in both are written once, with the value of the new path
+    EXPECT_EQ(0, audio_route_switch_path_id(ar, audio_route_get_path_id(ar, "mic"),
+            audio_route_get_path_id(ar, "speaker-and-mic")));
+    EXPECT_EQ((std::vector<std::string>{ "Switch", "Volume", "Gain" }), writtenNames());
+    EXPECT_EQ(0, audio_route_switch_path(ar, "speaker-and-mic", "speaker-and-mic"));
+    EXPECT_TRUE(gWrites.empty());
+
+    // deferred, the net change of several switches, in the order the ctls were first queued
+    audio_route_begin_update(ar);
+    EXPECT_EQ(0, audio_route_switch_path(ar, "speaker-and-mic", "speaker"));
+    EXPECT_EQ(0, audio_route_switch_path(ar, "speaker", "mic"));
+    EXPECT_TRUE(gWrites.empty());
+    EXPECT_EQ(0, audio_route_end_update(ar));
+    EXPECT_EQ((std::vector<std::string>{ "Gain", "Switch", "Volume" }), writtenNames());
+
+    EXPECT_EQ(-1, audio_route_switch_path(ar, "mic", "headphones"));
+    EXPECT_EQ(-1, audio_route_switch_path(ar, "headphones", "mic"));
+    EXPECT_EQ(-1, audio_route_switch_path_id(ar, 0, -1));
+    EXPECT_EQ((std::vector<long>{ 2 }), ctl("Mux").values);
+    EXPECT_TRUE(gWrites.empty());
+    audio_route_free(ar);
+}
@@ -8,14 +8,22 @@ LOCAL_MODULE_TAGS := optional
 LOCAL_SRC_FILES:= \
 	channels.c \
 	conversion.cpp \
+	convolver.cpp \
+	fft.cpp \
 	fifo.c \
 	fixedfft.cpp.arm \
 	format.c \
+	kernels.cpp \
 	limiter.c \
 	minifloat.c \
 	primitives.c \
 	resampler.c \
+	resampler_polyphase.c \
 	roundup.c \
+	sound_trigger_model.c \
+	task_pool.c \
+	trace.c \
+	visualizer_capture.c \
 	echo_reference.c
 
 LOCAL_C_INCLUDES += $(call include-path-for, speex)
@@ -29,6 +37,8 @@ LOCAL_SHARED_LIBRARIES := \
 	libspeexresampler
 
 LOCAL_CFLAGS := -Werror -Wall
+# Uncomment to record the hot path trace points of <audio_utils/trace.h>
+#LOCAL_CFLAGS += -DAUDIO_UTILS_TRACE
 include $(BUILD_SHARED_LIBRARY)
 
 include $(CLEAR_VARS)
@@ -36,12 +46,21 @@ LOCAL_MODULE := libaudioutils
 LOCAL_MODULE_TAGS := optional
 LOCAL_SRC_FILES := \
 	channels.c \
+	conversion.cpp \
+	convolver.cpp \
+	fft.cpp \
 	fifo.c \
+	fixedfft.cpp \
 	format.c \
+	kernels.cpp \
 	limiter.c \
 	minifloat.c \
 	primitives.c \
-	roundup.c
+	roundup.c \
+	sound_trigger_model.c \
+	task_pool.c \
+	trace.c \
+	visualizer_capture.c
 LOCAL_C_INCLUDES += \
 	$(call include-path-for, audio-utils)
 LOCAL_CFLAGS := -Werror -Wall
@@ -88,6 +107,7 @@ LOCAL_MODULE_TAGS := optional
 
 LOCAL_SRC_FILES := \
 	fifo.c \
+	minifloat.c \
 	primitives.c \
 	roundup.c
 
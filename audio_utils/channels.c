@@ -14,8 +14,11 @@
  * limitations under the License.
  */
 
+#include <errno.h>
+#include <stdbool.h>
 #include <string.h>
 #include <audio_utils/channels.h>
+#include <audio_utils/primitives.h>
 #include "private/private.h"
 
 /*
@@ -208,6 +211,270 @@ inline uint8x3_t int32_to_uint8x3(int32_t in) {
     return num_out_samples * sizeof(*out_buff); \
 }
 
+/* Channel contracts from a MULTICHANNEL float input buffer to a MONO float output buffer
+ * by mixing the first two input channels into the single output channel (and skipping the rest).
+ * See contract_channels() function below for parameter definitions.
+ *
+ * Move from front to back so that the conversion can be done in-place
+ * i.e. in_buff == out_buff
+ * NOTE: num_in_bytes must be a multiple of in_buff_channels * in_buff_sample_size.
+ * NOTE: Overload of the summed channels is avoided by averaging the two input channels.
+ */
+#define CONTRACT_TO_MONO_FLOAT(in_buff, out_buff, num_in_bytes) \
+{ \
+    size_t num_in_samples = num_in_bytes / sizeof(*in_buff); \
+    size_t num_out_samples = (num_in_samples * out_buff_chans) / in_buff_chans; \
+    size_t num_skip_samples = in_buff_chans - 2; \
+    typeof(out_buff) dst_ptr = out_buff; \
+    typeof(in_buff) src_ptr = in_buff; \
+    float temp; \
+    size_t src_index; \
+    for (src_index = 0; src_index < num_in_samples; src_index += in_buff_chans) { \
+        temp = *src_ptr++; \
+        temp += *src_ptr++; \
+        *dst_ptr++ = temp * 0.5f; \
+        src_ptr += num_skip_samples; \
+    } \
+    /* return number of *bytes* generated */ \
+    return num_out_samples * sizeof(*out_buff); \
+}
+
+#if defined(USE_NEON) || defined(USE_SSE2)
+
+/* Vectorized versions of the most common channel adjustments: 2 to 1, 4 to 2 and 8 to 2
+ * for contraction, and 1 to 2, 2 to 4 and 2 to 8 for expansion, for 16 and 32 bit samples.
+ * Each iteration transfers a block of 4 frames, loading the whole block before storing any of it,
+ * so the in-place rules are the same as for the scalar macros.
+ * These process as many whole blocks as possible, and return the number of frames done,
+ * so that the scalar macros can complete the remainder.
+ */
+#define VECTOR_FRAMES 4
+
+/* Contract frames from the front of the buffer */
+static size_t contract_channels_vector(const void* in_buff, size_t in_buff_chans,
+                                       void* out_buff, size_t out_buff_chans,
+                                       unsigned sample_size_in_bytes, bool is_float,
+                                       size_t num_frames)
+{
+    const uint8_t *src = (const uint8_t *)in_buff;
+    uint8_t *dst = (uint8_t *)out_buff;
+    const size_t in_frame_size = in_buff_chans * sample_size_in_bytes;
+    const size_t out_frame_size = out_buff_chans * sample_size_in_bytes;
+    const size_t blocks = num_frames / VECTOR_FRAMES;
+    size_t block;
+
+    if (out_buff_chans == 1 && in_buff_chans == 2 && sample_size_in_bytes == 2) {
+        /* average, as in CONTRACT_TO_MONO() */
+        for (block = 0; block < blocks; block++) {
+#if defined(USE_NEON)
+            int16x4x2_t lr = vld2_s16((const int16_t *)src);
+            vst1_s16((int16_t *)dst, vhadd_s16(lr.val[0], lr.val[1]));
+#else
+            __m128i x = _mm_loadu_si128((const __m128i *)src);
+            __m128i l = _mm_srai_epi32(_mm_slli_epi32(x, 16), 16);
+            __m128i r = _mm_srai_epi32(x, 16);
+            __m128i avg = _mm_add_epi32(_mm_and_si128(l, r),
+                    _mm_srai_epi32(_mm_xor_si128(l, r), 1));
+            _mm_storel_epi64((__m128i *)dst, _mm_packs_epi32(avg, avg));
+#endif
+            src += VECTOR_FRAMES * in_frame_size;
+            dst += VECTOR_FRAMES * out_frame_size;
+        }
+    } else if (out_buff_chans == 1 && in_buff_chans == 2 && sample_size_in_bytes == 4) {
+        for (block = 0; block < blocks; block++) {
+#if defined(USE_NEON)
+            if (is_float) {
+                float32x4x2_t lr = vld2q_f32((const float *)src);
+                vst1q_f32((float *)dst, vmulq_n_f32(vaddq_f32(lr.val[0], lr.val[1]), 0.5f));
+            } else {
+                int32x4x2_t lr = vld2q_s32((const int32_t *)src);
+                vst1q_s32((int32_t *)dst, vhaddq_s32(lr.val[0], lr.val[1]));
+            }
+#else
+            __m128 x0 = _mm_loadu_ps((const float *)src);
+            __m128 x1 = _mm_loadu_ps((const float *)src + 4);
+            __m128 l = _mm_shuffle_ps(x0, x1, _MM_SHUFFLE(2, 0, 2, 0));
+            __m128 r = _mm_shuffle_ps(x0, x1, _MM_SHUFFLE(3, 1, 3, 1));
+            if (is_float) {
+                _mm_storeu_ps((float *)dst, _mm_mul_ps(_mm_add_ps(l, r), _mm_set1_ps(0.5f)));
+            } else {
+                __m128i li = _mm_castps_si128(l);
+                __m128i ri = _mm_castps_si128(r);
+                _mm_storeu_si128((__m128i *)dst, _mm_add_epi32(_mm_and_si128(li, ri),
+                        _mm_srai_epi32(_mm_xor_si128(li, ri), 1)));
+            }
+#endif
+            src += VECTOR_FRAMES * in_frame_size;
+            dst += VECTOR_FRAMES * out_frame_size;
+        }
+    } else if (out_buff_chans == 2 && (in_buff_chans == 4 || in_buff_chans == 8) &&
+            sample_size_in_bytes == 2) {
+        /* each output frame is one 32-bit word, the first of each input frame */
+        for (block = 0; block < blocks; block++) {
+#if defined(USE_NEON)
+            if (in_buff_chans == 4) {
+                vst1q_u32((uint32_t *)dst, vld2q_u32((const uint32_t *)src).val[0]);
+            } else {
+                vst1q_u32((uint32_t *)dst, vld4q_u32((const uint32_t *)src).val[0]);
+            }
+#else
+            __m128i x;
+            if (in_buff_chans == 4) {
+                x = _mm_castps_si128(_mm_shuffle_ps(_mm_loadu_ps((const float *)src),
+                        _mm_loadu_ps((const float *)src + 4), _MM_SHUFFLE(2, 0, 2, 0)));
+            } else {
+                const __m128i *in = (const __m128i *)src;
+                x = _mm_unpacklo_epi64(
+                        _mm_unpacklo_epi32(_mm_loadu_si128(in), _mm_loadu_si128(in + 1)),
+                        _mm_unpacklo_epi32(_mm_loadu_si128(in + 2), _mm_loadu_si128(in + 3)));
+            }
+            _mm_storeu_si128((__m128i *)dst, x);
+#endif
+            src += VECTOR_FRAMES * in_frame_size;
+            dst += VECTOR_FRAMES * out_frame_size;
+        }
+    } else if (out_buff_chans == 2 && (in_buff_chans == 4 || in_buff_chans == 8) &&
+            sample_size_in_bytes == 4) {
+        /* each output frame is one 64-bit word, the first of each input frame */
+        const size_t stride = in_frame_size / 16; /* in units of 128-bit vectors */
+        for (block = 0; block < blocks; block++) {
+#if defined(USE_NEON)
+            const uint32_t *in = (const uint32_t *)src;
+            uint32x4_t f0 = vld1q_u32(in);
+            uint32x4_t f1 = vld1q_u32(in + 4 * stride);
+            uint32x4_t f2 = vld1q_u32(in + 8 * stride);
+            uint32x4_t f3 = vld1q_u32(in + 12 * stride);
+            vst1q_u32((uint32_t *)dst, vcombine_u32(vget_low_u32(f0), vget_low_u32(f1)));
+            vst1q_u32((uint32_t *)dst + 4, vcombine_u32(vget_low_u32(f2), vget_low_u32(f3)));
+#else
+            const __m128i *in = (const __m128i *)src;
+            __m128i f0 = _mm_loadu_si128(in);
+            __m128i f1 = _mm_loadu_si128(in + stride);
+            __m128i f2 = _mm_loadu_si128(in + 2 * stride);
+            __m128i f3 = _mm_loadu_si128(in + 3 * stride);
+            _mm_storeu_si128((__m128i *)dst, _mm_unpacklo_epi64(f0, f1));
+            _mm_storeu_si128((__m128i *)dst + 1, _mm_unpacklo_epi64(f2, f3));
+#endif
+            src += VECTOR_FRAMES * in_frame_size;
+            dst += VECTOR_FRAMES * out_frame_size;
+        }
+    } else {
+        return 0;
+    }
+    return blocks * VECTOR_FRAMES;
+}
+
+/* Expand frames from the back of the buffer */
+static size_t expand_channels_vector(const void* in_buff, size_t in_buff_chans,
+                                     void* out_buff, size_t out_buff_chans,
+                                     unsigned sample_size_in_bytes, size_t num_frames)
+{
+    const size_t in_frame_size = in_buff_chans * sample_size_in_bytes;
+    const size_t out_frame_size = out_buff_chans * sample_size_in_bytes;
+    const size_t blocks = num_frames / VECTOR_FRAMES;
+    const uint8_t *src = (const uint8_t *)in_buff + num_frames * in_frame_size;
+    uint8_t *dst = (uint8_t *)out_buff + num_frames * out_frame_size;
+    size_t block;
+
+    if (!((in_buff_chans == 1 && out_buff_chans == 2) ||
+            (in_buff_chans == 2 && (out_buff_chans == 4 || out_buff_chans == 8))) ||
+            (sample_size_in_bytes != 2 && sample_size_in_bytes != 4)) {
+        return 0;
+    }
+    for (block = 0; block < blocks; block++) {
+        src -= VECTOR_FRAMES * in_frame_size;
+        dst -= VECTOR_FRAMES * out_frame_size;
+#if defined(USE_NEON)
+        const uint32x4_t zero = vdupq_n_u32(0);
+        if (in_buff_chans == 1) {
+            /* duplicate mono, as in EXPAND_MONO_TO_MULTI() */
+            if (sample_size_in_bytes == 2) {
+                int16x4_t x = vld1_s16((const int16_t *)src);
+                int16x4x2_t xx = {{x, x}};
+                vst2_s16((int16_t *)dst, xx);
+            } else {
+                uint32x4_t x = vld1q_u32((const uint32_t *)src);
+                uint32x4x2_t xx = {{x, x}};
+                vst2q_u32((uint32_t *)dst, xx);
+            }
+        } else if (sample_size_in_bytes == 2) {
+            /* each input frame is one 32-bit word */
+            uint32x4_t x = vld1q_u32((const uint32_t *)src);
+            if (out_buff_chans == 4) {
+                uint32x4x2_t x2 = {{x, zero}};
+                vst2q_u32((uint32_t *)dst, x2);
+            } else {
+                uint32x4x4_t x4 = {{x, zero, zero, zero}};
+                vst4q_u32((uint32_t *)dst, x4);
+            }
+        } else {
+            /* each input frame is one 64-bit word */
+            const uint32_t *in = (const uint32_t *)src;
+            uint32x4_t x01 = vld1q_u32(in);
+            uint32x4_t x23 = vld1q_u32(in + 4);
+            uint32x2_t f[VECTOR_FRAMES] = {vget_low_u32(x01), vget_high_u32(x01),
+                    vget_low_u32(x23), vget_high_u32(x23)};
+            uint32_t *out = (uint32_t *)dst;
+            int i;
+            for (i = 0; i < VECTOR_FRAMES; i++) {
+                vst1q_u32(out, vcombine_u32(f[i], vget_low_u32(zero)));
+                if (out_buff_chans == 8) {
+                    vst1q_u32(out + 4, zero);
+                }
+                out += out_buff_chans;
+            }
+        }
+#else
+        const __m128i zero = _mm_setzero_si128();
+        __m128i *out = (__m128i *)dst;
+        if (in_buff_chans == 1) {
+            /* duplicate mono, as in EXPAND_MONO_TO_MULTI() */
+            if (sample_size_in_bytes == 2) {
+                __m128i x = _mm_loadl_epi64((const __m128i *)src);
+                _mm_storeu_si128(out, _mm_unpacklo_epi16(x, x));
+            } else {
+                __m128i x = _mm_loadu_si128((const __m128i *)src);
+                _mm_storeu_si128(out, _mm_unpacklo_epi32(x, x));
+                _mm_storeu_si128(out + 1, _mm_unpackhi_epi32(x, x));
+            }
+        } else if (sample_size_in_bytes == 2) {
+            /* each input frame is one 32-bit word */
+            __m128i x = _mm_loadu_si128((const __m128i *)src);
+            __m128i lo = _mm_unpacklo_epi32(x, zero);
+            __m128i hi = _mm_unpackhi_epi32(x, zero);
+            if (out_buff_chans == 4) {
+                _mm_storeu_si128(out, lo);
+                _mm_storeu_si128(out + 1, hi);
+            } else {
+                _mm_storeu_si128(out, _mm_unpacklo_epi64(lo, zero));
+                _mm_storeu_si128(out + 1, _mm_unpackhi_epi64(lo, zero));
+                _mm_storeu_si128(out + 2, _mm_unpacklo_epi64(hi, zero));
+                _mm_storeu_si128(out + 3, _mm_unpackhi_epi64(hi, zero));
+            }
+        } else {
+            /* each input frame is one 64-bit word */
+            __m128i x01 = _mm_loadu_si128((const __m128i *)src);
+            __m128i x23 = _mm_loadu_si128((const __m128i *)src + 1);
+            __m128i f[VECTOR_FRAMES] = {_mm_unpacklo_epi64(x01, zero),
+                    _mm_unpackhi_epi64(x01, zero), _mm_unpacklo_epi64(x23, zero),
+                    _mm_unpackhi_epi64(x23, zero)};
+            const size_t stride = out_frame_size / 16; /* in units of 128-bit vectors */
+            int i;
+            for (i = 0; i < VECTOR_FRAMES; i++) {
+                _mm_storeu_si128(out, f[i]);
+                if (out_buff_chans == 8) {
+                    _mm_storeu_si128(out + 1, zero);
+                }
+                out += stride;
+            }
+        }
+#endif
+    }
+    return blocks * VECTOR_FRAMES;
+}
+
+#endif /* USE_NEON || USE_SSE2 */
+
 /*
  * Convert a buffer of N-channel, interleaved samples to M-channel
  * (where N > M).
@@ -226,7 +493,8 @@ inline uint8x3_t int32_to_uint8x3(int32_t in) {
  */
 static size_t contract_channels(const void* in_buff, size_t in_buff_chans,
                                 void* out_buff, size_t out_buff_chans,
-                                unsigned sample_size_in_bytes, size_t num_in_bytes)
+                                unsigned sample_size_in_bytes, bool is_float,
+                                size_t num_in_bytes)
 {
     switch (sample_size_in_bytes) {
     case 1:
@@ -264,7 +532,11 @@ static size_t contract_channels(const void* in_buff, size_t in_buff_chans,
             // returns in macro
         }
     case 4:
-        if (out_buff_chans == 1) {
+        if (out_buff_chans == 1 && is_float) {
+            /* Special case Multi to Mono */
+            CONTRACT_TO_MONO_FLOAT((const float*)in_buff, (float*)out_buff, num_in_bytes);
+            // returns in macro
+        } else if (out_buff_chans == 1) {
             /* Special case Multi to Mono */
             CONTRACT_TO_MONO((const int32_t*)in_buff, (int32_t*)out_buff, num_in_bytes);
             // returns in macro
@@ -359,19 +631,414 @@ static size_t expand_channels(const void* in_buff, size_t in_buff_chans,
     }
 }
 
-size_t adjust_channels(const void* in_buff, size_t in_buff_chans,
-                       void* out_buff, size_t out_buff_chans,
-                       unsigned sample_size_in_bytes, size_t num_in_bytes)
+static size_t adjust_channels_common(const void* in_buff, size_t in_buff_chans,
+                                     void* out_buff, size_t out_buff_chans,
+                                     unsigned sample_size_in_bytes, bool is_float,
+                                     size_t num_in_bytes)
 {
+#if defined(USE_NEON) || defined(USE_SSE2)
+    const size_t in_frame_size = in_buff_chans * sample_size_in_bytes;
+    const size_t out_frame_size = out_buff_chans * sample_size_in_bytes;
+    const size_t num_frames = in_frame_size > 0 ? num_in_bytes / in_frame_size : 0;
+    size_t done;
+#endif
+
     if (out_buff_chans > in_buff_chans) {
+#if defined(USE_NEON) || defined(USE_SSE2)
+        /* the vector code does the last frames, and the scalar code the first ones */
+        done = expand_channels_vector(in_buff, in_buff_chans, out_buff, out_buff_chans,
+                                      sample_size_in_bytes, num_frames);
+        if (done > 0) {
+            return expand_channels(in_buff, in_buff_chans, out_buff, out_buff_chans,
+                                   sample_size_in_bytes,
+                                   (num_frames - done) * in_frame_size) +
+                    done * out_frame_size;
+        }
+#endif
         return expand_channels(in_buff, in_buff_chans, out_buff,  out_buff_chans,
                                sample_size_in_bytes, num_in_bytes);
     } else if (out_buff_chans < in_buff_chans) {
+#if defined(USE_NEON) || defined(USE_SSE2)
+        /* the vector code does the first frames, and the scalar code the last ones */
+        done = contract_channels_vector(in_buff, in_buff_chans, out_buff, out_buff_chans,
+                                        sample_size_in_bytes, is_float, num_frames);
+        if (done > 0) {
+            return contract_channels((const uint8_t*)in_buff + done * in_frame_size,
+                                     in_buff_chans,
+                                     (uint8_t*)out_buff + done * out_frame_size,
+                                     out_buff_chans, sample_size_in_bytes, is_float,
+                                     (num_frames - done) * in_frame_size) +
+                    done * out_frame_size;
+        }
+#endif
         return contract_channels(in_buff, in_buff_chans, out_buff,  out_buff_chans,
-                                 sample_size_in_bytes, num_in_bytes);
+                                 sample_size_in_bytes, is_float, num_in_bytes);
     } else if (in_buff != out_buff) {
         memcpy(out_buff, in_buff, num_in_bytes);
     }
 
     return num_in_bytes;
 }
+
+size_t adjust_channels(const void* in_buff, size_t in_buff_chans,
+                       void* out_buff, size_t out_buff_chans,
+                       unsigned sample_size_in_bytes, size_t num_in_bytes)
+{
+    return adjust_channels_common(in_buff, in_buff_chans, out_buff, out_buff_chans,
+                                  sample_size_in_bytes, false /*is_float*/, num_in_bytes);
+}
+
+size_t adjust_channels_float(const float* in_buff, size_t in_buff_chans,
+                             float* out_buff, size_t out_buff_chans,
+                             size_t num_in_bytes)
+{
+    return adjust_channels_common(in_buff, in_buff_chans, out_buff, out_buff_chans,
+                                  sizeof(float), true /*is_float*/, num_in_bytes);
+}
+
+/* Frames of 16-bit data converted to float at a time by channel_mix_i16() */
+#define CHANNEL_MIX_BLOCK_FRAMES 64
+
+/* -3 dB, the gain of each channel when one channel is split over a pair */
+#define CHANNEL_MIX_MINUS_3_DB  0.70710678f
+
+/* Position of the lowest bit of a single channel bit, as an index into dst_index */
+static inline unsigned channel_position(uint32_t channel)
+{
+    return __builtin_ctz(channel);
+}
+
+/*
+ * Adds gain from source channel src to the destination channel of the given output position,
+ * folding the position into its nearest destination channels if the destination lacks it.
+ * dst_index gives the destination channel of each position, or -1 if absent.
+ * Each fallback moves towards the front channels, so the recursion terminates.
+ */
+static void channel_mix_add(struct channel_mix *mix, const int8_t *dst_index,
+        uint32_t channel, uint32_t src, float gain)
+{
+    const int8_t d = dst_index[channel_position(channel)];
+    if (d >= 0) {
+        mix->coefs[d][src] += gain;
+        return;
+    }
+#define HAS(c) (dst_index[channel_position(c)] >= 0)
+    switch (channel) {
+    case AUDIO_CHANNEL_OUT_FRONT_LEFT:
+    case AUDIO_CHANNEL_OUT_FRONT_RIGHT:
+        if (HAS(AUDIO_CHANNEL_OUT_FRONT_CENTER)) {
+            channel_mix_add(mix, dst_index, AUDIO_CHANNEL_OUT_FRONT_CENTER, src, gain);
+        } else {
+            const uint32_t other = channel == AUDIO_CHANNEL_OUT_FRONT_LEFT ?
+                    AUDIO_CHANNEL_OUT_FRONT_RIGHT : AUDIO_CHANNEL_OUT_FRONT_LEFT;
+            if (HAS(other)) {
+                channel_mix_add(mix, dst_index, other, src, gain);
+            }
+        }
+        break;
+    case AUDIO_CHANNEL_OUT_FRONT_CENTER:
+    case AUDIO_CHANNEL_OUT_LOW_FREQUENCY:
+        if (channel == AUDIO_CHANNEL_OUT_LOW_FREQUENCY && HAS(AUDIO_CHANNEL_OUT_FRONT_CENTER)) {
+            channel_mix_add(mix, dst_index, AUDIO_CHANNEL_OUT_FRONT_CENTER, src, gain);
+        } else if (HAS(AUDIO_CHANNEL_OUT_FRONT_LEFT) && HAS(AUDIO_CHANNEL_OUT_FRONT_RIGHT)) {
+            channel_mix_add(mix, dst_index, AUDIO_CHANNEL_OUT_FRONT_LEFT, src,
+                    gain * CHANNEL_MIX_MINUS_3_DB);
+            channel_mix_add(mix, dst_index, AUDIO_CHANNEL_OUT_FRONT_RIGHT, src,
+                    gain * CHANNEL_MIX_MINUS_3_DB);
+        } else if (HAS(AUDIO_CHANNEL_OUT_FRONT_LEFT)) {
+            channel_mix_add(mix, dst_index, AUDIO_CHANNEL_OUT_FRONT_LEFT, src, gain);
+        } else if (HAS(AUDIO_CHANNEL_OUT_FRONT_RIGHT)) {
+            channel_mix_add(mix, dst_index, AUDIO_CHANNEL_OUT_FRONT_RIGHT, src, gain);
+        }
+        break;
+    case AUDIO_CHANNEL_OUT_FRONT_LEFT_OF_CENTER:
+        channel_mix_add(mix, dst_index, AUDIO_CHANNEL_OUT_FRONT_LEFT, src, gain);
+        break;
+    case AUDIO_CHANNEL_OUT_FRONT_RIGHT_OF_CENTER:
+        channel_mix_add(mix, dst_index, AUDIO_CHANNEL_OUT_FRONT_RIGHT, src, gain);
+        break;
+    case AUDIO_CHANNEL_OUT_BACK_LEFT:
+        if (HAS(AUDIO_CHANNEL_OUT_SIDE_LEFT)) {
+            channel_mix_add(mix, dst_index, AUDIO_CHANNEL_OUT_SIDE_LEFT, src, gain);
+        } else {
+            channel_mix_add(mix, dst_index, AUDIO_CHANNEL_OUT_FRONT_LEFT, src,
+                    gain * CHANNEL_MIX_MINUS_3_DB);
+        }
+        break;
+    case AUDIO_CHANNEL_OUT_BACK_RIGHT:
+        if (HAS(AUDIO_CHANNEL_OUT_SIDE_RIGHT)) {
+            channel_mix_add(mix, dst_index, AUDIO_CHANNEL_OUT_SIDE_RIGHT, src, gain);
+        } else {
+            channel_mix_add(mix, dst_index, AUDIO_CHANNEL_OUT_FRONT_RIGHT, src,
+                    gain * CHANNEL_MIX_MINUS_3_DB);
+        }
+        break;
+    case AUDIO_CHANNEL_OUT_SIDE_LEFT:
+        if (HAS(AUDIO_CHANNEL_OUT_BACK_LEFT)) {
+            channel_mix_add(mix, dst_index, AUDIO_CHANNEL_OUT_BACK_LEFT, src, gain);
+        } else {
+            channel_mix_add(mix, dst_index, AUDIO_CHANNEL_OUT_FRONT_LEFT, src,
+                    gain * CHANNEL_MIX_MINUS_3_DB);
+        }
+        break;
+    case AUDIO_CHANNEL_OUT_SIDE_RIGHT:
+        if (HAS(AUDIO_CHANNEL_OUT_BACK_RIGHT)) {
+            channel_mix_add(mix, dst_index, AUDIO_CHANNEL_OUT_BACK_RIGHT, src, gain);
+        } else {
+            channel_mix_add(mix, dst_index, AUDIO_CHANNEL_OUT_FRONT_RIGHT, src,
+                    gain * CHANNEL_MIX_MINUS_3_DB);
+        }
+        break;
+    case AUDIO_CHANNEL_OUT_BACK_CENTER:
+        /* the back pair falls back to the side pair, then to the front pair */
+        channel_mix_add(mix, dst_index, AUDIO_CHANNEL_OUT_BACK_LEFT, src,
+                gain * CHANNEL_MIX_MINUS_3_DB);
+        channel_mix_add(mix, dst_index, AUDIO_CHANNEL_OUT_BACK_RIGHT, src,
+                gain * CHANNEL_MIX_MINUS_3_DB);
+        break;
+    case AUDIO_CHANNEL_OUT_TOP_CENTER:
+    case AUDIO_CHANNEL_OUT_TOP_FRONT_CENTER:
+        channel_mix_add(mix, dst_index, AUDIO_CHANNEL_OUT_FRONT_CENTER, src,
+                gain * CHANNEL_MIX_MINUS_3_DB);
+        break;
+    case AUDIO_CHANNEL_OUT_TOP_FRONT_LEFT:
+        channel_mix_add(mix, dst_index, AUDIO_CHANNEL_OUT_FRONT_LEFT, src,
+                gain * CHANNEL_MIX_MINUS_3_DB);
+        break;
+    case AUDIO_CHANNEL_OUT_TOP_FRONT_RIGHT:
+        channel_mix_add(mix, dst_index, AUDIO_CHANNEL_OUT_FRONT_RIGHT, src,
+                gain * CHANNEL_MIX_MINUS_3_DB);
+        break;
+    case AUDIO_CHANNEL_OUT_TOP_BACK_LEFT:
+        channel_mix_add(mix, dst_index, AUDIO_CHANNEL_OUT_BACK_LEFT, src,
+                gain * CHANNEL_MIX_MINUS_3_DB);
+        break;
+    case AUDIO_CHANNEL_OUT_TOP_BACK_CENTER:
+        channel_mix_add(mix, dst_index, AUDIO_CHANNEL_OUT_BACK_CENTER, src,
+                gain * CHANNEL_MIX_MINUS_3_DB);
+        break;
+    case AUDIO_CHANNEL_OUT_TOP_BACK_RIGHT:
+        channel_mix_add(mix, dst_index, AUDIO_CHANNEL_OUT_BACK_RIGHT, src,
+                gain * CHANNEL_MIX_MINUS_3_DB);
+        break;
+    default:
+        break;
+    }
+#undef HAS
+}
+
+int channel_mix_init(struct channel_mix *mix,
+        audio_channel_mask_t dst_mask, audio_channel_mask_t src_mask)
+{
+    if (!audio_is_output_channel(dst_mask) || !audio_is_output_channel(src_mask)) {
+        return -EINVAL;
+    }
+    const uint32_t dst_channels = audio_channel_count_from_out_mask(dst_mask);
+    const uint32_t src_channels = audio_channel_count_from_out_mask(src_mask);
+    if (dst_channels == 0 || dst_channels > CHANNEL_MIX_MAX_CHANNELS ||
+            src_channels == 0 || src_channels > CHANNEL_MIX_MAX_CHANNELS) {
+        return -EINVAL;
+    }
+    memset(mix, 0, sizeof(*mix));
+
+    if (audio_channel_mask_get_representation(dst_mask) == AUDIO_CHANNEL_REPRESENTATION_INDEX ||
+            audio_channel_mask_get_representation(src_mask) ==
+                    AUDIO_CHANNEL_REPRESENTATION_INDEX) {
+        for (uint32_t i = 0; i < dst_channels && i < src_channels; ++i) {
+            mix->coefs[i][i] = 1.f;
+        }
+    } else {
+        const uint32_t dst_bits = audio_channel_mask_get_bits(dst_mask);
+        const uint32_t src_bits = audio_channel_mask_get_bits(src_mask);
+        /* a mono destination is mixed as stereo into rows 0 and 1, then averaged */
+        const bool dst_mono = dst_bits == AUDIO_CHANNEL_OUT_MONO;
+        const uint32_t layout_bits = dst_mono ? AUDIO_CHANNEL_OUT_STEREO : dst_bits;
+        int8_t dst_index[32];
+        memset(dst_index, -1, sizeof(dst_index));
+        int8_t d = 0;
+        for (uint32_t bits = layout_bits; bits != 0; bits &= bits - 1) {
+            dst_index[channel_position(bits)] = d++;
+        }
+        uint32_t s = 0;
+        for (uint32_t bits = src_bits; bits != 0; bits &= bits - 1, ++s) {
+            const uint32_t channel = bits & -bits;
+            if (src_bits == AUDIO_CHANNEL_OUT_MONO) {
+                channel_mix_add(mix, dst_index, AUDIO_CHANNEL_OUT_FRONT_LEFT, s, 1.f);
+                channel_mix_add(mix, dst_index, AUDIO_CHANNEL_OUT_FRONT_RIGHT, s, 1.f);
+            } else {
+                channel_mix_add(mix, dst_index, channel, s, 1.f);
+            }
+        }
+        if (dst_mono) {
+            for (s = 0; s < src_channels; ++s) {
+                mix->coefs[0][s] = (mix->coefs[0][s] + mix->coefs[1][s]) * 0.5f;
+                mix->coefs[1][s] = 0.f;
+            }
+        }
+    }
+    /* repack the rows as a dst_channels by src_channels array */
+    float packed[CHANNEL_MIX_MAX_CHANNELS * CHANNEL_MIX_MAX_CHANNELS];
+    for (uint32_t d = 0; d < dst_channels; ++d) {
+        memcpy(packed + d * src_channels, mix->coefs[d], src_channels * sizeof(float));
+    }
+    return channel_mix_init_from_coefs(mix, dst_channels, src_channels, packed);
+}
+
+/*
+ * The vector kernels compute a group of group_frames frames at a time, in group_vectors
+ * vectors of 4 destination samples: 4 mono frames, 2 stereo frames, or a single frame of
+ * 3 or more channels.  Lane k of vector v is destination channel (4 * v + k) % dst_channels
+ * of frame (4 * v + k) / dst_channels in the group, and lanes past the group have a zero
+ * coefficient.  Each source channel used by vector v, tap_src[v][t], is broadcast to the
+ * lanes of its frame and multiplied by columns[v][t].  Lanes past the group are stored too
+ * and rewritten by the next group, so the vector loop stops while the last group's stores
+ * still fit in the destination.
+ */
+int channel_mix_init_from_coefs(struct channel_mix *mix,
+        uint32_t dst_channels, uint32_t src_channels, const float *coefs)
+{
+    if (dst_channels == 0 || dst_channels > CHANNEL_MIX_MAX_CHANNELS ||
+            src_channels == 0 || src_channels > CHANNEL_MIX_MAX_CHANNELS) {
+        return -EINVAL;
+    }
+    memset(mix, 0, sizeof(*mix));
+    mix->dst_channels = dst_channels;
+    mix->src_channels = src_channels;
+    for (uint32_t d = 0; d < dst_channels; ++d) {
+        for (uint32_t s = 0; s < src_channels; ++s) {
+            mix->coefs[d][s] = coefs[d * src_channels + s];
+        }
+    }
+    mix->group_frames = dst_channels == 1 ? 4 : dst_channels == 2 ? 2 : 1;
+    mix->group_vectors = dst_channels <= 4 ? 1 : 2;
+    for (uint32_t v = 0; v < mix->group_vectors; ++v) {
+        for (uint32_t s = 0; s < src_channels; ++s) {
+            float column[4];
+            bool used = false;
+            for (uint32_t k = 0; k < 4; ++k) {
+                const uint32_t lane = 4 * v + k;
+                column[k] = lane / dst_channels < mix->group_frames ?
+                        mix->coefs[lane % dst_channels][s] : 0.f;
+                used = used || column[k] != 0.f;
+            }
+            if (used) {
+                const uint32_t t = mix->taps[v]++;
+                mix->tap_src[v][t] = s;
+                memcpy(mix->columns[v][t], column, sizeof(column));
+            }
+        }
+    }
+    return 0;
+}
+
+#if defined(USE_NEON) || defined(USE_SSE2)
+
+/* Mixes as many groups as fit, and returns the number of frames mixed.
+ * Called with a constant group_frames, so that the source broadcast is specialized.
+ */
+static inline size_t channel_mix_groups_float(const struct channel_mix *mix,
+        float *dst, const float *src, size_t frames, const size_t group_frames)
+{
+    const size_t src_channels = mix->src_channels;
+    const size_t dst_channels = mix->dst_channels;
+    const size_t stored = 4 * mix->group_vectors;
+    size_t done = 0;
+    for (; frames - done >= group_frames && (frames - done) * dst_channels >= stored;
+            done += group_frames, src += group_frames * src_channels,
+            dst += group_frames * dst_channels) {
+        for (uint32_t v = 0; v < mix->group_vectors; ++v) {
+#if defined(USE_NEON)
+            float32x4_t accum = vdupq_n_f32(0.f);
+            for (uint32_t t = 0; t < mix->taps[v]; ++t) {
+                const float *in = src + mix->tap_src[v][t];
+                float32x4_t x;
+                if (group_frames == 4) {
+                    x = vdupq_n_f32(in[0]);
+                    x = vsetq_lane_f32(in[src_channels], x, 1);
+                    x = vsetq_lane_f32(in[2 * src_channels], x, 2);
+                    x = vsetq_lane_f32(in[3 * src_channels], x, 3);
+                } else if (group_frames == 2) {
+                    x = vcombine_f32(vdup_n_f32(in[0]), vdup_n_f32(in[src_channels]));
+                } else {
+                    x = vdupq_n_f32(in[0]);
+                }
+                accum = vaddq_f32(accum, vmulq_f32(x, vld1q_f32(mix->columns[v][t])));
+            }
+            vst1q_f32(dst + 4 * v, accum);
+#else
+            __m128 accum = _mm_setzero_ps();
+            for (uint32_t t = 0; t < mix->taps[v]; ++t) {
+                const float *in = src + mix->tap_src[v][t];
+                __m128 x;
+                if (group_frames == 4) {
+                    x = _mm_setr_ps(in[0], in[src_channels], in[2 * src_channels],
+                            in[3 * src_channels]);
+                } else if (group_frames == 2) {
+                    x = _mm_setr_ps(in[0], in[0], in[src_channels], in[src_channels]);
+                } else {
+                    x = _mm_set1_ps(in[0]);
+                }
+                accum = _mm_add_ps(accum, _mm_mul_ps(x, _mm_loadu_ps(mix->columns[v][t])));
+            }
+            _mm_storeu_ps(dst + 4 * v, accum);
+#endif
+        }
+    }
+    return done;
+}
+
+#endif
+
+void channel_mix_float(const struct channel_mix *mix, float *dst, const float *src,
+        size_t frames)
+{
+    const size_t src_channels = mix->src_channels;
+    const size_t dst_channels = mix->dst_channels;
+#if defined(USE_NEON) || defined(USE_SSE2)
+    size_t done;
+    switch (mix->group_frames) {
+    case 4:
+        done = channel_mix_groups_float(mix, dst, src, frames, 4);
+        break;
+    case 2:
+        done = channel_mix_groups_float(mix, dst, src, frames, 2);
+        break;
+    default:
+        done = channel_mix_groups_float(mix, dst, src, frames, 1);
+        break;
+    }
+    frames -= done;
+    src += done * src_channels;
+    dst += done * dst_channels;
+#endif
+    /* same order of operations as the vector kernels */
+    for (; frames > 0; --frames, src += src_channels, dst += dst_channels) {
+        for (size_t d = 0; d < dst_channels; ++d) {
+            float accum = 0.f;
+            for (size_t s = 0; s < src_channels; ++s) {
+                accum += src[s] * mix->coefs[d][s];
+            }
+            dst[d] = accum;
+        }
+    }
+}
+
+void channel_mix_i16(const struct channel_mix *mix, int16_t *dst, const int16_t *src,
+        size_t frames)
+{
+    /* in blocks, converted with the vectorized format converters */
+    float in[CHANNEL_MIX_BLOCK_FRAMES * CHANNEL_MIX_MAX_CHANNELS];
+    float out[CHANNEL_MIX_BLOCK_FRAMES * CHANNEL_MIX_MAX_CHANNELS];
+    const size_t src_channels = mix->src_channels;
+    const size_t dst_channels = mix->dst_channels;
+    while (frames > 0) {
+        const size_t count =
+                frames < CHANNEL_MIX_BLOCK_FRAMES ? frames : CHANNEL_MIX_BLOCK_FRAMES;
+        memcpy_to_float_from_i16(in, src, count * src_channels);
+        channel_mix_float(mix, out, in, count);
+        memcpy_to_i16_from_float(dst, out, count * dst_channels);
+        src += count * src_channels;
+        dst += count * dst_channels;
+        frames -= count;
+    }
+}
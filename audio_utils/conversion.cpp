@@ -21,8 +21,128 @@
 #include <audio_utils/conversion.h>
 #include <utils/Log.h>
 #include <audio_utils/limiter.h>
+#include "private/private.h"
+
+namespace {
+
+// Channel count known at compile time, so that the sums stay in registers
+// and the division by the channel count becomes a multiplication.
+template <size_t N>
+void mono_blend_i16(int16_t *buf, size_t frames) {
+    for (size_t i = 0; i < frames; ++i, buf += N) {
+        int accum = 0;
+        for (size_t j = 0; j < N; ++j) {
+            accum += buf[j];
+        }
+        accum /= (int)N; // round to 0
+        for (size_t j = 0; j < N; ++j) {
+            buf[j] = accum;
+        }
+    }
+}
+
+template <>
+void mono_blend_i16<2>(int16_t *buf, size_t frames) {
+#if defined(USE_NEON)
+    for (; frames >= 8; frames -= 8, buf += 16) {
+        int16x8x2_t in = vld2q_s16(buf);
+        int32x4_t lo = vaddl_s16(vget_low_s16(in.val[0]), vget_low_s16(in.val[1]));
+        int32x4_t hi = vaddl_s16(vget_high_s16(in.val[0]), vget_high_s16(in.val[1]));
+        // add the sign bit before halving to round to 0
+        lo = vshrq_n_s32(vaddq_s32(lo,
+                vreinterpretq_s32_u32(vshrq_n_u32(vreinterpretq_u32_s32(lo), 31))), 1);
+        hi = vshrq_n_s32(vaddq_s32(hi,
+                vreinterpretq_s32_u32(vshrq_n_u32(vreinterpretq_u32_s32(hi), 31))), 1);
+        int16x8x2_t out;
+        out.val[0] = out.val[1] = vcombine_s16(vmovn_s32(lo), vmovn_s32(hi));
+        vst2q_s16(buf, out);
+    }
+#elif defined(USE_SSE2)
+    const __m128i ones = _mm_set1_epi16(1);
+    const __m128i low16 = _mm_set1_epi32(0xffff);
+    for (; frames >= 4; frames -= 4, buf += 8) {
+        __m128i accum = _mm_madd_epi16(_mm_loadu_si128((const __m128i *)buf), ones);
+        // add the sign bit before halving to round to 0
+        accum = _mm_srai_epi32(_mm_add_epi32(accum, _mm_srli_epi32(accum, 31)), 1);
+        accum = _mm_or_si128(_mm_and_si128(accum, low16), _mm_slli_epi32(accum, 16));
+        _mm_storeu_si128((__m128i *)buf, accum);
+    }
+#endif
+    for (; frames > 0; --frames, buf += 2) {
+        buf[0] = buf[1] = (buf[0] + buf[1]) / 2;
+    }
+}
+
+template <size_t N>
+void mono_blend_float(float *buf, size_t frames) {
+    const float recipdiv = 1. / N;
+    for (size_t i = 0; i < frames; ++i, buf += N) {
+        float accum = 0;
+        for (size_t j = 0; j < N; ++j) {
+            accum += buf[j];
+        }
+        accum *= recipdiv;
+        for (size_t j = 0; j < N; ++j) {
+            buf[j] = accum;
+        }
+    }
+}
+
+// Stereo float, in blocks so that the optional limiter can use limiter_block().
+void mono_blend_float_stereo(float *buf, size_t frames, bool limit) {
+    // with limit, the sum is scaled by sqrt(0.5) in float, within 1 ulp of the double product
+    const float scale = limit ? (float) M_SQRT1_2 : 0.5f;
+    static const size_t kBlockFrames = 64;
+    float accum[kBlockFrames];
+    while (frames > 0) {
+        const size_t count = frames < kBlockFrames ? frames : kBlockFrames;
+        size_t i = 0;
+#if defined(USE_NEON)
+        const float32x4_t vscale = vdupq_n_f32(scale);
+        for (; i + 4 <= count; i += 4) {
+            float32x4x2_t in = vld2q_f32(buf + 2 * i);
+            vst1q_f32(accum + i, vmulq_f32(vaddq_f32(in.val[0], in.val[1]), vscale));
+        }
+#elif defined(USE_SSE2)
+        const __m128 vscale = _mm_set1_ps(scale);
+        for (; i + 4 <= count; i += 4) {
+            __m128 a = _mm_loadu_ps(buf + 2 * i);
+            __m128 b = _mm_loadu_ps(buf + 2 * i + 4);
+            __m128 sum = _mm_add_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)),
+                    _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+            _mm_storeu_ps(accum + i, _mm_mul_ps(sum, vscale));
+        }
+#endif
+        for (; i < count; ++i) {
+            accum[i] = (buf[2 * i] + buf[2 * i + 1]) * scale;
+        }
+        if (limit) {
+            limiter_block(accum, count);
+        }
+        i = 0;
+#if defined(USE_NEON)
+        for (; i + 4 <= count; i += 4) {
+            float32x4x2_t out;
+            out.val[0] = out.val[1] = vld1q_f32(accum + i);
+            vst2q_f32(buf + 2 * i, out);
+        }
+#elif defined(USE_SSE2)
+        for (; i + 4 <= count; i += 4) {
+            __m128 sum = _mm_loadu_ps(accum + i);
+            _mm_storeu_ps(buf + 2 * i, _mm_unpacklo_ps(sum, sum));
+            _mm_storeu_ps(buf + 2 * i + 4, _mm_unpackhi_ps(sum, sum));
+        }
+#endif
+        for (; i < count; ++i) {
+            buf[2 * i] = buf[2 * i + 1] = accum[i];
+        }
+        buf += 2 * count;
+        frames -= count;
+    }
+}
+
+} // namespace
 
-// TODO: Speed up for special case of 2 channels?
 void mono_blend(void *buf, audio_format_t format, size_t channelCount, size_t frames, bool limit) {
     if (channelCount < 2) {
         return;
@@ -30,13 +150,22 @@ void mono_blend(void *buf, audio_format_t format, size_t channelCount, size_t fr
     switch (format) {
     case AUDIO_FORMAT_PCM_16_BIT: {
         int16_t *out = (int16_t *)buf;
+        switch (channelCount) {
+        case 2: mono_blend_i16<2>(out, frames); return;
+        case 3: mono_blend_i16<3>(out, frames); return;
+        case 4: mono_blend_i16<4>(out, frames); return;
+        case 5: mono_blend_i16<5>(out, frames); return;
+        case 6: mono_blend_i16<6>(out, frames); return;
+        case 7: mono_blend_i16<7>(out, frames); return;
+        case 8: mono_blend_i16<8>(out, frames); return;
+        }
         for (size_t i = 0; i < frames; ++i) {
             const int16_t *in = out;
             int accum = 0;
             for (size_t j = 0; j < channelCount; ++j) {
                 accum += *in++;
             }
-            accum /= channelCount; // round to 0
+            accum /= (int)channelCount; // round to 0
             for (size_t j = 0; j < channelCount; ++j) {
                 *out++ = accum;
             }
@@ -44,6 +173,15 @@ void mono_blend(void *buf, audio_format_t format, size_t channelCount, size_t fr
     } break;
     case AUDIO_FORMAT_PCM_FLOAT: {
         float *out = (float *)buf;
+        switch (channelCount) {
+        case 2: mono_blend_float_stereo(out, frames, limit); return;
+        case 3: mono_blend_float<3>(out, frames); return;
+        case 4: mono_blend_float<4>(out, frames); return;
+        case 5: mono_blend_float<5>(out, frames); return;
+        case 6: mono_blend_float<6>(out, frames); return;
+        case 7: mono_blend_float<7>(out, frames); return;
+        case 8: mono_blend_float<8>(out, frames); return;
+        }
         const float recipdiv = 1. / channelCount;
         for (size_t i = 0; i < frames; ++i) {
             const float *in = out;
@@ -51,11 +189,7 @@ void mono_blend(void *buf, audio_format_t format, size_t channelCount, size_t fr
             for (size_t j = 0; j < channelCount; ++j) {
                 accum += *in++;
             }
-            if (limit && channelCount == 2) {
-                accum = limiter(accum * M_SQRT1_2);
-            } else {
-                accum *= recipdiv;
-            }
+            accum *= recipdiv;
             for (size_t j = 0; j < channelCount; ++j) {
                 *out++ = accum;
             }
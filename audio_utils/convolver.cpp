@@ -0,0 +1,307 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Partitioned overlap-save convolution.
+ *
+ * The impulse response is covered by levels.  Level l has partitions of S = block_frames * 2^l
+ * frames starting at impulse offset D, and keeps a frequency-domain delay line of the spectra
+ * of its past input windows.  Every S input frames, the window of the latest 2 S frames is
+ * transformed, multiplied by each partition's spectrum against the matching past window, and
+ * the sum transformed back.  Its last S samples are the level's contribution to output frames
+ * [t - S + D, t + D), where t is the current input time.  They are added to an output ring
+ * indexed by output time, i.e. input time plus the block_frames latency.  Since D >= S -
+ * block_frames for every level, contributions are always complete before they are output.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "audio_utils_convolver"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <log/log.h>
+#include <audio_utils/convolver.h>
+#include <audio_utils/fft.h>
+#include <audio_utils/roundup.h>
+#include "private/private.h"
+
+#define CONVOLVER_MAX_LEVELS 16
+
+struct convolver_level {
+    size_t block;                   // partition size S in frames
+    size_t offset;                  // first impulse frame covered by this level
+    size_t partitions;              // number of partitions of this level
+    struct fft_float_plan *plan;    // transforms of 2 S frames
+    float *filter;                  // spectra of the partitions, per impulse channel,
+                                    // scaled by 1 / (2 S) for the unscaled inverse transform
+    float *fdl;                     // spectra of the latest input windows, per channel
+    size_t fdl_pos;                 // index in fdl of the latest spectrum
+};
+
+struct convolver {
+    size_t channel_count;
+    size_t impulse_channels;
+    size_t block;                   // block_frames, the latency
+    size_t level_count;
+    struct convolver_level levels[CONVOLVER_MAX_LEVELS];
+    size_t history_size;            // power of 2 >= 2 * largest partition
+    float *history;                 // input ring per channel, indexed by input time
+    size_t out_size;                // power of 2 > furthest output time written ahead
+    float *out;                     // output ring per channel, indexed by output time
+    uint64_t time;                  // input frames since reset
+    float *acc;                     // 2 * largest partition floats of work space
+};
+
+namespace {
+
+// acc += x * h, for spectra of n floats packed as by fft_float_real()
+void spectrum_mac(float *acc, const float *x, const float *h, size_t n)
+{
+    acc[0] += x[0] * h[0];
+    acc[1] += x[1] * h[1];
+    size_t i = 2;
+#if defined(USE_NEON)
+    for (; i + 8 <= n; i += 8) {
+        float32x4x2_t a = vld2q_f32(acc + i);
+        const float32x4x2_t xv = vld2q_f32(x + i);
+        const float32x4x2_t hv = vld2q_f32(h + i);
+        a.val[0] = vaddq_f32(a.val[0], vsubq_f32(vmulq_f32(xv.val[0], hv.val[0]),
+                vmulq_f32(xv.val[1], hv.val[1])));
+        a.val[1] = vaddq_f32(a.val[1], vaddq_f32(vmulq_f32(xv.val[0], hv.val[1]),
+                vmulq_f32(xv.val[1], hv.val[0])));
+        vst2q_f32(acc + i, a);
+    }
+#elif defined(USE_SSE2)
+    for (; i + 8 <= n; i += 8) {
+        const __m128 x0 = _mm_loadu_ps(x + i), x1 = _mm_loadu_ps(x + i + 4);
+        const __m128 h0 = _mm_loadu_ps(h + i), h1 = _mm_loadu_ps(h + i + 4);
+        const __m128 xr = _mm_shuffle_ps(x0, x1, _MM_SHUFFLE(2, 0, 2, 0));
+        const __m128 xi = _mm_shuffle_ps(x0, x1, _MM_SHUFFLE(3, 1, 3, 1));
+        const __m128 hr = _mm_shuffle_ps(h0, h1, _MM_SHUFFLE(2, 0, 2, 0));
+        const __m128 hi = _mm_shuffle_ps(h0, h1, _MM_SHUFFLE(3, 1, 3, 1));
+        const __m128 re = _mm_sub_ps(_mm_mul_ps(xr, hr), _mm_mul_ps(xi, hi));
+        const __m128 im = _mm_add_ps(_mm_mul_ps(xr, hi), _mm_mul_ps(xi, hr));
+        _mm_storeu_ps(acc + i, _mm_add_ps(_mm_loadu_ps(acc + i), _mm_unpacklo_ps(re, im)));
+        _mm_storeu_ps(acc + i + 4,
+                _mm_add_ps(_mm_loadu_ps(acc + i + 4), _mm_unpackhi_ps(re, im)));
+    }
+#endif
+    for (; i < n; i += 2) {
+        const float re = x[i] * h[i] - x[i + 1] * h[i + 1];
+        const float im = x[i] * h[i + 1] + x[i + 1] * h[i];
+        acc[i] += re;
+        acc[i + 1] += im;
+    }
+}
+
+// Run one level for the input block ending at c->time.
+void convolver_level_process(struct convolver *c, struct convolver_level *level)
+{
+    const size_t block = level->block;
+    const size_t n = 2 * block;
+    const size_t hmask = c->history_size - 1;
+    const size_t omask = c->out_size - 1;
+    level->fdl_pos = level->fdl_pos + 1 == level->partitions ? 0 : level->fdl_pos + 1;
+    // output time of the first frame contributed by this block
+    const uint64_t outStart = c->time - block + level->offset + c->block;
+
+    for (size_t ch = 0; ch < c->channel_count; ++ch) {
+        const float *history = c->history + ch * c->history_size;
+        float *spectrum = level->fdl + (ch * level->partitions + level->fdl_pos) * n;
+        const uint64_t start = c->time - n;
+        for (size_t i = 0; i < n; ++i) {
+            spectrum[i] = history[(start + i) & hmask];
+        }
+        fft_float_real(level->plan, spectrum);
+
+        const size_t ich = c->impulse_channels == 1 ? 0 : ch;
+        const float *filter = level->filter + ich * level->partitions * n;
+        memset(c->acc, 0, n * sizeof(float));
+        size_t pos = level->fdl_pos;
+        for (size_t p = 0; p < level->partitions; ++p) {
+            spectrum_mac(c->acc, level->fdl + (ch * level->partitions + pos) * n,
+                    filter + p * n, n);
+            pos = pos == 0 ? level->partitions - 1 : pos - 1;
+        }
+        fft_float_real_inverse(level->plan, c->acc);
+
+        float *out = c->out + ch * c->out_size;
+        for (size_t i = 0; i < block; ++i) {
+            out[(outStart + i) & omask] += c->acc[block + i];
+        }
+    }
+}
+
+} // namespace
+
+int convolver_create(const struct convolver_config *config, const float *impulse,
+        size_t impulse_frames, size_t impulse_channels, struct convolver **convolver)
+{
+    if (convolver == NULL) {
+        return -EINVAL;
+    }
+    *convolver = NULL;
+    if (config == NULL || impulse == NULL || impulse_frames == 0 || config->channel_count == 0 ||
+            (impulse_channels != 1 && impulse_channels != config->channel_count) ||
+            config->block_frames < 2 ||
+            (config->block_frames & (config->block_frames - 1)) != 0 ||
+            config->max_block_frames < config->block_frames ||
+            config->max_block_frames > FFT_FLOAT_MAX_SIZE / 2 ||
+            (config->max_block_frames & (config->max_block_frames - 1)) != 0) {
+        ALOGW("convolver_create() invalid parameters");
+        return -EINVAL;
+    }
+
+    struct convolver *c = (struct convolver *) calloc(1, sizeof(*c));
+    if (c == NULL) {
+        return -ENOMEM;
+    }
+    c->channel_count = config->channel_count;
+    c->impulse_channels = impulse_channels;
+    c->block = config->block_frames;
+
+    // two partitions per size, doubling up to max_block_frames which covers the rest
+    size_t offset = 0;
+    size_t block = config->block_frames;
+    while (offset < impulse_frames) {
+        struct convolver_level *level = &c->levels[c->level_count++];
+        const size_t remaining = (impulse_frames - offset + block - 1) / block;
+        level->block = block;
+        level->offset = offset;
+        level->partitions = block == config->max_block_frames || remaining < 2 ? remaining : 2;
+        offset += level->partitions * block;
+        if (block < config->max_block_frames) {
+            block *= 2;
+        }
+    }
+    const struct convolver_level *last = &c->levels[c->level_count - 1];
+    const size_t maxBlock = last->block;
+
+    c->history_size = 2 * maxBlock;
+    c->out_size = roundup(last->offset + c->block + 1);
+    c->history = (float *) calloc(c->channel_count * c->history_size, sizeof(float));
+    c->out = (float *) calloc(c->channel_count * c->out_size, sizeof(float));
+    c->acc = (float *) malloc(2 * maxBlock * sizeof(float));
+    if (c->history == NULL || c->out == NULL || c->acc == NULL) {
+        goto error;
+    }
+
+    for (size_t l = 0; l < c->level_count; ++l) {
+        struct convolver_level *level = &c->levels[l];
+        const size_t n = 2 * level->block;
+        level->plan = fft_float_plan_create(n);
+        level->filter = (float *) calloc(impulse_channels * level->partitions * n,
+                sizeof(float));
+        level->fdl = (float *) calloc(c->channel_count * level->partitions * n, sizeof(float));
+        if (level->plan == NULL || level->filter == NULL || level->fdl == NULL) {
+            goto error;
+        }
+        const float scale = 1.0f / n;
+        for (size_t ich = 0; ich < impulse_channels; ++ich) {
+            for (size_t p = 0; p < level->partitions; ++p) {
+                float *spectrum = level->filter + (ich * level->partitions + p) * n;
+                const size_t first = level->offset + p * level->block;
+                for (size_t i = 0; i < level->block && first + i < impulse_frames; ++i) {
+                    spectrum[i] = impulse[(first + i) * impulse_channels + ich] * scale;
+                }
+                fft_float_real(level->plan, spectrum);
+            }
+        }
+    }
+    ALOGV("convolver_create() %zu frames in %zu levels, latency %zu",
+            impulse_frames, c->level_count, c->block);
+    *convolver = c;
+    return 0;
+
+error:
+    convolver_destroy(c);
+    return -ENOMEM;
+}
+
+void convolver_destroy(struct convolver *convolver)
+{
+    if (convolver == NULL) {
+        return;
+    }
+    for (size_t l = 0; l < convolver->level_count; ++l) {
+        fft_float_plan_destroy(convolver->levels[l].plan);
+        free(convolver->levels[l].filter);
+        free(convolver->levels[l].fdl);
+    }
+    free(convolver->history);
+    free(convolver->out);
+    free(convolver->acc);
+    free(convolver);
+}
+
+void convolver_reset(struct convolver *convolver)
+{
+    struct convolver *c = convolver;
+    memset(c->history, 0, c->channel_count * c->history_size * sizeof(float));
+    memset(c->out, 0, c->channel_count * c->out_size * sizeof(float));
+    for (size_t l = 0; l < c->level_count; ++l) {
+        struct convolver_level *level = &c->levels[l];
+        memset(level->fdl, 0,
+                c->channel_count * level->partitions * 2 * level->block * sizeof(float));
+        level->fdl_pos = 0;
+    }
+    c->time = 0;
+}
+
+void convolver_process(struct convolver *convolver, const float *in, float *out, size_t frames)
+{
+    struct convolver *c = convolver;
+    const size_t channels = c->channel_count;
+    const size_t hmask = c->history_size - 1;
+    const size_t omask = c->out_size - 1;
+
+    while (frames > 0) {
+        size_t count = c->block - (size_t)(c->time & (c->block - 1));
+        if (count > frames) {
+            count = frames;
+        }
+        // all input of the chunk is consumed before any output is written, so in may equal out
+        for (size_t ch = 0; ch < channels; ++ch) {
+            float *history = c->history + ch * c->history_size;
+            for (size_t i = 0; i < count; ++i) {
+                history[(c->time + i) & hmask] = in[i * channels + ch];
+            }
+        }
+        for (size_t ch = 0; ch < channels; ++ch) {
+            float *ring = c->out + ch * c->out_size;
+            for (size_t i = 0; i < count; ++i) {
+                float *sample = &ring[(c->time + i) & omask];
+                out[i * channels + ch] = *sample;
+                *sample = 0;
+            }
+        }
+        c->time += count;
+        in += count * channels;
+        out += count * channels;
+        frames -= count;
+
+        if ((c->time & (c->block - 1)) == 0) {
+            for (size_t l = 0; l < c->level_count; ++l) {
+                struct convolver_level *level = &c->levels[l];
+                if ((c->time & (level->block - 1)) == 0) {
+                    convolver_level_process(c, level);
+                }
+            }
+        }
+    }
+}
@@ -19,13 +19,17 @@
 
 #include <errno.h>
 #include <inttypes.h>
-#include <pthread.h>
 #include <stdlib.h>
+#include <string.h>
 
+#include <cutils/atomic.h>
 #include <log/log.h>
 #include <system/audio.h>
+#include <audio_utils/channels.h>
+#include <audio_utils/fifo.h>
 #include <audio_utils/resampler.h>
 #include <audio_utils/echo_reference.h>
+#include <audio_utils/trace.h>
 
 // echo reference state: bit field indicating if read, write or both are active.
 enum state {
@@ -34,10 +38,30 @@ enum state {
     ECHOREF_WRITING = 0x02      // writing is active
 };
 
+/* The write path runs on the playback thread and must never block, so the playback and capture
+ * threads share no lock.  Frames converted to the read format are passed from write() to read()
+ * through a single-producer single-consumer FIFO, and the time stamp and delay of the latest write
+ * are published with a sequence counter.  All other fields are owned by one side:
+ * the wr_ fields and the resampler by write(), the rest by read().
+ */
+
+/* Duration of the FIFO between write() and read().  The reader drains the FIFO on every read(),
+ * so this only needs to absorb the writes made during one capture period.
+ */
+#define ECHO_REFERENCE_FIFO_MS 500
+
+// time stamp and delay of the latest write(), published by the writer to the reader
+struct echo_reference_timing {
+    struct timespec time_stamp;     // latest render time indicated by write()
+    int32_t delay_ns;               // playback buffer delay indicated by last write()
+    int32_t resampler_delay_ns;     // delay of the input resampler after last write()
+    uint32_t frames;                // total frames written to the FIFO, including that write
+};
+
 struct echo_reference {
     struct echo_reference_itfe itfe;
     int status;                     // init status
-    uint32_t state;                 // active state: reading, writing or both
+    volatile int32_t state;         // active state: reading, writing or both
     audio_format_t rd_format;       // read sample format
     uint32_t rd_channel_count;      // read number of channels
     uint32_t rd_sampling_rate;      // read sampling rate in Hz
@@ -46,11 +70,23 @@ struct echo_reference {
     uint32_t wr_channel_count;      // write number of channels
     uint32_t wr_sampling_rate;      // write sampling rate in Hz
     size_t wr_frame_size;           // write frame size (bytes per sample)
-    void *buffer;                   // main buffer
+    size_t max_read_frames;         // max frame count per read(), or 0 if buffers grow on demand
+    size_t max_write_frames;        // max frame count per write(), or 0 if buffers grow on demand
+    void *buffer;                   // main buffer, owned by reader
     size_t buf_size;                // main buffer size in frames
     size_t frames_in;               // number of frames in main buffer
+    uint32_t rd_frames;             // total frames read from the FIFO
+    struct audio_utils_fifo fifo;   // frames written and not yet moved to the main buffer
+    void *fifo_buffer;              // storage for fifo
+    size_t fifo_frame_count;        // capacity of fifo in frames
+    volatile int32_t timing_seq;    // odd while the writer updates timing
+    struct echo_reference_timing timing; // protected by timing_seq
+    uint32_t wr_frames;             // total frames written to the FIFO
     void *wr_buf;                   // buffer for input conversions
     size_t wr_buf_size;             // size of conversion buffer in frames
+    void *wr_chan_buf;              // channel conversion output read by the resampler, as
+                                    // the resampler output goes to wr_buf
+    size_t wr_chan_buf_size;        // size of channel conversion buffer in frames
     size_t wr_frames_in;            // number of frames in conversion buffer
     size_t wr_curr_frame_size;      // number of frames given to current write() function
     void *wr_src_buf;               // resampler input buf (either wr_buf or buffer used by write())
@@ -60,8 +96,10 @@ struct echo_reference {
     int16_t prev_delta_sign;        // sign of previous delay difference:
                                     //  1: positive, -1: negative, 0: unknown
     uint16_t delta_count;           // number of consecutive delay differences with same sign
-    pthread_mutex_t lock;                      // mutex protecting read/write concurrency
-    pthread_cond_t cond;                       // condition signaled when data is ready to read
+    enum echo_reference_delay_mode delay_mode; // how read() compensates for delay deviations
+    int64_t smoothed_delta_ns;      // smoothed deviation from expected delay, in tracking mode
+    volatile int32_t ratio_ppm;     // resampler adjustment requested by reader
+    int32_t wr_ratio_ppm;           // resampler adjustment last applied by writer
     struct resampler_itfe *resampler;          // input resampler
     struct resampler_buffer_provider provider; // resampler buffer provider
 };
@@ -87,9 +125,9 @@ int echo_reference_get_next_buffer(struct resampler_buffer_provider *buffer_prov
 
     buffer->frame_count = (buffer->frame_count > er->wr_frames_in) ?
             er->wr_frames_in : buffer->frame_count;
-    // this is er->rd_channel_count here as we resample after stereo to mono conversion if any
-    buffer->i16 = (int16_t *)er->wr_src_buf + (er->wr_curr_frame_size - er->wr_frames_in) *
-            er->rd_channel_count;
+    // this is er->rd_frame_size here as we resample after channel conversion if any
+    buffer->raw = (char *)er->wr_src_buf + (er->wr_curr_frame_size - er->wr_frames_in) *
+            er->rd_frame_size;
 
     return 0;
 }
@@ -109,20 +147,95 @@ void echo_reference_release_buffer(struct resampler_buffer_provider *buffer_prov
     er->wr_frames_in -= buffer->frame_count;
 }
 
-static void echo_reference_reset_l(struct echo_reference *er)
+// publish the time stamp and delay of the latest write, called by the writer only
+static void echo_reference_publish_timing(struct echo_reference *er)
 {
-    ALOGV("echo_reference_reset_l()");
-    free(er->buffer);
-    er->buffer = NULL;
-    er->buf_size = 0;
-    er->frames_in = 0;
-    free(er->wr_buf);
-    er->wr_buf = NULL;
-    er->wr_buf_size = 0;
+    const int32_t seq = er->timing_seq;
+    android_atomic_release_store(seq + 1, &er->timing_seq);
+    android_memory_barrier();
+    er->timing.time_stamp = er->wr_render_time;
+    er->timing.delay_ns = er->playback_delay;
+    er->timing.resampler_delay_ns =
+            er->resampler != NULL ? er->resampler->delay_ns(er->resampler) : 0;
+    er->timing.frames = er->wr_frames;
+    android_atomic_release_store(seq + 2, &er->timing_seq);
+}
+
+// get the time stamp and delay of the latest write, called by the reader only
+static void echo_reference_get_timing(struct echo_reference *er,
+                                      struct echo_reference_timing *timing)
+{
+    int32_t seq;
+    do {
+        seq = android_atomic_acquire_load(&er->timing_seq);
+        *timing = er->timing;
+        android_memory_barrier();
+    } while ((seq & 1) != 0 || seq != android_atomic_acquire_load(&er->timing_seq));
+}
+
+static void echo_reference_reset_write(struct echo_reference *er)
+{
+    ALOGV("echo_reference_reset_write()");
+    if (er->max_write_frames == 0) {
+        free(er->wr_buf);
+        er->wr_buf = NULL;
+        er->wr_buf_size = 0;
+        free(er->wr_chan_buf);
+        er->wr_chan_buf = NULL;
+        er->wr_chan_buf_size = 0;
+    }
     er->wr_render_time.tv_sec = 0;
     er->wr_render_time.tv_nsec = 0;
+    er->playback_delay = 0;
+    echo_reference_publish_timing(er);
+}
+
+// discard buffered frames, called by the reader only
+static void echo_reference_reset_read(struct echo_reference *er)
+{
+    ALOGV("echo_reference_reset_read()");
+    if (er->max_read_frames == 0) {
+        free(er->buffer);
+        er->buffer = NULL;
+        er->buf_size = 0;
+    }
+    er->frames_in = 0;
     er->delta_count = 0;
     er->prev_delta_sign = 0;
+    er->smoothed_delta_ns = 0;
+    android_atomic_release_store(0, &er->ratio_ppm);
+    // the writer may be writing concurrently, so discard what the FIFO has now
+    ssize_t frames;
+    struct audio_utils_iovec iovec[2];
+    frames = audio_utils_fifo_read_obtain(&er->fifo, iovec, er->fifo_frame_count);
+    if (frames < 0) {
+        frames = 0;
+    }
+    audio_utils_fifo_read_release(&er->fifo, frames);
+    er->rd_frames += frames;
+}
+
+// move all frames from the FIFO to the end of the main buffer, called by the reader only
+static void echo_reference_drain(struct echo_reference *er)
+{
+    size_t count = er->fifo_frame_count;
+    if (er->max_read_frames != 0) {
+        // frames which do not fit stay in the FIFO until the next read
+        count = er->buf_size - er->frames_in;
+    } else if (er->buf_size < er->frames_in + count) {
+        er->buf_size = er->frames_in + count;
+        er->buffer = realloc(er->buffer, er->buf_size * er->rd_frame_size);
+        ALOGV("echo_reference_drain(): increasing buffer size to %zu", er->buf_size);
+    }
+    if (count == 0) {
+        return;
+    }
+    ssize_t frames = audio_utils_fifo_read(&er->fifo,
+            (char *)er->buffer + er->frames_in * er->rd_frame_size, count);
+    if (frames > 0) {
+        er->frames_in += frames;
+        er->rd_frames += frames;
+    }
 }
 
 /* additional space in resampler buffer allowing for extra samples to be returned
@@ -130,9 +243,49 @@ static void echo_reference_reset_l(struct echo_reference *er)
  */
 #define RESAMPLER_HEADROOM_SAMPLES   10
 
+// number of frames to request from the resampler for a write of frameCount frames
+static size_t echo_reference_resampled_frames(struct echo_reference *er, size_t frameCount)
+{
+    return (frameCount * er->rd_sampling_rate) / er->wr_sampling_rate +
+            RESAMPLER_HEADROOM_SAMPLES;
+}
+
+static int echo_reference_create_resampler(struct echo_reference *er)
+{
+    int rc;
+    ALOGV("echo_reference_create_resampler() new ReSampler(%d, %d)",
+          er->wr_sampling_rate, er->rd_sampling_rate);
+    er->provider.get_next_buffer = echo_reference_get_next_buffer;
+    er->provider.release_buffer = echo_reference_release_buffer;
+    struct resampler_config config;
+    memset(&config, 0, sizeof(config));
+    config.in_sample_rate = er->wr_sampling_rate;
+    config.out_sample_rate = er->rd_sampling_rate;
+    config.channel_count = er->rd_channel_count;
+    config.quality = RESAMPLER_QUALITY_DEFAULT;
+    if (er->max_write_frames != 0) {
+        config.max_frame_count = echo_reference_resampled_frames(er, er->max_write_frames);
+        config.flags = RESAMPLER_FLAG_NO_ALLOC;
+    }
+    // prefer the polyphase engine, which shares its filter tables between
+    // echo references, and fall back to speex for ratios it does not support
+    config.engine = RESAMPLER_ENGINE_POLYPHASE;
+    rc = create_resampler_from_config(&config, &er->provider, &er->resampler);
+    if (rc != 0) {
+        config.engine = RESAMPLER_ENGINE_SPEEX;
+        rc = create_resampler_from_config(&config, &er->provider, &er->resampler);
+    }
+    if (rc != 0) {
+        er->resampler = NULL;
+        ALOGV("echo_reference_create_resampler() failure to create resampler %d", rc);
+    }
+    return rc;
+}
+
 static int echo_reference_write(struct echo_reference_itfe *echo_reference,
                          struct echo_reference_buffer *buffer)
 {
+    AUDIO_UTILS_TRACE_SCOPE("echo_reference_write");
     struct echo_reference *er = (struct echo_reference *)echo_reference;
     int status = 0;
 
@@ -140,15 +293,19 @@ static int echo_reference_write(struct echo_reference_itfe *echo_reference,
         return -EINVAL;
     }
 
-    pthread_mutex_lock(&er->lock);
-
     if (buffer == NULL) {
         ALOGV("echo_reference_write() stop write");
-        er->state &= ~ECHOREF_WRITING;
-        echo_reference_reset_l(er);
+        android_atomic_and(~ECHOREF_WRITING, &er->state);
+        echo_reference_reset_write(er);
         goto exit;
     }
 
+    if (er->max_write_frames != 0 && buffer->frame_count > er->max_write_frames) {
+        ALOGW("echo_reference_write() %zu frames exceeds maximum %zu",
+                buffer->frame_count, er->max_write_frames);
+        return -EINVAL;
+    }
+
     ALOGV("echo_reference_write() START trying to write %zu frames", buffer->frame_count);
     ALOGV("echo_reference_write() playbackTimestamp:[%d].[%d], er->playback_delay:[%" PRId32 "]",
             (int)buffer->time_stamp.tv_sec,
@@ -162,15 +319,15 @@ static int echo_reference_write(struct echo_reference_itfe *echo_reference,
         goto exit;
     }
 
-    if ((er->state & ECHOREF_WRITING) == 0) {
+    if ((android_atomic_acquire_load(&er->state) & ECHOREF_WRITING) == 0) {
         ALOGV("echo_reference_write() start write");
         if (er->resampler != NULL) {
             er->resampler->reset(er->resampler);
         }
-        er->state |= ECHOREF_WRITING;
+        android_atomic_or(ECHOREF_WRITING, &er->state);
     }
 
-    if ((er->state & ECHOREF_READING) == 0) {
+    if ((android_atomic_acquire_load(&er->state) & ECHOREF_READING) == 0) {
         goto exit;
     }
 
@@ -184,74 +341,73 @@ static int echo_reference_write(struct echo_reference_itfe *echo_reference,
 
     void *srcBuf;
     size_t inFrames;
-    // do stereo to mono and down sampling if necessary
+    // do channel conversion and resampling if necessary
     if (er->rd_channel_count != er->wr_channel_count ||
             er->rd_sampling_rate != er->wr_sampling_rate) {
-        size_t wrBufSize = buffer->frame_count;
-
-        inFrames = buffer->frame_count;
-
-        if (er->rd_sampling_rate != er->wr_sampling_rate) {
-            inFrames = (buffer->frame_count * er->rd_sampling_rate) / er->wr_sampling_rate +
-                                                    RESAMPLER_HEADROOM_SAMPLES;
-            // wr_buf is not only used as resampler output but also for stereo to mono conversion
-            // output so buffer size is driven by both write and read sample rates
-            if (inFrames > wrBufSize) {
-                wrBufSize = inFrames;
-            }
-        }
+        const bool resampling = er->rd_sampling_rate != er->wr_sampling_rate;
+        // wr_buf receives the resampler output if resampling, otherwise the channel conversion
+        inFrames = resampling ?
+                echo_reference_resampled_frames(er, buffer->frame_count) : buffer->frame_count;
 
-        if (er->wr_buf_size < wrBufSize) {
+        // always false if preallocated, as wr_buf_size is then sized for max_write_frames
+        if (er->wr_buf_size < inFrames) {
             ALOGV("echo_reference_write() increasing write buffer size from %zu to %zu",
-                    er->wr_buf_size, wrBufSize);
-            er->wr_buf_size = wrBufSize;
+                    er->wr_buf_size, inFrames);
+            er->wr_buf_size = inFrames;
             er->wr_buf = realloc(er->wr_buf, er->wr_buf_size * er->rd_frame_size);
         }
 
         if (er->rd_channel_count != er->wr_channel_count) {
-            // must be stereo to mono
-            int16_t *src16 = (int16_t *)buffer->raw;
-            int16_t *dst16 = (int16_t *)er->wr_buf;
-            size_t frames = buffer->frame_count;
-            while (frames--) {
-                *dst16++ = (int16_t)(((int32_t)*src16 + (int32_t)*(src16 + 1)) >> 1);
-                src16 += 2;
+            // the resampler reads its input while writing its output, so they must not overlap
+            void *chanBuf = er->wr_buf;
+            if (resampling) {
+                if (er->wr_chan_buf_size < buffer->frame_count) {
+                    er->wr_chan_buf_size = buffer->frame_count;
+                    er->wr_chan_buf = realloc(er->wr_chan_buf,
+                            er->wr_chan_buf_size * er->rd_frame_size);
+                }
+                chanBuf = er->wr_chan_buf;
+            }
+            // extra channels are dropped, except that mono is the average of the first two
+            if (er->rd_format == AUDIO_FORMAT_PCM_FLOAT) {
+                adjust_channels_float((const float *)buffer->raw, er->wr_channel_count,
+                        (float *)chanBuf, er->rd_channel_count,
+                        buffer->frame_count * er->wr_frame_size);
+            } else {
+                adjust_channels(buffer->raw, er->wr_channel_count,
+                        chanBuf, er->rd_channel_count, sizeof(int16_t),
+                        buffer->frame_count * er->wr_frame_size);
             }
         }
         if (er->wr_sampling_rate != er->rd_sampling_rate) {
-            if (er->resampler == NULL) {
-                int rc;
-                ALOGV("echo_reference_write() new ReSampler(%d, %d)",
-                      er->wr_sampling_rate, er->rd_sampling_rate);
-                er->provider.get_next_buffer = echo_reference_get_next_buffer;
-                er->provider.release_buffer = echo_reference_release_buffer;
-                rc = create_resampler(er->wr_sampling_rate,
-                                 er->rd_sampling_rate,
-                                 er->rd_channel_count,
-                                 RESAMPLER_QUALITY_DEFAULT,
-                                 &er->provider,
-                                 &er->resampler);
-                if (rc != 0) {
-                    er->resampler = NULL;
-                    ALOGV("echo_reference_write() failure to create resampler %d", rc);
-                    status = -ENODEV;
-                    goto exit;
-                }
+            if (er->resampler == NULL && echo_reference_create_resampler(er) != 0) {
+                status = -ENODEV;
+                goto exit;
             }
             // er->wr_src_buf and er->wr_frames_in are used by getNexBuffer() called by the
             // resampler to get new frames
             if (er->rd_channel_count != er->wr_channel_count) {
-                er->wr_src_buf = er->wr_buf;
+                er->wr_src_buf = er->wr_chan_buf;
             } else {
                 er->wr_src_buf = buffer->raw;
             }
             er->wr_frames_in = buffer->frame_count;
             // inFrames is always more than we need here to get frames remaining from previous runs
             // inFrames is updated by resample() with the number of frames produced
-            ALOGV("echo_reference_write() ReSampling(%d, %d)",
-                  er->wr_sampling_rate, er->rd_sampling_rate);
-            er->resampler->resample_from_provider(er->resampler,
-                                                     (int16_t *)er->wr_buf, &inFrames);
+            int32_t ppm = android_atomic_acquire_load(&er->ratio_ppm);
+            if (ppm != er->wr_ratio_ppm &&
+                    er->resampler->set_ratio_adjustment_ppm(er->resampler, ppm) == 0) {
+                er->wr_ratio_ppm = ppm;
+            }
+            ALOGV("echo_reference_write() ReSampling(%d, %d) %+" PRId32 " ppm",
+                  er->wr_sampling_rate, er->rd_sampling_rate, ppm);
+            if (er->rd_format == AUDIO_FORMAT_PCM_FLOAT) {
+                er->resampler->resample_from_provider_float(er->resampler,
+                                                             (float *)er->wr_buf, &inFrames);
+            } else {
+                er->resampler->resample_from_provider(er->resampler,
+                                                       (int16_t *)er->wr_buf, &inFrames);
+            }
             ALOGV_IF(er->wr_frames_in != 0,
                     "echo_reference_write() er->wr_frames_in not 0 (%d) after resampler",
                     er->wr_frames_in);
@@ -262,25 +418,22 @@ static int echo_reference_write(struct echo_reference_itfe *echo_reference,
         srcBuf = buffer->raw;
     }
 
-    if (er->frames_in + inFrames > er->buf_size) {
-        ALOGV("echo_reference_write() increasing buffer size from %zu to %zu",
-                er->buf_size, er->frames_in + inFrames);
-                er->buf_size = er->frames_in + inFrames;
-                er->buffer = realloc(er->buffer, er->buf_size * er->rd_frame_size);
+    // never blocks: if the reader has stalled and the FIFO is full, the excess is dropped
+    ssize_t written = audio_utils_fifo_write(&er->fifo, srcBuf, inFrames);
+    if (written > 0) {
+        er->wr_frames += written;
     }
-    memcpy((char *)er->buffer + er->frames_in * er->rd_frame_size,
-           srcBuf,
-           inFrames * er->rd_frame_size);
-    er->frames_in += inFrames;
+    AUDIO_UTILS_TRACE_COUNTER("echo_reference dropped frames", (ssize_t)inFrames - written);
+    ALOGW_IF(written != (ssize_t)inFrames, "echo_reference_write() dropped %zd frames",
+            (ssize_t)inFrames - written);
+    echo_reference_publish_timing(er);
 
-    ALOGV("echo_reference_write() frames written:[%zu], frames total:[%zu] buffer size:[%zu]\n"
+    ALOGV("echo_reference_write() frames written:[%zd], frames total:[%" PRIu32 "]\n"
           "                       er->wr_render_time:[%d].[%d], er->playback_delay:[%" PRId32 "]",
-          inFrames, er->frames_in, er->buf_size,
+          written, er->wr_frames,
           (int)er->wr_render_time.tv_sec, (int)er->wr_render_time.tv_nsec, er->playback_delay);
 
-    pthread_cond_signal(&er->cond);
 exit:
-    pthread_mutex_unlock(&er->lock);
     ALOGV("echo_reference_write() END");
     return status;
 }
@@ -291,35 +444,94 @@ exit:
 // the buffer
 #define MIN_DELTA_NUM 4
 
+// In ECHO_REFERENCE_DELAY_TRACKING mode, deviations smaller than this are corrected through the
+// resampler ratio, and larger ones by realigning the buffer as in ECHO_REFERENCE_DELAY_REALIGN.
+#define DELAY_TRACKING_MAX_DELTA_NS 20000000
+// weight of a new deviation in the smoothed deviation is 1 / DELAY_TRACKING_SMOOTHING
+#define DELAY_TRACKING_SMOOTHING 16
+// time over which the ratio adjustment aims to cancel the smoothed deviation
+#define DELAY_TRACKING_CONVERGENCE_MS 2000
+// limit of the ratio adjustment, well beyond the drift between two crystal clocks
+#define DELAY_TRACKING_MAX_PPM 1000
+
+// Update the resampler ratio adjustment from a new deviation between actual and expected delay.
+static void echo_reference_track_delay(struct echo_reference *er, int64_t deltaNs)
+{
+    er->smoothed_delta_ns += (deltaNs - er->smoothed_delta_ns) / DELAY_TRACKING_SMOOTHING;
+    // too much delay buffered is positive, and corrected by consuming more input per output frame
+    int64_t ppm = er->smoothed_delta_ns / DELAY_TRACKING_CONVERGENCE_MS;
+    if (ppm > DELAY_TRACKING_MAX_PPM) {
+        ppm = DELAY_TRACKING_MAX_PPM;
+    } else if (ppm < -DELAY_TRACKING_MAX_PPM) {
+        ppm = -DELAY_TRACKING_MAX_PPM;
+    }
+    ALOGV("echo_reference_track_delay(): deltaNs %" PRId64 " smoothed %" PRId64 " ppm %" PRId64,
+            deltaNs, er->smoothed_delta_ns, ppm);
+    android_atomic_release_store((int32_t)ppm, &er->ratio_ppm);
+}
+
+static int echo_reference_set_delay_mode(struct echo_reference_itfe *echo_reference,
+                                         enum echo_reference_delay_mode mode)
+{
+    struct echo_reference *er = (struct echo_reference *)echo_reference;
+
+    if (er == NULL) {
+        return -EINVAL;
+    }
+    switch (mode) {
+    case ECHO_REFERENCE_DELAY_REALIGN:
+        break;
+    case ECHO_REFERENCE_DELAY_TRACKING:
+        // the ratio can only be adjusted when resampling
+        if (er->rd_sampling_rate == er->wr_sampling_rate) {
+            return -ENOSYS;
+        }
+        break;
+    default:
+        return -EINVAL;
+    }
+    er->delay_mode = mode;
+    er->smoothed_delta_ns = 0;
+    android_atomic_release_store(0, &er->ratio_ppm);
+    return 0;
+}
+
 
 static int echo_reference_read(struct echo_reference_itfe *echo_reference,
                          struct echo_reference_buffer *buffer)
 {
+    AUDIO_UTILS_TRACE_SCOPE("echo_reference_read");
     struct echo_reference *er = (struct echo_reference *)echo_reference;
 
     if (er == NULL) {
         return -EINVAL;
     }
 
-    pthread_mutex_lock(&er->lock);
-
     if (buffer == NULL) {
         ALOGV("echo_reference_read() stop read");
-        er->state &= ~ECHOREF_READING;
+        android_atomic_and(~ECHOREF_READING, &er->state);
         goto exit;
     }
 
+    if (er->max_read_frames != 0 && buffer->frame_count > er->max_read_frames) {
+        ALOGW("echo_reference_read() %zu frames exceeds maximum %zu",
+                buffer->frame_count, er->max_read_frames);
+        return -EINVAL;
+    }
+
     ALOGV("echo_reference_read() START, delayCapture:[%" PRId32 "], "
             "er->frames_in:[%zu],buffer->frame_count:[%zu]",
     buffer->delay_ns, er->frames_in, buffer->frame_count);
 
-    if ((er->state & ECHOREF_READING) == 0) {
+    if ((android_atomic_acquire_load(&er->state) & ECHOREF_READING) == 0) {
         ALOGV("echo_reference_read() start read");
-        echo_reference_reset_l(er);
-        er->state |= ECHOREF_READING;
+        echo_reference_reset_read(er);
+        android_atomic_or(ECHOREF_READING, &er->state);
     }
 
-    if ((er->state & ECHOREF_WRITING) == 0) {
+    if ((android_atomic_acquire_load(&er->state) & ECHOREF_WRITING) == 0) {
+        // discard anything left from before the writer stopped
+        echo_reference_reset_read(er);
         memset(buffer->raw, 0, er->rd_frame_size * buffer->frame_count);
         buffer->delay_ns = 0;
         goto exit;
@@ -327,73 +539,75 @@ static int echo_reference_read(struct echo_reference_itfe *echo_reference,
 
 //    ALOGV("echo_reference_read() %d frames", buffer->frame_count);
 
-    // allow some time for new frames to arrive if not enough frames are ready for read
+    echo_reference_drain(er);
+
+    // allow some time for new frames to arrive if not enough frames are ready for read.
+    // The FIFO is empty after draining, so this waits for the next write.
     if (er->frames_in < buffer->frame_count) {
         uint32_t timeoutMs = (uint32_t)((1000 * buffer->frame_count) / er->rd_sampling_rate / 2);
-        struct timespec ts = {0, 0};
-
-#ifndef HAVE_PTHREAD_COND_TIMEDWAIT_RELATIVE
-        clock_gettime(CLOCK_REALTIME, &ts);
-#endif
+        struct timespec ts = {timeoutMs / 1000, (timeoutMs % 1000) * 1000000};
+        struct audio_utils_iovec iovec[2];
 
-        ts.tv_sec  += timeoutMs/1000;
-        ts.tv_nsec += (timeoutMs%1000) * 1000000;
-        if (ts.tv_nsec >= 1000000000) {
-            ts.tv_nsec -= 1000000000;
-            ts.tv_sec  += 1;
+        if (audio_utils_fifo_read_obtain_timed(&er->fifo, iovec, 1, &ts) > 0) {
+            audio_utils_fifo_read_release(&er->fifo, 0);
+            echo_reference_drain(er);
         }
 
-#ifdef HAVE_PTHREAD_COND_TIMEDWAIT_RELATIVE
-        pthread_cond_timedwait_relative_np(&er->cond, &er->lock, &ts);
-#else
-        pthread_cond_timedwait(&er->cond, &er->lock, &ts);
-#endif
-
         ALOGV_IF((er->frames_in < buffer->frame_count),
                  "echo_reference_read() waited %d ms but still not enough frames"\
-                 " er->frames_in: %d, buffer->frame_count = %d",
+                 " er->frames_in: %zu, buffer->frame_count = %zu",
                  timeoutMs, er->frames_in, buffer->frame_count);
     }
 
     int64_t timeDiff;
     struct timespec tmp;
+    struct echo_reference_timing timing;
+    echo_reference_get_timing(er, &timing);
+    // frames read from the FIFO but written after the latest time stamp was published
+    size_t framesAfterTiming = (size_t)(uint32_t)(er->rd_frames - timing.frames);
+    if (framesAfterTiming > er->frames_in) {
+        framesAfterTiming = 0;
+    }
 
-    if ((er->wr_render_time.tv_sec == 0 && er->wr_render_time.tv_nsec == 0) ||
+    if ((timing.time_stamp.tv_sec == 0 && timing.time_stamp.tv_nsec == 0) ||
         (buffer->time_stamp.tv_sec == 0 && buffer->time_stamp.tv_nsec == 0)) {
         ALOGV("echo_reference_read(): NEW:timestamp is zero---------setting timeDiff = 0, "\
              "not updating delay this time");
         timeDiff = 0;
     } else {
-        if (buffer->time_stamp.tv_nsec < er->wr_render_time.tv_nsec) {
-            tmp.tv_sec = buffer->time_stamp.tv_sec - er->wr_render_time.tv_sec - 1;
-            tmp.tv_nsec = 1000000000 + buffer->time_stamp.tv_nsec - er->wr_render_time.tv_nsec;
+        if (buffer->time_stamp.tv_nsec < timing.time_stamp.tv_nsec) {
+            tmp.tv_sec = buffer->time_stamp.tv_sec - timing.time_stamp.tv_sec - 1;
+            tmp.tv_nsec = 1000000000 + buffer->time_stamp.tv_nsec - timing.time_stamp.tv_nsec;
         } else {
-            tmp.tv_sec = buffer->time_stamp.tv_sec - er->wr_render_time.tv_sec;
-            tmp.tv_nsec = buffer->time_stamp.tv_nsec - er->wr_render_time.tv_nsec;
+            tmp.tv_sec = buffer->time_stamp.tv_sec - timing.time_stamp.tv_sec;
+            tmp.tv_nsec = buffer->time_stamp.tv_nsec - timing.time_stamp.tv_nsec;
         }
         timeDiff = (((int64_t)tmp.tv_sec * 1000000000 + tmp.tv_nsec));
 
-        int64_t expectedDelayNs =  er->playback_delay + buffer->delay_ns - timeDiff;
+        int64_t expectedDelayNs =  timing.delay_ns + buffer->delay_ns - timeDiff;
 
-        if (er->resampler != NULL) {
-            // Resampler already compensates part of the delay
-            int32_t rsmp_delay = er->resampler->delay_ns(er->resampler);
-            expectedDelayNs -= rsmp_delay;
-        }
+        // Resampler already compensates part of the delay
+        expectedDelayNs -= timing.resampler_delay_ns;
 
         ALOGV("echo_reference_read(): expectedDelayNs[%" PRId64 "] = "
-                "er->playback_delay[%" PRId32 "] + delayCapture[%" PRId32
+                "playback_delay[%" PRId32 "] + delayCapture[%" PRId32
                 "] - timeDiff[%" PRId64 "]",
-                expectedDelayNs, er->playback_delay, buffer->delay_ns, timeDiff);
+                expectedDelayNs, timing.delay_ns, buffer->delay_ns, timeDiff);
 
         if (expectedDelayNs > 0) {
-            int64_t delayNs = ((int64_t)er->frames_in * 1000000000) / er->rd_sampling_rate;
+            int64_t delayNs = ((int64_t)(er->frames_in - framesAfterTiming) * 1000000000) /
+                    er->rd_sampling_rate;
 
             int64_t  deltaNs = delayNs - expectedDelayNs;
 
             ALOGV("echo_reference_read(): EchoPathDelayDeviation between reference and DMA [%"
                     PRId64 "]", deltaNs);
-            if (llabs(deltaNs) >= MIN_DELAY_DELTA_NS) {
+            if (er->delay_mode == ECHO_REFERENCE_DELAY_TRACKING &&
+                    llabs(deltaNs) < DELAY_TRACKING_MAX_DELTA_NS) {
+                er->delta_count = 0;
+                er->prev_delta_sign = 0;
+                echo_reference_track_delay(er, deltaNs);
+            } else if (llabs(deltaNs) >= MIN_DELAY_DELTA_NS) {
                 // smooth the variation and update the reference buffer only
                 // if a deviation in the same direction is observed for more than MIN_DELTA_NUM
                 // consecutive reads.
@@ -407,7 +621,15 @@ static int echo_reference_read(struct echo_reference_itfe *echo_reference,
 
                 if (er->delta_count > MIN_DELTA_NUM) {
                     size_t previousFrameIn = er->frames_in;
-                    er->frames_in = (size_t)((expectedDelayNs * er->rd_sampling_rate)/1000000000);
+                    // the buffer is now aligned, so restart tracking from the nominal ratio
+                    er->smoothed_delta_ns = 0;
+                    android_atomic_release_store(0, &er->ratio_ppm);
+                    er->frames_in = (size_t)((expectedDelayNs * er->rd_sampling_rate)/1000000000) +
+                            framesAfterTiming;
+                    if (er->max_read_frames != 0 && er->frames_in > er->buf_size) {
+                        // cannot grow the buffer, so align as closely as it allows
+                        er->frames_in = er->buf_size;
+                    }
                     int offset = er->frames_in - previousFrameIn;
 
                     ALOGV("echo_reference_read(): deltaNs ENOUGH and %s: "
@@ -432,7 +654,7 @@ static int echo_reference_read(struct echo_reference_itfe *echo_reference,
                         // More data available in the reference buffer than expected
                         offset = -offset;
                         if (offset > 0) {
-                            memcpy(er->buffer, (char *)er->buffer + (offset * er->rd_frame_size),
+                            memmove(er->buffer, (char *)er->buffer + (offset * er->rd_frame_size),
                                    er->frames_in * er->rd_frame_size);
                             ALOGV("echo_reference_read(): shifting ref buffer by [%zu]",
                                   er->frames_in);
@@ -447,9 +669,9 @@ static int echo_reference_read(struct echo_reference_itfe *echo_reference,
             }
         } else {
             ALOGV("echo_reference_read(): NEGATIVE expectedDelayNs[%" PRId64
-                 "] = er->playback_delay[%" PRId32 "] + delayCapture[%" PRId32
+                 "] = playback_delay[%" PRId32 "] + delayCapture[%" PRId32
                  "] - timeDiff[%" PRId64 "]",
-                 expectedDelayNs, er->playback_delay, buffer->delay_ns, timeDiff);
+                 expectedDelayNs, timing.delay_ns, buffer->delay_ns, timeDiff);
         }
     }
 
@@ -470,35 +692,35 @@ static int echo_reference_read(struct echo_reference_itfe *echo_reference,
            buffer->frame_count * er->rd_frame_size);
 
     er->frames_in -= buffer->frame_count;
-    memcpy(er->buffer,
+    memmove(er->buffer,
            (char *)er->buffer + buffer->frame_count * er->rd_frame_size,
            er->frames_in * er->rd_frame_size);
 
     // As the reference buffer is now time aligned to the microphone signal there is a zero delay
     buffer->delay_ns = 0;
+    AUDIO_UTILS_TRACE_COUNTER("echo_reference frames_in", er->frames_in);
 
     ALOGV("echo_reference_read() END %zu frames, total frames in %zu",
           buffer->frame_count, er->frames_in);
 
-    pthread_cond_signal(&er->cond);
-
 exit:
-    pthread_mutex_unlock(&er->lock);
     return 0;
 }
 
 
-int create_echo_reference(audio_format_t rdFormat,
-                            uint32_t rdChannelCount,
-                            uint32_t rdSamplingRate,
-                            audio_format_t wrFormat,
-                            uint32_t wrChannelCount,
-                            uint32_t wrSamplingRate,
-                            struct echo_reference_itfe **echo_reference)
+static int echo_reference_create(audio_format_t rdFormat,
+                                 uint32_t rdChannelCount,
+                                 uint32_t rdSamplingRate,
+                                 audio_format_t wrFormat,
+                                 uint32_t wrChannelCount,
+                                 uint32_t wrSamplingRate,
+                                 size_t maxReadFrames,
+                                 size_t maxWriteFrames,
+                                 struct echo_reference_itfe **echo_reference)
 {
     struct echo_reference *er;
 
-    ALOGV("create_echo_reference()");
+    ALOGV("echo_reference_create() max frames rd %zu, wr %zu", maxReadFrames, maxWriteFrames);
 
     if (echo_reference == NULL) {
         return -EINVAL;
@@ -506,22 +728,26 @@ int create_echo_reference(audio_format_t rdFormat,
 
     *echo_reference = NULL;
 
-    if (rdFormat != AUDIO_FORMAT_PCM_16_BIT ||
+    if ((rdFormat != AUDIO_FORMAT_PCM_16_BIT && rdFormat != AUDIO_FORMAT_PCM_FLOAT) ||
             rdFormat != wrFormat) {
         ALOGW("create_echo_reference bad format rd %d, wr %d", rdFormat, wrFormat);
         return -EINVAL;
     }
-    if ((rdChannelCount != 1 && rdChannelCount != 2) ||
-            wrChannelCount != 2) {
+    if (rdChannelCount == 0 || rdChannelCount > FCC_8 ||
+            wrChannelCount == 0 || wrChannelCount > FCC_8) {
         ALOGW("create_echo_reference bad channel count rd %d, wr %d", rdChannelCount,
                 wrChannelCount);
         return -EINVAL;
     }
 
     er = (struct echo_reference *)calloc(1, sizeof(struct echo_reference));
+    if (er == NULL) {
+        return -ENOMEM;
+    }
 
     er->itfe.read = echo_reference_read;
     er->itfe.write = echo_reference_write;
+    er->itfe.set_delay_mode = echo_reference_set_delay_mode;
 
     er->state = ECHOREF_IDLE;
     er->rd_format = rdFormat;
@@ -532,8 +758,88 @@ int create_echo_reference(audio_format_t rdFormat,
     er->wr_sampling_rate = wrSamplingRate;
     er->rd_frame_size = audio_bytes_per_sample(rdFormat) * rdChannelCount;
     er->wr_frame_size = audio_bytes_per_sample(wrFormat) * wrChannelCount;
+    er->fifo_frame_count = (size_t)rdSamplingRate * ECHO_REFERENCE_FIFO_MS / 1000;
+    er->fifo_buffer = malloc(er->fifo_frame_count * er->rd_frame_size);
+    if (er->fifo_frame_count == 0 || er->fifo_buffer == NULL) {
+        free(er->fifo_buffer);
+        free(er);
+        return -ENOMEM;
+    }
+    audio_utils_fifo_init(&er->fifo, er->fifo_frame_count, er->rd_frame_size, er->fifo_buffer);
+
+    if (maxReadFrames != 0) {
+        // room for one FIFO's worth of frames in addition to those needed for one read
+        er->max_read_frames = maxReadFrames;
+        er->buf_size = er->fifo_frame_count + maxReadFrames;
+        er->buffer = malloc(er->buf_size * er->rd_frame_size);
+        if (er->buffer == NULL) {
+            goto error;
+        }
+    }
+    if (maxWriteFrames != 0) {
+        er->max_write_frames = maxWriteFrames;
+        if (er->rd_channel_count != er->wr_channel_count ||
+                er->rd_sampling_rate != er->wr_sampling_rate) {
+            const bool resampling = er->rd_sampling_rate != er->wr_sampling_rate;
+            er->wr_buf_size = resampling ?
+                    echo_reference_resampled_frames(er, maxWriteFrames) : maxWriteFrames;
+            if (resampling && echo_reference_create_resampler(er) != 0) {
+                goto error;
+            }
+            er->wr_buf = malloc(er->wr_buf_size * er->rd_frame_size);
+            if (er->wr_buf == NULL) {
+                goto error;
+            }
+            if (resampling && er->rd_channel_count != er->wr_channel_count) {
+                er->wr_chan_buf_size = maxWriteFrames;
+                er->wr_chan_buf = malloc(er->wr_chan_buf_size * er->rd_frame_size);
+                if (er->wr_chan_buf == NULL) {
+                    goto error;
+                }
+            }
+        }
+    }
+
     *echo_reference = &er->itfe;
     return 0;
+
+error:
+    release_echo_reference(&er->itfe);
+    return -ENOMEM;
+}
+
+int create_echo_reference(audio_format_t rdFormat,
+                            uint32_t rdChannelCount,
+                            uint32_t rdSamplingRate,
+                            audio_format_t wrFormat,
+                            uint32_t wrChannelCount,
+                            uint32_t wrSamplingRate,
+                            struct echo_reference_itfe **echo_reference)
+{
+    return echo_reference_create(rdFormat, rdChannelCount, rdSamplingRate,
+                                 wrFormat, wrChannelCount, wrSamplingRate,
+                                 0 /*maxReadFrames*/, 0 /*maxWriteFrames*/, echo_reference);
+}
+
+int create_echo_reference_preallocated(audio_format_t rdFormat,
+                                       uint32_t rdChannelCount,
+                                       uint32_t rdSamplingRate,
+                                       audio_format_t wrFormat,
+                                       uint32_t wrChannelCount,
+                                       uint32_t wrSamplingRate,
+                                       size_t maxReadFrames,
+                                       size_t maxWriteFrames,
+                                       struct echo_reference_itfe **echo_reference)
+{
+    if (maxReadFrames == 0 || maxWriteFrames == 0) {
+        if (echo_reference != NULL) {
+            *echo_reference = NULL;
+        }
+        return -EINVAL;
+    }
+    return echo_reference_create(rdFormat, rdChannelCount, rdSamplingRate,
+                                 wrFormat, wrChannelCount, wrSamplingRate,
+                                 maxReadFrames, maxWriteFrames, echo_reference);
 }
 
 void release_echo_reference(struct echo_reference_itfe *echo_reference) {
@@ -544,10 +850,16 @@ void release_echo_reference(struct echo_reference_itfe *echo_reference) {
     }
 
     ALOGV("EchoReference dstor");
-    echo_reference_reset_l(er);
+    echo_reference_reset_write(er);
+    echo_reference_reset_read(er);
     if (er->resampler != NULL) {
         release_resampler(er->resampler);
     }
+    free(er->wr_buf);
+    free(er->wr_chan_buf);
+    free(er->buffer);
+    audio_utils_fifo_deinit(&er->fifo);
+    free(er->fifo_buffer);
     free(er);
 }
 
@@ -0,0 +1,442 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* A float implementation of the Fast Fourier Transform (FFT), complementing the fixed point
+ * fixed_fft().  All tables are computed once per size in a plan: the bit-reversal permutation
+ * as a list of swaps, and the twiddle factors of each pass laid out contiguously, with real and
+ * imaginary parts in separate arrays so that they load directly into vector registers.
+ * After the permutation, pairs of radix-2 decimation in time stages are fused into radix-4
+ * passes, which halves the number of passes over the data.  A single radix-2 pass comes first
+ * when log2(n) is odd.  Passes with at least 4 butterflies per group use NEON or SSE2.
+ * Real transforms of size n use a complex transform of size n / 2.
+ */
+
+#define LOG_TAG "audio_utils_fft"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <audio_utils/fft.h>
+#include "private/private.h"
+
+// One complex transform size.
+struct fft_core {
+    size_t n;               // complex transform size, a power of 2
+    bool odd;               // whether log2(n) is odd, so that a radix-2 pass is needed
+    size_t swapCount;       // number of pairs in swaps
+    uint32_t *swaps;        // index pairs exchanged by the bit-reversal permutation
+    float *twiddles;        // for each radix-4 pass with quarter length q, 4 * q floats:
+                            // w1 real, w1 imaginary, w2 real, w2 imaginary,
+                            // where w1 = exp(-2 pi i j / (2 q)) and w2 = exp(-2 pi i j / (4 q))
+};
+
+struct fft_float_plan {
+    size_t n;
+    struct fft_core full;   // size n, for complex transforms
+    struct fft_core half;   // size n / 2, for real transforms
+    float *realTwiddles;    // exp(-2 pi i k / n) for 0 <= k < n / 2, interleaved
+};
+
+namespace {
+
+bool fft_core_init(struct fft_core *core, size_t n)
+{
+    int log2n = __builtin_ctz((unsigned) n);
+    core->n = n;
+    core->odd = (log2n & 1) != 0;
+
+    core->swapCount = 0;
+    for (size_t i = 0; i < n; ++i) {
+        size_t r = 0;
+        for (int b = 0; b < log2n; ++b) {
+            r |= ((i >> b) & 1) << (log2n - 1 - b);
+        }
+        if (i < r) {
+            ++core->swapCount;
+        }
+    }
+    core->swaps = (uint32_t *) malloc((core->swapCount * 2 + 1) * sizeof(uint32_t));
+
+    size_t twiddleCount = 0;
+    for (size_t q = core->odd ? 2 : 1; 4 * q <= n; q *= 4) {
+        twiddleCount += 4 * q;
+    }
+    core->twiddles = (float *) malloc((twiddleCount + 1) * sizeof(float));
+    if (core->swaps == NULL || core->twiddles == NULL) {
+        return false;
+    }
+
+    uint32_t *swap = core->swaps;
+    for (size_t i = 0; i < n; ++i) {
+        size_t r = 0;
+        for (int b = 0; b < log2n; ++b) {
+            r |= ((i >> b) & 1) << (log2n - 1 - b);
+        }
+        if (i < r) {
+            *swap++ = i;
+            *swap++ = r;
+        }
+    }
+
+    float *tw = core->twiddles;
+    for (size_t q = core->odd ? 2 : 1; 4 * q <= n; q *= 4) {
+        for (size_t j = 0; j < q; ++j) {
+            const double phase = -2. * M_PI * j / (4 * q);
+            tw[j] = (float) cos(2. * phase);
+            tw[q + j] = (float) sin(2. * phase);
+            tw[2 * q + j] = (float) cos(phase);
+            tw[3 * q + j] = (float) sin(phase);
+        }
+        tw += 4 * q;
+    }
+    return true;
+}
+
+void fft_core_deinit(struct fft_core *core)
+{
+    free(core->swaps);
+    free(core->twiddles);
+}
+
+#if defined(USE_NEON) || defined(USE_SSE2)
+#define USE_VECTOR
+
+// 4 complex values, with the real and imaginary parts in separate registers.
+#if defined(USE_NEON)
+typedef float32x4_t vfloat;
+static inline vfloat add(vfloat a, vfloat b) { return vaddq_f32(a, b); }
+static inline vfloat sub(vfloat a, vfloat b) { return vsubq_f32(a, b); }
+static inline vfloat mul(vfloat a, vfloat b) { return vmulq_f32(a, b); }
+static inline vfloat neg(vfloat a) { return vnegq_f32(a); }
+static inline vfloat load(const float *p) { return vld1q_f32(p); }
+#else
+typedef __m128 vfloat;
+static inline vfloat add(vfloat a, vfloat b) { return _mm_add_ps(a, b); }
+static inline vfloat sub(vfloat a, vfloat b) { return _mm_sub_ps(a, b); }
+static inline vfloat mul(vfloat a, vfloat b) { return _mm_mul_ps(a, b); }
+static inline vfloat neg(vfloat a) { return _mm_xor_ps(a, _mm_set1_ps(-0.0f)); }
+static inline vfloat load(const float *p) { return _mm_loadu_ps(p); }
+#endif
+
+struct vcomplex {
+    vfloat re;
+    vfloat im;
+};
+
+// Load 4 interleaved complex values.
+static inline vcomplex load_complex(const float *p)
+{
+    vcomplex c;
+#if defined(USE_NEON)
+    float32x4x2_t v = vld2q_f32(p);
+    c.re = v.val[0];
+    c.im = v.val[1];
+#else
+    __m128 a = _mm_loadu_ps(p);
+    __m128 b = _mm_loadu_ps(p + 4);
+    c.re = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+    c.im = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+#endif
+    return c;
+}
+
+static inline void store_complex(float *p, vcomplex c)
+{
+#if defined(USE_NEON)
+    float32x4x2_t v;
+    v.val[0] = c.re;
+    v.val[1] = c.im;
+    vst2q_f32(p, v);
+#else
+    _mm_storeu_ps(p, _mm_unpacklo_ps(c.re, c.im));
+    _mm_storeu_ps(p + 4, _mm_unpackhi_ps(c.re, c.im));
+#endif
+}
+#endif // USE_NEON || USE_SSE2
+
+// Fused pair of radix-2 stages on x0..x3, each a pointer to one complex value q apart.
+template <bool kInverse>
+inline void butterfly4(float *x0, float *x1, float *x2, float *x3,
+        float w1r, float w1i, float w2r, float w2i)
+{
+    if (kInverse) {
+        w1i = -w1i;
+        w2i = -w2i;
+    }
+    const float ur = w1r * x1[0] - w1i * x1[1];
+    const float ui = w1r * x1[1] + w1i * x1[0];
+    const float vr = w1r * x3[0] - w1i * x3[1];
+    const float vi = w1r * x3[1] + w1i * x3[0];
+    const float t0r = x0[0] + ur, t0i = x0[1] + ui;
+    const float t1r = x0[0] - ur, t1i = x0[1] - ui;
+    const float t2r = x2[0] + vr, t2i = x2[1] + vi;
+    const float t3r = x2[0] - vr, t3i = x2[1] - vi;
+    const float y2r = w2r * t2r - w2i * t2i;
+    const float y2i = w2r * t2i + w2i * t2r;
+    // y3 is rotated by -i for the forward transform, and by +i for the inverse
+    float y3r = w2i * t3r + w2r * t3i;
+    float y3i = -(w2r * t3r - w2i * t3i);
+    if (kInverse) {
+        y3r = -y3r;
+        y3i = -y3i;
+    }
+    x0[0] = t0r + y2r;
+    x0[1] = t0i + y2i;
+    x2[0] = t0r - y2r;
+    x2[1] = t0i - y2i;
+    x1[0] = t1r + y3r;
+    x1[1] = t1i + y3i;
+    x3[0] = t1r - y3r;
+    x3[1] = t1i - y3i;
+}
+
+#ifdef USE_VECTOR
+template <bool kInverse>
+inline void butterfly4_vector(float *x0, float *x1, float *x2, float *x3,
+        vfloat w1r, vfloat w1i, vfloat w2r, vfloat w2i)
+{
+    if (kInverse) {
+        w1i = neg(w1i);
+        w2i = neg(w2i);
+    }
+    const vcomplex a = load_complex(x0);
+    const vcomplex b = load_complex(x1);
+    const vcomplex c = load_complex(x2);
+    const vcomplex d = load_complex(x3);
+    const vfloat ur = sub(mul(w1r, b.re), mul(w1i, b.im));
+    const vfloat ui = add(mul(w1r, b.im), mul(w1i, b.re));
+    const vfloat vr = sub(mul(w1r, d.re), mul(w1i, d.im));
+    const vfloat vi = add(mul(w1r, d.im), mul(w1i, d.re));
+    const vcomplex t0 = {add(a.re, ur), add(a.im, ui)};
+    const vcomplex t1 = {sub(a.re, ur), sub(a.im, ui)};
+    const vcomplex t2 = {add(c.re, vr), add(c.im, vi)};
+    const vcomplex t3 = {sub(c.re, vr), sub(c.im, vi)};
+    const vcomplex y2 = {sub(mul(w2r, t2.re), mul(w2i, t2.im)),
+            add(mul(w2r, t2.im), mul(w2i, t2.re))};
+    // t3 * w2, rotated by -i for the forward transform, and by +i for the inverse
+    const vfloat pr = sub(mul(w2r, t3.re), mul(w2i, t3.im));
+    const vfloat pi = add(mul(w2r, t3.im), mul(w2i, t3.re));
+    const vcomplex y3 = kInverse ? vcomplex{neg(pi), pr} : vcomplex{pi, neg(pr)};
+    store_complex(x0, vcomplex{add(t0.re, y2.re), add(t0.im, y2.im)});
+    store_complex(x2, vcomplex{sub(t0.re, y2.re), sub(t0.im, y2.im)});
+    store_complex(x1, vcomplex{add(t1.re, y3.re), add(t1.im, y3.im)});
+    store_complex(x3, vcomplex{sub(t1.re, y3.re), sub(t1.im, y3.im)});
+}
+#endif
+
+template <bool kInverse>
+void fft_core_transform(const struct fft_core *core, float *data)
+{
+    const size_t n = core->n;
+
+    const uint32_t *swap = core->swaps;
+    for (size_t s = 0; s < core->swapCount; ++s, swap += 2) {
+        float *a = data + 2 * swap[0];
+        float *b = data + 2 * swap[1];
+        const float re = a[0], im = a[1];
+        a[0] = b[0];
+        a[1] = b[1];
+        b[0] = re;
+        b[1] = im;
+    }
+
+    size_t q = 1;
+    if (core->odd) {
+        for (float *x = data; x < data + 2 * n; x += 4) {
+            const float re = x[0], im = x[1];
+            x[0] = re + x[2];
+            x[1] = im + x[3];
+            x[2] = re - x[2];
+            x[3] = im - x[3];
+        }
+        q = 2;
+    }
+
+    const float *tw = core->twiddles;
+    for (; 4 * q <= n; tw += 4 * q, q *= 4) {
+        const float *w1r = tw, *w1i = tw + q, *w2r = tw + 2 * q, *w2i = tw + 3 * q;
+        for (size_t base = 0; base < n; base += 4 * q) {
+            float *x0 = data + 2 * base;
+            float *x1 = x0 + 2 * q;
+            float *x2 = x1 + 2 * q;
+            float *x3 = x2 + 2 * q;
+            size_t j = 0;
+#ifdef USE_VECTOR
+            for (; j + 4 <= q; j += 4) {
+                butterfly4_vector<kInverse>(x0 + 2 * j, x1 + 2 * j, x2 + 2 * j, x3 + 2 * j,
+                        load(w1r + j), load(w1i + j), load(w2r + j), load(w2i + j));
+            }
+#endif
+            for (; j < q; ++j) {
+                butterfly4<kInverse>(x0 + 2 * j, x1 + 2 * j, x2 + 2 * j, x3 + 2 * j,
+                        w1r[j], w1i[j], w2r[j], w2i[j]);
+            }
+        }
+    }
+}
+
+} // namespace
+
+struct fft_float_plan *fft_float_plan_create(size_t n)
+{
+    if (n < FFT_FLOAT_MIN_SIZE || n > FFT_FLOAT_MAX_SIZE || (n & (n - 1)) != 0) {
+        return NULL;
+    }
+    struct fft_float_plan *plan = (struct fft_float_plan *) calloc(1, sizeof(*plan));
+    if (plan == NULL) {
+        return NULL;
+    }
+    plan->n = n;
+    plan->realTwiddles = (float *) malloc(n * sizeof(float));
+    if (!fft_core_init(&plan->full, n) || !fft_core_init(&plan->half, n / 2) ||
+            plan->realTwiddles == NULL) {
+        fft_float_plan_destroy(plan);
+        return NULL;
+    }
+    for (size_t k = 0; k < n / 2; ++k) {
+        const double phase = -2. * M_PI * k / n;
+        plan->realTwiddles[2 * k] = (float) cos(phase);
+        plan->realTwiddles[2 * k + 1] = (float) sin(phase);
+    }
+    return plan;
+}
+
+void fft_float_plan_destroy(struct fft_float_plan *plan)
+{
+    if (plan == NULL) {
+        return;
+    }
+    fft_core_deinit(&plan->full);
+    fft_core_deinit(&plan->half);
+    free(plan->realTwiddles);
+    free(plan);
+}
+
+size_t fft_float_plan_size(const struct fft_float_plan *plan)
+{
+    return plan->n;
+}
+
+void fft_float_complex(const struct fft_float_plan *plan, float *data)
+{
+    fft_core_transform<false>(&plan->full, data);
+}
+
+void fft_float_complex_inverse(const struct fft_float_plan *plan, float *data)
+{
+    fft_core_transform<true>(&plan->full, data);
+}
+
+void fft_float_real(const struct fft_float_plan *plan, float *data)
+{
+    const size_t half = plan->n / 2;
+    // the even and odd samples are the real and imaginary parts of a half size transform
+    fft_core_transform<false>(&plan->half, data);
+
+    const float z0r = data[0], z0i = data[1];
+    data[0] = z0r + z0i;
+    data[1] = z0r - z0i;
+    // X[k] = E[k] + w^k O[k], where E and O are the transforms of the even and odd samples,
+    // E[k] = (Z[k] + conj(Z[half - k])) / 2 and O[k] = (Z[k] - conj(Z[half - k])) / 2i.
+    // Bins k and half - k use each other's inputs, so are computed together.
+    for (size_t k = 1; k <= half / 2; ++k) {
+        const size_t m = half - k;
+        float *xk = data + 2 * k;
+        float *xm = data + 2 * m;
+        const float zkr = xk[0], zki = xk[1];
+        const float zmr = xm[0], zmi = xm[1];
+        const float *wk = plan->realTwiddles + 2 * k;
+        const float *wm = plan->realTwiddles + 2 * m;
+        // bin k: E = (Z[k] + conj(Z[m])) / 2, O = (Z[k] - conj(Z[m])) / 2i
+        float er = 0.5f * (zkr + zmr), ei = 0.5f * (zki - zmi);
+        float orr = 0.5f * (zki + zmi), oi = -0.5f * (zkr - zmr);
+        xk[0] = er + wk[0] * orr - wk[1] * oi;
+        xk[1] = ei + wk[0] * oi + wk[1] * orr;
+        if (m != k) {
+            // bin m: same with k and m exchanged
+            er = 0.5f * (zmr + zkr);
+            ei = 0.5f * (zmi - zki);
+            orr = 0.5f * (zmi + zki);
+            oi = -0.5f * (zmr - zkr);
+            xm[0] = er + wm[0] * orr - wm[1] * oi;
+            xm[1] = ei + wm[0] * oi + wm[1] * orr;
+        }
+    }
+}
+
+void fft_float_real_inverse(const struct fft_float_plan *plan, float *data)
+{
+    const size_t half = plan->n / 2;
+
+    // 2 Z[k] = (X[k] + conj(X[half - k])) + i w^-k (X[k] - conj(X[half - k])),
+    // so that the unscaled inverse of size half yields n times the input, as for fft_float_real()
+    const float x0 = data[0], xh = data[1];
+    data[0] = x0 + xh;
+    data[1] = x0 - xh;
+    for (size_t k = 1; k <= half / 2; ++k) {
+        const size_t m = half - k;
+        float *xk = data + 2 * k;
+        float *xm = data + 2 * m;
+        const float xkr = xk[0], xki = xk[1];
+        const float xmr = xm[0], xmi = xm[1];
+        const float *wk = plan->realTwiddles + 2 * k;
+        const float *wm = plan->realTwiddles + 2 * m;
+        // bin k: s = X[k] + conj(X[m]), d = X[k] - conj(X[m]), Z = s + i conj(w^k) d
+        float sr = xkr + xmr, si = xki - xmi;
+        float dr = xkr - xmr, di = xki + xmi;
+        // conj(w) d = (wr dr + wi di) + i (wr di - wi dr), then times i
+        float pr = wk[0] * dr + wk[1] * di, pi = wk[0] * di - wk[1] * dr;
+        xk[0] = sr - pi;
+        xk[1] = si + pr;
+        if (m != k) {
+            sr = xmr + xkr;
+            si = xmi - xki;
+            dr = xmr - xkr;
+            di = xmi + xki;
+            pr = wm[0] * dr + wm[1] * di;
+            pi = wm[0] * di - wm[1] * dr;
+            xm[0] = sr - pi;
+            xm[1] = si + pr;
+        }
+    }
+    fft_core_transform<true>(&plan->half, data);
+}
+
+void fft_float_complex_batch(const struct fft_float_plan *plan, float *data, size_t count,
+        size_t stride, bool inverse)
+{
+    for (size_t f = 0; f < count; ++f, data += stride) {
+        if (inverse) {
+            fft_core_transform<true>(&plan->full, data);
+        } else {
+            fft_core_transform<false>(&plan->full, data);
+        }
+    }
+}
+
+void fft_float_real_batch(const struct fft_float_plan *plan, float *data, size_t count,
+        size_t stride, bool inverse)
+{
+    for (size_t f = 0; f < count; ++f, data += stride) {
+        if (inverse) {
+            fft_float_real_inverse(plan, data);
+        } else {
+            fft_float_real(plan, data);
+        }
+    }
+}
@@ -17,10 +17,18 @@
 //#define LOG_NDEBUG 0
 #define LOG_TAG "audio_utils_fifo"
 
+#include <errno.h>
+#include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
 #include <audio_utils/fifo.h>
 #include <audio_utils/roundup.h>
+#include <audio_utils/trace.h>
 #include <cutils/atomic.h>
 #include <cutils/log.h>
 
@@ -36,6 +44,13 @@ void audio_utils_fifo_init(struct audio_utils_fifo *fifo, size_t frameCount, siz
     fifo->mBuffer = buffer;
     fifo->mFront = 0;
     fifo->mRear = 0;
+    fifo->mReaderWaiting = 0;
+    fifo->mWriterWaiting = 0;
+    fifo->mFrontPtr = &fifo->mFront;
+    fifo->mRearPtr = &fifo->mRear;
+    fifo->mReaderWaitingPtr = &fifo->mReaderWaiting;
+    fifo->mWriterWaitingPtr = &fifo->mWriterWaiting;
+    fifo->mShared = 0;
 }
 
 void audio_utils_fifo_deinit(struct audio_utils_fifo *fifo __unused)
@@ -79,56 +94,677 @@ static inline size_t audio_utils_fifo_diff(struct audio_utils_fifo *fifo, int32_
     return (size_t) diff;
 }
 
-ssize_t audio_utils_fifo_write(struct audio_utils_fifo *fifo, const void *buffer, size_t count)
+// Return true if a pair of indices is consistent, as is always the case unless the indices are
+// in shared memory and the peer process has corrupted them.  Must be checked before using
+// indices read from shared memory, as the checks in audio_utils_fifo_diff() are only assertions.
+static bool audio_utils_fifo_indices_valid(struct audio_utils_fifo *fifo, int32_t rear,
+        int32_t front)
+{
+    uint32_t mask = fifo->mFrameCountP2 - 1;
+    if ((rear & mask) >= fifo->mFrameCount || (front & mask) >= fifo->mFrameCount) {
+        return false;
+    }
+    uint32_t genDiff = ((uint32_t) rear & ~mask) - ((uint32_t) front & ~mask);
+    if (genDiff == 0) {
+        return (rear & mask) >= (front & mask);
+    }
+    return genDiff == fifo->mFrameCountP2 && (rear & mask) <= (front & mask);
+}
+
+#ifdef __linux__
+static inline int audio_utils_fifo_futex(volatile int32_t *addr, int op, int32_t val,
+        const struct timespec *timeout)
+{
+    return syscall(SYS_futex, (int32_t *) addr, op, val, timeout, NULL, 0);
+}
+#endif
+
+// Called after publishing a new value of 'index', to wake up the other side if it is blocked.
+// The barrier orders the index store before the load of 'waiting', and pairs with the barrier
+// in audio_utils_fifo_wait().  There is no system call unless the other side is waiting.
+// A FIFO in shared memory must use the non-private futex operations.
+static inline void audio_utils_fifo_wake(volatile int32_t *waiting, volatile int32_t *index,
+        int shared)
+{
+#ifdef __linux__
+    android_memory_barrier();
+    if (*waiting) {
+        (void) audio_utils_fifo_futex(index, shared ? FUTEX_WAKE : FUTEX_WAKE_PRIVATE, 1, NULL);
+    }
+#else
+    (void) waiting;
+    (void) index;
+    (void) shared;
+#endif
+}
+
+// Block until *index no longer equals 'value', or until 'deadline' (CLOCK_MONOTONIC) has passed.
+// A NULL deadline waits indefinitely.  Return 0 if woken (possibly spuriously),
+// otherwise a negative errno.  The caller must re-check the index after return.
+static int audio_utils_fifo_wait(volatile int32_t *waiting, volatile int32_t *index,
+        int32_t value, const struct timespec *deadline, int shared)
 {
-    int32_t front = android_atomic_acquire_load(&fifo->mFront);
-    int32_t rear = fifo->mRear;
+#ifdef __linux__
+    struct timespec remaining;
+    if (deadline != NULL) {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        remaining.tv_sec = deadline->tv_sec - now.tv_sec;
+        remaining.tv_nsec = deadline->tv_nsec - now.tv_nsec;
+        if (remaining.tv_nsec < 0) {
+            remaining.tv_nsec += 1000000000;
+            remaining.tv_sec--;
+        }
+        if (remaining.tv_sec < 0) {
+            return -ETIMEDOUT;
+        }
+    }
+    android_atomic_release_store(1, waiting);
+    android_memory_barrier();
+    int err = 0;
+    if (android_atomic_acquire_load(index) == value &&
+            audio_utils_fifo_futex(index, shared ? FUTEX_WAIT : FUTEX_WAIT_PRIVATE, value,
+                    deadline != NULL ? &remaining : NULL) < 0) {
+        switch (errno) {
+        case EAGAIN:    // index changed before we could wait
+            break;
+        case ETIMEDOUT:
+        case EINTR:
+            err = -errno;
+            break;
+        default:
+            LOG_ALWAYS_FATAL("unexpected futex wait errno %d", errno);
+            break;
+        }
+    }
+    android_atomic_release_store(0, waiting);
+    return err;
+#else
+    (void) waiting;
+    (void) index;
+    (void) value;
+    (void) deadline;
+    (void) shared;
+    return -ENOSYS;
+#endif
+}
+
+// Convert a relative timeout to an absolute CLOCK_MONOTONIC deadline.
+static void audio_utils_fifo_deadline(const struct timespec *timeout, struct timespec *deadline)
+{
+    clock_gettime(CLOCK_MONOTONIC, deadline);
+    deadline->tv_sec += timeout->tv_sec;
+    deadline->tv_nsec += timeout->tv_nsec;
+    if (deadline->tv_nsec >= 1000000000) {
+        deadline->tv_nsec -= 1000000000;
+        deadline->tv_sec++;
+    }
+}
+
+// Return the difference between two indices: rear - front, like audio_utils_fifo_diff(), except
+// that the difference may exceed mFrameCount if the writer has lapped the reader.
+// Valid as long as the raw index difference is less than 2^31.
+static inline uint32_t audio_utils_fifo_diff_lapped(struct audio_utils_fifo *fifo, int32_t rear,
+        int32_t front)
+{
+    uint32_t diff = (uint32_t) rear - (uint32_t) front;
+    if (fifo->mFudgeFactor) {
+        uint32_t mask = ~(fifo->mFrameCountP2 - 1);
+        uint32_t genDiff = ((uint32_t) rear & mask) - ((uint32_t) front & mask);
+        diff -= (genDiff / fifo->mFrameCountP2) * fifo->mFudgeFactor;
+    }
+    return diff;
+}
+
+// Split the area of 'count' frames starting at masked index 'index' into at most two regions.
+static inline void audio_utils_fifo_split(struct audio_utils_fifo *fifo, int32_t index,
+        size_t count, struct audio_utils_iovec iovec[2])
+{
+    index &= fifo->mFrameCountP2 - 1;
+    size_t part1 = fifo->mFrameCount - index;
+    if (part1 > count) {
+        part1 = count;
+    }
+    iovec[0].mOffset = index;
+    iovec[0].mLength = part1;
+    iovec[1].mOffset = 0;
+    iovec[1].mLength = count - part1;
+}
+
+ssize_t audio_utils_fifo_write_obtain(struct audio_utils_fifo *fifo,
+        struct audio_utils_iovec iovec[2], size_t count)
+{
+    int32_t front = android_atomic_acquire_load(fifo->mFrontPtr);
+    int32_t rear = *fifo->mRearPtr;
+    if (fifo->mShared && !audio_utils_fifo_indices_valid(fifo, rear, front)) {
+        return -EIO;
+    }
     size_t availToWrite = fifo->mFrameCount - audio_utils_fifo_diff(fifo, rear, front);
     if (availToWrite > count) {
         availToWrite = count;
     }
-    rear &= fifo->mFrameCountP2 - 1;
-    size_t part1 = fifo->mFrameCount - rear;
-    if (part1 > availToWrite) {
-        part1 = availToWrite;
-    }
-    if (part1 > 0) {
-        memcpy((char *) fifo->mBuffer + (rear * fifo->mFrameSize), buffer,
-                part1 * fifo->mFrameSize);
-        size_t part2 = availToWrite - part1;
-        if (part2 > 0) {
-            memcpy(fifo->mBuffer, (char *) buffer + (part1 * fifo->mFrameSize),
-                    part2 * fifo->mFrameSize);
+    audio_utils_fifo_split(fifo, rear, availToWrite, iovec);
+    return availToWrite;
+}
+
+void audio_utils_fifo_write_release(struct audio_utils_fifo *fifo, size_t count)
+{
+    if (count > 0) {
+        android_atomic_release_store(audio_utils_fifo_sum(fifo, *fifo->mRearPtr, count),
+                fifo->mRearPtr);
+        audio_utils_fifo_wake(fifo->mReaderWaitingPtr, fifo->mRearPtr, fifo->mShared);
+    }
+}
+
+ssize_t audio_utils_fifo_read_obtain(struct audio_utils_fifo *fifo,
+        struct audio_utils_iovec iovec[2], size_t count)
+{
+    int32_t rear = android_atomic_acquire_load(fifo->mRearPtr);
+    int32_t front = *fifo->mFrontPtr;
+    if (fifo->mShared && !audio_utils_fifo_indices_valid(fifo, rear, front)) {
+        return -EIO;
+    }
+    size_t availToRead = audio_utils_fifo_diff(fifo, rear, front);
+    if (availToRead > count) {
+        availToRead = count;
+    }
+    audio_utils_fifo_split(fifo, front, availToRead, iovec);
+    return availToRead;
+}
+
+void audio_utils_fifo_read_release(struct audio_utils_fifo *fifo, size_t count)
+{
+    if (count > 0) {
+        android_atomic_release_store(audio_utils_fifo_sum(fifo, *fifo->mFrontPtr, count),
+                fifo->mFrontPtr);
+        audio_utils_fifo_wake(fifo->mWriterWaitingPtr, fifo->mFrontPtr, fifo->mShared);
+    }
+}
+
+ssize_t audio_utils_fifo_write_obtain_timed(struct audio_utils_fifo *fifo,
+        struct audio_utils_iovec iovec[2], size_t count, const struct timespec *timeout)
+{
+    struct timespec deadline;
+    if (timeout != NULL) {
+        audio_utils_fifo_deadline(timeout, &deadline);
+    }
+    for (;;) {
+        int32_t front = android_atomic_acquire_load(fifo->mFrontPtr);
+        ssize_t availToWrite = audio_utils_fifo_write_obtain(fifo, iovec, count);
+        if (availToWrite != 0 || count == 0) {
+            return availToWrite;
+        }
+        // FIFO is full, so wait for the reader to advance mFront beyond the value we saw
+        int err = audio_utils_fifo_wait(fifo->mWriterWaitingPtr, fifo->mFrontPtr, front,
+                timeout != NULL ? &deadline : NULL, fifo->mShared);
+        if (err < 0) {
+            return err;
+        }
+    }
+}
+
+ssize_t audio_utils_fifo_read_obtain_timed(struct audio_utils_fifo *fifo,
+        struct audio_utils_iovec iovec[2], size_t count, const struct timespec *timeout)
+{
+    struct timespec deadline;
+    if (timeout != NULL) {
+        audio_utils_fifo_deadline(timeout, &deadline);
+    }
+    for (;;) {
+        int32_t rear = android_atomic_acquire_load(fifo->mRearPtr);
+        ssize_t availToRead = audio_utils_fifo_read_obtain(fifo, iovec, count);
+        if (availToRead != 0 || count == 0) {
+            return availToRead;
+        }
+        // FIFO is empty, so wait for the writer to advance mRear beyond the value we saw
+        int err = audio_utils_fifo_wait(fifo->mReaderWaitingPtr, fifo->mRearPtr, rear,
+                timeout != NULL ? &deadline : NULL, fifo->mShared);
+        if (err < 0) {
+            return err;
         }
-        android_atomic_release_store(audio_utils_fifo_sum(fifo, fifo->mRear, availToWrite),
-                &fifo->mRear);
     }
+}
+
+// Copy 'buffer' into the regions of 'fifoBuffer' previously obtained for write.
+static inline void audio_utils_fifo_copy_in(void *fifoBuffer, size_t frameSize,
+        const struct audio_utils_iovec iovec[2], const void *buffer)
+{
+    memcpy((char *) fifoBuffer + (iovec[0].mOffset * frameSize), buffer,
+            iovec[0].mLength * frameSize);
+    if (iovec[1].mLength > 0) {
+        memcpy((char *) fifoBuffer + (iovec[1].mOffset * frameSize),
+                (char *) buffer + (iovec[0].mLength * frameSize),
+                iovec[1].mLength * frameSize);
+    }
+}
+
+// Copy the regions of 'fifoBuffer' previously obtained for read into 'buffer'.
+static inline void audio_utils_fifo_copy_out(void *fifoBuffer, size_t frameSize,
+        const struct audio_utils_iovec iovec[2], void *buffer)
+{
+    memcpy(buffer, (char *) fifoBuffer + (iovec[0].mOffset * frameSize),
+            iovec[0].mLength * frameSize);
+    if (iovec[1].mLength > 0) {
+        memcpy((char *) buffer + (iovec[0].mLength * frameSize),
+                (char *) fifoBuffer + (iovec[1].mOffset * frameSize),
+                iovec[1].mLength * frameSize);
+    }
+}
+
+ssize_t audio_utils_fifo_write(struct audio_utils_fifo *fifo, const void *buffer, size_t count)
+{
+    AUDIO_UTILS_TRACE_SCOPE("audio_utils_fifo_write");
+    struct audio_utils_iovec iovec[2];
+    ssize_t availToWrite = audio_utils_fifo_write_obtain(fifo, iovec, count);
+    if (availToWrite > 0) {
+        audio_utils_fifo_copy_in(fifo->mBuffer, fifo->mFrameSize, iovec, buffer);
+        audio_utils_fifo_write_release(fifo, availToWrite);
+    }
+    AUDIO_UTILS_TRACE_COUNTER("audio_utils_fifo_write frames", availToWrite);
     return availToWrite;
 }
 
 ssize_t audio_utils_fifo_read(struct audio_utils_fifo *fifo, void *buffer, size_t count)
 {
-    int32_t rear = android_atomic_acquire_load(&fifo->mRear);
-    int32_t front = fifo->mFront;
-    size_t availToRead = audio_utils_fifo_diff(fifo, rear, front);
+    AUDIO_UTILS_TRACE_SCOPE("audio_utils_fifo_read");
+    struct audio_utils_iovec iovec[2];
+    ssize_t availToRead = audio_utils_fifo_read_obtain(fifo, iovec, count);
+    if (availToRead > 0) {
+        audio_utils_fifo_copy_out(fifo->mBuffer, fifo->mFrameSize, iovec, buffer);
+        audio_utils_fifo_read_release(fifo, availToRead);
+    }
+    AUDIO_UTILS_TRACE_COUNTER("audio_utils_fifo_read frames", availToRead);
+    return availToRead;
+}
+
+ssize_t audio_utils_fifo_write_timed(struct audio_utils_fifo *fifo, const void *buffer,
+        size_t count, const struct timespec *timeout)
+{
+    AUDIO_UTILS_TRACE_SCOPE("audio_utils_fifo_write_timed");
+    struct audio_utils_iovec iovec[2];
+    ssize_t availToWrite = audio_utils_fifo_write_obtain_timed(fifo, iovec, count, timeout);
+    if (availToWrite > 0) {
+        audio_utils_fifo_copy_in(fifo->mBuffer, fifo->mFrameSize, iovec, buffer);
+        audio_utils_fifo_write_release(fifo, availToWrite);
+    }
+    AUDIO_UTILS_TRACE_COUNTER("audio_utils_fifo_write_timed frames", availToWrite);
+    return availToWrite;
+}
+
+ssize_t audio_utils_fifo_read_timed(struct audio_utils_fifo *fifo, void *buffer, size_t count,
+        const struct timespec *timeout)
+{
+    AUDIO_UTILS_TRACE_SCOPE("audio_utils_fifo_read_timed");
+    struct audio_utils_iovec iovec[2];
+    ssize_t availToRead = audio_utils_fifo_read_obtain_timed(fifo, iovec, count, timeout);
+    if (availToRead > 0) {
+        audio_utils_fifo_copy_out(fifo->mBuffer, fifo->mFrameSize, iovec, buffer);
+        audio_utils_fifo_read_release(fifo, availToRead);
+    }
+    AUDIO_UTILS_TRACE_COUNTER("audio_utils_fifo_read_timed frames", availToRead);
+    return availToRead;
+}
+
+void audio_utils_fifo_broadcast_init(struct audio_utils_fifo_broadcast *fifo,
+        size_t frameCount, size_t frameSize, void *buffer,
+        struct audio_utils_fifo_reader *readers, size_t readerCount, int overwrite)
+{
+    ALOG_ASSERT(fifo != NULL && readers != NULL && readerCount > 0);
+    audio_utils_fifo_init(&fifo->mFifo, frameCount, frameSize, buffer);
+    fifo->mReaders = readers;
+    fifo->mReaderCount = readerCount;
+    fifo->mOverwrite = overwrite;
+    fifo->mRearReserved = 0;
+    size_t i;
+    for (i = 0; i < readerCount; i++) {
+        readers[i].mFront = 0;
+        readers[i].mActive = 1;
+        readers[i].mOverruns = 0;
+    }
+}
+
+void audio_utils_fifo_broadcast_deinit(struct audio_utils_fifo_broadcast *fifo)
+{
+    audio_utils_fifo_deinit(&fifo->mFifo);
+}
+
+void audio_utils_fifo_broadcast_set_active(struct audio_utils_fifo_broadcast *fifo,
+        size_t reader, int active)
+{
+    ALOG_ASSERT(reader < fifo->mReaderCount);
+    struct audio_utils_fifo_reader *r = &fifo->mReaders[reader];
+    if (active) {
+        // A newly attached reader has nothing to read, so the writer can't overrun it
+        // even if the writer doesn't yet observe mActive.
+        android_atomic_release_store(android_atomic_acquire_load(&fifo->mFifo.mRear), &r->mFront);
+        android_atomic_release_store(1, &r->mActive);
+    } else {
+        android_atomic_release_store(0, &r->mActive);
+    }
+}
+
+ssize_t audio_utils_fifo_broadcast_write_obtain(struct audio_utils_fifo_broadcast *fifo,
+        struct audio_utils_iovec iovec[2], size_t count)
+{
+    struct audio_utils_fifo *base = &fifo->mFifo;
+    int32_t rear = base->mRear;
+    size_t availToWrite;
+    if (fifo->mOverwrite) {
+        availToWrite = base->mFrameCount;
+    } else {
+        // the writer is limited by the slowest active reader
+        size_t maxFilled = 0;
+        size_t i;
+        for (i = 0; i < fifo->mReaderCount; i++) {
+            struct audio_utils_fifo_reader *r = &fifo->mReaders[i];
+            if (android_atomic_acquire_load(&r->mActive)) {
+                size_t filled = audio_utils_fifo_diff(base, rear,
+                        android_atomic_acquire_load(&r->mFront));
+                if (filled > maxFilled) {
+                    maxFilled = filled;
+                }
+            }
+        }
+        availToWrite = base->mFrameCount - maxFilled;
+    }
+    if (availToWrite > count) {
+        availToWrite = count;
+    }
+    if (fifo->mOverwrite && availToWrite > 0) {
+        // Announce the area about to be overwritten before touching it,
+        // so that a reader can detect that its data was overwritten while being read.
+        android_atomic_release_store(audio_utils_fifo_sum(base, rear, availToWrite),
+                &fifo->mRearReserved);
+        android_memory_barrier();
+    }
+    audio_utils_fifo_split(base, rear, availToWrite, iovec);
+    return availToWrite;
+}
+
+void audio_utils_fifo_broadcast_write_release(struct audio_utils_fifo_broadcast *fifo,
+        size_t count)
+{
+    if (count > 0) {
+        android_atomic_release_store(audio_utils_fifo_sum(&fifo->mFifo, fifo->mFifo.mRear, count),
+                &fifo->mFifo.mRear);
+    }
+}
+
+ssize_t audio_utils_fifo_broadcast_write(struct audio_utils_fifo_broadcast *fifo,
+        const void *buffer, size_t count)
+{
+    struct audio_utils_iovec iovec[2];
+    ssize_t availToWrite = audio_utils_fifo_broadcast_write_obtain(fifo, iovec, count);
+    if (availToWrite > 0) {
+        audio_utils_fifo_copy_in(fifo->mFifo.mBuffer, fifo->mFifo.mFrameSize, iovec,
+                buffer);
+        audio_utils_fifo_broadcast_write_release(fifo, availToWrite);
+    }
+    return availToWrite;
+}
+
+// Discard everything unread by an overrun reader, and resynchronize it to the write index.
+static void audio_utils_fifo_broadcast_resync(struct audio_utils_fifo_broadcast *fifo,
+        struct audio_utils_fifo_reader *r)
+{
+    int32_t rear = android_atomic_acquire_load(&fifo->mFifo.mRear);
+    r->mOverruns += audio_utils_fifo_diff_lapped(&fifo->mFifo, rear, r->mFront);
+    android_atomic_release_store(rear, &r->mFront);
+}
+
+ssize_t audio_utils_fifo_broadcast_read_obtain(struct audio_utils_fifo_broadcast *fifo,
+        size_t reader, struct audio_utils_iovec iovec[2], size_t count)
+{
+    ALOG_ASSERT(reader < fifo->mReaderCount);
+    struct audio_utils_fifo *base = &fifo->mFifo;
+    struct audio_utils_fifo_reader *r = &fifo->mReaders[reader];
+    int32_t rear = android_atomic_acquire_load(&base->mRear);
+    int32_t front = r->mFront;
+    size_t availToRead;
+    if (fifo->mOverwrite) {
+        uint32_t filled = audio_utils_fifo_diff_lapped(base, rear, front);
+        if (filled > base->mFrameCount) {
+            audio_utils_fifo_broadcast_resync(fifo, r);
+            return -EOVERFLOW;
+        }
+        availToRead = filled;
+    } else {
+        availToRead = audio_utils_fifo_diff(base, rear, front);
+    }
     if (availToRead > count) {
         availToRead = count;
     }
-    front &= fifo->mFrameCountP2 - 1;
-    size_t part1 = fifo->mFrameCount - front;
-    if (part1 > availToRead) {
-        part1 = availToRead;
-    }
-    if (part1 > 0) {
-        memcpy(buffer, (char *) fifo->mBuffer + (front * fifo->mFrameSize),
-                part1 * fifo->mFrameSize);
-        size_t part2 = availToRead - part1;
-        if (part2 > 0) {
-            memcpy((char *) buffer + (part1 * fifo->mFrameSize), fifo->mBuffer,
-                    part2 * fifo->mFrameSize);
+    audio_utils_fifo_split(base, front, availToRead, iovec);
+    return availToRead;
+}
+
+ssize_t audio_utils_fifo_broadcast_read_release(struct audio_utils_fifo_broadcast *fifo,
+        size_t reader, size_t count)
+{
+    ALOG_ASSERT(reader < fifo->mReaderCount);
+    struct audio_utils_fifo_reader *r = &fifo->mReaders[reader];
+    if (fifo->mOverwrite) {
+        // Order our accesses to the data before the check of the writer's progress.
+        // The data is intact only if no write in progress or completed reaches our front.
+        android_memory_barrier();
+        int32_t reserved = android_atomic_acquire_load(&fifo->mRearReserved);
+        if (audio_utils_fifo_diff_lapped(&fifo->mFifo, reserved, r->mFront) >
+                fifo->mFifo.mFrameCount) {
+            audio_utils_fifo_broadcast_resync(fifo, r);
+            return -EOVERFLOW;
         }
-        android_atomic_release_store(audio_utils_fifo_sum(fifo, fifo->mFront, availToRead),
-                &fifo->mFront);
+    }
+    if (count > 0) {
+        android_atomic_release_store(audio_utils_fifo_sum(&fifo->mFifo, r->mFront, count),
+                &r->mFront);
+    }
+    return count;
+}
+
+ssize_t audio_utils_fifo_broadcast_read(struct audio_utils_fifo_broadcast *fifo,
+        size_t reader, void *buffer, size_t count)
+{
+    struct audio_utils_iovec iovec[2];
+    ssize_t availToRead = audio_utils_fifo_broadcast_read_obtain(fifo, reader, iovec, count);
+    if (availToRead > 0) {
+        audio_utils_fifo_copy_out(fifo->mFifo.mBuffer, fifo->mFifo.mFrameSize, iovec,
+                buffer);
+        availToRead = audio_utils_fifo_broadcast_read_release(fifo, reader, availToRead);
+    }
+    return availToRead;
+}
+
+uint32_t audio_utils_fifo_broadcast_get_overruns(struct audio_utils_fifo_broadcast *fifo,
+        size_t reader)
+{
+    ALOG_ASSERT(reader < fifo->mReaderCount);
+    return fifo->mReaders[reader].mOverruns;
+}
+
+// Upper limit on frameCount for a FIFO in shared memory, so that the index arithmetic
+// can't overflow even if the control block was formatted by a different process.
+#define AUDIO_UTILS_FIFO_SHARED_MAX_FRAME_COUNT 0x40000000
+
+size_t audio_utils_fifo_shared_size(size_t frameCount, size_t frameSize)
+{
+    size_t dataOffset = sizeof(struct audio_utils_fifo_shared);
+    if (frameCount == 0 || frameCount > AUDIO_UTILS_FIFO_SHARED_MAX_FRAME_COUNT ||
+            frameSize == 0 || frameSize > UINT32_MAX ||
+            frameCount > (UINT32_MAX - dataOffset) / frameSize) {
+        return 0;
+    }
+    return dataOffset + frameCount * frameSize;
+}
+
+int audio_utils_fifo_shared_init(void *shared, size_t size, size_t frameCount,
+        size_t frameSize)
+{
+    size_t needed = audio_utils_fifo_shared_size(frameCount, frameSize);
+    if (shared == NULL || needed == 0 || size < needed) {
+        return -EINVAL;
+    }
+    struct audio_utils_fifo_shared *control = (struct audio_utils_fifo_shared *) shared;
+    memset(control, 0, sizeof(*control));
+    control->mFrameCount = frameCount;
+    control->mFrameSize = frameSize;
+    control->mDataOffset = sizeof(struct audio_utils_fifo_shared);
+    // The magic is published last, so a peer which sees it also sees the other fields
+    android_atomic_release_store(AUDIO_UTILS_FIFO_SHARED_MAGIC,
+            (volatile int32_t *) &control->mMagic);
+    return 0;
+}
+
+int audio_utils_fifo_shared_attach(struct audio_utils_fifo *fifo, void *shared, size_t size)
+{
+    ALOG_ASSERT(fifo != NULL);
+    if (shared == NULL || size < sizeof(struct audio_utils_fifo_shared)) {
+        return -EINVAL;
+    }
+    struct audio_utils_fifo_shared *control = (struct audio_utils_fifo_shared *) shared;
+    if ((uint32_t) android_atomic_acquire_load((volatile int32_t *) &control->mMagic) !=
+            AUDIO_UTILS_FIFO_SHARED_MAGIC) {
+        return -EINVAL;
+    }
+    // Snapshot the geometry, so that later changes by the peer can't affect this process
+    uint32_t frameCount = control->mFrameCount;
+    uint32_t frameSize = control->mFrameSize;
+    uint32_t dataOffset = control->mDataOffset;
+    size_t needed = audio_utils_fifo_shared_size(frameCount, frameSize);
+    if (needed == 0 || dataOffset < sizeof(struct audio_utils_fifo_shared) ||
+            dataOffset > size || (size - dataOffset) / frameSize < frameCount) {
+        return -EINVAL;
+    }
+    audio_utils_fifo_init(fifo, frameCount, frameSize, (char *) shared + dataOffset);
+    fifo->mFrontPtr = &control->mFront;
+    fifo->mRearPtr = &control->mRear;
+    fifo->mReaderWaitingPtr = &control->mReaderWaiting;
+    fifo->mWriterWaitingPtr = &control->mWriterWaiting;
+    fifo->mShared = 1;
+    if (!audio_utils_fifo_indices_valid(fifo, *fifo->mRearPtr, *fifo->mFrontPtr)) {
+        return -EINVAL;
+    }
+    return 0;
+}
+
+// The legacy Android atomics are 32-bit only, so the 64-bit indices use the compiler builtins.
+
+void audio_utils_fifo64_init(struct audio_utils_fifo64 *fifo, size_t frameCount,
+        size_t frameSize, void *buffer)
+{
+    ALOG_ASSERT(fifo != NULL && frameCount > 0 && frameSize > 0 && buffer != NULL);
+    fifo->mFrameCount = frameCount;
+    fifo->mFrameSize = frameSize;
+    fifo->mBuffer = buffer;
+    fifo->mRear = 0;
+    fifo->mFrontCached = 0;
+    fifo->mRearOffset = 0;
+    fifo->mFront = 0;
+    fifo->mRearCached = 0;
+    fifo->mFrontOffset = 0;
+}
+
+void audio_utils_fifo64_deinit(struct audio_utils_fifo64 *fifo __unused)
+{
+}
+
+// Split the area of 'count' frames starting at frame offset 'offset' into at most two regions.
+static inline void audio_utils_fifo64_split(struct audio_utils_fifo64 *fifo, size_t offset,
+        size_t count, struct audio_utils_iovec iovec[2])
+{
+    size_t part1 = fifo->mFrameCount - offset;
+    if (part1 > count) {
+        part1 = count;
+    }
+    iovec[0].mOffset = offset;
+    iovec[0].mLength = part1;
+    iovec[1].mOffset = 0;
+    iovec[1].mLength = count - part1;
+}
+
+// Return the frame offset which is 'count' frames after 'offset', without a division.
+static inline size_t audio_utils_fifo64_advance(struct audio_utils_fifo64 *fifo, size_t offset,
+        size_t count)
+{
+    offset += count;
+    if (offset >= fifo->mFrameCount) {
+        offset -= fifo->mFrameCount;
+    }
+    return offset;
+}
+
+ssize_t audio_utils_fifo64_write_obtain(struct audio_utils_fifo64 *fifo,
+        struct audio_utils_iovec iovec[2], size_t count)
+{
+    uint64_t rear = fifo->mRear;
+    size_t availToWrite = fifo->mFrameCount - (size_t) (rear - fifo->mFrontCached);
+    if (availToWrite < count) {
+        fifo->mFrontCached = __atomic_load_n(&fifo->mFront, __ATOMIC_ACQUIRE);
+        availToWrite = fifo->mFrameCount - (size_t) (rear - fifo->mFrontCached);
+        if (availToWrite > count) {
+            availToWrite = count;
+        }
+    } else {
+        availToWrite = count;
+    }
+    audio_utils_fifo64_split(fifo, fifo->mRearOffset, availToWrite, iovec);
+    return availToWrite;
+}
+
+void audio_utils_fifo64_write_release(struct audio_utils_fifo64 *fifo, size_t count)
+{
+    if (count > 0) {
+        ALOG_ASSERT(fifo->mRear + count - fifo->mFrontCached <= fifo->mFrameCount);
+        fifo->mRearOffset = audio_utils_fifo64_advance(fifo, fifo->mRearOffset, count);
+        __atomic_store_n(&fifo->mRear, fifo->mRear + count, __ATOMIC_RELEASE);
+    }
+}
+
+ssize_t audio_utils_fifo64_read_obtain(struct audio_utils_fifo64 *fifo,
+        struct audio_utils_iovec iovec[2], size_t count)
+{
+    uint64_t front = fifo->mFront;
+    size_t availToRead = (size_t) (fifo->mRearCached - front);
+    if (availToRead < count) {
+        fifo->mRearCached = __atomic_load_n(&fifo->mRear, __ATOMIC_ACQUIRE);
+        availToRead = (size_t) (fifo->mRearCached - front);
+        if (availToRead > count) {
+            availToRead = count;
+        }
+    } else {
+        availToRead = count;
+    }
+    audio_utils_fifo64_split(fifo, fifo->mFrontOffset, availToRead, iovec);
+    return availToRead;
+}
+
+void audio_utils_fifo64_read_release(struct audio_utils_fifo64 *fifo, size_t count)
+{
+    if (count > 0) {
+        ALOG_ASSERT(fifo->mFront + count <= fifo->mRearCached);
+        fifo->mFrontOffset = audio_utils_fifo64_advance(fifo, fifo->mFrontOffset, count);
+        __atomic_store_n(&fifo->mFront, fifo->mFront + count, __ATOMIC_RELEASE);
+    }
+}
+
+ssize_t audio_utils_fifo64_write(struct audio_utils_fifo64 *fifo, const void *buffer,
+        size_t count)
+{
+    struct audio_utils_iovec iovec[2];
+    ssize_t availToWrite = audio_utils_fifo64_write_obtain(fifo, iovec, count);
+    if (availToWrite > 0) {
+        audio_utils_fifo_copy_in(fifo->mBuffer, fifo->mFrameSize, iovec, buffer);
+        audio_utils_fifo64_write_release(fifo, availToWrite);
+    }
+    return availToWrite;
+}
+
+ssize_t audio_utils_fifo64_read(struct audio_utils_fifo64 *fifo, void *buffer, size_t count)
+{
+    struct audio_utils_iovec iovec[2];
+    ssize_t availToRead = audio_utils_fifo64_read_obtain(fifo, iovec, count);
+    if (availToRead > 0) {
+        audio_utils_fifo_copy_out(fifo->mBuffer, fifo->mFrameSize, iovec, buffer);
+        audio_utils_fifo64_read_release(fifo, availToRead);
     }
     return availToRead;
 }
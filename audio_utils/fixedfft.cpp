@@ -26,6 +26,7 @@
 
 #include <stdio.h>
 #include <stdint.h>
+#include <stdlib.h>
 #ifdef __arm__
 #include <machine/cpu-features.h>
 #endif
@@ -164,3 +165,144 @@ void fixed_fft_real(int n, int32_t *v)
         v[n - i] = (x + y) ^ 0xFFFF;
     }
 }
+
+/* Plan for fixed_fft_real() of one size.  The bit-reversal permutation, and the twiddle factors of
+ * every stage in the order they are used, are computed once so that each transform only reads them
+ * sequentially.  The arithmetic is the same as fixed_fft_real(), so results are bit exact.
+ */
+struct fixed_fft_plan {
+    int n;
+    int swap_count;         // number of pairs in swaps
+    uint16_t *swaps;        // index pairs exchanged by the bit-reversal permutation
+    int32_t *twiddles;      // for stages p = 2, 4, ..., n / 2, the twiddles for r = 1 .. p - 1
+    int32_t *real_twiddles; // twiddles of the final real pass, for 0 <= i < n / 2
+};
+
+struct fixed_fft_plan *fixed_fft_plan_create(int n)
+{
+    if (n < 2 || n > MAX_FFT_SIZE / 2 || (n & (n - 1)) != 0) {
+        return NULL;
+    }
+    struct fixed_fft_plan *plan = (struct fixed_fft_plan *) calloc(1, sizeof(*plan));
+    if (plan == NULL) {
+        return NULL;
+    }
+    plan->n = n;
+
+    int i, p, r;
+    for (r = 0, i = 1; i < n; ++i) {
+        for (p = n; !(p & r); p >>= 1, r ^= p);
+        if (i < r) {
+            ++plan->swap_count;
+        }
+    }
+    plan->swaps = (uint16_t *) malloc((plan->swap_count * 2 + 1) * sizeof(uint16_t));
+    plan->twiddles = (int32_t *) malloc(n * sizeof(int32_t));
+    plan->real_twiddles = (int32_t *) malloc((n / 2) * sizeof(int32_t));
+    if (plan->swaps == NULL || plan->twiddles == NULL || plan->real_twiddles == NULL) {
+        fixed_fft_plan_destroy(plan);
+        return NULL;
+    }
+
+    uint16_t *swap = plan->swaps;
+    for (r = 0, i = 1; i < n; ++i) {
+        for (p = n; !(p & r); p >>= 1, r ^= p);
+        if (i < r) {
+            *swap++ = i;
+            *swap++ = r;
+        }
+    }
+
+    // same derivation as in fixed_fft()
+    int scale = LOG_FFT_SIZE;
+    int32_t *tw = plan->twiddles;
+    for (p = 1; p < n; p <<= 1) {
+        --scale;
+        for (r = 1; r < p; ++r) {
+            int32_t w = MAX_FFT_SIZE / 4 - (r << scale);
+            i = w >> 31;
+            *tw++ = ((int32_t) twiddle[(w ^ i) - i]) ^ (i << 16);
+        }
+    }
+
+    // same derivation as in fixed_fft_real()
+    scale = LOG_FFT_SIZE;
+    for (i = 1; i <= n; i <<= 1, --scale);
+    for (i = 0; i < n / 2; ++i) {
+        plan->real_twiddles[i] = (int32_t) twiddle[i << scale];
+    }
+    return plan;
+}
+
+void fixed_fft_plan_destroy(struct fixed_fft_plan *plan)
+{
+    if (plan == NULL) {
+        return;
+    }
+    free(plan->swaps);
+    free(plan->twiddles);
+    free(plan->real_twiddles);
+    free(plan);
+}
+
+void fixed_fft_real_batch(const struct fixed_fft_plan *plan, int32_t *v, size_t count,
+        size_t stride)
+{
+    const int n = plan->n;
+    const int m = n >> 1;
+    int32_t *frame;
+    size_t f;
+    int i, p, r;
+
+    for (f = 0, frame = v; f < count; ++f, frame += stride) {
+        const uint16_t *swap = plan->swaps;
+        for (i = 0; i < plan->swap_count; ++i, swap += 2) {
+            int32_t t = frame[swap[0]];
+            frame[swap[0]] = frame[swap[1]];
+            frame[swap[1]] = t;
+        }
+    }
+
+    // stage by stage across all frames, so that each twiddle is loaded once per batch
+    const int32_t *tw = plan->twiddles;
+    for (p = 1; p < n; p <<= 1) {
+        for (f = 0, frame = v; f < count; ++f, frame += stride) {
+            for (i = 0; i < n; i += p << 1) {
+                int32_t x = half(frame[i]);
+                int32_t y = half(frame[i + p]);
+                frame[i] = x + y;
+                frame[i + p] = x - y;
+            }
+        }
+        for (r = 1; r < p; ++r) {
+            const int32_t w = *tw++;
+            for (f = 0, frame = v; f < count; ++f, frame += stride) {
+                for (i = r; i < n; i += p << 1) {
+                    int32_t x = half(frame[i]);
+                    int32_t y = mult(w, frame[i + p]);
+                    frame[i] = x - y;
+                    frame[i + p] = x + y;
+                }
+            }
+        }
+    }
+
+    for (f = 0, frame = v; f < count; ++f, frame += stride) {
+        frame[0] = mult(~frame[0], 0x80008000);
+        frame[m] = half(frame[m]);
+        for (i = 1; i < n >> 1; ++i) {
+            int32_t x = half(frame[i]);
+            int32_t z = half(frame[n - i]);
+            int32_t y = z - (x ^ 0xFFFF);
+            x = half(x + (z ^ 0xFFFF));
+            y = mult(y, plan->real_twiddles[i]);
+            frame[i] = x - y;
+            frame[n - i] = (x + y) ^ 0xFFFF;
+        }
+    }
+}
+
+void fixed_fft_real_plan(const struct fixed_fft_plan *plan, int32_t *v)
+{
+    fixed_fft_real_batch(plan, v, 1, 0);
+}
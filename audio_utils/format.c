@@ -17,137 +17,164 @@
 /* #define LOG_NDEBUG 0 */
 #define LOG_TAG "audio_utils_format"
 
+#include <string.h>
 #include <cutils/log.h>
 #include <audio_utils/primitives.h>
 #include <audio_utils/format.h>
+#include <audio_utils/trace.h>
 
-void memcpy_by_audio_format(void *dst, audio_format_t dst_format,
-        const void *src, audio_format_t src_format, size_t count)
-{
-    /* default cases for error falls through to fatal log below. */
-    if (dst_format == src_format) {
-        switch (dst_format) {
-        case AUDIO_FORMAT_PCM_16_BIT:
-        case AUDIO_FORMAT_PCM_FLOAT:
-        case AUDIO_FORMAT_PCM_8_BIT:
-        case AUDIO_FORMAT_PCM_24_BIT_PACKED:
-        case AUDIO_FORMAT_PCM_32_BIT:
-        case AUDIO_FORMAT_PCM_8_24_BIT:
-            memcpy(dst, src, count * audio_bytes_per_sample(dst_format));
-            return;
-        default:
-            break;
-        }
+/* Adapters from the typed conversion routines in primitives.h to memcpy_by_audio_format_t.
+ * The name is the conversion routine name without the memcpy_to_ prefix.
+ */
+#define CONVERTER(name, dst_type, src_type) \
+    static void convert_##name(void *dst, const void *src, size_t count) \
+    { \
+        memcpy_to_##name((dst_type *) dst, (const src_type *) src, count); \
     }
-    switch (dst_format) {
+
+CONVERTER(i16_from_float, int16_t, float)
+CONVERTER(i16_from_u8, int16_t, uint8_t)
+CONVERTER(i16_from_p24, int16_t, uint8_t)
+CONVERTER(i16_from_i32, int16_t, int32_t)
+CONVERTER(i16_from_q8_23, int16_t, int32_t)
+CONVERTER(float_from_i16, float, int16_t)
+CONVERTER(float_from_u8, float, uint8_t)
+CONVERTER(float_from_p24, float, uint8_t)
+CONVERTER(float_from_i32, float, int32_t)
+CONVERTER(float_from_q8_23, float, int32_t)
+CONVERTER(u8_from_i16, uint8_t, int16_t)
+CONVERTER(u8_from_float, uint8_t, float)
+CONVERTER(p24_from_i16, uint8_t, int16_t)
+CONVERTER(p24_from_float, uint8_t, float)
+CONVERTER(p24_from_i32, uint8_t, int32_t)
+CONVERTER(p24_from_q8_23, uint8_t, int32_t)
+CONVERTER(i32_from_i16, int32_t, int16_t)
+CONVERTER(i32_from_float, int32_t, float)
+CONVERTER(i32_from_p24, int32_t, uint8_t)
+CONVERTER(q8_23_from_i16, int32_t, int16_t)
+CONVERTER(q8_23_from_float_with_clamp, int32_t, float)
+CONVERTER(q8_23_from_p24, int32_t, uint8_t)
+
+#undef CONVERTER
+
+/* Straight copies, for identical formats */
+static void copy_8(void *dst, const void *src, size_t count)
+{
+    memcpy(dst, src, count);
+}
+
+static void copy_16(void *dst, const void *src, size_t count)
+{
+    memcpy(dst, src, count * sizeof(int16_t));
+}
+
+static void copy_24(void *dst, const void *src, size_t count)
+{
+    memcpy(dst, src, count * 3);
+}
+
+static void copy_32(void *dst, const void *src, size_t count)
+{
+    memcpy(dst, src, count * sizeof(int32_t));
+}
+
+/* Row and column indices of the formats in the converter table below */
+enum {
+    FORMAT_INDEX_I16,
+    FORMAT_INDEX_FLOAT,
+    FORMAT_INDEX_U8,
+    FORMAT_INDEX_P24,
+    FORMAT_INDEX_I32,
+    FORMAT_INDEX_Q8_23,
+    FORMAT_INDEX_COUNT,
+};
+
+static int format_index(audio_format_t format)
+{
+    switch (format) {
     case AUDIO_FORMAT_PCM_16_BIT:
-        switch (src_format) {
-        case AUDIO_FORMAT_PCM_FLOAT:
-            memcpy_to_i16_from_float((int16_t*)dst, (float*)src, count);
-            return;
-        case AUDIO_FORMAT_PCM_8_BIT:
-            memcpy_to_i16_from_u8((int16_t*)dst, (uint8_t*)src, count);
-            return;
-        case AUDIO_FORMAT_PCM_24_BIT_PACKED:
-            memcpy_to_i16_from_p24((int16_t*)dst, (uint8_t*)src, count);
-            return;
-        case AUDIO_FORMAT_PCM_32_BIT:
-            memcpy_to_i16_from_i32((int16_t*)dst, (int32_t*)src, count);
-            return;
-        case AUDIO_FORMAT_PCM_8_24_BIT:
-            memcpy_to_i16_from_q8_23((int16_t*)dst, (int32_t*)src, count);
-            return;
-        default:
-            break;
-        }
-        break;
+        return FORMAT_INDEX_I16;
     case AUDIO_FORMAT_PCM_FLOAT:
-        switch (src_format) {
-        case AUDIO_FORMAT_PCM_16_BIT:
-            memcpy_to_float_from_i16((float*)dst, (int16_t*)src, count);
-            return;
-        case AUDIO_FORMAT_PCM_8_BIT:
-            memcpy_to_float_from_u8((float*)dst, (uint8_t*)src, count);
-            return;
-        case AUDIO_FORMAT_PCM_24_BIT_PACKED:
-            memcpy_to_float_from_p24((float*)dst, (uint8_t*)src, count);
-            return;
-        case AUDIO_FORMAT_PCM_32_BIT:
-            memcpy_to_float_from_i32((float*)dst, (int32_t*)src, count);
-            return;
-        case AUDIO_FORMAT_PCM_8_24_BIT:
-            memcpy_to_float_from_q8_23((float*)dst, (int32_t*)src, count);
-            return;
-        default:
-            break;
-        }
-        break;
+        return FORMAT_INDEX_FLOAT;
     case AUDIO_FORMAT_PCM_8_BIT:
-        switch (src_format) {
-        case AUDIO_FORMAT_PCM_16_BIT:
-            memcpy_to_u8_from_i16((uint8_t*)dst, (int16_t*)src, count);
-            return;
-        case AUDIO_FORMAT_PCM_FLOAT:
-            memcpy_to_u8_from_float((uint8_t*)dst, (float*)src, count);
-            return;
-        default:
-            break;
-        }
-        break;
+        return FORMAT_INDEX_U8;
     case AUDIO_FORMAT_PCM_24_BIT_PACKED:
-        switch (src_format) {
-        case AUDIO_FORMAT_PCM_16_BIT:
-            memcpy_to_p24_from_i16((uint8_t*)dst, (int16_t*)src, count);
-            return;
-        case AUDIO_FORMAT_PCM_FLOAT:
-            memcpy_to_p24_from_float((uint8_t*)dst, (float*)src, count);
-            return;
-        case AUDIO_FORMAT_PCM_32_BIT:
-            memcpy_to_p24_from_i32((uint8_t*)dst, (int32_t*)src, count);
-            return;
-        case AUDIO_FORMAT_PCM_8_24_BIT:
-            memcpy_to_p24_from_q8_23((uint8_t*)dst, (int32_t*)src, count);
-            return;
-        default:
-            break;
-        }
-        break;
+        return FORMAT_INDEX_P24;
     case AUDIO_FORMAT_PCM_32_BIT:
-        switch (src_format) {
-        case AUDIO_FORMAT_PCM_16_BIT:
-            memcpy_to_i32_from_i16((int32_t*)dst, (int16_t*)src, count);
-            return;
-        case AUDIO_FORMAT_PCM_FLOAT:
-            memcpy_to_i32_from_float((int32_t*)dst, (float*)src, count);
-            return;
-        case AUDIO_FORMAT_PCM_24_BIT_PACKED:
-            memcpy_to_i32_from_p24((int32_t*)dst, (uint8_t *)src, count);
-            return;
-        default:
-            break;
-        }
-        break;
+        return FORMAT_INDEX_I32;
     case AUDIO_FORMAT_PCM_8_24_BIT:
-        switch (src_format) {
-        case AUDIO_FORMAT_PCM_16_BIT:
-            memcpy_to_q8_23_from_i16((int32_t*)dst, (int16_t*)src, count);
-            return;
-        case AUDIO_FORMAT_PCM_FLOAT:
-            memcpy_to_q8_23_from_float_with_clamp((int32_t*)dst, (float*)src, count);
-            return;
-        case AUDIO_FORMAT_PCM_24_BIT_PACKED: {
-            memcpy_to_q8_23_from_p24((int32_t *)dst, (uint8_t *)src, count);
-            return;
-        }
-        default:
-            break;
-        }
-        break;
+        return FORMAT_INDEX_Q8_23;
     default:
-        break;
+        return -1;
+    }
+}
+
+/* Indexed by [dst][src].  NULL entries are conversions which are not supported. */
+static const memcpy_by_audio_format_t converters[FORMAT_INDEX_COUNT][FORMAT_INDEX_COUNT] = {
+    [FORMAT_INDEX_I16] = {
+        [FORMAT_INDEX_I16] = copy_16,
+        [FORMAT_INDEX_FLOAT] = convert_i16_from_float,
+        [FORMAT_INDEX_U8] = convert_i16_from_u8,
+        [FORMAT_INDEX_P24] = convert_i16_from_p24,
+        [FORMAT_INDEX_I32] = convert_i16_from_i32,
+        [FORMAT_INDEX_Q8_23] = convert_i16_from_q8_23,
+    },
+    [FORMAT_INDEX_FLOAT] = {
+        [FORMAT_INDEX_I16] = convert_float_from_i16,
+        [FORMAT_INDEX_FLOAT] = copy_32,
+        [FORMAT_INDEX_U8] = convert_float_from_u8,
+        [FORMAT_INDEX_P24] = convert_float_from_p24,
+        [FORMAT_INDEX_I32] = convert_float_from_i32,
+        [FORMAT_INDEX_Q8_23] = convert_float_from_q8_23,
+    },
+    [FORMAT_INDEX_U8] = {
+        [FORMAT_INDEX_I16] = convert_u8_from_i16,
+        [FORMAT_INDEX_FLOAT] = convert_u8_from_float,
+        [FORMAT_INDEX_U8] = copy_8,
+    },
+    [FORMAT_INDEX_P24] = {
+        [FORMAT_INDEX_I16] = convert_p24_from_i16,
+        [FORMAT_INDEX_FLOAT] = convert_p24_from_float,
+        [FORMAT_INDEX_P24] = copy_24,
+        [FORMAT_INDEX_I32] = convert_p24_from_i32,
+        [FORMAT_INDEX_Q8_23] = convert_p24_from_q8_23,
+    },
+    [FORMAT_INDEX_I32] = {
+        [FORMAT_INDEX_I16] = convert_i32_from_i16,
+        [FORMAT_INDEX_FLOAT] = convert_i32_from_float,
+        [FORMAT_INDEX_P24] = convert_i32_from_p24,
+        [FORMAT_INDEX_I32] = copy_32,
+    },
+    [FORMAT_INDEX_Q8_23] = {
+        [FORMAT_INDEX_I16] = convert_q8_23_from_i16,
+        [FORMAT_INDEX_FLOAT] = convert_q8_23_from_float_with_clamp,
+        [FORMAT_INDEX_P24] = convert_q8_23_from_p24,
+        [FORMAT_INDEX_Q8_23] = copy_32,
+    },
+};
+
+memcpy_by_audio_format_t memcpy_by_audio_format_get_converter(audio_format_t dst_format,
+        audio_format_t src_format)
+{
+    int dst_index = format_index(dst_format);
+    int src_index = format_index(src_format);
+    if (dst_index < 0 || src_index < 0) {
+        return NULL;
+    }
+    return converters[dst_index][src_index];
+}
+
+void memcpy_by_audio_format(void *dst, audio_format_t dst_format,
+        const void *src, audio_format_t src_format, size_t count)
+{
+    AUDIO_UTILS_TRACE_SCOPE("memcpy_by_audio_format");
+    memcpy_by_audio_format_t converter =
+            memcpy_by_audio_format_get_converter(dst_format, src_format);
+    if (converter == NULL) {
+        LOG_ALWAYS_FATAL("invalid src format %#x for dst format %#x",
+                src_format, dst_format);
     }
-    LOG_ALWAYS_FATAL("invalid src format %#x for dst format %#x",
-            src_format, dst_format);
+    converter(dst, src, count);
 }
 
 size_t memcpy_by_index_array_initialization_from_channel_mask(int8_t *idxary, size_t arysize,
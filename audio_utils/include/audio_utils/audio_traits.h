@@ -0,0 +1,176 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_AUDIO_UTILS_AUDIO_TRAITS_H
+#define ANDROID_AUDIO_UTILS_AUDIO_TRAITS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <system/audio.h>
+
+// Compile-time equivalents of the format and channel mask helpers of <system/audio.h>,
+// for templated kernels and for constant expressions such as array sizes.
+// Each constexpr function gives the same result as the audio.h helper of the same name
+// without the audio_ prefix; audio_traits_tests checks all of them against audio.h.
+
+namespace android {
+namespace audio_utils {
+
+namespace detail {
+
+constexpr bool main_format_is_one_of(uint32_t) {
+    return false;
+}
+
+template <typename... Formats>
+constexpr bool main_format_is_one_of(uint32_t main, audio_format_t first, Formats... rest) {
+    return main == (first & AUDIO_FORMAT_MAIN_MASK) || main_format_is_one_of(main, rest...);
+}
+
+} // namespace detail
+
+// See audio_bytes_per_sample_linear_pcm()
+constexpr size_t bytes_per_sample_linear_pcm(audio_format_t format) {
+    return format == AUDIO_FORMAT_PCM_16_BIT ? sizeof(int16_t)
+            : format == AUDIO_FORMAT_PCM_8_BIT ? sizeof(uint8_t)
+            : format == AUDIO_FORMAT_PCM_32_BIT ? sizeof(int32_t)
+            : format == AUDIO_FORMAT_PCM_8_24_BIT ? sizeof(int32_t)
+            : format == AUDIO_FORMAT_PCM_FLOAT ? sizeof(float)
+            : format == AUDIO_FORMAT_PCM_24_BIT_PACKED ? sizeof(uint8_t) * 3
+            : 0;
+}
+
+// See audio_bytes_per_sample()
+constexpr size_t bytes_per_sample(audio_format_t format) {
+    return bytes_per_sample_linear_pcm(format) != 0 ? bytes_per_sample_linear_pcm(format)
+            : format == AUDIO_FORMAT_PCM_24_BIT_OFFLOAD ? sizeof(int32_t)
+            : format == AUDIO_FORMAT_IEC61937 || format == AUDIO_FORMAT_PCM_16_BIT_OFFLOAD ?
+                    sizeof(int16_t)
+            : 0;
+}
+
+// See audio_is_linear_pcm()
+constexpr bool is_linear_pcm(audio_format_t format) {
+    return (format & AUDIO_FORMAT_MAIN_MASK) == AUDIO_FORMAT_PCM;
+}
+
+// See audio_is_valid_format()
+constexpr bool is_valid_format(audio_format_t format) {
+    return is_linear_pcm(format) ? bytes_per_sample_linear_pcm(format) != 0
+            : (format & AUDIO_FORMAT_MAIN_MASK) == AUDIO_FORMAT_PCM_OFFLOAD ?
+                    format == AUDIO_FORMAT_PCM_16_BIT_OFFLOAD ||
+                    format == AUDIO_FORMAT_PCM_24_BIT_OFFLOAD
+            : detail::main_format_is_one_of(format & AUDIO_FORMAT_MAIN_MASK,
+                    AUDIO_FORMAT_MP3, AUDIO_FORMAT_AMR_NB, AUDIO_FORMAT_AMR_WB,
+                    AUDIO_FORMAT_AAC, AUDIO_FORMAT_AAC_ADTS, AUDIO_FORMAT_HE_AAC_V1,
+                    AUDIO_FORMAT_HE_AAC_V2, AUDIO_FORMAT_VORBIS, AUDIO_FORMAT_OPUS,
+                    AUDIO_FORMAT_AC3, AUDIO_FORMAT_E_AC3, AUDIO_FORMAT_DTS, AUDIO_FORMAT_DTS_HD,
+                    AUDIO_FORMAT_IEC61937, AUDIO_FORMAT_QCELP, AUDIO_FORMAT_EVRC,
+                    AUDIO_FORMAT_EVRCB, AUDIO_FORMAT_EVRCWB, AUDIO_FORMAT_AAC_ADIF,
+                    AUDIO_FORMAT_AMR_WB_PLUS, AUDIO_FORMAT_MP2, AUDIO_FORMAT_EVRCNW,
+                    AUDIO_FORMAT_FLAC, AUDIO_FORMAT_ALAC, AUDIO_FORMAT_APE, AUDIO_FORMAT_WMA,
+                    AUDIO_FORMAT_WMA_PRO, AUDIO_FORMAT_DSD, AUDIO_FORMAT_DOLBY_TRUEHD);
+}
+
+// See audio_channel_count_from_out_mask()
+constexpr uint32_t channel_count_from_out_mask(audio_channel_mask_t mask) {
+    return (mask >> AUDIO_CHANNEL_COUNT_MAX) == AUDIO_CHANNEL_REPRESENTATION_POSITION ?
+                    __builtin_popcount(mask & AUDIO_CHANNEL_OUT_ALL)
+            : (mask >> AUDIO_CHANNEL_COUNT_MAX) == AUDIO_CHANNEL_REPRESENTATION_INDEX ?
+                    __builtin_popcount(mask & ((1u << AUDIO_CHANNEL_COUNT_MAX) - 1))
+            : 0;
+}
+
+// See audio_channel_out_mask_from_count()
+constexpr audio_channel_mask_t channel_out_mask_from_count(uint32_t channel_count) {
+    return channel_count == 0 ? AUDIO_CHANNEL_NONE
+            : channel_count == 1 ? AUDIO_CHANNEL_OUT_MONO
+            : channel_count == 2 ? AUDIO_CHANNEL_OUT_STEREO
+            : channel_count == 3 ? AUDIO_CHANNEL_OUT_STEREO | AUDIO_CHANNEL_OUT_FRONT_CENTER
+            : channel_count == 4 ? AUDIO_CHANNEL_OUT_QUAD
+            : channel_count == 5 ? AUDIO_CHANNEL_OUT_QUAD | AUDIO_CHANNEL_OUT_FRONT_CENTER
+            : channel_count == 6 ? AUDIO_CHANNEL_OUT_5POINT1
+            : channel_count == 7 ? AUDIO_CHANNEL_OUT_5POINT1 | AUDIO_CHANNEL_OUT_BACK_CENTER
+            : channel_count == 8 ? AUDIO_CHANNEL_OUT_7POINT1
+            : AUDIO_CHANNEL_INVALID;
+}
+
+// Bytes per frame of a format with proportional frames, or 0 if the format or mask is invalid.
+constexpr size_t bytes_per_frame(audio_format_t format, audio_channel_mask_t mask) {
+    return bytes_per_sample(format) * channel_count_from_out_mask(mask);
+}
+
+// Storage of one sample of 24-bit packed PCM
+struct packed24 {
+    uint8_t c[3];
+} __attribute__((__packed__));
+
+// Properties of a format, and for linear PCM the type of one sample.
+// The sample type is only defined for linear PCM formats, so using it with another format
+// is a compile error.
+template <audio_format_t Format>
+struct format_traits {
+    static constexpr audio_format_t format = Format;
+    static constexpr bool valid = is_valid_format(Format);
+    static constexpr bool linear_pcm = is_linear_pcm(Format);
+    static constexpr size_t sample_size = bytes_per_sample(Format);
+};
+
+template <audio_format_t Format> constexpr audio_format_t format_traits<Format>::format;
+template <audio_format_t Format> constexpr bool format_traits<Format>::valid;
+template <audio_format_t Format> constexpr bool format_traits<Format>::linear_pcm;
+template <audio_format_t Format> constexpr size_t format_traits<Format>::sample_size;
+
+template <audio_format_t Format> struct sample_type_of;
+template <> struct sample_type_of<AUDIO_FORMAT_PCM_16_BIT> { typedef int16_t type; };
+template <> struct sample_type_of<AUDIO_FORMAT_PCM_8_BIT> { typedef uint8_t type; };
+template <> struct sample_type_of<AUDIO_FORMAT_PCM_32_BIT> { typedef int32_t type; };
+template <> struct sample_type_of<AUDIO_FORMAT_PCM_8_24_BIT> { typedef int32_t type; };
+template <> struct sample_type_of<AUDIO_FORMAT_PCM_FLOAT> { typedef float type; };
+template <> struct sample_type_of<AUDIO_FORMAT_PCM_24_BIT_PACKED> { typedef packed24 type; };
+
+// Properties of an output channel mask; an invalid mask is a compile error.
+template <audio_channel_mask_t Mask>
+struct channel_mask_traits {
+    static constexpr audio_channel_mask_t mask = Mask;
+    static constexpr uint32_t channel_count = channel_count_from_out_mask(Mask);
+    static_assert(channel_count > 0, "not a valid output channel mask");
+};
+
+template <audio_channel_mask_t Mask>
+constexpr audio_channel_mask_t channel_mask_traits<Mask>::mask;
+template <audio_channel_mask_t Mask>
+constexpr uint32_t channel_mask_traits<Mask>::channel_count;
+
+// Properties of frames of a linear PCM format and an output channel mask.
+template <audio_format_t Format, audio_channel_mask_t Mask>
+struct frame_traits {
+    typedef typename sample_type_of<Format>::type sample_type;
+    static constexpr uint32_t channel_count = channel_mask_traits<Mask>::channel_count;
+    static constexpr size_t frame_size = format_traits<Format>::sample_size * channel_count;
+    static_assert(sizeof(sample_type) == format_traits<Format>::sample_size,
+            "sample type does not match the format");
+};
+
+template <audio_format_t Format, audio_channel_mask_t Mask>
+constexpr uint32_t frame_traits<Format, Mask>::channel_count;
+template <audio_format_t Format, audio_channel_mask_t Mask>
+constexpr size_t frame_traits<Format, Mask>::frame_size;
+
+} // namespace audio_utils
+} // namespace android
+
+#endif // ANDROID_AUDIO_UTILS_AUDIO_TRAITS_H
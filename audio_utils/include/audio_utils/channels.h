@@ -17,6 +17,10 @@
 #ifndef ANDROID_AUDIO_CHANNELS_H
 #define ANDROID_AUDIO_CHANNELS_H
 
+#include <stdint.h>
+#include <sys/cdefs.h>
+#include <system/audio.h>
+
 /** \cond */
 __BEGIN_DECLS
 /** \endcond */
@@ -45,6 +49,117 @@ size_t adjust_channels(const void* in_buff, size_t in_buff_chans,
                        void* out_buff, size_t out_buff_chans,
                        unsigned sample_size_in_bytes, size_t num_in_bytes);
 
+/**
+ * Expands or contracts float sample data from one interleaved channel format to another.
+ * Same as adjust_channels() with sample_size_in_bytes of 4, except that contraction to mono
+ * averages the first two channels as float instead of as 32-bit integer.
+ *
+ *   \param in_buff              points to the buffer of samples
+ *   \param in_buff_chans        Specifies the number of channels in the input buffer.
+ *   \param out_buff             points to the buffer to receive converted samples.
+ *   \param out_buff_chans       Specifies the number of channels in the output buffer.
+ *   \param num_in_bytes         size of input buffer in BYTES
+ *
+ * \return
+ *   the number of BYTES of output data or 0 if an error occurs.
+ *
+ * \note
+ *   The out and sums buffers must either be completely separate (non-overlapping), or
+ *   they must both start at the same address. Partially overlapping buffers are not supported.
+ */
+size_t adjust_channels_float(const float* in_buff, size_t in_buff_chans,
+                             float* out_buff, size_t out_buff_chans,
+                             size_t num_in_bytes);
+
+/** Maximum number of source or destination channels of a struct channel_mix. */
+#define CHANNEL_MIX_MAX_CHANNELS 8
+
+/**
+ * Mixing matrix from one interleaved channel layout to another, for channel_mix_float() and
+ * channel_mix_i16().  Initialize with channel_mix_init() or channel_mix_init_from_coefs().
+ * Only dst_channels, src_channels and coefs are meant to be read by the caller;
+ * the remaining fields hold the coefficients rearranged for the vector kernels.
+ */
+struct channel_mix {
+    uint32_t dst_channels;
+    uint32_t src_channels;
+    /* gain from each source channel to each destination channel, indexed [dst][src] */
+    float coefs[CHANNEL_MIX_MAX_CHANNELS][CHANNEL_MIX_MAX_CHANNELS];
+    uint32_t group_frames;      /* frames per group of vectors */
+    uint32_t group_vectors;     /* vectors of 4 destination samples per group, 1 or 2 */
+    uint32_t taps[2];           /* number of source channels used by each vector */
+    uint8_t tap_src[2][CHANNEL_MIX_MAX_CHANNELS];
+    float columns[2][CHANNEL_MIX_MAX_CHANNELS][4];
+};
+
+/**
+ * Initialize a mixing matrix from a source to a destination channel mask.
+ *
+ * Channels present in both masks are copied with unity gain.  Each source channel missing
+ * from the destination is folded into its nearest destination channels:
+ * - front left and right into front center, front center and LFE into front left and right
+ *   at -3 dB each, front left and right of center into front left and right;
+ * - side channels into back channels, or else into the front channels at -3 dB, and
+ *   back channels likewise into side or front channels;
+ * - back center into the back, side or front pair at -3 dB each;
+ * - top channels into the matching bottom channel at -3 dB.
+ * A mono destination gets the average of the stereo mix, and a mono source is copied to
+ * both front left and right, consistent with downmix_to_mono_*() and upmix_to_stereo_*().
+ * If either mask uses the index representation, channels are copied by index.
+ *
+ * The coefficients are not normalized, so the sum of several channels may exceed full scale.
+ *
+ *  \param mix       Caller-allocated matrix to initialize
+ *  \param dst_mask  Destination output channel mask
+ *  \param src_mask  Source output channel mask
+ *
+ * \return 0 on success, or -EINVAL if a mask is not a valid output channel mask or has more
+ *  than CHANNEL_MIX_MAX_CHANNELS channels.
+ */
+int channel_mix_init(struct channel_mix *mix,
+        audio_channel_mask_t dst_mask, audio_channel_mask_t src_mask);
+
+/**
+ * Initialize a mixing matrix from caller supplied coefficients, for custom layouts.
+ *
+ *  \param mix           Caller-allocated matrix to initialize
+ *  \param dst_channels  Number of destination channels per frame, 1 to CHANNEL_MIX_MAX_CHANNELS
+ *  \param src_channels  Number of source channels per frame, 1 to CHANNEL_MIX_MAX_CHANNELS
+ *  \param coefs         dst_channels rows of src_channels gains, so the gain from source
+ *                       channel s to destination channel d is coefs[d * src_channels + s]
+ *
+ * \return 0 on success, or -EINVAL if a channel count is out of range.
+ */
+int channel_mix_init_from_coefs(struct channel_mix *mix,
+        uint32_t dst_channels, uint32_t src_channels, const float *coefs);
+
+/**
+ * Mix float frames through a matrix.  The output is not clamped.
+ *
+ *  \param mix     Matrix initialized by channel_mix_init() or channel_mix_init_from_coefs()
+ *  \param dst     Destination buffer of mix->dst_channels samples per frame
+ *  \param src     Source buffer of mix->src_channels samples per frame
+ *  \param frames  Number of frames to mix
+ *
+ * The destination and source buffers must be completely separate (non-overlapping).
+ */
+void channel_mix_float(const struct channel_mix *mix, float *dst, const float *src,
+        size_t frames);
+
+/**
+ * Mix 16-bit frames through a matrix.  The mix is computed in float and the output is
+ * rounded and clamped as by memcpy_to_i16_from_float().
+ *
+ *  \param mix     Matrix initialized by channel_mix_init() or channel_mix_init_from_coefs()
+ *  \param dst     Destination buffer of mix->dst_channels samples per frame
+ *  \param src     Source buffer of mix->src_channels samples per frame
+ *  \param frames  Number of frames to mix
+ *
+ * The destination and source buffers must be completely separate (non-overlapping).
+ */
+void channel_mix_i16(const struct channel_mix *mix, int16_t *dst, const int16_t *src,
+        size_t frames);
+
 /** \cond */
 __END_DECLS
 /** \endcond */
@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_AUDIO_CONVOLVER_H
+#define ANDROID_AUDIO_CONVOLVER_H
+
+#include <stddef.h>
+#include <sys/cdefs.h>
+
+/** \cond */
+__BEGIN_DECLS
+/** \endcond */
+
+/**
+ * Partitioned fast convolution of interleaved float audio with long FIR filters,
+ * e.g. for room correction or speaker equalization effects.
+ *
+ * The impulse response is split into partitions which are convolved in the frequency domain
+ * by overlap-save, using the float FFT of fft.h.  With uniform partitioning, all partitions
+ * have block_frames frames.  With non-uniform partitioning, the partition size doubles,
+ * two partitions at each size, up to max_block_frames for the rest of the tail, which reduces
+ * the cost of long filters while keeping the latency of the smallest block.
+ * The output is delayed by exactly block_frames frames relative to the input.
+ */
+struct convolver;
+
+/** Parameters of convolver_create(). */
+struct convolver_config {
+    size_t channel_count;       // interleaved channels in the processed audio, >= 1
+    size_t block_frames;        // latency and size of the first partitions, a power of 2 >= 2
+    size_t max_block_frames;    // size of the largest partitions, a power of 2 between
+                                // block_frames and FFT_FLOAT_MAX_SIZE / 2.
+                                // Equal to block_frames for uniform partitioning.
+};
+
+/**
+ * Create a convolver.  All memory is allocated here, so convolver_process() can be called from
+ * a real-time thread.
+ *
+ *  \param config           Channel count and partitioning.
+ *  \param impulse          Impulse response, interleaved if impulse_channels > 1.
+ *  \param impulse_frames   Length of the impulse response in frames, > 0.
+ *  \param impulse_channels 1 to apply the same impulse response to all channels,
+ *                          or config->channel_count for one impulse response per channel.
+ *  \param convolver        Returned convolver, or NULL on error.
+ *
+ * \return 0 on success, -EINVAL if a parameter is invalid, or -ENOMEM if allocation failed.
+ */
+int convolver_create(const struct convolver_config *config, const float *impulse,
+        size_t impulse_frames, size_t impulse_channels, struct convolver **convolver);
+
+/** Release a convolver returned by convolver_create(); NULL is ignored. */
+void convolver_destroy(struct convolver *convolver);
+
+/** Clear the input history and pending output, as if no frames had been processed. */
+void convolver_reset(struct convolver *convolver);
+
+/**
+ * Filter interleaved frames.  Any frame count may be given; the partitions are processed as
+ * each block of input is completed.
+ *
+ *  \param convolver The convolver.
+ *  \param in        Input frames of channel_count floats.
+ *  \param out       Output frames of channel_count floats, may be the same as in.
+ *  \param frames    Number of frames.
+ */
+void convolver_process(struct convolver *convolver, const float *in, float *out, size_t frames);
+
+/** \cond */
+__END_DECLS
+/** \endcond */
+
+#endif  // ANDROID_AUDIO_CONVOLVER_H
@@ -47,11 +47,51 @@ struct echo_reference_buffer {
  *      - frame_count is updated with the actual number of frames returned
  */
 
+/** How read() keeps the reference aligned with the delay computed from the time stamps. */
+enum echo_reference_delay_mode {
+    /**
+     * Default: after a few consecutive reads deviating in the same direction,
+     * the buffer is realigned at once by dropping frames or inserting silence.
+     */
+    ECHO_REFERENCE_DELAY_REALIGN = 0,
+    /**
+     * Small deviations are smoothed and cancelled gradually by adjusting the resampling ratio,
+     * so that the reference stays continuous.  Only large jumps are realigned as above.
+     * This works best with precise time stamps for write(), e.g. with delay_ns and time_stamp
+     * derived from the presentation position reported by proxy_get_presentation_position().
+     * Requires different read and write sampling rates.
+     */
+    ECHO_REFERENCE_DELAY_TRACKING = 1,
+};
+
 struct echo_reference_itfe {
     int (*read)(struct echo_reference_itfe *echo_reference, struct echo_reference_buffer *buffer);
     int (*write)(struct echo_reference_itfe *echo_reference, struct echo_reference_buffer *buffer);
+    /**
+     * Select the delay compensation mode, from the thread which calls read().
+     *
+     * \return 0 on success, -EINVAL if mode is unknown,
+     *  -ENOSYS if ECHO_REFERENCE_DELAY_TRACKING is requested and the sampling rates are equal.
+     */
+    int (*set_delay_mode)(struct echo_reference_itfe *echo_reference,
+                          enum echo_reference_delay_mode mode);
 };
 
+/**
+ * Create an echo reference which converts frames given to write() to the format read().
+ *
+ *  \param rdFormat        Sample format of read(), AUDIO_FORMAT_PCM_16_BIT or
+ *                         AUDIO_FORMAT_PCM_FLOAT.  Samples are never converted between formats,
+ *                         so wrFormat must be the same.
+ *  \param rdChannelCount  Channel count of read(), 1 to FCC_8.
+ *  \param rdSamplingRate  Sampling rate of read() in Hz.
+ *  \param wrFormat        Sample format of write(), same as rdFormat.
+ *  \param wrChannelCount  Channel count of write(), 1 to FCC_8.  If it differs from
+ *                         rdChannelCount, the channels are converted as by adjust_channels().
+ *  \param wrSamplingRate  Sampling rate of write() in Hz.
+ *
+ * \return 0 on success, -EINVAL if a parameter is invalid, or -ENOMEM if allocation failed.
+ */
 int create_echo_reference(audio_format_t rdFormat,
                           uint32_t rdChannelCount,
                           uint32_t rdSamplingRate,
@@ -60,6 +100,27 @@ int create_echo_reference(audio_format_t rdFormat,
                           uint32_t wrSamplingRate,
                           struct echo_reference_itfe **);
 
+/**
+ * Same as create_echo_reference(), except that all buffers, including the resampler's,
+ * are allocated here, so that read() and write() never allocate memory and can be
+ * called from real-time threads.
+ *
+ *  \param maxReadFrames   Largest frame_count that will be passed to read(), > 0.
+ *  \param maxWriteFrames  Largest frame_count that will be passed to write(), > 0.
+ *
+ * \return 0 on success, -EINVAL if a parameter is invalid, or -ENOMEM if allocation failed.
+ *  read() or write() with a larger frame_count than declared here returns -EINVAL.
+ */
+int create_echo_reference_preallocated(audio_format_t rdFormat,
+                                       uint32_t rdChannelCount,
+                                       uint32_t rdSamplingRate,
+                                       audio_format_t wrFormat,
+                                       uint32_t wrChannelCount,
+                                       uint32_t wrSamplingRate,
+                                       size_t maxReadFrames,
+                                       size_t maxWriteFrames,
+                                       struct echo_reference_itfe **);
+
 void release_echo_reference(struct echo_reference_itfe *echo_reference);
 
 __END_DECLS
@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_AUDIO_FFT_H
+#define ANDROID_AUDIO_FFT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/cdefs.h>
+
+/** \cond */
+__BEGIN_DECLS
+/** \endcond */
+
+/** Smallest and largest supported transform sizes */
+#define FFT_FLOAT_MIN_SIZE 4
+#define FFT_FLOAT_MAX_SIZE 65536
+
+/**
+ * Precomputed twiddle factors and permutation for float FFTs of one size.
+ * A plan is read-only once created, so it can be shared by several threads.
+ */
+struct fft_float_plan;
+
+/**
+ * Create a plan for complex and real FFTs of size n.
+ * This allocates memory and computes the tables, so it should be done once per size,
+ * outside of any real-time thread.
+ *
+ *  \param n    Transform size, a power of 2 between FFT_FLOAT_MIN_SIZE and FFT_FLOAT_MAX_SIZE.
+ *
+ * \return the plan, or NULL if n is invalid or memory allocation failed.
+ */
+struct fft_float_plan *fft_float_plan_create(size_t n);
+
+/** Release a plan returned by fft_float_plan_create(); NULL is ignored. */
+void fft_float_plan_destroy(struct fft_float_plan *plan);
+
+/** Return the transform size n of a plan. */
+size_t fft_float_plan_size(const struct fft_float_plan *plan);
+
+/**
+ * In-place forward complex FFT, X[k] = sum of x[t] * exp(-2 pi i k t / n).
+ * The result is not scaled.
+ *
+ *  \param plan Plan for size n.
+ *  \param data n complex values as interleaved real and imaginary parts, i.e. 2 * n floats.
+ */
+void fft_float_complex(const struct fft_float_plan *plan, float *data);
+
+/**
+ * In-place inverse complex FFT, x[t] = sum of X[k] * exp(2 pi i k t / n).
+ * The result is not scaled: a forward then inverse transform multiplies the input by n.
+ * Same parameters as fft_float_complex().
+ */
+void fft_float_complex_inverse(const struct fft_float_plan *plan, float *data);
+
+/**
+ * In-place forward FFT of n real values, computed with a complex FFT of size n / 2.
+ * The spectrum is returned packed in the same n floats:
+ * data[0] is the real X[0], data[1] is the real X[n / 2],
+ * and data[2 * k], data[2 * k + 1] are the real and imaginary parts of X[k] for 0 < k < n / 2.
+ * The remaining bins are the complex conjugates X[n - k] = conj(X[k]).
+ * The result is not scaled.
+ *
+ *  \param plan Plan for size n.
+ *  \param data n real values on input, the packed spectrum on output.
+ */
+void fft_float_real(const struct fft_float_plan *plan, float *data);
+
+/**
+ * In-place inverse of fft_float_real(), from the packed spectrum to n real values.
+ * The result is not scaled: a forward then inverse transform multiplies the input by n.
+ */
+void fft_float_real_inverse(const struct fft_float_plan *plan, float *data);
+
+/**
+ * Transform count frames of the same size in one call, e.g. the overlapping blocks of a
+ * spectrogram or the channels of a multichannel buffer.
+ *
+ *  \param plan    Plan for size n.
+ *  \param data    First frame, of 2 * n floats as for fft_float_complex().
+ *  \param count   Number of frames.
+ *  \param stride  Distance between the starts of consecutive frames in floats, >= 2 * n.
+ *  \param inverse Whether to apply fft_float_complex_inverse() instead of fft_float_complex().
+ */
+void fft_float_complex_batch(const struct fft_float_plan *plan, float *data, size_t count,
+        size_t stride, bool inverse);
+
+/**
+ * Same as fft_float_complex_batch() for fft_float_real() and fft_float_real_inverse(),
+ * with frames of n floats and stride >= n.
+ */
+void fft_float_real_batch(const struct fft_float_plan *plan, float *data, size_t count,
+        size_t stride, bool inverse);
+
+/** \cond */
+__END_DECLS
+/** \endcond */
+
+#endif  // ANDROID_AUDIO_FFT_H
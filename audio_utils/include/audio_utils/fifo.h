@@ -17,7 +17,9 @@
 #ifndef ANDROID_AUDIO_FIFO_H
 #define ANDROID_AUDIO_FIFO_H
 
+#include <stdint.h>
 #include <stdlib.h>
+#include <time.h>
 
 // FIXME use atomic_int_least32_t and new atomic operations instead of legacy Android ones
 // #include <stdatomic.h>
@@ -26,8 +28,10 @@
 extern "C" {
 #endif
 
-// Single writer, single reader non-blocking FIFO.
-// Writer and reader must be in same process.
+// Single writer, single reader FIFO.
+// The basic API is non-blocking; the _timed variants optionally block with a timeout.
+// Writer and reader must be in same process, unless the FIFO is attached to shared memory
+// with audio_utils_fifo_shared_attach().
 
 // No user-serviceable parts within.
 struct audio_utils_fifo {
@@ -41,6 +45,24 @@ struct audio_utils_fifo {
 
     volatile int32_t mFront; // frame index of first frame slot available to read, or read index
     volatile int32_t mRear;  // frame index of next frame slot available to write, or write index
+
+    volatile int32_t mReaderWaiting; // non-zero if reader may be blocked in a futex wait on mRear
+    volatile int32_t mWriterWaiting; // non-zero if writer may be blocked in a futex wait on mFront
+
+    // These are const after initialization, and point either to the four fields above,
+    // or to the corresponding fields of a struct audio_utils_fifo_shared.
+    volatile int32_t *mFrontPtr;
+    volatile int32_t *mRearPtr;
+    volatile int32_t *mReaderWaitingPtr;
+    volatile int32_t *mWriterWaitingPtr;
+    int        mShared;       // non-zero if indices and buffer are shared between processes
+};
+
+// Describes one contiguous region of the FIFO buffer, as returned by the obtain functions.
+// Both fields are in units of frames, not bytes.
+struct audio_utils_iovec {
+    size_t     mOffset;     // frame offset of the region relative to start of buffer
+    size_t     mLength;     // number of frames in the region, or 0 if region is not used
 };
 
 /**
@@ -74,7 +96,8 @@ void audio_utils_fifo_deinit(struct audio_utils_fifo *fifo);
  *
  * The actual transfer count may be zero if the FIFO is full,
  * or partial if the FIFO was almost full.
- * A negative return value indicates an error.  Currently there are no errors defined.
+ * A negative return value indicates an error:
+ *  -EIO        the FIFO is in shared memory, and the peer has corrupted the indices.
  */
 ssize_t audio_utils_fifo_write(struct audio_utils_fifo *fifo, const void *buffer, size_t count);
 
@@ -88,10 +111,391 @@ ssize_t audio_utils_fifo_write(struct audio_utils_fifo *fifo, const void *buffer
  *
  * The actual transfer count may be zero if the FIFO is empty,
  * or partial if the FIFO was almost empty.
- * A negative return value indicates an error.  Currently there are no errors defined.
+ * A negative return value indicates an error:
+ *  -EIO        the FIFO is in shared memory, and the peer has corrupted the indices.
  */
 ssize_t audio_utils_fifo_read(struct audio_utils_fifo *fifo, void *buffer, size_t count);
 
+/**
+ * Obtain direct access to the FIFO buffer for writing, without copying.
+ * The writable area is returned in up to two contiguous regions, because it may wrap around
+ * the end of the buffer.  The caller fills the regions in place, starting at
+ * (char *) fifo->mBuffer + iovec[i].mOffset * fifo->mFrameSize, and then calls
+ * audio_utils_fifo_write_release() to make the frames visible to the reader.
+ *
+ *  \param fifo        Pointer to the FIFO object.
+ *  \param iovec       Array of two regions, updated with the available areas.
+ *                     iovec[1].mLength is non-zero only if iovec[0].mLength is non-zero.
+ *  \param count       Desired number of frames to write.
+ *
+ * \return actual number of frames available <= count,
+ *  which is the sum of iovec[0].mLength and iovec[1].mLength.
+ *
+ * The actual count may be zero if the FIFO is full, or partial if the FIFO was almost full.
+ * A negative return value indicates an error:
+ *  -EIO        the FIFO is in shared memory, and the peer has corrupted the indices.
+ * Each obtain must be followed by exactly one release, before the next obtain or write.
+ */
+ssize_t audio_utils_fifo_write_obtain(struct audio_utils_fifo *fifo,
+        struct audio_utils_iovec iovec[2], size_t count);
+
+/**
+ * Release frames previously obtained by audio_utils_fifo_write_obtain(),
+ * making them available to the reader.
+ *
+ *  \param fifo        Pointer to the FIFO object.
+ *  \param count       Number of frames actually written, <= return value of the obtain.
+ */
+void audio_utils_fifo_write_release(struct audio_utils_fifo *fifo, size_t count);
+
+/**
+ * Obtain direct access to the FIFO buffer for reading, without copying.
+ * The readable area is returned in up to two contiguous regions, as for
+ * audio_utils_fifo_write_obtain().  After consuming the frames in place,
+ * the caller calls audio_utils_fifo_read_release() to return the space to the writer.
+ *
+ *  \param fifo        Pointer to the FIFO object.
+ *  \param iovec       Array of two regions, updated with the available areas.
+ *                     iovec[1].mLength is non-zero only if iovec[0].mLength is non-zero.
+ *  \param count       Desired number of frames to read.
+ *
+ * \return actual number of frames available <= count,
+ *  which is the sum of iovec[0].mLength and iovec[1].mLength.
+ *
+ * The actual count may be zero if the FIFO is empty, or partial if the FIFO was almost empty.
+ * A negative return value indicates an error:
+ *  -EIO        the FIFO is in shared memory, and the peer has corrupted the indices.
+ * Each obtain must be followed by exactly one release, before the next obtain or read.
+ */
+ssize_t audio_utils_fifo_read_obtain(struct audio_utils_fifo *fifo,
+        struct audio_utils_iovec iovec[2], size_t count);
+
+/**
+ * Release frames previously obtained by audio_utils_fifo_read_obtain(),
+ * making the space available to the writer.
+ *
+ *  \param fifo        Pointer to the FIFO object.
+ *  \param count       Number of frames actually read, <= return value of the obtain.
+ */
+void audio_utils_fifo_read_release(struct audio_utils_fifo *fifo, size_t count);
+
+/**
+ * Write to FIFO, blocking if the FIFO is full.
+ * If at least one frame can be written, this behaves exactly like audio_utils_fifo_write()
+ * and does not block or make any system calls.  Otherwise it waits until the reader
+ * releases space, or until the timeout expires.
+ *
+ *  \param fifo        Pointer to the FIFO object.
+ *  \param buffer      Pointer to source buffer containing 'count' frames of data.
+ *  \param count       Desired number of frames to write.
+ *  \param timeout     Maximum relative time to wait, or NULL to wait indefinitely.
+ *                     A zero timeout does not block.
+ *
+ * \return actual number of frames written <= count, or a negative error code:
+ *  -ETIMEDOUT  the timeout expired before any frames could be written,
+ *  -EINTR      the wait was interrupted by a signal,
+ *  -ENOSYS     blocking is not supported on this platform and the FIFO is full.
+ */
+ssize_t audio_utils_fifo_write_timed(struct audio_utils_fifo *fifo, const void *buffer,
+        size_t count, const struct timespec *timeout);
+
+/**
+ * Read from FIFO, blocking if the FIFO is empty.
+ * If at least one frame can be read, this behaves exactly like audio_utils_fifo_read()
+ * and does not block or make any system calls.  Otherwise it waits until the writer
+ * releases frames, or until the timeout expires.
+ *
+ *  \param fifo        Pointer to the FIFO object.
+ *  \param buffer      Pointer to destination buffer to be filled with up to 'count' frames of data.
+ *  \param count       Desired number of frames to read.
+ *  \param timeout     Maximum relative time to wait, or NULL to wait indefinitely.
+ *                     A zero timeout does not block.
+ *
+ * \return actual number of frames read <= count, or a negative error code as for
+ *  audio_utils_fifo_write_timed().
+ */
+ssize_t audio_utils_fifo_read_timed(struct audio_utils_fifo *fifo, void *buffer, size_t count,
+        const struct timespec *timeout);
+
+/**
+ * Blocking variant of audio_utils_fifo_write_obtain(), with the same
+ * timeout and error semantics as audio_utils_fifo_write_timed().
+ */
+ssize_t audio_utils_fifo_write_obtain_timed(struct audio_utils_fifo *fifo,
+        struct audio_utils_iovec iovec[2], size_t count, const struct timespec *timeout);
+
+/**
+ * Blocking variant of audio_utils_fifo_read_obtain(), with the same
+ * timeout and error semantics as audio_utils_fifo_read_timed().
+ */
+ssize_t audio_utils_fifo_read_obtain_timed(struct audio_utils_fifo *fifo,
+        struct audio_utils_iovec iovec[2], size_t count, const struct timespec *timeout);
+
+// Single writer, multiple reader (broadcast) FIFO.
+// Each frame written is delivered to every active reader, without an extra copy per reader.
+// Each reader has its own read index.  By default the writer is limited by the slowest active
+// reader.  In overwrite mode the writer never waits, and a reader which falls more than
+// mFrameCount frames behind loses those frames and is resynchronized to the write index.
+// Writer and readers must be in same process, and each reader must be used by only one thread.
+
+// Per-reader state of a broadcast FIFO.  No user-serviceable parts within.
+struct audio_utils_fifo_reader {
+    volatile int32_t mFront;    // frame index of next frame slot for this reader to read
+    volatile int32_t mActive;   // non-zero if this reader is attached, and so limits the writer
+    uint32_t         mOverruns; // total frames lost due to overwrite, modulo 2^32
+};
+
+// No user-serviceable parts within.
+struct audio_utils_fifo_broadcast {
+    struct audio_utils_fifo mFifo;      // geometry, buffer and write index; mFront is unused
+    struct audio_utils_fifo_reader *mReaders;   // caller-allocated array of mReaderCount readers
+    size_t     mReaderCount;            // number of readers > 0
+    int        mOverwrite;              // non-zero if writer may overwrite unread frames
+    volatile int32_t mRearReserved;     // in overwrite mode, the end of the write in progress
+};
+
+/**
+ * Initialize a broadcast FIFO object.  All readers are initially active.
+ *
+ *  \param fifo        Pointer to the broadcast FIFO object.
+ *  \param frameCount  Max number of significant frames to be stored in the FIFO > 0.
+ *  \param frameSize   Size of each frame in bytes.
+ *  \param buffer      Pointer to a caller-allocated buffer of frameCount frames.
+ *  \param readers     Pointer to a caller-allocated array of readerCount reader objects.
+ *  \param readerCount Number of readers > 0.
+ *  \param overwrite   Zero if the writer is limited by the slowest active reader,
+ *                     non-zero if the writer may overwrite frames not yet read.
+ */
+void audio_utils_fifo_broadcast_init(struct audio_utils_fifo_broadcast *fifo,
+        size_t frameCount, size_t frameSize, void *buffer,
+        struct audio_utils_fifo_reader *readers, size_t readerCount, int overwrite);
+
+/**
+ * De-initialize a broadcast FIFO object.
+ *
+ *  \param fifo        Pointer to the broadcast FIFO object.
+ */
+void audio_utils_fifo_broadcast_deinit(struct audio_utils_fifo_broadcast *fifo);
+
+/**
+ * Attach or detach a reader.  An inactive reader does not limit the writer.
+ * A reader that is (re-)attached starts reading at the current write index.
+ * Must be called by the thread which owns the reader.
+ *
+ *  \param fifo        Pointer to the broadcast FIFO object.
+ *  \param reader      Index of reader, < readerCount.
+ *  \param active      Non-zero to attach, zero to detach.
+ */
+void audio_utils_fifo_broadcast_set_active(struct audio_utils_fifo_broadcast *fifo,
+        size_t reader, int active);
+
+/**
+ * Write to broadcast FIFO.  Same semantics as audio_utils_fifo_write(),
+ * where the available space is determined by the slowest active reader,
+ * or is always mFrameCount in overwrite mode.
+ */
+ssize_t audio_utils_fifo_broadcast_write(struct audio_utils_fifo_broadcast *fifo,
+        const void *buffer, size_t count);
+
+/**
+ * Obtain direct access for writing.  Same semantics as audio_utils_fifo_write_obtain().
+ */
+ssize_t audio_utils_fifo_broadcast_write_obtain(struct audio_utils_fifo_broadcast *fifo,
+        struct audio_utils_iovec iovec[2], size_t count);
+
+/**
+ * Release frames obtained for writing.  Same semantics as audio_utils_fifo_write_release().
+ */
+void audio_utils_fifo_broadcast_write_release(struct audio_utils_fifo_broadcast *fifo,
+        size_t count);
+
+/**
+ * Read from broadcast FIFO on behalf of one reader.
+ * Same semantics as audio_utils_fifo_read(), with the addition of one error.
+ *
+ *  \param fifo        Pointer to the broadcast FIFO object.
+ *  \param reader      Index of reader, < readerCount.
+ *  \param buffer      Pointer to destination buffer to be filled with up to 'count' frames of data.
+ *  \param count       Desired number of frames to read.
+ *
+ * \return actual number of frames read <= count, or
+ *  -EOVERFLOW in overwrite mode if the reader was overrun.  The unread frames are lost,
+ *  the reader is resynchronized to the write index, and the contents of buffer are undefined.
+ */
+ssize_t audio_utils_fifo_broadcast_read(struct audio_utils_fifo_broadcast *fifo,
+        size_t reader, void *buffer, size_t count);
+
+/**
+ * Obtain direct access for reading on behalf of one reader.
+ * Same semantics as audio_utils_fifo_read_obtain(), and may also return -EOVERFLOW
+ * as for audio_utils_fifo_broadcast_read().
+ */
+ssize_t audio_utils_fifo_broadcast_read_obtain(struct audio_utils_fifo_broadcast *fifo,
+        size_t reader, struct audio_utils_iovec iovec[2], size_t count);
+
+/**
+ * Release frames obtained for reading on behalf of one reader.
+ *
+ * \return count, or -EOVERFLOW in overwrite mode if the writer overwrote any of the
+ *  obtained frames while they were being accessed.  In that case the reader is
+ *  resynchronized to the write index, and the data accessed must be discarded.
+ */
+ssize_t audio_utils_fifo_broadcast_read_release(struct audio_utils_fifo_broadcast *fifo,
+        size_t reader, size_t count);
+
+/**
+ * \return total number of frames lost by this reader due to overwrite, modulo 2^32.
+ */
+uint32_t audio_utils_fifo_broadcast_get_overruns(struct audio_utils_fifo_broadcast *fifo,
+        size_t reader);
+
+// Cross-process FIFO in shared memory, such as an ashmem or memfd region mapped into both the
+// writer and reader processes, possibly at different addresses.  The region starts with a
+// control block containing only fixed-size fields and no pointers, followed by the data at
+// offset mDataOffset.  Each process attaches its own struct audio_utils_fifo to the region,
+// and then uses the ordinary FIFO API.  The writer and reader each trust only their own
+// mapping size; if the peer corrupts the shared indices, the FIFO API returns -EIO.
+
+#define AUDIO_UTILS_FIFO_CACHE_LINE_SIZE 64
+
+#define AUDIO_UTILS_FIFO_SHARED_MAGIC 0x46494630    // 'FIF0'
+
+// Layout of the control block at the start of a shared memory region.
+// No user-serviceable parts within.
+struct audio_utils_fifo_shared {
+    // These fields are const after audio_utils_fifo_shared_init()
+    uint32_t   mMagic;        // AUDIO_UTILS_FIFO_SHARED_MAGIC
+    uint32_t   mFrameCount;   // max number of significant frames to be stored in the FIFO > 0
+    uint32_t   mFrameSize;    // size of each frame in bytes
+    uint32_t   mDataOffset;   // byte offset of the data relative to start of control block
+    uint8_t    mPad0[AUDIO_UTILS_FIFO_CACHE_LINE_SIZE - 4 * sizeof(uint32_t)];
+
+    // Written by reader; the front index and writer waiting flag are on their own cache line
+    volatile int32_t mFront;
+    volatile int32_t mWriterWaiting;
+    uint8_t    mPad1[AUDIO_UTILS_FIFO_CACHE_LINE_SIZE - 2 * sizeof(int32_t)];
+
+    // Written by writer; the rear index and reader waiting flag are on their own cache line
+    volatile int32_t mRear;
+    volatile int32_t mReaderWaiting;
+    uint8_t    mPad2[AUDIO_UTILS_FIFO_CACHE_LINE_SIZE - 2 * sizeof(int32_t)];
+};
+
+/**
+ * Return the size in bytes of a shared memory region needed to hold a FIFO,
+ * including the control block.
+ *
+ *  \param frameCount  Max number of significant frames to be stored in the FIFO > 0.
+ *  \param frameSize   Size of each frame in bytes.
+ *
+ * \return size in bytes, or 0 if the parameters are invalid or the size would be too large.
+ */
+size_t audio_utils_fifo_shared_size(size_t frameCount, size_t frameSize);
+
+/**
+ * Format a shared memory region as an empty FIFO.  Must be called by exactly one process,
+ * before any process calls audio_utils_fifo_shared_attach().
+ *
+ *  \param shared      Pointer to the start of the mapped region, aligned to a cache line.
+ *  \param size        Size of the mapped region in bytes.
+ *  \param frameCount  Max number of significant frames to be stored in the FIFO > 0.
+ *  \param frameSize   Size of each frame in bytes.
+ *
+ * \return 0 on success, or -EINVAL if the parameters are invalid or the region is too small.
+ */
+int audio_utils_fifo_shared_init(void *shared, size_t size, size_t frameCount,
+        size_t frameSize);
+
+/**
+ * Initialize a process-local FIFO object to use a shared memory region previously formatted
+ * by audio_utils_fifo_shared_init(), possibly in another process.  The control block is
+ * validated against the size of the local mapping.  The FIFO object can then be passed to
+ * the ordinary FIFO functions, including the _timed variants, and must be de-initialized
+ * with audio_utils_fifo_deinit().
+ *
+ *  \param fifo        Pointer to the FIFO object.
+ *  \param shared      Pointer to the start of the mapped region in this process.
+ *  \param size        Size of the mapped region in bytes.
+ *
+ * \return 0 on success, or -EINVAL if the control block is not valid for this mapping.
+ */
+int audio_utils_fifo_shared_attach(struct audio_utils_fifo *fifo, void *shared, size_t size);
+
+// Single writer, single reader FIFO with a layout optimized for writer and reader on different
+// cores.  Same non-blocking semantics as struct audio_utils_fifo, but each index is on its own
+// cache line together with the other state owned by the same side, and the indices are 64-bit
+// monotonic frame counters.  The counters never wrap in practice, so the fill level is a plain
+// subtraction, and frameCount is not limited by the index width.  Each side keeps a cached copy
+// of the other side's index, and only reloads it when the cached value doesn't allow the
+// transfer, which avoids pulling the other side's cache line on most calls.
+// Writer and reader must be in same process.
+
+// No user-serviceable parts within.
+struct audio_utils_fifo64 {
+    // These fields are const after initialization
+    size_t     mFrameCount;   // max number of significant frames to be stored in the FIFO > 0
+    size_t     mFrameSize;    // size of each frame in bytes
+    void      *mBuffer;       // pointer to caller-allocated buffer of size mFrameCount frames
+
+    // Owned by writer
+    volatile uint64_t mRear __attribute__((aligned(AUDIO_UTILS_FIFO_CACHE_LINE_SIZE)));
+                              // total frames written
+    uint64_t   mFrontCached;  // writer's most recently observed value of mFront
+    size_t     mRearOffset;   // mRear modulo mFrameCount
+
+    // Owned by reader
+    volatile uint64_t mFront __attribute__((aligned(AUDIO_UTILS_FIFO_CACHE_LINE_SIZE)));
+                              // total frames read
+    uint64_t   mRearCached;   // reader's most recently observed value of mRear
+    size_t     mFrontOffset;  // mFront modulo mFrameCount
+} __attribute__((aligned(AUDIO_UTILS_FIFO_CACHE_LINE_SIZE)));
+
+/**
+ * Initialize a FIFO object.  Same parameters as audio_utils_fifo_init().
+ * For best results the FIFO object should be aligned to AUDIO_UTILS_FIFO_CACHE_LINE_SIZE,
+ * but the two indices are on different cache lines regardless.
+ */
+void audio_utils_fifo64_init(struct audio_utils_fifo64 *fifo, size_t frameCount,
+        size_t frameSize, void *buffer);
+
+/**
+ * De-initialize a FIFO object.
+ */
+void audio_utils_fifo64_deinit(struct audio_utils_fifo64 *fifo);
+
+/**
+ * Write to FIFO.  Same semantics as audio_utils_fifo_write().
+ */
+ssize_t audio_utils_fifo64_write(struct audio_utils_fifo64 *fifo, const void *buffer,
+        size_t count);
+
+/**
+ * Read from FIFO.  Same semantics as audio_utils_fifo_read().
+ */
+ssize_t audio_utils_fifo64_read(struct audio_utils_fifo64 *fifo, void *buffer, size_t count);
+
+/**
+ * Obtain direct access for writing.  Same semantics as audio_utils_fifo_write_obtain().
+ */
+ssize_t audio_utils_fifo64_write_obtain(struct audio_utils_fifo64 *fifo,
+        struct audio_utils_iovec iovec[2], size_t count);
+
+/**
+ * Release frames obtained for writing.  Same semantics as audio_utils_fifo_write_release().
+ */
+void audio_utils_fifo64_write_release(struct audio_utils_fifo64 *fifo, size_t count);
+
+/**
+ * Obtain direct access for reading.  Same semantics as audio_utils_fifo_read_obtain().
+ */
+ssize_t audio_utils_fifo64_read_obtain(struct audio_utils_fifo64 *fifo,
+        struct audio_utils_iovec iovec[2], size_t count);
+
+/**
+ * Release frames obtained for reading.  Same semantics as audio_utils_fifo_read_release().
+ */
+void audio_utils_fifo64_read_release(struct audio_utils_fifo64 *fifo, size_t count);
+
 #ifdef __cplusplus
 }
 #endif
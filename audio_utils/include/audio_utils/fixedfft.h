@@ -17,6 +17,7 @@
 #ifndef ANDROID_AUDIO_FIXEDFFT_H
 #define ANDROID_AUDIO_FIXEDFFT_H
 
+#include <stddef.h>
 #include <stdint.h>
 #include <sys/cdefs.h>
 
@@ -27,6 +28,39 @@ __BEGIN_DECLS
 /** See description in fixedfft.cpp */
 extern void fixed_fft_real(int n, int32_t *v);
 
+/**
+ * Cached tables for fixed_fft_real() of one size: the bit-reversal permutation and the
+ * twiddle factors of each stage.  A plan is read-only once created, so it can be shared.
+ */
+struct fixed_fft_plan;
+
+/**
+ * Create a plan for fixed_fft_real() of size n.
+ *
+ *  \param n    Same as for fixed_fft_real(), a power of 2 between 2 and 512.
+ *
+ * \return the plan, or NULL if n is invalid or memory allocation failed.
+ */
+extern struct fixed_fft_plan *fixed_fft_plan_create(int n);
+
+/** Release a plan returned by fixed_fft_plan_create(); NULL is ignored. */
+extern void fixed_fft_plan_destroy(struct fixed_fft_plan *plan);
+
+/** Same as fixed_fft_real() for the size of the plan, with bit exact results. */
+extern void fixed_fft_real_plan(const struct fixed_fft_plan *plan, int32_t *v);
+
+/**
+ * Apply fixed_fft_real_plan() to count frames in one call.  The stages are run across all
+ * frames in turn, so that each twiddle factor is loaded once per batch instead of once per frame.
+ *
+ *  \param plan   Plan for size n.
+ *  \param v      First frame, each of n int32_t as for fixed_fft_real().
+ *  \param count  Number of frames.
+ *  \param stride Distance between the starts of consecutive frames in int32_t, >= n.
+ */
+extern void fixed_fft_real_batch(const struct fixed_fft_plan *plan, int32_t *v, size_t count,
+        size_t stride);
+
 /** \cond */
 __END_DECLS
 /** \endcond */
@@ -64,6 +64,28 @@ void memcpy_by_audio_format(void *dst, audio_format_t dst_format,
         const void *src, audio_format_t src_format, size_t count);
 
 
+/**
+ * Signature of a conversion routine returned by memcpy_by_audio_format_get_converter().
+ * The parameters are as for memcpy_by_audio_format(), with the formats already resolved.
+ */
+typedef void (*memcpy_by_audio_format_t)(void *dst, const void *src, size_t count);
+
+/**
+ * Resolve a pair of buffer sample formats to a conversion routine, once,
+ * so that callers converting many buffers can avoid the per-call format dispatch
+ * of memcpy_by_audio_format().
+ *
+ *  \param dst_format Destination buffer format
+ *  \param src_format Source buffer format
+ *
+ * \return the conversion routine, with the same behavior as memcpy_by_audio_format()
+ * for these formats, or NULL if the conversion is not allowed by the rules given for
+ * memcpy_by_audio_format().  Unlike memcpy_by_audio_format(), an unsupported pair
+ * is not a fatal error.
+ */
+memcpy_by_audio_format_t memcpy_by_audio_format_get_converter(audio_format_t dst_format,
+        audio_format_t src_format);
+
 /**
  * This function creates an index array for converting audio data with different
  * channel position and index masks, used by memcpy_by_index_array().
@@ -0,0 +1,145 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_AUDIO_UTILS_KERNELS_H
+#define ANDROID_AUDIO_UTILS_KERNELS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <audio_utils/audio_traits.h>
+#include <audio_utils/primitives.h>
+
+// Conversion, remap and mix kernels with the formats and channel counts as template
+// parameters.  With everything but the frame count known at compile time, the compiler
+// can unroll the per-frame loops and vectorize across frames, without the runtime dispatch
+// of memcpy_by_audio_format() or the runtime channel counts of memcpy_by_index_array().
+//
+// Each sample conversion gives the same result as the scalar loop of the matching
+// memcpy_to_*_from_*() routine in primitives.h.  The linear PCM formats other than
+// AUDIO_FORMAT_PCM_24_BIT_PACKED are supported; a conversion which is not defined is a
+// compile error.
+
+namespace android {
+namespace audio_utils {
+
+// Type of one sample of a linear PCM format
+template <audio_format_t Format>
+using sample_t = typename sample_type_of<Format>::type;
+
+// Conversion of one sample from format Src to format Dst
+template <audio_format_t Dst, audio_format_t Src>
+struct sample_converter;
+
+template <audio_format_t Format>
+struct sample_converter<Format, Format> {
+    static sample_t<Format> convert(sample_t<Format> sample) { return sample; }
+};
+
+#define AUDIO_UTILS_SAMPLE_CONVERTER(dst_format, src_format, expression) \
+    template <> \
+    struct sample_converter<dst_format, src_format> { \
+        static sample_t<dst_format> convert(sample_t<src_format> sample) { \
+            return expression; \
+        } \
+    };
+
+AUDIO_UTILS_SAMPLE_CONVERTER(AUDIO_FORMAT_PCM_16_BIT, AUDIO_FORMAT_PCM_FLOAT,
+        clamp16_from_float(sample))
+AUDIO_UTILS_SAMPLE_CONVERTER(AUDIO_FORMAT_PCM_16_BIT, AUDIO_FORMAT_PCM_8_BIT,
+        (int16_t)(sample - 0x80) << 8)
+AUDIO_UTILS_SAMPLE_CONVERTER(AUDIO_FORMAT_PCM_16_BIT, AUDIO_FORMAT_PCM_32_BIT,
+        sample >> 16)
+AUDIO_UTILS_SAMPLE_CONVERTER(AUDIO_FORMAT_PCM_16_BIT, AUDIO_FORMAT_PCM_8_24_BIT,
+        clamp16(sample >> 8))
+AUDIO_UTILS_SAMPLE_CONVERTER(AUDIO_FORMAT_PCM_FLOAT, AUDIO_FORMAT_PCM_16_BIT,
+        float_from_i16(sample))
+AUDIO_UTILS_SAMPLE_CONVERTER(AUDIO_FORMAT_PCM_FLOAT, AUDIO_FORMAT_PCM_8_BIT,
+        float_from_u8(sample))
+AUDIO_UTILS_SAMPLE_CONVERTER(AUDIO_FORMAT_PCM_FLOAT, AUDIO_FORMAT_PCM_32_BIT,
+        float_from_i32(sample))
+AUDIO_UTILS_SAMPLE_CONVERTER(AUDIO_FORMAT_PCM_FLOAT, AUDIO_FORMAT_PCM_8_24_BIT,
+        float_from_q8_23(sample))
+AUDIO_UTILS_SAMPLE_CONVERTER(AUDIO_FORMAT_PCM_8_BIT, AUDIO_FORMAT_PCM_16_BIT,
+        (sample >> 8) + 0x80)
+AUDIO_UTILS_SAMPLE_CONVERTER(AUDIO_FORMAT_PCM_8_BIT, AUDIO_FORMAT_PCM_FLOAT,
+        clamp8_from_float(sample))
+AUDIO_UTILS_SAMPLE_CONVERTER(AUDIO_FORMAT_PCM_32_BIT, AUDIO_FORMAT_PCM_16_BIT,
+        (int32_t)sample << 16)
+AUDIO_UTILS_SAMPLE_CONVERTER(AUDIO_FORMAT_PCM_32_BIT, AUDIO_FORMAT_PCM_FLOAT,
+        clamp32_from_float(sample))
+AUDIO_UTILS_SAMPLE_CONVERTER(AUDIO_FORMAT_PCM_8_24_BIT, AUDIO_FORMAT_PCM_16_BIT,
+        (int32_t)sample << 8)
+AUDIO_UTILS_SAMPLE_CONVERTER(AUDIO_FORMAT_PCM_8_24_BIT, AUDIO_FORMAT_PCM_FLOAT,
+        clamp24_from_float(sample))
+
+#undef AUDIO_UTILS_SAMPLE_CONVERTER
+
+// Convert frames of Channels samples from format Src to format Dst.
+// The buffers must not overlap, unless dst == src and the formats have the same sample size.
+template <audio_format_t Dst, audio_format_t Src, size_t Channels>
+void convert(sample_t<Dst> *dst, const sample_t<Src> *src, size_t frames) {
+    static_assert(Channels > 0, "no channels");
+    for (size_t i = 0; i < frames; ++i, dst += Channels, src += Channels) {
+        for (size_t j = 0; j < Channels; ++j) {
+            dst[j] = sample_converter<Dst, Src>::convert(src[j]);
+        }
+    }
+}
+
+// Rearrange the samples of each frame, with the same meaning of idxary as
+// memcpy_by_index_array(): dst channel i is src channel idxary[i], or zero if idxary[i] < 0.
+// Each idxary[i] must be less than SrcChannels.  The buffers must not overlap.
+template <audio_format_t Format, size_t DstChannels, size_t SrcChannels>
+void remap(sample_t<Format> *dst, const sample_t<Format> *src, size_t frames,
+        const int8_t *idxary) {
+    static_assert(DstChannels > 0 && SrcChannels > 0, "no channels");
+    // lets the compiler keep the whole index array in registers
+    int8_t index[DstChannels];
+    for (size_t i = 0; i < DstChannels; ++i) {
+        index[i] = idxary[i];
+    }
+    for (size_t i = 0; i < frames; ++i, dst += DstChannels, src += SrcChannels) {
+        for (size_t j = 0; j < DstChannels; ++j) {
+            dst[j] = index[j] < 0 ? sample_t<Format>() : src[index[j]];
+        }
+    }
+}
+
+// Mix frames of Channels samples of format Src into format Dst with a gain per channel:
+// dst[j] = convert(float(dst[j]) + float(src[j]) * gains[j]), with the sums in float.
+// For a float destination this is a plain multiply-accumulate, and for the other formats
+// the sums are clamped to the destination range by the conversion.
+// The buffers must not overlap, unless dst == src and the formats are the same.
+template <audio_format_t Dst, audio_format_t Src, size_t Channels>
+void mix(sample_t<Dst> *dst, const sample_t<Src> *src, size_t frames, const float *gains) {
+    static_assert(Channels > 0, "no channels");
+    float gain[Channels];
+    for (size_t j = 0; j < Channels; ++j) {
+        gain[j] = gains[j];
+    }
+    for (size_t i = 0; i < frames; ++i, dst += Channels, src += Channels) {
+        for (size_t j = 0; j < Channels; ++j) {
+            const float sum = sample_converter<AUDIO_FORMAT_PCM_FLOAT, Dst>::convert(dst[j]) +
+                    sample_converter<AUDIO_FORMAT_PCM_FLOAT, Src>::convert(src[j]) * gain[j];
+            dst[j] = sample_converter<Dst, AUDIO_FORMAT_PCM_FLOAT>::convert(sum);
+        }
+    }
+}
+
+} // namespace audio_utils
+} // namespace android
+
+#endif // ANDROID_AUDIO_UTILS_KERNELS_H
@@ -20,6 +20,7 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <sys/cdefs.h>
+#include <audio_utils/minifloat.h>
 
 /** \cond */
 __BEGIN_DECLS
@@ -51,6 +52,46 @@ __BEGIN_DECLS
  */
 void ditherAndClamp(int32_t* out, const int32_t *sums, size_t c);
 
+/**
+ * Accumulate 16-bit samples into 32-bit sums, with a linear volume ramp per channel,
+ * as the inner loop of a track mixer.  The sums are Q4.27 for unity gain, the input of
+ * ditherAndClamp().  For frame f the volume of channel c is volumes[c] + volume_incs[c] * f,
+ * and sums[f * channels + c] += src[f * channels + c] * (volume >> 16) as by mulAdd().
+ * On return volumes[c] is advanced by volume_incs[c] * frames, the volume of the first frame
+ * of the next buffer.  With all increments 0 this is a mix with constant volume.
+ *
+ *  \param sums         Accumulator buffer of frames * channels samples
+ *  \param src          Source buffer of frames * channels samples
+ *  \param channels     Number of channels per frame
+ *  \param frames       Number of frames to mix
+ *  \param volumes      Array of channels volumes in unsigned fixed-point U4.28, as produced by
+ *                      u4_28_from_float(); they must be at most 0x7FFFFFFF over the ramp
+ *  \param volume_incs  Array of channels volume increments per frame in U4.28
+ *
+ * The accumulator and source buffers must be completely separate.
+ */
+void mix_to_i32_from_i16_with_ramp(int32_t *sums, const int16_t *src, size_t channels,
+        size_t frames, int32_t *volumes, const int32_t *volume_incs);
+
+/**
+ * Accumulate float samples into float sums, with a linear volume ramp per channel.
+ * For frame f the volume of channel c is volumes[c] + volume_incs[c] * f,
+ * and sums[f * channels + c] += src[f * channels + c] * volume.
+ * On return volumes[c] is advanced by volume_incs[c] * frames, the volume of the first frame
+ * of the next buffer.  The sums are not clamped.
+ *
+ *  \param sums         Accumulator buffer of frames * channels samples
+ *  \param src          Source buffer of frames * channels samples
+ *  \param channels     Number of channels per frame
+ *  \param frames       Number of frames to mix
+ *  \param volumes      Array of channels volumes
+ *  \param volume_incs  Array of channels volume increments per frame
+ *
+ * The accumulator and source buffers must be completely separate.
+ */
+void mix_to_float_from_float_with_ramp(float *sums, const float *src, size_t channels,
+        size_t frames, float *volumes, const float *volume_incs);
+
 /**
  * Expand and copy samples from unsigned 8-bit offset by 0x80 to signed 16-bit.
  *
@@ -145,6 +186,137 @@ void memcpy_to_float_from_q4_27(float *dst, const int32_t *src, size_t count);
  */
 void memcpy_to_float_from_i16(float *dst, const int16_t *src, size_t count);
 
+/**
+ * Copy samples from single-precision floating-point to signed fixed-point 16 bit Q0.15,
+ * applying a gain in the same pass.  The result for each sample is
+ * clamp16_from_float(src[i] * gain).
+ *
+ *  \param dst     Destination buffer
+ *  \param src     Source buffer
+ *  \param count   Number of samples to copy
+ *  \param gain    Gain to apply, where 1.0 is unity
+ *
+ * The destination and source buffers must either be completely separate (non-overlapping), or
+ * they must both start at the same address.  Partially overlapping buffers are not supported.
+ */
+void memcpy_to_i16_from_float_with_gain(int16_t *dst, const float *src, size_t count,
+        float gain);
+
+/**
+ * Copy samples from signed fixed-point 16 bit Q0.15 to single-precision floating-point,
+ * applying a gain in the same pass.  The result for each sample is
+ * float_from_i16(src[i]) * gain.
+ *
+ *  \param dst     Destination buffer
+ *  \param src     Source buffer
+ *  \param count   Number of samples to copy
+ *  \param gain    Gain to apply, where 1.0 is unity
+ *
+ * The destination and source buffers must be completely separate.
+ */
+void memcpy_to_float_from_i16_with_gain(float *dst, const int16_t *src, size_t count,
+        float gain);
+
+/**
+ * Copy interleaved stereo frames from single-precision floating-point to signed fixed-point
+ * 16 bit Q0.15, applying separate left and right gains in the same pass.
+ *
+ *  \param dst     Destination buffer
+ *  \param src     Source buffer
+ *  \param frames  Number of stereo frames to copy; the buffers contain 2 * frames samples
+ *  \param gainL   Gain to apply to the left channel, where 1.0 is unity
+ *  \param gainR   Gain to apply to the right channel, where 1.0 is unity
+ *
+ * The destination and source buffers must either be completely separate (non-overlapping), or
+ * they must both start at the same address.  Partially overlapping buffers are not supported.
+ */
+void memcpy_to_i16_from_float_with_stereo_gain(int16_t *dst, const float *src, size_t frames,
+        float gainL, float gainR);
+
+/**
+ * Copy interleaved stereo frames from signed fixed-point 16 bit Q0.15 to single-precision
+ * floating-point, applying separate left and right gains in the same pass.
+ *
+ *  \param dst     Destination buffer
+ *  \param src     Source buffer
+ *  \param frames  Number of stereo frames to copy; the buffers contain 2 * frames samples
+ *  \param gainL   Gain to apply to the left channel, where 1.0 is unity
+ *  \param gainR   Gain to apply to the right channel, where 1.0 is unity
+ *
+ * The destination and source buffers must be completely separate.
+ */
+void memcpy_to_float_from_i16_with_stereo_gain(float *dst, const int16_t *src, size_t frames,
+        float gainL, float gainR);
+
+/**
+ * Copy interleaved stereo frames from single-precision floating-point to signed fixed-point
+ * 16 bit Q0.15, applying a linear volume ramp in the same pass.
+ * Frame i of the buffer has gain from + (to - from) * i / frames, for each channel separately,
+ * so the ramp reaches 'to' at the first frame of the next buffer.
+ *
+ *  \param dst     Destination buffer
+ *  \param src     Source buffer
+ *  \param frames  Number of stereo frames to copy; the buffers contain 2 * frames samples
+ *  \param from    Left and right gains at the first frame
+ *  \param to      Left and right gains at the end of the ramp
+ *
+ * The destination and source buffers must either be completely separate (non-overlapping), or
+ * they must both start at the same address.  Partially overlapping buffers are not supported.
+ */
+void memcpy_to_i16_from_float_with_stereo_ramp(int16_t *dst, const float *src, size_t frames,
+        gain_minifloat_packed_t from, gain_minifloat_packed_t to);
+
+/**
+ * Copy interleaved stereo frames from signed fixed-point 16 bit Q0.15 to single-precision
+ * floating-point, applying a linear volume ramp in the same pass.
+ * The ramp is as for memcpy_to_i16_from_float_with_stereo_ramp().
+ *
+ *  \param dst     Destination buffer
+ *  \param src     Source buffer
+ *  \param frames  Number of stereo frames to copy; the buffers contain 2 * frames samples
+ *  \param from    Left and right gains at the first frame
+ *  \param to      Left and right gains at the end of the ramp
+ *
+ * The destination and source buffers must be completely separate.
+ */
+void memcpy_to_float_from_i16_with_stereo_ramp(float *dst, const int16_t *src, size_t frames,
+        gain_minifloat_packed_t from, gain_minifloat_packed_t to);
+
+/**
+ * Apply a linear volume ramp to interleaved stereo frames of signed fixed-point 16 bit Q0.15,
+ * for a volume change without a click.  The ramp is as for
+ * memcpy_to_i16_from_float_with_stereo_ramp(), computed in float, so the result for each
+ * sample is clamp16_from_float(float_from_i16(src[i]) * gain).
+ *
+ *  \param dst     Destination buffer
+ *  \param src     Source buffer
+ *  \param frames  Number of stereo frames to copy; the buffers contain 2 * frames samples
+ *  \param from    Left and right gains at the first frame
+ *  \param to      Left and right gains at the end of the ramp
+ *
+ * The destination and source buffers must either be completely separate (non-overlapping), or
+ * they must both start at the same address.  Partially overlapping buffers are not supported.
+ */
+void memcpy_to_i16_from_i16_with_stereo_ramp(int16_t *dst, const int16_t *src, size_t frames,
+        gain_minifloat_packed_t from, gain_minifloat_packed_t to);
+
+/**
+ * Apply a linear volume ramp to interleaved stereo frames of single-precision floating-point,
+ * for a volume change without a click.  The ramp is as for
+ * memcpy_to_i16_from_float_with_stereo_ramp().  The result is not clamped.
+ *
+ *  \param dst     Destination buffer
+ *  \param src     Source buffer
+ *  \param frames  Number of stereo frames to copy; the buffers contain 2 * frames samples
+ *  \param from    Left and right gains at the first frame
+ *  \param to      Left and right gains at the end of the ramp
+ *
+ * The destination and source buffers must either be completely separate (non-overlapping), or
+ * they must both start at the same address.  Partially overlapping buffers are not supported.
+ */
+void memcpy_to_float_from_float_with_stereo_ramp(float *dst, const float *src, size_t frames,
+        gain_minifloat_packed_t from, gain_minifloat_packed_t to);
+
 /**
  * Copy samples from unsigned fixed-point 8 bit to single-precision floating-point.
  * The output float range is [-1.0, 1.0) for the fixed-point range [0x00, 0xFF].
@@ -450,6 +622,35 @@ size_t nonZeroStereo32(const int32_t *frames, size_t count);
  */
 size_t nonZeroStereo16(const int16_t *frames, size_t count);
 
+/**
+ * Find the first frame which is not silent, stopping the scan there.
+ * A frame is silent if the magnitude of each of its samples is at most threshold.
+ * Use a threshold of 0 to look for exact digital silence, or a small positive threshold
+ * to treat near-silence (e.g. dither or a decaying tail) as silent.
+ *
+ *  \param samples   Interleaved input samples
+ *  \param channels  Number of samples per frame, must be >= 1
+ *  \param frames    Number of frames to scan
+ *  \param threshold Largest magnitude considered silent, must be >= 0
+ *
+ * \return the index of the first non-silent frame, or frames if the whole buffer is silent.
+ */
+size_t find_non_silent_frame_i16(const int16_t *samples, size_t channels, size_t frames,
+        int16_t threshold);
+
+/**
+ * Same as find_non_silent_frame_i16(), for 32-bit integer samples.
+ */
+size_t find_non_silent_frame_i32(const int32_t *samples, size_t channels, size_t frames,
+        int32_t threshold);
+
+/**
+ * Same as find_non_silent_frame_i16(), for float samples.
+ * NaN samples are considered silent.
+ */
+size_t find_non_silent_frame_float(const float *samples, size_t channels, size_t frames,
+        float threshold);
+
 /**
  * Copy frames, selecting source samples based on a source channel mask to fit
  * the destination channel mask. Unmatched channels in the destination channel mask
@@ -577,6 +778,60 @@ size_t memcpy_by_index_array_initialization_src_index(int8_t *idxary, size_t idx
 size_t memcpy_by_index_array_initialization_dst_index(int8_t *idxary, size_t idxcount,
         uint32_t dst_mask, uint32_t src_mask);
 
+/** Maximum number of channels in a struct memcpy_by_index_array_plan */
+#define MEMCPY_BY_INDEX_ARRAY_PLAN_MAX_CHANNELS 32
+
+/**
+ * A channel remap compiled from an index array, for repeated use by
+ * memcpy_by_index_array_plan_execute().  Initialize with memcpy_by_index_array_plan_init().
+ * No user-serviceable parts within.
+ */
+struct memcpy_by_index_array_plan {
+    uint32_t dst_channels;
+    uint32_t src_channels;
+    size_t sample_size;
+    int kind;               /* which specialized copy to use, see primitives.c */
+    uint32_t first;         /* for a contiguous run of source channels, the first one */
+    int8_t idxary[MEMCPY_BY_INDEX_ARRAY_PLAN_MAX_CHANNELS];
+    uint8_t shuffle[16];    /* for a vector byte shuffle, the source byte of each dst byte */
+};
+
+/**
+ * Compile an index array into a plan, with the same meaning as the parameters to
+ * memcpy_by_index_array().  The plan selects the fastest available copy for the remap:
+ * a straight copy if the remap is the identity, a frame-by-frame block copy if the
+ * destination channels are a contiguous run of the source channels (e.g. dropping channels),
+ * a fill with zero if no source channels are used, a vector byte shuffle if both frames
+ * fit in a vector register, or otherwise the generic copy of memcpy_by_index_array().
+ *
+ *  \param plan          Caller-allocated plan to initialize
+ *  \param dst_channels  Number of destination channels per frame, 1 to 32
+ *  \param src_channels  Number of source channels per frame, 1 to 32
+ *  \param idxary        Array of dst_channels indices representing channels in the source frame,
+ *                       for example as prepared by memcpy_by_index_array_initialization().
+ *                       The array is copied, so it need not remain valid after the call.
+ *  \param sample_size   Size of each sample in bytes.  Must be 1, 2, 3, or 4.
+ *
+ * \return 0 on success, or -EINVAL if a parameter is out of range, including an index
+ *  which is not less than src_channels.
+ */
+int memcpy_by_index_array_plan_init(struct memcpy_by_index_array_plan *plan,
+        uint32_t dst_channels, uint32_t src_channels, const int8_t *idxary, size_t sample_size);
+
+/**
+ * Copy frames according to a plan, with the same result as memcpy_by_index_array()
+ * given the parameters used to initialize the plan.
+ *
+ *  \param plan          Plan initialized by memcpy_by_index_array_plan_init()
+ *  \param dst           Destination buffer
+ *  \param src           Source buffer
+ *  \param count         Number of frames to copy
+ *
+ * The destination and source buffers must be completely separate (non-overlapping).
+ */
+void memcpy_by_index_array_plan_execute(const struct memcpy_by_index_array_plan *plan,
+        void *dst, const void *src, size_t count);
+
 /**
  * Clamp (aka hard limit or clip) a signed 32-bit sample to 16-bit range.
  */
@@ -34,6 +34,7 @@ struct resampler_buffer {
         void*       raw;
         short*      i16;
         int8_t*     i8;
+        float*      f32;
     };
     size_t frame_count;
 };
@@ -67,6 +68,8 @@ struct resampler_itfe {
     /**
      * resample input from buffer provider and output at most *outFrameCount to out buffer.
      * *outFrameCount is updated with the actual number of frames produced.
+     * Returns -ENOMEM if RESAMPLER_FLAG_NO_ALLOC was requested and *outFrameCount exceeds
+     * the configured max_frame_count.
      */
     int (*resample_from_provider)(struct resampler_itfe *resampler,
                     int16_t *out,
@@ -85,8 +88,39 @@ struct resampler_itfe {
      * \return the latency introduced by the resampler in ns.
      */
     int32_t (*delay_ns)(struct resampler_itfe *resampler);
+    /**
+     * same as resample_from_provider() for float samples: the buffer provider
+     * returns float samples, with the channel count given at creation.
+     * Do not mix 16-bit and float calls on the same resampler, unless reset() is called in between.
+     */
+    int (*resample_from_provider_float)(struct resampler_itfe *resampler,
+                    float *out,
+                    size_t *outFrameCount);
+    /**
+     * same as resample_from_input() for float samples.
+     */
+    int (*resample_from_input_float)(struct resampler_itfe *resampler,
+                    const float *in,
+                    size_t *inFrameCount,
+                    float *out,
+                    size_t *outFrameCount);
+    /**
+     * Adjust the resampling ratio around its nominal value, to follow the drift between the
+     * input and output clocks, e.g. from the fill level of a FIFO between them.
+     * ppm is in parts per million of the nominal input sample rate, and is positive when
+     * the input clock is faster than nominal, so that more input is consumed per output frame.
+     * The adjustment applies from the next output frame, without discontinuity, and replaces any
+     * previous one; 0 restores the nominal ratio.
+     * This is cheap for RESAMPLER_ENGINE_POLYPHASE, and can be called every period.
+     * RESAMPLER_ENGINE_SPEEX recomputes its filter on each change.
+     *
+     * \return 0 on success, -EINVAL if ppm exceeds RESAMPLER_MAX_RATIO_ADJUSTMENT_PPM.
+     */
+    int (*set_ratio_adjustment_ppm)(struct resampler_itfe *resampler, int32_t ppm);
 };
 
+#define RESAMPLER_MAX_RATIO_ADJUSTMENT_PPM 50000
+
 /**
  * create a resampler according to input parameters passed.
  * If resampler_buffer_provider is not NULL only resample_from_provider() can be called.
@@ -99,6 +133,101 @@ int create_resampler(uint32_t inSampleRate,
           struct resampler_buffer_provider *provider,
           struct resampler_itfe **);
 
+/** resampler implementations available behind struct resampler_itfe */
+enum resampler_engine {
+    /** Speex resampler, any sample rates */
+    RESAMPLER_ENGINE_SPEEX = 0,
+    /**
+     * Windowed sinc polyphase filter computed in float, for sample rates with a rational ratio of
+     * at most RESAMPLER_POLYPHASE_MAX_PHASES phases after reduction, such as 44100 <-> 48000 and
+     * 16000 <-> 48000.  Filter tables are read-only and shared by all resamplers with the same
+     * ratio and quality.
+     */
+    RESAMPLER_ENGINE_POLYPHASE = 1,
+};
+
+#define RESAMPLER_POLYPHASE_MAX_PHASES 1024
+
+/** flags for struct resampler_config */
+enum resampler_flags {
+    RESAMPLER_FLAG_NONE = 0x0,
+    /**
+     * Never allocate memory after creation, so that the resampler can be used from a real-time
+     * thread.  A call to resample_from_provider() which needs more input buffer than was
+     * preallocated for max_frame_count fails with -ENOMEM, producing no frames and
+     * consuming no input.
+     */
+    RESAMPLER_FLAG_NO_ALLOC = 0x1,
+};
+
+/**
+ * Parameters of create_resampler_from_config().
+ * Zero-initialize this structure before setting fields, so that any fields not set by the caller
+ * keep their default behavior.
+ */
+struct resampler_config {
+    uint32_t in_sample_rate;        // input sampling rate in Hz
+    uint32_t out_sample_rate;       // output sampling rate in Hz
+    uint32_t channel_count;         // number of channels (interleaved)
+    uint32_t quality;               // RESAMPLER_QUALITY_MIN < quality < RESAMPLER_QUALITY_MAX
+    enum resampler_engine engine;   // implementation to use
+    size_t max_frame_count;         // maximum *outFrameCount passed to resample_from_provider(),
+                                    // for which buffers are preallocated, or 0 if unknown
+    uint32_t flags;                 // a combination of enum resampler_flags
+};
+
+/**
+ * create a resampler according to a configuration.
+ * Same as create_resampler(), except for the choice of engine.
+ *
+ * \return
+ *  0 on success,
+ *  -EINVAL if a parameter is invalid or unsupported by the requested engine,
+ *         or if RESAMPLER_FLAG_NO_ALLOC is set without max_frame_count,
+ *  -ENODEV if the engine could not be created.
+ */
+int create_resampler_from_config(const struct resampler_config *config,
+          struct resampler_buffer_provider *provider,
+          struct resampler_itfe **resampler);
+
+/** one stream of resample_batch_from_input_float() */
+struct resampler_batch_item {
+    struct resampler_itfe *resampler;   // resampler created without a buffer provider
+    const float *in;                    // input frames
+    size_t in_frame_count;              // as input: number of frames in in,
+                                        // as output: number of frames consumed
+    float *out;                         // output frames
+    size_t out_frame_count;             // as input: maximum number of frames to produce,
+                                        // as output: number of frames produced
+    int status;                         // as output: result of resample_from_input_float()
+};
+
+/**
+ * Same as resample_from_input_float() for each of count items, in one call.
+ * Consecutive items are processed in lockstep when their resamplers use
+ * RESAMPLER_ENGINE_POLYPHASE with the same ratio, quality, channel count and ratio adjustment,
+ * are in the same state, and are given the same frame counts: the filter row, and its
+ * interpolation for an adjusted ratio, is then computed once per output frame for all of them,
+ * and mono streams are filtered four at a time with vector instructions.
+ * Resamplers created with the same configuration and always given the same frame counts,
+ * e.g. those of concurrent capture streams sharing one period, stay in the same state.
+ * Other items are processed one at a time.
+ *
+ * \return 0 if all items succeeded, otherwise the status of the first item which failed.
+ */
+int resample_batch_from_input_float(struct resampler_batch_item *items, size_t count);
+
+struct audio_utils_task_pool;
+
+/**
+ * Same as resample_batch_from_input_float(), with the items split across the threads of a pool
+ * of <audio_utils/task_pool.h>, or processed by the calling thread alone if pool is NULL.
+ * Each resampler must appear in at most one item.  This blocks until all items are processed,
+ * so it is meant for offline processing and must not be called from a real-time thread.
+ */
+int resample_batch_from_input_float_parallel(struct audio_utils_task_pool *pool,
+        struct resampler_batch_item *items, size_t count);
+
 /**
  * release resampler resources.
  */
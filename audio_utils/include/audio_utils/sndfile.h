@@ -40,12 +40,19 @@ typedef struct {
     int format;
 } SF_INFO;
 
+// Largest channel count of a file that can be read or written, e.g. for microphone arrays
+#define SF_MAX_CHANNELS 256
+
 // opaque to clients
 typedef struct SNDFILE_ SNDFILE;
 
 // Access modes
 #define SFM_READ    1
 #define SFM_WRITE   2
+// Combined with SFM_READ: memory-map the data chunk instead of reading it through stdio.
+// Reads then convert directly from the page cache, and sf_readf_view() is available.
+// The file must not be truncated while it is open.
+#define SFM_MMAP    4
 
 // Format
 #define SF_FORMAT_TYPEMASK  1
@@ -71,6 +78,34 @@ sf_count_t sf_readf_short(SNDFILE *handle, short *ptr, sf_count_t desired);
 sf_count_t sf_readf_float(SNDFILE *handle, float *ptr, sf_count_t desired);
 sf_count_t sf_readf_int(SNDFILE *handle, int *ptr, sf_count_t desired);
 
+/**
+ * Move the read position of a file opened with SFM_READ, in frames within the data chunk.
+ * With SFM_MMAP this does no I/O, so analysis of a region costs only the size of the region.
+ * \param whence SEEK_SET, SEEK_CUR or SEEK_END as for fseek()
+ * \return new position in frames from the start of the data, or -1 if the handle is not
+ *         readable or the position would be outside of [0, frames]
+ */
+sf_count_t sf_seek(SNDFILE *handle, sf_count_t frames, int whence);
+
+/**
+ * Read a range of interleaved frames starting at frame offset, as sf_seek() to offset
+ * followed by sf_readf_*().  The read position is left after the range.
+ * \return actual number of frames read, which is 0 if offset is out of range
+ */
+sf_count_t sf_preadf_short(SNDFILE *handle, short *ptr, sf_count_t frames, sf_count_t offset);
+sf_count_t sf_preadf_float(SNDFILE *handle, float *ptr, sf_count_t frames, sf_count_t offset);
+sf_count_t sf_preadf_int(SNDFILE *handle, int *ptr, sf_count_t frames, sf_count_t offset);
+
+/**
+ * Read interleaved frames without copying, for a file opened with SFM_READ | SFM_MMAP.
+ * On return *ptr points to the frames in the file's own sample format given by SF_INFO.format,
+ * which stay valid until sf_close().  The samples are little-endian as stored in the file,
+ * and may not be aligned to the sample size.
+ * \return actual number of frames in the view, or 0 at end of file, if the file is not mapped,
+ *         or if the host is big-endian
+ */
+sf_count_t sf_readf_view(SNDFILE *handle, const void **ptr, sf_count_t desired);
+
 /**
  * Write interleaved frames
  * \return actual number of frames written
@@ -79,6 +114,24 @@ sf_count_t sf_writef_short(SNDFILE *handle, const short *ptr, sf_count_t desired
 sf_count_t sf_writef_float(SNDFILE *handle, const float *ptr, sf_count_t desired);
 sf_count_t sf_writef_int(SNDFILE *handle, const int *ptr, sf_count_t desired);
 
+// Flags for sf_set_write_buffer()
+#define SF_WRITE_BACKGROUND 1   // write full buffers from a background thread
+#define SF_WRITE_DIRECT     2   // bypass the page cache with O_DIRECT where supported
+
+/**
+ * Buffer the writes of a file opened with SFM_WRITE, before the first frame is written.
+ * Frames are converted directly into a buffer, and written with one system call each time the
+ * buffer is full.  With SF_WRITE_BACKGROUND there are two buffers, one of which is written by
+ * a background thread while the other is filled, so a capture thread only blocks if the disk
+ * falls a full buffer behind.  Write errors are then reported by later sf_writef_*() calls,
+ * which return 0.  SF_WRITE_DIRECT is ignored if the platform or file system does not
+ * support it.  The header sizes are updated by sf_close() as usual.
+ * \param bufferFrames size of each buffer in frames, e.g. one second or more for many channels
+ * \return 0 on success, -EINVAL if the arguments are invalid or frames were already written,
+ *         or another negative errno if the buffers or thread could not be created
+ */
+int sf_set_write_buffer(SNDFILE *handle, sf_count_t bufferFrames, int flags);
+
 /** \cond */
 __END_DECLS
 /** \endcond */
@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_AUDIO_SOUND_TRIGGER_MODEL_H
+#define ANDROID_AUDIO_SOUND_TRIGGER_MODEL_H
+
+#include <stddef.h>
+#include <sys/cdefs.h>
+#include <system/sound_trigger.h>
+
+/** \cond */
+__BEGIN_DECLS
+/** \endcond */
+
+/**
+ * Helpers for sound model blobs, the single block passed to load_sound_model():
+ * a struct sound_trigger_sound_model header, or the larger header of its type such as
+ * struct sound_trigger_phrase_sound_model, followed by the opaque model data at data_offset.
+ * A blob file holds exactly one blob, so it can be mapped and passed to load_sound_model()
+ * in place instead of being read and copied into a new allocation.
+ */
+
+/**
+ * Return the size of the header of a sound model type, e.g.
+ * sizeof(struct sound_trigger_phrase_sound_model) for SOUND_MODEL_TYPE_KEYPHRASE,
+ * or 0 if the type is unknown.
+ */
+size_t sound_trigger_sound_model_header_size(sound_trigger_sound_model_type_t type);
+
+/** Return the size of a blob, data_offset + data_size. */
+size_t sound_trigger_sound_model_size(const struct sound_trigger_sound_model *model);
+
+/**
+ * Build a compact blob, with the data right after the header.
+ *
+ *  \param header    Header of the model type, of which all fields are copied
+ *                   except data_size and data_offset.
+ *  \param data      Opaque model data.
+ *  \param data_size Size of data in bytes.
+ *
+ * \return the blob, to be released with free(), or NULL if the header is invalid or memory
+ *         allocation failed.
+ */
+struct sound_trigger_sound_model *sound_trigger_sound_model_create(
+        const struct sound_trigger_sound_model *header, const void *data, size_t data_size);
+
+/**
+ * Check that size bytes hold exactly one valid blob: a known type, a header within the
+ * limits of <system/sound_trigger.h> with terminated strings, and data within the blob.
+ *
+ * \return 0 if valid, or -EINVAL.
+ */
+int sound_trigger_sound_model_validate(const struct sound_trigger_sound_model *model,
+        size_t size);
+
+/**
+ * Write a blob to a file descriptor, in the compact layout of sound_trigger_sound_model_create().
+ *
+ * \return 0 on success, -EINVAL if the blob is invalid, or the negated errno of a failed write.
+ */
+int sound_trigger_sound_model_write(const struct sound_trigger_sound_model *model, int fd);
+
+/**
+ * Map a blob file written by sound_trigger_sound_model_write() read-only.  The file must hold
+ * exactly one valid blob, and must not be modified while it is mapped.  The file descriptor
+ * may be closed once mapped.
+ *
+ * \return the blob, to be released with sound_trigger_sound_model_unmap(), or NULL on error.
+ */
+const struct sound_trigger_sound_model *sound_trigger_sound_model_map(int fd);
+
+/** Same as sound_trigger_sound_model_map() for the file at path. */
+const struct sound_trigger_sound_model *sound_trigger_sound_model_map_file(const char *path);
+
+/** Release a blob returned by sound_trigger_sound_model_map(); NULL is ignored. */
+void sound_trigger_sound_model_unmap(const struct sound_trigger_sound_model *model);
+
+/** \cond */
+__END_DECLS
+/** \endcond */
+
+#endif  // ANDROID_AUDIO_SOUND_TRIGGER_MODEL_H
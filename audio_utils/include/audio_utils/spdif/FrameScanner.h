@@ -17,6 +17,7 @@
 #ifndef ANDROID_AUDIO_FRAME_SCANNER_H
 #define ANDROID_AUDIO_FRAME_SCANNER_H
 
+#include <stddef.h>
 #include <stdint.h>
 
 namespace android {
@@ -45,6 +46,26 @@ public:
      */
     virtual bool scan(uint8_t byte);
 
+    /**
+     * Pass a block of the encoded stream to this scanner.
+     * This is equivalent to calling scan() for each byte up to and including the last byte of
+     * a valid header, but finds sync word candidates with memchr() and gathers the
+     * header in bulk, so unsynchronized data costs little per byte.
+     * The scanner state carries over between blocks, so a header may span several calls.
+     * @param data encoded stream
+     * @param numBytes number of bytes in data
+     * @param found set to true if a complete and valid header was detected,
+     *              in which case it ends at the last byte consumed
+     * @return number of bytes consumed, which is numBytes unless a header was found
+     */
+    virtual size_t scan(const uint8_t *data, size_t numBytes, bool *found);
+
+    /**
+     * Discard a partially matched sync word or header, so that the next scan()
+     * starts looking for a new frame.
+     */
+    virtual void resetScan() { mCursor = 0; }
+
     /**
      * @return address of where the sync header was stored by scan()
      */
@@ -70,6 +91,11 @@ public:
 
     size_t getFrameSizeBytes()     const { return mFrameSizeBytes; }
 
+    /**
+     * @return number of bytes skipped so far while looking for the start of a frame
+     */
+    uint32_t getBytesSkipped()     const { return mBytesSkipped; }
+
     /**
      * dataType is defined by the SPDIF standard for each format
      */
@@ -0,0 +1,99 @@
+/*
+ * Copyright 2016, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_AUDIO_SPDIF_DECODER_H
+#define ANDROID_AUDIO_SPDIF_DECODER_H
+
+#include <stdint.h>
+#include <hardware/audio.h>
+#include <audio_utils/spdif/FrameScanner.h>
+
+namespace android {
+
+/**
+ * Scan SPDIF input, for example captured from HDMI ARC, for IEC 61937 data bursts.
+ * Then unwrap the encoded frames carried by each burst and pass them on.
+ * This is the reverse of SPDIFEncoder.
+ */
+class SPDIFDecoder {
+public:
+
+    SPDIFDecoder(audio_format_t format);
+
+    virtual ~SPDIFDecoder();
+
+    /**
+     * Write stereo 16-bit PCM samples as captured from SPDIF.
+     * The padding between data bursts is skipped in bulk, and a burst payload that is
+     * entirely within the buffer is byte swapped in place and passed to writeOutput()
+     * without being copied, so the contents of the buffer are modified.
+     * Data bursts may span several writes.
+     * @param buffer 2-byte aligned samples in native byte order
+     * @param numBytes a multiple of 2
+     * @return number of bytes written or negative error
+     */
+    ssize_t write(void* buffer, size_t numBytes);
+
+    /**
+     * Called by SPDIFDecoder for each encoded frame found in a data burst.
+     * The buffer is only valid during the call.
+     * Must be implemented in the subclass.
+     * @return number of bytes written or negative error
+     */
+    virtual ssize_t writeOutput(const void* buffer, size_t numBytes) = 0;
+
+    /**
+     * @return sample rate of the last encoded frame passed to writeOutput()
+     */
+    uint32_t getSampleRate() const { return mFramer->getSampleRate(); }
+
+    /**
+     * @return ratio of the data burst sample rate to the encoded sample rate
+     *         for the last encoded frame passed to writeOutput()
+     */
+    uint32_t getRateMultiplier() const { return mFramer->getRateMultiplier(); }
+
+    /**
+     * @return  true if we can unwrap this format from an SPDIF stream
+     */
+    static bool isFormatSupported(audio_format_t format);
+
+    /**
+     * Discard any partial data burst and look for the next burst preamble.
+     * This should be called when the input is interrupted.
+     */
+    void reset();
+
+protected:
+    bool   isDataTypeSupported(int dataType) const;
+    void   startPayload();
+    void   writeFrames(const uint8_t* payload, size_t numBytes);
+
+    audio_format_t mFormat;
+    // Works with various formats including AC3.
+    FrameScanner *mFramer;
+
+    uint8_t  *mPayloadBuffer; // holds a payload that spans writes, in stream byte order
+    size_t    mPayloadBufferSizeBytes;
+    size_t    mPayloadSizeBytes;    // size of the current payload, 0 if scanning for preamble
+    size_t    mPayloadShortsRead;   // shorts of the current payload in mPayloadBuffer
+    uint16_t  mPreamble[4];         // Pa, Pb, Pc, Pd
+    size_t    mPreambleCount;       // number of preamble words matched so far
+};
+
+}  // namespace android
+
+#endif  // ANDROID_AUDIO_SPDIF_DECODER_H
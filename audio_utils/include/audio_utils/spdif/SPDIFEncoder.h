@@ -34,6 +34,22 @@ namespace android {
 class SPDIFEncoder {
 public:
 
+    /**
+     * Counters accumulated since the encoder was created, for diagnosing passthrough
+     * glitches and wasted bandwidth. They are not cleared by reset().
+     */
+    struct Stats {
+        uint64_t bytesWritten;      // encoded bytes passed to write()
+        uint64_t bytesSkipped;      // encoded bytes skipped looking for a frame sync
+        uint64_t syncFrames;        // encoded frames wrapped in data bursts
+        uint64_t bursts;            // data bursts output
+        uint64_t burstBytes;        // bytes of data bursts output, including preamble and padding
+        uint64_t payloadBytes;      // bytes of burst payload, excluding preamble and padding
+        uint64_t zeroPadBytes;      // bytes of zero padding after the payload
+        uint32_t overflows;         // bursts discarded because the burst buffer overflowed
+        uint32_t maxFramesInBurst;  // most encoded frames in one data burst
+    };
+
     SPDIFEncoder(audio_format_t format);
     // Defaults to AC3 format. Was in original API.
     SPDIFEncoder();
@@ -54,6 +70,23 @@ public:
      */
     virtual ssize_t writeOutput( const void* buffer, size_t numBytes ) = 0;
 
+    /**
+     * Optionally implemented by the subclass so that data bursts are assembled directly in
+     * its output, for example in a region obtained from a HAL ring buffer, instead of in an
+     * internal buffer that is then copied by writeOutput().
+     * Called at the start of each data burst.
+     * @param numBytes size needed for the largest data burst of the format
+     * @return 2-byte aligned buffer of at least numBytes, or NULL to use writeOutput()
+     */
+    virtual void *obtainOutputBuffer(size_t /* numBytes */) { return NULL; }
+
+    /**
+     * Called once for each non-NULL obtainOutputBuffer(), when the data burst is complete.
+     * numBytes is zero if the burst was discarded, for example by reset().
+     * @return number of bytes written or negative error
+     */
+    virtual ssize_t releaseOutputBuffer(size_t numBytes) { return numBytes; }
+
     /**
      * Get ratio of the encoded data burst sample rate to the encoded rate.
      * For example, EAC3 data bursts are 4X the encoded rate.
@@ -81,12 +114,30 @@ public:
      */
     void reset();
 
+    /**
+     * @return counters of the encoder activity
+     */
+    Stats getStats() const;
+
+    /**
+     * Print the state and counters of the encoder, for dumpsys.
+     */
+    void dump(int fd) const;
+
+    // Burst preamble sync words, also recognized by SPDIFDecoder.
+    static const unsigned short kSPDIFSync1; // Pa
+    static const unsigned short kSPDIFSync2; // Pb
+
 protected:
     void   clearBurstBuffer();
     void   writeBurstBufferShorts(const uint16_t* buffer, size_t numBytes);
     void   writeBurstBufferBytes(const uint8_t* buffer, size_t numBytes);
+    void   writeBurstBufferZeros(size_t numBytes);
+    void   writePayloadBytes(const uint8_t* buffer, size_t numBytes);
+    void   padMATFrame(size_t position);
     void   sendZeroPad();
     void   flushBurstBuffer();
+    void   endBurst();
     void   startDataBurst();
     size_t startSyncFrame();
 
@@ -96,17 +147,17 @@ protected:
     uint32_t  mSampleRate;
     size_t    mFrameSize;   // size of sync frame in bytes
     uint16_t *mBurstBuffer; // ALSA wants to get SPDIF data as shorts.
+    uint16_t *mBurst;       // burst being assembled, mBurstBuffer or from obtainOutputBuffer()
     size_t    mBurstBufferSizeBytes;
     uint32_t  mRateMultiplier;
     uint32_t  mBurstFrames;
     size_t    mByteCursor;  // cursor into data burst
     int       mBitstreamNumber;
     size_t    mPayloadBytesPending; // number of bytes needed to finish burst
+    uint32_t  mFramesInBurst; // number of sync frames started in the current burst
+    Stats     mStats;
     // state variable, true if scanning for start of frame
     bool      mScanning;
-
-    static const unsigned short kSPDIFSync1; // Pa
-    static const unsigned short kSPDIFSync2; // Pb
 };
 
 }  // namespace android
@@ -0,0 +1,134 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_AUDIO_TASK_POOL_H
+#define ANDROID_AUDIO_TASK_POOL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/cdefs.h>
+#include <system/audio.h>
+
+/** \cond */
+__BEGIN_DECLS
+/** \endcond */
+
+/**
+ * Pool of worker threads splitting large offline jobs, such as file conversion or bulk
+ * FFT analysis, across cores.  Each thread starts with an equal share of a job, and a thread
+ * which runs out of work steals half of the remaining work of another one, so that the job
+ * still finishes together on cores of different speeds.
+ *
+ * The pool is meant for offline processing: it allocates, blocks and wakes threads,
+ * so it must not be used from real-time threads.  The real-time APIs of audio_utils stay
+ * single-threaded.
+ */
+struct audio_utils_task_pool;
+
+/** Which cores the worker threads run on */
+enum audio_utils_task_pool_placement {
+    /** All cores */
+    AUDIO_UTILS_TASK_POOL_PLACEMENT_ANY = 0,
+    /**
+     * The cores with the highest maximum frequency, e.g. the big cores of a big.LITTLE system.
+     * All cores if they have the same maximum frequency, or if it is unknown.
+     */
+    AUDIO_UTILS_TASK_POOL_PLACEMENT_BIG = 1,
+    /** The other cores, e.g. the LITTLE cores, or all cores as for _BIG if there are none. */
+    AUDIO_UTILS_TASK_POOL_PLACEMENT_LITTLE = 2,
+};
+
+/**
+ * Parameters of audio_utils_task_pool_create().
+ * Zero-initialize this structure before setting fields, so that any fields not set by the caller
+ * keep their default behavior.
+ */
+struct audio_utils_task_pool_config {
+    uint32_t thread_count;      // number of worker threads, or 0 for one per selected core
+                                // except the one of the calling thread
+    enum audio_utils_task_pool_placement placement; // cores to run the worker threads on
+    bool pin_threads;           // pin each worker thread to one of the selected cores,
+                                // instead of letting it run on any of them
+};
+
+/**
+ * Create a pool and its worker threads.
+ *
+ *  \param config Parameters, or NULL for the defaults.
+ *
+ * \return the pool, or NULL if memory allocation or thread creation failed.
+ */
+struct audio_utils_task_pool *audio_utils_task_pool_create(
+        const struct audio_utils_task_pool_config *config);
+
+/** Stop the worker threads and release a pool; NULL is ignored. */
+void audio_utils_task_pool_destroy(struct audio_utils_task_pool *pool);
+
+/** Return the number of worker threads of a pool, not counting the calling thread. */
+uint32_t audio_utils_task_pool_thread_count(const struct audio_utils_task_pool *pool);
+
+/** Process the items from begin to end - 1 of a job, with the argument of the job. */
+typedef void (*audio_utils_task_fn)(void *arg, size_t begin, size_t end);
+
+/**
+ * Process count items, split in ranges of at most grain items given to fn by the worker threads
+ * and the calling thread, and return when all are processed.  fn must be safe to call
+ * concurrently on distinct ranges.  Calls from several threads are run one after the other.
+ * With a NULL pool or a pool without worker threads, or if count <= grain, fn is called once
+ * from the calling thread.
+ *
+ *  \param pool  The pool, or NULL.
+ *  \param count Number of items.
+ *  \param grain Largest number of items per call to fn, > 0.
+ *  \param fn    Function processing a range of items.
+ *  \param arg   Argument passed to fn.
+ */
+void audio_utils_task_pool_parallel_for(struct audio_utils_task_pool *pool, size_t count,
+        size_t grain, audio_utils_task_fn fn, void *arg);
+
+/** Same as memcpy_by_audio_format() of <audio_utils/format.h>, split across the pool.
+ * The conversion is done from the calling thread alone if dst and src overlap.
+ */
+void audio_utils_task_pool_memcpy_by_audio_format(struct audio_utils_task_pool *pool,
+        void *dst, audio_format_t dst_format,
+        const void *src, audio_format_t src_format, size_t count);
+
+struct fixed_fft_plan;
+struct fft_float_plan;
+
+/** Same as fixed_fft_real_batch() of <audio_utils/fixedfft.h>, with the frames split across the
+ * pool. */
+void audio_utils_task_pool_fixed_fft_real_batch(struct audio_utils_task_pool *pool,
+        const struct fixed_fft_plan *plan, int32_t *v, size_t count, size_t stride);
+
+/** Same as fft_float_complex_batch() of <audio_utils/fft.h>, with the frames split across the
+ * pool. */
+void audio_utils_task_pool_fft_float_complex_batch(struct audio_utils_task_pool *pool,
+        const struct fft_float_plan *plan, float *data, size_t count, size_t stride,
+        bool inverse);
+
+/** Same as fft_float_real_batch() of <audio_utils/fft.h>, with the frames split across the
+ * pool. */
+void audio_utils_task_pool_fft_float_real_batch(struct audio_utils_task_pool *pool,
+        const struct fft_float_plan *plan, float *data, size_t count, size_t stride,
+        bool inverse);
+
+/** \cond */
+__END_DECLS
+/** \endcond */
+
+#endif  // ANDROID_AUDIO_TASK_POOL_H
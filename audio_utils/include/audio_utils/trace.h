@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_AUDIO_TRACE_H
+#define ANDROID_AUDIO_TRACE_H
+
+#include <stdint.h>
+#include <sys/cdefs.h>
+
+/* Hot path trace points for the audio_utils library.
+ *
+ * Each thread records begin, end and counter events into its own ring buffer, without locks
+ * or system calls after the first event of the thread.  The rings of all threads can be
+ * dumped at any time, e.g. after a missed deadline, in systrace or in the JSON trace event
+ * format which both the systrace viewer and Perfetto import.
+ *
+ * The trace points in the library are compiled out unless it is built with
+ * -DAUDIO_UTILS_TRACE, see Android.mk.  The functions are always available, so that
+ * clients can record events of their own around the library calls and dump the rings.
+ */
+
+__BEGIN_DECLS
+
+/** Number of events kept per thread; older events are overwritten. */
+#define AUDIO_UTILS_TRACE_RING_EVENTS 2048
+
+/** Maximum number of threads with a ring at the same time; events of other threads are dropped. */
+#define AUDIO_UTILS_TRACE_MAX_THREADS 32
+
+/** Output formats of audio_utils_trace_dump() */
+enum audio_utils_trace_format {
+    AUDIO_UTILS_TRACE_FORMAT_SYSTRACE,  /* ftrace text of tracing_mark_write events */
+    AUDIO_UTILS_TRACE_FORMAT_JSON,      /* JSON trace event format */
+};
+
+/**
+ * Record the beginning of a slice on the calling thread.
+ *
+ *  \param name  Slice name, which must have static storage duration as it is not copied,
+ *               and must not contain '|', '"' or '\\'.
+ */
+void audio_utils_trace_begin(const char *name);
+
+/**
+ * Record the end of the innermost slice begun on the calling thread.
+ */
+void audio_utils_trace_end(void);
+
+/**
+ * Record the value of a counter, e.g. a buffer fill level, on the calling thread.
+ *
+ *  \param name  Counter name, with the same requirements as for audio_utils_trace_begin().
+ *  \param value Counter value
+ */
+void audio_utils_trace_counter(const char *name, int32_t value);
+
+/**
+ * Write the events of all threads to a file descriptor, in timestamp order.
+ * The events are still recorded while dumping, and the ones which are overwritten
+ * during the dump are left out, so it is safe to call at any time from any thread.
+ *
+ *  \param fd     File descriptor to write to
+ *  \param format Output format
+ *
+ * \return 0 on success, otherwise a negative errno.
+ */
+int audio_utils_trace_dump(int fd, enum audio_utils_trace_format format);
+
+/**
+ * Forget the events recorded so far by all threads.
+ */
+void audio_utils_trace_reset(void);
+
+/* For AUDIO_UTILS_TRACE_SCOPE, not for direct use */
+void audio_utils_trace_scope_end(int *scope);
+
+#ifdef AUDIO_UTILS_TRACE
+/** Record a slice from here to the end of the enclosing block. */
+#define AUDIO_UTILS_TRACE_SCOPE(name) \
+    int audio_utils_trace_scope_ __attribute__((cleanup(audio_utils_trace_scope_end), unused)) = \
+            (audio_utils_trace_begin(name), 0)
+/** Record the value of a counter. */
+#define AUDIO_UTILS_TRACE_COUNTER(name, value) audio_utils_trace_counter(name, (int32_t)(value))
+#else
+#define AUDIO_UTILS_TRACE_SCOPE(name) do { } while (0)
+#define AUDIO_UTILS_TRACE_COUNTER(name, value) do { } while (0)
+#endif
+
+__END_DECLS
+
+#endif // ANDROID_AUDIO_TRACE_H
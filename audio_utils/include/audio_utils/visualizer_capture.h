@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_AUDIO_VISUALIZER_CAPTURE_H
+#define ANDROID_AUDIO_VISUALIZER_CAPTURE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/cdefs.h>
+
+/** \cond */
+__BEGIN_DECLS
+/** \endcond */
+
+/** Smallest and largest supported capture sizes, in samples */
+#define VISUALIZER_CAPTURE_MIN_SIZE 4
+#define VISUALIZER_CAPTURE_MAX_SIZE 1024
+
+/** Largest supported meter window, in samples */
+#define VISUALIZER_CAPTURE_MAX_METER_WINDOW 65536
+
+/** Level reported for silence, in millibels */
+#define VISUALIZER_CAPTURE_SILENCE_MB (-9600)
+
+/**
+ * Streaming analyzer for the visualizer effect contract of <audio_effects/effect_visualizer.h>.
+ * Each write downmixes the audio to mono into a ring of recent samples, and updates the peak
+ * and RMS of the meter window incrementally, at a constant amortized cost per sample.
+ * Waveforms and FFTs are only computed when a capture is requested, the FFT with a fixed_fft_plan
+ * created once with the analyzer, so that always-on meters cost next to nothing.
+ *
+ * An analyzer is not thread safe: writes and captures must be serialized by the caller,
+ * as the visualizer effect does for its process and command calls.
+ */
+struct visualizer_capture;
+
+/**
+ * Create an analyzer.  This allocates memory and the FFT plan, so it should be done
+ * outside of any real-time thread.
+ *
+ *  \param capture_size Number of samples of each capture, a power of 2 between
+ *                      VISUALIZER_CAPTURE_MIN_SIZE and VISUALIZER_CAPTURE_MAX_SIZE.
+ *  \param meter_window Number of most recent samples measured for the peak and RMS,
+ *                      between 1 and VISUALIZER_CAPTURE_MAX_METER_WINDOW.
+ *
+ * \return the analyzer, or NULL if a parameter is invalid or memory allocation failed.
+ */
+struct visualizer_capture *visualizer_capture_create(size_t capture_size, size_t meter_window);
+
+/** Release an analyzer returned by visualizer_capture_create(); NULL is ignored. */
+void visualizer_capture_destroy(struct visualizer_capture *capture);
+
+/** Forget all samples written, as after visualizer_capture_create(). */
+void visualizer_capture_reset(struct visualizer_capture *capture);
+
+/**
+ * Append frames to the analyzer, downmixed to mono by averaging the channels.
+ *
+ *  \param capture       The analyzer.
+ *  \param buffer        Interleaved frames of 16-bit samples.
+ *  \param frames        Number of frames.
+ *  \param channel_count Number of channels per frame, >= 1.
+ */
+void visualizer_capture_write(struct visualizer_capture *capture, const int16_t *buffer,
+        size_t frames, uint32_t channel_count);
+
+/**
+ * Return the peak and RMS levels of the meter window, in millibels relative to full scale as for
+ * VISUALIZER_CMD_MEASURE, or VISUALIZER_CAPTURE_SILENCE_MB for silence.  Before meter_window
+ * samples have been written, the levels are those of the samples written so far.
+ * Either pointer may be NULL.
+ */
+void visualizer_capture_measure(const struct visualizer_capture *capture, int32_t *peak_mb,
+        int32_t *rms_mb);
+
+/**
+ * Copy the latest capture_size samples, oldest first, in the 8-bit unsigned format of
+ * VISUALIZER_CMD_CAPTURE (0 = 0x80).  Silence is returned for samples not written yet.
+ *
+ *  \param capture  The analyzer.
+ *  \param waveform capture_size bytes.
+ */
+void visualizer_capture_waveform(const struct visualizer_capture *capture, uint8_t *waveform);
+
+/**
+ * Compute the FFT of the latest capture_size samples, in the format of
+ * android.media.audiofx.Visualizer.getFft(): the real and imaginary parts of capture_size / 2
+ * bins as signed bytes, except that fft[1] holds the real part of the bin at half the capture rate.
+ * The transform is computed from the 16-bit samples, so it is more precise than one computed from
+ * the 8-bit waveform.
+ *
+ *  \param capture The analyzer.
+ *  \param fft     capture_size bytes.
+ */
+void visualizer_capture_fft(struct visualizer_capture *capture, int8_t *fft);
+
+/** \cond */
+__END_DECLS
+/** \endcond */
+
+#endif  // ANDROID_AUDIO_VISUALIZER_CAPTURE_H
@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <audio_utils/kernels.h>
+#include "private/private.h"
+
+// Instantiations of the templated kernels for the C API.
+
+using namespace android::audio_utils;
+
+namespace {
+
+template <audio_format_t Format, size_t DstChannels, size_t SrcChannels>
+void remap_kernel(void *dst, const void *src, size_t count, const int8_t *idxary) {
+    remap<Format, DstChannels, SrcChannels>((sample_t<Format> *)dst,
+            (const sample_t<Format> *)src, count, idxary);
+}
+
+// Channel counts with a specialized remap: mono, stereo, quad, 5.1 and 7.1
+const int kChannelIndex[] = { -1, 0, 1, -1, 2, -1, 3, -1, 4 };
+const size_t kChannelCounts = 5;
+
+// Any format with the sample size will do, as remap only copies samples.
+#define REMAP_ROW(format, dst_channels) { \
+        remap_kernel<format, dst_channels, 1>, \
+        remap_kernel<format, dst_channels, 2>, \
+        remap_kernel<format, dst_channels, 4>, \
+        remap_kernel<format, dst_channels, 6>, \
+        remap_kernel<format, dst_channels, 8>, \
+    }
+
+#define REMAP_TABLE(format) { \
+        REMAP_ROW(format, 1), \
+        REMAP_ROW(format, 2), \
+        REMAP_ROW(format, 4), \
+        REMAP_ROW(format, 6), \
+        REMAP_ROW(format, 8), \
+    }
+
+// Indexed by [sample size / 2 - 1][dst channel index][src channel index]
+const remap_kernel_t kRemapKernels[2][kChannelCounts][kChannelCounts] = {
+    REMAP_TABLE(AUDIO_FORMAT_PCM_16_BIT),
+    REMAP_TABLE(AUDIO_FORMAT_PCM_32_BIT),
+};
+
+#undef REMAP_TABLE
+#undef REMAP_ROW
+
+} // namespace
+
+remap_kernel_t remap_kernel_get(uint32_t dst_channels, uint32_t src_channels,
+        size_t sample_size) {
+    const size_t kChannelIndexSize = sizeof(kChannelIndex) / sizeof(kChannelIndex[0]);
+    if (dst_channels >= kChannelIndexSize || src_channels >= kChannelIndexSize ||
+            (sample_size != sizeof(int16_t) && sample_size != sizeof(int32_t))) {
+        return NULL;
+    }
+    const int dst_index = kChannelIndex[dst_channels];
+    const int src_index = kChannelIndex[src_channels];
+    if (dst_index < 0 || src_index < 0) {
+        return NULL;
+    }
+    return kRemapKernels[sample_size / 2 - 1][dst_index][src_index];
+}
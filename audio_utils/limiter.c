@@ -16,6 +16,7 @@
 
 #include <math.h>
 #include <audio_utils/limiter.h>
+#include "private/private.h"
 
 #undef USE_ATAN_APPROXIMATION
 
@@ -67,3 +68,54 @@ float limiter(float in)
     }
     return out;
 }
+
+#ifndef USE_ATAN_APPROXIMATION
+#if defined(USE_NEON)
+// Same operations as the polynomial spline in limiter(), four samples at a time.
+static inline float32x4_t limiter_vector(float32x4_t in)
+{
+    const float32x4_t in_abs = vabsq_f32(in);
+    float32x4_t out = vaddq_f32(vmulq_f32(vdupq_n_f32(0.3431457505f), in_abs),
+            vdupq_n_f32(-1.798989873f));
+    out = vaddq_f32(vmulq_f32(out, in_abs), vdupq_n_f32(3.029437252f));
+    out = vaddq_f32(vmulq_f32(out, in_abs), vdupq_n_f32(-0.6568542495f));
+    // (float) M_SQRT2 is just below M_SQRT2, so <= matches the scalar < on the double
+    out = vbslq_f32(vcleq_f32(in_abs, vdupq_n_f32((float) M_SQRT2)), out, vdupq_n_f32(1.0f));
+    out = vbslq_f32(vdupq_n_u32(0x80000000), in, out);
+    return vbslq_f32(vcleq_f32(in_abs, vdupq_n_f32((float) M_SQRT1_2)), in, out);
+}
+#elif defined(USE_SSE2)
+static inline __m128 limiter_vector(__m128 in)
+{
+    const __m128 sign = _mm_set1_ps(-0.0f);
+    const __m128 in_abs = _mm_andnot_ps(sign, in);
+    __m128 out = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(0.3431457505f), in_abs),
+            _mm_set1_ps(-1.798989873f));
+    out = _mm_add_ps(_mm_mul_ps(out, in_abs), _mm_set1_ps(3.029437252f));
+    out = _mm_add_ps(_mm_mul_ps(out, in_abs), _mm_set1_ps(-0.6568542495f));
+    __m128 mask = _mm_cmple_ps(in_abs, _mm_set1_ps((float) M_SQRT2));
+    out = _mm_or_ps(_mm_and_ps(mask, out), _mm_andnot_ps(mask, _mm_set1_ps(1.0f)));
+    out = _mm_or_ps(out, _mm_and_ps(sign, in));
+    mask = _mm_cmple_ps(in_abs, _mm_set1_ps((float) M_SQRT1_2));
+    return _mm_or_ps(_mm_and_ps(mask, in), _mm_andnot_ps(mask, out));
+}
+#endif
+#endif // !USE_ATAN_APPROXIMATION
+
+void limiter_block(float *buffer, size_t count)
+{
+#ifndef USE_ATAN_APPROXIMATION
+#if defined(USE_NEON)
+    for (; count >= 4; count -= 4, buffer += 4) {
+        vst1q_f32(buffer, limiter_vector(vld1q_f32(buffer)));
+    }
+#elif defined(USE_SSE2)
+    for (; count >= 4; count -= 4, buffer += 4) {
+        _mm_storeu_ps(buffer, limiter_vector(_mm_loadu_ps(buffer)));
+    }
+#endif
+#endif
+    for (; count > 0; --count, ++buffer) {
+        *buffer = limiter(*buffer);
+    }
+}
@@ -14,13 +14,142 @@
  * limitations under the License.
  */
 
+#include <errno.h>
+#include <math.h>
+#include <stdbool.h>
+#include <string.h>
 #include <cutils/bitops.h>  /* for popcount() */
 #include <audio_utils/primitives.h>
 #include "private/private.h"
 
+/* The vectorized format converters are selected at build time by the target instruction set,
+ * see private.h.  Each one handles a multiple of the vector width, and leaves the remainder to
+ * the scalar loop.  The results are bit-exact with the scalar clamp and conversion helpers in
+ * primitives.h.
+ */
+
+/* The byte shuffle for channel remapping needs a table lookup instruction */
+#if defined(USE_NEON)
+#define USE_BYTE_SHUFFLE
+#elif defined(__SSSE3__)
+#include <tmmintrin.h>
+#define USE_BYTE_SHUFFLE
+#endif
+
+#if defined(USE_NEON) || defined(USE_SSE2)
+
+/* See clamp16_from_float() for the offset and limits */
+#define CLAMP16_OFFSET  ((float)(3 << (22 - 15)))
+#define CLAMP16_ZERO    (0x10f << 22)
+#define CLAMP16_LIMNEG  (CLAMP16_ZERO - 32768)
+#define CLAMP16_LIMPOS  (CLAMP16_ZERO + 32767)
+
+/* See clamp24_from_float() for the scale and limits */
+#define CLAMP24_SCALE   ((float)(1 << 23))
+#define CLAMP24_LIMPOS  (0x7fffff / CLAMP24_SCALE)
+#define CLAMP24_LIMNEG  (-0x800000 / CLAMP24_SCALE)
+
+#endif
+
+#if defined(USE_NEON)
+
+/* Vector equivalent of clamp16_from_float(), producing 8 samples */
+static inline int16x8_t clamp16x8_from_float32x4x2(float32x4_t flo, float32x4_t fhi)
+{
+    const float32x4_t offset = vdupq_n_f32(CLAMP16_OFFSET);
+    const int32x4_t limneg = vdupq_n_s32(CLAMP16_LIMNEG);
+    const int32x4_t limpos = vdupq_n_s32(CLAMP16_LIMPOS);
+    const int32x4_t zero = vdupq_n_s32(CLAMP16_ZERO);
+    int32x4_t lo = vreinterpretq_s32_f32(vaddq_f32(flo, offset));
+    int32x4_t hi = vreinterpretq_s32_f32(vaddq_f32(fhi, offset));
+    lo = vsubq_s32(vminq_s32(vmaxq_s32(lo, limneg), limpos), zero);
+    hi = vsubq_s32(vminq_s32(vmaxq_s32(hi, limneg), limpos), zero);
+    return vcombine_s16(vmovn_s32(lo), vmovn_s32(hi));
+}
+
+static inline int16x8_t clamp16x8_from_float(const float *src)
+{
+    return clamp16x8_from_float32x4x2(vld1q_f32(src), vld1q_f32(src + 4));
+}
+
+/* Vector equivalent of clamp24_from_float(), producing 4 samples */
+static inline int32x4_t clamp24x4_from_float(const float *src)
+{
+    const float32x4_t half = vdupq_n_f32(0.5f);
+    const uint32x4_t sign = vdupq_n_u32(0x80000000);
+    float32x4_t f = vld1q_f32(src);
+    f = vminq_f32(vmaxq_f32(f, vdupq_n_f32(CLAMP24_LIMNEG)), vdupq_n_f32(CLAMP24_LIMPOS));
+    f = vmulq_f32(f, vdupq_n_f32(CLAMP24_SCALE));
+    /* round to nearest, ties away from 0, then truncate;
+     * the addition is exact because |f| < 2^23.
+     */
+    float32x4_t bias = vreinterpretq_f32_u32(vorrq_u32(vreinterpretq_u32_f32(half),
+            vandq_u32(vreinterpretq_u32_f32(f), sign)));
+    return vcvtq_s32_f32(vaddq_f32(f, bias));
+}
+
+#elif defined(USE_SSE2)
+
+/* Vector equivalent of clamp16_from_float(), producing 8 samples */
+static inline __m128i clamp16x8_from_m128x2(__m128 flo, __m128 fhi)
+{
+    const __m128 offset = _mm_set1_ps(CLAMP16_OFFSET);
+    const __m128i limneg = _mm_set1_epi32(CLAMP16_LIMNEG);
+    const __m128i limpos = _mm_set1_epi32(CLAMP16_LIMPOS);
+    const __m128i zero = _mm_set1_epi32(CLAMP16_ZERO);
+    __m128i lo = _mm_castps_si128(_mm_add_ps(flo, offset));
+    __m128i hi = _mm_castps_si128(_mm_add_ps(fhi, offset));
+    /* SSE2 has no 32-bit integer min and max, so select with compare masks */
+    __m128i mask = _mm_cmplt_epi32(lo, limneg);
+    lo = _mm_or_si128(_mm_and_si128(mask, limneg), _mm_andnot_si128(mask, lo));
+    mask = _mm_cmpgt_epi32(lo, limpos);
+    lo = _mm_or_si128(_mm_and_si128(mask, limpos), _mm_andnot_si128(mask, lo));
+    mask = _mm_cmplt_epi32(hi, limneg);
+    hi = _mm_or_si128(_mm_and_si128(mask, limneg), _mm_andnot_si128(mask, hi));
+    mask = _mm_cmpgt_epi32(hi, limpos);
+    hi = _mm_or_si128(_mm_and_si128(mask, limpos), _mm_andnot_si128(mask, hi));
+    /* after the clamp the values are in 16-bit range, so the saturating pack is exact */
+    return _mm_packs_epi32(_mm_sub_epi32(lo, zero), _mm_sub_epi32(hi, zero));
+}
+
+static inline __m128i clamp16x8_from_float(const float *src)
+{
+    return clamp16x8_from_m128x2(_mm_loadu_ps(src), _mm_loadu_ps(src + 4));
+}
+
+/* Vector equivalent of clamp24_from_float(), producing 4 samples */
+static inline __m128i clamp24x4_from_float(const float *src)
+{
+    const __m128 sign = _mm_castsi128_ps(_mm_set1_epi32(0x80000000));
+    __m128 f = _mm_loadu_ps(src);
+    f = _mm_min_ps(_mm_max_ps(f, _mm_set1_ps(CLAMP24_LIMNEG)), _mm_set1_ps(CLAMP24_LIMPOS));
+    f = _mm_mul_ps(f, _mm_set1_ps(CLAMP24_SCALE));
+    /* round to nearest, ties away from 0, then truncate;
+     * the addition is exact because |f| < 2^23.
+     */
+    __m128 bias = _mm_or_ps(_mm_set1_ps(0.5f), _mm_and_ps(f, sign));
+    return _mm_cvttps_epi32(_mm_add_ps(f, bias));
+}
+
+#endif
+
 void ditherAndClamp(int32_t* out, const int32_t *sums, size_t c)
 {
     size_t i;
+    /* 4 pairs at a time; each block is loaded before it is stored, so in place works */
+#if defined(USE_NEON)
+    for (; c >= 4; c -= 4, sums += 8, out += 4) {
+        int16x8_t pairs = vcombine_s16(vqshrn_n_s32(vld1q_s32(sums), 12),
+                vqshrn_n_s32(vld1q_s32(sums + 4), 12));
+        vst1q_s32(out, vreinterpretq_s32_s16(pairs));
+    }
+#elif defined(USE_SSE2)
+    for (; c >= 4; c -= 4, sums += 8, out += 4) {
+        __m128i lo = _mm_srai_epi32(_mm_loadu_si128((const __m128i *) sums), 12);
+        __m128i hi = _mm_srai_epi32(_mm_loadu_si128((const __m128i *) (sums + 4)), 12);
+        _mm_storeu_si128((__m128i *) out, _mm_packs_epi32(lo, hi));
+    }
+#endif
     for (i=0 ; i<c ; i++) {
         int32_t l = *sums++;
         int32_t r = *sums++;
@@ -32,6 +161,166 @@ void ditherAndClamp(int32_t* out, const int32_t *sums, size_t c)
     }
 }
 
+/*
+ * The mix kernels vectorize over consecutive samples when 4 is a multiple of the channel
+ * count, so that each lane keeps the same channel, and otherwise over the channels of each
+ * frame, in up to 2 vectors of 4 channels.  The scalar loops complete the remainder.
+ */
+void mix_to_i32_from_i16_with_ramp(int32_t *sums, const int16_t *src, size_t channels,
+        size_t frames, int32_t *volumes, const int32_t *volume_incs)
+{
+    size_t f = 0;
+    size_t c;
+#if defined(USE_NEON) || defined(USE_SSE2)
+    if (channels == 1 || channels == 2 || channels == 4) {
+        const size_t step = 4 / channels;
+        int32_t vol[4], inc[4];
+        for (c = 0; c < 4; ++c) {
+            inc[c] = volume_incs[c % channels];
+            vol[c] = volumes[c % channels] + inc[c] * (int32_t) (c / channels);
+            inc[c] *= (int32_t) step;
+        }
+#if defined(USE_NEON)
+        int32x4_t v = vld1q_s32(vol);
+        const int32x4_t vinc = vld1q_s32(inc);
+        for (; f + step <= frames; f += step, src += 4, sums += 4) {
+            int16x4_t gain = vmovn_s32(vshrq_n_s32(v, 16));
+            vst1q_s32(sums, vmlal_s16(vld1q_s32(sums), vld1_s16(src), gain));
+            v = vaddq_s32(v, vinc);
+        }
+#else
+        __m128i v = _mm_loadu_si128((const __m128i *) vol);
+        const __m128i vinc = _mm_loadu_si128((const __m128i *) inc);
+        const __m128i zero = _mm_setzero_si128();
+        for (; f + step <= frames; f += step, src += 4, sums += 4) {
+            /* 16-bit terms in the low half of each 32-bit lane, so madd is a plain multiply */
+            __m128i in = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i *) src), zero);
+            __m128i acc = _mm_loadu_si128((const __m128i *) sums);
+            acc = _mm_add_epi32(acc, _mm_madd_epi16(in, _mm_srli_epi32(v, 16)));
+            _mm_storeu_si128((__m128i *) sums, acc);
+            v = _mm_add_epi32(v, vinc);
+        }
+#endif
+    } else if (channels > 4 && channels <= 8) {
+        const size_t vectors = channels / 4;
+#if defined(USE_NEON)
+        int32x4_t v[2], vinc[2];
+        for (size_t i = 0; i < vectors; ++i) {
+            v[i] = vld1q_s32(volumes + 4 * i);
+            vinc[i] = vld1q_s32(volume_incs + 4 * i);
+        }
+#else
+        __m128i v[2], vinc[2];
+        const __m128i zero = _mm_setzero_si128();
+        for (size_t i = 0; i < vectors; ++i) {
+            v[i] = _mm_loadu_si128((const __m128i *) (volumes + 4 * i));
+            vinc[i] = _mm_loadu_si128((const __m128i *) (volume_incs + 4 * i));
+        }
+#endif
+        for (; f < frames; ++f, src += channels, sums += channels) {
+            for (size_t i = 0; i < vectors; ++i) {
+#if defined(USE_NEON)
+                int16x4_t gain = vmovn_s32(vshrq_n_s32(v[i], 16));
+                vst1q_s32(sums + 4 * i,
+                        vmlal_s16(vld1q_s32(sums + 4 * i), vld1_s16(src + 4 * i), gain));
+                v[i] = vaddq_s32(v[i], vinc[i]);
+#else
+                __m128i in = _mm_unpacklo_epi16(
+                        _mm_loadl_epi64((const __m128i *) (src + 4 * i)), zero);
+                __m128i acc = _mm_loadu_si128((const __m128i *) (sums + 4 * i));
+                acc = _mm_add_epi32(acc, _mm_madd_epi16(in, _mm_srli_epi32(v[i], 16)));
+                _mm_storeu_si128((__m128i *) (sums + 4 * i), acc);
+                v[i] = _mm_add_epi32(v[i], vinc[i]);
+#endif
+            }
+            for (c = 4 * vectors; c < channels; ++c) {
+                const int32_t volume = volumes[c] + volume_incs[c] * (int32_t) f;
+                sums[c] = mulAdd(src[c], volume >> 16, sums[c]);
+            }
+        }
+    }
+#endif
+    for (; f < frames; ++f) {
+        for (c = 0; c < channels; ++c) {
+            const int32_t volume = volumes[c] + volume_incs[c] * (int32_t) f;
+            *sums = mulAdd(*src++, volume >> 16, *sums);
+            ++sums;
+        }
+    }
+    for (c = 0; c < channels; ++c) {
+        volumes[c] += volume_incs[c] * (int32_t) frames;
+    }
+}
+
+void mix_to_float_from_float_with_ramp(float *sums, const float *src, size_t channels,
+        size_t frames, float *volumes, const float *volume_incs)
+{
+    size_t f = 0;
+    size_t c;
+#if defined(USE_NEON) || defined(USE_SSE2)
+    if (channels == 1 || channels == 2 || channels == 4) {
+        const size_t step = 4 / channels;
+        float vol[4], inc[4], frame[4];
+        for (c = 0; c < 4; ++c) {
+            vol[c] = volumes[c % channels];
+            inc[c] = volume_incs[c % channels];
+            frame[c] = c / channels;
+        }
+        /* the frame index in float is exact, so the gains match the scalar loop */
+#if defined(USE_NEON)
+        const float32x4_t vvol = vld1q_f32(vol);
+        const float32x4_t vinc = vld1q_f32(inc);
+        const float32x4_t vstep = vdupq_n_f32(step);
+        float32x4_t vframe = vld1q_f32(frame);
+        for (; f + step <= frames; f += step, src += 4, sums += 4) {
+            float32x4_t gain = vaddq_f32(vvol, vmulq_f32(vinc, vframe));
+            vst1q_f32(sums, vaddq_f32(vld1q_f32(sums), vmulq_f32(vld1q_f32(src), gain)));
+            vframe = vaddq_f32(vframe, vstep);
+        }
+#else
+        const __m128 vvol = _mm_loadu_ps(vol);
+        const __m128 vinc = _mm_loadu_ps(inc);
+        const __m128 vstep = _mm_set1_ps(step);
+        __m128 vframe = _mm_loadu_ps(frame);
+        for (; f + step <= frames; f += step, src += 4, sums += 4) {
+            __m128 gain = _mm_add_ps(vvol, _mm_mul_ps(vinc, vframe));
+            _mm_storeu_ps(sums, _mm_add_ps(_mm_loadu_ps(sums),
+                    _mm_mul_ps(_mm_loadu_ps(src), gain)));
+            vframe = _mm_add_ps(vframe, vstep);
+        }
+#endif
+    } else if (channels > 4 && channels <= 8) {
+        const size_t vectors = channels / 4;
+        for (; f < frames; ++f, src += channels, sums += channels) {
+            for (size_t i = 0; i < vectors; ++i) {
+#if defined(USE_NEON)
+                float32x4_t gain = vaddq_f32(vld1q_f32(volumes + 4 * i),
+                        vmulq_f32(vld1q_f32(volume_incs + 4 * i), vdupq_n_f32(f)));
+                vst1q_f32(sums + 4 * i, vaddq_f32(vld1q_f32(sums + 4 * i),
+                        vmulq_f32(vld1q_f32(src + 4 * i), gain)));
+#else
+                __m128 gain = _mm_add_ps(_mm_loadu_ps(volumes + 4 * i),
+                        _mm_mul_ps(_mm_loadu_ps(volume_incs + 4 * i), _mm_set1_ps(f)));
+                _mm_storeu_ps(sums + 4 * i, _mm_add_ps(_mm_loadu_ps(sums + 4 * i),
+                        _mm_mul_ps(_mm_loadu_ps(src + 4 * i), gain)));
+#endif
+            }
+            for (c = 4 * vectors; c < channels; ++c) {
+                sums[c] += src[c] * (volumes[c] + volume_incs[c] * f);
+            }
+        }
+    }
+#endif
+    for (; f < frames; ++f) {
+        for (c = 0; c < channels; ++c) {
+            *sums++ += *src++ * (volumes[c] + volume_incs[c] * f);
+        }
+    }
+    for (c = 0; c < channels; ++c) {
+        volumes[c] += volume_incs[c] * frames;
+    }
+}
+
 void memcpy_to_i16_from_u8(int16_t *dst, const uint8_t *src, size_t count)
 {
     dst += count;
@@ -64,6 +353,15 @@ void memcpy_to_i16_from_i32(int16_t *dst, const int32_t *src, size_t count)
 
 void memcpy_to_i16_from_float(int16_t *dst, const float *src, size_t count)
 {
+#if defined(USE_NEON)
+    for (; count >= 8; count -= 8, src += 8, dst += 8) {
+        vst1q_s16(dst, clamp16x8_from_float(src));
+    }
+#elif defined(USE_SSE2)
+    for (; count >= 8; count -= 8, src += 8, dst += 8) {
+        _mm_storeu_si128((__m128i *) dst, clamp16x8_from_float(src));
+    }
+#endif
     while (count--) {
         *dst++ = clamp16_from_float(*src++);
     }
@@ -78,11 +376,344 @@ void memcpy_to_float_from_q4_27(float *dst, const int32_t *src, size_t count)
 
 void memcpy_to_float_from_i16(float *dst, const int16_t *src, size_t count)
 {
+    /* the scaling is exact, see float_from_i16() */
+#if defined(USE_NEON)
+    const float32x4_t scale = vdupq_n_f32(1. / (float)(1UL << 15));
+    for (; count >= 8; count -= 8, src += 8, dst += 8) {
+        int16x8_t ival = vld1q_s16(src);
+        vst1q_f32(dst, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(ival))), scale));
+        vst1q_f32(dst + 4, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(ival))), scale));
+    }
+#elif defined(USE_SSE2)
+    const __m128 scale = _mm_set1_ps(1. / (float)(1UL << 15));
+    for (; count >= 8; count -= 8, src += 8, dst += 8) {
+        __m128i ival = _mm_loadu_si128((const __m128i *) src);
+        /* sign extend by unpacking into the upper half of each 32-bit lane */
+        __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(ival, ival), 16);
+        __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(ival, ival), 16);
+        _mm_storeu_ps(dst, _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+        _mm_storeu_ps(dst + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+    }
+#endif
     while (count--) {
         *dst++ = float_from_i16(*src++);
     }
 }
 
+/* Common implementation of the fused float to i16 with gain, where even samples have gain0
+ * and odd samples have gain1.  The vector width is a multiple of 2, so the lanes alternate too.
+ */
+static void memcpy_to_i16_from_float_with_gain2(int16_t *dst, const float *src, size_t count,
+        float gain0, float gain1)
+{
+#if defined(USE_NEON)
+    const float32_t gains[4] = {gain0, gain1, gain0, gain1};
+    const float32x4_t gain = vld1q_f32(gains);
+    for (; count >= 8; count -= 8, src += 8, dst += 8) {
+        vst1q_s16(dst, clamp16x8_from_float32x4x2(vmulq_f32(vld1q_f32(src), gain),
+                vmulq_f32(vld1q_f32(src + 4), gain)));
+    }
+#elif defined(USE_SSE2)
+    const __m128 gain = _mm_setr_ps(gain0, gain1, gain0, gain1);
+    for (; count >= 8; count -= 8, src += 8, dst += 8) {
+        _mm_storeu_si128((__m128i *) dst, clamp16x8_from_m128x2(
+                _mm_mul_ps(_mm_loadu_ps(src), gain), _mm_mul_ps(_mm_loadu_ps(src + 4), gain)));
+    }
+#endif
+    for (; count >= 2; count -= 2) {
+        *dst++ = clamp16_from_float(*src++ * gain0);
+        *dst++ = clamp16_from_float(*src++ * gain1);
+    }
+    if (count) {
+        *dst = clamp16_from_float(*src * gain0);
+    }
+}
+
+/* Common implementation of the fused i16 to float with gain, as above */
+static void memcpy_to_float_from_i16_with_gain2(float *dst, const int16_t *src, size_t count,
+        float gain0, float gain1)
+{
+    /* float_from_i16() scaling is exact, so scale and gain can't be combined into one multiply */
+#if defined(USE_NEON)
+    const float32x4_t scale = vdupq_n_f32(1. / (float)(1UL << 15));
+    const float32_t gains[4] = {gain0, gain1, gain0, gain1};
+    const float32x4_t gain = vld1q_f32(gains);
+    for (; count >= 8; count -= 8, src += 8, dst += 8) {
+        int16x8_t ival = vld1q_s16(src);
+        vst1q_f32(dst, vmulq_f32(vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(ival))),
+                scale), gain));
+        vst1q_f32(dst + 4, vmulq_f32(vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(ival))),
+                scale), gain));
+    }
+#elif defined(USE_SSE2)
+    const __m128 scale = _mm_set1_ps(1. / (float)(1UL << 15));
+    const __m128 gain = _mm_setr_ps(gain0, gain1, gain0, gain1);
+    for (; count >= 8; count -= 8, src += 8, dst += 8) {
+        __m128i ival = _mm_loadu_si128((const __m128i *) src);
+        __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(ival, ival), 16);
+        __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(ival, ival), 16);
+        _mm_storeu_ps(dst, _mm_mul_ps(_mm_mul_ps(_mm_cvtepi32_ps(lo), scale), gain));
+        _mm_storeu_ps(dst + 4, _mm_mul_ps(_mm_mul_ps(_mm_cvtepi32_ps(hi), scale), gain));
+    }
+#endif
+    for (; count >= 2; count -= 2) {
+        *dst++ = float_from_i16(*src++) * gain0;
+        *dst++ = float_from_i16(*src++) * gain1;
+    }
+    if (count) {
+        *dst = float_from_i16(*src) * gain0;
+    }
+}
+
+void memcpy_to_i16_from_float_with_gain(int16_t *dst, const float *src, size_t count,
+        float gain)
+{
+    memcpy_to_i16_from_float_with_gain2(dst, src, count, gain, gain);
+}
+
+void memcpy_to_float_from_i16_with_gain(float *dst, const int16_t *src, size_t count,
+        float gain)
+{
+    memcpy_to_float_from_i16_with_gain2(dst, src, count, gain, gain);
+}
+
+void memcpy_to_i16_from_float_with_stereo_gain(int16_t *dst, const float *src, size_t frames,
+        float gainL, float gainR)
+{
+    memcpy_to_i16_from_float_with_gain2(dst, src, frames * 2, gainL, gainR);
+}
+
+void memcpy_to_float_from_i16_with_stereo_gain(float *dst, const int16_t *src, size_t frames,
+        float gainL, float gainR)
+{
+    memcpy_to_float_from_i16_with_gain2(dst, src, frames * 2, gainL, gainR);
+}
+
+/*
+ * Linear stereo ramp of the fused gain routines.  The gain of frame i is gain + step * i,
+ * computed from the frame index instead of by repeated addition, so that it does not drift
+ * and the vector loops, which take 4 frames at a time, give the same gains as the scalar loops.
+ */
+struct stereo_ramp {
+    float gainL;
+    float gainR;
+    float stepL;
+    float stepR;
+};
+
+static inline void stereo_ramp_init(struct stereo_ramp *ramp, size_t frames,
+        gain_minifloat_packed_t from, gain_minifloat_packed_t to)
+{
+    ramp->gainL = float_from_gain(gain_minifloat_unpack_left(from));
+    ramp->gainR = float_from_gain(gain_minifloat_unpack_right(from));
+    ramp->stepL = (float_from_gain(gain_minifloat_unpack_left(to)) - ramp->gainL) / frames;
+    ramp->stepR = (float_from_gain(gain_minifloat_unpack_right(to)) - ramp->gainR) / frames;
+}
+
+#if defined(USE_NEON)
+
+/* Gains of frames i to i + 3 of the ramp, as vectors of L R L R */
+struct stereo_ramp_vector {
+    float32x4_t gain;
+    float32x4_t step;
+    float32x4_t index;  /* frame offset of each lane, 0 0 1 1 */
+};
+
+static inline void stereo_ramp_vector_init(struct stereo_ramp_vector *v,
+        const struct stereo_ramp *ramp)
+{
+    const float32_t gains[4] = {ramp->gainL, ramp->gainR, ramp->gainL, ramp->gainR};
+    const float32_t steps[4] = {ramp->stepL, ramp->stepR, ramp->stepL, ramp->stepR};
+    const float32_t index[4] = {0.f, 0.f, 1.f, 1.f};
+    v->gain = vld1q_f32(gains);
+    v->step = vld1q_f32(steps);
+    v->index = vld1q_f32(index);
+}
+
+static inline void stereo_ramp_vector_gains(const struct stereo_ramp_vector *v, size_t i,
+        float32x4_t *lo, float32x4_t *hi)
+{
+    const float32x4_t index = vaddq_f32(v->index, vdupq_n_f32(i));
+    *lo = vaddq_f32(v->gain, vmulq_f32(v->step, index));
+    *hi = vaddq_f32(v->gain, vmulq_f32(v->step, vaddq_f32(index, vdupq_n_f32(2.f))));
+}
+
+/* Converts 8 samples from i16 to float, exactly as float_from_i16() */
+static inline void float32x4x2_from_i16(const int16_t *src, float32x4_t *lo, float32x4_t *hi)
+{
+    const float32x4_t scale = vdupq_n_f32(1. / (float)(1UL << 15));
+    const int16x8_t ival = vld1q_s16(src);
+    *lo = vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(ival))), scale);
+    *hi = vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(ival))), scale);
+}
+
+#elif defined(USE_SSE2)
+
+/* Gains of frames i to i + 3 of the ramp, as vectors of L R L R */
+struct stereo_ramp_vector {
+    __m128 gain;
+    __m128 step;
+    __m128 index;   /* frame offset of each lane, 0 0 1 1 */
+};
+
+static inline void stereo_ramp_vector_init(struct stereo_ramp_vector *v,
+        const struct stereo_ramp *ramp)
+{
+    v->gain = _mm_setr_ps(ramp->gainL, ramp->gainR, ramp->gainL, ramp->gainR);
+    v->step = _mm_setr_ps(ramp->stepL, ramp->stepR, ramp->stepL, ramp->stepR);
+    v->index = _mm_setr_ps(0.f, 0.f, 1.f, 1.f);
+}
+
+static inline void stereo_ramp_vector_gains(const struct stereo_ramp_vector *v, size_t i,
+        __m128 *lo, __m128 *hi)
+{
+    const __m128 index = _mm_add_ps(v->index, _mm_set1_ps(i));
+    *lo = _mm_add_ps(v->gain, _mm_mul_ps(v->step, index));
+    *hi = _mm_add_ps(v->gain, _mm_mul_ps(v->step, _mm_add_ps(index, _mm_set1_ps(2.f))));
+}
+
+/* Converts 8 samples from i16 to float, exactly as float_from_i16() */
+static inline void m128x2_from_i16(const int16_t *src, __m128 *lo, __m128 *hi)
+{
+    const __m128 scale = _mm_set1_ps(1. / (float)(1UL << 15));
+    const __m128i ival = _mm_loadu_si128((const __m128i *) src);
+    *lo = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(ival, ival), 16)), scale);
+    *hi = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(ival, ival), 16)), scale);
+}
+
+#endif
+
+void memcpy_to_i16_from_float_with_stereo_ramp(int16_t *dst, const float *src, size_t frames,
+        gain_minifloat_packed_t from, gain_minifloat_packed_t to)
+{
+    if (frames == 0) {
+        return;
+    }
+    struct stereo_ramp ramp;
+    stereo_ramp_init(&ramp, frames, from, to);
+    size_t i = 0;
+#if defined(USE_NEON) || defined(USE_SSE2)
+    struct stereo_ramp_vector v;
+    stereo_ramp_vector_init(&v, &ramp);
+    for (; i + 4 <= frames; i += 4, src += 8, dst += 8) {
+#if defined(USE_NEON)
+        float32x4_t lo, hi;
+        stereo_ramp_vector_gains(&v, i, &lo, &hi);
+        vst1q_s16(dst, clamp16x8_from_float32x4x2(vmulq_f32(vld1q_f32(src), lo),
+                vmulq_f32(vld1q_f32(src + 4), hi)));
+#else
+        __m128 lo, hi;
+        stereo_ramp_vector_gains(&v, i, &lo, &hi);
+        _mm_storeu_si128((__m128i *) dst, clamp16x8_from_m128x2(
+                _mm_mul_ps(_mm_loadu_ps(src), lo), _mm_mul_ps(_mm_loadu_ps(src + 4), hi)));
+#endif
+    }
+#endif
+    for (; i < frames; i++) {
+        *dst++ = clamp16_from_float(*src++ * (ramp.gainL + ramp.stepL * i));
+        *dst++ = clamp16_from_float(*src++ * (ramp.gainR + ramp.stepR * i));
+    }
+}
+
+void memcpy_to_float_from_i16_with_stereo_ramp(float *dst, const int16_t *src, size_t frames,
+        gain_minifloat_packed_t from, gain_minifloat_packed_t to)
+{
+    if (frames == 0) {
+        return;
+    }
+    struct stereo_ramp ramp;
+    stereo_ramp_init(&ramp, frames, from, to);
+    size_t i = 0;
+#if defined(USE_NEON) || defined(USE_SSE2)
+    struct stereo_ramp_vector v;
+    stereo_ramp_vector_init(&v, &ramp);
+    for (; i + 4 <= frames; i += 4, src += 8, dst += 8) {
+#if defined(USE_NEON)
+        float32x4_t lo, hi, flo, fhi;
+        stereo_ramp_vector_gains(&v, i, &lo, &hi);
+        float32x4x2_from_i16(src, &flo, &fhi);
+        vst1q_f32(dst, vmulq_f32(flo, lo));
+        vst1q_f32(dst + 4, vmulq_f32(fhi, hi));
+#else
+        __m128 lo, hi, flo, fhi;
+        stereo_ramp_vector_gains(&v, i, &lo, &hi);
+        m128x2_from_i16(src, &flo, &fhi);
+        _mm_storeu_ps(dst, _mm_mul_ps(flo, lo));
+        _mm_storeu_ps(dst + 4, _mm_mul_ps(fhi, hi));
+#endif
+    }
+#endif
+    for (; i < frames; i++) {
+        *dst++ = float_from_i16(*src++) * (ramp.gainL + ramp.stepL * i);
+        *dst++ = float_from_i16(*src++) * (ramp.gainR + ramp.stepR * i);
+    }
+}
+
+void memcpy_to_i16_from_i16_with_stereo_ramp(int16_t *dst, const int16_t *src, size_t frames,
+        gain_minifloat_packed_t from, gain_minifloat_packed_t to)
+{
+    if (frames == 0) {
+        return;
+    }
+    struct stereo_ramp ramp;
+    stereo_ramp_init(&ramp, frames, from, to);
+    size_t i = 0;
+#if defined(USE_NEON) || defined(USE_SSE2)
+    struct stereo_ramp_vector v;
+    stereo_ramp_vector_init(&v, &ramp);
+    for (; i + 4 <= frames; i += 4, src += 8, dst += 8) {
+#if defined(USE_NEON)
+        float32x4_t lo, hi, flo, fhi;
+        stereo_ramp_vector_gains(&v, i, &lo, &hi);
+        float32x4x2_from_i16(src, &flo, &fhi);
+        vst1q_s16(dst, clamp16x8_from_float32x4x2(vmulq_f32(flo, lo), vmulq_f32(fhi, hi)));
+#else
+        __m128 lo, hi, flo, fhi;
+        stereo_ramp_vector_gains(&v, i, &lo, &hi);
+        m128x2_from_i16(src, &flo, &fhi);
+        _mm_storeu_si128((__m128i *) dst,
+                clamp16x8_from_m128x2(_mm_mul_ps(flo, lo), _mm_mul_ps(fhi, hi)));
+#endif
+    }
+#endif
+    for (; i < frames; i++) {
+        *dst++ = clamp16_from_float(float_from_i16(*src++) * (ramp.gainL + ramp.stepL * i));
+        *dst++ = clamp16_from_float(float_from_i16(*src++) * (ramp.gainR + ramp.stepR * i));
+    }
+}
+
+void memcpy_to_float_from_float_with_stereo_ramp(float *dst, const float *src, size_t frames,
+        gain_minifloat_packed_t from, gain_minifloat_packed_t to)
+{
+    if (frames == 0) {
+        return;
+    }
+    struct stereo_ramp ramp;
+    stereo_ramp_init(&ramp, frames, from, to);
+    size_t i = 0;
+#if defined(USE_NEON) || defined(USE_SSE2)
+    struct stereo_ramp_vector v;
+    stereo_ramp_vector_init(&v, &ramp);
+    for (; i + 4 <= frames; i += 4, src += 8, dst += 8) {
+#if defined(USE_NEON)
+        float32x4_t lo, hi;
+        stereo_ramp_vector_gains(&v, i, &lo, &hi);
+        vst1q_f32(dst, vmulq_f32(vld1q_f32(src), lo));
+        vst1q_f32(dst + 4, vmulq_f32(vld1q_f32(src + 4), hi));
+#else
+        __m128 lo, hi;
+        stereo_ramp_vector_gains(&v, i, &lo, &hi);
+        _mm_storeu_ps(dst, _mm_mul_ps(_mm_loadu_ps(src), lo));
+        _mm_storeu_ps(dst + 4, _mm_mul_ps(_mm_loadu_ps(src + 4), hi));
+#endif
+    }
+#endif
+    for (; i < frames; i++) {
+        *dst++ = *src++ * (ramp.gainL + ramp.stepL * i);
+        *dst++ = *src++ * (ramp.gainR + ramp.stepR * i);
+    }
+}
+
 void memcpy_to_float_from_u8(float *dst, const uint8_t *src, size_t count)
 {
     while (count--) {
@@ -139,6 +770,29 @@ void memcpy_to_p24_from_i16(uint8_t *dst, const int16_t *src, size_t count)
 
 void memcpy_to_p24_from_float(uint8_t *dst, const float *src, size_t count)
 {
+#if defined(USE_NEON) || defined(USE_SSE2)
+    /* convert 4 samples at a time in vector registers, and pack through a small buffer */
+    for (; count >= 4; count -= 4, src += 4) {
+        int32_t ival[4];
+#if defined(USE_NEON)
+        vst1q_s32(ival, clamp24x4_from_float(src));
+#else
+        _mm_storeu_si128((__m128i *) ival, clamp24x4_from_float(src));
+#endif
+        int i;
+        for (i = 0; i < 4; i++) {
+#ifdef HAVE_BIG_ENDIAN
+            *dst++ = ival[i] >> 16;
+            *dst++ = ival[i] >> 8;
+            *dst++ = ival[i];
+#else
+            *dst++ = ival[i];
+            *dst++ = ival[i] >> 8;
+            *dst++ = ival[i] >> 16;
+#endif
+        }
+    }
+#endif
     while (count--) {
         int32_t ival = clamp24_from_float(*src++);
 
@@ -197,6 +851,15 @@ void memcpy_to_q8_23_from_i16(int32_t *dst, const int16_t *src, size_t count)
 
 void memcpy_to_q8_23_from_float_with_clamp(int32_t *dst, const float *src, size_t count)
 {
+#if defined(USE_NEON)
+    for (; count >= 4; count -= 4, src += 4, dst += 4) {
+        vst1q_s32(dst, clamp24x4_from_float(src));
+    }
+#elif defined(USE_SSE2)
+    for (; count >= 4; count -= 4, src += 4, dst += 4) {
+        _mm_storeu_si128((__m128i *) dst, clamp24x4_from_float(src));
+    }
+#endif
     while (count--) {
         *dst++ = clamp24_from_float(*src++);
     }
@@ -338,6 +1001,126 @@ size_t nonZeroStereo16(const int16_t *frames, size_t count)
     return nonZero;
 }
 
+/* The vector loops below skip silent samples 2 vectors at a time, and stop at the first block
+ * containing a sample above threshold.  The scalar loop then locates the sample within the block
+ * and also handles the remainder.  The result is converted from samples to frames at the end,
+ * so the channel count does not affect the vector loops.
+ */
+size_t find_non_silent_frame_i16(const int16_t *samples, size_t channels, size_t frames,
+        int16_t threshold)
+{
+    const size_t count = frames * channels;
+    size_t i = 0;
+#if defined(USE_NEON)
+    const int16x8_t hi = vdupq_n_s16(threshold);
+    const int16x8_t lo = vdupq_n_s16(-threshold);
+    for (; i + 16 <= count; i += 16) {
+        int16x8_t x0 = vld1q_s16(samples + i);
+        int16x8_t x1 = vld1q_s16(samples + i + 8);
+        uint16x8_t loud = vorrq_u16(vorrq_u16(vcgtq_s16(x0, hi), vcltq_s16(x0, lo)),
+                vorrq_u16(vcgtq_s16(x1, hi), vcltq_s16(x1, lo)));
+        uint32x2_t any = vreinterpret_u32_u16(
+                vorr_u16(vget_low_u16(loud), vget_high_u16(loud)));
+        if ((vget_lane_u32(any, 0) | vget_lane_u32(any, 1)) != 0) {
+            break;
+        }
+    }
+#elif defined(USE_SSE2)
+    const __m128i hi = _mm_set1_epi16(threshold);
+    const __m128i lo = _mm_set1_epi16(-threshold);
+    for (; i + 16 <= count; i += 16) {
+        __m128i x0 = _mm_loadu_si128((const __m128i *)(samples + i));
+        __m128i x1 = _mm_loadu_si128((const __m128i *)(samples + i + 8));
+        __m128i loud = _mm_or_si128(
+                _mm_or_si128(_mm_cmpgt_epi16(x0, hi), _mm_cmplt_epi16(x0, lo)),
+                _mm_or_si128(_mm_cmpgt_epi16(x1, hi), _mm_cmplt_epi16(x1, lo)));
+        if (_mm_movemask_epi8(loud) != 0) {
+            break;
+        }
+    }
+#endif
+    for (; i < count; i++) {
+        if (samples[i] > threshold || samples[i] < -threshold) {
+            return i / channels;
+        }
+    }
+    return frames;
+}
+
+size_t find_non_silent_frame_i32(const int32_t *samples, size_t channels, size_t frames,
+        int32_t threshold)
+{
+    const size_t count = frames * channels;
+    size_t i = 0;
+#if defined(USE_NEON)
+    const int32x4_t hi = vdupq_n_s32(threshold);
+    const int32x4_t lo = vdupq_n_s32(-threshold);
+    for (; i + 8 <= count; i += 8) {
+        int32x4_t x0 = vld1q_s32(samples + i);
+        int32x4_t x1 = vld1q_s32(samples + i + 4);
+        uint32x4_t loud = vorrq_u32(vorrq_u32(vcgtq_s32(x0, hi), vcltq_s32(x0, lo)),
+                vorrq_u32(vcgtq_s32(x1, hi), vcltq_s32(x1, lo)));
+        uint32x2_t any = vorr_u32(vget_low_u32(loud), vget_high_u32(loud));
+        if ((vget_lane_u32(any, 0) | vget_lane_u32(any, 1)) != 0) {
+            break;
+        }
+    }
+#elif defined(USE_SSE2)
+    const __m128i hi = _mm_set1_epi32(threshold);
+    const __m128i lo = _mm_set1_epi32(-threshold);
+    for (; i + 8 <= count; i += 8) {
+        __m128i x0 = _mm_loadu_si128((const __m128i *)(samples + i));
+        __m128i x1 = _mm_loadu_si128((const __m128i *)(samples + i + 4));
+        __m128i loud = _mm_or_si128(
+                _mm_or_si128(_mm_cmpgt_epi32(x0, hi), _mm_cmplt_epi32(x0, lo)),
+                _mm_or_si128(_mm_cmpgt_epi32(x1, hi), _mm_cmplt_epi32(x1, lo)));
+        if (_mm_movemask_epi8(loud) != 0) {
+            break;
+        }
+    }
+#endif
+    for (; i < count; i++) {
+        if (samples[i] > threshold || samples[i] < -threshold) {
+            return i / channels;
+        }
+    }
+    return frames;
+}
+
+size_t find_non_silent_frame_float(const float *samples, size_t channels, size_t frames,
+        float threshold)
+{
+    const size_t count = frames * channels;
+    size_t i = 0;
+#if defined(USE_NEON)
+    const float32x4_t thr = vdupq_n_f32(threshold);
+    for (; i + 8 <= count; i += 8) {
+        uint32x4_t loud = vorrq_u32(vcagtq_f32(vld1q_f32(samples + i), thr),
+                vcagtq_f32(vld1q_f32(samples + i + 4), thr));
+        uint32x2_t any = vorr_u32(vget_low_u32(loud), vget_high_u32(loud));
+        if ((vget_lane_u32(any, 0) | vget_lane_u32(any, 1)) != 0) {
+            break;
+        }
+    }
+#elif defined(USE_SSE2)
+    const __m128 thr = _mm_set1_ps(threshold);
+    const __m128 sign = _mm_set1_ps(-0.f);
+    for (; i + 8 <= count; i += 8) {
+        __m128 x0 = _mm_andnot_ps(sign, _mm_loadu_ps(samples + i));
+        __m128 x1 = _mm_andnot_ps(sign, _mm_loadu_ps(samples + i + 4));
+        if (_mm_movemask_ps(_mm_or_ps(_mm_cmpgt_ps(x0, thr), _mm_cmpgt_ps(x1, thr))) != 0) {
+            break;
+        }
+    }
+#endif
+    for (; i < count; i++) {
+        if (fabsf(samples[i]) > threshold) {
+            return i / channels;
+        }
+    }
+    return frames;
+}
+
 /*
  * C macro to do channel mask copying independent of dst/src sample type.
  * Don't pass in any expressions for the macro arguments here.
@@ -430,6 +1213,12 @@ void memcpy_by_index_array(void *dst, uint32_t dst_channels,
         const void *src, uint32_t src_channels,
         const int8_t *idxary, size_t sample_size, size_t count)
 {
+    /* the common channel counts have a kernel unrolled over the channels of the frame */
+    remap_kernel_t kernel = remap_kernel_get(dst_channels, src_channels, sample_size);
+    if (kernel != NULL) {
+        kernel(dst, src, count, idxary);
+        return;
+    }
     switch (sample_size) {
     case 1: {
         uint8_t *udst = (uint8_t*)dst;
@@ -524,3 +1313,143 @@ size_t memcpy_by_index_array_initialization_dst_index(int8_t *idxary, size_t idx
     }
     return dst_idx;
 }
+
+/* Values for memcpy_by_index_array_plan.kind */
+enum {
+    PLAN_KIND_GENERIC,      /* memcpy_by_index_array() */
+    PLAN_KIND_IDENTITY,     /* memcpy() of the whole buffer */
+    PLAN_KIND_RUN,          /* memcpy() of a run of source channels for each frame */
+    PLAN_KIND_ZERO,         /* memset() of the whole buffer */
+    PLAN_KIND_SHUFFLE,      /* vector byte shuffle for each frame */
+};
+
+int memcpy_by_index_array_plan_init(struct memcpy_by_index_array_plan *plan,
+        uint32_t dst_channels, uint32_t src_channels, const int8_t *idxary, size_t sample_size)
+{
+    if (plan == NULL || idxary == NULL ||
+            dst_channels == 0 || dst_channels > MEMCPY_BY_INDEX_ARRAY_PLAN_MAX_CHANNELS ||
+            src_channels == 0 || src_channels > MEMCPY_BY_INDEX_ARRAY_PLAN_MAX_CHANNELS ||
+            sample_size == 0 || sample_size > 4) {
+        return -EINVAL;
+    }
+    bool zero = true;
+    bool run = true;
+    uint32_t i;
+    for (i = 0; i < dst_channels; ++i) {
+        if (idxary[i] >= (int) src_channels) {
+            return -EINVAL;
+        }
+        if (idxary[i] >= 0) {
+            zero = false;
+        }
+        if (idxary[i] < 0 || idxary[i] != idxary[0] + (int) i) {
+            run = false;
+        }
+        plan->idxary[i] = idxary[i];
+    }
+    plan->dst_channels = dst_channels;
+    plan->src_channels = src_channels;
+    plan->sample_size = sample_size;
+    plan->first = run ? idxary[0] : 0;
+    if (zero) {
+        plan->kind = PLAN_KIND_ZERO;
+    } else if (run) {
+        plan->kind = dst_channels == src_channels ? PLAN_KIND_IDENTITY : PLAN_KIND_RUN;
+    } else {
+        plan->kind = PLAN_KIND_GENERIC;
+#ifdef USE_BYTE_SHUFFLE
+        if (dst_channels * sample_size <= sizeof(plan->shuffle) &&
+                src_channels * sample_size <= sizeof(plan->shuffle)) {
+            /* index 0x80 selects zero for both pshufb and vtbl */
+            size_t b;
+            for (b = 0; b < sizeof(plan->shuffle); ++b) {
+                int index = b < dst_channels * sample_size ? idxary[b / sample_size] : -1;
+                plan->shuffle[b] = index < 0 ? 0x80 :
+                        index * sample_size + b % sample_size;
+            }
+            plan->kind = PLAN_KIND_SHUFFLE;
+        }
+#endif
+    }
+    return 0;
+}
+
+#ifdef USE_BYTE_SHUFFLE
+/* Shuffle each frame with one vector load, table lookup, and store, while at least
+ * 16 bytes remain in both buffers.  Loads and stores past the end of the frame are
+ * harmless because of that, and the extra bytes stored are overwritten by the next frame.
+ * Returns the number of frames remaining.
+ */
+static size_t memcpy_by_byte_shuffle(uint8_t *dst, size_t dst_frame_size,
+        const uint8_t *src, size_t src_frame_size, const uint8_t *shuffle, size_t count)
+{
+    size_t min_frame_size = dst_frame_size < src_frame_size ? dst_frame_size : src_frame_size;
+    /* frames left to the caller, so that the last vector frame has (frames + 1) frames of both
+     * buffers behind it, i.e. (frames + 1) * min_frame_size >= 16
+     */
+    size_t frames = (16 + min_frame_size - 1) / min_frame_size - 1;
+    if (count <= frames) {
+        return count;
+    }
+    frames = count - frames;
+    size_t i;
+#if defined(USE_NEON)
+    const uint8x16_t table = vld1q_u8(shuffle);
+    for (i = 0; i < frames; ++i, src += src_frame_size, dst += dst_frame_size) {
+#if defined(__aarch64__)
+        vst1q_u8(dst, vqtbl1q_u8(vld1q_u8(src), table));
+#else
+        uint8x16_t in = vld1q_u8(src);
+        uint8x8x2_t pair = {{vget_low_u8(in), vget_high_u8(in)}};
+        vst1q_u8(dst, vcombine_u8(vtbl2_u8(pair, vget_low_u8(table)),
+                vtbl2_u8(pair, vget_high_u8(table))));
+#endif
+    }
+#else
+    const __m128i table = _mm_loadu_si128((const __m128i *) shuffle);
+    for (i = 0; i < frames; ++i, src += src_frame_size, dst += dst_frame_size) {
+        _mm_storeu_si128((__m128i *) dst,
+                _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) src), table));
+    }
+#endif
+    return count - frames;
+}
+#endif
+
+void memcpy_by_index_array_plan_execute(const struct memcpy_by_index_array_plan *plan,
+        void *dst, const void *src, size_t count)
+{
+    const size_t dst_frame_size = plan->dst_channels * plan->sample_size;
+    const size_t src_frame_size = plan->src_channels * plan->sample_size;
+    switch (plan->kind) {
+    case PLAN_KIND_IDENTITY:
+        memcpy(dst, src, count * dst_frame_size);
+        break;
+    case PLAN_KIND_ZERO:
+        memset(dst, 0, count * dst_frame_size);
+        break;
+    case PLAN_KIND_RUN: {
+        uint8_t *udst = (uint8_t *) dst;
+        const uint8_t *usrc = (const uint8_t *) src + plan->first * plan->sample_size;
+        while (count--) {
+            memcpy(udst, usrc, dst_frame_size);
+            udst += dst_frame_size;
+            usrc += src_frame_size;
+        }
+    } break;
+#ifdef USE_BYTE_SHUFFLE
+    case PLAN_KIND_SHUFFLE: {
+        size_t remaining = memcpy_by_byte_shuffle((uint8_t *) dst, dst_frame_size,
+                (const uint8_t *) src, src_frame_size, plan->shuffle, count);
+        size_t done = count - remaining;
+        memcpy_by_index_array((uint8_t *) dst + done * dst_frame_size, plan->dst_channels,
+                (const uint8_t *) src + done * src_frame_size, plan->src_channels,
+                plan->idxary, plan->sample_size, remaining);
+    } break;
+#endif
+    default:
+        memcpy_by_index_array(dst, plan->dst_channels, src, plan->src_channels,
+                plan->idxary, plan->sample_size, count);
+        break;
+    }
+}
@@ -17,8 +17,20 @@
 #ifndef ANDROID_AUDIO_PRIVATE_H
 #define ANDROID_AUDIO_PRIVATE_H
 
+#include <stddef.h>
 #include <stdint.h>
 
+/* Vector instruction set for the optimized routines, selected at build time.
+ * At most one of USE_NEON or USE_SSE2 is defined, and the matching intrinsics are included.
+ */
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define USE_NEON
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define USE_SSE2
+#endif
+
 __BEGIN_DECLS
 
 /* Defines not necessary for external use but kept here to be common
@@ -30,6 +42,17 @@ __BEGIN_DECLS
  */
 typedef struct {uint8_t c[3];} __attribute__((__packed__)) uint8x3_t;
 
+/* Copy by index array with the channel counts and sample size fixed at compile time,
+ * with the same parameters and result as memcpy_by_index_array().
+ */
+typedef void (*remap_kernel_t)(void *dst, const void *src, size_t count, const int8_t *idxary);
+
+/* Returns the templated remap kernel of kernels.h instantiated for the channel counts and
+ * sample size, or NULL if there is none and memcpy_by_index_array() must do the copy.
+ */
+remap_kernel_t remap_kernel_get(uint32_t dst_channels, uint32_t src_channels,
+        size_t sample_size);
+
 __END_DECLS
 
 #endif /*ANDROID_AUDIO_PRIVATE_H*/
@@ -0,0 +1,52 @@
+/*
+** Copyright 2016, The Android Open-Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+#ifndef ANDROID_AUDIO_RESAMPLER_PRIVATE_H
+#define ANDROID_AUDIO_RESAMPLER_PRIVATE_H
+
+#include <audio_utils/resampler.h>
+
+__BEGIN_DECLS
+
+/* Common head of the state of every resampler engine, so that release_resampler()
+ * can dispatch to the engine which created the resampler.
+ */
+struct resampler_common {
+    struct resampler_itfe itfe;
+    void (*release)(struct resampler_itfe *resampler);
+};
+
+/* Polyphase engine, see resampler_polyphase.c.
+ * Same parameters and return values as create_resampler_from_config().
+ */
+int create_polyphase_resampler(const struct resampler_config *config,
+                               struct resampler_buffer_provider *provider,
+                               struct resampler_itfe **resampler);
+
+/* Number of consecutive items, from the first, which polyphase_resample_lockstep() can process
+ * together, or 0 if the first item does not use the polyphase engine or is invalid, and must be
+ * processed by its resample_from_input_float().
+ */
+size_t polyphase_lockstep_count(const struct resampler_batch_item *items, size_t count);
+
+/* Process count items accepted by polyphase_lockstep_count() in lockstep,
+ * as resample_batch_from_input_float().
+ */
+void polyphase_resample_lockstep(struct resampler_batch_item *items, size_t count);
+
+__END_DECLS
+
+#endif // ANDROID_AUDIO_RESAMPLER_PRIVATE_H
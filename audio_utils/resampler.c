@@ -18,27 +18,35 @@
 #define LOG_TAG "resampler"
 
 #include <errno.h>
+#include <stdbool.h>
 #include <stdlib.h>
+#include <string.h>
 #include <cutils/log.h>
 #include <system/audio.h>
 #include <audio_utils/resampler.h>
+#include <audio_utils/task_pool.h>
+#include <audio_utils/trace.h>
 #include <speex/speex_resampler.h>
+#include "private/resampler.h"
 
 
 struct resampler {
-    struct resampler_itfe itfe;
+    struct resampler_common common;
     SpeexResamplerState *speex_resampler;       // handle on speex resampler
     struct resampler_buffer_provider *provider; // buffer provider installed by client
     uint32_t in_sample_rate;                    // input sampling rate in Hz
     uint32_t out_sample_rate;                   // output sampling rate in Hz
     uint32_t channel_count;                     // number of channels (interleaved)
-    int16_t *in_buf;                            // input buffer
-    size_t in_buf_size;                         // input buffer size
+    void *in_buf;                               // input buffer, 16-bit or float samples
+    size_t in_buf_bytes;                        // input buffer size in bytes
     size_t frames_in;                           // number of frames in input buffer
     size_t frames_rq;                           // cached number of output frames
     size_t frames_needed;                       // minimum number of input frames to produce
                                                 // frames_rq output frames
     int32_t speex_delay_ns;                     // delay introduced by speex resampler in ns
+    uint32_t flags;                             // enum resampler_flags
+    int32_t ratio_adjustment_ppm;               // current value of set_ratio_adjustment_ppm()
+    size_t max_frame_count;                     // largest request preallocated for
 };
 
 
@@ -70,12 +78,11 @@ static int32_t resampler_delay_ns(struct resampler_itfe *resampler)
 
 // outputs a number of frames less or equal to *outFrameCount and updates *outFrameCount
 // with the actual number of frames produced.
-int resampler_resample_from_provider(struct resampler_itfe *resampler,
-                       int16_t *out,
+static int speex_resample_from_provider(struct resampler *rsmp,
+                       void *out,
+                       bool is_float,
                        size_t *outFrameCount)
 {
-    struct resampler *rsmp = (struct resampler *)resampler;
-
     if (rsmp == NULL || out == NULL || outFrameCount == NULL) {
         return -EINVAL;
     }
@@ -84,6 +91,7 @@ int resampler_resample_from_provider(struct resampler_itfe *resampler,
         return -ENOSYS;
     }
 
+    const size_t frame_size = rsmp->channel_count * (is_float ? sizeof(float) : sizeof(int16_t));
     size_t framesRq = *outFrameCount;
     // update and cache the number of frames needed at the input sampling rate to produce
     // the number of frames requested at the output sampling rate
@@ -91,7 +99,12 @@ int resampler_resample_from_provider(struct resampler_itfe *resampler,
         rsmp->frames_needed = (framesRq * rsmp->in_sample_rate) / rsmp->out_sample_rate + 1;
         rsmp->frames_rq = framesRq;
     }
+    if ((rsmp->flags & RESAMPLER_FLAG_NO_ALLOC) && framesRq > rsmp->max_frame_count) {
+        *outFrameCount = 0;
+        return -ENOMEM;
+    }
 
+    int status = 0;
     size_t framesWr = 0;
     spx_uint32_t inFrames = 0;
     while (framesWr < framesRq) {
@@ -99,10 +112,14 @@ int resampler_resample_from_provider(struct resampler_itfe *resampler,
             // make sure that the number of frames present in rsmp->in_buf (rsmp->frames_in) is at
             // least the number of frames needed to produce the number of frames requested at
             // the output sampling rate
-            if (rsmp->in_buf_size < rsmp->frames_needed) {
-                rsmp->in_buf_size = rsmp->frames_needed;
-                rsmp->in_buf = (int16_t *)realloc(rsmp->in_buf,
-                                        rsmp->in_buf_size * rsmp->channel_count * sizeof(int16_t));
+            if (rsmp->in_buf_bytes < rsmp->frames_needed * frame_size) {
+                void *in_buf = realloc(rsmp->in_buf, rsmp->frames_needed * frame_size);
+                if (in_buf == NULL) {
+                    status = -ENOMEM;
+                    break;
+                }
+                rsmp->in_buf = in_buf;
+                rsmp->in_buf_bytes = rsmp->frames_needed * frame_size;
             }
             struct resampler_buffer buf;
             buf.frame_count = rsmp->frames_needed - rsmp->frames_in;
@@ -110,27 +127,34 @@ int resampler_resample_from_provider(struct resampler_itfe *resampler,
             if (buf.raw == NULL) {
                 break;
             }
-            memcpy(rsmp->in_buf + rsmp->frames_in * rsmp->channel_count,
+            memcpy((char *)rsmp->in_buf + rsmp->frames_in * frame_size,
                     buf.raw,
-                    buf.frame_count * rsmp->channel_count * sizeof(int16_t));
+                    buf.frame_count * frame_size);
             rsmp->frames_in += buf.frame_count;
             rsmp->provider->release_buffer(rsmp->provider, &buf);
         }
 
         spx_uint32_t outFrames = framesRq - framesWr;
         inFrames = rsmp->frames_in;
-        if (rsmp->channel_count == 1) {
+        void *dst = (char *)out + framesWr * frame_size;
+        if (is_float) {
+            speex_resampler_process_interleaved_float(rsmp->speex_resampler,
+                                        (const float *)rsmp->in_buf,
+                                        &inFrames,
+                                        (float *)dst,
+                                        &outFrames);
+        } else if (rsmp->channel_count == 1) {
             speex_resampler_process_int(rsmp->speex_resampler,
                                         0,
-                                        rsmp->in_buf,
+                                        (const int16_t *)rsmp->in_buf,
                                         &inFrames,
-                                        out + framesWr,
+                                        (int16_t *)dst,
                                         &outFrames);
         } else {
             speex_resampler_process_interleaved_int(rsmp->speex_resampler,
-                                        rsmp->in_buf,
+                                        (const int16_t *)rsmp->in_buf,
                                         &inFrames,
-                                        out + framesWr * rsmp->channel_count,
+                                        (int16_t *)dst,
                                         &outFrames);
         }
         framesWr += outFrames;
@@ -141,12 +165,30 @@ int resampler_resample_from_provider(struct resampler_itfe *resampler,
     }
     if (rsmp->frames_in) {
         memmove(rsmp->in_buf,
-                rsmp->in_buf + inFrames * rsmp->channel_count,
-                rsmp->frames_in * rsmp->channel_count * sizeof(int16_t));
+                (char *)rsmp->in_buf + inFrames * frame_size,
+                rsmp->frames_in * frame_size);
     }
     *outFrameCount = framesWr;
 
-    return 0;
+    return status;
+}
+
+int resampler_resample_from_provider(struct resampler_itfe *resampler,
+                       int16_t *out,
+                       size_t *outFrameCount)
+{
+    AUDIO_UTILS_TRACE_SCOPE("resampler_resample_from_provider");
+    return speex_resample_from_provider((struct resampler *)resampler, out,
+            false /*is_float*/, outFrameCount);
+}
+
+static int speex_resample_from_provider_float(struct resampler_itfe *resampler,
+                       float *out,
+                       size_t *outFrameCount)
+{
+    AUDIO_UTILS_TRACE_SCOPE("resampler_resample_from_provider_float");
+    return speex_resample_from_provider((struct resampler *)resampler, out,
+            true /*is_float*/, outFrameCount);
 }
 
 int resampler_resample_from_input(struct resampler_itfe *resampler,
@@ -186,28 +228,93 @@ int resampler_resample_from_input(struct resampler_itfe *resampler,
     return 0;
 }
 
-int create_resampler(uint32_t inSampleRate,
-                    uint32_t outSampleRate,
-                    uint32_t channelCount,
-                    uint32_t quality,
-                    struct resampler_buffer_provider* provider,
-                    struct resampler_itfe **resampler)
+static int speex_resample_from_input_float(struct resampler_itfe *resampler,
+                                           const float *in,
+                                           size_t *inFrameCount,
+                                           float *out,
+                                           size_t *outFrameCount)
 {
-    int error;
-    struct resampler *rsmp;
-
-    ALOGV("create_resampler() In SR %d Out SR %d channels %d",
-         inSampleRate, outSampleRate, channelCount);
+    struct resampler *rsmp = (struct resampler *)resampler;
 
-    if (resampler == NULL) {
+    if (rsmp == NULL || in == NULL || inFrameCount == NULL ||
+            out == NULL || outFrameCount == NULL) {
         return -EINVAL;
     }
+    if (rsmp->provider != NULL) {
+        *outFrameCount = 0;
+        return -ENOSYS;
+    }
 
-    *resampler = NULL;
+    spx_uint32_t inFrames = *inFrameCount;
+    spx_uint32_t outFrames = *outFrameCount;
+    speex_resampler_process_interleaved_float(rsmp->speex_resampler, in, &inFrames,
+                                              out, &outFrames);
+    *inFrameCount = inFrames;
+    *outFrameCount = outFrames;
+
+    ALOGV("speex_resample_from_input_float() DONE in %zu out %zu", *inFrameCount, *outFrameCount);
 
-    if (quality <= RESAMPLER_QUALITY_MIN || quality >= RESAMPLER_QUALITY_MAX) {
+    return 0;
+}
+
+static int speex_set_ratio_adjustment_ppm(struct resampler_itfe *resampler, int32_t ppm)
+{
+    struct resampler *rsmp = (struct resampler *)resampler;
+
+    if (rsmp == NULL || ppm > RESAMPLER_MAX_RATIO_ADJUSTMENT_PPM ||
+            ppm < -RESAMPLER_MAX_RATIO_ADJUSTMENT_PPM) {
+        return -EINVAL;
+    }
+    if (ppm == rsmp->ratio_adjustment_ppm) {
+        return 0;
+    }
+    // speex recomputes its filter on a ratio change, so skip the call when nothing changed
+    uint32_t divisor = rsmp->in_sample_rate;
+    uint32_t r = rsmp->out_sample_rate;
+    while (r != 0) {
+        uint32_t t = divisor % r;
+        divisor = r;
+        r = t;
+    }
+    uint64_t num = (uint64_t)(rsmp->in_sample_rate / divisor) * (1000000 + ppm);
+    uint64_t den = (uint64_t)(rsmp->out_sample_rate / divisor) * 1000000;
+    while (num > UINT32_MAX || den > UINT32_MAX) {
+        num >>= 1;
+        den >>= 1;
+    }
+    int error = speex_resampler_set_rate_frac(rsmp->speex_resampler, (spx_uint32_t)num,
+            (spx_uint32_t)den, rsmp->in_sample_rate, rsmp->out_sample_rate);
+    if (error != 0) {
+        ALOGW("speex_set_ratio_adjustment_ppm(%d) failed: %s", ppm,
+                speex_resampler_strerror(error));
         return -EINVAL;
     }
+    rsmp->ratio_adjustment_ppm = ppm;
+    return 0;
+}
+
+static void speex_release(struct resampler_itfe *resampler)
+{
+    struct resampler *rsmp = (struct resampler *)resampler;
+
+    free(rsmp->in_buf);
+
+    if (rsmp->speex_resampler != NULL) {
+        speex_resampler_destroy(rsmp->speex_resampler);
+    }
+    free(rsmp);
+}
+
+static int create_speex_resampler(const struct resampler_config *config,
+                    struct resampler_buffer_provider* provider,
+                    struct resampler_itfe **resampler)
+{
+    const uint32_t inSampleRate = config->in_sample_rate;
+    const uint32_t outSampleRate = config->out_sample_rate;
+    const uint32_t channelCount = config->channel_count;
+    const uint32_t quality = config->quality;
+    int error;
+    struct resampler *rsmp;
 
     rsmp = (struct resampler *)calloc(1, sizeof(struct resampler));
 
@@ -222,43 +329,166 @@ int create_resampler(uint32_t inSampleRate,
         return -ENODEV;
     }
 
-    rsmp->itfe.reset = resampler_reset;
-    rsmp->itfe.resample_from_provider = resampler_resample_from_provider;
-    rsmp->itfe.resample_from_input = resampler_resample_from_input;
-    rsmp->itfe.delay_ns = resampler_delay_ns;
+    rsmp->common.itfe.reset = resampler_reset;
+    rsmp->common.itfe.resample_from_provider = resampler_resample_from_provider;
+    rsmp->common.itfe.resample_from_input = resampler_resample_from_input;
+    rsmp->common.itfe.delay_ns = resampler_delay_ns;
+    rsmp->common.itfe.resample_from_provider_float = speex_resample_from_provider_float;
+    rsmp->common.itfe.resample_from_input_float = speex_resample_from_input_float;
+    rsmp->common.itfe.set_ratio_adjustment_ppm = speex_set_ratio_adjustment_ppm;
+    rsmp->common.release = speex_release;
 
     rsmp->provider = provider;
     rsmp->in_sample_rate = inSampleRate;
     rsmp->out_sample_rate = outSampleRate;
     rsmp->channel_count = channelCount;
     rsmp->in_buf = NULL;
-    rsmp->in_buf_size = 0;
+    rsmp->in_buf_bytes = 0;
+    rsmp->flags = config->flags;
+    rsmp->max_frame_count = config->max_frame_count;
+    if (config->max_frame_count > 0) {
+        // same as frames_needed in speex_resample_from_provider(), with room for float samples
+        rsmp->in_buf_bytes = ((config->max_frame_count * inSampleRate) / outSampleRate + 1) *
+                channelCount * sizeof(float);
+        rsmp->in_buf = malloc(rsmp->in_buf_bytes);
+        if (rsmp->in_buf == NULL) {
+            speex_resampler_destroy(rsmp->speex_resampler);
+            free(rsmp);
+            return -ENODEV;
+        }
+    }
 
-    resampler_reset(&rsmp->itfe);
+    resampler_reset(&rsmp->common.itfe);
 
     int frames = speex_resampler_get_input_latency(rsmp->speex_resampler);
     rsmp->speex_delay_ns = (int32_t)((1000000000 * (int64_t)frames) / rsmp->in_sample_rate);
     frames = speex_resampler_get_output_latency(rsmp->speex_resampler);
     rsmp->speex_delay_ns += (int32_t)((1000000000 * (int64_t)frames) / rsmp->out_sample_rate);
 
-    *resampler = &rsmp->itfe;
+    *resampler = &rsmp->common.itfe;
     ALOGV("create_resampler() DONE rsmp %p &rsmp->itfe %p speex %p",
-         rsmp, &rsmp->itfe, rsmp->speex_resampler);
+         rsmp, &rsmp->common.itfe, rsmp->speex_resampler);
     return 0;
 }
 
-void release_resampler(struct resampler_itfe *resampler)
+int create_resampler_from_config(const struct resampler_config *config,
+                    struct resampler_buffer_provider* provider,
+                    struct resampler_itfe **resampler)
 {
-    struct resampler *rsmp = (struct resampler *)resampler;
+    if (resampler == NULL) {
+        return -EINVAL;
+    }
 
-    if (rsmp == NULL) {
-        return;
+    *resampler = NULL;
+
+    if (config == NULL) {
+        return -EINVAL;
     }
 
-    free(rsmp->in_buf);
+    ALOGV("create_resampler_from_config() In SR %d Out SR %d channels %d engine %d",
+         config->in_sample_rate, config->out_sample_rate, config->channel_count, config->engine);
 
-    if (rsmp->speex_resampler != NULL) {
-        speex_resampler_destroy(rsmp->speex_resampler);
+    if (config->quality <= RESAMPLER_QUALITY_MIN || config->quality >= RESAMPLER_QUALITY_MAX) {
+        return -EINVAL;
     }
-    free(rsmp);
+    if ((config->flags & RESAMPLER_FLAG_NO_ALLOC) && config->max_frame_count == 0) {
+        return -EINVAL;
+    }
+
+    switch (config->engine) {
+    case RESAMPLER_ENGINE_SPEEX:
+        return create_speex_resampler(config, provider, resampler);
+    case RESAMPLER_ENGINE_POLYPHASE:
+        return create_polyphase_resampler(config, provider, resampler);
+    default:
+        return -EINVAL;
+    }
+}
+
+int create_resampler(uint32_t inSampleRate,
+                    uint32_t outSampleRate,
+                    uint32_t channelCount,
+                    uint32_t quality,
+                    struct resampler_buffer_provider* provider,
+                    struct resampler_itfe **resampler)
+{
+    struct resampler_config config;
+
+    memset(&config, 0, sizeof(config));
+    config.in_sample_rate = inSampleRate;
+    config.out_sample_rate = outSampleRate;
+    config.channel_count = channelCount;
+    config.quality = quality;
+    config.engine = RESAMPLER_ENGINE_SPEEX;
+    return create_resampler_from_config(&config, provider, resampler);
+}
+
+int resample_batch_from_input_float(struct resampler_batch_item *items, size_t count)
+{
+    AUDIO_UTILS_TRACE_SCOPE("resample_batch_from_input_float");
+    if (items == NULL && count > 0) {
+        return -EINVAL;
+    }
+    int status = 0;
+    size_t i = 0;
+    while (i < count) {
+        size_t n = polyphase_lockstep_count(items + i, count - i);
+        if (n == 0) {
+            // not a polyphase resampler, or an invalid item for which it returns the error
+            struct resampler_batch_item *item = &items[i];
+            if (item->resampler == NULL) {
+                item->status = -EINVAL;
+            } else if (item->resampler->resample_from_input_float == NULL) {
+                item->status = -ENOSYS;
+            } else {
+                item->status = item->resampler->resample_from_input_float(item->resampler,
+                        item->in, &item->in_frame_count, item->out, &item->out_frame_count);
+            }
+            n = 1;
+        } else {
+            polyphase_resample_lockstep(items + i, n);
+        }
+        for (; n > 0; n--, i++) {
+            if (status == 0) {
+                status = items[i].status;
+            }
+        }
+    }
+    return status;
+}
+
+static void resample_batch_range(void *arg, size_t begin, size_t end)
+{
+    struct resampler_batch_item *items = (struct resampler_batch_item *)arg;
+    resample_batch_from_input_float(items + begin, end - begin);
+}
+
+/* Items per task: one group of mono streams filtered together by the polyphase engine */
+#define RESAMPLER_BATCH_GRAIN 4
+
+int resample_batch_from_input_float_parallel(struct audio_utils_task_pool *pool,
+        struct resampler_batch_item *items, size_t count)
+{
+    if (items == NULL && count > 0) {
+        return -EINVAL;
+    }
+    audio_utils_task_pool_parallel_for(pool, count, RESAMPLER_BATCH_GRAIN,
+            resample_batch_range, items);
+    for (size_t i = 0; i < count; i++) {
+        if (items[i].status != 0) {
+            return items[i].status;
+        }
+    }
+    return 0;
+}
+
+void release_resampler(struct resampler_itfe *resampler)
+{
+    struct resampler_common *common = (struct resampler_common *)resampler;
+
+    if (common == NULL) {
+        return;
+    }
+
+    common->release(resampler);
 }
@@ -0,0 +1,885 @@
+/*
+** Copyright 2016, The Android Open-Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "resampler_polyphase"
+
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cutils/log.h>
+#include <audio_utils/primitives.h>
+#include <audio_utils/resampler.h>
+#include "private/private.h"
+#include "private/resampler.h"
+
+/* Polyphase resampler.
+ *
+ * The ratio in_sample_rate / out_sample_rate is reduced to step / phases.  Conceptually the input
+ * is upsampled by phases, low-pass filtered, and decimated by step.  Only the filter phases which
+ * contribute to an output frame are computed, so each output frame is the dot product of
+ * taps consecutive input frames and one row of a (phases + 1) x taps coefficient table.
+ * The extra last row is the first one delayed by one input frame, so that a row and its successor
+ * are always adjacent in memory.
+ *
+ * The prototype filter is a Kaiser windowed sinc, with a cutoff just below the Nyquist
+ * frequency of the lower of the two sample rates.  Each row is normalized for unity gain at DC.
+ * Coefficients depend only on the ratio and on the quality level, so the tables are computed once,
+ * kept in a reference counted list, and shared read-only by all resamplers using them.
+ *
+ * A ratio adjustment for clock drift changes the step by a fraction of a phase, kept in 32-bit
+ * fixed point.  While the position is between two rows, the coefficients are linearly
+ * interpolated between them, which costs taps multiply-adds per output frame.
+ */
+
+/* Number of input frames in the input buffer beyond those covered by the filter,
+ * and number of output frames converted at once for 16-bit output.
+ */
+#define RESAMPLER_POLYPHASE_BLOCK 256
+
+/* Longest filter supported, reached when downsampling by a large factor */
+#define RESAMPLER_POLYPHASE_MAX_TAPS 512
+
+/* Filter design for each quality level, from lowest to highest */
+static const struct {
+    uint32_t taps;      // number of taps when upsampling, multiplied by the ratio if downsampling
+    double beta;        // Kaiser window parameter, higher for more stop band attenuation
+    double cutoff;      // cutoff as a fraction of the Nyquist frequency of the lower rate
+} kFilterDesign[] = {
+    {16, 5.0, 0.85},
+    {32, 7.0, 0.90},
+    {48, 8.0, 0.92},
+    {64, 9.0, 0.94},
+};
+
+static uint32_t quality_level(uint32_t quality)
+{
+    return quality <= 2 ? 0 : quality <= 4 ? 1 : quality <= 6 ? 2 : 3;
+}
+
+struct polyphase_table {
+    struct polyphase_table *next;   // next in list of shared tables
+    uint32_t ref_count;             // number of resamplers using this table
+    uint32_t phases;                // denominator of the reduced ratio
+    uint32_t step;                  // numerator of the reduced ratio
+    uint32_t level;                 // index in kFilterDesign
+    uint32_t taps;                  // length of each row, a multiple of 4
+    float coefs[];                  // (phases + 1) rows of taps coefficients
+};
+
+static pthread_mutex_t sTablesLock = PTHREAD_MUTEX_INITIALIZER;
+static struct polyphase_table *sTables;    // protected by sTablesLock
+
+struct polyphase_resampler {
+    struct resampler_common common;
+    struct resampler_buffer_provider *provider; // buffer provider installed by client
+    struct polyphase_table *table;              // shared filter coefficients
+    uint32_t in_sample_rate;                    // input sampling rate in Hz
+    uint32_t out_sample_rate;                   // output sampling rate in Hz
+    uint32_t channel_count;                     // number of channels (interleaved)
+    uint32_t step_int;                          // input frames advanced per output frame
+    uint32_t step_frac;                         // and additional phases advanced
+    uint32_t step_sub;                          // and additional fraction of a phase,
+                                                // non-zero only for an adjusted ratio
+    float *in_buf;                              // input history converted to float
+    size_t in_buf_size;                         // input buffer size in frames
+    size_t frames_in;                           // number of frames in input buffer
+    size_t pos;                                 // first input frame used by next output frame,
+                                                // beyond frames_in if input must be skipped
+    uint32_t phase;                             // row of table used by next output frame
+    uint32_t phase_sub;                         // fraction of the way to the next row
+    float *coef_buf;                            // interpolated row, taps coefficients
+    float *out_buf;                             // output before conversion to 16-bit,
+                                                // RESAMPLER_POLYPHASE_BLOCK frames
+};
+
+static uint32_t gcd(uint32_t a, uint32_t b)
+{
+    while (b != 0) {
+        uint32_t r = a % b;
+        a = b;
+        b = r;
+    }
+    return a;
+}
+
+// zeroth order modified Bessel function of the first kind, for the Kaiser window
+static double bessel_i0(double x)
+{
+    const double y = x * x / 4;
+    double sum = 1;
+    double term = 1;
+    int k;
+    for (k = 1; term > sum * 1e-12; k++) {
+        term *= y / ((double)k * k);
+        sum += term;
+    }
+    return sum;
+}
+
+static struct polyphase_table *polyphase_table_create(uint32_t phases, uint32_t step,
+                                                      uint32_t level, uint32_t taps)
+{
+    struct polyphase_table *table = (struct polyphase_table *)malloc(
+            sizeof(struct polyphase_table) + (phases + 1) * taps * sizeof(float));
+    if (table == NULL) {
+        return NULL;
+    }
+    table->next = NULL;
+    table->ref_count = 0;
+    table->phases = phases;
+    table->step = step;
+    table->level = level;
+    table->taps = taps;
+
+    const double half = taps / 2;
+    const double fc = (step > phases ? (double)phases / step : 1.0) * kFilterDesign[level].cutoff;
+    const double beta = kFilterDesign[level].beta;
+    const double i0_beta = bessel_i0(beta);
+    uint32_t p, k;
+    for (p = 0; p <= phases; p++) {
+        float *row = table->coefs + p * taps;
+        double sum = 0;
+        for (k = 0; k < taps; k++) {
+            // distance in input frames from the output frame, which lies between taps
+            // half - 1 and half
+            const double d = k - (half - 1) - (double)p / phases;
+            const double x = M_PI * fc * d;
+            const double sinc = x == 0 ? 1.0 : sin(x) / x;
+            const double r = d / half;
+            const double window = r * r < 1 ? bessel_i0(beta * sqrt(1 - r * r)) / i0_beta : 0;
+            row[k] = (float)(fc * sinc * window);
+            sum += row[k];
+        }
+        for (k = 0; k < taps; k++) {
+            row[k] = (float)(row[k] / sum);
+        }
+    }
+    return table;
+}
+
+// get a shared table, creating it if needed
+static struct polyphase_table *polyphase_table_acquire(uint32_t phases, uint32_t step,
+                                                       uint32_t level, uint32_t taps)
+{
+    struct polyphase_table *table;
+
+    pthread_mutex_lock(&sTablesLock);
+    for (table = sTables; table != NULL; table = table->next) {
+        if (table->phases == phases && table->step == step && table->level == level) {
+            break;
+        }
+    }
+    if (table == NULL) {
+        table = polyphase_table_create(phases, step, level, taps);
+        if (table != NULL) {
+            table->next = sTables;
+            sTables = table;
+        }
+    }
+    if (table != NULL) {
+        table->ref_count++;
+    }
+    pthread_mutex_unlock(&sTablesLock);
+    return table;
+}
+
+static void polyphase_table_release(struct polyphase_table *table)
+{
+    struct polyphase_table **link;
+
+    pthread_mutex_lock(&sTablesLock);
+    if (--table->ref_count == 0) {
+        for (link = &sTables; *link != NULL; link = &(*link)->next) {
+            if (*link == table) {
+                *link = table->next;
+                break;
+            }
+        }
+        free(table);
+    }
+    pthread_mutex_unlock(&sTablesLock);
+}
+
+// Compute one output frame from taps input frames.  taps is a multiple of 4.
+static inline void filter_mono(const float *in, const float *coefs, size_t taps, float *out)
+{
+    size_t k;
+#if defined(USE_NEON)
+    float32x4_t acc = vdupq_n_f32(0);
+    for (k = 0; k < taps; k += 4) {
+        acc = vmlaq_f32(acc, vld1q_f32(in + k), vld1q_f32(coefs + k));
+    }
+    float32x2_t sum = vadd_f32(vget_low_f32(acc), vget_high_f32(acc));
+    out[0] = vget_lane_f32(vpadd_f32(sum, sum), 0);
+#elif defined(USE_SSE2)
+    __m128 acc = _mm_setzero_ps();
+    for (k = 0; k < taps; k += 4) {
+        acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(in + k), _mm_loadu_ps(coefs + k)));
+    }
+    acc = _mm_add_ps(acc, _mm_movehl_ps(acc, acc));
+    acc = _mm_add_ss(acc, _mm_shuffle_ps(acc, acc, 1));
+    out[0] = _mm_cvtss_f32(acc);
+#else
+    float acc = 0;
+    for (k = 0; k < taps; k++) {
+        acc += in[k] * coefs[k];
+    }
+    out[0] = acc;
+#endif
+}
+
+static inline void filter_stereo(const float *in, const float *coefs, size_t taps, float *out)
+{
+    size_t k;
+#if defined(USE_NEON)
+    float32x4_t accL = vdupq_n_f32(0);
+    float32x4_t accR = vdupq_n_f32(0);
+    for (k = 0; k < taps; k += 4) {
+        float32x4x2_t x = vld2q_f32(in + 2 * k);
+        float32x4_t c = vld1q_f32(coefs + k);
+        accL = vmlaq_f32(accL, x.val[0], c);
+        accR = vmlaq_f32(accR, x.val[1], c);
+    }
+    float32x2_t sum = vpadd_f32(vadd_f32(vget_low_f32(accL), vget_high_f32(accL)),
+            vadd_f32(vget_low_f32(accR), vget_high_f32(accR)));
+    vst1_f32(out, sum);
+#elif defined(USE_SSE2)
+    // lanes are L R L R for both accumulators
+    __m128 acc0 = _mm_setzero_ps();
+    __m128 acc1 = _mm_setzero_ps();
+    for (k = 0; k < taps; k += 4) {
+        __m128 c = _mm_loadu_ps(coefs + k);
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(in + 2 * k), _mm_unpacklo_ps(c, c)));
+        acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(in + 2 * k + 4), _mm_unpackhi_ps(c, c)));
+    }
+    acc0 = _mm_add_ps(acc0, acc1);
+    acc0 = _mm_add_ps(acc0, _mm_movehl_ps(acc0, acc0));
+    _mm_storel_pi((__m64 *)out, acc0);
+#else
+    float accL = 0;
+    float accR = 0;
+    for (k = 0; k < taps; k++) {
+        accL += in[2 * k] * coefs[k];
+        accR += in[2 * k + 1] * coefs[k];
+    }
+    out[0] = accL;
+    out[1] = accR;
+#endif
+}
+
+static inline void filter_multi(const float *in, const float *coefs, size_t taps,
+                                size_t channel_count, float *out)
+{
+    size_t ch, k;
+    for (ch = 0; ch < channel_count; ch++) {
+        float acc = 0;
+        for (k = 0; k < taps; k++) {
+            acc += in[k * channel_count + ch] * coefs[k];
+        }
+        out[ch] = acc;
+    }
+}
+
+// Compute four mono output frames, each from taps input frames of a different stream,
+// sharing the loads of the coefficients.  taps is a multiple of 4.
+static inline void filter_mono4(const float *const in[4], const float *coefs, size_t taps,
+                                float *const out[4])
+{
+    size_t k;
+#if defined(USE_NEON)
+    float32x4_t acc0 = vdupq_n_f32(0);
+    float32x4_t acc1 = vdupq_n_f32(0);
+    float32x4_t acc2 = vdupq_n_f32(0);
+    float32x4_t acc3 = vdupq_n_f32(0);
+    for (k = 0; k < taps; k += 4) {
+        float32x4_t c = vld1q_f32(coefs + k);
+        acc0 = vmlaq_f32(acc0, vld1q_f32(in[0] + k), c);
+        acc1 = vmlaq_f32(acc1, vld1q_f32(in[1] + k), c);
+        acc2 = vmlaq_f32(acc2, vld1q_f32(in[2] + k), c);
+        acc3 = vmlaq_f32(acc3, vld1q_f32(in[3] + k), c);
+    }
+    float32x2_t sum01 = vpadd_f32(vadd_f32(vget_low_f32(acc0), vget_high_f32(acc0)),
+            vadd_f32(vget_low_f32(acc1), vget_high_f32(acc1)));
+    float32x2_t sum23 = vpadd_f32(vadd_f32(vget_low_f32(acc2), vget_high_f32(acc2)),
+            vadd_f32(vget_low_f32(acc3), vget_high_f32(acc3)));
+    *out[0] = vget_lane_f32(sum01, 0);
+    *out[1] = vget_lane_f32(sum01, 1);
+    *out[2] = vget_lane_f32(sum23, 0);
+    *out[3] = vget_lane_f32(sum23, 1);
+#elif defined(USE_SSE2)
+    __m128 acc0 = _mm_setzero_ps();
+    __m128 acc1 = _mm_setzero_ps();
+    __m128 acc2 = _mm_setzero_ps();
+    __m128 acc3 = _mm_setzero_ps();
+    for (k = 0; k < taps; k += 4) {
+        __m128 c = _mm_loadu_ps(coefs + k);
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(in[0] + k), c));
+        acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(in[1] + k), c));
+        acc2 = _mm_add_ps(acc2, _mm_mul_ps(_mm_loadu_ps(in[2] + k), c));
+        acc3 = _mm_add_ps(acc3, _mm_mul_ps(_mm_loadu_ps(in[3] + k), c));
+    }
+    // after the transpose, lane i of the sum is the output of stream i
+    _MM_TRANSPOSE4_PS(acc0, acc1, acc2, acc3);
+    float sum[4];
+    _mm_storeu_ps(sum, _mm_add_ps(_mm_add_ps(acc0, acc1), _mm_add_ps(acc2, acc3)));
+    *out[0] = sum[0];
+    *out[1] = sum[1];
+    *out[2] = sum[2];
+    *out[3] = sum[3];
+#else
+    size_t i;
+    for (i = 0; i < 4; i++) {
+        float acc = 0;
+        for (k = 0; k < taps; k++) {
+            acc += in[i][k] * coefs[k];
+        }
+        *out[i] = acc;
+    }
+#endif
+}
+
+static inline void filter_frame(const float *in, const float *coefs, size_t taps,
+                                size_t channel_count, float *out)
+{
+    switch (channel_count) {
+    case 1:
+        filter_mono(in, coefs, taps, out);
+        break;
+    case 2:
+        filter_stereo(in, coefs, taps, out);
+        break;
+    default:
+        filter_multi(in, coefs, taps, channel_count, out);
+        break;
+    }
+}
+
+// Returns the coefficients of the next output frame, interpolated into coef_buf if needed
+static inline const float *polyphase_coefs(struct polyphase_resampler *rsmp)
+{
+    const struct polyphase_table *table = rsmp->table;
+    const size_t taps = table->taps;
+    const float *coefs = table->coefs + rsmp->phase * taps;
+    if (rsmp->phase_sub != 0) {
+        const float *next = coefs + taps;
+        const float weight = rsmp->phase_sub * (1.0f / 4294967296.0f);
+        size_t k;
+        for (k = 0; k < taps; k++) {
+            rsmp->coef_buf[k] = coefs[k] + (next[k] - coefs[k]) * weight;
+        }
+        coefs = rsmp->coef_buf;
+    }
+    return coefs;
+}
+
+// Advance the position by one output frame
+static inline void polyphase_advance(struct polyphase_resampler *rsmp)
+{
+    const uint32_t phase_sub = rsmp->phase_sub + rsmp->step_sub;
+    rsmp->pos += rsmp->step_int;
+    rsmp->phase += rsmp->step_frac + (phase_sub < rsmp->phase_sub ? 1 : 0);
+    rsmp->phase_sub = phase_sub;
+    if (rsmp->phase >= rsmp->table->phases) {
+        rsmp->phase -= rsmp->table->phases;
+        rsmp->pos++;
+    }
+}
+
+// Produce at most out_frames output frames from the input buffer only.
+// Returns the number of frames produced.
+static size_t polyphase_produce(struct polyphase_resampler *rsmp, float *out, size_t out_frames)
+{
+    const size_t taps = rsmp->table->taps;
+    const size_t channel_count = rsmp->channel_count;
+    size_t n;
+
+    for (n = 0; n < out_frames && rsmp->pos + taps <= rsmp->frames_in; n++) {
+        filter_frame(rsmp->in_buf + rsmp->pos * channel_count, polyphase_coefs(rsmp), taps,
+                channel_count, out);
+        out += channel_count;
+        polyphase_advance(rsmp);
+    }
+    return n;
+}
+
+// Same as polyphase_produce(), but output to 16-bit or float samples
+static size_t polyphase_produce_to(struct polyphase_resampler *rsmp, void *out, bool is_float,
+                                   size_t out_frames)
+{
+    if (is_float) {
+        return polyphase_produce(rsmp, (float *)out, out_frames);
+    }
+    int16_t *out16 = (int16_t *)out;
+    size_t produced = 0;
+    while (produced < out_frames) {
+        size_t block = out_frames - produced;
+        if (block > RESAMPLER_POLYPHASE_BLOCK) {
+            block = RESAMPLER_POLYPHASE_BLOCK;
+        }
+        size_t n = polyphase_produce(rsmp, rsmp->out_buf, block);
+        memcpy_to_i16_from_float(out16 + produced * rsmp->channel_count, rsmp->out_buf,
+                n * rsmp->channel_count);
+        produced += n;
+        if (n < block) {
+            break;
+        }
+    }
+    return produced;
+}
+
+// Discard input frames which are no longer needed, to make room for new ones
+static void polyphase_compact(struct polyphase_resampler *rsmp)
+{
+    if (rsmp->pos >= rsmp->frames_in) {
+        rsmp->pos -= rsmp->frames_in;
+        rsmp->frames_in = 0;
+    } else if (rsmp->pos > 0) {
+        memmove(rsmp->in_buf, rsmp->in_buf + rsmp->pos * rsmp->channel_count,
+                (rsmp->frames_in - rsmp->pos) * rsmp->channel_count * sizeof(float));
+        rsmp->frames_in -= rsmp->pos;
+        rsmp->pos = 0;
+    }
+}
+
+// Append at most frames input frames to the input buffer, after polyphase_compact().
+// Returns the number of input frames consumed, including frames skipped when downsampling.
+static size_t polyphase_append(struct polyphase_resampler *rsmp, const void *in, bool is_float,
+                               size_t frames)
+{
+    const size_t channel_count = rsmp->channel_count;
+    // pos is only non-zero here if the input buffer is empty and frames must be skipped
+    size_t skip = rsmp->pos < frames ? rsmp->pos : frames;
+    size_t count = frames - skip;
+    if (count > rsmp->in_buf_size - rsmp->frames_in) {
+        count = rsmp->in_buf_size - rsmp->frames_in;
+    }
+    rsmp->pos -= skip;
+    float *dst = rsmp->in_buf + rsmp->frames_in * channel_count;
+    if (is_float) {
+        memcpy(dst, (const float *)in + skip * channel_count, count * channel_count * sizeof(float));
+    } else {
+        memcpy_to_float_from_i16(dst, (const int16_t *)in + skip * channel_count,
+                count * channel_count);
+    }
+    rsmp->frames_in += count;
+    return skip + count;
+}
+
+// number of input frames to append so that out_frames frames can be produced
+static size_t polyphase_frames_needed(const struct polyphase_resampler *rsmp, size_t out_frames)
+{
+    if (out_frames == 0) {
+        return 0;
+    }
+    const struct polyphase_table *table = rsmp->table;
+    const uint64_t subs = ((uint64_t)(out_frames - 1) * rsmp->step_sub + rsmp->phase_sub) >> 32;
+    const uint64_t advance = (uint64_t)(out_frames - 1) * rsmp->step_int +
+            ((uint64_t)(out_frames - 1) * rsmp->step_frac + rsmp->phase + subs) /
+            table->phases;
+    const uint64_t last = rsmp->pos + advance + table->taps;
+    return last > rsmp->frames_in ? (size_t)(last - rsmp->frames_in) : 0;
+}
+
+static int polyphase_resample_from_provider(struct polyphase_resampler *rsmp, void *out,
+                                            bool is_float, size_t *outFrameCount)
+{
+    if (out == NULL || outFrameCount == NULL) {
+        return -EINVAL;
+    }
+    if (rsmp->provider == NULL) {
+        *outFrameCount = 0;
+        return -ENOSYS;
+    }
+
+    const size_t sample_size = is_float ? sizeof(float) : sizeof(int16_t);
+    const size_t framesRq = *outFrameCount;
+    size_t framesWr = 0;
+    for (;;) {
+        framesWr += polyphase_produce_to(rsmp,
+                (char *)out + framesWr * rsmp->channel_count * sample_size, is_float,
+                framesRq - framesWr);
+        if (framesWr == framesRq) {
+            break;
+        }
+        polyphase_compact(rsmp);
+        struct resampler_buffer buf;
+        buf.frame_count = polyphase_frames_needed(rsmp, framesRq - framesWr);
+        if (buf.frame_count > rsmp->in_buf_size - rsmp->frames_in + rsmp->pos) {
+            buf.frame_count = rsmp->in_buf_size - rsmp->frames_in + rsmp->pos;
+        }
+        rsmp->provider->get_next_buffer(rsmp->provider, &buf);
+        if (buf.raw == NULL || buf.frame_count == 0) {
+            break;
+        }
+        buf.frame_count = polyphase_append(rsmp, buf.raw, is_float, buf.frame_count);
+        rsmp->provider->release_buffer(rsmp->provider, &buf);
+    }
+    // The provider running dry is expected, e.g. echo_reference asks for headroom beyond
+    // the nominal count, and all the input it had was consumed.
+    ALOGV_IF(framesWr != framesRq, "polyphase resample() produced %zu of %zu frames",
+            framesWr, framesRq);
+    *outFrameCount = framesWr;
+    return 0;
+}
+
+static int polyphase_resample_from_input(struct polyphase_resampler *rsmp, const void *in,
+                                         bool is_float, size_t *inFrameCount, void *out,
+                                         size_t *outFrameCount)
+{
+    if (in == NULL || inFrameCount == NULL || out == NULL || outFrameCount == NULL) {
+        return -EINVAL;
+    }
+    if (rsmp->provider != NULL) {
+        *outFrameCount = 0;
+        return -ENOSYS;
+    }
+
+    const size_t sample_size = (is_float ? sizeof(float) : sizeof(int16_t)) *
+            rsmp->channel_count;
+    const size_t inFrames = *inFrameCount;
+    const size_t outFrames = *outFrameCount;
+    size_t inDone = 0;
+    size_t outDone = 0;
+    for (;;) {
+        outDone += polyphase_produce_to(rsmp, (char *)out + outDone * sample_size, is_float,
+                outFrames - outDone);
+        if (outDone == outFrames || inDone == inFrames) {
+            break;
+        }
+        polyphase_compact(rsmp);
+        size_t consumed = polyphase_append(rsmp, (const char *)in + inDone * sample_size,
+                is_float, inFrames - inDone);
+        if (consumed == 0) {
+            break;
+        }
+        inDone += consumed;
+    }
+    *inFrameCount = inDone;
+    *outFrameCount = outDone;
+    ALOGV("polyphase resample_from_input() DONE in %zu out %zu", inDone, outDone);
+    return 0;
+}
+
+static void polyphase_reset(struct resampler_itfe *resampler)
+{
+    struct polyphase_resampler *rsmp = (struct polyphase_resampler *)resampler;
+
+    // prime with silence, so that the first output frame is aligned on the first input frame
+    rsmp->frames_in = rsmp->table->taps / 2 - 1;
+    memset(rsmp->in_buf, 0, rsmp->frames_in * rsmp->channel_count * sizeof(float));
+    rsmp->pos = 0;
+    rsmp->phase = 0;
+    rsmp->phase_sub = 0;
+}
+
+static int polyphase_resample_from_provider_i16(struct resampler_itfe *resampler,
+                                                int16_t *out,
+                                                size_t *outFrameCount)
+{
+    if (resampler == NULL) {
+        return -EINVAL;
+    }
+    return polyphase_resample_from_provider((struct polyphase_resampler *)resampler, out,
+            false /*is_float*/, outFrameCount);
+}
+
+static int polyphase_resample_from_input_i16(struct resampler_itfe *resampler,
+                                             int16_t *in,
+                                             size_t *inFrameCount,
+                                             int16_t *out,
+                                             size_t *outFrameCount)
+{
+    if (resampler == NULL) {
+        return -EINVAL;
+    }
+    return polyphase_resample_from_input((struct polyphase_resampler *)resampler, in,
+            false /*is_float*/, inFrameCount, out, outFrameCount);
+}
+
+static int polyphase_resample_from_provider_float(struct resampler_itfe *resampler,
+                                                  float *out,
+                                                  size_t *outFrameCount)
+{
+    if (resampler == NULL) {
+        return -EINVAL;
+    }
+    return polyphase_resample_from_provider((struct polyphase_resampler *)resampler, out,
+            true /*is_float*/, outFrameCount);
+}
+
+static int polyphase_resample_from_input_float(struct resampler_itfe *resampler,
+                                               const float *in,
+                                               size_t *inFrameCount,
+                                               float *out,
+                                               size_t *outFrameCount)
+{
+    if (resampler == NULL) {
+        return -EINVAL;
+    }
+    return polyphase_resample_from_input((struct polyphase_resampler *)resampler, in,
+            true /*is_float*/, inFrameCount, out, outFrameCount);
+}
+
+static int polyphase_set_ratio_adjustment_ppm(struct resampler_itfe *resampler, int32_t ppm)
+{
+    struct polyphase_resampler *rsmp = (struct polyphase_resampler *)resampler;
+
+    if (rsmp == NULL || ppm > RESAMPLER_MAX_RATIO_ADJUSTMENT_PPM ||
+            ppm < -RESAMPLER_MAX_RATIO_ADJUSTMENT_PPM) {
+        return -EINVAL;
+    }
+    const uint32_t phases = rsmp->table->phases;
+    // step in phases, small enough for a double to keep the 32-bit fraction exact
+    const double step = rsmp->table->step * (1.0 + ppm * 1e-6);
+    const uint64_t whole = (uint64_t)step;
+    double sub = (step - whole) * 4294967296.0;
+    rsmp->step_int = (uint32_t)(whole / phases);
+    rsmp->step_frac = (uint32_t)(whole % phases);
+    rsmp->step_sub = sub < 4294967295.0 ? (uint32_t)sub : UINT32_MAX;
+    return 0;
+}
+
+static int32_t polyphase_delay_ns(struct resampler_itfe *resampler)
+{
+    struct polyphase_resampler *rsmp = (struct polyphase_resampler *)resampler;
+
+    // input frames buffered beyond the position of the next output frame
+    int64_t frames = (int64_t)rsmp->frames_in - (int64_t)rsmp->pos -
+            (int64_t)(rsmp->table->taps / 2 - 1);
+    if (frames < 0) {
+        frames = 0;
+    }
+    return (int32_t)((1000000000 * frames) / rsmp->in_sample_rate);
+}
+
+static void polyphase_release(struct resampler_itfe *resampler)
+{
+    struct polyphase_resampler *rsmp = (struct polyphase_resampler *)resampler;
+
+    polyphase_table_release(rsmp->table);
+    free(rsmp->in_buf);
+    free(rsmp->out_buf);
+    free(rsmp->coef_buf);
+    free(rsmp);
+}
+
+size_t polyphase_lockstep_count(const struct resampler_batch_item *items, size_t count)
+{
+    if (count == 0 || items[0].resampler == NULL ||
+            ((struct resampler_common *)items[0].resampler)->release != polyphase_release) {
+        return 0;
+    }
+    const struct polyphase_resampler *lead = (struct polyphase_resampler *)items[0].resampler;
+    if (lead->provider != NULL || items[0].in == NULL || items[0].out == NULL) {
+        return 0;
+    }
+    size_t n, j;
+    for (n = 1; n < count; n++) {
+        const struct polyphase_resampler *rsmp = (struct polyphase_resampler *)items[n].resampler;
+        // a resampler appearing twice must be run twice, so it ends the group
+        for (j = 0; j < n && items[j].resampler != items[n].resampler; j++) {
+        }
+        if (rsmp == NULL || j < n ||
+                ((struct resampler_common *)rsmp)->release != polyphase_release ||
+                rsmp->provider != NULL || items[n].in == NULL || items[n].out == NULL ||
+                items[n].in_frame_count != items[0].in_frame_count ||
+                items[n].out_frame_count != items[0].out_frame_count ||
+                rsmp->table != lead->table || rsmp->channel_count != lead->channel_count ||
+                rsmp->in_buf_size != lead->in_buf_size ||
+                rsmp->step_int != lead->step_int || rsmp->step_frac != lead->step_frac ||
+                rsmp->step_sub != lead->step_sub || rsmp->frames_in != lead->frames_in ||
+                rsmp->pos != lead->pos || rsmp->phase != lead->phase ||
+                rsmp->phase_sub != lead->phase_sub) {
+            break;
+        }
+    }
+    return n;
+}
+
+// Same as polyphase_produce() for resamplers in the same state, writing each stream's output
+// from frame offset of its out buffer.  The position is advanced once for all of them.
+static size_t polyphase_produce_lockstep(struct resampler_batch_item *items, size_t count,
+                                         size_t offset, size_t out_frames)
+{
+    struct polyphase_resampler *lead = (struct polyphase_resampler *)items[0].resampler;
+    const size_t taps = lead->table->taps;
+    const size_t channel_count = lead->channel_count;
+    size_t n, i;
+
+    for (n = 0; n < out_frames && lead->pos + taps <= lead->frames_in; n++) {
+        const float *coefs = polyphase_coefs(lead);
+        const size_t in_offset = lead->pos * channel_count;
+        const size_t out_offset = (offset + n) * channel_count;
+        i = 0;
+        if (channel_count == 1) {
+            for (; i + 4 <= count; i += 4) {
+                const float *const in[4] = {
+                    ((struct polyphase_resampler *)items[i].resampler)->in_buf + in_offset,
+                    ((struct polyphase_resampler *)items[i + 1].resampler)->in_buf + in_offset,
+                    ((struct polyphase_resampler *)items[i + 2].resampler)->in_buf + in_offset,
+                    ((struct polyphase_resampler *)items[i + 3].resampler)->in_buf + in_offset,
+                };
+                float *const out[4] = {
+                    items[i].out + out_offset,
+                    items[i + 1].out + out_offset,
+                    items[i + 2].out + out_offset,
+                    items[i + 3].out + out_offset,
+                };
+                filter_mono4(in, coefs, taps, out);
+            }
+        }
+        for (; i < count; i++) {
+            filter_frame(((struct polyphase_resampler *)items[i].resampler)->in_buf + in_offset,
+                    coefs, taps, channel_count, items[i].out + out_offset);
+        }
+        polyphase_advance(lead);
+    }
+    for (i = 1; i < count; i++) {
+        struct polyphase_resampler *rsmp = (struct polyphase_resampler *)items[i].resampler;
+        rsmp->pos = lead->pos;
+        rsmp->phase = lead->phase;
+        rsmp->phase_sub = lead->phase_sub;
+    }
+    return n;
+}
+
+void polyphase_resample_lockstep(struct resampler_batch_item *items, size_t count)
+{
+    struct polyphase_resampler *lead = (struct polyphase_resampler *)items[0].resampler;
+    const size_t channel_count = lead->channel_count;
+    const size_t inFrames = items[0].in_frame_count;
+    const size_t outFrames = items[0].out_frame_count;
+    size_t inDone = 0;
+    size_t outDone = 0;
+    size_t i;
+
+    // same loop as polyphase_resample_from_input(), which keeps the states equal
+    for (;;) {
+        outDone += polyphase_produce_lockstep(items, count, outDone, outFrames - outDone);
+        if (outDone == outFrames || inDone == inFrames) {
+            break;
+        }
+        size_t consumed = 0;
+        for (i = 0; i < count; i++) {
+            struct polyphase_resampler *rsmp = (struct polyphase_resampler *)items[i].resampler;
+            polyphase_compact(rsmp);
+            consumed = polyphase_append(rsmp, items[i].in + inDone * channel_count, true,
+                    inFrames - inDone);
+        }
+        if (consumed == 0) {
+            break;
+        }
+        inDone += consumed;
+    }
+    for (i = 0; i < count; i++) {
+        items[i].in_frame_count = inDone;
+        items[i].out_frame_count = outDone;
+        items[i].status = 0;
+    }
+    ALOGV("polyphase_resample_lockstep() DONE %zu streams in %zu out %zu", count, inDone, outDone);
+}
+
+int create_polyphase_resampler(const struct resampler_config *config,
+                               struct resampler_buffer_provider *provider,
+                               struct resampler_itfe **resampler)
+{
+    struct polyphase_resampler *rsmp;
+
+    if (config->in_sample_rate == 0 || config->out_sample_rate == 0 ||
+            config->channel_count == 0) {
+        return -EINVAL;
+    }
+    const uint32_t divisor = gcd(config->in_sample_rate, config->out_sample_rate);
+    const uint32_t phases = config->out_sample_rate / divisor;
+    const uint32_t step = config->in_sample_rate / divisor;
+    if (phases > RESAMPLER_POLYPHASE_MAX_PHASES) {
+        ALOGV("create_polyphase_resampler() unsupported ratio %u / %u",
+                config->in_sample_rate, config->out_sample_rate);
+        return -EINVAL;
+    }
+    const uint32_t level = quality_level(config->quality);
+    uint64_t taps = kFilterDesign[level].taps;
+    if (step > phases) {
+        taps = (taps * step + phases - 1) / phases;
+    }
+    taps = (taps + 3) & ~3;
+    if (taps > RESAMPLER_POLYPHASE_MAX_TAPS) {
+        ALOGV("create_polyphase_resampler() unsupported ratio %u / %u",
+                config->in_sample_rate, config->out_sample_rate);
+        return -EINVAL;
+    }
+
+    rsmp = (struct polyphase_resampler *)calloc(1, sizeof(struct polyphase_resampler));
+    if (rsmp == NULL) {
+        return -ENODEV;
+    }
+    rsmp->table = polyphase_table_acquire(phases, step, level, (uint32_t)taps);
+    // never allocates after creation, so RESAMPLER_FLAG_NO_ALLOC needs no special handling.
+    // If the largest request is known, the input buffer holds all of the input it needs,
+    // so that the provider is called once per request.
+    size_t block = RESAMPLER_POLYPHASE_BLOCK;
+    if (config->max_frame_count > 0) {
+        // with room for the largest ratio adjustment
+        const uint64_t frames = (uint64_t)config->max_frame_count * step / phases *
+                (1000000 + RESAMPLER_MAX_RATIO_ADJUSTMENT_PPM) / 1000000 + 3;
+        if (frames > block) {
+            block = (size_t)frames;
+        }
+    }
+    rsmp->in_buf_size = taps + block;
+    rsmp->in_buf = (float *)malloc(rsmp->in_buf_size * config->channel_count * sizeof(float));
+    rsmp->out_buf = (float *)malloc(RESAMPLER_POLYPHASE_BLOCK * config->channel_count *
+            sizeof(float));
+    rsmp->coef_buf = (float *)malloc(taps * sizeof(float));
+    if (rsmp->table == NULL || rsmp->in_buf == NULL || rsmp->out_buf == NULL ||
+            rsmp->coef_buf == NULL) {
+        if (rsmp->table != NULL) {
+            polyphase_table_release(rsmp->table);
+        }
+        free(rsmp->in_buf);
+        free(rsmp->out_buf);
+        free(rsmp->coef_buf);
+        free(rsmp);
+        return -ENODEV;
+    }
+
+    rsmp->common.itfe.reset = polyphase_reset;
+    rsmp->common.itfe.resample_from_provider = polyphase_resample_from_provider_i16;
+    rsmp->common.itfe.resample_from_input = polyphase_resample_from_input_i16;
+    rsmp->common.itfe.delay_ns = polyphase_delay_ns;
+    rsmp->common.itfe.resample_from_provider_float = polyphase_resample_from_provider_float;
+    rsmp->common.itfe.resample_from_input_float = polyphase_resample_from_input_float;
+    rsmp->common.itfe.set_ratio_adjustment_ppm = polyphase_set_ratio_adjustment_ppm;
+    rsmp->common.release = polyphase_release;
+
+    rsmp->provider = provider;
+    rsmp->in_sample_rate = config->in_sample_rate;
+    rsmp->out_sample_rate = config->out_sample_rate;
+    rsmp->channel_count = config->channel_count;
+    rsmp->step_int = step / phases;
+    rsmp->step_frac = step % phases;
+
+    polyphase_reset(&rsmp->common.itfe);
+
+    *resampler = &rsmp->common.itfe;
+    ALOGV("create_polyphase_resampler() DONE rsmp %p phases %u step %u taps %u",
+            rsmp, phases, step, rsmp->table->taps);
+    return 0;
+}
@@ -0,0 +1,213 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "audio_utils_sound_trigger_model"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <log/log.h>
+#include <audio_utils/sound_trigger_model.h>
+
+size_t sound_trigger_sound_model_header_size(sound_trigger_sound_model_type_t type)
+{
+    switch (type) {
+    case SOUND_MODEL_TYPE_KEYPHRASE:
+        return sizeof(struct sound_trigger_phrase_sound_model);
+    case SOUND_MODEL_TYPE_GENERIC:
+        return sizeof(struct sound_trigger_generic_sound_model);
+    default:
+        return 0;
+    }
+}
+
+size_t sound_trigger_sound_model_size(const struct sound_trigger_sound_model *model)
+{
+    return (size_t) model->data_offset + model->data_size;
+}
+
+// Check the fields of a header of the given size, ignoring data_offset and data_size
+static int validate_header(const struct sound_trigger_sound_model *model, size_t size)
+{
+    if (size < sizeof(*model)) {
+        return -EINVAL;
+    }
+    const size_t header_size = sound_trigger_sound_model_header_size(model->type);
+    if (header_size == 0 || size < header_size) {
+        return -EINVAL;
+    }
+    if (model->type == SOUND_MODEL_TYPE_KEYPHRASE) {
+        const struct sound_trigger_phrase_sound_model *phrase_model =
+                (const struct sound_trigger_phrase_sound_model *) model;
+        if (phrase_model->num_phrases > SOUND_TRIGGER_MAX_PHRASES) {
+            return -EINVAL;
+        }
+        for (unsigned int i = 0; i < phrase_model->num_phrases; ++i) {
+            const struct sound_trigger_phrase *phrase = &phrase_model->phrases[i];
+            if (phrase->num_users > SOUND_TRIGGER_MAX_USERS ||
+                    memchr(phrase->locale, '\0', sizeof(phrase->locale)) == NULL ||
+                    memchr(phrase->text, '\0', sizeof(phrase->text)) == NULL) {
+                return -EINVAL;
+            }
+        }
+    }
+    return 0;
+}
+
+struct sound_trigger_sound_model *sound_trigger_sound_model_create(
+        const struct sound_trigger_sound_model *header, const void *data, size_t data_size)
+{
+    if (header == NULL || (data == NULL && data_size > 0)) {
+        return NULL;
+    }
+    const size_t header_size = sound_trigger_sound_model_header_size(header->type);
+    if (header_size == 0 || validate_header(header, header_size) != 0 ||
+            data_size > UINT32_MAX - header_size) {
+        return NULL;
+    }
+    struct sound_trigger_sound_model *model =
+            (struct sound_trigger_sound_model *) malloc(header_size + data_size);
+    if (model == NULL) {
+        return NULL;
+    }
+    memcpy(model, header, header_size);
+    model->data_offset = header_size;
+    model->data_size = data_size;
+    if (data_size > 0) {
+        memcpy((uint8_t *) model + header_size, data, data_size);
+    }
+    return model;
+}
+
+int sound_trigger_sound_model_validate(const struct sound_trigger_sound_model *model,
+        size_t size)
+{
+    if (model == NULL) {
+        return -EINVAL;
+    }
+    int res = validate_header(model, size);
+    if (res != 0) {
+        return res;
+    }
+    if (model->data_offset < sound_trigger_sound_model_header_size(model->type) ||
+            (uint64_t) model->data_offset + model->data_size != size) {
+        return -EINVAL;
+    }
+    return 0;
+}
+
+int sound_trigger_sound_model_write(const struct sound_trigger_sound_model *model, int fd)
+{
+    if (model == NULL || fd < 0) {
+        return -EINVAL;
+    }
+    int res = validate_header(model, sound_trigger_sound_model_size(model));
+    if (res != 0 ||
+            model->data_offset < sound_trigger_sound_model_header_size(model->type)) {
+        return -EINVAL;
+    }
+
+    // write the header and data as one compact blob, dropping any gap between them
+    const size_t header_size = sound_trigger_sound_model_header_size(model->type);
+    union {
+        struct sound_trigger_sound_model common;
+        struct sound_trigger_phrase_sound_model phrase;
+        struct sound_trigger_generic_sound_model generic;
+    } header;
+    memcpy(&header, model, header_size);
+    header.common.data_offset = header_size;
+    const uint8_t *parts[2] = { (const uint8_t *) &header,
+            (const uint8_t *) model + model->data_offset };
+    const size_t sizes[2] = { header_size, model->data_size };
+
+    for (int i = 0; i < 2; ++i) {
+        const uint8_t *bytes = parts[i];
+        size_t remaining = sizes[i];
+        while (remaining > 0) {
+            ssize_t written = write(fd, bytes, remaining);
+            if (written < 0 && errno == EINTR) {
+                continue;
+            }
+            if (written <= 0) {
+                res = written < 0 ? -errno : -EIO;
+                ALOGE("%s: unable to write sound model: %s", __func__, strerror(-res));
+                return res;
+            }
+            bytes += written;
+            remaining -= written;
+        }
+    }
+    return 0;
+}
+
+const struct sound_trigger_sound_model *sound_trigger_sound_model_map(int fd)
+{
+    if (fd < 0) {
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        ALOGE("%s: unable to stat fd %d: %s", __func__, fd, strerror(errno));
+        return NULL;
+    }
+    if (st.st_size < (off_t) sizeof(struct sound_trigger_sound_model) ||
+            (uint64_t) st.st_size > UINT32_MAX) {
+        ALOGE("%s: file size %lld can't hold a sound model", __func__, (long long) st.st_size);
+        return NULL;
+    }
+    const size_t size = st.st_size;
+
+    void *mapping = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (mapping == MAP_FAILED) {
+        ALOGE("%s: unable to map fd %d: %s", __func__, fd, strerror(errno));
+        return NULL;
+    }
+    const struct sound_trigger_sound_model *model =
+            (const struct sound_trigger_sound_model *) mapping;
+    if (sound_trigger_sound_model_validate(model, size) != 0) {
+        ALOGE("%s: fd %d does not hold exactly one valid sound model", __func__, fd);
+        munmap(mapping, size);
+        return NULL;
+    }
+    return model;
+}
+
+const struct sound_trigger_sound_model *sound_trigger_sound_model_map_file(const char *path)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        ALOGE("%s: unable to open %s: %s", __func__, path, strerror(errno));
+        return NULL;
+    }
+    const struct sound_trigger_sound_model *model = sound_trigger_sound_model_map(fd);
+    close(fd);
+    return model;
+}
+
+void sound_trigger_sound_model_unmap(const struct sound_trigger_sound_model *model)
+{
+    if (model == NULL) {
+        return;
+    }
+    munmap((void *) model, sound_trigger_sound_model_size(model));
+}
@@ -0,0 +1,144 @@
+/*
+ * Copyright 2016, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "AudioSPDIF"
+//#define LOG_NDEBUG 0
+
+#include <assert.h>
+#include <string.h>
+
+#include <utils/Log.h>
+#include <audio_utils/spdif/FrameScanner.h>
+
+#include "AACFrameScanner.h"
+#include "BitFieldParser.h"
+
+namespace android {
+
+// Only the first byte of the 12-bit ADTS syncword can be matched exactly.
+// The rest is checked by parseHeader().
+const uint8_t AACFrameScanner::kSyncBytes[] = { 0xFF };
+
+// sampling_frequency_index from ISO/IEC 13818-7 table 35.
+// 7350 Hz has no matching IEC60958 frame rate.
+const int32_t AACFrameScanner::kAACSampleRateTable[AAC_NUM_SAMPLE_RATE_TABLE_ENTRIES]
+        = { 96000, 88200, 64000, 48000, 44100, 32000, 24000, 22050,
+        16000, 12000, 11025, 8000, -1, -1, -1, -1 };
+
+// Defined in IEC61937-6
+#define IEC61937_DATA_TYPE_MPEG2_AAC              7
+#define IEC61937_DATA_TYPE_MPEG2_AAC_LSF_2048    19
+#define IEC61937_DATA_TYPE_MPEG2_AAC_LSF_4096    (19 | 0x20)
+
+// The data burst must be sent at a rate of 32 kHz or more.
+#define IEC61937_MIN_AAC_BURST_RATE          32000
+
+#define ADTS_HEADER_BYTES_NEEDED                 7
+
+// Scanner for AAC ADTS byte streams.
+AACFrameScanner::AACFrameScanner()
+ : FrameScanner(IEC61937_DATA_TYPE_MPEG2_AAC,
+    AACFrameScanner::kSyncBytes,
+    sizeof(AACFrameScanner::kSyncBytes),
+    ADTS_HEADER_BYTES_NEEDED)
+ , mSampleFramesPerSyncFrame(0)
+{
+}
+
+AACFrameScanner::~AACFrameScanner()
+{
+}
+
+// Parse ADTS header.
+// Sets mDataType, mFrameSizeBytes,
+//      mSampleRate, mRateMultiplier, mSampleFramesPerSyncFrame.
+//
+// @return true if valid
+bool AACFrameScanner::parseHeader()
+{
+    BitFieldParser parser(&mHeaderBuffer[mSyncLength], mHeaderLength - mSyncLength);
+
+    // These variables are named after the fields in ISO/IEC 13818-7 paragraph 6.2
+    // Extract field in order.
+    uint32_t syncword = parser.readBits(4); // low bits of the 12-bit syncword
+    (void) /* uint32_t id = */ parser.readBits(1);
+    uint32_t layer = parser.readBits(2);
+    (void) /* uint32_t protection_absent = */ parser.readBits(1);
+    (void) /* uint32_t profile = */ parser.readBits(2);
+    uint32_t sampling_frequency_index = parser.readBits(4);
+    (void) /* uint32_t private_bit = */ parser.readBits(1);
+    (void) /* uint32_t channel_configuration = */ parser.readBits(3);
+    (void) /* uint32_t original_copy = */ parser.readBits(1);
+    (void) /* uint32_t home = */ parser.readBits(1);
+    (void) /* uint32_t copyright_identification_bit = */ parser.readBits(1);
+    (void) /* uint32_t copyright_identification_start = */ parser.readBits(1);
+    uint32_t frame_length = parser.readBits(13);
+    (void) /* uint32_t adts_buffer_fullness = */ parser.readBits(11);
+    uint32_t number_of_raw_data_blocks_in_frame = parser.readBits(2);
+    // make sure we did not read past collected data
+    ALOG_ASSERT((mSyncLength + ((parser.getBitCursor() + 7) >> 3))
+            <= mHeaderLength);
+
+    // Validate fields.
+    if (syncword != 0xF || layer != 0) {
+        ALOGV("AACFrameScanner: not an ADTS header");
+        return false;
+    }
+    if (frame_length < ADTS_HEADER_BYTES_NEEDED) {
+        ALOGE("AACFrameScanner: ERROR - frame_length = %u", frame_length);
+        return false;
+    }
+    int32_t sampleRate = kAACSampleRateTable[sampling_frequency_index];
+    if (sampleRate < 0) {
+        ALOGE("AACFrameScanner: ERROR - invalid sampleRate[%u] = %d",
+                sampling_frequency_index, sampleRate);
+        return false;
+    }
+
+    // Low sampling frequencies are sent at 2 or 4 times the rate, per IEC61937-6.
+    uint32_t rateMultiplier = 1;
+    while ((uint32_t) sampleRate * rateMultiplier < IEC61937_MIN_AAC_BURST_RATE) {
+        rateMultiplier *= 2;
+    }
+    int burstFrames = (number_of_raw_data_blocks_in_frame + 1)
+            * AAC_PCM_FRAMES_PER_BLOCK * rateMultiplier;
+    switch (burstFrames) {
+    case AAC_PCM_FRAMES_PER_BLOCK:
+        mDataType = IEC61937_DATA_TYPE_MPEG2_AAC;
+        break;
+    case 2 * AAC_PCM_FRAMES_PER_BLOCK:
+        mDataType = IEC61937_DATA_TYPE_MPEG2_AAC_LSF_2048;
+        break;
+    case 4 * AAC_PCM_FRAMES_PER_BLOCK:
+        mDataType = IEC61937_DATA_TYPE_MPEG2_AAC_LSF_4096;
+        break;
+    default:
+        ALOGE("AACFrameScanner: ERROR - %d frames per data burst not supported", burstFrames);
+        return false;
+    }
+
+    mSampleRate = (uint32_t) sampleRate;
+    mRateMultiplier = rateMultiplier;
+    mSampleFramesPerSyncFrame = burstFrames;
+    mFrameSizeBytes = frame_length;
+    ALOGI_IF((mFormatDumpCount == 0),
+            "AAC frame rate = %d * %d, size = %zu",
+            mSampleRate, mRateMultiplier, mFrameSizeBytes);
+    mFormatDumpCount++;
+    return true;
+}
+
+}  // namespace android
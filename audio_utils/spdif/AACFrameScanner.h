@@ -0,0 +1,62 @@
+/*
+ * Copyright 2016, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_AUDIO_AAC_FRAME_SCANNER_H
+#define ANDROID_AUDIO_AAC_FRAME_SCANNER_H
+
+#include <stdint.h>
+#include <audio_utils/spdif/FrameScanner.h>
+
+namespace android {
+
+#define AAC_NUM_SAMPLE_RATE_TABLE_ENTRIES      16
+#define AAC_PCM_FRAMES_PER_BLOCK             1024
+#define AAC_MAX_BURST_FRAMES                 4096
+
+/**
+ * Scanner for MPEG-2/4 AAC in ADTS frames, as wrapped by IEC61937-6.
+ */
+class AACFrameScanner : public FrameScanner
+{
+public:
+    AACFrameScanner();
+    virtual ~AACFrameScanner();
+
+    virtual int getMaxChannels()   const { return 7 + 1; }
+
+    virtual int getMaxSampleFramesPerSyncFrame() const { return AAC_MAX_BURST_FRAMES; }
+
+    virtual int getSampleFramesPerSyncFrame() const {
+        return mSampleFramesPerSyncFrame;
+    }
+
+    virtual bool isFirstInBurst() { return true; }
+    virtual bool isLastInBurst() { return true; }
+    virtual void resetBurst()  { }
+
+protected:
+
+    int mSampleFramesPerSyncFrame;
+
+    virtual bool parseHeader();
+
+    static const uint8_t kSyncBytes[];
+    static const int32_t kAACSampleRateTable[];
+};
+
+}  // namespace android
+
+#endif  // ANDROID_AUDIO_AAC_FRAME_SCANNER_H
@@ -8,9 +8,12 @@ LOCAL_MODULE_TAGS := optional
 LOCAL_SRC_FILES:= \
 	BitFieldParser.cpp \
 	FrameScanner.cpp \
+	AACFrameScanner.cpp \
 	AC3FrameScanner.cpp \
 	DTSFrameScanner.cpp \
-	SPDIFEncoder.cpp
+	TrueHDFrameScanner.cpp \
+	SPDIFEncoder.cpp \
+	SPDIFDecoder.cpp
 
 LOCAL_C_INCLUDES += $(call include-path-for, audio-utils)
 
@@ -19,4 +22,7 @@ LOCAL_SHARED_LIBRARIES := \
 	liblog
 
 LOCAL_CFLAGS := -Werror -Wall
+# Uncomment both to record the trace point of SPDIFEncoder::write(), see <audio_utils/trace.h>
+#LOCAL_CFLAGS += -DAUDIO_UTILS_TRACE
+#LOCAL_SHARED_LIBRARIES += libaudioutils
 include $(BUILD_SHARED_LIBRARY)
@@ -25,8 +25,12 @@
 
 namespace android {
 
-BitFieldParser::BitFieldParser(uint8_t *data)
+BitFieldParser::BitFieldParser(const uint8_t *data, size_t numBytes)
  : mData(data)
+ , mNumBytes(numBytes)
+ , mByteCursor(0)
+ , mCache(0)
+ , mCacheBits(0)
  , mBitCursor(0)
 {
 }
@@ -35,26 +39,24 @@ BitFieldParser::~BitFieldParser()
 {
 }
 
-uint32_t BitFieldParser::readBits(uint32_t numBits)
+// Top up the cache to at least 57 bits, or to the end of the data.
+void BitFieldParser::refill()
 {
-    ALOG_ASSERT(numBits <= 32);
-
-    // Extract some bits from the current byte.
-    uint32_t byteCursor = mBitCursor >> 3; // 8 bits per byte
-    uint8_t byte = mData[byteCursor];
-
-    uint32_t bitsLeftInByte = 8 - (mBitCursor & 7);
-    uint32_t bitsFromByte = (bitsLeftInByte < numBits) ? bitsLeftInByte : numBits;
-    uint32_t result = byte >> (bitsLeftInByte - bitsFromByte);
-    result &= (1 << bitsFromByte) - 1; // mask
-    mBitCursor += bitsFromByte;
-
-    uint32_t bitsRemaining = numBits - bitsFromByte;
-    if (bitsRemaining == 0) {
-        return result;
+    if (mNumBytes - mByteCursor >= sizeof(uint64_t)) {
+        // One unaligned load, of which only the whole bytes that fit are consumed.
+        uint64_t bytes;
+        memcpy(&bytes, &mData[mByteCursor], sizeof(bytes));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        bytes = __builtin_bswap64(bytes);
+#endif
+        mCache |= bytes >> mCacheBits;
+        mByteCursor += (63 - mCacheBits) >> 3;
+        mCacheBits |= 56;
     } else {
-        // Use recursion to get remaining bits.
-        return (result << bitsRemaining) | readBits(bitsRemaining);
+        while (mCacheBits <= 56 && mByteCursor < mNumBytes) {
+            mCache |= (uint64_t) mData[mByteCursor++] << (56 - mCacheBits);
+            mCacheBits += 8;
+        }
     }
 }
 
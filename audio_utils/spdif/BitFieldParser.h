@@ -17,37 +17,84 @@
 #ifndef ANDROID_AUDIO_BIT_FIELD_PARSER_H
 #define ANDROID_AUDIO_BIT_FIELD_PARSER_H
 
+#include <stddef.h>
 #include <stdint.h>
 
 namespace android {
 
 /**
  * Extract bit fields from a byte array.
+ * Bits are taken from a 64-bit cache, which is refilled 8 bytes at a time,
+ * so reading a field only costs a few shifts.
  */
 class BitFieldParser {
 public:
 
-    BitFieldParser(uint8_t *data);
+    /**
+     * @param data Big Endian bit fields
+     * @param numBytes size of data. Reading past the end returns zero bits.
+     */
+    BitFieldParser(const uint8_t *data, size_t numBytes);
     virtual ~BitFieldParser();
 
     /**
-     * Read numBits bits from the data array.
+     * Read numBits bits from the data array without consuming them.
      * Fields may span byte boundaries but may not exceed 32-bits.
-     * Note that the caller must ensure that there is suffcient data.
      * Assume data is organized as BigEndian format.
      */
-    uint32_t readBits(uint32_t numBits);
+    uint32_t peekBits(uint32_t numBits) {
+        if (numBits == 0) {
+            return 0;
+        }
+        if (mCacheBits < numBits) {
+            refill();
+        }
+        return (uint32_t) (mCache >> (64 - numBits));
+    }
+
+    /**
+     * Skip numBits bits, which may be more than 32.
+     */
+    void skipBits(uint32_t numBits) {
+        mBitCursor += numBits;
+        while (numBits > mCacheBits) {
+            numBits -= mCacheBits;
+            mCache = 0;
+            mCacheBits = 0;
+            refill();
+            if (mCacheBits == 0) {
+                return; // past the end
+            }
+        }
+        // A shift of 64 is undefined, so consume in two steps.
+        mCache = (mCache << (numBits >> 1)) << (numBits - (numBits >> 1));
+        mCacheBits -= numBits;
+    }
+
+    /**
+     * Read and consume numBits bits, at most 32.
+     */
+    uint32_t readBits(uint32_t numBits) {
+        uint32_t result = peekBits(numBits);
+        skipBits(numBits);
+        return result;
+    }
 
     /*
      * When the cursor is zero it points to a position right before
-     * the most significant bit.
-     * When the cursor is seven it points to a position right before
-     * the least significant bit.
+     * the most significant bit of the first byte.
+     * It counts the bits consumed since then.
      */
     uint32_t getBitCursor() const { return mBitCursor; }
 
 private:
-    uint8_t *mData;
+    void refill();
+
+    const uint8_t *mData;
+    size_t   mNumBytes;
+    size_t   mByteCursor;   // next byte to load into the cache
+    uint64_t mCache;        // next bits to read, starting from the MSB
+    uint32_t mCacheBits;    // number of valid bits in mCache
     uint32_t mBitCursor;
 };
 
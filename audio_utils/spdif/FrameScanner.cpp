@@ -76,4 +76,53 @@ bool FrameScanner::scan(uint8_t byte)
     return result;
 }
 
+// Same states as scan(uint8_t), but skips to sync word candidates and copies the header.
+size_t FrameScanner::scan(const uint8_t *data, size_t numBytes, bool *found)
+{
+    size_t consumed = 0;
+    *found = false;
+    while (consumed < numBytes) {
+        assert(mCursor < sizeof(mHeaderBuffer));
+        if (mCursor == 0) {
+            // skip to the next candidate for the first byte of the sync word
+            const uint8_t *candidate = (const uint8_t *) memchr(&data[consumed], mSyncBytes[0],
+                    numBytes - consumed);
+            size_t skipped = (candidate == NULL) ? numBytes - consumed
+                    : candidate - &data[consumed];
+            mBytesSkipped += skipped;
+            consumed += skipped;
+            if (candidate == NULL) {
+                break;
+            }
+            mHeaderBuffer[mCursor++] = data[consumed++];
+        } else if (mCursor < mSyncLength) {
+            // match the rest of the sync word
+            uint8_t byte = data[consumed++];
+            if (byte == mSyncBytes[mCursor]) {
+                mHeaderBuffer[mCursor++] = byte;
+            } else {
+                mBytesSkipped += 1; // skip unsynchronized data
+                mCursor = 0;
+            }
+        } else {
+            // gather as much of the header as is available
+            size_t needed = mHeaderLength - mCursor;
+            size_t available = numBytes - consumed;
+            size_t count = (needed < available) ? needed : available;
+            memcpy(&mHeaderBuffer[mCursor], &data[consumed], count);
+            mCursor += count;
+            consumed += count;
+            if (mCursor >= mHeaderLength) {
+                mCursor = 0;
+                if (parseHeader()) {
+                    *found = true;
+                    break;
+                }
+                ALOGE("FrameScanner: ERROR - parseHeader() failed.");
+            }
+        }
+    }
+    return consumed;
+}
+
 }  // namespace android
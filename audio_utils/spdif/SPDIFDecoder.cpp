@@ -0,0 +1,246 @@
+/*
+ * Copyright 2016, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+
+#define LOG_TAG "AudioSPDIF"
+#include <utils/Log.h>
+#include <audio_utils/spdif/SPDIFDecoder.h>
+#include <audio_utils/spdif/SPDIFEncoder.h>
+
+#include "AACFrameScanner.h"
+#include "AC3FrameScanner.h"
+#include "DTSFrameScanner.h"
+#include "SwapBytes.h"
+
+namespace android {
+
+// Data types of the burst info Pc, as defined in IEC61937-2 paragraph 4.2
+#define IEC61937_DATA_TYPE_MASK      0x7F
+#define IEC61937_DATA_TYPE_AC3          1
+#define IEC61937_DATA_TYPE_MPEG2_AAC    7
+#define IEC61937_DATA_TYPE_DTS_I       11
+#define IEC61937_DATA_TYPE_DTS_II      12
+#define IEC61937_DATA_TYPE_DTS_III     13
+#define IEC61937_DATA_TYPE_DTS_IV      17
+#define IEC61937_DATA_TYPE_MPEG2_AAC_LSF_2048  19
+#define IEC61937_DATA_TYPE_MPEG2_AAC_LSF_4096  (19 | 0x20)
+#define IEC61937_DATA_TYPE_E_AC3       21
+
+SPDIFDecoder::SPDIFDecoder(audio_format_t format)
+  : mFormat(audio_get_main_format(format))
+  , mFramer(NULL)
+  , mPayloadBuffer(NULL)
+  , mPayloadBufferSizeBytes(0)
+  , mPayloadSizeBytes(0)
+  , mPayloadShortsRead(0)
+  , mPreambleCount(0)
+{
+    switch(mFormat) {
+        case AUDIO_FORMAT_AC3:
+        case AUDIO_FORMAT_E_AC3:
+            mFramer = new AC3FrameScanner();
+            break;
+        case AUDIO_FORMAT_DTS:
+        case AUDIO_FORMAT_DTS_HD:
+            mFramer = new DTSFrameScanner();
+            break;
+        case AUDIO_FORMAT_AAC_ADTS:
+            mFramer = new AACFrameScanner();
+            break;
+        default:
+            break;
+    }
+
+    // This a programmer error. Call isFormatSupported() first.
+    LOG_ALWAYS_FATAL_IF((mFramer == NULL),
+        "SPDIFDecoder: invalid audio format = 0x%08X", format);
+
+    // Same as the largest data burst of SPDIFEncoder, which includes the preamble.
+    mPayloadBufferSizeBytes = sizeof(uint16_t)
+            * SPDIF_ENCODED_CHANNEL_COUNT
+            * mFramer->getMaxSampleFramesPerSyncFrame();
+    mPayloadBuffer = new uint8_t[mPayloadBufferSizeBytes];
+}
+
+SPDIFDecoder::~SPDIFDecoder()
+{
+    delete[] mPayloadBuffer;
+    delete mFramer;
+}
+
+// MAT frames would need to be split into TrueHD access units, so they are not supported.
+bool SPDIFDecoder::isFormatSupported(audio_format_t format)
+{
+    switch(audio_get_main_format(format)) {
+        case AUDIO_FORMAT_AC3:
+        case AUDIO_FORMAT_E_AC3:
+        case AUDIO_FORMAT_DTS:
+        case AUDIO_FORMAT_DTS_HD:
+        case AUDIO_FORMAT_AAC_ADTS:
+            return true;
+        default:
+            return false;
+    }
+}
+
+void SPDIFDecoder::reset()
+{
+    ALOGV("SPDIFDecoder: reset()");
+    mPayloadSizeBytes = 0;
+    mPayloadShortsRead = 0;
+    mPreambleCount = 0;
+    mFramer->resetScan();
+    mFramer->resetBurst();
+}
+
+bool SPDIFDecoder::isDataTypeSupported(int dataType) const
+{
+    switch (dataType) {
+        case IEC61937_DATA_TYPE_AC3:
+        case IEC61937_DATA_TYPE_E_AC3:
+            return mFormat == AUDIO_FORMAT_AC3 || mFormat == AUDIO_FORMAT_E_AC3;
+        case IEC61937_DATA_TYPE_DTS_I:
+        case IEC61937_DATA_TYPE_DTS_II:
+        case IEC61937_DATA_TYPE_DTS_III:
+        case IEC61937_DATA_TYPE_DTS_IV:
+            return mFormat == AUDIO_FORMAT_DTS || mFormat == AUDIO_FORMAT_DTS_HD;
+        case IEC61937_DATA_TYPE_MPEG2_AAC:
+        case IEC61937_DATA_TYPE_MPEG2_AAC_LSF_2048:
+        case IEC61937_DATA_TYPE_MPEG2_AAC_LSF_4096:
+            return mFormat == AUDIO_FORMAT_AAC_ADTS;
+        default:
+            return false; // including NULL and PAUSE bursts, which carry no frames
+    }
+}
+
+// Interpret the burst info Pc and the length code Pd of a complete preamble.
+void SPDIFDecoder::startPayload()
+{
+    const int dataType = mPreamble[2] & IEC61937_DATA_TYPE_MASK;
+    if (!isDataTypeSupported(dataType)) {
+        ALOGV("SPDIFDecoder: skipping burst with data type %d", dataType);
+        return;
+    }
+    // Per IEC 61973-3:5.3.3, for E-AC3 burst-length is in bytes. Otherwise it is in bits.
+    const size_t lengthCode = mPreamble[3];
+    const size_t numBytes = (dataType == IEC61937_DATA_TYPE_E_AC3)
+            ? lengthCode : (lengthCode + 7) >> 3;
+    if (numBytes > mPayloadBufferSizeBytes) {
+        ALOGE("SPDIFDecoder: burst payload too large, %zu bytes", numBytes);
+        return;
+    }
+    mPayloadSizeBytes = numBytes;
+    mPayloadShortsRead = 0;
+}
+
+// Pass on each complete encoded frame of a payload.
+void SPDIFDecoder::writeFrames(const uint8_t *payload, size_t numBytes)
+{
+    mFramer->resetScan();
+    mFramer->resetBurst();
+    size_t offset = 0;
+    while (offset < numBytes) {
+        bool found;
+        size_t consumed = mFramer->scan(&payload[offset], numBytes - offset, &found);
+        if (!found) {
+            break;
+        }
+        // The header was gathered entirely from this payload, after resetScan().
+        const size_t start = offset + consumed - mFramer->getHeaderSizeBytes();
+        const size_t frameSize = mFramer->getFrameSizeBytes();
+        if (frameSize > numBytes - start) {
+            ALOGE("SPDIFDecoder: encoded frame of %zu bytes truncated to %zu",
+                    frameSize, numBytes - start);
+            break;
+        }
+        writeOutput(&payload[start], frameSize);
+        offset = start + frameSize;
+    }
+}
+
+// Unwraps encoded frames from data bursts.
+ssize_t SPDIFDecoder::write(void *buffer, size_t numBytes)
+{
+    if ((numBytes & 1) || ((uintptr_t) buffer & 1)) {
+        return -EINVAL;
+    }
+    uint16_t *data = (uint16_t *) buffer;
+    const size_t numShorts = numBytes >> 1;
+    // First byte in memory of the Pa sync word, to find candidates with memchr().
+    const uint16_t sync1 = SPDIFEncoder::kSPDIFSync1;
+    const uint8_t sync1First = *(const uint8_t *) &sync1;
+    size_t index = 0;
+    while (index < numShorts) {
+        if (mPayloadSizeBytes > 0) {
+            // Unwrap payload until we hit the end of the burst.
+            const size_t payloadShorts = (mPayloadSizeBytes + 1) >> 1;
+            const size_t available = numShorts - index;
+            if (mPayloadShortsRead == 0 && available >= payloadShorts) {
+                // The whole payload is here, so convert it where it is.
+                swapBytePairs(&data[index], &data[index], payloadShorts);
+                writeFrames((const uint8_t *) &data[index], mPayloadSizeBytes);
+                index += payloadShorts;
+                mPayloadSizeBytes = 0;
+                continue;
+            }
+            size_t count = payloadShorts - mPayloadShortsRead;
+            if (count > available) {
+                count = available;
+            }
+            swapBytePairs(&mPayloadBuffer[mPayloadShortsRead * sizeof(uint16_t)],
+                    &data[index], count);
+            index += count;
+            mPayloadShortsRead += count;
+            if (mPayloadShortsRead == payloadShorts) {
+                writeFrames(mPayloadBuffer, mPayloadSizeBytes);
+                mPayloadSizeBytes = 0;
+            }
+        } else if (mPreambleCount == 0) {
+            // Skip padding to the next candidate for Pa, which must be on a short boundary.
+            const uint8_t *bytes = (const uint8_t *) data;
+            const uint8_t *candidate = (const uint8_t *) memchr(&bytes[index << 1], sync1First,
+                    numBytes - (index << 1));
+            if (candidate == NULL) {
+                break;
+            }
+            const size_t offset = candidate - bytes;
+            index = offset >> 1;
+            if ((offset & 1) == 0 && data[index] == SPDIFEncoder::kSPDIFSync1) {
+                mPreamble[mPreambleCount++] = data[index];
+            }
+            index++;
+        } else {
+            const uint16_t word = data[index];
+            if (mPreambleCount == 1 && word != SPDIFEncoder::kSPDIFSync2) {
+                // Not a preamble, but this word could be the start of one.
+                mPreambleCount = 0;
+                continue;
+            }
+            mPreamble[mPreambleCount++] = word;
+            index++;
+            if (mPreambleCount == 4) {
+                mPreambleCount = 0;
+                startPayload();
+            }
+        }
+    }
+    return numBytes;
+}
+
+}  // namespace android
@@ -14,15 +14,21 @@
  * limitations under the License.
  */
 
+#include <inttypes.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <string.h>
 
 #define LOG_TAG "AudioSPDIF"
 #include <utils/Log.h>
 #include <audio_utils/spdif/SPDIFEncoder.h>
+#include <audio_utils/trace.h>
 
+#include "AACFrameScanner.h"
 #include "AC3FrameScanner.h"
 #include "DTSFrameScanner.h"
+#include "SwapBytes.h"
+#include "TrueHDFrameScanner.h"
 
 namespace android {
 
@@ -37,15 +43,18 @@ SPDIFEncoder::SPDIFEncoder(audio_format_t format)
   : mFramer(NULL)
   , mSampleRate(48000)
   , mBurstBuffer(NULL)
+  , mBurst(NULL)
   , mBurstBufferSizeBytes(0)
   , mRateMultiplier(1)
   , mBurstFrames(0)
   , mByteCursor(0)
   , mBitstreamNumber(0)
   , mPayloadBytesPending(0)
+  , mFramesInBurst(0)
   , mScanning(true)
 {
-    switch(format) {
+    memset(&mStats, 0, sizeof(mStats));
+    switch(audio_get_main_format(format)) {
         case AUDIO_FORMAT_AC3:
         case AUDIO_FORMAT_E_AC3:
             mFramer = new AC3FrameScanner();
@@ -54,6 +63,12 @@ SPDIFEncoder::SPDIFEncoder(audio_format_t format)
         case AUDIO_FORMAT_DTS_HD:
             mFramer = new DTSFrameScanner();
             break;
+        case AUDIO_FORMAT_AAC_ADTS:
+            mFramer = new AACFrameScanner();
+            break;
+        case AUDIO_FORMAT_DOLBY_TRUEHD:
+            mFramer = new TrueHDFrameScanner();
+            break;
         default:
             break;
     }
@@ -69,6 +84,7 @@ SPDIFEncoder::SPDIFEncoder(audio_format_t format)
     ALOGI("SPDIFEncoder: mBurstBufferSizeBytes = %zu, littleEndian = %d",
             mBurstBufferSizeBytes, isLittleEndian());
     mBurstBuffer = new uint16_t[mBurstBufferSizeBytes >> 1];
+    mBurst = mBurstBuffer;
     clearBurstBuffer();
 }
 
@@ -79,23 +95,49 @@ SPDIFEncoder::SPDIFEncoder()
 
 SPDIFEncoder::~SPDIFEncoder()
 {
+    // A burst obtained from the subclass cannot be released here, as the subclass
+    // has already been destroyed.
     delete[] mBurstBuffer;
     delete mFramer;
 }
 
 bool SPDIFEncoder::isFormatSupported(audio_format_t format)
 {
-    switch(format) {
+    switch(audio_get_main_format(format)) {
         case AUDIO_FORMAT_AC3:
         case AUDIO_FORMAT_E_AC3:
         case AUDIO_FORMAT_DTS:
         case AUDIO_FORMAT_DTS_HD:
+        case AUDIO_FORMAT_AAC_ADTS:
+        case AUDIO_FORMAT_DOLBY_TRUEHD:
             return true;
         default:
             return false;
     }
 }
 
+SPDIFEncoder::Stats SPDIFEncoder::getStats() const
+{
+    Stats stats = mStats;
+    stats.bytesSkipped = mFramer->getBytesSkipped();
+    return stats;
+}
+
+void SPDIFEncoder::dump(int fd) const
+{
+    const Stats stats = getStats();
+    dprintf(fd, "  data type: %d, rate: %u * %u\n",
+            mFramer->getDataType(), mFramer->getSampleRate(), mRateMultiplier);
+    dprintf(fd, "  bytes written: %" PRIu64 ", skipped: %" PRIu64 "\n",
+            stats.bytesWritten, stats.bytesSkipped);
+    dprintf(fd, "  sync frames: %" PRIu64 ", bursts: %" PRIu64 ", max frames per burst: %u\n",
+            stats.syncFrames, stats.bursts, stats.maxFramesInBurst);
+    dprintf(fd, "  burst bytes: %" PRIu64 ", payload: %" PRIu64 ", zero pad: %" PRIu64
+            " (%.1f%%)\n", stats.burstBytes, stats.payloadBytes, stats.zeroPadBytes,
+            stats.burstBytes == 0 ? 0. : 100. * stats.zeroPadBytes / stats.burstBytes);
+    dprintf(fd, "  overflows: %u\n", stats.overflows);
+}
+
 int SPDIFEncoder::getBytesPerOutputFrame()
 {
     return SPDIF_ENCODED_CHANNEL_COUNT * sizeof(int16_t);
@@ -104,15 +146,16 @@ int SPDIFEncoder::getBytesPerOutputFrame()
 void SPDIFEncoder::writeBurstBufferShorts(const uint16_t *buffer, size_t numShorts)
 {
     // avoid static analyser warning
-    LOG_ALWAYS_FATAL_IF((mBurstBuffer == NULL), "mBurstBuffer never allocated");
+    LOG_ALWAYS_FATAL_IF((mBurst == NULL), "mBurstBuffer never allocated");
     mByteCursor = (mByteCursor + 1) & ~1; // round up to even byte
     size_t bytesToWrite = numShorts * sizeof(uint16_t);
     if ((mByteCursor + bytesToWrite) > mBurstBufferSizeBytes) {
         ALOGE("SPDIFEncoder: Burst buffer overflow!");
+        mStats.overflows++;
         reset();
         return;
     }
-    memcpy(&mBurstBuffer[mByteCursor >> 1], buffer, bytesToWrite);
+    memcpy(&mBurst[mByteCursor >> 1], buffer, bytesToWrite);
     mByteCursor += bytesToWrite;
 }
 
@@ -126,26 +169,91 @@ void SPDIFEncoder::writeBurstBufferShorts(const uint16_t *buffer, size_t numShor
 // Big and Little Endian CPUs.
 void SPDIFEncoder::writeBurstBufferBytes(const uint8_t *buffer, size_t numBytes)
 {
-    size_t bytesToWrite = numBytes;
-    if ((mByteCursor + bytesToWrite) > mBurstBufferSizeBytes) {
+    if ((mByteCursor + numBytes) > mBurstBufferSizeBytes) {
         ALOGE("SPDIFEncoder: Burst buffer overflow!");
+        mStats.overflows++;
         clearBurstBuffer();
         return;
     }
-    uint16_t pad = mBurstBuffer[mByteCursor >> 1];
-    for (size_t i = 0; i < bytesToWrite; i++) {
-        if (mByteCursor & 1 ) {
-            pad |= *buffer++; // put second byte in LSB
-            mBurstBuffer[mByteCursor >> 1] = pad;
-            pad = 0;
-        } else {
-            pad |= (*buffer++) << 8; // put first byte in MSB
-        }
+    if (numBytes == 0) {
+        return;
+    }
+    // Complete a partially filled short, whose MSB was written last time.
+    if (mByteCursor & 1) {
+        mBurst[mByteCursor >> 1] |= *buffer++;
         mByteCursor++;
+        numBytes--;
+    }
+    const size_t numShorts = numBytes >> 1;
+    swapBytePairs(&mBurst[mByteCursor >> 1], buffer, numShorts);
+    mByteCursor += numShorts * sizeof(uint16_t);
+    // Save partially filled short, with a zero LSB in case it ends the payload.
+    if (numBytes & 1) {
+        mBurst[mByteCursor >> 1] = buffer[numBytes - 1] << 8;
+        mByteCursor++;
+    }
+}
+
+// A trailing odd byte already has a zero LSB, so only whole shorts need to be cleared.
+void SPDIFEncoder::writeBurstBufferZeros(size_t numBytes)
+{
+    if ((mByteCursor + numBytes) > mBurstBufferSizeBytes) {
+        ALOGE("SPDIFEncoder: Burst buffer overflow!");
+        mStats.overflows++;
+        clearBurstBuffer();
+        return;
+    }
+    const size_t start = (mByteCursor + 1) & ~1;
+    const size_t end = (mByteCursor + numBytes + 1) & ~1;
+    if (end > start) {
+        memset((uint8_t *) mBurst + start, 0, end - start);
+    }
+    mByteCursor += numBytes;
+}
+
+// Write encoded data to the payload.
+// For MAT, the middle code is inserted when the data reaches its position.
+void SPDIFEncoder::writePayloadBytes(const uint8_t *buffer, size_t numBytes)
+{
+    if (mFramer->getDataType() != IEC61937_DATA_TYPE_MAT) {
+        writeBurstBufferBytes(buffer, numBytes);
+        return;
     }
-    // Save partially filled short.
-    if (mByteCursor & 1 ){
-        mBurstBuffer[mByteCursor >> 1] = pad;
+    while (numBytes > 0) {
+        if (mByteCursor == MAT_MIDDLE_CODE_OFFSET) {
+            writeBurstBufferBytes(TrueHDFrameScanner::kMATMiddleCode,
+                    sizeof(TrueHDFrameScanner::kMATMiddleCode));
+        }
+        size_t bytesToWrite = numBytes;
+        if (mByteCursor < MAT_MIDDLE_CODE_OFFSET
+                && (mByteCursor + bytesToWrite) > MAT_MIDDLE_CODE_OFFSET) {
+            bytesToWrite = MAT_MIDDLE_CODE_OFFSET - mByteCursor;
+        }
+        if ((mByteCursor + bytesToWrite) > MAT_END_CODE_OFFSET) {
+            ALOGE("SPDIFEncoder: MAT frame overflow!");
+            mStats.overflows++;
+            clearBurstBuffer();
+            return;
+        }
+        writeBurstBufferBytes(buffer, bytesToWrite);
+        buffer += bytesToWrite;
+        numBytes -= bytesToWrite;
+    }
+}
+
+// Pad a MAT frame with zeros up to a position in the burst, including the middle code
+// if it is reached.
+void SPDIFEncoder::padMATFrame(size_t position)
+{
+    while (mByteCursor < position) {
+        if (mByteCursor == MAT_MIDDLE_CODE_OFFSET) {
+            writeBurstBufferBytes(TrueHDFrameScanner::kMATMiddleCode,
+                    sizeof(TrueHDFrameScanner::kMATMiddleCode));
+        } else if (mByteCursor < MAT_MIDDLE_CODE_OFFSET && position > MAT_MIDDLE_CODE_OFFSET) {
+            writeBurstBufferZeros(MAT_MIDDLE_CODE_OFFSET - mByteCursor);
+        } else {
+            writeBurstBufferZeros(position - mByteCursor);
+        }
     }
 }
 
@@ -156,11 +264,12 @@ void SPDIFEncoder::sendZeroPad()
             * SPDIF_ENCODED_CHANNEL_COUNT;
     if (mByteCursor > burstSize) {
         ALOGE("SPDIFEncoder: Burst buffer, contents too large!");
+        mStats.overflows++;
         clearBurstBuffer();
     } else {
-        // We don't have to write zeros because buffer already set to zero
-        // by clearBurstBuffer(). Just pretend we wrote zeros by
-        // incrementing cursor.
+        // A trailing odd byte already has a zero LSB, so start at the next short.
+        const size_t padStart = (mByteCursor + 1) & ~1;
+        memset((uint8_t *) mBurst + padStart, 0, burstSize - padStart);
         mByteCursor = burstSize;
     }
 }
@@ -168,6 +277,15 @@ void SPDIFEncoder::sendZeroPad()
 void SPDIFEncoder::reset()
 {
     ALOGV("SPDIFEncoder: reset()");
+    if (mFramer != NULL) {
+        mFramer->resetScan();
+    }
+    endBurst();
+}
+
+// Get ready for the next data burst, without losing sync with the encoded stream.
+void SPDIFEncoder::endBurst()
+{
     clearBurstBuffer();
     if (mFramer != NULL) {
         mFramer->resetBurst();
@@ -180,20 +298,43 @@ void SPDIFEncoder::flushBurstBuffer()
 {
     const int preambleSize = 4 * sizeof(uint16_t);
     if (mByteCursor > preambleSize) {
+        if (mFramer->getDataType() == IEC61937_DATA_TYPE_MAT) {
+            padMATFrame(MAT_END_CODE_OFFSET);
+            writeBurstBufferBytes(TrueHDFrameScanner::kMATEndCode,
+                    sizeof(TrueHDFrameScanner::kMATEndCode));
+        }
         // Set lengthCode for valid payload before zeroPad.
         uint16_t numBytes = (mByteCursor - preambleSize);
-        mBurstBuffer[3] = mFramer->convertBytesToLengthCode(numBytes);
+        mBurst[3] = mFramer->convertBytesToLengthCode(numBytes);
 
         sendZeroPad();
-        writeOutput(mBurstBuffer, mByteCursor);
+        if (mByteCursor > 0) {
+            mStats.bursts++;
+            mStats.burstBytes += mByteCursor;
+            mStats.payloadBytes += numBytes;
+            mStats.zeroPadBytes += mByteCursor - preambleSize - numBytes;
+            if (mFramesInBurst > mStats.maxFramesInBurst) {
+                mStats.maxFramesInBurst = mFramesInBurst;
+            }
+        }
+        if (mBurst != mBurstBuffer) {
+            mBurst = mBurstBuffer;
+            releaseOutputBuffer(mByteCursor);
+        } else {
+            writeOutput(mBurstBuffer, mByteCursor);
+        }
     }
-    reset();
+    endBurst();
 }
 
+// Every byte of a burst is written before it is output, including the zero padding,
+// so the buffer itself does not need to be cleared.
 void SPDIFEncoder::clearBurstBuffer()
 {
-    if (mBurstBuffer) {
-        memset(mBurstBuffer, 0, mBurstBufferSizeBytes);
+    if (mBurst != mBurstBuffer) {
+        // Discard a burst that was being assembled in the subclass buffer.
+        mBurst = mBurstBuffer;
+        releaseOutputBuffer(0);
     }
     mByteCursor = 0;
 }
@@ -209,32 +350,56 @@ void SPDIFEncoder::startDataBurst()
 
     mRateMultiplier = mFramer->getRateMultiplier();
 
+    // Assemble the burst in place in the output, if the subclass provides a buffer.
+    void *output = obtainOutputBuffer(mBurstBufferSizeBytes);
+    if (output != NULL) {
+        mBurst = (uint16_t *) output;
+    }
+
     preamble[0] = kSPDIFSync1;
     preamble[1] = kSPDIFSync2;
     preamble[2] = burstInfo;
     preamble[3] = 0; // lengthCode - This will get set after the buffer is full.
     writeBurstBufferShorts(preamble, 4);
+    mFramesInBurst = 0;
+
+    if (mFramer->getDataType() == IEC61937_DATA_TYPE_MAT) {
+        writeBurstBufferBytes(TrueHDFrameScanner::kMATStartCode,
+                sizeof(TrueHDFrameScanner::kMATStartCode));
+    }
 }
 
 size_t SPDIFEncoder::startSyncFrame()
 {
+    // Each access unit of a MAT frame starts in its own slot.
+    if (mFramer->getDataType() == IEC61937_DATA_TYPE_MAT) {
+        padMATFrame(mFramesInBurst * MAT_SLOT_BYTES);
+    }
+    mFramesInBurst++;
+    mStats.syncFrames++;
     // Write start of encoded frame that was buffered in frame detector.
     size_t syncSize = mFramer->getHeaderSizeBytes();
-    writeBurstBufferBytes(mFramer->getHeaderAddress(), syncSize);
+    writePayloadBytes(mFramer->getHeaderAddress(), syncSize);
     return mFramer->getFrameSizeBytes() - syncSize;
 }
 
 // Wraps raw encoded data into a data burst.
 ssize_t SPDIFEncoder::write( const void *buffer, size_t numBytes )
 {
+    AUDIO_UTILS_TRACE_SCOPE("SPDIFEncoder::write");
     size_t bytesLeft = numBytes;
     const uint8_t *data = (const uint8_t *)buffer;
+    mStats.bytesWritten += numBytes;
     ALOGV("SPDIFEncoder: mScanning = %d, write(buffer[0] = 0x%02X, numBytes = %zu)",
         mScanning, (uint) *data, numBytes);
     while (bytesLeft > 0) {
         if (mScanning) {
-        // Look for beginning of next encoded frame.
-            if (mFramer->scan(*data)) {
+            // Look for beginning of next encoded frame.
+            bool found;
+            size_t consumed = mFramer->scan(data, bytesLeft, &found);
+            data += consumed;
+            bytesLeft -= consumed;
+            if (found) {
                 if (mByteCursor == 0) {
                     startDataBurst();
                 } else if (mFramer->isFirstInBurst()) {
@@ -245,8 +410,6 @@ ssize_t SPDIFEncoder::write( const void *buffer, size_t numBytes )
                 mPayloadBytesPending = startSyncFrame();
                 mScanning = false;
             }
-            data++;
-            bytesLeft--;
         } else {
             // Write payload until we hit end of frame.
             size_t bytesToWrite = bytesLeft;
@@ -254,7 +417,7 @@ ssize_t SPDIFEncoder::write( const void *buffer, size_t numBytes )
             if (bytesToWrite > mPayloadBytesPending) {
                 bytesToWrite = mPayloadBytesPending;
             }
-            writeBurstBufferBytes(data, bytesToWrite);
+            writePayloadBytes(data, bytesToWrite);
 
             data += bytesToWrite;
             bytesLeft -= bytesToWrite;
@@ -0,0 +1,71 @@
+/*
+ * Copyright 2016, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_AUDIO_SPDIF_SWAP_BYTES_H
+#define ANDROID_AUDIO_SPDIF_SWAP_BYTES_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/cdefs.h>
+
+#include "../private/private.h"
+
+namespace android {
+
+/**
+ * Convert count shorts between the byte order of an encoded stream and the shorts
+ * of an SPDIF data burst, which carry the first byte of each pair in the MSB.
+ * This swaps the bytes of each pair on little endian CPUs and copies them otherwise.
+ * src and dst need not be aligned, and may be the same for an in place conversion.
+ */
+static inline void swapBytePairs(void *dst, const void *src, size_t count)
+{
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    if (dst != src) {
+        memmove(dst, src, count * sizeof(uint16_t));
+    }
+#else
+    const uint8_t *in = (const uint8_t *) src;
+    uint8_t *out = (uint8_t *) dst;
+#if defined(USE_NEON)
+    for (; count >= 8; count -= 8) {
+        vst1q_u8(out, vrev16q_u8(vld1q_u8(in)));
+        in += 16;
+        out += 16;
+    }
+#elif defined(USE_SSE2)
+    for (; count >= 8; count -= 8) {
+        const __m128i pairs = _mm_loadu_si128((const __m128i *) in);
+        _mm_storeu_si128((__m128i *) out,
+                _mm_or_si128(_mm_slli_epi16(pairs, 8), _mm_srli_epi16(pairs, 8)));
+        in += 16;
+        out += 16;
+    }
+#endif
+    for (; count > 0; --count) {
+        const uint8_t first = in[0];
+        out[0] = in[1];
+        out[1] = first;
+        in += 2;
+        out += 2;
+    }
+#endif
+}
+
+}  // namespace android
+
+#endif  // ANDROID_AUDIO_SPDIF_SWAP_BYTES_H
@@ -0,0 +1,156 @@
+/*
+ * Copyright 2016, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "AudioSPDIF"
+//#define LOG_NDEBUG 0
+
+#include <assert.h>
+#include <string.h>
+
+#include <utils/Log.h>
+#include <audio_utils/spdif/FrameScanner.h>
+
+#include "TrueHDFrameScanner.h"
+
+namespace android {
+
+// Major sync of a TrueHD access unit, after the 4 byte unit header.
+const uint8_t TrueHDFrameScanner::kSyncBytes[] =
+        { 0xF8, 0x72, 0x6F, 0xBA };
+
+// audio_sampling_frequency of the major sync info
+const int32_t TrueHDFrameScanner::kTrueHDSampleRateTable[TRUEHD_NUM_SAMPLE_RATE_TABLE_ENTRIES]
+        = { 48000, 96000, 192000, -1, -1, -1, -1, -1,
+        44100, 88200, 176400, -1, -1, -1, -1, -1 };
+
+const uint8_t TrueHDFrameScanner::kMATStartCode[20] = {
+        0x07, 0x9E, 0x00, 0x03, 0x84, 0x01, 0x01, 0x01, 0x80, 0x00,
+        0x56, 0xA5, 0x3B, 0xF4, 0x81, 0x83, 0x49, 0x80, 0x77, 0xE0 };
+const uint8_t TrueHDFrameScanner::kMATMiddleCode[12] = {
+        0xC3, 0xC1, 0x42, 0x49, 0x3B, 0xFA, 0x82, 0x83, 0x49, 0x80, 0x77, 0xE0 };
+const uint8_t TrueHDFrameScanner::kMATEndCode[16] = {
+        0xC3, 0xC2, 0xC0, 0xC4, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x97, 0x11, 0x00, 0x00, 0x00, 0x00 };
+
+// A MAT frame is sent at 768 kHz, or 705.6 kHz for the 44.1 kHz family.
+#define MAT_BURST_RATE_48K  768000
+#define MAT_BURST_RATE_44K  705600
+
+// Scanner for TrueHD byte streams.
+TrueHDFrameScanner::TrueHDFrameScanner()
+ : FrameScanner(IEC61937_DATA_TYPE_MAT,
+    TrueHDFrameScanner::kSyncBytes,
+    sizeof(TrueHDFrameScanner::kSyncBytes),
+    TRUEHD_MAJOR_SYNC_HEADER_BYTES)
+ , mLocked(false)
+ , mUnitsInBurst(0)
+{
+}
+
+TrueHDFrameScanner::~TrueHDFrameScanner()
+{
+}
+
+void TrueHDFrameScanner::resetScan()
+{
+    FrameScanner::resetScan();
+    mLocked = false;
+}
+
+// Until synchronized, keep the last bytes until they hold a unit header followed
+// by a major sync. After that, each unit header immediately follows the previous unit.
+bool TrueHDFrameScanner::scan(uint8_t byte)
+{
+    if (mLocked) {
+        mHeaderBuffer[mCursor++] = byte;
+        if (mCursor < TRUEHD_UNIT_HEADER_BYTES) {
+            return false;
+        }
+        mCursor = 0;
+        mHeaderLength = TRUEHD_UNIT_HEADER_BYTES;
+        if (parseHeader()) {
+            return true;
+        }
+        ALOGW("TrueHDFrameScanner: lost sync");
+        mLocked = false;
+        return false;
+    }
+    if (mCursor < TRUEHD_MAJOR_SYNC_HEADER_BYTES) {
+        mHeaderBuffer[mCursor++] = byte;
+    } else {
+        memmove(&mHeaderBuffer[0], &mHeaderBuffer[1], TRUEHD_MAJOR_SYNC_HEADER_BYTES - 1);
+        mHeaderBuffer[TRUEHD_MAJOR_SYNC_HEADER_BYTES - 1] = byte;
+        mBytesSkipped += 1; // skip unsynchronized data
+    }
+    if (mCursor == TRUEHD_MAJOR_SYNC_HEADER_BYTES
+            && memcmp(&mHeaderBuffer[TRUEHD_UNIT_HEADER_BYTES], mSyncBytes, mSyncLength) == 0) {
+        mHeaderLength = TRUEHD_MAJOR_SYNC_HEADER_BYTES;
+        if (parseHeader()) {
+            mCursor = 0;
+            mLocked = true;
+            return true;
+        }
+    }
+    return false;
+}
+
+// The unit headers are only a few bytes, so there is little to gain from scanning in bulk.
+size_t TrueHDFrameScanner::scan(const uint8_t *data, size_t numBytes, bool *found)
+{
+    *found = false;
+    for (size_t i = 0; i < numBytes; i++) {
+        if (scan(data[i])) {
+            *found = true;
+            return i + 1;
+        }
+    }
+    return numBytes;
+}
+
+// Parse the access unit header, and the major sync info if present.
+// Sets mFrameSizeBytes, mSampleRate, mRateMultiplier.
+//
+// @return true if valid
+bool TrueHDFrameScanner::parseHeader()
+{
+    // The names are from the Meridian Lossless Packing spec.
+    uint32_t access_unit_length = ((mHeaderBuffer[0] & 0x0F) << 8) | mHeaderBuffer[1];
+    size_t frameSizeBytes = access_unit_length * sizeof(uint16_t);
+    if (frameSizeBytes < mHeaderLength) {
+        ALOGE("TrueHDFrameScanner: ERROR - access_unit_length = %u", access_unit_length);
+        return false;
+    }
+    if (mHeaderLength == TRUEHD_MAJOR_SYNC_HEADER_BYTES) {
+        uint32_t audio_sampling_frequency = mHeaderBuffer[8] >> 4;
+        int32_t sampleRate = kTrueHDSampleRateTable[audio_sampling_frequency];
+        if (sampleRate < 0) {
+            ALOGE("TrueHDFrameScanner: ERROR - invalid sampleRate[%u] = %d",
+                    audio_sampling_frequency, sampleRate);
+            return false;
+        }
+        mSampleRate = (uint32_t) sampleRate;
+        mRateMultiplier = ((mSampleRate % 44100) == 0 ? MAT_BURST_RATE_44K : MAT_BURST_RATE_48K)
+                / mSampleRate;
+        ALOGI_IF((mFormatDumpCount == 0),
+                "TrueHD frame rate = %d * %d", mSampleRate, mRateMultiplier);
+        mFormatDumpCount++;
+    }
+    mFrameSizeBytes = frameSizeBytes;
+    mUnitsInBurst++;
+    return true;
+}
+
+}  // namespace android
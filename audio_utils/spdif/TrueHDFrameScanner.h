@@ -0,0 +1,83 @@
+/*
+ * Copyright 2016, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_AUDIO_TRUEHD_FRAME_SCANNER_H
+#define ANDROID_AUDIO_TRUEHD_FRAME_SCANNER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <audio_utils/spdif/FrameScanner.h>
+
+namespace android {
+
+#define TRUEHD_NUM_SAMPLE_RATE_TABLE_ENTRIES    16
+#define TRUEHD_UNIT_HEADER_BYTES                 4
+#define TRUEHD_MAJOR_SYNC_HEADER_BYTES          12
+#define TRUEHD_UNITS_PER_MAT_FRAME              24
+
+// Layout of a MAT frame, as offsets in its data burst including the 8 byte preamble.
+// The access units of a MAT frame are sent in slots of MAT_SLOT_BYTES.
+#define IEC61937_DATA_TYPE_MAT                  22
+#define MAT_BURST_FRAMES                     15360
+#define MAT_SLOT_BYTES                        2560
+#define MAT_MIDDLE_CODE_OFFSET               30716
+#define MAT_END_CODE_OFFSET                  61416
+
+/**
+ * Scanner for Dolby TrueHD access units, which are sent in MAT frames as per IEC61937-9.
+ * Only some access units start with a major sync, so after the first one is found,
+ * the following access units are located by their length.
+ */
+class TrueHDFrameScanner : public FrameScanner
+{
+public:
+    TrueHDFrameScanner();
+    virtual ~TrueHDFrameScanner();
+
+    virtual bool scan(uint8_t byte);
+    virtual size_t scan(const uint8_t *data, size_t numBytes, bool *found);
+    virtual void resetScan();
+
+    virtual int getMaxChannels()   const { return 7 + 1; }
+
+    virtual int getMaxSampleFramesPerSyncFrame() const { return MAT_BURST_FRAMES; }
+    virtual int getSampleFramesPerSyncFrame()    const { return MAT_BURST_FRAMES; }
+
+    virtual bool isFirstInBurst() { return false; }
+    virtual bool isLastInBurst() { return mUnitsInBurst >= TRUEHD_UNITS_PER_MAT_FRAME; }
+    virtual void resetBurst() { mUnitsInBurst = 0; }
+
+    // For MAT, the burst-length is in bytes.
+    virtual uint16_t convertBytesToLengthCode(uint16_t numBytes) const { return numBytes; }
+
+    // Codes at the start, middle and end of each MAT frame.
+    static const uint8_t kMATStartCode[20];
+    static const uint8_t kMATMiddleCode[12];
+    static const uint8_t kMATEndCode[16];
+
+protected:
+    bool mLocked;           // true if the next byte starts an access unit
+    int  mUnitsInBurst;
+
+    virtual bool parseHeader();
+
+    static const uint8_t kSyncBytes[];
+    static const int32_t kTrueHDSampleRateTable[];
+};
+
+}  // namespace android
+
+#endif  // ANDROID_AUDIO_TRUEHD_FRAME_SCANNER_H
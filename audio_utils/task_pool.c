@@ -0,0 +1,478 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define _GNU_SOURCE // for CPU_SET
+//#define LOG_NDEBUG 0
+#define LOG_TAG "audio_utils_task_pool"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+#include <log/log.h>
+#include <audio_utils/fft.h>
+#include <audio_utils/fixedfft.h>
+#include <audio_utils/format.h>
+#include <audio_utils/task_pool.h>
+
+/* Each thread of a job, the calling thread last, owns a range of the items which it takes from
+ * the front, grain items at a time.  Once its range is empty, it steals the back half of the
+ * range of another thread, or exits the job when all ranges are empty.  A range in transit to a
+ * thief is in no range, but then the thief itself processes it, so no work is lost.
+ */
+struct task_range {
+    pthread_mutex_t lock;
+    size_t begin;               // next item to process
+    size_t end;                 // end of the range, lowered by thieves
+};
+
+struct audio_utils_task_pool {
+    uint32_t thread_count;      // worker threads, the calling thread of a job is one more
+    pthread_t *threads;
+    struct task_range *ranges;  // thread_count + 1 ranges, the last for the calling thread
+    int *cpus;                  // cpu of each worker thread if pinned, or -1
+    int *selected_cpus;         // the cores chosen by the placement
+    uint32_t selected_count;
+    bool restrict_cpus;         // whether the worker threads are restricted to selected_cpus
+    pthread_mutex_t call_lock;  // serializes calls to audio_utils_task_pool_parallel_for()
+    pthread_mutex_t lock;       // protects the fields below
+    pthread_cond_t work_cond;   // signaled when a job starts or the pool exits
+    pthread_cond_t done_cond;   // signaled when the last worker thread finishes a job
+    uint32_t generation;        // incremented for each job
+    uint32_t active;            // worker threads still running the current job
+    bool exiting;
+    audio_utils_task_fn fn;     // current job, read-only while it runs
+    void *arg;
+    size_t grain;
+};
+
+struct task_thread {
+    struct audio_utils_task_pool *pool;
+    uint32_t index;
+};
+
+// Take the next grain items of the own range
+static bool take_own(struct audio_utils_task_pool *pool, uint32_t self, size_t *begin,
+        size_t *end)
+{
+    struct task_range *range = &pool->ranges[self];
+    pthread_mutex_lock(&range->lock);
+    const bool found = range->begin < range->end;
+    if (found) {
+        *begin = range->begin;
+        *end = range->end - range->begin > pool->grain ? range->begin + pool->grain : range->end;
+        range->begin = *end;
+    }
+    pthread_mutex_unlock(&range->lock);
+    return found;
+}
+
+// Move the back half of the range of another thread to the empty own range
+static bool steal(struct audio_utils_task_pool *pool, uint32_t self)
+{
+    const uint32_t range_count = pool->thread_count + 1;
+    for (uint32_t i = 1; i < range_count; ++i) {
+        struct task_range *victim = &pool->ranges[(self + i) % range_count];
+        pthread_mutex_lock(&victim->lock);
+        const size_t remaining = victim->end - victim->begin;
+        if (remaining == 0) {
+            pthread_mutex_unlock(&victim->lock);
+            continue;
+        }
+        // the owner keeps its next grain, unless that is all there is
+        const size_t stolen = remaining > pool->grain ? (remaining + 1) / 2 : remaining;
+        const size_t end = victim->end;
+        victim->end -= stolen;
+        pthread_mutex_unlock(&victim->lock);
+
+        struct task_range *range = &pool->ranges[self];
+        pthread_mutex_lock(&range->lock);
+        range->begin = end - stolen;
+        range->end = end;
+        pthread_mutex_unlock(&range->lock);
+        return true;
+    }
+    return false;
+}
+
+static void run_job(struct audio_utils_task_pool *pool, uint32_t self)
+{
+    size_t begin, end;
+    for (;;) {
+        if (take_own(pool, self, &begin, &end)) {
+            pool->fn(pool->arg, begin, end);
+        } else if (!steal(pool, self)) {
+            break;
+        }
+    }
+}
+
+#ifdef __linux__
+// Restrict the calling thread to the cpu if >= 0, otherwise to the selected cpus
+static void set_affinity(const struct audio_utils_task_pool *pool, int cpu)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (cpu >= 0) {
+        CPU_SET(cpu, &set);
+    } else {
+        for (uint32_t i = 0; i < pool->selected_count; ++i) {
+            CPU_SET(pool->selected_cpus[i], &set);
+        }
+    }
+    if (sched_setaffinity(0 /*calling thread*/, sizeof(set), &set) != 0) {
+        ALOGW("%s: unable to set the affinity of a worker thread", __func__);
+    }
+}
+#endif
+
+static void *worker_loop(void *arg)
+{
+    struct task_thread *thread = (struct task_thread *) arg;
+    struct audio_utils_task_pool *pool = thread->pool;
+    const uint32_t self = thread->index;
+    free(thread);
+#ifdef __linux__
+    if (pool->restrict_cpus) {
+        set_affinity(pool, pool->cpus[self]);
+    }
+#endif
+
+    // no job runs before audio_utils_task_pool_create() returns, so the first one is generation 1
+    uint32_t generation = 0;
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (!pool->exiting && pool->generation == generation) {
+            pthread_cond_wait(&pool->work_cond, &pool->lock);
+        }
+        if (pool->exiting) {
+            break;
+        }
+        generation = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+        run_job(pool, self);
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->active == 0) {
+            pthread_cond_signal(&pool->done_cond);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+// Return the maximum frequency of a cpu in kHz, or 0 if unknown
+static unsigned long cpu_max_freq(int cpu)
+{
+    char path[96];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cpufreq/cpuinfo_max_freq", cpu);
+    FILE *file = fopen(path, "re");
+    if (file == NULL) {
+        return 0;
+    }
+    unsigned long freq = 0;
+    if (fscanf(file, "%lu", &freq) != 1) {
+        freq = 0;
+    }
+    fclose(file);
+    return freq;
+}
+
+// Fill selected_cpus with the cpus of the placement, returns their count
+static uint32_t select_cpus(enum audio_utils_task_pool_placement placement, int *selected_cpus,
+        uint32_t cpu_count)
+{
+    unsigned long max_freq = 0;
+    unsigned long *freqs = (unsigned long *) malloc(cpu_count * sizeof(unsigned long));
+    if (freqs == NULL) {
+        placement = AUDIO_UTILS_TASK_POOL_PLACEMENT_ANY;
+    } else {
+        for (uint32_t cpu = 0; cpu < cpu_count; ++cpu) {
+            freqs[cpu] = cpu_max_freq(cpu);
+            if (freqs[cpu] > max_freq) {
+                max_freq = freqs[cpu];
+            }
+        }
+    }
+    uint32_t count = 0;
+    if (placement != AUDIO_UTILS_TASK_POOL_PLACEMENT_ANY) {
+        for (uint32_t cpu = 0; cpu < cpu_count; ++cpu) {
+            const bool big = freqs[cpu] == max_freq;
+            if (big == (placement == AUDIO_UTILS_TASK_POOL_PLACEMENT_BIG)) {
+                selected_cpus[count++] = cpu;
+            }
+        }
+    }
+    if (count == 0) {
+        for (uint32_t cpu = 0; cpu < cpu_count; ++cpu) {
+            selected_cpus[count++] = cpu;
+        }
+    }
+    free(freqs);
+    return count;
+}
+
+struct audio_utils_task_pool *audio_utils_task_pool_create(
+        const struct audio_utils_task_pool_config *config)
+{
+    struct audio_utils_task_pool_config defaults;
+    if (config == NULL) {
+        memset(&defaults, 0, sizeof(defaults));
+        config = &defaults;
+    }
+    struct audio_utils_task_pool *pool =
+            (struct audio_utils_task_pool *) calloc(1, sizeof(*pool));
+    if (pool == NULL) {
+        return NULL;
+    }
+    long cpu_count = sysconf(_SC_NPROCESSORS_CONF);
+    if (cpu_count < 1) {
+        cpu_count = 1;
+    }
+    pool->selected_cpus = (int *) malloc(cpu_count * sizeof(int));
+    if (pool->selected_cpus == NULL) {
+        free(pool);
+        return NULL;
+    }
+    pool->selected_count = select_cpus(config->placement, pool->selected_cpus,
+            (uint32_t) cpu_count);
+    pool->restrict_cpus = config->pin_threads ||
+            config->placement != AUDIO_UTILS_TASK_POOL_PLACEMENT_ANY;
+    pool->thread_count = config->thread_count != 0 ? config->thread_count :
+            pool->selected_count - 1;
+
+    pool->threads = (pthread_t *) calloc(pool->thread_count + 1, sizeof(pthread_t));
+    pool->ranges = (struct task_range *) calloc(pool->thread_count + 1,
+            sizeof(struct task_range));
+    pool->cpus = (int *) malloc((pool->thread_count + 1) * sizeof(int));
+    if (pool->threads == NULL || pool->ranges == NULL || pool->cpus == NULL) {
+        free(pool->threads);
+        free(pool->ranges);
+        free(pool->cpus);
+        free(pool->selected_cpus);
+        free(pool);
+        return NULL;
+    }
+    for (uint32_t i = 0; i <= pool->thread_count; ++i) {
+        pthread_mutex_init(&pool->ranges[i].lock, NULL);
+        // with the calling thread, which usually runs on the first selected core, last
+        pool->cpus[i] = config->pin_threads ?
+                pool->selected_cpus[(i + 1) % pool->selected_count] : -1;
+    }
+    pthread_mutex_init(&pool->call_lock, NULL);
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work_cond, NULL);
+    pthread_cond_init(&pool->done_cond, NULL);
+
+    uint32_t started;
+    for (started = 0; started < pool->thread_count; ++started) {
+        struct task_thread *thread = (struct task_thread *) malloc(sizeof(*thread));
+        if (thread == NULL) {
+            break;
+        }
+        thread->pool = pool;
+        thread->index = started;
+        if (pthread_create(&pool->threads[started], NULL, worker_loop, thread) != 0) {
+            free(thread);
+            break;
+        }
+    }
+    if (started < pool->thread_count) {
+        ALOGE("%s: unable to start worker thread %u", __func__, started);
+        for (uint32_t i = started + 1; i <= pool->thread_count; ++i) {
+            pthread_mutex_destroy(&pool->ranges[i].lock);
+        }
+        pool->thread_count = started;
+        audio_utils_task_pool_destroy(pool);
+        return NULL;
+    }
+    ALOGV("%s: %u threads on %u cores", __func__, pool->thread_count, pool->selected_count);
+    return pool;
+}
+
+void audio_utils_task_pool_destroy(struct audio_utils_task_pool *pool)
+{
+    if (pool == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&pool->lock);
+    pool->exiting = true;
+    pthread_cond_broadcast(&pool->work_cond);
+    pthread_mutex_unlock(&pool->lock);
+    for (uint32_t i = 0; i < pool->thread_count; ++i) {
+        pthread_join(pool->threads[i], NULL);
+    }
+    for (uint32_t i = 0; i <= pool->thread_count; ++i) {
+        pthread_mutex_destroy(&pool->ranges[i].lock);
+    }
+    pthread_cond_destroy(&pool->done_cond);
+    pthread_cond_destroy(&pool->work_cond);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_mutex_destroy(&pool->call_lock);
+    free(pool->threads);
+    free(pool->ranges);
+    free(pool->cpus);
+    free(pool->selected_cpus);
+    free(pool);
+}
+
+uint32_t audio_utils_task_pool_thread_count(const struct audio_utils_task_pool *pool)
+{
+    return pool->thread_count;
+}
+
+void audio_utils_task_pool_parallel_for(struct audio_utils_task_pool *pool, size_t count,
+        size_t grain, audio_utils_task_fn fn, void *arg)
+{
+    if (count == 0) {
+        return;
+    }
+    if (grain == 0) {
+        grain = 1;
+    }
+    if (pool == NULL || pool->thread_count == 0 || count <= grain) {
+        fn(arg, 0, count);
+        return;
+    }
+
+    pthread_mutex_lock(&pool->call_lock);
+    const uint32_t range_count = pool->thread_count + 1;
+    for (uint32_t i = 0; i < range_count; ++i) {
+        // no other thread accesses the ranges between jobs
+        pool->ranges[i].begin = count * i / range_count;
+        pool->ranges[i].end = count * (i + 1) / range_count;
+    }
+    pool->fn = fn;
+    pool->arg = arg;
+    pool->grain = grain;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->active = pool->thread_count;
+    ++pool->generation;
+    pthread_cond_broadcast(&pool->work_cond);
+    pthread_mutex_unlock(&pool->lock);
+
+    run_job(pool, pool->thread_count);
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->active > 0) {
+        pthread_cond_wait(&pool->done_cond, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    pthread_mutex_unlock(&pool->call_lock);
+}
+
+/* Number of samples converted per task, large enough to amortize the task overhead and small
+ * enough to balance the load of a buffer of a few seconds.
+ */
+#define TASK_POOL_CONVERSION_GRAIN 16384
+
+struct conversion_job {
+    void *dst;
+    audio_format_t dst_format;
+    size_t dst_sample_size;
+    const void *src;
+    audio_format_t src_format;
+    size_t src_sample_size;
+};
+
+static void convert_range(void *arg, size_t begin, size_t end)
+{
+    const struct conversion_job *job = (const struct conversion_job *) arg;
+    memcpy_by_audio_format((char *) job->dst + begin * job->dst_sample_size, job->dst_format,
+            (const char *) job->src + begin * job->src_sample_size, job->src_format,
+            end - begin);
+}
+
+void audio_utils_task_pool_memcpy_by_audio_format(struct audio_utils_task_pool *pool,
+        void *dst, audio_format_t dst_format,
+        const void *src, audio_format_t src_format, size_t count)
+{
+    struct conversion_job job = {
+        dst, dst_format, audio_bytes_per_sample(dst_format),
+        src, src_format, audio_bytes_per_sample(src_format),
+    };
+    // in-place conversions between sizes run forwards or backwards, so can't be split
+    const char *dst_bytes = (const char *) dst;
+    const char *src_bytes = (const char *) src;
+    if (job.dst_sample_size == 0 || job.src_sample_size == 0 ||
+            (dst_bytes < src_bytes + count * job.src_sample_size &&
+             src_bytes < dst_bytes + count * job.dst_sample_size)) {
+        pool = NULL;
+    }
+    audio_utils_task_pool_parallel_for(pool, count, TASK_POOL_CONVERSION_GRAIN, convert_range,
+            &job);
+}
+
+struct fft_job {
+    const void *plan;
+    void *data;
+    size_t stride;
+    bool inverse;
+};
+
+static void fixed_fft_range(void *arg, size_t begin, size_t end)
+{
+    const struct fft_job *job = (const struct fft_job *) arg;
+    fixed_fft_real_batch((const struct fixed_fft_plan *) job->plan,
+            (int32_t *) job->data + begin * job->stride, end - begin, job->stride);
+}
+
+static void fft_float_complex_range(void *arg, size_t begin, size_t end)
+{
+    const struct fft_job *job = (const struct fft_job *) arg;
+    fft_float_complex_batch((const struct fft_float_plan *) job->plan,
+            (float *) job->data + begin * job->stride, end - begin, job->stride, job->inverse);
+}
+
+static void fft_float_real_range(void *arg, size_t begin, size_t end)
+{
+    const struct fft_job *job = (const struct fft_job *) arg;
+    fft_float_real_batch((const struct fft_float_plan *) job->plan,
+            (float *) job->data + begin * job->stride, end - begin, job->stride, job->inverse);
+}
+
+// Frames per task, so that each task amortizes the loads of the plan over a few frames
+#define TASK_POOL_FFT_GRAIN 4
+
+void audio_utils_task_pool_fixed_fft_real_batch(struct audio_utils_task_pool *pool,
+        const struct fixed_fft_plan *plan, int32_t *v, size_t count, size_t stride)
+{
+    struct fft_job job = { plan, v, stride, false };
+    audio_utils_task_pool_parallel_for(pool, count, TASK_POOL_FFT_GRAIN, fixed_fft_range, &job);
+}
+
+void audio_utils_task_pool_fft_float_complex_batch(struct audio_utils_task_pool *pool,
+        const struct fft_float_plan *plan, float *data, size_t count, size_t stride,
+        bool inverse)
+{
+    struct fft_job job = { plan, data, stride, inverse };
+    audio_utils_task_pool_parallel_for(pool, count, TASK_POOL_FFT_GRAIN, fft_float_complex_range,
+            &job);
+}
+
+void audio_utils_task_pool_fft_float_real_batch(struct audio_utils_task_pool *pool,
+        const struct fft_float_plan *plan, float *data, size_t count, size_t stride,
+        bool inverse)
+{
+    struct fft_job job = { plan, data, stride, inverse };
+    audio_utils_task_pool_parallel_for(pool, count, TASK_POOL_FFT_GRAIN, fft_float_real_range,
+            &job);
+}
@@ -31,6 +31,228 @@ LOCAL_MODULE_TAGS := tests
 LOCAL_CFLAGS := -Werror -Wall
 include $(BUILD_HOST_NATIVE_TEST)
 
+include $(CLEAR_VARS)
+LOCAL_C_INCLUDES := \
+	$(call include-path-for, audio-utils)
+LOCAL_SRC_FILES := \
+	audio_traits_tests.cpp
+LOCAL_MODULE := audio_traits_tests
+LOCAL_MODULE_TAGS := tests
+LOCAL_CFLAGS := -Werror -Wall
+include $(BUILD_NATIVE_TEST)
+
+include $(CLEAR_VARS)
+LOCAL_C_INCLUDES := \
+	$(call include-path-for, audio-utils)
+LOCAL_SRC_FILES := \
+	audio_traits_tests.cpp
+LOCAL_MODULE := audio_traits_tests
+LOCAL_MODULE_TAGS := tests
+LOCAL_CFLAGS := -Werror -Wall
+include $(BUILD_HOST_NATIVE_TEST)
+
+include $(CLEAR_VARS)
+LOCAL_SHARED_LIBRARIES := \
+	liblog \
+	libcutils \
+	libaudioutils
+LOCAL_C_INCLUDES := \
+	$(call include-path-for, audio-utils)
+LOCAL_SRC_FILES := \
+	trace_tests.cpp
+LOCAL_MODULE := trace_tests
+LOCAL_MODULE_TAGS := tests
+LOCAL_CFLAGS := -Werror -Wall
+include $(BUILD_NATIVE_TEST)
+
+include $(CLEAR_VARS)
+LOCAL_SHARED_LIBRARIES := \
+	liblog \
+	libcutils
+LOCAL_STATIC_LIBRARIES := \
+	libaudioutils
+LOCAL_C_INCLUDES := \
+	$(call include-path-for, audio-utils)
+LOCAL_SRC_FILES := \
+	trace_tests.cpp
+LOCAL_MODULE := trace_tests
+LOCAL_MODULE_TAGS := tests
+LOCAL_CFLAGS := -Werror -Wall
+include $(BUILD_HOST_NATIVE_TEST)
+
+include $(CLEAR_VARS)
+LOCAL_SHARED_LIBRARIES := \
+	liblog \
+	libcutils \
+	libaudioutils
+LOCAL_C_INCLUDES := \
+	$(call include-path-for, audio-utils)
+LOCAL_SRC_FILES := \
+	resampler_tests.cpp
+LOCAL_MODULE := resampler_tests
+LOCAL_MODULE_TAGS := tests
+LOCAL_CFLAGS := -Werror -Wall
+include $(BUILD_NATIVE_TEST)
+
+include $(CLEAR_VARS)
+LOCAL_SHARED_LIBRARIES := \
+	liblog \
+	libcutils \
+	libaudioutils
+LOCAL_C_INCLUDES := \
+	$(call include-path-for, audio-utils)
+LOCAL_SRC_FILES := \
+	echo_reference_tests.cpp
+LOCAL_MODULE := echo_reference_tests
+LOCAL_MODULE_TAGS := tests
+LOCAL_CFLAGS := -Werror -Wall
+include $(BUILD_NATIVE_TEST)
+
+include $(CLEAR_VARS)
+LOCAL_SHARED_LIBRARIES := \
+	liblog \
+	libcutils \
+	libaudioutils
+LOCAL_C_INCLUDES := \
+	$(call include-path-for, audio-utils)
+LOCAL_SRC_FILES := \
+	fft_tests.cpp
+LOCAL_MODULE := fft_tests
+LOCAL_MODULE_TAGS := tests
+LOCAL_CFLAGS := -Werror -Wall
+include $(BUILD_NATIVE_TEST)
+
+include $(CLEAR_VARS)
+LOCAL_SHARED_LIBRARIES := \
+	liblog \
+	libcutils
+LOCAL_STATIC_LIBRARIES := \
+	libaudioutils
+LOCAL_C_INCLUDES := \
+	$(call include-path-for, audio-utils)
+LOCAL_SRC_FILES := \
+	fft_tests.cpp
+LOCAL_MODULE := fft_tests
+LOCAL_MODULE_TAGS := tests
+LOCAL_CFLAGS := -Werror -Wall
+include $(BUILD_HOST_NATIVE_TEST)
+
+include $(CLEAR_VARS)
+LOCAL_SHARED_LIBRARIES := \
+	liblog \
+	libcutils \
+	libaudioutils
+LOCAL_C_INCLUDES := \
+	$(call include-path-for, audio-utils)
+LOCAL_SRC_FILES := \
+	visualizer_capture_tests.cpp
+LOCAL_MODULE := visualizer_capture_tests
+LOCAL_MODULE_TAGS := tests
+LOCAL_CFLAGS := -Werror -Wall
+include $(BUILD_NATIVE_TEST)
+
+include $(CLEAR_VARS)
+LOCAL_SHARED_LIBRARIES := \
+	liblog \
+	libcutils
+LOCAL_STATIC_LIBRARIES := \
+	libaudioutils
+LOCAL_C_INCLUDES := \
+	$(call include-path-for, audio-utils)
+LOCAL_SRC_FILES := \
+	visualizer_capture_tests.cpp
+LOCAL_MODULE := visualizer_capture_tests
+LOCAL_MODULE_TAGS := tests
+LOCAL_CFLAGS := -Werror -Wall
+include $(BUILD_HOST_NATIVE_TEST)
+
+include $(CLEAR_VARS)
+LOCAL_SHARED_LIBRARIES := \
+	liblog \
+	libcutils \
+	libaudioutils
+LOCAL_C_INCLUDES := \
+	$(call include-path-for, audio-utils)
+LOCAL_SRC_FILES := \
+	task_pool_tests.cpp
+LOCAL_MODULE := task_pool_tests
+LOCAL_MODULE_TAGS := tests
+LOCAL_CFLAGS := -Werror -Wall
+include $(BUILD_NATIVE_TEST)
+
+include $(CLEAR_VARS)
+LOCAL_SHARED_LIBRARIES := \
+	liblog \
+	libcutils
+LOCAL_STATIC_LIBRARIES := \
+	libaudioutils
+LOCAL_C_INCLUDES := \
+	$(call include-path-for, audio-utils)
+LOCAL_SRC_FILES := \
+	task_pool_tests.cpp
+LOCAL_MODULE := task_pool_tests
+LOCAL_MODULE_TAGS := tests
+LOCAL_CFLAGS := -Werror -Wall
+include $(BUILD_HOST_NATIVE_TEST)
+
+include $(CLEAR_VARS)
+LOCAL_SHARED_LIBRARIES := \
+	liblog \
+	libcutils \
+	libaudioutils
+LOCAL_C_INCLUDES := \
+	$(call include-path-for, audio-utils)
+LOCAL_SRC_FILES := \
+	sound_trigger_model_tests.cpp
+LOCAL_MODULE := sound_trigger_model_tests
+LOCAL_MODULE_TAGS := tests
+LOCAL_CFLAGS := -Werror -Wall
+include $(BUILD_NATIVE_TEST)
+
+include $(CLEAR_VARS)
+LOCAL_SHARED_LIBRARIES := \
+	liblog \
+	libcutils
+LOCAL_STATIC_LIBRARIES := \
+	libaudioutils
+LOCAL_C_INCLUDES := \
+	$(call include-path-for, audio-utils)
+LOCAL_SRC_FILES := \
+	sound_trigger_model_tests.cpp
+LOCAL_MODULE := sound_trigger_model_tests
+LOCAL_MODULE_TAGS := tests
+LOCAL_CFLAGS := -Werror -Wall
+include $(BUILD_HOST_NATIVE_TEST)
+
+include $(CLEAR_VARS)
+LOCAL_SHARED_LIBRARIES := \
+	liblog \
+	libcutils \
+	libaudioutils
+LOCAL_C_INCLUDES := \
+	$(call include-path-for, audio-utils)
+LOCAL_SRC_FILES := \
+	convolver_tests.cpp
+LOCAL_MODULE := convolver_tests
+LOCAL_MODULE_TAGS := tests
+LOCAL_CFLAGS := -Werror -Wall
+include $(BUILD_NATIVE_TEST)
+
+include $(CLEAR_VARS)
+LOCAL_SHARED_LIBRARIES := \
+	liblog \
+	libcutils
+LOCAL_STATIC_LIBRARIES := \
+	libaudioutils
+LOCAL_C_INCLUDES := \
+	$(call include-path-for, audio-utils)
+LOCAL_SRC_FILES := \
+	convolver_tests.cpp
+LOCAL_MODULE := convolver_tests
+LOCAL_MODULE_TAGS := tests
+LOCAL_CFLAGS := -Werror -Wall
+include $(BUILD_HOST_NATIVE_TEST)
+
 include $(CLEAR_VARS)
 LOCAL_SRC_FILES := fifo_tests.cpp
 LOCAL_MODULE := fifo_tests
@@ -47,7 +269,74 @@ LOCAL_MODULE := fifo_tests
 LOCAL_C_INCLUDES := $(call include-path-for, audio-utils)
 # libmedia libbinder libcutils libutils
 LOCAL_STATIC_LIBRARIES := libsndfile libaudioutils liblog
+LOCAL_LDLIBS := -lpthread
+LOCAL_CFLAGS := -Werror -Wall
+include $(BUILD_HOST_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_SHARED_LIBRARIES := \
+	liblog \
+	libcutils \
+	libaudioutils
+LOCAL_STATIC_LIBRARIES := \
+	libsndfile
+LOCAL_C_INCLUDES := \
+	$(call include-path-for, audio-utils)
+LOCAL_SRC_FILES := \
+	sndfile_tests.cpp
+LOCAL_MODULE := sndfile_tests
+LOCAL_MODULE_TAGS := tests
 LOCAL_CFLAGS := -Werror -Wall
+include $(BUILD_NATIVE_TEST)
+
+include $(CLEAR_VARS)
+LOCAL_SHARED_LIBRARIES := \
+	liblog \
+	libcutils
+LOCAL_STATIC_LIBRARIES := \
+	libsndfile \
+	libaudioutils
+LOCAL_C_INCLUDES := \
+	$(call include-path-for, audio-utils)
+LOCAL_SRC_FILES := \
+	sndfile_tests.cpp
+LOCAL_MODULE := sndfile_tests
+LOCAL_MODULE_TAGS := tests
+LOCAL_LDLIBS := -lpthread
+LOCAL_CFLAGS := -Werror -Wall
+include $(BUILD_HOST_NATIVE_TEST)
+
+include $(CLEAR_VARS)
+LOCAL_SHARED_LIBRARIES := \
+	liblog \
+	libcutils \
+	libaudiospdif
+LOCAL_C_INCLUDES := \
+	$(call include-path-for, audio-utils)
+LOCAL_SRC_FILES := \
+	spdif_tests.cpp
+LOCAL_MODULE := spdif_tests
+LOCAL_MODULE_TAGS := tests
+LOCAL_CFLAGS := -Werror -Wall
+include $(BUILD_NATIVE_TEST)
+
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES := fifo_benchmark.cpp
+LOCAL_MODULE := fifo_benchmark
+LOCAL_C_INCLUDES := $(call include-path-for, audio-utils)
+LOCAL_SHARED_LIBRARIES := libaudioutils
+LOCAL_MODULE_TAGS := tests
+LOCAL_CFLAGS := -Werror -Wall -O2
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES := fifo_benchmark.cpp
+LOCAL_MODULE := fifo_benchmark
+LOCAL_C_INCLUDES := $(call include-path-for, audio-utils)
+LOCAL_STATIC_LIBRARIES := libaudioutils liblog
+LOCAL_LDLIBS := -lpthread
+LOCAL_MODULE_TAGS := tests
+LOCAL_CFLAGS := -Werror -Wall -O2
 include $(BUILD_HOST_EXECUTABLE)
 
 include $(CLEAR_VARS)
@@ -57,3 +346,42 @@ LOCAL_C_INCLUDES := $(call include-path-for, audio-utils)
 LOCAL_STATIC_LIBRARIES := libaudioutils
 LOCAL_CFLAGS := -Werror -Wall
 include $(BUILD_HOST_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES := wav_convert.cpp
+LOCAL_MODULE := wav_convert
+LOCAL_C_INCLUDES := $(call include-path-for, audio-utils)
+LOCAL_SHARED_LIBRARIES := libaudioutils liblog
+LOCAL_STATIC_LIBRARIES := libsndfile
+LOCAL_MODULE_TAGS := optional
+LOCAL_CFLAGS := -Werror -Wall -O2
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES := wav_convert.cpp
+LOCAL_MODULE := wav_convert
+LOCAL_C_INCLUDES := $(call include-path-for, audio-utils)
+LOCAL_STATIC_LIBRARIES := libsndfile libaudioutils liblog
+LOCAL_LDLIBS := -lpthread
+LOCAL_MODULE_TAGS := optional
+LOCAL_CFLAGS := -Werror -Wall -O2
+include $(BUILD_HOST_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES := pipeline_benchmark.cpp
+LOCAL_MODULE := pipeline_benchmark
+LOCAL_C_INCLUDES := $(call include-path-for, audio-utils)
+LOCAL_SHARED_LIBRARIES := libaudioutils liblog
+LOCAL_STATIC_LIBRARIES := libsndfile
+LOCAL_MODULE_TAGS := tests
+LOCAL_CFLAGS := -Werror -Wall -O2
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES := primitives_benchmark.cpp
+LOCAL_MODULE := primitives_benchmark
+LOCAL_C_INCLUDES := $(call include-path-for, audio-utils)
+LOCAL_SHARED_LIBRARIES := libaudioutils
+LOCAL_MODULE_TAGS := tests
+LOCAL_CFLAGS := -Werror -Wall -O2
+include $(BUILD_EXECUTABLE)
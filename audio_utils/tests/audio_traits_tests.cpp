@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+#include <audio_utils/audio_traits.h>
+
+using namespace android::audio_utils;
+
+// usable in constant expressions
+static_assert(bytes_per_sample(AUDIO_FORMAT_PCM_24_BIT_PACKED) == 3, "packed 24 bit");
+static_assert(!is_valid_format(AUDIO_FORMAT_INVALID), "invalid format");
+static_assert(channel_count_from_out_mask(AUDIO_CHANNEL_OUT_7POINT1) == 8, "7.1");
+static_assert(frame_traits<AUDIO_FORMAT_PCM_FLOAT, AUDIO_CHANNEL_OUT_5POINT1>::frame_size == 24,
+        "5.1 float");
+static_assert(sizeof(frame_traits<AUDIO_FORMAT_PCM_24_BIT_PACKED,
+        AUDIO_CHANNEL_OUT_STEREO>::sample_type) == 3, "packed 24 bit sample");
+
+TEST(audio_utils_audio_traits, formats) {
+    // every sub-format of every main format, and the sub-format bits alone
+    for (uint32_t main = 0; main < 0x30; ++main) {
+        for (uint32_t sub = 0; sub < 0x10; ++sub) {
+            const uint32_t subs[] = { sub, sub << 4, sub << 20 };
+            for (uint32_t s : subs) {
+                const audio_format_t format = (audio_format_t)((main << 24) | s);
+                EXPECT_EQ(audio_bytes_per_sample(format), bytes_per_sample(format))
+                        << std::hex << format;
+                EXPECT_EQ(audio_is_valid_format(format), is_valid_format(format))
+                        << std::hex << format;
+                EXPECT_EQ(audio_is_linear_pcm(format), is_linear_pcm(format))
+                        << std::hex << format;
+            }
+        }
+    }
+    EXPECT_EQ(audio_is_valid_format(AUDIO_FORMAT_INVALID), is_valid_format(AUDIO_FORMAT_INVALID));
+    EXPECT_EQ(2u, format_traits<AUDIO_FORMAT_PCM_16_BIT>::sample_size);
+    EXPECT_TRUE(format_traits<AUDIO_FORMAT_AAC_LC>::valid);
+    EXPECT_FALSE(format_traits<AUDIO_FORMAT_AAC_LC>::linear_pcm);
+}
+
+TEST(audio_utils_audio_traits, channel_masks) {
+    for (uint32_t count = 0; count <= AUDIO_CHANNEL_COUNT_MAX + 1; ++count) {
+        EXPECT_EQ(audio_channel_out_mask_from_count(count), channel_out_mask_from_count(count))
+                << count;
+        const audio_channel_mask_t mask = audio_channel_mask_for_index_assignment_from_count(count);
+        EXPECT_EQ(audio_channel_count_from_out_mask(mask), channel_count_from_out_mask(mask))
+                << std::hex << mask;
+    }
+    // positional masks with bits in and out of AUDIO_CHANNEL_OUT_ALL, and the representations
+    for (uint32_t i = 0; i < 4096; ++i) {
+        const audio_channel_mask_t mask = i * 2654435761u;
+        EXPECT_EQ(audio_channel_count_from_out_mask(mask), channel_count_from_out_mask(mask))
+                << std::hex << mask;
+    }
+    EXPECT_EQ(6u, (channel_mask_traits<AUDIO_CHANNEL_OUT_5POINT1>::channel_count));
+    EXPECT_EQ(8u, (frame_traits<AUDIO_FORMAT_PCM_16_BIT, AUDIO_CHANNEL_OUT_QUAD>::frame_size));
+    EXPECT_EQ(12u, bytes_per_frame(AUDIO_FORMAT_PCM_32_BIT, AUDIO_CHANNEL_INDEX_MASK_3));
+    EXPECT_EQ(0u, bytes_per_frame(AUDIO_FORMAT_MP3, AUDIO_CHANNEL_OUT_STEREO));
+}
@@ -22,3 +22,11 @@ echo "testing primitives"
 adb push $OUT/system/lib/libaudioutils.so /system/lib
 adb push $OUT/data/nativetest/primitives_tests /system/bin
 adb shell /system/bin/primitives_tests
+
+echo "testing audio_traits"
+adb push $OUT/data/nativetest/audio_traits_tests /system/bin
+adb shell /system/bin/audio_traits_tests
+
+echo "testing trace"
+adb push $OUT/data/nativetest/trace_tests /system/bin
+adb shell /system/bin/trace_tests
@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "audio_utils_convolver_tests"
+
+#include <errno.h>
+#include <math.h>
+#include <vector>
+#include <gtest/gtest.h>
+#include <audio_utils/convolver.h>
+
+// pseudo-random values in [-1, 1)
+static std::vector<float> makeNoise(size_t count, unsigned seed)
+{
+    std::vector<float> noise(count);
+    for (size_t i = 0; i < count; ++i) {
+        seed = seed * 1103515245 + 12345;
+        noise[i] = (float)((seed >> 8) & 0xffff) / 32768.f - 1.f;
+    }
+    return noise;
+}
+
+// direct convolution delayed by latency frames, in double
+static std::vector<double> referenceConvolve(const std::vector<float> &in, size_t channels,
+        const std::vector<float> &impulse, size_t impulseChannels, size_t latency)
+{
+    const size_t frames = in.size() / channels;
+    const size_t impulseFrames = impulse.size() / impulseChannels;
+    std::vector<double> out(in.size());
+    for (size_t n = latency; n < frames; ++n) {
+        for (size_t ch = 0; ch < channels; ++ch) {
+            const size_t ich = impulseChannels == 1 ? 0 : ch;
+            double sum = 0;
+            for (size_t k = 0; k < impulseFrames && k <= n - latency; ++k) {
+                sum += (double)impulse[k * impulseChannels + ich] *
+                        in[(n - latency - k) * channels + ch];
+            }
+            out[n * channels + ch] = sum;
+        }
+    }
+    return out;
+}
+
+static void checkConvolver(size_t channels, size_t block, size_t maxBlock, size_t impulseFrames,
+        size_t impulseChannels, size_t chunk, bool inPlace)
+{
+    const size_t frames = 4 * impulseFrames + 3 * maxBlock + 37;
+    const std::vector<float> in = makeNoise(frames * channels, channels + chunk);
+    std::vector<float> impulse = makeNoise(impulseFrames * impulseChannels, impulseFrames);
+    for (size_t i = 0; i < impulse.size(); ++i) {
+        impulse[i] *= 0.1f;
+    }
+    const struct convolver_config config = { channels, block, maxBlock };
+    struct convolver *convolver;
+    ASSERT_EQ(0, convolver_create(&config, &impulse[0], impulseFrames, impulseChannels,
+            &convolver));
+
+    const std::vector<double> expected =
+            referenceConvolve(in, channels, impulse, impulseChannels, block);
+    for (int pass = 0; pass < 2; ++pass) {
+        std::vector<float> out(inPlace ? in : std::vector<float>(in.size()));
+        for (size_t offset = 0, count; offset < frames; offset += count) {
+            count = chunk < frames - offset ? chunk : frames - offset;
+            convolver_process(convolver, &(inPlace ? out : in)[offset * channels],
+                    &out[offset * channels], count);
+        }
+        const double tolerance = 2e-5 * sqrt((double)impulseFrames);
+        for (size_t i = 0; i < out.size(); ++i) {
+            ASSERT_NEAR(expected[i], out[i], tolerance) << "i=" << i << " pass=" << pass;
+        }
+        // after a reset, the same input gives the same output
+        convolver_reset(convolver);
+    }
+    convolver_destroy(convolver);
+}
+
+TEST(audio_utils_convolver, create) {
+    const float impulse[8] = { 1.f, 1.f, 0.5f, 0.5f, 0.25f, 0.25f, 0.125f, 0.125f };
+    struct convolver *convolver = NULL;
+    struct convolver_config config = { 2, 64, 256 };
+    EXPECT_EQ(-EINVAL, convolver_create(&config, impulse, 0, 1, &convolver));
+    EXPECT_EQ(NULL, convolver);
+    EXPECT_EQ(-EINVAL, convolver_create(&config, impulse, 4, 3, &convolver));
+    config.block_frames = 48;
+    EXPECT_EQ(-EINVAL, convolver_create(&config, impulse, 4, 1, &convolver));
+    config.block_frames = 512;
+    EXPECT_EQ(-EINVAL, convolver_create(&config, impulse, 4, 1, &convolver));
+    config.block_frames = 64;
+    EXPECT_EQ(0, convolver_create(&config, impulse, 4, 2, &convolver));
+    ASSERT_TRUE(convolver != NULL);
+    convolver_destroy(convolver);
+    convolver_destroy(NULL);
+}
+
+TEST(audio_utils_convolver, impulse) {
+    // a unit impulse passes the input through with the block latency
+    const float impulse[1] = { 1.f };
+    const struct convolver_config config = { 1, 16, 16 };
+    struct convolver *convolver;
+    ASSERT_EQ(0, convolver_create(&config, impulse, 1, 1, &convolver));
+    const std::vector<float> in = makeNoise(100, 1);
+    std::vector<float> out(in.size());
+    convolver_process(convolver, &in[0], &out[0], in.size());
+    for (size_t i = 0; i < out.size(); ++i) {
+        ASSERT_NEAR(i < 16 ? 0.f : in[i - 16], out[i], 1e-6) << "i=" << i;
+    }
+    convolver_destroy(convolver);
+}
+
+TEST(audio_utils_convolver, uniform) {
+    checkConvolver(1, 32, 32, 500, 1, 32, false);
+    checkConvolver(2, 64, 64, 1000, 1, 17, false);
+    checkConvolver(2, 16, 16, 100, 2, 100, true);
+}
+
+TEST(audio_utils_convolver, non_uniform) {
+    checkConvolver(1, 16, 256, 3000, 1, 16, false);
+    checkConvolver(2, 32, 512, 5000, 2, 29, true);
+    checkConvolver(3, 8, 1024, 900, 1, 333, false);
+    // shorter than the first level
+    checkConvolver(2, 64, 1024, 20, 2, 64, false);
+}
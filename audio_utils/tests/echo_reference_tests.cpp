@@ -0,0 +1,500 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "audio_utils_echo_reference_tests"
+
+#include <math.h>
+#include <string.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <gtest/gtest.h>
+#include <system/audio.h>
+#include <audio_utils/echo_reference.h>
+#include <audio_utils/resampler.h>
+
+static const uint32_t kWriteRate = 16000;
+static const uint32_t kReadRate = 48000;
+
+// pseudo-random samples in [-0.5, 0.5), so that frames overwritten by other frames show up
+static double noise(size_t i)
+{
+    return (double)((i * 7919 + 104729) % 65536) / 65536. - 0.5;
+}
+
+// the same samples in every channel, so that any channel conversion keeps them
+template <typename T>
+static std::vector<T> makeInput(size_t frames, uint32_t channels);
+
+template <>
+std::vector<int16_t> makeInput(size_t frames, uint32_t channels)
+{
+    std::vector<int16_t> out(frames * channels);
+    for (size_t i = 0; i < frames; ++i) {
+        for (uint32_t c = 0; c < channels; ++c) {
+            out[i * channels + c] = (int16_t)lrint(32768. * noise(i));
+        }
+    }
+    return out;
+}
+
+template <>
+std::vector<float> makeInput(size_t frames, uint32_t channels)
+{
+    std::vector<float> out(frames * channels);
+    for (size_t i = 0; i < frames; ++i) {
+        for (uint32_t c = 0; c < channels; ++c) {
+            out[i * channels + c] = (float)noise(i);
+        }
+    }
+    return out;
+}
+
+static int resampleFromInput(struct resampler_itfe *resampler, int16_t *in, size_t *inFrames,
+        int16_t *out, size_t *outFrames)
+{
+    return resampler->resample_from_input(resampler, in, inFrames, out, outFrames);
+}
+
+static int resampleFromInput(struct resampler_itfe *resampler, float *in, size_t *inFrames,
+        float *out, size_t *outFrames)
+{
+    return resampler->resample_from_input_float(resampler, in, inFrames, out, outFrames);
+}
+
+// the mono input resampled independently of the echo reference, by the engine it prefers
+template <typename T>
+static std::vector<T> resampleMono(std::vector<T> in, uint32_t inRate, uint32_t outRate)
+{
+    struct resampler_config config;
+    memset(&config, 0, sizeof(config));
+    config.in_sample_rate = inRate;
+    config.out_sample_rate = outRate;
+    config.channel_count = 1;
+    config.quality = RESAMPLER_QUALITY_DEFAULT;
+    config.engine = RESAMPLER_ENGINE_POLYPHASE;
+    struct resampler_itfe *resampler;
+    EXPECT_EQ(0, create_resampler_from_config(&config, nullptr, &resampler));
+    if (resampler == nullptr) {
+        return std::vector<T>();
+    }
+    size_t inFrames = in.size();
+    std::vector<T> out(in.size() * outRate / inRate + 16);
+    size_t outFrames = out.size();
+    EXPECT_EQ(0, resampleFromInput(resampler, in.data(), &inFrames, out.data(), &outFrames));
+    release_resampler(resampler);
+    out.resize(outFrames);
+    return out;
+}
+
+template <typename T>
+static void checkChannelChangeAndUpsampling(audio_format_t format, bool preallocated)
+{
+    const uint32_t wrChannels = 2;
+    const size_t writeFrames = 1024;
+    const size_t writeCount = 4;
+    const size_t readFrames = 1024;
+
+    struct echo_reference_itfe *er = nullptr;
+    if (preallocated) {
+        ASSERT_EQ(0, create_echo_reference_preallocated(format, 1 /*rdChannelCount*/, kReadRate,
+                format, wrChannels, kWriteRate, readFrames, writeFrames, &er));
+    } else {
+        ASSERT_EQ(0, create_echo_reference(format, 1 /*rdChannelCount*/, kReadRate,
+                format, wrChannels, kWriteRate, &er));
+    }
+    ASSERT_NE(nullptr, er);
+
+    std::vector<T> readBuf(readFrames);
+    struct echo_reference_buffer rdBuffer;
+    memset(&rdBuffer, 0, sizeof(rdBuffer));
+    // start reading, so that write() passes frames on; a zero time stamp skips delay alignment
+    rdBuffer.raw = readBuf.data();
+    rdBuffer.frame_count = readFrames;
+    ASSERT_EQ(0, er->read(er, &rdBuffer));
+
+    std::vector<T> input = makeInput<T>(writeFrames * writeCount, wrChannels);
+    for (size_t i = 0; i < writeCount; ++i) {
+        struct echo_reference_buffer wrBuffer;
+        memset(&wrBuffer, 0, sizeof(wrBuffer));
+        wrBuffer.raw = input.data() + i * writeFrames * wrChannels;
+        wrBuffer.frame_count = writeFrames;
+        wrBuffer.time_stamp.tv_sec = 1;
+        ASSERT_EQ(0, er->write(er, &wrBuffer));
+    }
+
+    std::vector<T> expected = resampleMono(makeInput<T>(writeFrames * writeCount, 1),
+            kWriteRate, kReadRate);
+    // less than the frames written, so that read() does not wait for more
+    const size_t reads = expected.size() / readFrames - 1;
+    ASSERT_LT(0u, reads);
+    for (size_t i = 0; i < reads; ++i) {
+        rdBuffer.raw = readBuf.data();
+        rdBuffer.frame_count = readFrames;
+        ASSERT_EQ(0, er->read(er, &rdBuffer));
+        ASSERT_EQ(readFrames, rdBuffer.frame_count);
+        for (size_t j = 0; j < readFrames; ++j) {
+            ASSERT_NEAR(expected[i * readFrames + j], readBuf[j], 1e-6)
+                    << "frame " << i * readFrames + j << " preallocated " << preallocated;
+        }
+    }
+    release_echo_reference(er);
+}
+
+TEST(audio_utils_echo_reference, channel_change_and_upsampling) {
+    checkChannelChangeAndUpsampling<int16_t>(AUDIO_FORMAT_PCM_16_BIT, false /*preallocated*/);
+    checkChannelChangeAndUpsampling<int16_t>(AUDIO_FORMAT_PCM_16_BIT, true /*preallocated*/);
+    checkChannelChangeAndUpsampling<float>(AUDIO_FORMAT_PCM_FLOAT, false /*preallocated*/);
+    checkChannelChangeAndUpsampling<float>(AUDIO_FORMAT_PCM_FLOAT, true /*preallocated*/);
+}
+
+// writes frames with a valid time stamp, so that they are passed on while reading
+template <typename T>
+static int writeFrames(struct echo_reference_itfe *er, T *frames, size_t frameCount)
+{
+    struct echo_reference_buffer buffer;
+    memset(&buffer, 0, sizeof(buffer));
+    buffer.raw = frames;
+    buffer.frame_count = frameCount;
+    buffer.time_stamp.tv_sec = 1;
+    return er->write(er, &buffer);
+}
+
+// reads frames without a time stamp, so that the delay is never realigned
+template <typename T>
+static int readFrames(struct echo_reference_itfe *er, T *frames, size_t frameCount)
+{
+    struct echo_reference_buffer buffer;
+    memset(&buffer, 0, sizeof(buffer));
+    buffer.raw = frames;
+    buffer.frame_count = frameCount;
+    return er->read(er, &buffer);
+}
+
+// mono frames numbered from first, which is never 0, so that silence is told apart
+static std::vector<int16_t> makeRamp(size_t frames, int16_t first)
+{
+    std::vector<int16_t> out(frames);
+    for (size_t i = 0; i < frames; ++i) {
+        out[i] = (int16_t)(first + i);
+    }
+    return out;
+}
+
+TEST(audio_utils_echo_reference, write_read) {
+    const size_t frames = 480;
+    struct echo_reference_itfe *er;
+    ASSERT_EQ(0, create_echo_reference(AUDIO_FORMAT_PCM_16_BIT, 1, 48000,
+            AUDIO_FORMAT_PCM_16_BIT, 1, 48000, &er));
+    std::vector<int16_t> written = makeRamp(frames, 1);
+    std::vector<int16_t> read(frames, -1);
+
+    // frames written before reading starts are discarded
+    ASSERT_EQ(0, writeFrames(er, written.data(), frames));
+    ASSERT_EQ(0, readFrames(er, read.data(), frames));
+    EXPECT_EQ(std::vector<int16_t>(frames), read);
+
+    for (int i = 0; i < 3; ++i) {
+        written = makeRamp(frames, 1 + i * frames);
+        ASSERT_EQ(0, writeFrames(er, written.data(), frames));
+        ASSERT_EQ(0, readFrames(er, read.data(), frames));
+        EXPECT_EQ(written, read) << "write " << i;
+    }
+
+    // stopping the writer drops what was not read
+    ASSERT_EQ(0, writeFrames(er, written.data(), frames));
+    ASSERT_EQ(0, er->write(er, nullptr));
+    ASSERT_EQ(0, readFrames(er, read.data(), frames));
+    EXPECT_EQ(std::vector<int16_t>(frames), read);
+
+    EXPECT_EQ(0, er->read(er, nullptr));
+    release_echo_reference(er);
+}
+
+TEST(audio_utils_echo_reference, concurrent_write_read) {
+    // the playback thread writes while the capture thread reads, without any lock between them
+    const size_t frames = 160;
+    const size_t writes = 200;
+    struct echo_reference_itfe *er;
+    ASSERT_EQ(0, create_echo_reference(AUDIO_FORMAT_PCM_16_BIT, 1, 16000,
+            AUDIO_FORMAT_PCM_16_BIT, 1, 16000, &er));
+    std::vector<int16_t> read(frames);
+    ASSERT_EQ(0, readFrames(er, read.data(), frames));
+
+    std::atomic<bool> done(false);
+    std::thread writer([er, &done] {
+        for (size_t i = 0; i < writes; ++i) {
+            std::vector<int16_t> written = makeRamp(frames, 1 + i * frames);
+            EXPECT_EQ(0, writeFrames(er, written.data(), frames));
+            if (i % 10 == 0) {
+                std::this_thread::yield();
+            }
+        }
+        done = true;
+    });
+
+    // frames may be dropped if the FIFO overflows, but never repeated or reordered
+    int16_t last = 0;
+    size_t received = 0;
+    for (int emptyReads = 0; emptyReads < 10; ) {
+        const bool writerDone = done;
+        ASSERT_EQ(0, readFrames(er, read.data(), frames));
+        bool empty = true;
+        for (int16_t sample : read) {
+            if (sample != 0) {
+                ASSERT_LT(last, sample);
+                last = sample;
+                ++received;
+                empty = false;
+            }
+        }
+        if (writerDone && empty) {
+            ++emptyReads;
+        }
+    }
+    writer.join();
+    EXPECT_LT(0u, received);
+    EXPECT_EQ((int16_t)(writes * frames), last);
+    release_echo_reference(er);
+}
+
+TEST(audio_utils_echo_reference, preallocated_limits) {
+    struct echo_reference_itfe *er = nullptr;
+    EXPECT_EQ(-EINVAL, create_echo_reference_preallocated(AUDIO_FORMAT_PCM_16_BIT, 1, 48000,
+            AUDIO_FORMAT_PCM_16_BIT, 1, 48000, 0 /*maxReadFrames*/, 480, &er));
+    EXPECT_EQ(nullptr, er);
+    EXPECT_EQ(-EINVAL, create_echo_reference_preallocated(AUDIO_FORMAT_PCM_16_BIT, 1, 48000,
+            AUDIO_FORMAT_PCM_16_BIT, 1, 48000, 480, 0 /*maxWriteFrames*/, &er));
+    EXPECT_EQ(nullptr, er);
+
+    // stereo 44.1 kHz playback to mono 48 kHz capture, which needs every buffer
+    const size_t maxReadFrames = 480;
+    const size_t maxWriteFrames = 441;
+    ASSERT_EQ(0, create_echo_reference_preallocated(AUDIO_FORMAT_PCM_16_BIT, 1, 48000,
+            AUDIO_FORMAT_PCM_16_BIT, 2, 44100, maxReadFrames, maxWriteFrames, &er));
+    std::vector<int16_t> read(maxReadFrames + 1);
+    std::vector<int16_t> written = makeInput<int16_t>(maxWriteFrames + 1, 2);
+    EXPECT_EQ(-EINVAL, readFrames(er, read.data(), maxReadFrames + 1));
+    ASSERT_EQ(0, readFrames(er, read.data(), maxReadFrames));
+    EXPECT_EQ(-EINVAL, writeFrames(er, written.data(), maxWriteFrames + 1));
+
+    // 10 ms periods, with writes shorter than the maximum
+    size_t nonZero = 0;
+    for (int i = 0; i < 100; ++i) {
+        ASSERT_EQ(0, writeFrames(er, written.data(), i % 2 == 0 ? maxWriteFrames : 100));
+        ASSERT_EQ(0, readFrames(er, read.data(), i % 2 == 0 ? maxReadFrames : 109));
+        for (size_t j = 0; j < maxReadFrames; ++j) {
+            nonZero += read[j] != 0;
+        }
+    }
+    EXPECT_LT(10000u, nonZero);
+    release_echo_reference(er);
+}
+
+// number of reads deviating in the same direction before the delay is realigned
+static const int kMinDeltaNum = 4;
+
+TEST(audio_utils_echo_reference, preallocated_realign) {
+    // a delay realignment beyond the preallocated buffer is limited to its size
+    const size_t frames = 480;
+    for (bool preallocated : { false, true }) {
+        struct echo_reference_itfe *er;
+        if (preallocated) {
+            ASSERT_EQ(0, create_echo_reference_preallocated(AUDIO_FORMAT_PCM_16_BIT, 1, 48000,
+                    AUDIO_FORMAT_PCM_16_BIT, 1, 48000, frames, frames, &er));
+        } else {
+            ASSERT_EQ(0, create_echo_reference(AUDIO_FORMAT_PCM_16_BIT, 1, 48000,
+                    AUDIO_FORMAT_PCM_16_BIT, 1, 48000, &er));
+        }
+        std::vector<int16_t> read(frames);
+        ASSERT_EQ(0, readFrames(er, read.data(), frames));
+        for (int i = 0; i < 20; ++i) {
+            std::vector<int16_t> written = makeRamp(frames, 1 + i * frames);
+            struct echo_reference_buffer buffer;
+            memset(&buffer, 0, sizeof(buffer));
+            buffer.raw = written.data();
+            buffer.frame_count = frames;
+            buffer.time_stamp.tv_sec = 1 + i;
+            buffer.delay_ns = 1000000000;   // much more than the FIFO holds
+            ASSERT_EQ(0, er->write(er, &buffer));
+
+            memset(&buffer, 0, sizeof(buffer));
+            buffer.raw = read.data();
+            buffer.frame_count = frames;
+            buffer.time_stamp.tv_sec = 1 + i;
+            ASSERT_EQ(0, er->read(er, &buffer));
+            EXPECT_EQ(frames, buffer.frame_count);
+            EXPECT_EQ(0, buffer.delay_ns);
+            // realigned after a few reads, by as much silence as the buffer holds
+            if (i < kMinDeltaNum) {
+                EXPECT_EQ(written, read) << "read " << i;
+            } else if (i > kMinDeltaNum) {
+                EXPECT_EQ(std::vector<int16_t>(frames), read) << "read " << i;
+            }
+        }
+        release_echo_reference(er);
+    }
+}
+
+TEST(audio_utils_echo_reference, set_delay_mode) {
+    struct echo_reference_itfe *er;
+    ASSERT_EQ(0, create_echo_reference(AUDIO_FORMAT_PCM_16_BIT, 1, 48000,
+            AUDIO_FORMAT_PCM_16_BIT, 1, 48000, &er));
+    // tracking adjusts the resampling ratio, so it needs different rates
+    EXPECT_EQ(-ENOSYS, er->set_delay_mode(er, ECHO_REFERENCE_DELAY_TRACKING));
+    EXPECT_EQ(0, er->set_delay_mode(er, ECHO_REFERENCE_DELAY_REALIGN));
+    EXPECT_EQ(-EINVAL, er->set_delay_mode(er, (enum echo_reference_delay_mode)2));
+    release_echo_reference(er);
+
+    ASSERT_EQ(0, create_echo_reference(AUDIO_FORMAT_PCM_16_BIT, 1, 48000,
+            AUDIO_FORMAT_PCM_16_BIT, 2, 44100, &er));
+    EXPECT_EQ(0, er->set_delay_mode(er, ECHO_REFERENCE_DELAY_TRACKING));
+    EXPECT_EQ(0, er->set_delay_mode(er, ECHO_REFERENCE_DELAY_REALIGN));
+    release_echo_reference(er);
+}
+
+// Count the silent frames read in 10 ms periods of constant 44.1 kHz playback to 48 kHz capture,
+// with the playback delay indicated by write() exceeding what is buffered by about extraDelayNs.
+// Silence is only inserted by realigning the delay.
+static size_t countSilentFrames(enum echo_reference_delay_mode mode, int32_t extraDelayNs)
+{
+    const size_t writeCount = 441;
+    const size_t readCount = 480;
+    struct echo_reference_itfe *er;
+    EXPECT_EQ(0, create_echo_reference(AUDIO_FORMAT_PCM_16_BIT, 1, 48000,
+            AUDIO_FORMAT_PCM_16_BIT, 1, 44100, &er));
+    if (er == nullptr) {
+        return 0;
+    }
+    EXPECT_EQ(0, er->set_delay_mode(er, mode));
+    std::vector<int16_t> written(writeCount, 10000);
+    std::vector<int16_t> read(readCount);
+    EXPECT_EQ(0, readFrames(er, read.data(), readCount));
+
+    size_t silent = 0;
+    for (int i = 0; i < 200; ++i) {
+        struct echo_reference_buffer buffer;
+        memset(&buffer, 0, sizeof(buffer));
+        buffer.raw = written.data();
+        buffer.frame_count = writeCount;
+        buffer.time_stamp.tv_sec = 1 + i;
+        // about one period is buffered when reading
+        buffer.delay_ns = 10000000 + extraDelayNs;
+        EXPECT_EQ(0, er->write(er, &buffer));
+
+        memset(&buffer, 0, sizeof(buffer));
+        buffer.raw = read.data();
+        buffer.frame_count = readCount;
+        buffer.time_stamp.tv_sec = 1 + i;
+        EXPECT_EQ(0, er->read(er, &buffer));
+        // skip the start of the resampler output
+        if (i >= 2) {
+            for (int16_t sample : read) {
+                silent += sample == 0;
+            }
+        }
+    }
+    release_echo_reference(er);
+    return silent;
+}
+
+TEST(audio_utils_echo_reference, delay_tracking) {
+    // a small deviation is realigned at once, or tracked by the resampler without a gap
+    EXPECT_LT(0u, countSilentFrames(ECHO_REFERENCE_DELAY_REALIGN, 5000000));
+    EXPECT_EQ(0u, countSilentFrames(ECHO_REFERENCE_DELAY_TRACKING, 5000000));
+    // a large one is realigned in both modes
+    EXPECT_LT(0u, countSilentFrames(ECHO_REFERENCE_DELAY_REALIGN, 50000000));
+    EXPECT_LT(0u, countSilentFrames(ECHO_REFERENCE_DELAY_TRACKING, 50000000));
+}
+
+TEST(audio_utils_echo_reference, create_parameters) {
+    struct echo_reference_itfe *er;
+    // formats are never converted
+    EXPECT_EQ(-EINVAL, create_echo_reference(AUDIO_FORMAT_PCM_16_BIT, 1, 48000,
+            AUDIO_FORMAT_PCM_FLOAT, 1, 48000, &er));
+    EXPECT_EQ(-EINVAL, create_echo_reference(AUDIO_FORMAT_PCM_32_BIT, 1, 48000,
+            AUDIO_FORMAT_PCM_32_BIT, 1, 48000, &er));
+    EXPECT_EQ(-EINVAL, create_echo_reference(AUDIO_FORMAT_PCM_FLOAT, 0, 48000,
+            AUDIO_FORMAT_PCM_FLOAT, 1, 48000, &er));
+    EXPECT_EQ(-EINVAL, create_echo_reference(AUDIO_FORMAT_PCM_FLOAT, 1, 48000,
+            AUDIO_FORMAT_PCM_FLOAT, FCC_8 + 1, 48000, &er));
+    EXPECT_EQ(-EINVAL, create_echo_reference(AUDIO_FORMAT_PCM_FLOAT, 1, 48000,
+            AUDIO_FORMAT_PCM_FLOAT, 1, 48000, nullptr));
+    ASSERT_EQ(0, create_echo_reference(AUDIO_FORMAT_PCM_FLOAT, FCC_8, 48000,
+            AUDIO_FORMAT_PCM_FLOAT, FCC_8, 48000, &er));
+    release_echo_reference(er);
+}
+
+// sample c of frame i, such that the average of the first two channels is exact
+template <typename T>
+static T channelSample(size_t i, uint32_t c);
+
+template <>
+int16_t channelSample(size_t i, uint32_t c)
+{
+    return (int16_t)(i * 2 * FCC_8 + c * 2);
+}
+
+template <>
+float channelSample(size_t i, uint32_t c)
+{
+    return channelSample<int16_t>(i, c) / 32768.f;
+}
+
+template <typename T>
+static void checkChannelConversion(audio_format_t format, uint32_t wrChannels,
+        uint32_t rdChannels)
+{
+    const size_t frames = 480;
+    struct echo_reference_itfe *er;
+    ASSERT_EQ(0, create_echo_reference(format, rdChannels, 48000,
+            format, wrChannels, 48000, &er));
+    std::vector<T> written(frames * wrChannels);
+    std::vector<T> expected(frames * rdChannels);
+    for (size_t i = 0; i < frames; ++i) {
+        for (uint32_t c = 0; c < wrChannels; ++c) {
+            written[i * wrChannels + c] = channelSample<T>(i, c);
+        }
+        // extra channels are dropped or silent, except that mono is the average of the first
+        // two channels, and is copied to both of them
+        for (uint32_t c = 0; c < rdChannels; ++c) {
+            T sample = c < wrChannels ? channelSample<T>(i, c) : 0;
+            if (rdChannels == 1 && wrChannels > 1) {
+                sample = (channelSample<T>(i, 0) + channelSample<T>(i, 1)) / 2;
+            } else if (wrChannels == 1 && c == 1) {
+                sample = channelSample<T>(i, 0);
+            }
+            expected[i * rdChannels + c] = sample;
+        }
+    }
+    std::vector<T> read(frames * rdChannels);
+    ASSERT_EQ(0, readFrames(er, read.data(), frames));
+    ASSERT_EQ(0, writeFrames(er, written.data(), frames));
+    ASSERT_EQ(0, readFrames(er, read.data(), frames));
+    EXPECT_EQ(expected, read) << "channels " << wrChannels << " to " << rdChannels;
+    release_echo_reference(er);
+}
+
+TEST(audio_utils_echo_reference, channel_conversion) {
+    checkChannelConversion<int16_t>(AUDIO_FORMAT_PCM_16_BIT, 6, 2);
+    checkChannelConversion<int16_t>(AUDIO_FORMAT_PCM_16_BIT, 4, 1);
+    checkChannelConversion<int16_t>(AUDIO_FORMAT_PCM_16_BIT, 2, FCC_8);
+    checkChannelConversion<float>(AUDIO_FORMAT_PCM_FLOAT, FCC_8, 2);
+    checkChannelConversion<float>(AUDIO_FORMAT_PCM_FLOAT, 2, 1);
+    checkChannelConversion<float>(AUDIO_FORMAT_PCM_FLOAT, 1, 6);
+    checkChannelConversion<float>(AUDIO_FORMAT_PCM_FLOAT, 4, 4);
+}
@@ -0,0 +1,196 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "audio_utils_fft_tests"
+
+#include <math.h>
+#include <stdlib.h>
+#include <vector>
+#include <gtest/gtest.h>
+#include <audio_utils/fft.h>
+#include <audio_utils/fixedfft.h>
+
+// pseudo-random values in [-1, 1)
+static std::vector<float> makeNoise(size_t count, unsigned seed)
+{
+    std::vector<float> noise(count);
+    for (size_t i = 0; i < count; ++i) {
+        seed = seed * 1103515245 + 12345;
+        noise[i] = (float)((seed >> 8) & 0xffff) / 32768.f - 1.f;
+    }
+    return noise;
+}
+
+// direct DFT in double, of n interleaved complex values
+static std::vector<double> referenceDft(const std::vector<float> &in, size_t n, bool inverse)
+{
+    std::vector<double> out(2 * n);
+    const double sign = inverse ? 1. : -1.;
+    for (size_t k = 0; k < n; ++k) {
+        double re = 0, im = 0;
+        for (size_t t = 0; t < n; ++t) {
+            const double phase = sign * 2. * M_PI * (double)((k * t) % n) / n;
+            re += in[2 * t] * cos(phase) - in[2 * t + 1] * sin(phase);
+            im += in[2 * t] * sin(phase) + in[2 * t + 1] * cos(phase);
+        }
+        out[2 * k] = re;
+        out[2 * k + 1] = im;
+    }
+    return out;
+}
+
+// error tolerance grows with log2(n), relative to the sqrt(n) magnitude of the spectrum of noise
+static double tolerance(size_t n)
+{
+    return 1e-6 * sqrt((double)n) * (log2((double)n) + 1) * 4;
+}
+
+TEST(audio_utils_fft, plan_create) {
+    EXPECT_EQ(NULL, fft_float_plan_create(0));
+    EXPECT_EQ(NULL, fft_float_plan_create(2));
+    EXPECT_EQ(NULL, fft_float_plan_create(48));
+    EXPECT_EQ(NULL, fft_float_plan_create(FFT_FLOAT_MAX_SIZE * 2));
+    struct fft_float_plan *plan = fft_float_plan_create(FFT_FLOAT_MIN_SIZE);
+    ASSERT_TRUE(plan != NULL);
+    EXPECT_EQ((size_t)FFT_FLOAT_MIN_SIZE, fft_float_plan_size(plan));
+    fft_float_plan_destroy(plan);
+    fft_float_plan_destroy(NULL);
+}
+
+TEST(audio_utils_fft, complex) {
+    for (size_t n = FFT_FLOAT_MIN_SIZE; n <= 2048; n *= 2) {
+        struct fft_float_plan *plan = fft_float_plan_create(n);
+        ASSERT_TRUE(plan != NULL);
+        const std::vector<float> in = makeNoise(2 * n, n);
+        const double tol = tolerance(n);
+        for (int inverse = 0; inverse <= 1; ++inverse) {
+            std::vector<double> expected = referenceDft(in, n, inverse);
+            std::vector<float> data(in);
+            if (inverse) {
+                fft_float_complex_inverse(plan, &data[0]);
+            } else {
+                fft_float_complex(plan, &data[0]);
+            }
+            for (size_t i = 0; i < 2 * n; ++i) {
+                ASSERT_NEAR(expected[i], data[i], tol) << "n=" << n << " i=" << i
+                        << " inverse=" << inverse;
+            }
+        }
+        fft_float_plan_destroy(plan);
+    }
+}
+
+TEST(audio_utils_fft, real) {
+    for (size_t n = FFT_FLOAT_MIN_SIZE; n <= 2048; n *= 2) {
+        struct fft_float_plan *plan = fft_float_plan_create(n);
+        ASSERT_TRUE(plan != NULL);
+        const std::vector<float> in = makeNoise(n, n + 1);
+        std::vector<float> complexIn(2 * n);
+        for (size_t t = 0; t < n; ++t) {
+            complexIn[2 * t] = in[t];
+        }
+        std::vector<double> expected = referenceDft(complexIn, n, false /*inverse*/);
+        std::vector<float> data(in);
+        fft_float_real(plan, &data[0]);
+        const double tol = tolerance(n);
+        EXPECT_NEAR(expected[0], data[0], tol);
+        EXPECT_NEAR(expected[n], data[1], tol); // real part of X[n / 2]
+        for (size_t i = 2; i < n; ++i) {
+            ASSERT_NEAR(expected[i], data[i], tol) << "n=" << n << " i=" << i;
+        }
+
+        // unscaled inverse returns n times the input
+        fft_float_real_inverse(plan, &data[0]);
+        for (size_t t = 0; t < n; ++t) {
+            ASSERT_NEAR(in[t], data[t] / n, 1e-5) << "n=" << n << " t=" << t;
+        }
+        fft_float_plan_destroy(plan);
+    }
+}
+
+TEST(audio_utils_fft, round_trip_max_size) {
+    const size_t n = FFT_FLOAT_MAX_SIZE;
+    struct fft_float_plan *plan = fft_float_plan_create(n);
+    ASSERT_TRUE(plan != NULL);
+    const std::vector<float> in = makeNoise(2 * n, 1);
+    std::vector<float> data(in);
+    fft_float_complex(plan, &data[0]);
+    fft_float_complex_inverse(plan, &data[0]);
+    for (size_t i = 0; i < 2 * n; ++i) {
+        ASSERT_NEAR(in[i], data[i] / n, 1e-5) << "i=" << i;
+    }
+    fft_float_plan_destroy(plan);
+}
+
+TEST(audio_utils_fft, batch) {
+    const size_t n = 256, count = 5, stride = 2 * n + 6;
+    struct fft_float_plan *plan = fft_float_plan_create(n);
+    ASSERT_TRUE(plan != NULL);
+    const std::vector<float> in = makeNoise(stride * count, 3);
+    for (int inverse = 0; inverse <= 1; ++inverse) {
+        std::vector<float> batch(in);
+        fft_float_complex_batch(plan, &batch[0], count, stride, inverse);
+        std::vector<float> realBatch(in);
+        fft_float_real_batch(plan, &realBatch[0], count, stride, inverse);
+        for (size_t f = 0; f < count; ++f) {
+            std::vector<float> single(in.begin() + f * stride, in.begin() + (f + 1) * stride);
+            std::vector<float> realSingle(single);
+            if (inverse) {
+                fft_float_complex_inverse(plan, &single[0]);
+                fft_float_real_inverse(plan, &realSingle[0]);
+            } else {
+                fft_float_complex(plan, &single[0]);
+                fft_float_real(plan, &realSingle[0]);
+            }
+            for (size_t i = 0; i < stride; ++i) {
+                ASSERT_EQ(single[i], batch[f * stride + i]);
+                ASSERT_EQ(realSingle[i], realBatch[f * stride + i]);
+            }
+        }
+    }
+    fft_float_plan_destroy(plan);
+}
+
+TEST(audio_utils_fixedfft, plan_bit_exact) {
+    EXPECT_EQ(NULL, fixed_fft_plan_create(1));
+    EXPECT_EQ(NULL, fixed_fft_plan_create(384));
+    EXPECT_EQ(NULL, fixed_fft_plan_create(1024));
+    for (int n = 2; n <= 512; n *= 2) {
+        struct fixed_fft_plan *plan = fixed_fft_plan_create(n);
+        ASSERT_TRUE(plan != NULL);
+        const size_t count = 3, stride = n + 1;
+        std::vector<int32_t> in(stride * count);
+        unsigned seed = n;
+        for (size_t i = 0; i < in.size(); ++i) {
+            seed = seed * 1103515245 + 12345;
+            in[i] = (int32_t)seed;
+        }
+        std::vector<int32_t> batch(in);
+        fixed_fft_real_batch(plan, &batch[0], count, stride);
+        for (size_t f = 0; f < count; ++f) {
+            std::vector<int32_t> expected(in.begin() + f * stride, in.begin() + (f + 1) * stride);
+            std::vector<int32_t> single(expected);
+            fixed_fft_real(n, &expected[0]);
+            fixed_fft_real_plan(plan, &single[0]);
+            for (size_t i = 0; i < stride; ++i) {
+                ASSERT_EQ(expected[i], single[i]) << "n=" << n << " i=" << i;
+                ASSERT_EQ(expected[i], batch[f * stride + i]) << "n=" << n << " f=" << f;
+            }
+        }
+        fixed_fft_plan_destroy(plan);
+    }
+}
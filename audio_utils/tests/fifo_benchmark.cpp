@@ -0,0 +1,232 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Benchmark for audio_utils FIFO library.
+// A producer thread writes and a consumer thread reads a fixed number of frames through the FIFO,
+// using the blocking API.  For each combination of frame size, frame count, and CPU placement,
+// this reports the throughput and the latency percentiles of individual write and read calls.
+// Compare the results before and after a change, on an otherwise idle device.
+
+#include <algorithm>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <audio_utils/fifo.h>
+
+static inline int64_t systemTimeNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Pin the calling thread to one CPU.  Returns false if not possible, e.g. CPU is offline.
+static bool pinToCpu(int cpu)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return sched_setaffinity(0 /*calling thread*/, sizeof(set), &set) == 0;
+}
+
+// If one side fails, this lets the other side give up instead of blocking forever
+static const struct timespec kTimeout = {1 /*tv_sec*/, 0 /*tv_nsec*/};
+
+struct Side {
+    struct audio_utils_fifo *mFifo;
+    char *mBuffer;          // source or destination, mFramesPerOp frames
+    size_t mFramesPerOp;
+    size_t mTotalFrames;
+    int mCpu;               // CPU to pin to, or -1 for no pinning
+    int64_t *mLatencyNs;    // one entry per call
+    size_t mOps;            // number of entries used in mLatencyNs
+    bool mFailed;
+};
+
+static void *producerLoop(void *arg)
+{
+    Side *side = (Side *) arg;
+    if (side->mCpu >= 0 && !pinToCpu(side->mCpu)) {
+        side->mFailed = true;
+        return NULL;
+    }
+    size_t framesWritten = 0;
+    while (framesWritten < side->mTotalFrames) {
+        size_t framesToWrite = std::min(side->mFramesPerOp, side->mTotalFrames - framesWritten);
+        int64_t before = systemTimeNs();
+        ssize_t actual = audio_utils_fifo_write_timed(side->mFifo, side->mBuffer, framesToWrite,
+                &kTimeout);
+        side->mLatencyNs[side->mOps++] = systemTimeNs() - before;
+        if (actual <= 0) {
+            side->mFailed = true;
+            break;
+        }
+        framesWritten += actual;
+    }
+    return NULL;
+}
+
+static void *consumerLoop(void *arg)
+{
+    Side *side = (Side *) arg;
+    if (side->mCpu >= 0 && !pinToCpu(side->mCpu)) {
+        side->mFailed = true;
+        return NULL;
+    }
+    size_t framesRead = 0;
+    while (framesRead < side->mTotalFrames) {
+        size_t framesToRead = std::min(side->mFramesPerOp, side->mTotalFrames - framesRead);
+        int64_t before = systemTimeNs();
+        ssize_t actual = audio_utils_fifo_read_timed(side->mFifo, side->mBuffer, framesToRead,
+                &kTimeout);
+        side->mLatencyNs[side->mOps++] = systemTimeNs() - before;
+        if (actual <= 0) {
+            side->mFailed = true;
+            break;
+        }
+        framesRead += actual;
+    }
+    return NULL;
+}
+
+// Sort the latencies in place, and print the 50th, 90th, 99th percentiles and maximum.
+static void printPercentiles(const char *label, int64_t *latencyNs, size_t ops)
+{
+    if (ops == 0) {
+        printf(" %s -", label);
+        return;
+    }
+    std::sort(latencyNs, latencyNs + ops);
+    printf(" %s %6lld %6lld %6lld %8lld", label,
+            (long long) latencyNs[ops * 50 / 100], (long long) latencyNs[ops * 90 / 100],
+            (long long) latencyNs[ops * 99 / 100], (long long) latencyNs[ops - 1]);
+}
+
+// Run one configuration and print one line of results.  Returns false on failure.
+static bool runOne(size_t frameSize, size_t frameCount, size_t framesPerOp, size_t totalFrames,
+        int producerCpu, int consumerCpu)
+{
+    char *fifoBuffer = new char[frameCount * frameSize];
+    struct audio_utils_fifo fifo;
+    audio_utils_fifo_init(&fifo, frameCount, frameSize, fifoBuffer);
+
+    // each side can need at most one call per frame
+    size_t maxOps = totalFrames;
+    Side producer = {&fifo, new char[framesPerOp * frameSize], framesPerOp, totalFrames,
+            producerCpu, new int64_t[maxOps], 0, false};
+    Side consumer = {&fifo, new char[framesPerOp * frameSize], framesPerOp, totalFrames,
+            consumerCpu, new int64_t[maxOps], 0, false};
+    memset(producer.mBuffer, 0x55, framesPerOp * frameSize);
+
+    int64_t start = systemTimeNs();
+    pthread_t producerThread, consumerThread;
+    pthread_create(&consumerThread, NULL, consumerLoop, &consumer);
+    pthread_create(&producerThread, NULL, producerLoop, &producer);
+    pthread_join(producerThread, NULL);
+    pthread_join(consumerThread, NULL);
+    int64_t elapsedNs = systemTimeNs() - start;
+
+    bool ok = !producer.mFailed && !consumer.mFailed;
+    if (ok) {
+        printf("%5zu %6zu %4s %4zu %10.0f", frameSize, frameCount,
+                producerCpu < 0 ? "any" : producerCpu == consumerCpu ? "same" : "diff",
+                framesPerOp, (double) totalFrames * 1e9 / elapsedNs);
+        printPercentiles(" W", producer.mLatencyNs, producer.mOps);
+        printPercentiles(" R", consumer.mLatencyNs, consumer.mOps);
+        printf("\n");
+    } else {
+        fprintf(stderr, "frameSize=%zu frameCount=%zu producerCpu=%d consumerCpu=%d failed\n",
+                frameSize, frameCount, producerCpu, consumerCpu);
+    }
+
+    delete[] producer.mBuffer;
+    delete[] producer.mLatencyNs;
+    delete[] consumer.mBuffer;
+    delete[] consumer.mLatencyNs;
+    audio_utils_fifo_deinit(&fifo);
+    delete[] fifoBuffer;
+    return ok;
+}
+
+int main(int argc, char **argv)
+{
+    size_t framesPerOp = 64;
+    size_t totalFrames = 1 << 20;
+    int cpu0 = 0;
+    int cpu1 = 1;
+    int i;
+    for (i = 1; i < argc; i++) {
+        char *arg = argv[i];
+        if (arg[0] != '-')
+            break;
+        switch (arg[1]) {
+        case 'b':   // frames per write and per read
+            framesPerOp = atoi(&arg[2]);
+            break;
+        case 'n':   // total frames per configuration
+            totalFrames = atoi(&arg[2]);
+            break;
+        case 'p':   // first CPU, used for "same" and as producer for "diff"
+            cpu0 = atoi(&arg[2]);
+            break;
+        case 'q':   // second CPU, used as consumer for "diff"
+            cpu1 = atoi(&arg[2]);
+            break;
+        default:
+            fprintf(stderr, "%s: unknown option %s\n", argv[0], arg);
+            goto usage;
+        }
+    }
+    if (argc - i != 0 || framesPerOp == 0 || totalFrames == 0) {
+usage:
+        fprintf(stderr, "usage: %s [-b#] [-n#] [-p#] [-q#]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    static const size_t frameSizes[] = {2, 4, 8, 32};
+    // power of 2, and non-power of 2 which exercises the fudge factor
+    static const size_t frameCounts[] = {256, 1024, 240, 960};
+    // CPU placements: unpinned, producer and consumer on same CPU, and on different CPUs
+    const int placements[][2] = {{-1, -1}, {cpu0, cpu0}, {cpu0, cpu1}};
+    bool multiCpu = sysconf(_SC_NPROCESSORS_ONLN) > 1;
+
+    printf("Latencies are in nanoseconds: p50 p90 p99 max\n");
+    printf("%5s %6s %4s %4s %10s  %-32s %-32s\n", "fsize", "fcount", "cpu", "op",
+            "frames/s", "write latency", "read latency");
+    int failures = 0;
+    for (size_t fs = 0; fs < sizeof(frameSizes) / sizeof(frameSizes[0]); fs++) {
+        for (size_t fc = 0; fc < sizeof(frameCounts) / sizeof(frameCounts[0]); fc++) {
+            if (framesPerOp > frameCounts[fc]) {
+                continue;
+            }
+            for (size_t pl = 0; pl < sizeof(placements) / sizeof(placements[0]); pl++) {
+                if (placements[pl][0] != placements[pl][1] && !multiCpu) {
+                    continue;
+                }
+                if (!runOne(frameSizes[fs], frameCounts[fc], framesPerOp, totalFrames,
+                        placements[pl][0], placements[pl][1])) {
+                    failures++;
+                }
+            }
+        }
+    }
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
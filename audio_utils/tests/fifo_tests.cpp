@@ -15,19 +15,99 @@
  */
 
 // Test program for audio_utils FIFO library.
-// This only tests the single-threaded aspects, not the barriers.
+// By default this only tests the single-threaded aspects, not the barriers.
+// The -t option runs the writer on a separate thread using the blocking API.
+// The -l option uses the cache-line padded FIFO with 64-bit indices instead.
+// The -p option runs the writer in a separate process, with the FIFO in shared memory.
 
 #include <limits.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
 #include <audio_utils/fifo.h>
 #include <audio_utils/sndfile.h>
 
+// Write to FIFO through the obtain/release interface, copying directly into the regions.
+static ssize_t fifoWriteZeroCopy(struct audio_utils_fifo *fifo, const void *buffer, size_t count)
+{
+    struct audio_utils_iovec iovec[2];
+    ssize_t obtained = audio_utils_fifo_write_obtain(fifo, iovec, count);
+    if (obtained <= 0) {
+        return obtained;
+    }
+    const char *src = (const char *) buffer;
+    for (int i = 0; i < 2; i++) {
+        size_t bytes = iovec[i].mLength * fifo->mFrameSize;
+        memcpy((char *) fifo->mBuffer + iovec[i].mOffset * fifo->mFrameSize, src, bytes);
+        src += bytes;
+    }
+    audio_utils_fifo_write_release(fifo, obtained);
+    return obtained;
+}
+
+// Read from FIFO through the obtain/release interface, copying directly from the regions.
+static ssize_t fifoReadZeroCopy(struct audio_utils_fifo *fifo, void *buffer, size_t count)
+{
+    struct audio_utils_iovec iovec[2];
+    ssize_t obtained = audio_utils_fifo_read_obtain(fifo, iovec, count);
+    if (obtained <= 0) {
+        return obtained;
+    }
+    char *dst = (char *) buffer;
+    for (int i = 0; i < 2; i++) {
+        size_t bytes = iovec[i].mLength * fifo->mFrameSize;
+        memcpy(dst, (const char *) fifo->mBuffer + iovec[i].mOffset * fifo->mFrameSize, bytes);
+        dst += bytes;
+    }
+    audio_utils_fifo_read_release(fifo, obtained);
+    return obtained;
+}
+
+struct BlockingWriter {
+    struct audio_utils_fifo *mFifo;
+    const short *mBuffer;
+    size_t mFrames;
+    size_t mChannels;
+    size_t mMaxFramesPerWrite;
+    bool mFailed;
+};
+
+// Writer thread for -t: write all frames with random counts, blocking while the FIFO is full.
+static void *blockingWriterLoop(void *arg)
+{
+    BlockingWriter *writer = (BlockingWriter *) arg;
+    size_t framesWritten = 0;
+    while (framesWritten < writer->mFrames) {
+        size_t framesToWrite = writer->mFrames - framesWritten;
+        if (framesToWrite > writer->mMaxFramesPerWrite) {
+            framesToWrite = writer->mMaxFramesPerWrite;
+        }
+        framesToWrite = rand() % framesToWrite + 1;
+        ssize_t actualWritten = audio_utils_fifo_write_timed(writer->mFifo,
+                &writer->mBuffer[framesWritten * writer->mChannels], framesToWrite,
+                NULL /*timeout*/);
+        if (actualWritten <= 0 || (size_t) actualWritten > framesToWrite) {
+            writer->mFailed = true;
+            break;
+        }
+        framesWritten += actualWritten;
+    }
+    return NULL;
+}
+
 int main(int argc, char **argv)
 {
     size_t frameCount = 256;
     size_t maxFramesPerRead = 1;
     size_t maxFramesPerWrite = 1;
+    bool zeroCopy = false;
+    bool threaded = false;
+    bool crossProcess = false;
+    bool padded = false;
+    size_t readerCount = 0;
     int i;
     for (i = 1; i < argc; i++) {
         char *arg = argv[i];
@@ -37,12 +117,28 @@ int main(int argc, char **argv)
         case 'c':   // FIFO frame count
             frameCount = atoi(&arg[2]);
             break;
+        case 'l':   // use cache-line padded FIFO with 64-bit indices
+            padded = true;
+            break;
+        case 'm':   // number of readers for broadcast FIFO
+            readerCount = atoi(&arg[2]);
+            break;
+        case 'p':   // writer in separate process, FIFO in shared memory
+            threaded = true;
+            crossProcess = true;
+            break;
         case 'r':   // maximum frame count per read from FIFO
             maxFramesPerRead = atoi(&arg[2]);
             break;
         case 'w':   // maximum frame count per write to FIFO
             maxFramesPerWrite = atoi(&arg[2]);
             break;
+        case 't':   // writer on separate thread, blocking write and read
+            threaded = true;
+            break;
+        case 'z':   // use obtain/release instead of write/read
+            zeroCopy = true;
+            break;
         default:
             fprintf(stderr, "%s: unknown option %s\n", argv[0], arg);
             goto usage;
@@ -51,7 +147,7 @@ int main(int argc, char **argv)
 
     if (argc - i != 2) {
 usage:
-        fprintf(stderr, "usage: %s [-c#] in.wav out.wav\n", argv[0]);
+        fprintf(stderr, "usage: %s [-c#] [-m#] [-r#] [-w#] [-l] [-p] [-t] [-z] in.wav out.wav\n", argv[0]);
         return EXIT_FAILURE;
     }
     char *inputFile = argv[i];
@@ -90,60 +186,203 @@ usage:
     struct audio_utils_fifo fifo;
     short *fifoBuffer = new short[frameCount * sfinfoin.channels];
     audio_utils_fifo_init(&fifo, frameCount, frameSize, fifoBuffer);
+    struct audio_utils_fifo64 fifo64;
+    audio_utils_fifo64_init(&fifo64, frameCount, frameSize, fifoBuffer);
     int fifoWriteCount = 0, fifoReadCount = 0;
     int fifoFillLevel = 0, minFillLevel = INT_MAX, maxFillLevel = INT_MIN;
-    for (;;) {
-        size_t framesToWrite = sfinfoin.frames - framesWritten;
-        size_t framesToRead = sfinfoin.frames - framesRead;
-        if (framesToWrite == 0 && framesToRead == 0) {
-            break;
+    if (threaded) {
+        struct audio_utils_fifo *readerFifo = &fifo;
+        struct audio_utils_fifo sharedFifo;
+        size_t sharedSize = audio_utils_fifo_shared_size(frameCount, frameSize);
+        void *shared = MAP_FAILED;
+        pid_t writerPid = -1;
+        if (crossProcess) {
+            shared = mmap(NULL, sharedSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS,
+                    -1, 0);
+            if (shared == MAP_FAILED || audio_utils_fifo_shared_init(shared, sharedSize,
+                    frameCount, frameSize) != 0) {
+                fprintf(stderr, "shared FIFO setup failed\n");
+                return EXIT_FAILURE;
+            }
+            writerPid = fork();
+            if (writerPid == 0) {
+                // the writer process attaches its own view of the same FIFO
+                struct audio_utils_fifo writerFifo;
+                if (audio_utils_fifo_shared_attach(&writerFifo, shared, sharedSize) != 0) {
+                    _exit(EXIT_FAILURE);
+                }
+                BlockingWriter writer = {&writerFifo, inputBuffer, (size_t) sfinfoin.frames,
+                        (size_t) sfinfoin.channels, maxFramesPerWrite, false};
+                blockingWriterLoop(&writer);
+                _exit(writer.mFailed ? EXIT_FAILURE : EXIT_SUCCESS);
+            }
+            if (writerPid < 0 ||
+                    audio_utils_fifo_shared_attach(&sharedFifo, shared, sharedSize) != 0) {
+                fprintf(stderr, "shared FIFO setup failed\n");
+                return EXIT_FAILURE;
+            }
+            readerFifo = &sharedFifo;
         }
-
-        if (framesToWrite > maxFramesPerWrite) {
-            framesToWrite = maxFramesPerWrite;
+        BlockingWriter writer = {&fifo, inputBuffer, (size_t) sfinfoin.frames,
+                (size_t) sfinfoin.channels, maxFramesPerWrite, false};
+        pthread_t writerThread;
+        if (!crossProcess) {
+            pthread_create(&writerThread, NULL, blockingWriterLoop, &writer);
         }
-        framesToWrite = rand() % (framesToWrite + 1);
-        ssize_t actualWritten = audio_utils_fifo_write(&fifo,
-                &inputBuffer[framesWritten * sfinfoin.channels], framesToWrite);
-        if (actualWritten < 0 || (size_t) actualWritten > framesToWrite) {
-            fprintf(stderr, "write to FIFO failed\n");
-            break;
+        while (framesRead < (size_t) sfinfoin.frames) {
+            size_t framesToRead = sfinfoin.frames - framesRead;
+            if (framesToRead > maxFramesPerRead) {
+                framesToRead = maxFramesPerRead;
+            }
+            ssize_t actualRead = audio_utils_fifo_read_timed(readerFifo,
+                    &outputBuffer[framesRead * sfinfoin.channels], framesToRead,
+                    NULL /*timeout*/);
+            if (actualRead <= 0 || (size_t) actualRead > framesToRead) {
+                fprintf(stderr, "read from FIFO failed\n");
+                break;
+            }
+            framesRead += actualRead;
+            fifoReadCount++;
         }
-        framesWritten += actualWritten;
-        if (actualWritten > 0) {
-            fifoWriteCount++;
+        if (crossProcess) {
+            int status;
+            if (waitpid(writerPid, &status, 0) != writerPid || !WIFEXITED(status) ||
+                    WEXITSTATUS(status) != EXIT_SUCCESS) {
+                writer.mFailed = true;
+            }
+            audio_utils_fifo_deinit(&sharedFifo);
+            munmap(shared, sharedSize);
+        } else {
+            pthread_join(writerThread, NULL);
         }
-        fifoFillLevel += actualWritten;
-        if (fifoFillLevel > maxFillLevel) {
-            maxFillLevel = fifoFillLevel;
-            if (maxFillLevel > (int) frameCount)
-                abort();
+        if (writer.mFailed) {
+            fprintf(stderr, "write to FIFO failed\n");
         }
-
-        if (framesToRead > maxFramesPerRead) {
-            framesToRead = maxFramesPerRead;
+    } else if (readerCount > 0) {
+        // Broadcast to all readers; reader 0 goes to the output file, and the others must match.
+        struct audio_utils_fifo_broadcast broadcastFifo;
+        struct audio_utils_fifo_reader *readers = new audio_utils_fifo_reader[readerCount];
+        audio_utils_fifo_broadcast_init(&broadcastFifo, frameCount, frameSize, fifoBuffer,
+                readers, readerCount, 0 /*overwrite*/);
+        short **readerBuffers = new short *[readerCount];
+        size_t *readerFrames = new size_t[readerCount];
+        for (size_t j = 0; j < readerCount; j++) {
+            readerBuffers[j] = j == 0 ? outputBuffer :
+                    new short[sfinfoin.frames * sfinfoin.channels];
+            readerFrames[j] = 0;
         }
-        framesToRead = rand() % (framesToRead + 1);
-        ssize_t actualRead = audio_utils_fifo_read(&fifo,
-                &outputBuffer[framesRead * sfinfoin.channels], framesToRead);
-        if (actualRead < 0 || (size_t) actualRead > framesToRead) {
-            fprintf(stderr, "read from FIFO failed\n");
-            break;
-        }
-        framesRead += actualRead;
-        if (actualRead > 0) {
-            fifoReadCount++;
+        while (framesRead < (size_t) sfinfoin.frames) {
+            size_t framesToWrite = sfinfoin.frames - framesWritten;
+            if (framesToWrite > maxFramesPerWrite) {
+                framesToWrite = maxFramesPerWrite;
+            }
+            framesToWrite = rand() % (framesToWrite + 1);
+            ssize_t actualWritten = audio_utils_fifo_broadcast_write(&broadcastFifo,
+                    &inputBuffer[framesWritten * sfinfoin.channels], framesToWrite);
+            if (actualWritten < 0 || (size_t) actualWritten > framesToWrite) {
+                fprintf(stderr, "write to FIFO failed\n");
+                break;
+            }
+            framesWritten += actualWritten;
+            if (actualWritten > 0) {
+                fifoWriteCount++;
+            }
+            for (size_t j = 0; j < readerCount; j++) {
+                size_t framesToRead = sfinfoin.frames - readerFrames[j];
+                if (framesToRead > maxFramesPerRead) {
+                    framesToRead = maxFramesPerRead;
+                }
+                framesToRead = rand() % (framesToRead + 1);
+                ssize_t actualRead = audio_utils_fifo_broadcast_read(&broadcastFifo, j,
+                        &readerBuffers[j][readerFrames[j] * sfinfoin.channels], framesToRead);
+                if (actualRead < 0 || (size_t) actualRead > framesToRead) {
+                    fprintf(stderr, "read from FIFO failed\n");
+                    abort();
+                }
+                readerFrames[j] += actualRead;
+                if (j == 0 && actualRead > 0) {
+                    fifoReadCount++;
+                }
+            }
+            framesRead = readerFrames[0];
+            for (size_t j = 1; j < readerCount; j++) {
+                if (readerFrames[j] < framesRead) {
+                    framesRead = readerFrames[j];
+                }
+            }
         }
-        fifoFillLevel -= actualRead;
-        if (fifoFillLevel < minFillLevel) {
-            minFillLevel = fifoFillLevel;
-            if (minFillLevel < 0)
+        for (size_t j = 1; j < readerCount; j++) {
+            if (memcmp(readerBuffers[j], outputBuffer, framesRead * frameSize)) {
+                fprintf(stderr, "reader %zu differs from reader 0\n", j);
                 abort();
+            }
+            delete[] readerBuffers[j];
+        }
+        delete[] readerBuffers;
+        delete[] readerFrames;
+        audio_utils_fifo_broadcast_deinit(&broadcastFifo);
+        delete[] readers;
+    } else {
+        for (;;) {
+            size_t framesToWrite = sfinfoin.frames - framesWritten;
+            size_t framesToRead = sfinfoin.frames - framesRead;
+            if (framesToWrite == 0 && framesToRead == 0) {
+                break;
+            }
+
+            if (framesToWrite > maxFramesPerWrite) {
+                framesToWrite = maxFramesPerWrite;
+            }
+            framesToWrite = rand() % (framesToWrite + 1);
+            ssize_t actualWritten = padded ? audio_utils_fifo64_write(&fifo64,
+                    &inputBuffer[framesWritten * sfinfoin.channels], framesToWrite) :
+                    (zeroCopy ? fifoWriteZeroCopy : audio_utils_fifo_write)(&fifo,
+                    &inputBuffer[framesWritten * sfinfoin.channels], framesToWrite);
+            if (actualWritten < 0 || (size_t) actualWritten > framesToWrite) {
+                fprintf(stderr, "write to FIFO failed\n");
+                break;
+            }
+            framesWritten += actualWritten;
+            if (actualWritten > 0) {
+                fifoWriteCount++;
+            }
+            fifoFillLevel += actualWritten;
+            if (fifoFillLevel > maxFillLevel) {
+                maxFillLevel = fifoFillLevel;
+                if (maxFillLevel > (int) frameCount)
+                    abort();
+            }
+
+            if (framesToRead > maxFramesPerRead) {
+                framesToRead = maxFramesPerRead;
+            }
+            framesToRead = rand() % (framesToRead + 1);
+            ssize_t actualRead = padded ? audio_utils_fifo64_read(&fifo64,
+                    &outputBuffer[framesRead * sfinfoin.channels], framesToRead) :
+                    (zeroCopy ? fifoReadZeroCopy : audio_utils_fifo_read)(&fifo,
+                    &outputBuffer[framesRead * sfinfoin.channels], framesToRead);
+            if (actualRead < 0 || (size_t) actualRead > framesToRead) {
+                fprintf(stderr, "read from FIFO failed\n");
+                break;
+            }
+            framesRead += actualRead;
+            if (actualRead > 0) {
+                fifoReadCount++;
+            }
+            fifoFillLevel -= actualRead;
+            if (fifoFillLevel < minFillLevel) {
+                minFillLevel = fifoFillLevel;
+                if (minFillLevel < 0)
+                    abort();
+            }
         }
     }
     printf("FIFO non-empty writes: %d, non-empty reads: %d\n", fifoWriteCount, fifoReadCount);
-    printf("fill=%d, min=%d, max=%d\n", fifoFillLevel, minFillLevel, maxFillLevel);
+    if (!threaded && readerCount == 0) {
+        printf("fill=%d, min=%d, max=%d\n", fifoFillLevel, minFillLevel, maxFillLevel);
+    }
     audio_utils_fifo_deinit(&fifo);
+    audio_utils_fifo64_deinit(&fifo64);
     delete[] fifoBuffer;
 
     SF_INFO sfinfoout;
@@ -159,7 +398,6 @@ usage:
     sf_count_t actualWritten = sf_writef_short(sfout, outputBuffer, framesRead);
     delete[] inputBuffer;
     delete[] outputBuffer;
-    delete[] fifoBuffer;
     if (actualWritten != (sf_count_t) framesRead) {
         fprintf(stderr, "%s: unexpected error\n", outputFile);
         sf_close(sfout);
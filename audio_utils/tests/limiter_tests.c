@@ -19,6 +19,49 @@
 #include <stdlib.h>
 #include <audio_utils/limiter.h>
 
+// Compare limiter_block() with limiter() over the input range, return number of mismatches.
+static int check_limiter_block(void)
+{
+    enum { kCount = 1000003 }; // odd, so the scalar tail of limiter_block() is also exercised
+    static float buffer[kCount];
+    int i;
+    for (i = 0; i < kCount; i++) {
+        buffer[i] = (float) (M_SQRT2 * (2.0 * i / (kCount - 1) - 1.0));
+    }
+    // crossover and end points exactly
+    buffer[0] = (float) M_SQRT1_2;
+    buffer[1] = -(float) M_SQRT1_2;
+    buffer[2] = nextafterf((float) M_SQRT1_2, 1.0f);
+    buffer[3] = (float) M_SQRT2;
+    buffer[4] = -(float) M_SQRT2;
+    buffer[5] = 0.0f;
+    buffer[6] = -0.0f;
+    limiter_block(buffer, kCount);
+    int errors = 0;
+    for (i = 0; i < kCount; i++) {
+        float in = (float) (M_SQRT2 * (2.0 * i / (kCount - 1) - 1.0));
+        switch (i) {
+        case 0: in = (float) M_SQRT1_2; break;
+        case 1: in = -(float) M_SQRT1_2; break;
+        case 2: in = nextafterf((float) M_SQRT1_2, 1.0f); break;
+        case 3: in = (float) M_SQRT2; break;
+        case 4: in = -(float) M_SQRT2; break;
+        case 5: in = 0.0f; break;
+        case 6: in = -0.0f; break;
+        }
+        float expected = limiter(in);
+        // within 1 ulp, see limiter_block()
+        if (fabsf(buffer[i] - expected) > fabsf(nextafterf(expected, 0.0f) - expected) ||
+                signbit(buffer[i]) != signbit(expected)) {
+            if (errors++ < 10) {
+                fprintf(stderr, "limiter_block(%.9g)=%.9g, limiter()=%.9g\n",
+                        in, buffer[i], expected);
+            }
+        }
+    }
+    return errors;
+}
+
 int main(int argc, char **argv)
 {
     int i;
@@ -37,6 +80,11 @@ int main(int argc, char **argv)
                 printf("%g,%g\n", -in, out);
             }
         }
+        int errors = check_limiter_block();
+        if (errors != 0) {
+            fprintf(stderr, "limiter_block: %d mismatches\n", errors);
+            return EXIT_FAILURE;
+        }
     }
     return EXIT_SUCCESS;
 }
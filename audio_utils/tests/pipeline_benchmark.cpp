@@ -0,0 +1,336 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Benchmark for a HAL-like processing chain built from the audio_utils library.
+// Each period of 16-bit input, read from a WAV file through tinysndfile or synthesized, goes
+// through format conversion to float, channel count adjustment, channel remapping by index array,
+// resampling, mono blend, the limiter, conversion to the output format and a FIFO.
+// For each period size this reports the mean time per frame of each stage and the share of the
+// period duration it takes, and the total thread CPU time as a share of real time.
+// Compare the results before and after a change, on an otherwise idle device.
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <vector>
+#include <audio_utils/channels.h>
+#include <audio_utils/conversion.h>
+#include <audio_utils/fifo.h>
+#include <audio_utils/format.h>
+#include <audio_utils/limiter.h>
+#include <audio_utils/primitives.h>
+#include <audio_utils/resampler.h>
+#include <audio_utils/sndfile.h>
+
+static inline int64_t clockNs(clockid_t clock)
+{
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void usage(const char *progname)
+{
+    fprintf(stderr, "Usage: %s [-r output-rate] [-c output-channels] [-f 16|float] "
+            "[-s seconds] [-p period-frames]... [input.wav]\n", progname);
+    fprintf(stderr, "  -r  output sample rate, default 48000\n");
+    fprintf(stderr, "  -c  output channel count 1 to 8, default 2\n");
+    fprintf(stderr, "  -f  output sample format, default 16\n");
+    fprintf(stderr, "  -s  seconds of audio processed for each period size, default 10\n");
+    fprintf(stderr, "  -p  input frames per period, may be repeated, default 192 240 480 960\n");
+    fprintf(stderr, "  without an input file, a 44100 Hz stereo sine wave is used\n");
+}
+
+enum Stage {
+    STAGE_READ,
+    STAGE_TO_FLOAT,
+    STAGE_ADJUST,
+    STAGE_REMAP,
+    STAGE_RESAMPLE,
+    STAGE_MONO_BLEND,
+    STAGE_LIMITER,
+    STAGE_FROM_FLOAT,
+    STAGE_FIFO,
+    STAGE_COUNT
+};
+
+static const char * const kStageNames[STAGE_COUNT] = {
+    "read", "to float", "adjust channels", "remap channels", "resample", "mono blend",
+    "limiter", "from float", "fifo",
+};
+
+struct StageStats {
+    int64_t mNs;
+    size_t mFrames;     // frames processed by the stage, at its own sample rate
+};
+
+struct Source {
+    SNDFILE *mFile;     // NULL for the synthesized sine wave
+    uint32_t mRate;
+    uint32_t mChannels;
+    std::vector<int16_t> mSine;    // one second, looped
+    size_t mSinePosition;
+};
+
+// Read frameCount frames of 16-bit input, starting over at the end of the file or sine wave
+static void readSource(Source *source, int16_t *dst, size_t frameCount)
+{
+    while (frameCount > 0) {
+        size_t frames;
+        if (source->mFile != NULL) {
+            sf_count_t actual = sf_readf_short(source->mFile, dst, frameCount);
+            if (actual <= 0) {
+                sf_seek(source->mFile, 0, SEEK_SET);
+                continue;
+            }
+            frames = actual;
+        } else {
+            size_t sineFrames = source->mSine.size() / source->mChannels;
+            frames = std::min(frameCount, sineFrames - source->mSinePosition);
+            memcpy(dst, &source->mSine[source->mSinePosition * source->mChannels],
+                    frames * source->mChannels * sizeof(int16_t));
+            source->mSinePosition = (source->mSinePosition + frames) % sineFrames;
+        }
+        dst += frames * source->mChannels;
+        frameCount -= frames;
+    }
+}
+
+static bool runPipeline(Source *source, uint32_t outRate, uint32_t outChannels,
+        audio_format_t outFormat, size_t periodFrames, double seconds)
+{
+    const uint32_t inRate = source->mRate;
+    const uint32_t inChannels = source->mChannels;
+    const size_t outSampleSize = audio_bytes_per_sample(outFormat);
+    // resampler output for one period, with room for the frames its input buffer carries over
+    const size_t maxOutFrames = periodFrames * outRate / inRate + 64;
+    const size_t maxChannels = std::max(inChannels, outChannels);
+
+    std::vector<int16_t> input(periodFrames * inChannels);
+    std::vector<float> floatIn(periodFrames * maxChannels);
+    std::vector<float> adjusted(periodFrames * maxChannels);
+    std::vector<float> remapped(periodFrames * outChannels);
+    std::vector<float> resampled(maxOutFrames * outChannels);
+    std::vector<uint8_t> output(maxOutFrames * outChannels * outSampleSize);
+    std::vector<uint8_t> sink(output.size());
+
+    // reverse the channel order, so every sample moves
+    int8_t idxary[FCC_8];
+    for (uint32_t i = 0; i < outChannels; i++) {
+        idxary[i] = outChannels - 1 - i;
+    }
+
+    struct resampler_itfe *resampler = NULL;
+    if (inRate != outRate) {
+        struct resampler_config config;
+        memset(&config, 0, sizeof(config));
+        config.in_sample_rate = inRate;
+        config.out_sample_rate = outRate;
+        config.channel_count = outChannels;
+        config.quality = RESAMPLER_QUALITY_DEFAULT;
+        config.engine = RESAMPLER_ENGINE_POLYPHASE;
+        if (create_resampler_from_config(&config, NULL, &resampler) != 0) {
+            config.engine = RESAMPLER_ENGINE_SPEEX;
+            if (create_resampler_from_config(&config, NULL, &resampler) != 0) {
+                fprintf(stderr, "Could not create a resampler from %u to %u Hz\n", inRate,
+                        outRate);
+                return false;
+            }
+        }
+    }
+
+    // enough for a few periods, as between a HAL's processing and its output thread
+    const size_t fifoFrames = 4 * maxOutFrames;
+    const size_t frameSize = outChannels * outSampleSize;
+    std::vector<uint8_t> fifoBuffer(fifoFrames * frameSize);
+    struct audio_utils_fifo fifo;
+    audio_utils_fifo_init(&fifo, fifoFrames, frameSize, &fifoBuffer[0]);
+
+    StageStats stats[STAGE_COUNT];
+    memset(stats, 0, sizeof(stats));
+    const size_t periods = (size_t) (seconds * inRate / periodFrames) + 1;
+    const int64_t cpuBefore = clockNs(CLOCK_THREAD_CPUTIME_ID);
+    int64_t last = clockNs(CLOCK_MONOTONIC);
+    // charge the time since the last stage ended to stage
+    auto lap = [&](Stage stage, size_t frames) {
+        int64_t now = clockNs(CLOCK_MONOTONIC);
+        stats[stage].mNs += now - last;
+        stats[stage].mFrames += frames;
+        last = now;
+    };
+
+    for (size_t period = 0; period < periods; period++) {
+        last = clockNs(CLOCK_MONOTONIC);
+        readSource(source, &input[0], periodFrames);
+        lap(STAGE_READ, periodFrames);
+
+        memcpy_by_audio_format(&floatIn[0], AUDIO_FORMAT_PCM_FLOAT, &input[0],
+                AUDIO_FORMAT_PCM_16_BIT, periodFrames * inChannels);
+        lap(STAGE_TO_FLOAT, periodFrames);
+
+        const float *channelsIn = &floatIn[0];
+        if (inChannels != outChannels) {
+            adjust_channels_float(&floatIn[0], inChannels, &adjusted[0], outChannels,
+                    periodFrames * inChannels * sizeof(float));
+            channelsIn = &adjusted[0];
+            lap(STAGE_ADJUST, periodFrames);
+        }
+
+        memcpy_by_index_array(&remapped[0], outChannels, channelsIn, outChannels, idxary,
+                sizeof(float), periodFrames);
+        lap(STAGE_REMAP, periodFrames);
+
+        float *processed = &remapped[0];
+        size_t outFrames = periodFrames;
+        if (resampler != NULL) {
+            size_t inFrames = periodFrames;
+            outFrames = maxOutFrames;
+            resampler->resample_from_input_float(resampler, &remapped[0], &inFrames,
+                    &resampled[0], &outFrames);
+            processed = &resampled[0];
+            lap(STAGE_RESAMPLE, outFrames);
+        }
+
+        mono_blend(processed, AUDIO_FORMAT_PCM_FLOAT, outChannels, outFrames);
+        lap(STAGE_MONO_BLEND, outFrames);
+
+        limiter_block(processed, outFrames * outChannels);
+        lap(STAGE_LIMITER, outFrames);
+
+        memcpy_by_audio_format(&output[0], outFormat, processed, AUDIO_FORMAT_PCM_FLOAT,
+                outFrames * outChannels);
+        lap(STAGE_FROM_FLOAT, outFrames);
+
+        audio_utils_fifo_write(&fifo, &output[0], outFrames);
+        audio_utils_fifo_read(&fifo, &sink[0], outFrames);
+        lap(STAGE_FIFO, outFrames);
+    }
+
+    const int64_t cpuNs = clockNs(CLOCK_THREAD_CPUTIME_ID) - cpuBefore;
+    const double audioNs = (double) periods * periodFrames * 1e9 / inRate;
+    audio_utils_fifo_deinit(&fifo);
+    if (resampler != NULL) {
+        release_resampler(resampler);
+    }
+
+    printf("period %zu frames (%.2f ms): total CPU %.2f%% of real time\n", periodFrames,
+            periodFrames * 1e3 / inRate, cpuNs * 100.0 / audioNs);
+    for (int stage = 0; stage < STAGE_COUNT; stage++) {
+        if (stats[stage].mFrames == 0) {
+            continue;
+        }
+        printf("  %-16s %8.2f ns/frame %7.3f%% of period\n", kStageNames[stage],
+                (double) stats[stage].mNs / stats[stage].mFrames,
+                stats[stage].mNs * 100.0 / audioNs);
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t outRate = 48000;
+    uint32_t outChannels = 2;
+    audio_format_t outFormat = AUDIO_FORMAT_PCM_16_BIT;
+    double seconds = 10.0;
+    std::vector<size_t> periodSizes;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "r:c:f:s:p:")) != -1) {
+        switch (opt) {
+        case 'r':
+            outRate = atoi(optarg);
+            break;
+        case 'c':
+            outChannels = atoi(optarg);
+            break;
+        case 'f':
+            if (!strcmp(optarg, "16")) {
+                outFormat = AUDIO_FORMAT_PCM_16_BIT;
+            } else if (!strcmp(optarg, "float")) {
+                outFormat = AUDIO_FORMAT_PCM_FLOAT;
+            } else {
+                usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 's':
+            seconds = atof(optarg);
+            break;
+        case 'p':
+            if (atoi(optarg) <= 0) {
+                usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+            periodSizes.push_back(atoi(optarg));
+            break;
+        default:
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (outRate == 0 || outChannels < 1 || outChannels > FCC_8 || seconds <= 0 ||
+            optind + 1 < argc) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (periodSizes.empty()) {
+        // 4, 5, 10 and 20 ms at 48 kHz
+        periodSizes = {192, 240, 480, 960};
+    }
+
+    Source source;
+    source.mFile = NULL;
+    source.mSinePosition = 0;
+    if (optind < argc) {
+        SF_INFO info;
+        memset(&info, 0, sizeof(info));
+        source.mFile = sf_open(argv[optind], SFM_READ, &info);
+        if (source.mFile == NULL || info.channels < 1 || info.channels > FCC_8) {
+            fprintf(stderr, "Could not open %s\n", argv[optind]);
+            return EXIT_FAILURE;
+        }
+        source.mRate = info.samplerate;
+        source.mChannels = info.channels;
+    } else {
+        source.mRate = 44100;
+        source.mChannels = 2;
+        source.mSine.resize(source.mRate * source.mChannels);
+        for (size_t i = 0; i < source.mRate; i++) {
+            int16_t sample = 16384 * sin(2 * M_PI * 1000 * i / source.mRate);
+            source.mSine[2 * i] = sample;
+            source.mSine[2 * i + 1] = -sample;
+        }
+    }
+
+    printf("%u Hz %u channels -> %u Hz %u channels %s\n", source.mRate, source.mChannels,
+            outRate, outChannels, outFormat == AUDIO_FORMAT_PCM_FLOAT ? "float" : "16-bit");
+    int status = EXIT_SUCCESS;
+    for (size_t periodFrames : periodSizes) {
+        if (!runPipeline(&source, outRate, outChannels, outFormat, periodFrames, seconds)) {
+            status = EXIT_FAILURE;
+            break;
+        }
+    }
+    if (source.mFile != NULL) {
+        sf_close(source.mFile);
+    }
+    return status;
+}
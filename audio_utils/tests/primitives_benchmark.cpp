@@ -0,0 +1,407 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Throughput benchmark for the sample converters in <audio_utils/primitives.h>.
+// Each routine runs over a range of buffer sizes, once with buffers aligned to 64 bytes and once
+// with source and destination offset by one sample, which defeats vector alignment but keeps
+// natural alignment. For each case this reports the best of several trials, as GB/s of source
+// plus destination traffic and as samples per CPU cycle.
+// Cycles are derived from the CPU clock rate given with -m, or else read from cpufreq, so pin
+// the benchmark to one core running at a fixed frequency for stable numbers.
+
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <audio_utils/minifloat.h>
+#include <audio_utils/primitives.h>
+#include <system/audio.h>
+
+static inline int64_t clockNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Sink for results of the nonZero routines, so that the calls are not optimized away.
+static volatile size_t sSink;
+
+// Every routine is wrapped to this signature; count is in units as defined by the table below.
+typedef void (*Routine)(void *dst, const void *src, size_t count);
+
+enum SourceType {
+    SOURCE_INT,     // random bytes, valid for any integer format
+    SOURCE_FLOAT,   // random floats in [-1.5, 1.5], exercising clamping
+};
+
+struct Benchmark {
+    const char *name;
+    Routine routine;
+    SourceType sourceType;
+    size_t srcBytes;    // source bytes per unit of count
+    size_t dstBytes;    // destination bytes per unit of count, 0 if no destination
+    size_t samples;     // samples processed per unit of count
+};
+
+#define CONVERT(dst_type, src_type, name) \
+    [](void *dst, const void *src, size_t count) { \
+        name((dst_type *) dst, (const src_type *) src, count); }
+
+static const float kGain = 0.7f;
+static const gain_minifloat_packed_t kRampFrom =
+        gain_minifloat_pack(gain_from_float(0.25f), gain_from_float(0.5f));
+static const gain_minifloat_packed_t kRampTo =
+        gain_minifloat_pack(gain_from_float(1.0f), gain_from_float(0.75f));
+
+// memcpy_by_channel_mask cases: 5.1 to stereo drops channels, stereo to 5.1 zero fills.
+static const uint32_t kMask5Point1 = AUDIO_CHANNEL_OUT_5POINT1;
+static const uint32_t kMaskStereo = AUDIO_CHANNEL_OUT_STEREO;
+
+static const Benchmark kBenchmarks[] = {
+    { "memcpy", [](void *dst, const void *src, size_t count) { memcpy(dst, src, count * 2); },
+            SOURCE_INT, 2, 2, 1 },
+    { "ditherAndClamp",
+            [](void *dst, const void *src, size_t count) {
+                ditherAndClamp((int32_t *) dst, (const int32_t *) src, count); },
+            SOURCE_INT, 8, 4, 2 },
+    { "mix_to_i32_from_i16_with_ramp stereo",
+            [](void *dst, const void *src, size_t count) {
+                int32_t volumes[2] = { 0x1000000, 0x2000000 };
+                static const int32_t incs[2] = { 1, -1 };
+                mix_to_i32_from_i16_with_ramp((int32_t *) dst, (const int16_t *) src, 2, count,
+                        volumes, incs); },
+            SOURCE_INT, 4, 8, 2 },
+    { "mix_to_float_from_float_with_ramp stereo",
+            [](void *dst, const void *src, size_t count) {
+                float volumes[2] = { 0.5f, 0.25f };
+                static const float incs[2] = { 1e-6f, -1e-6f };
+                mix_to_float_from_float_with_ramp((float *) dst, (const float *) src, 2, count,
+                        volumes, incs); },
+            SOURCE_FLOAT, 8, 8, 2 },
+    { "memcpy_to_i16_from_u8", CONVERT(int16_t, uint8_t, memcpy_to_i16_from_u8),
+            SOURCE_INT, 1, 2, 1 },
+    { "memcpy_to_u8_from_i16", CONVERT(uint8_t, int16_t, memcpy_to_u8_from_i16),
+            SOURCE_INT, 2, 1, 1 },
+    { "memcpy_to_u8_from_float", CONVERT(uint8_t, float, memcpy_to_u8_from_float),
+            SOURCE_FLOAT, 4, 1, 1 },
+    { "memcpy_to_i16_from_i32", CONVERT(int16_t, int32_t, memcpy_to_i16_from_i32),
+            SOURCE_INT, 4, 2, 1 },
+    { "memcpy_to_i16_from_float", CONVERT(int16_t, float, memcpy_to_i16_from_float),
+            SOURCE_FLOAT, 4, 2, 1 },
+    { "memcpy_to_float_from_q4_27", CONVERT(float, int32_t, memcpy_to_float_from_q4_27),
+            SOURCE_INT, 4, 4, 1 },
+    { "memcpy_to_float_from_i16", CONVERT(float, int16_t, memcpy_to_float_from_i16),
+            SOURCE_INT, 2, 4, 1 },
+    { "memcpy_to_i16_from_float_with_gain",
+            [](void *dst, const void *src, size_t count) {
+                memcpy_to_i16_from_float_with_gain(
+                        (int16_t *) dst, (const float *) src, count, kGain); },
+            SOURCE_FLOAT, 4, 2, 1 },
+    { "memcpy_to_float_from_i16_with_gain",
+            [](void *dst, const void *src, size_t count) {
+                memcpy_to_float_from_i16_with_gain(
+                        (float *) dst, (const int16_t *) src, count, kGain); },
+            SOURCE_INT, 2, 4, 1 },
+    { "memcpy_to_i16_from_float_with_stereo_gain",
+            [](void *dst, const void *src, size_t count) {
+                memcpy_to_i16_from_float_with_stereo_gain(
+                        (int16_t *) dst, (const float *) src, count, kGain, 1.0f - kGain); },
+            SOURCE_FLOAT, 8, 4, 2 },
+    { "memcpy_to_float_from_i16_with_stereo_gain",
+            [](void *dst, const void *src, size_t count) {
+                memcpy_to_float_from_i16_with_stereo_gain(
+                        (float *) dst, (const int16_t *) src, count, kGain, 1.0f - kGain); },
+            SOURCE_INT, 4, 8, 2 },
+    { "memcpy_to_i16_from_float_with_stereo_ramp",
+            [](void *dst, const void *src, size_t count) {
+                memcpy_to_i16_from_float_with_stereo_ramp(
+                        (int16_t *) dst, (const float *) src, count, kRampFrom, kRampTo); },
+            SOURCE_FLOAT, 8, 4, 2 },
+    { "memcpy_to_float_from_i16_with_stereo_ramp",
+            [](void *dst, const void *src, size_t count) {
+                memcpy_to_float_from_i16_with_stereo_ramp(
+                        (float *) dst, (const int16_t *) src, count, kRampFrom, kRampTo); },
+            SOURCE_INT, 4, 8, 2 },
+    { "memcpy_to_i16_from_i16_with_stereo_ramp",
+            [](void *dst, const void *src, size_t count) {
+                memcpy_to_i16_from_i16_with_stereo_ramp(
+                        (int16_t *) dst, (const int16_t *) src, count, kRampFrom, kRampTo); },
+            SOURCE_INT, 4, 4, 2 },
+    { "memcpy_to_float_from_float_with_stereo_ramp",
+            [](void *dst, const void *src, size_t count) {
+                memcpy_to_float_from_float_with_stereo_ramp(
+                        (float *) dst, (const float *) src, count, kRampFrom, kRampTo); },
+            SOURCE_FLOAT, 8, 8, 2 },
+    { "memcpy_to_float_from_u8", CONVERT(float, uint8_t, memcpy_to_float_from_u8),
+            SOURCE_INT, 1, 4, 1 },
+    { "memcpy_to_float_from_p24", CONVERT(float, uint8_t, memcpy_to_float_from_p24),
+            SOURCE_INT, 3, 4, 1 },
+    { "memcpy_to_i16_from_p24", CONVERT(int16_t, uint8_t, memcpy_to_i16_from_p24),
+            SOURCE_INT, 3, 2, 1 },
+    { "memcpy_to_i32_from_p24", CONVERT(int32_t, uint8_t, memcpy_to_i32_from_p24),
+            SOURCE_INT, 3, 4, 1 },
+    { "memcpy_to_p24_from_i16", CONVERT(uint8_t, int16_t, memcpy_to_p24_from_i16),
+            SOURCE_INT, 2, 3, 1 },
+    { "memcpy_to_p24_from_float", CONVERT(uint8_t, float, memcpy_to_p24_from_float),
+            SOURCE_FLOAT, 4, 3, 1 },
+    { "memcpy_to_p24_from_q8_23", CONVERT(uint8_t, int32_t, memcpy_to_p24_from_q8_23),
+            SOURCE_INT, 4, 3, 1 },
+    { "memcpy_to_p24_from_i32", CONVERT(uint8_t, int32_t, memcpy_to_p24_from_i32),
+            SOURCE_INT, 4, 3, 1 },
+    { "memcpy_to_q8_23_from_i16", CONVERT(int32_t, int16_t, memcpy_to_q8_23_from_i16),
+            SOURCE_INT, 2, 4, 1 },
+    { "memcpy_to_q8_23_from_float_with_clamp",
+            CONVERT(int32_t, float, memcpy_to_q8_23_from_float_with_clamp),
+            SOURCE_FLOAT, 4, 4, 1 },
+    { "memcpy_to_q8_23_from_p24", CONVERT(int32_t, uint8_t, memcpy_to_q8_23_from_p24),
+            SOURCE_INT, 3, 4, 1 },
+    { "memcpy_to_q4_27_from_float", CONVERT(int32_t, float, memcpy_to_q4_27_from_float),
+            SOURCE_FLOAT, 4, 4, 1 },
+    { "memcpy_to_i16_from_q8_23", CONVERT(int16_t, int32_t, memcpy_to_i16_from_q8_23),
+            SOURCE_INT, 4, 2, 1 },
+    { "memcpy_to_float_from_q8_23", CONVERT(float, int32_t, memcpy_to_float_from_q8_23),
+            SOURCE_INT, 4, 4, 1 },
+    { "memcpy_to_i32_from_i16", CONVERT(int32_t, int16_t, memcpy_to_i32_from_i16),
+            SOURCE_INT, 2, 4, 1 },
+    { "memcpy_to_i32_from_float", CONVERT(int32_t, float, memcpy_to_i32_from_float),
+            SOURCE_FLOAT, 4, 4, 1 },
+    { "memcpy_to_float_from_i32", CONVERT(float, int32_t, memcpy_to_float_from_i32),
+            SOURCE_INT, 4, 4, 1 },
+    { "downmix_to_mono_i16_from_stereo_i16",
+            CONVERT(int16_t, int16_t, downmix_to_mono_i16_from_stereo_i16),
+            SOURCE_INT, 4, 2, 2 },
+    { "upmix_to_stereo_i16_from_mono_i16",
+            CONVERT(int16_t, int16_t, upmix_to_stereo_i16_from_mono_i16),
+            SOURCE_INT, 2, 4, 1 },
+    { "downmix_to_mono_float_from_stereo_float",
+            CONVERT(float, float, downmix_to_mono_float_from_stereo_float),
+            SOURCE_FLOAT, 8, 4, 2 },
+    { "upmix_to_stereo_float_from_mono_float",
+            CONVERT(float, float, upmix_to_stereo_float_from_mono_float),
+            SOURCE_FLOAT, 4, 8, 1 },
+    { "nonZeroMono32",
+            [](void *dst __unused, const void *src, size_t count) {
+                sSink += nonZeroMono32((const int32_t *) src, count); },
+            SOURCE_INT, 4, 0, 1 },
+    { "nonZeroMono16",
+            [](void *dst __unused, const void *src, size_t count) {
+                sSink += nonZeroMono16((const int16_t *) src, count); },
+            SOURCE_INT, 2, 0, 1 },
+    { "nonZeroStereo32",
+            [](void *dst __unused, const void *src, size_t count) {
+                sSink += nonZeroStereo32((const int32_t *) src, count); },
+            SOURCE_INT, 8, 0, 2 },
+    { "nonZeroStereo16",
+            [](void *dst __unused, const void *src, size_t count) {
+                sSink += nonZeroStereo16((const int16_t *) src, count); },
+            SOURCE_INT, 4, 0, 2 },
+    { "memcpy_by_channel_mask i16 5.1 to stereo",
+            [](void *dst, const void *src, size_t count) {
+                memcpy_by_channel_mask(dst, kMaskStereo, src, kMask5Point1, 2, count); },
+            SOURCE_INT, 12, 4, 6 },
+    { "memcpy_by_channel_mask i16 stereo to 5.1",
+            [](void *dst, const void *src, size_t count) {
+                memcpy_by_channel_mask(dst, kMask5Point1, src, kMaskStereo, 2, count); },
+            SOURCE_INT, 4, 12, 2 },
+    { "memcpy_by_channel_mask i32 5.1 to stereo",
+            [](void *dst, const void *src, size_t count) {
+                memcpy_by_channel_mask(dst, kMaskStereo, src, kMask5Point1, 4, count); },
+            SOURCE_INT, 24, 8, 6 },
+    { "memcpy_by_channel_mask i32 stereo to 5.1",
+            [](void *dst, const void *src, size_t count) {
+                memcpy_by_channel_mask(dst, kMask5Point1, src, kMaskStereo, 4, count); },
+            SOURCE_INT, 8, 24, 2 },
+};
+
+static const size_t kDefaultSizes[] = { 16, 64, 256, 1024, 4096, 16384, 65536 };
+static const size_t kMaxSizes = 16;
+static const size_t kAlignment = 64;
+static const int kTrials = 5;
+
+// Returns the current clock rate of the CPU this thread runs on in Hz, or 0 if unknown.
+static double readCpuHz()
+{
+    char path[80];
+    int cpu = 0;
+#ifdef __linux__
+    cpu = sched_getcpu();
+    if (cpu < 0) {
+        cpu = 0;
+    }
+#endif
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cpufreq/scaling_cur_freq", cpu);
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        return 0;
+    }
+    unsigned long khz = 0;
+    if (fscanf(file, "%lu", &khz) != 1) {
+        khz = 0;
+    }
+    fclose(file);
+    return khz * 1e3;
+}
+
+static void fillSource(void *buffer, size_t bytes, SourceType type)
+{
+    if (type == SOURCE_FLOAT) {
+        float *f = (float *) buffer;
+        for (size_t i = 0; i < bytes / sizeof(float); ++i) {
+            f[i] = (float) rand() / RAND_MAX * 3.0f - 1.5f;
+        }
+    } else {
+        uint8_t *b = (uint8_t *) buffer;
+        for (size_t i = 0; i < bytes; ++i) {
+            b[i] = rand();
+        }
+    }
+}
+
+static void usage(const char *progname)
+{
+    fprintf(stderr, "Usage: %s [-m cpu-MHz] [-n samples-per-trial] [-z count]... [name]...\n",
+            progname);
+    fprintf(stderr, "  -m  CPU clock rate used to compute samples/cycle, default from cpufreq\n");
+    fprintf(stderr, "  -n  samples processed per timed trial, default 4194304\n");
+    fprintf(stderr, "  -z  count passed to each routine, may be repeated, "
+            "default 16 64 256 1024 4096 16384 65536\n");
+    fprintf(stderr, "  name  run only routines whose name contains this string\n");
+}
+
+int main(int argc, char **argv)
+{
+    double cpuHz = 0;
+    size_t samplesPerTrial = 4194304;
+    size_t sizes[kMaxSizes];
+    size_t sizeCount = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "m:n:z:")) != -1) {
+        switch (opt) {
+        case 'm':
+            cpuHz = atof(optarg) * 1e6;
+            break;
+        case 'n':
+            samplesPerTrial = strtoul(optarg, NULL, 0);
+            break;
+        case 'z':
+            if (sizeCount < kMaxSizes) {
+                sizes[sizeCount++] = strtoul(optarg, NULL, 0);
+            }
+            break;
+        default:
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (samplesPerTrial == 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (sizeCount == 0) {
+        sizeCount = sizeof(kDefaultSizes) / sizeof(kDefaultSizes[0]);
+        memcpy(sizes, kDefaultSizes, sizeof(kDefaultSizes));
+    }
+    size_t maxCount = 0;
+    for (size_t i = 0; i < sizeCount; ++i) {
+        if (sizes[i] == 0) {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+        if (sizes[i] > maxCount) {
+            maxCount = sizes[i];
+        }
+    }
+    if (cpuHz == 0) {
+        cpuHz = readCpuHz();
+    }
+
+    // Largest bytes per unit in the table is 24; leave room for the unaligned offset.
+    const size_t bufferBytes = maxCount * 24 + kAlignment;
+    void *src;
+    void *dst;
+    if (posix_memalign(&src, kAlignment, bufferBytes) != 0 ||
+            posix_memalign(&dst, kAlignment, bufferBytes) != 0) {
+        fprintf(stderr, "Out of memory\n");
+        return EXIT_FAILURE;
+    }
+
+    if (cpuHz > 0) {
+        printf("CPU clock %.0f MHz\n", cpuHz * 1e-6);
+    } else {
+        printf("CPU clock unknown, use -m to report samples/cycle\n");
+    }
+    printf("%-42s %7s %9s %8s %9s %8s\n", "routine", "count",
+            "GB/s", "smp/cyc", "unal GB/s", "smp/cyc");
+    for (size_t b = 0; b < sizeof(kBenchmarks) / sizeof(kBenchmarks[0]); ++b) {
+        const Benchmark &bench = kBenchmarks[b];
+        bool selected = optind >= argc;
+        for (int i = optind; i < argc; ++i) {
+            if (strstr(bench.name, argv[i]) != NULL) {
+                selected = true;
+                break;
+            }
+        }
+        if (!selected) {
+            continue;
+        }
+        fillSource(src, bufferBytes, bench.sourceType);
+        for (size_t s = 0; s < sizeCount; ++s) {
+            const size_t count = sizes[s];
+            size_t repeats = samplesPerTrial / (count * bench.samples);
+            if (repeats == 0) {
+                repeats = 1;
+            }
+            double gbps[2];
+            double samplesPerCycle[2];
+            for (int unaligned = 0; unaligned < 2; ++unaligned) {
+                // Offset by one sample of each side, so natural alignment is kept.
+                const size_t srcOffset = unaligned ? bench.srcBytes / bench.samples : 0;
+                const size_t dstOffset =
+                        unaligned && bench.dstBytes != 0 ? bench.dstBytes / bench.samples : 0;
+                void *srcPtr = (uint8_t *) src + srcOffset;
+                void *dstPtr = (uint8_t *) dst + dstOffset;
+                bench.routine(dstPtr, srcPtr, count);   // warm up caches
+                int64_t best = INT64_MAX;
+                for (int trial = 0; trial < kTrials; ++trial) {
+                    const int64_t start = clockNs();
+                    for (size_t r = 0; r < repeats; ++r) {
+                        bench.routine(dstPtr, srcPtr, count);
+                    }
+                    const int64_t elapsed = clockNs() - start;
+                    if (elapsed < best) {
+                        best = elapsed;
+                    }
+                }
+                if (best <= 0) {
+                    best = 1;
+                }
+                const double units = (double) count * repeats;
+                gbps[unaligned] = units * (bench.srcBytes + bench.dstBytes) / best;
+                samplesPerCycle[unaligned] = cpuHz > 0 ?
+                        units * bench.samples / (best * 1e-9 * cpuHz) : 0;
+            }
+            printf("%-42s %7zu %9.2f %8.3f %9.2f %8.3f\n", bench.name, count,
+                    gbps[0], samplesPerCycle[0], gbps[1], samplesPerCycle[1]);
+        }
+    }
+    free(src);
+    free(dst);
+    return EXIT_SUCCESS;
+}
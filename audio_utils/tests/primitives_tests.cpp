@@ -17,13 +17,17 @@
 //#define LOG_NDEBUG 0
 #define LOG_TAG "audio_utils_primitives_tests"
 
+#include <algorithm>
 #include <math.h>
 #include <vector>
 #include <cutils/log.h>
 #include <gtest/gtest.h>
 #include <audio_utils/primitives.h>
 #include <audio_utils/format.h>
+#include <audio_utils/kernels.h>
 #include <audio_utils/channels.h>
+#include <audio_utils/conversion.h>
+#include <audio_utils/limiter.h>
 
 #define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
 
@@ -339,6 +343,361 @@ void checkMonotoneOrZero(const T *ary, size_t size)
     }
 }
 
+TEST(audio_utils_primitives, memcpy_vector_bit_exact) {
+    // The vectorized converters must match the scalar helpers exactly,
+    // including clamping, rounding, and the tail which is not a multiple of the vector width.
+    static const float specialValues[] = {
+            -INFINITY, -1.e20, -2., -1.0000001, -1., -0.99999994, -0.5, -1.e-30, -0., 0.,
+            1.e-30, 0.5, 0.99999994, 1., 1.0000001, 2., 1.e20, INFINITY,
+            0.5 / (1 << 15), 1.5 / (1 << 15), -0.5 / (1 << 15), -1.5 / (1 << 15),
+            0.5 / (1 << 23), 1.5 / (1 << 23), -0.5 / (1 << 23), -1.5 / (1 << 23),
+            (float) 0x7fffff / (1 << 23), (0x7fffff - 0.5) / (1 << 23),
+    };
+    const size_t count = 65536 + 3;
+    float *fary = new float[count];
+    int16_t *i16ary = new int16_t[count];
+    int32_t *i32ary = new int32_t[count];
+    uint8_t *pary = new uint8_t[count * 3];
+
+    for (size_t i = 0; i < count; ++i) {
+        if (i < ARRAY_SIZE(specialValues)) {
+            fary[i] = specialValues[i];
+        } else {
+            // sweep [-1.25, 1.25) in steps which are not a multiple of the 16 or 24 bit lsb
+            fary[i] = ((float) i - count / 2) * (2.5 / count);
+        }
+    }
+
+    memcpy_to_i16_from_float(i16ary, fary, count);
+    memcpy_to_q8_23_from_float_with_clamp(i32ary, fary, count);
+    memcpy_to_p24_from_float(pary, fary, count);
+    for (size_t i = 0; i < count; ++i) {
+        EXPECT_EQ(clamp16_from_float(fary[i]), i16ary[i]) << "index " << i;
+        EXPECT_EQ(clamp24_from_float(fary[i]), i32ary[i]) << "index " << i;
+        EXPECT_EQ(clamp24_from_float(fary[i]), i32_from_p24(pary + 3 * i) >> 8) << "index " << i;
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        i16ary[i] = i - 32768;
+    }
+    memcpy_to_float_from_i16(fary, i16ary, count);
+    for (size_t i = 0; i < count; ++i) {
+        EXPECT_EQ(float_from_i16(i16ary[i]), fary[i]) << "index " << i;
+    }
+
+    delete[] fary;
+    delete[] i16ary;
+    delete[] i32ary;
+    delete[] pary;
+}
+
+TEST(audio_utils_primitives, memcpy_with_gain) {
+    // The fused routines must match a conversion followed by a separate gain pass.
+    const size_t frames = 1027;
+    const float gainL = 0.7071f;
+    const float gainR = 1.9f; // enough to clamp the largest samples
+    int16_t *i16ref = new int16_t[frames * 2];
+    int16_t *i16ary = new int16_t[frames * 2];
+    float *fref = new float[frames * 2];
+    float *fary = new float[frames * 2];
+
+    for (size_t i = 0; i < frames * 2; ++i) {
+        i16ref[i] = (int16_t) (i * 16411);
+        fref[i] = float_from_i16(i16ref[i]);
+    }
+
+    memcpy_to_float_from_i16_with_stereo_gain(fary, i16ref, frames, gainL, gainR);
+    memcpy_to_i16_from_float_with_stereo_gain(i16ary, fref, frames, gainL, gainR);
+    for (size_t i = 0; i < frames * 2; ++i) {
+        float gain = i & 1 ? gainR : gainL;
+        EXPECT_EQ(float_from_i16(i16ref[i]) * gain, fary[i]) << "index " << i;
+        EXPECT_EQ(clamp16_from_float(fref[i] * gain), i16ary[i]) << "index " << i;
+    }
+
+    memcpy_to_float_from_i16_with_gain(fary, i16ref, frames * 2 - 1, gainR);
+    memcpy_to_i16_from_float_with_gain(i16ary, fref, frames * 2 - 1, gainR);
+    for (size_t i = 0; i < frames * 2 - 1; ++i) {
+        EXPECT_EQ(float_from_i16(i16ref[i]) * gainR, fary[i]) << "index " << i;
+        EXPECT_EQ(clamp16_from_float(fref[i] * gainR), i16ary[i]) << "index " << i;
+    }
+
+    // a ramp from unity to zero on the left, and from zero to unity on the right
+    const gain_minifloat_packed_t from = gain_minifloat_pack(GAIN_MINIFLOAT_UNITY, 0);
+    const gain_minifloat_packed_t to = gain_minifloat_pack(0, GAIN_MINIFLOAT_UNITY);
+    memcpy_to_float_from_i16_with_stereo_ramp(fary, i16ref, frames, from, to);
+    EXPECT_EQ(fref[0], fary[0]);
+    EXPECT_EQ(0.f, fary[1]);
+    for (size_t i = 1; i < frames; ++i) {
+        EXPECT_LE(fabsf(fary[i * 2]), fabsf(fref[i * 2]));
+        EXPECT_NEAR(fref[i * 2] * (frames - i) / frames, fary[i * 2], 1e-6);
+        EXPECT_NEAR(fref[i * 2 + 1] * i / frames, fary[i * 2 + 1], 1e-6);
+    }
+    memcpy_to_i16_from_float_with_stereo_ramp(i16ary, fref, frames, from, to);
+    for (size_t i = 0; i < frames; ++i) {
+        EXPECT_EQ(clamp16_from_float(fary[i * 2]), i16ary[i * 2]) << "index " << i;
+        EXPECT_EQ(clamp16_from_float(fary[i * 2 + 1]), i16ary[i * 2 + 1]) << "index " << i;
+    }
+
+    delete[] i16ref;
+    delete[] i16ary;
+    delete[] fref;
+    delete[] fary;
+}
+
+TEST(audio_utils_primitives, memcpy_with_stereo_ramp) {
+    for (size_t frames = 1; frames <= 37; frames += 9) { // vector blocks and a scalar tail
+        std::vector<int16_t> i16ref(frames * 2), i16ary(frames * 2);
+        std::vector<float> fref(frames * 2), fary(frames * 2);
+        for (size_t i = 0; i < frames * 2; ++i) {
+            i16ref[i] = (int16_t) (i * 16411);
+            fref[i] = float_from_i16(i16ref[i]) * 1.5f; // some samples clamp
+        }
+        // ramp down on the left and up past unity on the right
+        const gain_minifloat_packed_t from =
+                gain_minifloat_pack(gain_from_float(0.75f), gain_from_float(0.125f));
+        const gain_minifloat_packed_t to =
+                gain_minifloat_pack(gain_from_float(0.25f), gain_from_float(1.5f));
+        const float gainL = float_from_gain(gain_minifloat_unpack_left(from));
+        const float gainR = float_from_gain(gain_minifloat_unpack_right(from));
+        const float stepL = (float_from_gain(gain_minifloat_unpack_left(to)) - gainL) / frames;
+        const float stepR = (float_from_gain(gain_minifloat_unpack_right(to)) - gainR) / frames;
+        std::vector<float> gains(frames * 2);
+        for (size_t i = 0; i < frames; ++i) {
+            gains[i * 2] = gainL + stepL * i;
+            gains[i * 2 + 1] = gainR + stepR * i;
+        }
+
+        memcpy_to_i16_from_float_with_stereo_ramp(i16ary.data(), fref.data(), frames, from, to);
+        for (size_t i = 0; i < frames * 2; ++i) {
+            EXPECT_EQ(clamp16_from_float(fref[i] * gains[i]), i16ary[i]) << "index " << i;
+        }
+        memcpy_to_float_from_i16_with_stereo_ramp(fary.data(), i16ref.data(), frames, from, to);
+        for (size_t i = 0; i < frames * 2; ++i) {
+            EXPECT_EQ(float_from_i16(i16ref[i]) * gains[i], fary[i]) << "index " << i;
+        }
+        memcpy_to_i16_from_i16_with_stereo_ramp(i16ary.data(), i16ref.data(), frames, from, to);
+        for (size_t i = 0; i < frames * 2; ++i) {
+            EXPECT_EQ(clamp16_from_float(float_from_i16(i16ref[i]) * gains[i]), i16ary[i])
+                    << "index " << i;
+        }
+        memcpy_to_float_from_float_with_stereo_ramp(fary.data(), fref.data(), frames, from, to);
+        for (size_t i = 0; i < frames * 2; ++i) {
+            EXPECT_EQ(fref[i] * gains[i], fary[i]) << "index " << i;
+        }
+
+        // in place
+        std::vector<int16_t> i16inout(i16ref);
+        memcpy_to_i16_from_i16_with_stereo_ramp(i16inout.data(), i16inout.data(), frames,
+                from, to);
+        EXPECT_EQ(0, memcmp(i16ary.data(), i16inout.data(), frames * 2 * sizeof(int16_t)));
+        std::vector<float> finout(fref);
+        memcpy_to_float_from_float_with_stereo_ramp(finout.data(), finout.data(), frames,
+                from, to);
+        EXPECT_EQ(0, memcmp(fary.data(), finout.data(), frames * 2 * sizeof(float)));
+    }
+}
+
+TEST(audio_utils_primitives, ditherAndClamp) {
+    static const size_t kPairs = 37; // not a multiple of the vector length
+    std::vector<int32_t> sums(kPairs * 2);
+    for (size_t i = 0; i < sums.size(); ++i) {
+        sums[i] = (int32_t)(i * 2654435761u); // covers the clamp limits
+    }
+    sums[0] = INT32_MIN;
+    sums[1] = INT32_MAX;
+    sums[2] = -1;
+    sums[3] = 0x7ffffff;
+    std::vector<int32_t> ref(kPairs);
+    for (size_t i = 0; i < kPairs; ++i) {
+        const int16_t l = clamp16(sums[2 * i] >> 12);
+        const int16_t r = clamp16(sums[2 * i + 1] >> 12);
+        ref[i] = (r << 16) | (l & 0xFFFF);
+    }
+    std::vector<int32_t> out(kPairs);
+    ditherAndClamp(out.data(), sums.data(), kPairs);
+    EXPECT_EQ(0, memcmp(out.data(), ref.data(), kPairs * sizeof(int32_t)));
+
+    // in place
+    ditherAndClamp(sums.data(), sums.data(), kPairs);
+    EXPECT_EQ(0, memcmp(sums.data(), ref.data(), kPairs * sizeof(int32_t)));
+}
+
+TEST(audio_utils_primitives, mix_with_ramp) {
+    static const size_t kFrames = 61; // not a multiple of the vector length
+    for (size_t channels = 1; channels <= 10; ++channels) {
+        std::vector<int16_t> in16(kFrames * channels);
+        std::vector<float> inFloat(kFrames * channels);
+        std::vector<int32_t> sums32(kFrames * channels), ref32(kFrames * channels);
+        std::vector<float> sumsFloat(kFrames * channels), refFloat(kFrames * channels);
+        for (size_t i = 0; i < in16.size(); ++i) {
+            in16[i] = (int16_t)((i * 7919 + 13) % 65536 - 32768);
+            inFloat[i] = float_from_i16(in16[i]);
+            ref32[i] = sums32[i] = (int32_t)((i * 104729) % 2000001) - 1000000;
+            refFloat[i] = sumsFloat[i] = (float)ref32[i] / (1 << 20);
+        }
+        std::vector<int32_t> volumes32(channels), incs32(channels);
+        std::vector<float> volumesFloat(channels), incsFloat(channels);
+        for (size_t c = 0; c < channels; ++c) {
+            // ramp up, down and constant, ending within [0, 2.0]
+            volumesFloat[c] = 0.25f * (c % 5);
+            incsFloat[c] = c % 3 == 0 ? 0.f : (c % 3 == 1 ? 1.f : -0.5f) / kFrames * 0.5f;
+            volumes32[c] = u4_28_from_float(volumesFloat[c]);
+            incs32[c] = (int32_t)(incsFloat[c] * (1 << 28));
+        }
+        for (size_t f = 0; f < kFrames; ++f) {
+            for (size_t c = 0; c < channels; ++c) {
+                const size_t i = f * channels + c;
+                const int32_t volume = volumes32[c] + incs32[c] * (int32_t)f;
+                ref32[i] += in16[i] * (volume >> 16);
+                refFloat[i] += inFloat[i] * (volumesFloat[c] + incsFloat[c] * f);
+            }
+        }
+
+        std::vector<int32_t> endVolumes32(volumes32);
+        mix_to_i32_from_i16_with_ramp(sums32.data(), in16.data(), channels, kFrames,
+                endVolumes32.data(), incs32.data());
+        EXPECT_EQ(0, memcmp(sums32.data(), ref32.data(), ref32.size() * sizeof(int32_t)))
+                << channels << " channels";
+        std::vector<float> endVolumesFloat(volumesFloat);
+        mix_to_float_from_float_with_ramp(sumsFloat.data(), inFloat.data(), channels, kFrames,
+                endVolumesFloat.data(), incsFloat.data());
+        for (size_t i = 0; i < refFloat.size(); ++i) {
+            EXPECT_FLOAT_EQ(refFloat[i], sumsFloat[i]) << channels << " channels sample " << i;
+        }
+        for (size_t c = 0; c < channels; ++c) {
+            EXPECT_EQ(volumes32[c] + incs32[c] * (int32_t)kFrames, endVolumes32[c]);
+            EXPECT_FLOAT_EQ(volumesFloat[c] + incsFloat[c] * kFrames, endVolumesFloat[c]);
+        }
+    }
+}
+
+// Stores a 16-bit sample in format, without using the conversions under test.
+// Samples with a zero low byte are exactly representable in all the PCM formats.
+static void storeSample(audio_format_t format, int16_t sample, uint8_t *dst)
+{
+    switch (format) {
+    case AUDIO_FORMAT_PCM_16_BIT:
+        memcpy(dst, &sample, sizeof(sample));
+        break;
+    case AUDIO_FORMAT_PCM_FLOAT: {
+        const float f = sample / 32768.f;
+        memcpy(dst, &f, sizeof(f));
+        break;
+    }
+    case AUDIO_FORMAT_PCM_8_BIT:
+        dst[0] = (uint8_t) ((sample >> 8) + 128);
+        break;
+    case AUDIO_FORMAT_PCM_24_BIT_PACKED:
+        // little endian
+        dst[0] = 0;
+        dst[1] = (uint8_t) sample;
+        dst[2] = (uint8_t) (sample >> 8);
+        break;
+    case AUDIO_FORMAT_PCM_32_BIT: {
+        const int32_t i32 = (int32_t) sample * 65536;
+        memcpy(dst, &i32, sizeof(i32));
+        break;
+    }
+    case AUDIO_FORMAT_PCM_8_24_BIT: {
+        const int32_t q8_23 = (int32_t) sample * 256;
+        memcpy(dst, &q8_23, sizeof(q8_23));
+        break;
+    }
+    default:
+        FAIL() << "format " << format;
+    }
+}
+
+TEST(audio_utils_primitives, memcpy_by_audio_format_get_converter) {
+    static const audio_format_t formats[] = {
+            AUDIO_FORMAT_PCM_16_BIT, AUDIO_FORMAT_PCM_FLOAT, AUDIO_FORMAT_PCM_8_BIT,
+            AUDIO_FORMAT_PCM_24_BIT_PACKED, AUDIO_FORMAT_PCM_32_BIT, AUDIO_FORMAT_PCM_8_24_BIT,
+    };
+    // the full 8-bit range, so that every conversion is exact
+    const size_t count = 256;
+    std::vector<uint8_t> samples[ARRAY_SIZE(formats)];
+    for (size_t f = 0; f < ARRAY_SIZE(formats); ++f) {
+        const size_t size = audio_bytes_per_sample(formats[f]);
+        samples[f].resize(count * size);
+        for (size_t i = 0; i < count; ++i) {
+            storeSample(formats[f], (int16_t) ((i - 128) * 256), &samples[f][i * size]);
+        }
+    }
+
+    for (size_t d = 0; d < ARRAY_SIZE(formats); ++d) {
+        for (size_t s = 0; s < ARRAY_SIZE(formats); ++s) {
+            memcpy_by_audio_format_t converter =
+                    memcpy_by_audio_format_get_converter(formats[d], formats[s]);
+            // every pair is supported, except among the formats other than i16 and float,
+            // where only identical formats and the 24/32 bit combinations are supported
+            bool simple = d <= 1 || s <= 1 || d == s;
+            if (simple) {
+                ASSERT_TRUE(converter != NULL) << "dst " << formats[d] << " src " << formats[s];
+            }
+            if (converter == NULL) {
+                continue;
+            }
+            std::vector<uint8_t> dst(samples[d].size(), 0x55);
+            converter(dst.data(), samples[s].data(), count);
+            EXPECT_TRUE(samples[d] == dst) << "dst " << formats[d] << " src " << formats[s];
+            // and memcpy_by_audio_format() does the same conversion
+            std::fill(dst.begin(), dst.end(), 0x55);
+            memcpy_by_audio_format(dst.data(), formats[d], samples[s].data(), formats[s], count);
+            EXPECT_TRUE(samples[d] == dst) << "dst " << formats[d] << " src " << formats[s];
+        }
+    }
+    EXPECT_TRUE(memcpy_by_audio_format_get_converter(AUDIO_FORMAT_PCM_8_BIT,
+            AUDIO_FORMAT_PCM_32_BIT) == NULL);
+    EXPECT_TRUE(memcpy_by_audio_format_get_converter(AUDIO_FORMAT_PCM_16_BIT,
+            AUDIO_FORMAT_MP3) == NULL);
+}
+
+TEST(audio_utils_primitives, find_non_silent_frame) {
+    const size_t frames = 1000;
+    for (size_t channels = 1; channels <= 3; ++channels) {
+        std::vector<int16_t> i16(frames * channels);
+        std::vector<int32_t> i32(frames * channels);
+        std::vector<float> f(frames * channels);
+
+        // all silent
+        EXPECT_EQ(frames, find_non_silent_frame_i16(i16.data(), channels, frames, 0));
+        EXPECT_EQ(frames, find_non_silent_frame_i32(i32.data(), channels, frames, 0));
+        EXPECT_EQ(frames, find_non_silent_frame_float(f.data(), channels, frames, 0.f));
+        EXPECT_EQ((size_t)0, find_non_silent_frame_i16(i16.data(), channels, 0, 0));
+
+        // near-silence below threshold, with the extreme negative value past a small threshold
+        for (size_t i = 0; i < frames * channels; ++i) {
+            i16[i] = (i & 1) ? -3 : 3;
+            i32[i] = (i & 1) ? -3 : 3;
+            f[i] = (i & 1) ? -1e-4f : 1e-4f;
+        }
+        EXPECT_EQ(frames, find_non_silent_frame_i16(i16.data(), channels, frames, 3));
+        EXPECT_EQ(frames, find_non_silent_frame_i32(i32.data(), channels, frames, 3));
+        EXPECT_EQ(frames, find_non_silent_frame_float(f.data(), channels, frames, 1e-4f));
+        EXPECT_EQ((size_t)0, find_non_silent_frame_i16(i16.data(), channels, frames, 2));
+        EXPECT_EQ((size_t)0, find_non_silent_frame_float(f.data(), channels, frames, 1e-5f));
+
+        // a single loud sample, at each position across vector block boundaries
+        for (size_t pos = 0; pos < 40; ++pos) {
+            const size_t sample = frames * channels - 1 - pos;
+            for (size_t neg = 0; neg < 2; ++neg) {
+                i16[sample] = neg ? INT16_MIN : 4;
+                i32[sample] = neg ? INT32_MIN + 1 : 4;
+                f[sample] = neg ? -1.f : 1e-3f;
+                EXPECT_EQ(sample / channels,
+                        find_non_silent_frame_i16(i16.data(), channels, frames, 3));
+                EXPECT_EQ(sample / channels,
+                        find_non_silent_frame_i32(i32.data(), channels, frames, 3));
+                EXPECT_EQ(sample / channels,
+                        find_non_silent_frame_float(f.data(), channels, frames, 1e-4f));
+            }
+            i16[sample] = 3;
+            i32[sample] = 3;
+            f[sample] = 1e-4f;
+        }
+    }
+}
+
 TEST(audio_utils_primitives, memcpy_by_channel_mask) {
     uint32_t dst_mask;
     uint32_t src_mask;
@@ -655,6 +1014,194 @@ TEST(audio_utils_primitives, memcpy_by_index_array_src_index) {
     delete[] u24ary;
 }
 
+TEST(audio_utils_primitives, memcpy_by_index_array_plan) {
+    // The plan must give the same result as memcpy_by_index_array(), for each kind of remap.
+    static const struct {
+        uint32_t dst_channels;
+        uint32_t src_channels;
+        int8_t idxary[12];
+    } remaps[] = {
+        {2, 2, {0, 1}},                                         // identity
+        {8, 8, {0, 1, 2, 3, 4, 5, 6, 7}},                       // identity
+        {2, 8, {0, 1}},                                         // drop channels
+        {6, 8, {2, 3, 4, 5, 6, 7}},                             // drop leading channels
+        {4, 2, {-1, -1, -1, -1}},                               // zero fill
+        {2, 2, {1, 0}},                                         // swap L and R
+        {6, 1, {-1, -1, 0, -1, -1, -1}},                        // mono to 5.1 center
+        {8, 8, {1, 0, 3, 2, 5, 4, 7, 6}},                       // 7.1 swizzle
+        {8, 6, {0, 1, 2, 3, 4, 5, -1, -1}},                     // 5.1 to 7.1
+        {12, 12, {11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0}},       // too large for a shuffle
+        {12, 8, {0, 1, 2, 3, 4, 5, 6, 7, -1, -1, 0, 1}},        // replicate
+    };
+    const size_t count = 1001;
+    const size_t maxFrameSize = 12 * 4;
+    uint8_t *src = new uint8_t[count * maxFrameSize];
+    uint8_t *dst = new uint8_t[count * maxFrameSize];
+    uint8_t *ref = new uint8_t[count * maxFrameSize];
+    for (size_t i = 0; i < count * maxFrameSize; ++i) {
+        src[i] = i * 7 + 3;
+    }
+
+    for (size_t r = 0; r < ARRAY_SIZE(remaps); ++r) {
+        for (size_t sample_size = 1; sample_size <= 4; ++sample_size) {
+            struct memcpy_by_index_array_plan plan;
+            ASSERT_EQ(0, memcpy_by_index_array_plan_init(&plan, remaps[r].dst_channels,
+                    remaps[r].src_channels, remaps[r].idxary, sample_size));
+            memset(dst, 0xff, count * maxFrameSize);
+            memset(ref, 0xff, count * maxFrameSize);
+            memcpy_by_index_array_plan_execute(&plan, dst, src, count);
+            memcpy_by_index_array(ref, remaps[r].dst_channels, src, remaps[r].src_channels,
+                    remaps[r].idxary, sample_size, count);
+            EXPECT_EQ(0, memcmp(ref, dst, count * maxFrameSize))
+                    << "remap " << r << " sample_size " << sample_size;
+        }
+    }
+
+    // invalid parameters
+    struct memcpy_by_index_array_plan plan;
+    static const int8_t outOfRange[] = {0, 2};
+    EXPECT_EQ(-EINVAL, memcpy_by_index_array_plan_init(&plan, 2, 2, outOfRange, 2));
+    EXPECT_EQ(-EINVAL, memcpy_by_index_array_plan_init(&plan, 2, 2, remaps[0].idxary, 5));
+    EXPECT_EQ(-EINVAL, memcpy_by_index_array_plan_init(&plan, 33, 2, remaps[0].idxary, 2));
+
+    delete[] src;
+    delete[] dst;
+    delete[] ref;
+}
+
+TEST(audio_utils_primitives, memcpy_by_index_array_plan_exact_size) {
+    // Buffers of exactly count frames, so that any access past either end is caught with ASan,
+    // for frames of different sizes on each side.
+    static const struct {
+        uint32_t dst_channels;
+        uint32_t src_channels;
+        int8_t idxary[8];
+    } remaps[] = {
+        {4, 1, {0, 0, 0, 0}},                                   // upmix mono
+        {8, 2, {0, 1, 0, 1, -1, -1, 1, 0}},                     // upmix stereo
+        {2, 8, {1, 0}},                                         // downmix with swap
+        {1, 4, {3}},                                            // extract one channel
+        {3, 4, {2, -1, 0}},                                     // downmix with zero fill
+    };
+    for (size_t r = 0; r < ARRAY_SIZE(remaps); ++r) {
+        for (size_t sample_size = 1; sample_size <= 4; ++sample_size) {
+            struct memcpy_by_index_array_plan plan;
+            ASSERT_EQ(0, memcpy_by_index_array_plan_init(&plan, remaps[r].dst_channels,
+                    remaps[r].src_channels, remaps[r].idxary, sample_size));
+            const size_t dstFrameSize = remaps[r].dst_channels * sample_size;
+            const size_t srcFrameSize = remaps[r].src_channels * sample_size;
+            for (size_t count = 1; count <= 40; ++count) {
+                std::vector<uint8_t> src(count * srcFrameSize);
+                for (size_t i = 0; i < src.size(); ++i) {
+                    src[i] = i * 7 + 3;
+                }
+                std::vector<uint8_t> dst(count * dstFrameSize, 0xff);
+                std::vector<uint8_t> ref(count * dstFrameSize, 0xff);
+                memcpy_by_index_array_plan_execute(&plan, dst.data(), src.data(), count);
+                memcpy_by_index_array(ref.data(), remaps[r].dst_channels, src.data(),
+                        remaps[r].src_channels, remaps[r].idxary, sample_size, count);
+                ASSERT_EQ(ref, dst) << "remap " << r << " sample_size " << sample_size
+                        << " count " << count;
+            }
+        }
+    }
+}
+
+using android::audio_utils::sample_t;
+
+// Compare the templated conversion against memcpy_by_audio_format(), starting from
+// float samples which go past full scale so that the clamping is exercised.
+template <audio_format_t Dst, audio_format_t Src, size_t Channels>
+static void checkKernelConvert(const std::vector<float> &f32) {
+    const size_t frames = f32.size() / Channels;
+    std::vector<sample_t<Src>> src(f32.size());
+    memcpy_by_audio_format(src.data(), Src, f32.data(), AUDIO_FORMAT_PCM_FLOAT, f32.size());
+    std::vector<sample_t<Dst>> ref(f32.size());
+    std::vector<sample_t<Dst>> dst(f32.size());
+    memcpy_by_audio_format(ref.data(), Dst, src.data(), Src, f32.size());
+    android::audio_utils::convert<Dst, Src, Channels>(dst.data(), src.data(), frames);
+    EXPECT_EQ(0, memcmp(ref.data(), dst.data(), ref.size() * sizeof(ref[0])))
+            << "dst format " << Dst << " src format " << Src;
+}
+
+TEST(audio_utils_kernels, convert) {
+    static const size_t kFrames = 1003;
+    std::vector<float> f32(kFrames * 2);
+    for (size_t i = 0; i < f32.size(); ++i) {
+        f32[i] = (float)(3. * i / f32.size() - 1.5);
+    }
+    checkKernelConvert<AUDIO_FORMAT_PCM_16_BIT, AUDIO_FORMAT_PCM_16_BIT, 2>(f32);
+    checkKernelConvert<AUDIO_FORMAT_PCM_16_BIT, AUDIO_FORMAT_PCM_FLOAT, 2>(f32);
+    checkKernelConvert<AUDIO_FORMAT_PCM_16_BIT, AUDIO_FORMAT_PCM_8_BIT, 2>(f32);
+    checkKernelConvert<AUDIO_FORMAT_PCM_16_BIT, AUDIO_FORMAT_PCM_32_BIT, 2>(f32);
+    checkKernelConvert<AUDIO_FORMAT_PCM_16_BIT, AUDIO_FORMAT_PCM_8_24_BIT, 2>(f32);
+    checkKernelConvert<AUDIO_FORMAT_PCM_FLOAT, AUDIO_FORMAT_PCM_16_BIT, 2>(f32);
+    checkKernelConvert<AUDIO_FORMAT_PCM_FLOAT, AUDIO_FORMAT_PCM_FLOAT, 1>(f32);
+    checkKernelConvert<AUDIO_FORMAT_PCM_FLOAT, AUDIO_FORMAT_PCM_8_BIT, 2>(f32);
+    checkKernelConvert<AUDIO_FORMAT_PCM_FLOAT, AUDIO_FORMAT_PCM_32_BIT, 2>(f32);
+    checkKernelConvert<AUDIO_FORMAT_PCM_FLOAT, AUDIO_FORMAT_PCM_8_24_BIT, 2>(f32);
+    checkKernelConvert<AUDIO_FORMAT_PCM_8_BIT, AUDIO_FORMAT_PCM_16_BIT, 2>(f32);
+    checkKernelConvert<AUDIO_FORMAT_PCM_8_BIT, AUDIO_FORMAT_PCM_FLOAT, 2>(f32);
+    checkKernelConvert<AUDIO_FORMAT_PCM_32_BIT, AUDIO_FORMAT_PCM_16_BIT, 2>(f32);
+    checkKernelConvert<AUDIO_FORMAT_PCM_32_BIT, AUDIO_FORMAT_PCM_FLOAT, 2>(f32);
+    checkKernelConvert<AUDIO_FORMAT_PCM_8_24_BIT, AUDIO_FORMAT_PCM_16_BIT, 2>(f32);
+    checkKernelConvert<AUDIO_FORMAT_PCM_8_24_BIT, AUDIO_FORMAT_PCM_FLOAT, 2>(f32);
+}
+
+TEST(audio_utils_kernels, remap) {
+    static const size_t kFrames = 1001;
+    static const int8_t kStereoTo51[] = {1, 0, -1, -1, 0, 1};
+    static const int8_t k51ToStereo[] = {0, 1};
+    std::vector<int16_t> src(kFrames * 6);
+    for (size_t i = 0; i < src.size(); ++i) {
+        src[i] = (int16_t)(i * 7 + 3);
+    }
+    std::vector<int16_t> dst(kFrames * 6 + 1, 1234);
+    android::audio_utils::remap<AUDIO_FORMAT_PCM_16_BIT, 6, 2>(
+            dst.data(), src.data(), kFrames, kStereoTo51);
+    for (size_t i = 0; i < kFrames; ++i) {
+        for (size_t j = 0; j < 6; ++j) {
+            const int index = kStereoTo51[j];
+            EXPECT_EQ(index < 0 ? 0 : src[i * 2 + index], dst[i * 6 + j]);
+        }
+    }
+    EXPECT_EQ(1234, dst[kFrames * 6]);
+
+    android::audio_utils::remap<AUDIO_FORMAT_PCM_16_BIT, 2, 6>(
+            dst.data(), src.data(), kFrames, k51ToStereo);
+    for (size_t i = 0; i < kFrames; ++i) {
+        EXPECT_EQ(src[i * 6], dst[i * 2]);
+        EXPECT_EQ(src[i * 6 + 1], dst[i * 2 + 1]);
+    }
+}
+
+TEST(audio_utils_kernels, mix) {
+    static const size_t kFrames = 1003;
+    static const float kGains[] = {0.5f, 2.f};
+    std::vector<int16_t> i16(kFrames * 2);
+    for (size_t i = 0; i < i16.size(); ++i) {
+        i16[i] = (int16_t)(((i * 7919) % 65536) - 32768);
+    }
+    std::vector<float> f32(i16.size());
+    memcpy_to_float_from_i16(f32.data(), i16.data(), i16.size());
+
+    // float accumulation
+    std::vector<float> sums(f32.size(), 0.25f);
+    android::audio_utils::mix<AUDIO_FORMAT_PCM_FLOAT, AUDIO_FORMAT_PCM_16_BIT, 2>(
+            sums.data(), i16.data(), kFrames, kGains);
+    for (size_t i = 0; i < sums.size(); ++i) {
+        EXPECT_EQ(0.25f + f32[i] * kGains[i & 1], sums[i]);
+    }
+
+    // 16-bit destination saturates
+    std::vector<int16_t> out(i16);
+    android::audio_utils::mix<AUDIO_FORMAT_PCM_16_BIT, AUDIO_FORMAT_PCM_FLOAT, 2>(
+            out.data(), f32.data(), kFrames, kGains);
+    for (size_t i = 0; i < out.size(); ++i) {
+        EXPECT_EQ(clamp16_from_float(f32[i] + f32[i] * kGains[i & 1]), out[i]);
+    }
+}
+
 TEST(audio_utils_channels, adjust_channels) {
     uint16_t *u16ref = new uint16_t[65536];
     uint16_t *u16expand = new uint16_t[65536*2];
@@ -687,3 +1234,237 @@ TEST(audio_utils_channels, adjust_channels) {
     delete[] u16expand;
     delete[] u16ary;
 }
+
+// Integer averages round toward negative infinity, as in channels.c
+static inline int32_t halve(int32_t sum) { return sum >> 1; }
+static inline int64_t halve(int64_t sum) { return sum >> 1; }
+static inline float halve(float sum) { return sum * 0.5f; }
+
+// Reference for adjust_channels(): expansion zero fills (after duplicating mono to stereo),
+// and contraction keeps the first channels (or averages the first two into mono).
+template<typename T, typename A>
+static void adjustChannelsRef(const T *in, size_t inChans, T *out, size_t outChans,
+        size_t frames)
+{
+    for (size_t i = 0; i < frames; ++i) {
+        for (size_t c = 0; c < outChans; ++c) {
+            T value;
+            if (inChans == 1) {
+                value = c < 2 ? in[i] : 0;
+            } else if (outChans == 1) {
+                value = halve((A)in[i * inChans] + (A)in[i * inChans + 1]);
+            } else {
+                value = c < inChans ? in[i * inChans + c] : 0;
+            }
+            out[i * outChans + c] = value;
+        }
+    }
+}
+
+template<typename T, typename A>
+static void checkAdjustChannels(size_t (*adjust)(const T *, size_t, T *, size_t, size_t))
+{
+    static const size_t chans[][2] = {
+        {2, 1}, {1, 2}, {4, 2}, {2, 4}, {8, 2}, {2, 8}, {6, 2}, {2, 6}, {1, 8}, {8, 1},
+    };
+    // include frame counts which are not a multiple of the vector block size
+    static const size_t frameCounts[] = {0, 1, 3, 4, 5, 17, 64, 1023};
+    for (size_t i = 0; i < sizeof(chans) / sizeof(chans[0]); ++i) {
+        const size_t inChans = chans[i][0];
+        const size_t outChans = chans[i][1];
+        const size_t maxChans = std::max(inChans, outChans);
+        for (size_t j = 0; j < sizeof(frameCounts) / sizeof(frameCounts[0]); ++j) {
+            const size_t frames = frameCounts[j];
+            std::vector<T> in(frames * inChans + 1);
+            for (size_t k = 0; k < in.size(); ++k) {
+                in[k] = (T)((k * 7919 + 13) % 2001) - 1000;
+            }
+            std::vector<T> ref(frames * outChans + 1);
+            adjustChannelsRef<T, A>(in.data(), inChans, ref.data(), outChans, frames);
+
+            std::vector<T> out(frames * outChans + 1);
+            EXPECT_EQ(frames * outChans * sizeof(T),
+                    adjust(in.data(), inChans, out.data(), outChans,
+                            frames * inChans * sizeof(T)));
+            EXPECT_EQ(0, memcmp(out.data(), ref.data(), frames * outChans * sizeof(T)))
+                    << inChans << " to " << outChans << " frames " << frames;
+
+            // in place
+            std::vector<T> inout(frames * maxChans + 1);
+            std::copy(in.begin(), in.begin() + frames * inChans, inout.begin());
+            adjust(inout.data(), inChans, inout.data(), outChans, frames * inChans * sizeof(T));
+            EXPECT_EQ(0, memcmp(inout.data(), ref.data(), frames * outChans * sizeof(T)))
+                    << inChans << " to " << outChans << " frames " << frames << " in place";
+        }
+    }
+}
+
+template<typename T>
+static size_t adjustChannelsInt(const T *in, size_t inChans, T *out, size_t outChans,
+        size_t numInBytes)
+{
+    return adjust_channels(in, inChans, out, outChans, sizeof(T), numInBytes);
+}
+
+TEST(audio_utils_channels, adjust_channels_vector) {
+    checkAdjustChannels<int16_t, int32_t>(adjustChannelsInt<int16_t>);
+    checkAdjustChannels<int32_t, int64_t>(adjustChannelsInt<int32_t>);
+    checkAdjustChannels<float, float>(adjust_channels_float);
+}
+
+TEST(audio_utils_channels, channel_mix_init) {
+    struct channel_mix mix;
+    const float h = M_SQRT1_2;
+
+    // 5.1 (FL FR FC LFE BL BR) to stereo
+    ASSERT_EQ(0, channel_mix_init(&mix, AUDIO_CHANNEL_OUT_STEREO, AUDIO_CHANNEL_OUT_5POINT1));
+    EXPECT_EQ(2u, mix.dst_channels);
+    EXPECT_EQ(6u, mix.src_channels);
+    const float fiveOneToStereo[2][6] = {
+        { 1, 0, h, h, h, 0 },
+        { 0, 1, h, h, 0, h },
+    };
+    for (size_t d = 0; d < 2; ++d) {
+        for (size_t s = 0; s < 6; ++s) {
+            EXPECT_FLOAT_EQ(fiveOneToStereo[d][s], mix.coefs[d][s]) << d << " " << s;
+        }
+    }
+
+    // 7.1 (FL FR FC LFE BL BR SL SR) to quad (FL FR BL BR)
+    ASSERT_EQ(0, channel_mix_init(&mix, AUDIO_CHANNEL_OUT_QUAD, AUDIO_CHANNEL_OUT_7POINT1));
+    const float sevenOneToQuad[4][8] = {
+        { 1, 0, h, h, 0, 0, 0, 0 },
+        { 0, 1, h, h, 0, 0, 0, 0 },
+        { 0, 0, 0, 0, 1, 0, 1, 0 },
+        { 0, 0, 0, 0, 0, 1, 0, 1 },
+    };
+    for (size_t d = 0; d < 4; ++d) {
+        for (size_t s = 0; s < 8; ++s) {
+            EXPECT_FLOAT_EQ(sevenOneToQuad[d][s], mix.coefs[d][s]) << d << " " << s;
+        }
+    }
+
+    // mono destination averages, mono source duplicates
+    ASSERT_EQ(0, channel_mix_init(&mix, AUDIO_CHANNEL_OUT_MONO, AUDIO_CHANNEL_OUT_STEREO));
+    EXPECT_FLOAT_EQ(0.5f, mix.coefs[0][0]);
+    EXPECT_FLOAT_EQ(0.5f, mix.coefs[0][1]);
+    ASSERT_EQ(0, channel_mix_init(&mix, AUDIO_CHANNEL_OUT_STEREO, AUDIO_CHANNEL_OUT_MONO));
+    EXPECT_FLOAT_EQ(1.f, mix.coefs[0][0]);
+    EXPECT_FLOAT_EQ(1.f, mix.coefs[1][0]);
+    ASSERT_EQ(0, channel_mix_init(&mix, AUDIO_CHANNEL_OUT_MONO, AUDIO_CHANNEL_OUT_MONO));
+    EXPECT_FLOAT_EQ(1.f, mix.coefs[0][0]);
+
+    // identity, and copy by index
+    ASSERT_EQ(0, channel_mix_init(&mix, AUDIO_CHANNEL_OUT_7POINT1, AUDIO_CHANNEL_OUT_7POINT1));
+    for (size_t d = 0; d < 8; ++d) {
+        for (size_t s = 0; s < 8; ++s) {
+            EXPECT_EQ(d == s ? 1.f : 0.f, mix.coefs[d][s]);
+        }
+    }
+    ASSERT_EQ(0, channel_mix_init(&mix, audio_channel_mask_for_index_assignment_from_count(3),
+            AUDIO_CHANNEL_OUT_5POINT1));
+    EXPECT_EQ(3u, mix.dst_channels);
+    for (size_t d = 0; d < 3; ++d) {
+        for (size_t s = 0; s < 6; ++s) {
+            EXPECT_EQ(d == s ? 1.f : 0.f, mix.coefs[d][s]);
+        }
+    }
+
+    EXPECT_EQ(-EINVAL, channel_mix_init(&mix, AUDIO_CHANNEL_OUT_STEREO, AUDIO_CHANNEL_NONE));
+    EXPECT_EQ(-EINVAL, channel_mix_init(&mix, AUDIO_CHANNEL_OUT_STEREO, AUDIO_CHANNEL_OUT_ALL));
+    EXPECT_EQ(-EINVAL, channel_mix_init_from_coefs(&mix, 9, 2, NULL));
+    EXPECT_EQ(-EINVAL, channel_mix_init_from_coefs(&mix, 2, 0, NULL));
+}
+
+TEST(audio_utils_channels, channel_mix) {
+    static const size_t kFrames = 67; // not a multiple of the group or block length
+    struct channel_mix mix;
+    for (uint32_t dstChans = 1; dstChans <= CHANNEL_MIX_MAX_CHANNELS; ++dstChans) {
+        for (uint32_t srcChans = 1; srcChans <= CHANNEL_MIX_MAX_CHANNELS; ++srcChans) {
+            // some zero coefficients, so that unused source channels are skipped
+            std::vector<float> coefs(dstChans * srcChans);
+            for (size_t i = 0; i < coefs.size(); ++i) {
+                coefs[i] = i % 3 == 1 ? 0.f : ((i * 37 + dstChans) % 19) / 19.f - 0.4f;
+            }
+            ASSERT_EQ(0, channel_mix_init_from_coefs(&mix, dstChans, srcChans, coefs.data()));
+
+            std::vector<float> in(kFrames * srcChans);
+            std::vector<int16_t> in16(kFrames * srcChans);
+            for (size_t i = 0; i < in.size(); ++i) {
+                in16[i] = (int16_t)((i * 7919 + 13) % 65536 - 32768);
+                in[i] = float_from_i16(in16[i]);
+            }
+            std::vector<float> ref(kFrames * dstChans);
+            for (size_t f = 0; f < kFrames; ++f) {
+                for (size_t d = 0; d < dstChans; ++d) {
+                    float accum = 0.f;
+                    for (size_t s = 0; s < srcChans; ++s) {
+                        accum += in[f * srcChans + s] * coefs[d * srcChans + s];
+                    }
+                    ref[f * dstChans + d] = accum;
+                }
+            }
+
+            // extra element to check for writes past the end
+            std::vector<float> out(kFrames * dstChans + 1, 1234.f);
+            channel_mix_float(&mix, out.data(), in.data(), kFrames);
+            for (size_t i = 0; i < ref.size(); ++i) {
+                EXPECT_NEAR(ref[i], out[i], 1e-6f)
+                        << srcChans << " to " << dstChans << " sample " << i;
+            }
+            EXPECT_EQ(1234.f, out[ref.size()]);
+
+            std::vector<int16_t> out16(kFrames * dstChans + 1, 1234);
+            channel_mix_i16(&mix, out16.data(), in16.data(), kFrames);
+            for (size_t i = 0; i < ref.size(); ++i) {
+                EXPECT_NEAR(clamp16_from_float(ref[i]), out16[i], 1)
+                        << srcChans << " to " << dstChans << " sample " << i;
+            }
+            EXPECT_EQ(1234, out16[ref.size()]);
+        }
+    }
+}
+
+TEST(audio_utils_conversion, mono_blend) {
+    static const size_t kFrames = 1003; // not a multiple of the vector or block length
+    for (size_t channels = 2; channels <= 10; ++channels) {
+        const size_t samples = kFrames * channels;
+        std::vector<int16_t> i16(samples);
+        std::vector<float> f32(samples);
+        for (size_t i = 0; i < samples; ++i) {
+            i16[i] = (int16_t)(((i * 7919) % 65536) - 32768);
+            f32[i] = i16[i] * (1.0f / 32768);
+        }
+        std::vector<int16_t> i16Out(i16);
+        std::vector<float> f32Out(f32);
+        mono_blend(&i16Out[0], AUDIO_FORMAT_PCM_16_BIT, channels, kFrames, false /*limit*/);
+        mono_blend(&f32Out[0], AUDIO_FORMAT_PCM_FLOAT, channels, kFrames, false /*limit*/);
+        for (size_t i = 0; i < kFrames; ++i) {
+            int accum = 0;
+            float faccum = 0;
+            for (size_t j = 0; j < channels; ++j) {
+                accum += i16[i * channels + j];
+                faccum += f32[i * channels + j];
+            }
+            faccum *= (float)(1. / channels);
+            for (size_t j = 0; j < channels; ++j) {
+                // average rounds to 0
+                EXPECT_EQ(accum / (int)channels, i16Out[i * channels + j]);
+                EXPECT_EQ(faccum, f32Out[i * channels + j]);
+            }
+        }
+    }
+
+    // stereo float with limiter
+    std::vector<float> f32(2 * kFrames);
+    for (size_t i = 0; i < f32.size(); ++i) {
+        f32[i] = (float)(2. * i / f32.size() - 1.);
+    }
+    std::vector<float> f32Out(f32);
+    mono_blend(&f32Out[0], AUDIO_FORMAT_PCM_FLOAT, 2, kFrames, true /*limit*/);
+    for (size_t i = 0; i < kFrames; ++i) {
+        float expected = limiter((f32[2 * i] + f32[2 * i + 1]) * M_SQRT1_2);
+        EXPECT_NEAR(expected, f32Out[2 * i], 1e-6);
+        EXPECT_EQ(f32Out[2 * i], f32Out[2 * i + 1]);
+    }
+}
@@ -0,0 +1,417 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "audio_utils_resampler_tests"
+
+#include <errno.h>
+#include <math.h>
+#include <string.h>
+#include <vector>
+#include <gtest/gtest.h>
+#include <audio_utils/resampler.h>
+#include <audio_utils/task_pool.h>
+
+static struct resampler_itfe *createPolyphase(uint32_t inRate, uint32_t outRate,
+        uint32_t channelCount, struct resampler_buffer_provider *provider = NULL)
+{
+    struct resampler_config config;
+    memset(&config, 0, sizeof(config));
+    config.in_sample_rate = inRate;
+    config.out_sample_rate = outRate;
+    config.channel_count = channelCount;
+    config.quality = RESAMPLER_QUALITY_DEFAULT;
+    config.engine = RESAMPLER_ENGINE_POLYPHASE;
+    struct resampler_itfe *resampler = NULL;
+    EXPECT_EQ(0, create_resampler_from_config(&config, provider, &resampler));
+    return resampler;
+}
+
+// interleaved 16-bit sine, same in all channels
+static std::vector<int16_t> makeSine(double frequency, uint32_t rate, size_t frames,
+        uint32_t channelCount, double amplitude = 16384.)
+{
+    std::vector<int16_t> sine(frames * channelCount);
+    for (size_t i = 0; i < frames; ++i) {
+        for (size_t c = 0; c < channelCount; ++c) {
+            sine[i * channelCount + c] =
+                    (int16_t)lround(amplitude * sin(2 * M_PI * frequency * i / rate));
+        }
+    }
+    return sine;
+}
+
+// resample in chunks of varying size, to exercise the buffering
+static std::vector<int16_t> resampleFromInput(struct resampler_itfe *resampler,
+        std::vector<int16_t> &in, uint32_t channelCount, size_t outFrames)
+{
+    std::vector<int16_t> out(outFrames * channelCount);
+    size_t inDone = 0;
+    size_t outDone = 0;
+    for (size_t chunk = 1; outDone < outFrames; chunk = chunk * 3 % 997 + 1) {
+        size_t inFrames = std::min(chunk, in.size() / channelCount - inDone);
+        size_t frames = std::min(chunk, outFrames - outDone);
+        EXPECT_EQ(0, resampler->resample_from_input(resampler, &in[inDone * channelCount],
+                &inFrames, &out[outDone * channelCount], &frames));
+        if (inFrames == 0 && frames == 0) {
+            break;
+        }
+        inDone += inFrames;
+        outDone += frames;
+    }
+    out.resize(outDone * channelCount);
+    return out;
+}
+
+TEST(audio_utils_resampler, polyphase_unsupported) {
+    struct resampler_config config;
+    memset(&config, 0, sizeof(config));
+    config.in_sample_rate = 44100;
+    config.out_sample_rate = 48001;
+    config.channel_count = 1;
+    config.quality = RESAMPLER_QUALITY_DEFAULT;
+    config.engine = RESAMPLER_ENGINE_POLYPHASE;
+    struct resampler_itfe *resampler = (struct resampler_itfe *)&config;
+    EXPECT_EQ(-EINVAL, create_resampler_from_config(&config, NULL, &resampler));
+    EXPECT_EQ(NULL, resampler);
+    config.out_sample_rate = 48000;
+    config.quality = RESAMPLER_QUALITY_MAX;
+    EXPECT_EQ(-EINVAL, create_resampler_from_config(&config, NULL, &resampler));
+}
+
+TEST(audio_utils_resampler, polyphase_sine) {
+    static const struct {
+        uint32_t inRate;
+        uint32_t outRate;
+        uint32_t channelCount;
+    } kConfigs[] = {
+        {44100, 48000, 1}, {48000, 44100, 2}, {16000, 48000, 2}, {48000, 16000, 1},
+        {8000, 48000, 3},
+    };
+    const double frequency = 1000.;
+    for (size_t i = 0; i < sizeof(kConfigs) / sizeof(kConfigs[0]); ++i) {
+        const uint32_t inRate = kConfigs[i].inRate;
+        const uint32_t outRate = kConfigs[i].outRate;
+        const uint32_t channelCount = kConfigs[i].channelCount;
+        struct resampler_itfe *resampler = createPolyphase(inRate, outRate, channelCount);
+        ASSERT_TRUE(resampler != NULL);
+
+        std::vector<int16_t> in = makeSine(frequency, inRate, inRate / 2, channelCount);
+        const size_t outFrames = outRate / 4;
+        std::vector<int16_t> out = resampleFromInput(resampler, in, channelCount, outFrames);
+        ASSERT_EQ(outFrames * channelCount, out.size());
+
+        // the first output frame is aligned on the first input frame,
+        // so after the filter has settled the output is the same sine at the output rate
+        std::vector<int16_t> ref = makeSine(frequency, outRate, outFrames, channelCount);
+        int maxError = 0;
+        for (size_t j = outRate / 100 * channelCount; j < out.size(); ++j) {
+            maxError = std::max(maxError, abs(out[j] - ref[j]));
+        }
+        EXPECT_LT(maxError, 32) << inRate << " to " << outRate;
+        release_resampler(resampler);
+    }
+}
+
+TEST(audio_utils_resampler, polyphase_stop_band) {
+    // a tone above the output Nyquist frequency must be attenuated
+    struct resampler_itfe *resampler = createPolyphase(48000, 16000, 1);
+    ASSERT_TRUE(resampler != NULL);
+    std::vector<int16_t> in = makeSine(12000., 48000, 24000, 1);
+    std::vector<int16_t> out = resampleFromInput(resampler, in, 1, 4000);
+    ASSERT_EQ(4000u, out.size());
+    int peak = 0;
+    for (size_t j = 1000; j < out.size(); ++j) {
+        peak = std::max(peak, abs(out[j]));
+    }
+    EXPECT_LT(peak, 16384 / 100); // at least 40 dB
+    release_resampler(resampler);
+}
+
+struct VectorProvider {
+    struct resampler_buffer_provider provider;  // must be first
+    std::vector<int16_t> *data;
+    size_t channelCount;
+    size_t frames;      // frames given so far
+};
+
+static int getNextBuffer(struct resampler_buffer_provider *provider,
+        struct resampler_buffer *buffer)
+{
+    VectorProvider *vp = (VectorProvider *)provider;
+    size_t available = vp->data->size() / vp->channelCount - vp->frames;
+    // give at most 100 frames at a time
+    buffer->frame_count = std::min(std::min(buffer->frame_count, available), (size_t)100);
+    buffer->i16 = buffer->frame_count > 0 ? &(*vp->data)[vp->frames * vp->channelCount] : NULL;
+    return buffer->frame_count > 0 ? 0 : -ENODATA;
+}
+
+static void releaseBuffer(struct resampler_buffer_provider *provider,
+        struct resampler_buffer *buffer)
+{
+    VectorProvider *vp = (VectorProvider *)provider;
+    vp->frames += buffer->frame_count;
+}
+
+TEST(audio_utils_resampler, polyphase_provider) {
+    // the provider and input paths must produce the same output
+    const uint32_t channelCount = 2;
+    std::vector<int16_t> in = makeSine(440., 44100, 22050, channelCount);
+    VectorProvider vp = {{getNextBuffer, releaseBuffer}, &in, channelCount, 0};
+    struct resampler_itfe *fromProvider = createPolyphase(44100, 48000, channelCount,
+            &vp.provider);
+    struct resampler_itfe *fromInput = createPolyphase(44100, 48000, channelCount);
+    ASSERT_TRUE(fromProvider != NULL && fromInput != NULL);
+
+    const size_t outFrames = 20000;
+    std::vector<int16_t> out(outFrames * channelCount);
+    size_t outDone = 0;
+    while (outDone < outFrames) {
+        size_t frames = std::min((size_t)480, outFrames - outDone);
+        ASSERT_EQ(0, fromProvider->resample_from_provider(fromProvider,
+                &out[outDone * channelCount], &frames));
+        ASSERT_GT(frames, 0u);
+        outDone += frames;
+    }
+    // the provider is asked only for the frames needed
+    EXPECT_LT(vp.frames, outFrames * 44100 / 48000 + 64);
+
+    std::vector<int16_t> ref = resampleFromInput(fromInput, in, channelCount, outFrames);
+    EXPECT_EQ(0, memcmp(out.data(), ref.data(), out.size() * sizeof(int16_t)));
+
+    // input path is not available with a provider, and vice versa
+    size_t inFrames = 1;
+    size_t frames = 1;
+    EXPECT_EQ(-ENOSYS, fromProvider->resample_from_input(fromProvider, &in[0], &inFrames,
+            &out[0], &frames));
+    EXPECT_EQ(-ENOSYS, fromInput->resample_from_provider(fromInput, &out[0], &frames));
+
+    release_resampler(fromProvider);
+    release_resampler(fromInput);
+}
+
+TEST(audio_utils_resampler, no_alloc) {
+    const uint32_t channelCount = 2;
+    const size_t maxFrames = 480;
+    std::vector<int16_t> in = makeSine(440., 44100, 44100, channelCount);
+    for (int engine = RESAMPLER_ENGINE_SPEEX; engine <= RESAMPLER_ENGINE_POLYPHASE; ++engine) {
+        VectorProvider vp = {{getNextBuffer, releaseBuffer}, &in, channelCount, 0};
+        struct resampler_config config;
+        memset(&config, 0, sizeof(config));
+        config.in_sample_rate = 44100;
+        config.out_sample_rate = 48000;
+        config.channel_count = channelCount;
+        config.quality = RESAMPLER_QUALITY_DEFAULT;
+        config.engine = (enum resampler_engine)engine;
+        config.flags = RESAMPLER_FLAG_NO_ALLOC;
+        struct resampler_itfe *resampler = NULL;
+
+        // the maximum frame count is needed to preallocate
+        EXPECT_EQ(-EINVAL, create_resampler_from_config(&config, &vp.provider, &resampler));
+        config.max_frame_count = maxFrames;
+        ASSERT_EQ(0, create_resampler_from_config(&config, &vp.provider, &resampler));
+
+        std::vector<int16_t> out((maxFrames + 1) * channelCount);
+        for (size_t frames = 1; frames <= maxFrames; frames += 61) {
+            size_t outFrames = frames;
+            EXPECT_EQ(0, resampler->resample_from_provider(resampler, out.data(), &outFrames));
+            EXPECT_EQ(frames, outFrames);
+        }
+        if (engine == RESAMPLER_ENGINE_SPEEX) {
+            // no room for the input of a larger request
+            size_t consumed = vp.frames;
+            size_t outFrames = maxFrames * 2;
+            EXPECT_EQ(-ENOMEM, resampler->resample_from_provider(resampler, out.data(),
+                    &outFrames));
+            EXPECT_EQ(0u, outFrames);
+            EXPECT_EQ(consumed, vp.frames);
+        }
+        release_resampler(resampler);
+    }
+}
+
+TEST(audio_utils_resampler, polyphase_float) {
+    // float and 16-bit paths compute the same, except for output quantization
+    const uint32_t channelCount = 6;
+    const size_t inFrames = 4410;
+    std::vector<int16_t> in = makeSine(1000., 44100, inFrames, channelCount);
+    std::vector<float> inFloat(in.size());
+    for (size_t i = 0; i < in.size(); ++i) {
+        inFloat[i] = in[i] / 32768.f;
+    }
+    struct resampler_itfe *r16 = createPolyphase(44100, 48000, channelCount);
+    struct resampler_itfe *rFloat = createPolyphase(44100, 48000, channelCount);
+    ASSERT_TRUE(r16 != NULL && rFloat != NULL);
+
+    const size_t outFrames = 4000;
+    std::vector<int16_t> out16 = resampleFromInput(r16, in, channelCount, outFrames);
+    ASSERT_EQ(outFrames * channelCount, out16.size());
+    std::vector<float> outFloat(outFrames * channelCount);
+    size_t inDone = 0;
+    size_t outDone = 0;
+    while (outDone < outFrames) {
+        size_t inCount = std::min((size_t)441, inFrames - inDone);
+        size_t outCount = outFrames - outDone;
+        ASSERT_EQ(0, rFloat->resample_from_input_float(rFloat, &inFloat[inDone * channelCount],
+                &inCount, &outFloat[outDone * channelCount], &outCount));
+        ASSERT_TRUE(inCount > 0 || outCount > 0);
+        inDone += inCount;
+        outDone += outCount;
+    }
+    for (size_t i = 0; i < outFloat.size(); ++i) {
+        EXPECT_NEAR(out16[i] / 32768., outFloat[i], 1. / 32768.);
+    }
+    release_resampler(r16);
+    release_resampler(rFloat);
+}
+
+TEST(audio_utils_resampler, polyphase_ratio_adjustment) {
+    const uint32_t inRate = 48000;
+    const uint32_t outRate = 48000;
+    struct resampler_itfe *resampler = createPolyphase(inRate, outRate, 1);
+    ASSERT_TRUE(resampler != NULL);
+    EXPECT_EQ(-EINVAL, resampler->set_ratio_adjustment_ppm(resampler,
+            RESAMPLER_MAX_RATIO_ADJUSTMENT_PPM + 1));
+    EXPECT_EQ(-EINVAL, resampler->set_ratio_adjustment_ppm(resampler,
+            -RESAMPLER_MAX_RATIO_ADJUSTMENT_PPM - 1));
+
+    const int32_t ppm[] = {0, 2500, -1250, 333};
+    const size_t periodFrames = 4800;
+    std::vector<int16_t> in = makeSine(1000., inRate, inRate * 2, 1);
+    std::vector<int16_t> out(periodFrames);
+    size_t inDone = 0;
+    double inTime = 0;  // input position of next output frame, in frames
+    for (size_t period = 0; period < sizeof(ppm) / sizeof(ppm[0]); ++period) {
+        ASSERT_EQ(0, resampler->set_ratio_adjustment_ppm(resampler, ppm[period]));
+        size_t inFrames = in.size() - inDone;
+        size_t outFrames = periodFrames;
+        ASSERT_EQ(0, resampler->resample_from_input(resampler, &in[inDone], &inFrames,
+                out.data(), &outFrames));
+        ASSERT_EQ(periodFrames, outFrames);
+        inDone += inFrames;
+
+        // the output follows the input sine at the adjusted ratio, with no discontinuity
+        const double step = (double)inRate / outRate * (1 + ppm[period] * 1e-6);
+        int maxError = 0;
+        for (size_t j = 0; j < outFrames; ++j, inTime += step) {
+            if (period == 0 && j < 480) {
+                continue;   // filter settling
+            }
+            int expected = (int)lround(16384. * sin(2 * M_PI * 1000. * inTime / inRate));
+            maxError = std::max(maxError, abs(out[j] - expected));
+        }
+        EXPECT_LT(maxError, 32) << "ppm " << ppm[period];
+    }
+    release_resampler(resampler);
+}
+
+TEST(audio_utils_resampler, batch) {
+    // streams in lockstep, a stereo stream, a speex stream and a stream which got out of step,
+    // each compared with the same resampler run on its own
+    const uint32_t inRate = 16000;
+    const uint32_t outRate = 48000;
+    const size_t monoCount = 6;
+    const uint32_t channelCounts[] = {1, 1, 1, 1, 1, 1, 2, 1, 1};
+    const size_t streamCount = sizeof(channelCounts) / sizeof(channelCounts[0]);
+    std::vector<struct resampler_itfe *> batched, single;
+    for (size_t s = 0; s < streamCount; ++s) {
+        if (s == monoCount + 1) {
+            struct resampler_itfe *resampler = NULL;
+            ASSERT_EQ(0, create_resampler(inRate, outRate, channelCounts[s],
+                    RESAMPLER_QUALITY_DEFAULT, NULL, &resampler));
+            batched.push_back(resampler);
+            ASSERT_EQ(0, create_resampler(inRate, outRate, channelCounts[s],
+                    RESAMPLER_QUALITY_DEFAULT, NULL, &resampler));
+            single.push_back(resampler);
+        } else {
+            batched.push_back(createPolyphase(inRate, outRate, channelCounts[s]));
+            single.push_back(createPolyphase(inRate, outRate, channelCounts[s]));
+        }
+        ASSERT_TRUE(batched.back() != NULL && single.back() != NULL);
+    }
+    ASSERT_EQ(0, batched[streamCount - 1]->set_ratio_adjustment_ppm(batched[streamCount - 1], 100));
+    ASSERT_EQ(0, single[streamCount - 1]->set_ratio_adjustment_ppm(single[streamCount - 1], 100));
+
+    const size_t periodFrames = 160;
+    const size_t periods = 20;
+    std::vector<std::vector<float>> in(streamCount);
+    for (size_t s = 0; s < streamCount; ++s) {
+        std::vector<int16_t> sine = makeSine(300. + 100. * s, inRate, periodFrames * periods,
+                channelCounts[s]);
+        for (int16_t sample : sine) {
+            in[s].push_back(sample / 32768.f);
+        }
+    }
+    // odd periods are split across the threads of a pool
+    struct audio_utils_task_pool_config poolConfig;
+    memset(&poolConfig, 0, sizeof(poolConfig));
+    poolConfig.thread_count = 2;
+    struct audio_utils_task_pool *pool = audio_utils_task_pool_create(&poolConfig);
+    ASSERT_TRUE(pool != NULL);
+    std::vector<struct resampler_batch_item> items(streamCount);
+    std::vector<std::vector<float>> outBatched(streamCount), outSingle(streamCount);
+    for (size_t period = 0; period < periods; ++period) {
+        for (size_t s = 0; s < streamCount; ++s) {
+            outBatched[s].resize(3 * periodFrames * channelCounts[s]);
+            outSingle[s].resize(3 * periodFrames * channelCounts[s]);
+            items[s].resampler = batched[s];
+            items[s].in = &in[s][period * periodFrames * channelCounts[s]];
+            items[s].in_frame_count = periodFrames;
+            items[s].out = outBatched[s].data();
+            items[s].out_frame_count = 3 * periodFrames;
+            items[s].status = -1;
+        }
+        if (period % 2 == 0) {
+            ASSERT_EQ(0, resample_batch_from_input_float(items.data(), streamCount));
+        } else {
+            ASSERT_EQ(0, resample_batch_from_input_float_parallel(pool, items.data(),
+                    streamCount));
+        }
+        for (size_t s = 0; s < streamCount; ++s) {
+            size_t inFrames = periodFrames;
+            size_t outFrames = 3 * periodFrames;
+            ASSERT_EQ(0, single[s]->resample_from_input_float(single[s],
+                    &in[s][period * periodFrames * channelCounts[s]], &inFrames,
+                    outSingle[s].data(), &outFrames));
+            EXPECT_EQ(0, items[s].status);
+            ASSERT_EQ(inFrames, items[s].in_frame_count) << "stream " << s;
+            ASSERT_EQ(outFrames, items[s].out_frame_count) << "stream " << s;
+            for (size_t i = 0; i < outFrames * channelCounts[s]; ++i) {
+                // only the order of the additions may differ
+                ASSERT_NEAR(outSingle[s][i], outBatched[s][i], 1e-6)
+                        << "stream " << s << " period " << period << " sample " << i;
+            }
+        }
+    }
+
+    // a failed item does not stop the others
+    std::vector<float> out(3 * periodFrames);
+    items[0].in = NULL;
+    items[1].out = out.data();
+    EXPECT_EQ(-EINVAL, resample_batch_from_input_float(items.data(), 2));
+    EXPECT_EQ(-EINVAL, items[0].status);
+    EXPECT_EQ(0, items[1].status);
+    EXPECT_EQ(0, resample_batch_from_input_float(NULL, 0));
+    EXPECT_EQ(-EINVAL, resample_batch_from_input_float_parallel(pool, items.data(), 2));
+    EXPECT_EQ(-EINVAL, items[0].status);
+    EXPECT_EQ(0, resample_batch_from_input_float_parallel(NULL, NULL, 0));
+    audio_utils_task_pool_destroy(pool);
+
+    for (size_t s = 0; s < streamCount; ++s) {
+        release_resampler(batched[s]);
+        release_resampler(single[s]);
+    }
+}
@@ -0,0 +1,258 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "audio_utils_sndfile_tests"
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+#include <audio_utils/sndfile.h>
+
+static std::string tempPath(const char *name)
+{
+#ifdef __ANDROID__
+    std::string path("/data/local/tmp/");
+#else
+    std::string path("/tmp/");
+#endif
+    return path + name + "_" + std::to_string(getpid()) + ".wav";
+}
+
+static std::vector<short> makeRamp(size_t count)
+{
+    std::vector<short> samples(count);
+    for (size_t i = 0; i < count; ++i) {
+        samples[i] = (short) ((i * 37) % 60000 - 30000);
+    }
+    return samples;
+}
+
+// write frames of 16-bit samples, optionally buffered, and check they are all accepted
+static void writeFile(const std::string &path, int format, int channels,
+        const std::vector<short> &samples, int bufferFlags)
+{
+    SF_INFO info = { 0, 48000, channels, SF_FORMAT_WAV | format };
+    SNDFILE *handle = sf_open(path.c_str(), SFM_WRITE, &info);
+    ASSERT_TRUE(handle != NULL);
+    if (bufferFlags >= 0) {
+        ASSERT_EQ(0, sf_set_write_buffer(handle, 1000, bufferFlags));
+        EXPECT_EQ(-EINVAL, sf_set_write_buffer(handle, 1000, bufferFlags));
+    }
+    const size_t frames = samples.size() / channels;
+    for (size_t offset = 0, count; offset < frames; offset += count) {
+        count = std::min(frames - offset, offset % 777 + 1);
+        ASSERT_EQ((sf_count_t) count,
+                sf_writef_short(handle, &samples[offset * channels], count));
+    }
+    sf_close(handle);
+}
+
+TEST(audio_utils_sndfile, write_read) {
+    const int channels = 3;
+    const std::vector<short> samples = makeRamp(channels * 10007);
+    const std::string path = tempPath("sndfile_write_read");
+    const int formats[] = { SF_FORMAT_PCM_16, SF_FORMAT_FLOAT };
+    for (int format : formats) {
+        for (int flags = -1; flags <= (SF_WRITE_BACKGROUND | SF_WRITE_DIRECT); ++flags) {
+            writeFile(path, format, channels, samples, flags);
+            for (int mode = SFM_READ; mode <= (SFM_READ | SFM_MMAP); mode += SFM_MMAP) {
+                SF_INFO info;
+                SNDFILE *handle = sf_open(path.c_str(), mode, &info);
+                ASSERT_TRUE(handle != NULL);
+                EXPECT_EQ(channels, info.channels);
+                EXPECT_EQ(SF_FORMAT_WAV | format, info.format);
+                ASSERT_EQ((sf_count_t) (samples.size() / channels), info.frames);
+                std::vector<short> read(samples.size());
+                EXPECT_EQ(info.frames, sf_readf_short(handle, &read[0], info.frames + 1));
+                EXPECT_EQ(samples, read) << "format=" << format << " flags=" << flags
+                        << " mode=" << mode;
+                sf_close(handle);
+            }
+        }
+    }
+    unlink(path.c_str());
+}
+
+// A write error of the background thread is reported by a later write.
+TEST(audio_utils_sndfile, write_error) {
+    const int channels = 2;
+    const std::vector<short> samples = makeRamp(channels * 1000);
+    const std::string path = tempPath("sndfile_write_error");
+    SF_INFO info;
+    memset(&info, 0, sizeof(info));
+    info.samplerate = 48000;
+    info.channels = channels;
+    info.format = SF_FORMAT_WAV | SF_FORMAT_PCM_16;
+    SNDFILE *handle = sf_open(path.c_str(), SFM_WRITE, &info);
+    ASSERT_TRUE(handle != NULL);
+    ASSERT_EQ(0, sf_set_write_buffer(handle, 100, SF_WRITE_BACKGROUND));
+
+    // writes beyond the file size limit fail with EFBIG, instead of raising SIGXFSZ
+    struct rlimit limit;
+    ASSERT_EQ(0, getrlimit(RLIMIT_FSIZE, &limit));
+    struct rlimit small = limit;
+    small.rlim_cur = 16384;
+    sighandler_t handler = signal(SIGXFSZ, SIG_IGN);
+    ASSERT_EQ(0, setrlimit(RLIMIT_FSIZE, &small));
+    sf_count_t written = 0;
+    for (int i = 0; i < 100; ++i) {
+        written = sf_writef_short(handle, &samples[0], samples.size() / channels);
+        if (written == 0) {
+            break;
+        }
+    }
+    EXPECT_EQ(0, written);
+    sf_close(handle);
+    EXPECT_EQ(0, setrlimit(RLIMIT_FSIZE, &limit));
+    signal(SIGXFSZ, handler);
+    unlink(path.c_str());
+}
+
+TEST(audio_utils_sndfile, view) {
+    const int channels = 2;
+    const std::vector<short> samples = makeRamp(channels * 5000);
+    const std::string path = tempPath("sndfile_view");
+    writeFile(path, SF_FORMAT_PCM_16, channels, samples, -1 /*bufferFlags*/);
+    SF_INFO info;
+    SNDFILE *handle = sf_open(path.c_str(), SFM_READ, &info);
+    ASSERT_TRUE(handle != NULL);
+    const void *view;
+    EXPECT_EQ(0, sf_readf_view(handle, &view, 1));  // only for mapped files
+    sf_close(handle);
+
+    handle = sf_open(path.c_str(), SFM_READ | SFM_MMAP, &info);
+    ASSERT_TRUE(handle != NULL);
+    short frame[channels];
+    ASSERT_EQ(1, sf_readf_short(handle, frame, 1));
+    ASSERT_EQ(4999, sf_readf_view(handle, &view, 6000));
+    EXPECT_EQ(0, memcmp(view, &samples[channels], (samples.size() - channels) * sizeof(short)));
+    EXPECT_EQ(0, sf_readf_view(handle, &view, 1));
+    sf_close(handle);
+    unlink(path.c_str());
+}
+
+TEST(audio_utils_sndfile, seek) {
+    const int channels = 2;
+    const std::vector<short> samples = makeRamp(channels * 5000);
+    const std::string path = tempPath("sndfile_seek");
+    writeFile(path, SF_FORMAT_PCM_16, channels, samples, -1 /*bufferFlags*/);
+    for (int mode = SFM_READ; mode <= (SFM_READ | SFM_MMAP); mode += SFM_MMAP) {
+        SF_INFO info;
+        SNDFILE *handle = sf_open(path.c_str(), mode, &info);
+        ASSERT_TRUE(handle != NULL);
+        EXPECT_EQ(-1, sf_seek(handle, -1, SEEK_SET));
+        EXPECT_EQ(-1, sf_seek(handle, 1, SEEK_END));
+        EXPECT_EQ(4000, sf_seek(handle, -1000, SEEK_END));
+        EXPECT_EQ(4100, sf_seek(handle, 100, SEEK_CUR));
+        short frame[channels];
+        ASSERT_EQ(1, sf_readf_short(handle, frame, 1));
+        EXPECT_EQ(samples[4100 * channels], frame[0]);
+        EXPECT_EQ(4101, sf_seek(handle, 0, SEEK_CUR));
+
+        std::vector<short> range(300 * channels);
+        ASSERT_EQ(300, sf_preadf_short(handle, &range[0], 300, 1234));
+        EXPECT_TRUE(std::equal(range.begin(), range.end(), samples.begin() + 1234 * channels));
+        EXPECT_EQ(1534, sf_seek(handle, 0, SEEK_CUR));
+        EXPECT_EQ(100, sf_preadf_short(handle, &range[0], 300, 4900));
+        EXPECT_EQ(0, sf_preadf_short(handle, &range[0], 300, 5001));
+
+        if (mode & SFM_MMAP) {
+            const void *view;
+            ASSERT_EQ(0, sf_seek(handle, 0, SEEK_SET));
+            ASSERT_EQ(5000, sf_readf_view(handle, &view, 6000));
+            EXPECT_EQ(0, memcmp(view, &samples[0], samples.size() * sizeof(short)));
+            EXPECT_EQ(0, sf_readf_view(handle, &view, 1));
+        }
+        sf_close(handle);
+    }
+    unlink(path.c_str());
+}
+
+TEST(audio_utils_sndfile, high_resolution) {
+    // float and int frames are converted in one pass to and from packed 24-bit and float files
+    const int channels = 2;
+    const size_t frames = 4001;
+    std::vector<int> ints(channels * frames);
+    std::vector<float> floats(ints.size());
+    for (size_t i = 0; i < ints.size(); ++i) {
+        ints[i] = (int) ((i * 2654435761u) & 0xffffff00);   // 24 significant bits
+        floats[i] = ints[i] / 2147483648.f;
+    }
+    const std::string path = tempPath("sndfile_high_resolution");
+    const int formats[] = { SF_FORMAT_PCM_24, SF_FORMAT_PCM_32, SF_FORMAT_FLOAT };
+    for (int format : formats) {
+        for (int useFloat = 0; useFloat <= 1; ++useFloat) {
+            SF_INFO info = { 0, 96000, channels, SF_FORMAT_WAV | format };
+            SNDFILE *handle = sf_open(path.c_str(), SFM_WRITE, &info);
+            ASSERT_TRUE(handle != NULL);
+            ASSERT_EQ((sf_count_t) frames, useFloat ?
+                    sf_writef_float(handle, &floats[0], frames) :
+                    sf_writef_int(handle, &ints[0], frames));
+            sf_close(handle);
+
+            handle = sf_open(path.c_str(), SFM_READ | SFM_MMAP, &info);
+            ASSERT_TRUE(handle != NULL);
+            std::vector<int> readInts(ints.size());
+            std::vector<float> readFloats(floats.size());
+            ASSERT_EQ((sf_count_t) frames, sf_readf_int(handle, &readInts[0], frames));
+            ASSERT_EQ((sf_count_t) frames,
+                    sf_preadf_float(handle, &readFloats[0], frames, 0 /*offset*/));
+            for (size_t i = 0; i < ints.size(); ++i) {
+                // 24 bits survive every path, except rounding of full scale from float
+                ASSERT_NEAR(ints[i], readInts[i], 256) << "format=" << format << " i=" << i;
+                ASSERT_NEAR(floats[i], readFloats[i], 1. / (1 << 23)) << "format=" << format;
+            }
+            sf_close(handle);
+        }
+    }
+    unlink(path.c_str());
+}
+
+TEST(audio_utils_sndfile, many_channels) {
+    // multichannel capture, where a frame straddles two write buffers with direct I/O
+    const std::string path = tempPath("sndfile_many_channels");
+    const int channelCounts[] = { 32, 33, SF_MAX_CHANNELS };
+    const int formats[] = { SF_FORMAT_PCM_16, SF_FORMAT_FLOAT };
+    for (int channels : channelCounts) {
+        const std::vector<short> samples = makeRamp(channels * 3001);
+        for (int format : formats) {
+            for (int flags : { -1, 0, SF_WRITE_DIRECT }) {
+                writeFile(path, format, channels, samples, flags);
+                SF_INFO info;
+                SNDFILE *handle = sf_open(path.c_str(), SFM_READ, &info);
+                ASSERT_TRUE(handle != NULL);
+                EXPECT_EQ(channels, info.channels);
+                ASSERT_EQ((sf_count_t) (samples.size() / channels), info.frames);
+                std::vector<short> read(samples.size());
+                EXPECT_EQ(info.frames, sf_readf_short(handle, &read[0], info.frames));
+                EXPECT_EQ(samples, read) << "channels=" << channels << " format=" << format
+                        << " flags=" << flags;
+                sf_close(handle);
+            }
+        }
+    }
+    SF_INFO info = { 0, 48000, SF_MAX_CHANNELS + 1, SF_FORMAT_WAV | SF_FORMAT_PCM_16 };
+    EXPECT_TRUE(sf_open(path.c_str(), SFM_WRITE, &info) == NULL);
+    unlink(path.c_str());
+}
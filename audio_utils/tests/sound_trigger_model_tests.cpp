@@ -0,0 +1,148 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "audio_utils_sound_trigger_model_tests"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+#include <gtest/gtest.h>
+#include <audio_utils/sound_trigger_model.h>
+
+static std::vector<uint8_t> makeData(size_t size)
+{
+    std::vector<uint8_t> data(size);
+    for (size_t i = 0; i < size; ++i) {
+        data[i] = (uint8_t)(i * 7 + 3);
+    }
+    return data;
+}
+
+static struct sound_trigger_phrase_sound_model makePhraseHeader()
+{
+    struct sound_trigger_phrase_sound_model header;
+    memset(&header, 0, sizeof(header));
+    header.common.type = SOUND_MODEL_TYPE_KEYPHRASE;
+    header.common.uuid.timeLow = 0x12345678;
+    header.num_phrases = 1;
+    header.phrases[0].id = 3;
+    header.phrases[0].recognition_mode = RECOGNITION_MODE_VOICE_TRIGGER;
+    header.phrases[0].num_users = 1;
+    strcpy(header.phrases[0].locale, "en_US");
+    strcpy(header.phrases[0].text, "hello");
+    return header;
+}
+
+TEST(audio_utils_sound_trigger_model, create) {
+    const std::vector<uint8_t> data = makeData(1000);
+    struct sound_trigger_phrase_sound_model header = makePhraseHeader();
+    struct sound_trigger_sound_model *model =
+            sound_trigger_sound_model_create(&header.common, data.data(), data.size());
+    ASSERT_NE(nullptr, model);
+    EXPECT_EQ(sizeof(header), model->data_offset);
+    EXPECT_EQ(data.size(), model->data_size);
+    EXPECT_EQ(sizeof(header) + data.size(), sound_trigger_sound_model_size(model));
+    EXPECT_EQ(0, memcmp(data.data(), (uint8_t *)model + model->data_offset, data.size()));
+    const struct sound_trigger_phrase_sound_model *phraseModel =
+            (const struct sound_trigger_phrase_sound_model *)model;
+    EXPECT_STREQ("hello", phraseModel->phrases[0].text);
+    EXPECT_EQ(0, sound_trigger_sound_model_validate(model, sound_trigger_sound_model_size(model)));
+    EXPECT_EQ(-EINVAL, sound_trigger_sound_model_validate(model,
+            sound_trigger_sound_model_size(model) - 1));
+    EXPECT_EQ(-EINVAL, sound_trigger_sound_model_validate(model,
+            sound_trigger_sound_model_size(model) + 1));
+    free(model);
+
+    struct sound_trigger_generic_sound_model generic;
+    memset(&generic, 0, sizeof(generic));
+    generic.common.type = SOUND_MODEL_TYPE_GENERIC;
+    model = sound_trigger_sound_model_create(&generic.common, nullptr, 0);
+    ASSERT_NE(nullptr, model);
+    EXPECT_EQ(sizeof(generic), sound_trigger_sound_model_size(model));
+    free(model);
+
+    // invalid headers are rejected
+    generic.common.type = SOUND_MODEL_TYPE_UNKNOWN;
+    EXPECT_EQ(nullptr, sound_trigger_sound_model_create(&generic.common, nullptr, 0));
+    header.num_phrases = SOUND_TRIGGER_MAX_PHRASES + 1;
+    EXPECT_EQ(nullptr, sound_trigger_sound_model_create(&header.common, nullptr, 0));
+    header = makePhraseHeader();
+    memset(header.phrases[0].text, 'a', sizeof(header.phrases[0].text));
+    EXPECT_EQ(nullptr, sound_trigger_sound_model_create(&header.common, nullptr, 0));
+    header = makePhraseHeader();
+    header.phrases[0].num_users = SOUND_TRIGGER_MAX_USERS + 1;
+    EXPECT_EQ(nullptr, sound_trigger_sound_model_create(&header.common, nullptr, 0));
+    EXPECT_EQ(nullptr, sound_trigger_sound_model_create(&header.common, nullptr, 1));
+}
+
+TEST(audio_utils_sound_trigger_model, map) {
+    const std::vector<uint8_t> data = makeData(100000);
+    struct sound_trigger_phrase_sound_model header = makePhraseHeader();
+
+    // a blob with a gap before its data is written compact
+    const size_t gap = 24;
+    std::vector<uint8_t> sparse(sizeof(header) + gap + data.size());
+    header.common.data_offset = sizeof(header) + gap;
+    header.common.data_size = data.size();
+    memcpy(sparse.data(), &header, sizeof(header));
+    memcpy(sparse.data() + sizeof(header) + gap, data.data(), data.size());
+    const struct sound_trigger_sound_model *sparseModel =
+            (const struct sound_trigger_sound_model *)sparse.data();
+    ASSERT_EQ(0, sound_trigger_sound_model_validate(sparseModel, sparse.size()));
+
+    FILE *file = tmpfile();
+    ASSERT_NE(nullptr, file);
+    const int fd = fileno(file);
+    ASSERT_EQ(0, sound_trigger_sound_model_write(sparseModel, fd));
+
+    const struct sound_trigger_sound_model *mapped = sound_trigger_sound_model_map(fd);
+    ASSERT_NE(nullptr, mapped);
+    EXPECT_EQ(SOUND_MODEL_TYPE_KEYPHRASE, mapped->type);
+    EXPECT_EQ(sizeof(header), mapped->data_offset);
+    EXPECT_EQ(data.size(), mapped->data_size);
+    EXPECT_EQ(0, memcmp(data.data(), (const uint8_t *)mapped + mapped->data_offset,
+            data.size()));
+    EXPECT_EQ(0x12345678u, mapped->uuid.timeLow);
+    EXPECT_STREQ("en_US",
+            ((const struct sound_trigger_phrase_sound_model *)mapped)->phrases[0].locale);
+    sound_trigger_sound_model_unmap(mapped);
+    sound_trigger_sound_model_unmap(nullptr);
+
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/self/fd/%d", fd);
+    mapped = sound_trigger_sound_model_map_file(path);
+    ASSERT_NE(nullptr, mapped);
+    EXPECT_EQ(data.size(), mapped->data_size);
+    sound_trigger_sound_model_unmap(mapped);
+
+    // a truncated or padded file is rejected
+    const off_t size = sizeof(header) + data.size();
+    ASSERT_EQ(0, ftruncate(fd, size - 1));
+    EXPECT_EQ(nullptr, sound_trigger_sound_model_map(fd));
+    ASSERT_EQ(0, ftruncate(fd, size + 1));
+    EXPECT_EQ(nullptr, sound_trigger_sound_model_map(fd));
+    ASSERT_EQ(0, ftruncate(fd, 0));
+    EXPECT_EQ(nullptr, sound_trigger_sound_model_map(fd));
+    EXPECT_EQ(nullptr, sound_trigger_sound_model_map(-1));
+    EXPECT_EQ(nullptr, sound_trigger_sound_model_map_file("/nonexistent/sound_model"));
+    EXPECT_EQ(-EINVAL, sound_trigger_sound_model_write(nullptr, fd));
+
+    fclose(file);
+}
@@ -0,0 +1,519 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "audio_utils_spdif_tests"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include <gtest/gtest.h>
+#include <audio_utils/spdif/SPDIFDecoder.h>
+#include <audio_utils/spdif/SPDIFEncoder.h>
+#include "../spdif/BitFieldParser.h"
+#include "../spdif/DTSFrameScanner.h"
+
+using namespace android;
+
+typedef std::vector<uint8_t> Frame;
+
+class TestEncoder : public SPDIFEncoder {
+public:
+    explicit TestEncoder(audio_format_t format) : SPDIFEncoder(format) {}
+    virtual ssize_t writeOutput(const void *buffer, size_t numBytes) {
+        const uint8_t *bytes = (const uint8_t *) buffer;
+        mOutput.insert(mOutput.end(), bytes, bytes + numBytes);
+        return numBytes;
+    }
+    std::vector<uint8_t> mOutput;
+};
+
+// Assembles the bursts in its own buffer, which is filled with garbage beforehand.
+class ZeroCopyEncoder : public TestEncoder {
+public:
+    explicit ZeroCopyEncoder(audio_format_t format) : TestEncoder(format) {}
+    virtual ssize_t writeOutput(const void * /* buffer */, size_t numBytes) {
+        ADD_FAILURE() << "writeOutput() of " << numBytes << " bytes";
+        return numBytes;
+    }
+    virtual void *obtainOutputBuffer(size_t numBytes) {
+        EXPECT_TRUE(mBuffer.empty()) << "burst not released";
+        mBuffer.assign(numBytes / sizeof(uint16_t), 0xA5A5);
+        return &mBuffer[0];
+    }
+    virtual ssize_t releaseOutputBuffer(size_t numBytes) {
+        EXPECT_FALSE(mBuffer.empty()) << "burst not obtained";
+        EXPECT_LE(numBytes, mBuffer.size() * sizeof(uint16_t));
+        const uint8_t *bytes = (const uint8_t *) &mBuffer[0];
+        mOutput.insert(mOutput.end(), bytes, bytes + numBytes);
+        mBuffer.clear();
+        mDiscarded += numBytes == 0;
+        return numBytes;
+    }
+    std::vector<uint16_t> mBuffer;
+    size_t mDiscarded = 0;
+};
+
+class TestDecoder : public SPDIFDecoder {
+public:
+    explicit TestDecoder(audio_format_t format) : SPDIFDecoder(format) {}
+    virtual ssize_t writeOutput(const void *buffer, size_t numBytes) {
+        const uint8_t *bytes = (const uint8_t *) buffer;
+        mFrames.push_back(Frame(bytes, bytes + numBytes));
+        return numBytes;
+    }
+    std::vector<Frame> mFrames;
+};
+
+// 48 kHz AC3 frame with random contents, sizes from AC3 spec table 5.13
+static Frame makeAC3Frame()
+{
+    static const uint16_t kWords[19] = {
+        64, 80, 96, 112, 128, 160, 192, 224, 256, 320,
+        384, 448, 512, 640, 768, 896, 1024, 1152, 1280 };
+    const int frmsizcod = rand() % 38;
+    Frame frame(kWords[frmsizcod / 2] * sizeof(uint16_t));
+    for (size_t i = 0; i < frame.size(); ++i) {
+        frame[i] = rand();
+    }
+    frame[0] = 0x0B;
+    frame[1] = 0x77;
+    frame[4] = frmsizcod;       // fscod 0 for 48 kHz
+    frame[5] = (8 << 3) | 1;    // bsid 8, bsmod 1
+    return frame;
+}
+
+// 48 kHz E-AC3 frame of 6 audio blocks on substream 0, with random contents
+static Frame makeEAC3Frame()
+{
+    const size_t words = 100 + rand() % 300;
+    Frame frame(words * sizeof(uint16_t));
+    for (size_t i = 0; i < frame.size(); ++i) {
+        frame[i] = rand();
+    }
+    frame[0] = 0x0B;
+    frame[1] = 0x77;
+    frame[2] = (words - 1) >> 8;    // strmtyp 0, substreamid 0
+    frame[3] = (words - 1) & 0xFF;
+    frame[4] = 3 << 4;              // fscod 0, numblkscod 3
+    frame[5] = 16 << 3;             // bsid 16
+    return frame;
+}
+
+// ADTS frame with random contents, of one raw data block
+static Frame makeADTSFrame(int samplingFrequencyIndex)
+{
+    Frame frame(100 + rand() % 1500);
+    for (size_t i = 0; i < frame.size(); ++i) {
+        frame[i] = rand();
+    }
+    frame[0] = 0xFF;
+    frame[1] = 0xF1;                                    // MPEG-4, no CRC
+    frame[2] = (1 << 6) | (samplingFrequencyIndex << 2); // LC, mono
+    frame[3] = (1 << 6) | (frame.size() >> 11);
+    frame[4] = frame.size() >> 3;
+    frame[5] = ((frame.size() & 7) << 5) | 0x1F;
+    frame[6] = 0xFC;                                     // 1 raw data block
+    return frame;
+}
+
+// TrueHD access unit with random contents, with a 48 kHz major sync if requested
+static Frame makeTrueHDUnit(bool majorSync)
+{
+    const size_t words = 50 + rand() % 1000;
+    Frame frame(words * sizeof(uint16_t));
+    for (size_t i = 0; i < frame.size(); ++i) {
+        frame[i] = rand();
+    }
+    frame[0] = (frame[0] & 0xF0) | (words >> 8);
+    frame[1] = words & 0xFF;
+    if (majorSync) {
+        const uint8_t sync[] = { 0xF8, 0x72, 0x6F, 0xBA, 0x00 };
+        memcpy(&frame[4], sync, sizeof(sync));
+    } else if (frame[4] == 0xF8) {
+        frame[4] = 0; // avoid a false major sync
+    }
+    return frame;
+}
+
+// Encode frames, then decode them in chunks of random size, similar to capture periods.
+static void checkRoundTrip(audio_format_t format, const std::vector<Frame> &frames,
+        size_t maxChunk, uint32_t sampleRate = 48000)
+{
+    TestEncoder encoder(format);
+    for (const Frame &frame : frames) {
+        ASSERT_EQ((ssize_t) frame.size(), encoder.write(&frame[0], frame.size()));
+    }
+    std::vector<uint8_t> &burst = encoder.mOutput;
+    ASSERT_GT(burst.size(), 0u);
+    ASSERT_EQ(0u, burst.size() % encoder.getBytesPerOutputFrame());
+
+    const SPDIFEncoder::Stats stats = encoder.getStats();
+    size_t totalBytes = 0;
+    for (const Frame &frame : frames) {
+        totalBytes += frame.size();
+    }
+    EXPECT_EQ(totalBytes, stats.bytesWritten);
+    EXPECT_EQ(0u, stats.bytesSkipped);
+    EXPECT_EQ(frames.size(), stats.syncFrames);
+    EXPECT_EQ(burst.size(), stats.burstBytes);
+    EXPECT_EQ(stats.burstBytes, stats.bursts * 8 + stats.payloadBytes + stats.zeroPadBytes);
+    EXPECT_EQ(0u, stats.overflows);
+    EXPECT_GE(stats.maxFramesInBurst, 1u);
+
+    TestDecoder decoder(format);
+    std::vector<uint16_t> chunk; // writes need whole, aligned shorts
+    for (size_t offset = 0, count; offset < burst.size(); offset += count) {
+        count = std::min(burst.size() - offset, (rand() % maxChunk + 1) * sizeof(uint16_t));
+        chunk.resize(count / sizeof(uint16_t));
+        memcpy(&chunk[0], &burst[offset], count);
+        ASSERT_EQ((ssize_t) count, decoder.write(&chunk[0], count));
+    }
+    EXPECT_EQ(sampleRate, decoder.getSampleRate());
+    // E-AC3 frames are only sent when the next burst starts, so some are still in the encoder.
+    ASSERT_LE(decoder.mFrames.size(), frames.size());
+    ASSERT_GE(decoder.mFrames.size() + 8, frames.size());
+    for (size_t i = 0; i < decoder.mFrames.size(); ++i) {
+        ASSERT_EQ(frames[i], decoder.mFrames[i]) << "frame " << i;
+    }
+    EXPECT_EQ(encoder.getRateMultiplier(), decoder.getRateMultiplier());
+}
+
+TEST(audio_utils_spdif, ac3) {
+    srand(1);
+    std::vector<Frame> frames;
+    for (int i = 0; i < 100; ++i) {
+        frames.push_back(makeAC3Frame());
+    }
+    // bursts inside one write, and across many
+    checkRoundTrip(AUDIO_FORMAT_AC3, frames, 20000);
+    checkRoundTrip(AUDIO_FORMAT_AC3, frames, 100);
+    checkRoundTrip(AUDIO_FORMAT_AC3, frames, 1);
+}
+
+TEST(audio_utils_spdif, eac3) {
+    srand(2);
+    std::vector<Frame> frames;
+    for (int i = 0; i < 100; ++i) {
+        frames.push_back(makeEAC3Frame());
+    }
+    checkRoundTrip(AUDIO_FORMAT_E_AC3, frames, 100000);
+    checkRoundTrip(AUDIO_FORMAT_E_AC3, frames, 333);
+}
+
+TEST(audio_utils_spdif, aac) {
+    srand(3);
+    std::vector<Frame> frames;
+    for (int i = 0; i < 100; ++i) {
+        frames.push_back(makeADTSFrame(3));
+    }
+    checkRoundTrip(AUDIO_FORMAT_AAC_ADTS_LC, frames, 1000);
+
+    // 24 kHz is sent at twice the rate, in bursts of 2048 frames
+    frames.clear();
+    for (int i = 0; i < 50; ++i) {
+        frames.push_back(makeADTSFrame(6));
+    }
+    checkRoundTrip(AUDIO_FORMAT_AAC_ADTS, frames, 777, 24000);
+    TestEncoder encoder(AUDIO_FORMAT_AAC_ADTS);
+    encoder.write(&frames[0][0], frames[0].size());
+    EXPECT_EQ(2u, encoder.getRateMultiplier());
+    EXPECT_EQ(2048u * 4, encoder.mOutput.size());
+}
+
+TEST(audio_utils_spdif, truehd) {
+    srand(4);
+    std::vector<Frame> units;
+    for (int i = 0; i < 24 * 3 + 5; ++i) {
+        units.push_back(makeTrueHDUnit(i % 16 == 0));
+    }
+    TestEncoder encoder(AUDIO_FORMAT_DOLBY_TRUEHD);
+    for (const Frame &unit : units) {
+        // the first unit is split so that the major sync spans writes
+        const size_t split = &unit == &units[0] ? 6 : 0;
+        encoder.write(&unit[0], split);
+        encoder.write(&unit[split], unit.size() - split);
+    }
+    EXPECT_EQ(16u, encoder.getRateMultiplier());
+    EXPECT_EQ(24u, encoder.getStats().maxFramesInBurst);
+    FILE *dump = tmpfile();
+    ASSERT_TRUE(dump != NULL);
+    encoder.dump(fileno(dump));
+    EXPECT_GT(ftell(dump), 0);
+    fclose(dump);
+
+    // three complete MAT frames, with each unit in its slot
+    const size_t burstSize = 61440;
+    ASSERT_EQ(3 * burstSize, encoder.mOutput.size());
+    static const uint8_t kMiddleCode[] = { 0xC3, 0xC1, 0x42, 0x49 };
+    for (size_t burst = 0; burst < 3; ++burst) {
+        std::vector<uint8_t> bytes(&encoder.mOutput[burst * burstSize],
+                &encoder.mOutput[(burst + 1) * burstSize]);
+        const uint16_t *shorts = (const uint16_t *) &bytes[0];
+        ASSERT_EQ(SPDIFEncoder::kSPDIFSync1, shorts[0]);
+        ASSERT_EQ(SPDIFEncoder::kSPDIFSync2, shorts[1]);
+        EXPECT_EQ(22, shorts[2] & 0x7F);
+        EXPECT_EQ(61424, shorts[3]);
+        // back to stream byte order
+        for (size_t i = 0; i < bytes.size(); i += 2) {
+            std::swap(bytes[i], bytes[i + 1]);
+        }
+        EXPECT_EQ(0x07, bytes[8]);
+        EXPECT_EQ(0x9E, bytes[9]);
+        EXPECT_EQ(0, memcmp(&bytes[30716], kMiddleCode, sizeof(kMiddleCode)));
+        EXPECT_EQ(0xC3, bytes[61416]);
+        EXPECT_EQ(0xC2, bytes[61417]);
+        for (size_t k = 0; k < 24; ++k) {
+            const size_t slot = k == 0 ? 28 : k == 12 ? 30728 : k * 2560;
+            const Frame &unit = units[burst * 24 + k];
+            ASSERT_EQ(0, memcmp(&bytes[slot], &unit[0], unit.size())) << "unit " << k;
+        }
+    }
+}
+
+// Write frames in chunks of random size, not aligned to the frames or to shorts.
+static void writeFrames(SPDIFEncoder *encoder, const std::vector<Frame> &frames, size_t maxChunk)
+{
+    std::vector<uint8_t> stream;
+    for (const Frame &frame : frames) {
+        stream.insert(stream.end(), frame.begin(), frame.end());
+    }
+    for (size_t offset = 0, count; offset < stream.size(); offset += count) {
+        count = std::min(stream.size() - offset, rand() % maxChunk + 1);
+        ASSERT_EQ((ssize_t) count, encoder->write(&stream[offset], count));
+    }
+}
+
+// Bursts assembled in the subclass buffer are the same as those copied by writeOutput().
+static void checkOutputBuffer(audio_format_t format, const std::vector<Frame> &frames)
+{
+    for (size_t maxChunk : { 1, 7, 1001, 100000 }) {
+        TestEncoder copying(format);
+        writeFrames(&copying, frames, maxChunk);
+        ZeroCopyEncoder direct(format);
+        writeFrames(&direct, frames, maxChunk);
+        ASSERT_GT(copying.mOutput.size(), 0u);
+        ASSERT_EQ(copying.mOutput.size(), direct.mOutput.size()) << maxChunk;
+        EXPECT_TRUE(copying.mOutput == direct.mOutput) << maxChunk;
+        EXPECT_EQ(0u, direct.mDiscarded);
+        EXPECT_EQ(copying.getStats().bursts, direct.getStats().bursts);
+        EXPECT_EQ(copying.getStats().zeroPadBytes, direct.getStats().zeroPadBytes);
+
+        // a burst in progress is given back empty
+        if (!direct.mBuffer.empty()) {
+            direct.reset();
+            EXPECT_TRUE(direct.mBuffer.empty());
+            EXPECT_EQ(1u, direct.mDiscarded);
+            EXPECT_EQ(copying.mOutput.size(), direct.mOutput.size());
+        }
+    }
+}
+
+TEST(audio_utils_spdif, output_buffer) {
+    srand(5);
+    std::vector<Frame> frames;
+    for (int i = 0; i < 20; ++i) {
+        frames.push_back(makeAC3Frame());
+    }
+    checkOutputBuffer(AUDIO_FORMAT_AC3, frames);
+
+    frames.clear();
+    for (int i = 0; i < 20; ++i) {
+        frames.push_back(makeEAC3Frame());
+    }
+    checkOutputBuffer(AUDIO_FORMAT_E_AC3, frames);
+
+    // odd frame sizes, which end the payload in the middle of a short
+    frames.clear();
+    for (int i = 0; i < 20; ++i) {
+        frames.push_back(makeADTSFrame(3));
+    }
+    checkOutputBuffer(AUDIO_FORMAT_AAC_ADTS_LC, frames);
+
+    frames.clear();
+    for (int i = 0; i < 24 * 2 + 5; ++i) {
+        frames.push_back(makeTrueHDUnit(i % 16 == 0));
+    }
+    checkOutputBuffer(AUDIO_FORMAT_DOLBY_TRUEHD, frames);
+}
+
+// Bit numBit of data, counting from the MSB of the first byte, or zero past the end.
+static uint32_t referenceBit(const Frame &data, size_t numBit)
+{
+    return numBit / 8 < data.size() ? (data[numBit / 8] >> (7 - numBit % 8)) & 1 : 0;
+}
+
+static uint32_t referenceBits(const Frame &data, size_t cursor, uint32_t numBits)
+{
+    uint32_t bits = 0;
+    for (uint32_t i = 0; i < numBits; ++i) {
+        bits = (bits << 1) | referenceBit(data, cursor + i);
+    }
+    return bits;
+}
+
+TEST(audio_utils_spdif, bit_field_parser) {
+    srand(6);
+    // short enough for the byte at a time refill, and long enough for the 64-bit one
+    for (size_t size : { 0, 1, 3, 7, 8, 9, 15, 16, 17, 33, 100 }) {
+        Frame data(size);
+        for (size_t i = 0; i < size; ++i) {
+            data[i] = rand();
+        }
+        for (int pass = 0; pass < 20; ++pass) {
+            BitFieldParser parser(data.data(), data.size());
+            size_t cursor = 0;
+            // reads and skips of any length and alignment, until well past the end
+            while (cursor < size * 8 + 100) {
+                const uint32_t numBits = rand() % 33;
+                switch (rand() % 3) {
+                case 0:
+                    ASSERT_EQ(referenceBits(data, cursor, numBits), parser.readBits(numBits))
+                            << "size " << size << " cursor " << cursor << " bits " << numBits;
+                    cursor += numBits;
+                    break;
+                case 1:
+                    ASSERT_EQ(referenceBits(data, cursor, numBits), parser.peekBits(numBits))
+                            << "size " << size << " cursor " << cursor << " bits " << numBits;
+                    break;
+                default: {
+                    const uint32_t skip = rand() % 100;
+                    parser.skipBits(skip);
+                    cursor += skip;
+                    break;
+                }
+                }
+                ASSERT_EQ(cursor, parser.getBitCursor());
+            }
+        }
+    }
+
+    // 32-bit fields across bytes, and the end of the data
+    const Frame data = { 0x12, 0x34, 0x56, 0x78, 0x9A, 0xBC, 0xDE, 0xF0, 0x0F };
+    BitFieldParser parser(data.data(), data.size());
+    EXPECT_EQ(0x1u, parser.readBits(4));
+    EXPECT_EQ(0x23456789u, parser.readBits(32));
+    EXPECT_EQ(0xABCDEF00u, parser.readBits(32));
+    EXPECT_EQ(0xF0000000u, parser.peekBits(32));
+    EXPECT_EQ(0xFu, parser.readBits(4));
+    EXPECT_EQ(0u, parser.readBits(32));
+    EXPECT_EQ(104u, parser.getBitCursor());
+}
+
+// DTS core frame header, with fields of the widths of the DTS spec 5.3.1
+static Frame makeDTSHeader(uint32_t cpf, uint32_t nblks, uint32_t fsize, uint32_t sfreq)
+{
+    const struct { uint32_t value; uint32_t bits; } fields[] = {
+        { 1, 1 },       // ftype, normal frame
+        { 31, 5 },      // deficit
+        { cpf, 1 },
+        { nblks, 7 },
+        { fsize, 14 },
+        { 2, 6 },       // amode, stereo
+        { sfreq, 4 },
+    };
+    Frame header = { 0x7F, 0xFE, 0x80, 0x01 };
+    header.resize(12);
+    size_t cursor = 32;
+    for (const auto &field : fields) {
+        for (uint32_t i = 0; i < field.bits; ++i, ++cursor) {
+            if ((field.value >> (field.bits - 1 - i)) & 1) {
+                header[cursor / 8] |= 0x80 >> (cursor % 8);
+            }
+        }
+    }
+    return header;
+}
+
+TEST(audio_utils_spdif, dts_frame_scanner) {
+    static const struct {
+        uint32_t nblks;
+        uint32_t fsize;
+        uint32_t sfreq;
+        uint32_t sampleRate;
+        int dataType;
+    } kHeaders[] = {
+        { 15, 1023, 13, 48000, 11 },    // 512 frames, DTS type I
+        { 31, 2047, 8, 44100, 12 },     // 1024 frames, type II
+        { 63, 4095, 12, 24000, 13 },    // 2048 frames, type III
+        { 127, 16383, 3, 32000, 17 },   // 4096 frames, type IV
+        { 5, 95, 1, 8000, 11 },         // the smallest frame allowed
+    };
+    for (const auto &h : kHeaders) {
+        const Frame header = makeDTSHeader(0, h.nblks, h.fsize, h.sfreq);
+        // after some garbage, and split in two
+        Frame stream = { 0x00, 0xFE, 0x80, 0x01, 0x55 };
+        stream.insert(stream.end(), header.begin(), header.end());
+        DTSFrameScanner scanner;
+        bool found = false;
+        const size_t split = 8;
+        EXPECT_EQ(split, scanner.scan(stream.data(), split, &found));
+        EXPECT_FALSE(found);
+        EXPECT_EQ(stream.size() - split,
+                scanner.scan(&stream[split], stream.size() - split, &found));
+        ASSERT_TRUE(found) << h.nblks;
+        EXPECT_EQ(5u, scanner.getBytesSkipped());
+        EXPECT_EQ(h.sampleRate, scanner.getSampleRate());
+        EXPECT_EQ(1u, scanner.getRateMultiplier());
+        EXPECT_EQ(h.fsize + 1, scanner.getFrameSizeBytes());
+        EXPECT_EQ((int) (h.nblks + 1) * 32, scanner.getSampleFramesPerSyncFrame());
+        EXPECT_EQ(h.dataType, scanner.getDataType());
+        EXPECT_EQ(0, memcmp(header.data(), scanner.getHeaderAddress(), header.size()));
+        EXPECT_EQ(header.size(), scanner.getHeaderSizeBytes());
+    }
+
+    // a compressed checksum, too few blocks, too small a frame, a reserved rate
+    const Frame invalid[] = {
+        makeDTSHeader(1, 15, 1023, 13),
+        makeDTSHeader(0, 4, 1023, 13),
+        makeDTSHeader(0, 15, 94, 13),
+        makeDTSHeader(0, 15, 1023, 0),
+        makeDTSHeader(0, 15, 1023, 14),
+    };
+    for (const Frame &header : invalid) {
+        DTSFrameScanner scanner;
+        bool found = true;
+        EXPECT_EQ(header.size(), scanner.scan(header.data(), header.size(), &found));
+        EXPECT_FALSE(found);
+    }
+}
+
+TEST(audio_utils_spdif, decoder) {
+    TestDecoder decoder(AUDIO_FORMAT_AC3);
+    uint16_t samples[16] = {};
+    EXPECT_EQ(-EINVAL, decoder.write(samples, 3));
+    EXPECT_EQ(-EINVAL, decoder.write((uint8_t *) samples + 1, 4));
+
+    // A pause burst and a burst of another format carry no frames.
+    samples[2] = SPDIFEncoder::kSPDIFSync1;
+    samples[3] = SPDIFEncoder::kSPDIFSync2;
+    samples[4] = 3;         // pause
+    samples[5] = 32;
+    samples[8] = SPDIFEncoder::kSPDIFSync1;
+    samples[9] = SPDIFEncoder::kSPDIFSync2;
+    samples[10] = 11;       // DTS type I
+    samples[11] = 32;
+    EXPECT_EQ((ssize_t) sizeof(samples), decoder.write(samples, sizeof(samples)));
+    EXPECT_EQ(0u, decoder.mFrames.size());
+    EXPECT_TRUE(SPDIFDecoder::isFormatSupported(AUDIO_FORMAT_E_AC3));
+    EXPECT_TRUE(SPDIFDecoder::isFormatSupported(AUDIO_FORMAT_AAC_ADTS_HE_V1));
+    EXPECT_FALSE(SPDIFDecoder::isFormatSupported(AUDIO_FORMAT_DOLBY_TRUEHD));
+    EXPECT_TRUE(SPDIFEncoder::isFormatSupported(AUDIO_FORMAT_DOLBY_TRUEHD));
+    EXPECT_FALSE(SPDIFDecoder::isFormatSupported(AUDIO_FORMAT_PCM_16_BIT));
+}
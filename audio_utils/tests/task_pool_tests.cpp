@@ -0,0 +1,176 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "audio_utils_task_pool_tests"
+
+#include <string.h>
+#include <atomic>
+#include <vector>
+#include <gtest/gtest.h>
+#include <audio_utils/fft.h>
+#include <audio_utils/fixedfft.h>
+#include <audio_utils/format.h>
+#include <audio_utils/task_pool.h>
+
+struct CountJob {
+    std::vector<std::atomic<int>> *visits;
+    size_t grain;
+    std::atomic<bool> *tooLarge;
+};
+
+static void countRange(void *arg, size_t begin, size_t end)
+{
+    CountJob *job = (CountJob *)arg;
+    if (begin >= end || end - begin > job->grain) {
+        *job->tooLarge = true;
+    }
+    for (size_t i = begin; i < end; ++i) {
+        ++(*job->visits)[i];
+    }
+}
+
+static void checkParallelFor(struct audio_utils_task_pool *pool, size_t count, size_t grain)
+{
+    std::vector<std::atomic<int>> visits(count);
+    for (auto &visit : visits) {
+        visit = 0;
+    }
+    std::atomic<bool> tooLarge(false);
+    CountJob job = { &visits, grain, &tooLarge };
+    audio_utils_task_pool_parallel_for(pool, count, grain, countRange, &job);
+    // with no worker threads or a single grain, the items are all processed in one call
+    if (pool != nullptr && audio_utils_task_pool_thread_count(pool) > 0 && count > grain) {
+        EXPECT_FALSE(tooLarge) << "count " << count << " grain " << grain;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        ASSERT_EQ(1, visits[i]) << "item " << i << " count " << count << " grain " << grain;
+    }
+}
+
+TEST(audio_utils_task_pool, parallel_for) {
+    struct audio_utils_task_pool_config config;
+    memset(&config, 0, sizeof(config));
+    config.thread_count = 3;
+    struct audio_utils_task_pool *pool = audio_utils_task_pool_create(&config);
+    ASSERT_NE(nullptr, pool);
+    EXPECT_EQ(3u, audio_utils_task_pool_thread_count(pool));
+
+    for (size_t count : { 0, 1, 5, 100, 1000, 100003 }) {
+        for (size_t grain : { 1, 3, 64, 4096 }) {
+            checkParallelFor(pool, count, grain);
+        }
+    }
+    checkParallelFor(nullptr, 1000, 7);
+    audio_utils_task_pool_destroy(pool);
+    audio_utils_task_pool_destroy(nullptr);
+}
+
+TEST(audio_utils_task_pool, placement) {
+    for (auto placement : { AUDIO_UTILS_TASK_POOL_PLACEMENT_ANY,
+            AUDIO_UTILS_TASK_POOL_PLACEMENT_BIG, AUDIO_UTILS_TASK_POOL_PLACEMENT_LITTLE }) {
+        for (bool pin : { false, true }) {
+            struct audio_utils_task_pool_config config;
+            memset(&config, 0, sizeof(config));
+            config.placement = placement;
+            config.pin_threads = pin;
+            struct audio_utils_task_pool *pool = audio_utils_task_pool_create(&config);
+            ASSERT_NE(nullptr, pool);
+            checkParallelFor(pool, 10000, 10);
+            audio_utils_task_pool_destroy(pool);
+        }
+    }
+    // the defaults
+    struct audio_utils_task_pool *pool = audio_utils_task_pool_create(nullptr);
+    ASSERT_NE(nullptr, pool);
+    checkParallelFor(pool, 10000, 10);
+    audio_utils_task_pool_destroy(pool);
+}
+
+TEST(audio_utils_task_pool, memcpy_by_audio_format) {
+    struct audio_utils_task_pool_config config;
+    memset(&config, 0, sizeof(config));
+    config.thread_count = 3;
+    struct audio_utils_task_pool *pool = audio_utils_task_pool_create(&config);
+    ASSERT_NE(nullptr, pool);
+
+    const size_t count = 100000;
+    std::vector<int16_t> src(count);
+    for (size_t i = 0; i < count; ++i) {
+        src[i] = (int16_t)(i * 37);
+    }
+    std::vector<float> expected(count), actual(count);
+    memcpy_by_audio_format(expected.data(), AUDIO_FORMAT_PCM_FLOAT,
+            src.data(), AUDIO_FORMAT_PCM_16_BIT, count);
+    audio_utils_task_pool_memcpy_by_audio_format(pool, actual.data(), AUDIO_FORMAT_PCM_FLOAT,
+            src.data(), AUDIO_FORMAT_PCM_16_BIT, count);
+    EXPECT_EQ(0, memcmp(expected.data(), actual.data(), count * sizeof(float)));
+
+    // in place, from a larger to a smaller sample size
+    std::vector<int16_t> back(count);
+    memcpy_by_audio_format(back.data(), AUDIO_FORMAT_PCM_16_BIT,
+            expected.data(), AUDIO_FORMAT_PCM_FLOAT, count);
+    audio_utils_task_pool_memcpy_by_audio_format(pool, actual.data(), AUDIO_FORMAT_PCM_16_BIT,
+            actual.data(), AUDIO_FORMAT_PCM_FLOAT, count);
+    EXPECT_EQ(0, memcmp(back.data(), actual.data(), count * sizeof(int16_t)));
+    EXPECT_EQ(0, memcmp(src.data(), back.data(), count * sizeof(int16_t)));
+
+    audio_utils_task_pool_destroy(pool);
+}
+
+TEST(audio_utils_task_pool, fft_batch) {
+    struct audio_utils_task_pool_config config;
+    memset(&config, 0, sizeof(config));
+    config.thread_count = 3;
+    struct audio_utils_task_pool *pool = audio_utils_task_pool_create(&config);
+    ASSERT_NE(nullptr, pool);
+
+    const size_t n = 256;
+    const size_t stride = 2 * n + 8;
+    const size_t count = 37;
+
+    std::vector<float> expected(stride * count);
+    for (size_t i = 0; i < expected.size(); ++i) {
+        expected[i] = (float)((i * 7919) % 1000) / 1000.f - 0.5f;
+    }
+    std::vector<float> actual(expected);
+    struct fft_float_plan *floatPlan = fft_float_plan_create(n);
+    ASSERT_NE(nullptr, floatPlan);
+    fft_float_complex_batch(floatPlan, expected.data(), count, stride, false);
+    audio_utils_task_pool_fft_float_complex_batch(pool, floatPlan, actual.data(), count, stride,
+            false);
+    EXPECT_EQ(0, memcmp(expected.data(), actual.data(), expected.size() * sizeof(float)));
+    fft_float_real_batch(floatPlan, expected.data(), count, stride, true);
+    audio_utils_task_pool_fft_float_real_batch(pool, floatPlan, actual.data(), count, stride,
+            true);
+    EXPECT_EQ(0, memcmp(expected.data(), actual.data(), expected.size() * sizeof(float)));
+    fft_float_plan_destroy(floatPlan);
+
+    std::vector<int32_t> fixedExpected(stride * count);
+    for (size_t i = 0; i < fixedExpected.size(); ++i) {
+        fixedExpected[i] = (int32_t)(((i * 7919) % 65536) << 16 | ((i * 104729) % 65536));
+    }
+    std::vector<int32_t> fixedActual(fixedExpected);
+    struct fixed_fft_plan *fixedPlan = fixed_fft_plan_create(n);
+    ASSERT_NE(nullptr, fixedPlan);
+    fixed_fft_real_batch(fixedPlan, fixedExpected.data(), count, stride);
+    audio_utils_task_pool_fixed_fft_real_batch(pool, fixedPlan, fixedActual.data(), count,
+            stride);
+    EXPECT_EQ(fixedExpected, fixedActual);
+    fixed_fft_plan_destroy(fixedPlan);
+
+    audio_utils_task_pool_destroy(pool);
+}
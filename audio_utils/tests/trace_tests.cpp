@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// The trace macros are tested here regardless of how the library was built.
+#define AUDIO_UTILS_TRACE 1
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string>
+#include <gtest/gtest.h>
+#include <audio_utils/trace.h>
+
+static std::string dump(enum audio_utils_trace_format format) {
+    FILE *file = tmpfile();
+    EXPECT_TRUE(file != NULL);
+    EXPECT_EQ(0, audio_utils_trace_dump(fileno(file), format));
+    std::string contents;
+    rewind(file);
+    char buffer[4096];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        contents.append(buffer, n);
+    }
+    fclose(file);
+    return contents;
+}
+
+static size_t occurrences(const std::string &haystack, const std::string &needle) {
+    size_t count = 0;
+    for (size_t pos = haystack.find(needle); pos != std::string::npos;
+            pos = haystack.find(needle, pos + needle.size())) {
+        ++count;
+    }
+    return count;
+}
+
+static void *traceThread(void *arg __unused) {
+    for (int i = 0; i < 10; ++i) {
+        AUDIO_UTILS_TRACE_SCOPE("worker");
+        AUDIO_UTILS_TRACE_COUNTER("worker count", i);
+    }
+    return NULL;
+}
+
+TEST(audio_utils_trace, systrace) {
+    audio_utils_trace_reset();
+    {
+        AUDIO_UTILS_TRACE_SCOPE("outer");
+        AUDIO_UTILS_TRACE_COUNTER("level", 42);
+    }
+    pthread_t thread;
+    ASSERT_EQ(0, pthread_create(&thread, NULL, traceThread, NULL));
+    ASSERT_EQ(0, pthread_join(thread, NULL));
+
+    const std::string systrace = dump(AUDIO_UTILS_TRACE_FORMAT_SYSTRACE);
+    const std::string pid = std::to_string(getpid());
+    EXPECT_EQ(0u, systrace.find("# tracer: nop\n"));
+    EXPECT_EQ(1u, occurrences(systrace, "tracing_mark_write: B|" + pid + "|outer\n"));
+    EXPECT_EQ(1u, occurrences(systrace, "tracing_mark_write: C|" + pid + "|level|42\n"));
+    EXPECT_EQ(10u, occurrences(systrace, "|worker\n"));
+    EXPECT_EQ(1u, occurrences(systrace, "|worker count|9\n"));
+    EXPECT_EQ(11u, occurrences(systrace, "tracing_mark_write: E|" + pid + "\n"));
+
+    // the end of the outer slice precedes the events of the other thread
+    EXPECT_LT(systrace.find("|level|42"), systrace.find("|worker\n"));
+
+    audio_utils_trace_reset();
+    EXPECT_EQ(std::string::npos, dump(AUDIO_UTILS_TRACE_FORMAT_SYSTRACE).find("tracing_mark"));
+}
+
+TEST(audio_utils_trace, json) {
+    audio_utils_trace_reset();
+    {
+        AUDIO_UTILS_TRACE_SCOPE("outer");
+        AUDIO_UTILS_TRACE_COUNTER("level", -1);
+    }
+    const std::string json = dump(AUDIO_UTILS_TRACE_FORMAT_JSON);
+    EXPECT_EQ(0u, json.find("{\"traceEvents\":["));
+    EXPECT_EQ(1u, occurrences(json, "\"ph\":\"M\""));
+    EXPECT_EQ(1u, occurrences(json, "{\"name\":\"outer\",\"ph\":\"B\""));
+    EXPECT_EQ(1u, occurrences(json, "\"ph\":\"E\""));
+    EXPECT_EQ(1u, occurrences(json, "\"args\":{\"value\":-1}"));
+    EXPECT_NE(std::string::npos, json.find("\n],\"displayTimeUnit\":\"ns\"}\n"));
+}
+
+TEST(audio_utils_trace, ring_overwrite) {
+    audio_utils_trace_reset();
+    const int events = AUDIO_UTILS_TRACE_RING_EVENTS + 100;
+    for (int i = 0; i < events; ++i) {
+        audio_utils_trace_counter("overwrite", i);
+    }
+    const std::string systrace = dump(AUDIO_UTILS_TRACE_FORMAT_SYSTRACE);
+    // only the most recent events are kept
+    EXPECT_EQ((size_t)AUDIO_UTILS_TRACE_RING_EVENTS, occurrences(systrace, "|overwrite|"));
+    EXPECT_EQ(std::string::npos, systrace.find("|overwrite|99\n"));
+    EXPECT_NE(std::string::npos, systrace.find("|overwrite|100\n"));
+    EXPECT_NE(std::string::npos, systrace.find("|overwrite|" + std::to_string(events - 1) + "\n"));
+
+    EXPECT_EQ(-EINVAL, audio_utils_trace_dump(1, (enum audio_utils_trace_format) 99));
+}
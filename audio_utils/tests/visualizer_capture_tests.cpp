@@ -0,0 +1,158 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "audio_utils_visualizer_capture_tests"
+
+#include <math.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <vector>
+#include <gtest/gtest.h>
+#include <audio_utils/visualizer_capture.h>
+
+// pseudo-random 16-bit samples
+static std::vector<int16_t> makeNoise(size_t count, unsigned seed)
+{
+    std::vector<int16_t> noise(count);
+    for (size_t i = 0; i < count; ++i) {
+        seed = seed * 1103515245 + 12345;
+        noise[i] = (int16_t)(seed >> 16);
+    }
+    return noise;
+}
+
+static int32_t toMillibels(double level)
+{
+    return level > 0 ? (int32_t)(2000 * log10(level / 32767.)) : VISUALIZER_CAPTURE_SILENCE_MB;
+}
+
+TEST(audio_utils_visualizer_capture, create) {
+    EXPECT_EQ(nullptr, visualizer_capture_create(2, 1));
+    EXPECT_EQ(nullptr, visualizer_capture_create(96, 1));
+    EXPECT_EQ(nullptr, visualizer_capture_create(2048, 1));
+    EXPECT_EQ(nullptr, visualizer_capture_create(128, 0));
+    EXPECT_EQ(nullptr, visualizer_capture_create(128, VISUALIZER_CAPTURE_MAX_METER_WINDOW + 1));
+    visualizer_capture_destroy(nullptr);
+
+    struct visualizer_capture *capture = visualizer_capture_create(128, 1000);
+    ASSERT_NE(nullptr, capture);
+    int32_t peak, rms;
+    visualizer_capture_measure(capture, &peak, &rms);
+    EXPECT_EQ(VISUALIZER_CAPTURE_SILENCE_MB, peak);
+    EXPECT_EQ(VISUALIZER_CAPTURE_SILENCE_MB, rms);
+    uint8_t waveform[128];
+    visualizer_capture_waveform(capture, waveform);
+    EXPECT_EQ(128, std::count(waveform, waveform + 128, 0x80));
+    visualizer_capture_destroy(capture);
+}
+
+// the incremental meters match a direct computation over the window, across writes of any size
+TEST(audio_utils_visualizer_capture, meters) {
+    const size_t window = 300;
+    const std::vector<int16_t> noise = makeNoise(5000, 42);
+    for (size_t captureSize : { (size_t)128, (size_t)1024 }) {
+        struct visualizer_capture *capture = visualizer_capture_create(captureSize, window);
+        ASSERT_NE(nullptr, capture);
+        size_t written = 0;
+        for (size_t frames = 1; written + frames <= noise.size(); frames = frames * 3 % 257 + 1) {
+            visualizer_capture_write(capture, &noise[written], frames, 1);
+            written += frames;
+
+            const size_t start = written > window ? written - window : 0;
+            int32_t peak = 0;
+            double sumSquares = 0;
+            for (size_t i = start; i < written; ++i) {
+                peak = std::max(peak, abs((int32_t)noise[i]));
+                sumSquares += (double)noise[i] * noise[i];
+            }
+            int32_t peakMb, rmsMb;
+            visualizer_capture_measure(capture, &peakMb, &rmsMb);
+            EXPECT_EQ(toMillibels(peak), peakMb) << "after " << written;
+            EXPECT_EQ(toMillibels(sqrt(sumSquares / (written - start))), rmsMb)
+                    << "after " << written;
+        }
+        visualizer_capture_reset(capture);
+        int32_t peakMb;
+        visualizer_capture_measure(capture, &peakMb, nullptr);
+        EXPECT_EQ(VISUALIZER_CAPTURE_SILENCE_MB, peakMb);
+        visualizer_capture_destroy(capture);
+    }
+}
+
+TEST(audio_utils_visualizer_capture, waveform) {
+    const size_t captureSize = 256;
+    struct visualizer_capture *capture = visualizer_capture_create(captureSize, 64);
+    ASSERT_NE(nullptr, capture);
+
+    // stereo is averaged to mono
+    std::vector<int16_t> stereo(2 * 100);
+    for (size_t i = 0; i < 100; ++i) {
+        stereo[2 * i] = (int16_t)(i * 256);
+        stereo[2 * i + 1] = (int16_t)(i * 256 + 512);
+    }
+    visualizer_capture_write(capture, stereo.data(), 100, 2);
+    uint8_t waveform[captureSize];
+    visualizer_capture_waveform(capture, waveform);
+    for (size_t i = 0; i < captureSize - 100; ++i) {
+        ASSERT_EQ(0x80, waveform[i]) << i;
+    }
+    for (size_t i = 0; i < 100; ++i) {
+        ASSERT_EQ((uint8_t)((i + 1) ^ 0x80), waveform[captureSize - 100 + i]) << i;
+    }
+
+    // only the latest capture is kept
+    const std::vector<int16_t> noise = makeNoise(1000, 7);
+    visualizer_capture_write(capture, noise.data(), noise.size(), 1);
+    visualizer_capture_waveform(capture, waveform);
+    for (size_t i = 0; i < captureSize; ++i) {
+        ASSERT_EQ((uint8_t)((noise[noise.size() - captureSize + i] >> 8) ^ 0x80), waveform[i]);
+    }
+    visualizer_capture_destroy(capture);
+}
+
+TEST(audio_utils_visualizer_capture, fft) {
+    const size_t captureSize = 1024;
+    struct visualizer_capture *capture = visualizer_capture_create(captureSize, captureSize);
+    ASSERT_NE(nullptr, capture);
+
+    // a sine on bin 37 dominates all other bins
+    const size_t bin = 37;
+    std::vector<int16_t> sine(captureSize);
+    for (size_t i = 0; i < captureSize; ++i) {
+        sine[i] = (int16_t)(16384 * sin(2 * M_PI * bin * i / captureSize));
+    }
+    visualizer_capture_write(capture, sine.data(), sine.size(), 1);
+    int8_t fft[captureSize];
+    visualizer_capture_fft(capture, fft);
+    size_t loudest = 0;
+    int32_t loudestMagnitude = -1;
+    for (size_t k = 1; k < captureSize / 2; ++k) {
+        const int32_t magnitude = fft[2 * k] * fft[2 * k] + fft[2 * k + 1] * fft[2 * k + 1];
+        if (magnitude > loudestMagnitude) {
+            loudest = k;
+            loudestMagnitude = magnitude;
+        }
+    }
+    EXPECT_EQ(bin, loudest);
+    EXPECT_LE(abs(fft[0]), 1);
+
+    // capturing does not change the state
+    int8_t again[captureSize];
+    visualizer_capture_fft(capture, again);
+    EXPECT_TRUE(std::equal(fft, fft + captureSize, again));
+    visualizer_capture_destroy(capture);
+}
@@ -0,0 +1,368 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Batch converter of .wav files between sample formats and channel counts.
+// Every input file is split into chunks of frames, and a pool of threads converts the chunks
+// of all files in parallel.  Input files are memory-mapped, and converted chunks are written
+// in order through a buffered background writer for each output file.
+// At the end this reports the throughput in frames per second and megabytes per second.
+
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <audio_utils/channels.h>
+#include <audio_utils/format.h>
+#include <audio_utils/sndfile.h>
+
+static inline int64_t systemTimeNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void usage(const char *progname)
+{
+    fprintf(stderr, "Usage: %s -o output-dir [-f 16|24|32|float] [-c channels] [-j threads] "
+            "[-b chunk-frames] input.wav ...\n", progname);
+    fprintf(stderr, "  -o  directory of the converted files, which keep their base names\n");
+    fprintf(stderr, "  -f  output sample format, default same as input\n");
+    fprintf(stderr, "  -c  output channel count 1 to 8, default same as input\n");
+    fprintf(stderr, "  -j  number of conversion threads, default number of CPUs\n");
+    fprintf(stderr, "  -b  frames per chunk, default 65536\n");
+}
+
+static audio_format_t audioFormatFromSf(int format)
+{
+    switch (format & SF_FORMAT_SUBMASK) {
+    case SF_FORMAT_PCM_U8:
+        return AUDIO_FORMAT_PCM_8_BIT;
+    case SF_FORMAT_PCM_16:
+        return AUDIO_FORMAT_PCM_16_BIT;
+    case SF_FORMAT_PCM_24:
+        return AUDIO_FORMAT_PCM_24_BIT_PACKED;
+    case SF_FORMAT_PCM_32:
+        return AUDIO_FORMAT_PCM_32_BIT;
+    case SF_FORMAT_FLOAT:
+        return AUDIO_FORMAT_PCM_FLOAT;
+    default:
+        return AUDIO_FORMAT_INVALID;
+    }
+}
+
+struct File {
+    std::string mInputPath;
+    std::string mOutputPath;
+    SNDFILE *mInput;
+    SNDFILE *mOutput;           // opened by the writer of the first chunk
+    SF_INFO mInputInfo;
+    SF_INFO mOutputInfo;
+    bool mIntegerPath;          // convert through int32 instead of float to keep 32-bit samples
+    memcpy_by_audio_format_t mConverter;    // from the input view to float
+    size_t mChunks;
+    pthread_mutex_t mLock;      // protects mInput, mOutput, mNextChunk and mFailed
+    pthread_cond_t mCond;       // signalled when mNextChunk or mFailed changes
+    size_t mNextChunk;          // index of the next chunk to write
+    bool mFailed;
+};
+
+struct Job {
+    File *mFile;
+    size_t mChunk;
+};
+
+struct Pool {
+    std::vector<File*> mFiles;
+    std::vector<Job> mJobs;     // all chunks of all files in order, so writes rarely wait
+    size_t mChunkFrames;
+    int mMaxChannels;           // most input or output channels of any file
+    pthread_mutex_t mLock;      // protects mNextJob
+    size_t mNextJob;
+};
+
+// Convert one chunk of frames, then write it after the previous chunks of the same file.
+static void convertChunk(Pool *pool, File *file, size_t chunk, void *in, void *out)
+{
+    const size_t first = chunk * pool->mChunkFrames;
+    const size_t frames = std::min(pool->mChunkFrames, (size_t) file->mInputInfo.frames - first);
+    const int inChannels = file->mInputInfo.channels;
+    const int outChannels = file->mOutputInfo.channels;
+    bool ok;
+
+    // the views stay valid until the input is closed, so only positioning needs the lock
+    pthread_mutex_lock(&file->mLock);
+    const void *view = NULL;
+    if (file->mIntegerPath) {
+        ok = sf_preadf_int(file->mInput, (int *) in, frames, first) == (sf_count_t) frames;
+    } else {
+        ok = sf_seek(file->mInput, first, SEEK_SET) == (sf_count_t) first &&
+                sf_readf_view(file->mInput, &view, frames) == (sf_count_t) frames;
+    }
+    pthread_mutex_unlock(&file->mLock);
+
+    const void *result = in;
+    if (ok) {
+        const size_t samples = frames * inChannels;
+        if (!file->mIntegerPath) {
+            // views are only aligned as in the file, e.g. float data follows a 58-byte header
+            const size_t sampleSize = audio_bytes_per_sample(
+                    audioFormatFromSf(file->mInputInfo.format));
+            if (sampleSize > 1 && ((uintptr_t) view & (sampleSize - 1)) != 0) {
+                memcpy(out, view, samples * sampleSize);
+                view = out;
+            }
+            file->mConverter(in, view, samples);
+        }
+        if (inChannels != outChannels) {
+            if (file->mIntegerPath) {
+                adjust_channels(in, inChannels, out, outChannels, sizeof(int32_t),
+                        samples * sizeof(int32_t));
+            } else {
+                adjust_channels_float((const float *) in, inChannels, (float *) out,
+                        outChannels, samples * sizeof(float));
+            }
+            result = out;
+        }
+    }
+
+    pthread_mutex_lock(&file->mLock);
+    while (file->mNextChunk != chunk && !file->mFailed) {
+        pthread_cond_wait(&file->mCond, &file->mLock);
+    }
+    if (ok && !file->mFailed && chunk == 0) {
+        file->mOutput = sf_open(file->mOutputPath.c_str(), SFM_WRITE, &file->mOutputInfo);
+        ok = file->mOutput != NULL &&
+                sf_set_write_buffer(file->mOutput, pool->mChunkFrames, SF_WRITE_BACKGROUND) == 0;
+    }
+    if (ok && !file->mFailed) {
+        const sf_count_t written = file->mIntegerPath ?
+                sf_writef_int(file->mOutput, (const int *) result, frames) :
+                sf_writef_float(file->mOutput, (const float *) result, frames);
+        ok = written == (sf_count_t) frames;
+    }
+    if (!ok && !file->mFailed) {
+        fprintf(stderr, "%s: conversion failed at frame %zu\n", file->mInputPath.c_str(), first);
+        file->mFailed = true;
+    }
+    file->mNextChunk++;
+    if (file->mNextChunk == file->mChunks || file->mFailed) {
+        if (file->mOutput != NULL) {
+            sf_close(file->mOutput);
+            file->mOutput = NULL;
+        }
+    }
+    pthread_cond_broadcast(&file->mCond);
+    pthread_mutex_unlock(&file->mLock);
+}
+
+static void *workerLoop(void *arg)
+{
+    Pool *pool = (Pool *) arg;
+    // large enough for the input or output of a chunk of any file as float or int32
+    const size_t bufferSize = pool->mChunkFrames * pool->mMaxChannels * sizeof(float);
+    void *in = malloc(bufferSize);
+    void *out = malloc(bufferSize);
+    if (in == NULL || out == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+    for (;;) {
+        pthread_mutex_lock(&pool->mLock);
+        const size_t index = pool->mNextJob++;
+        pthread_mutex_unlock(&pool->mLock);
+        if (index >= pool->mJobs.size()) {
+            break;
+        }
+        const Job &job = pool->mJobs[index];
+        convertChunk(pool, job.mFile, job.mChunk, in, out);
+    }
+    free(in);
+    free(out);
+    return NULL;
+}
+
+// Open and validate an input file, and compute the output parameters.
+static File *openFile(const char *inputPath, const char *outputDir, int outFormat,
+        int outChannels)
+{
+    File *file = new File();
+    file->mInputPath = inputPath;
+    const char *slash = strrchr(inputPath, '/');
+    file->mOutputPath = std::string(outputDir) + "/" + (slash != NULL ? slash + 1 : inputPath);
+    file->mInput = sf_open(inputPath, SFM_READ | SFM_MMAP, &file->mInputInfo);
+    if (file->mInput == NULL) {
+        fprintf(stderr, "%s: could not open\n", inputPath);
+        delete file;
+        return NULL;
+    }
+    char inputReal[PATH_MAX], outputReal[PATH_MAX];
+    if (realpath(file->mOutputPath.c_str(), outputReal) != NULL &&
+            realpath(inputPath, inputReal) != NULL && !strcmp(inputReal, outputReal)) {
+        fprintf(stderr, "%s: output would overwrite input\n", inputPath);
+        sf_close(file->mInput);
+        delete file;
+        return NULL;
+    }
+    file->mOutputInfo = file->mInputInfo;
+    file->mOutputInfo.frames = 0;
+    if (outFormat != 0) {
+        file->mOutputInfo.format = SF_FORMAT_WAV | outFormat;
+    }
+    if (outChannels != 0) {
+        file->mOutputInfo.channels = outChannels;
+    }
+    const int inSub = file->mInputInfo.format & SF_FORMAT_SUBMASK;
+    const int outSub = file->mOutputInfo.format & SF_FORMAT_SUBMASK;
+    file->mIntegerPath = inSub == SF_FORMAT_PCM_32 && outSub == SF_FORMAT_PCM_32;
+    file->mConverter = memcpy_by_audio_format_get_converter(AUDIO_FORMAT_PCM_FLOAT,
+            audioFormatFromSf(inSub));
+    if (!file->mIntegerPath && file->mConverter == NULL) {
+        fprintf(stderr, "%s: unsupported format %#x\n", inputPath, file->mInputInfo.format);
+        sf_close(file->mInput);
+        delete file;
+        return NULL;
+    }
+    pthread_mutex_init(&file->mLock, NULL);
+    pthread_cond_init(&file->mCond, NULL);
+    file->mOutput = NULL;
+    file->mNextChunk = 0;
+    file->mFailed = false;
+    return file;
+}
+
+int main(int argc, char **argv)
+{
+    const char *progname = argv[0];
+    const char *outputDir = NULL;
+    int outFormat = 0;
+    int outChannels = 0;
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
+    long chunkFrames = 65536;
+    int opt;
+    while ((opt = getopt(argc, argv, "o:f:c:j:b:")) != -1) {
+        switch (opt) {
+        case 'o':
+            outputDir = optarg;
+            break;
+        case 'f':
+            if (!strcmp(optarg, "16")) {
+                outFormat = SF_FORMAT_PCM_16;
+            } else if (!strcmp(optarg, "24")) {
+                outFormat = SF_FORMAT_PCM_24;
+            } else if (!strcmp(optarg, "32")) {
+                outFormat = SF_FORMAT_PCM_32;
+            } else if (!strcmp(optarg, "float")) {
+                outFormat = SF_FORMAT_FLOAT;
+            } else {
+                usage(progname);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'c':
+            outChannels = atoi(optarg);
+            if (outChannels < 1 || outChannels > FCC_8) {
+                usage(progname);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'j':
+            threads = atol(optarg);
+            break;
+        case 'b':
+            chunkFrames = atol(optarg);
+            break;
+        default:
+            usage(progname);
+            return EXIT_FAILURE;
+        }
+    }
+    if (outputDir == NULL || optind >= argc || threads < 1 || chunkFrames < 1) {
+        usage(progname);
+        return EXIT_FAILURE;
+    }
+
+    Pool pool;
+    pool.mChunkFrames = chunkFrames;
+    pool.mMaxChannels = 1;
+    pool.mNextJob = 0;
+    pthread_mutex_init(&pool.mLock, NULL);
+    int status = EXIT_SUCCESS;
+    double inputBytes = 0;
+    size_t totalFrames = 0;
+    for (int i = optind; i < argc; ++i) {
+        File *file = openFile(argv[i], outputDir, outFormat, outChannels);
+        if (file == NULL) {
+            status = EXIT_FAILURE;
+            continue;
+        }
+        // an empty file still has one chunk, to write its header
+        file->mChunks = std::max((size_t) 1,
+                (file->mInputInfo.frames + pool.mChunkFrames - 1) / pool.mChunkFrames);
+        for (size_t chunk = 0; chunk < file->mChunks; ++chunk) {
+            pool.mJobs.push_back(Job{file, chunk});
+        }
+        pool.mFiles.push_back(file);
+        pool.mMaxChannels = std::max(pool.mMaxChannels,
+                std::max(file->mInputInfo.channels, file->mOutputInfo.channels));
+        totalFrames += file->mInputInfo.frames;
+        inputBytes += (double) file->mInputInfo.frames * file->mInputInfo.channels *
+                audio_bytes_per_sample(audioFormatFromSf(file->mInputInfo.format));
+    }
+
+    const int64_t startNs = systemTimeNs();
+    if ((size_t) threads > pool.mJobs.size()) {
+        threads = std::max((size_t) 1, pool.mJobs.size());
+    }
+    std::vector<pthread_t> workers(threads);
+    for (long i = 0; i < threads; ++i) {
+        if (pthread_create(&workers[i], NULL, workerLoop, &pool) != 0) {
+            fprintf(stderr, "pthread_create failed\n");
+            return EXIT_FAILURE;
+        }
+    }
+    for (long i = 0; i < threads; ++i) {
+        pthread_join(workers[i], NULL);
+    }
+    const double seconds = (systemTimeNs() - startNs) * 1e-9;
+
+    size_t converted = 0;
+    for (File *file : pool.mFiles) {
+        if (file->mFailed) {
+            status = EXIT_FAILURE;
+        } else {
+            ++converted;
+        }
+        sf_close(file->mInput);
+        pthread_cond_destroy(&file->mCond);
+        pthread_mutex_destroy(&file->mLock);
+        delete file;
+    }
+    printf("converted %zu of %d files, %zu frames, %.1f MB in %.3f s with %ld threads\n",
+            converted, argc - optind, totalFrames, inputBytes / 1e6, seconds, threads);
+    if (seconds > 0) {
+        printf("throughput %.0f frames/s, %.1f MB/s\n", totalFrames / seconds,
+                inputBytes / 1e6 / seconds);
+    }
+    return status;
+}
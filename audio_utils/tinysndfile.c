@@ -22,20 +22,54 @@
 #endif
 #include <string.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #define WAVE_FORMAT_PCM         1
 #define WAVE_FORMAT_IEEE_FLOAT  3
 #define WAVE_FORMAT_EXTENSIBLE  0xFFFE
 
+#define SF_WRITE_DIRECT_ALIGNMENT 4096
+
+// State of buffered writing, see sf_set_write_buffer()
+struct sf_write_buffer {
+    int fd;
+    int flags;
+    uint8_t *buffers[2];    // filled alternately, so one can be written in the background
+    size_t size;            // bytes per buffer
+    int current;            // index of the buffer being filled
+    size_t fill;            // bytes filled in the current buffer
+    off_t offset;           // file offset of the current buffer
+    int error;              // first write error as a negative errno, or 0
+    // SF_WRITE_BACKGROUND
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;    // signalled when pending or exiting changes
+    int pending;            // index of the buffer to be written by the thread, or -1
+    size_t pendingBytes;
+    off_t pendingOffset;
+    int exiting;
+};
+
 struct SNDFILE_ {
     int mode;
-    uint8_t *temp;  // realloc buffer used for shrinking 16 bits to 8 bits and byte-swapping
+    uint8_t *temp;  // realloc buffer for format conversions and byte-swapping
     FILE *stream;
     size_t bytesPerFrame;
     size_t remaining;   // frames unread for SFM_READ, frames written for SFM_WRITE
     SF_INFO info;
+    void *map;          // SFM_MMAP: mapping of the data chunk, or NULL if read through stream
+    size_t mapLength;
+    const uint8_t *data;    // SFM_MMAP: first frame of the data chunk, within map
+    struct sf_write_buffer *writeBuffer;    // NULL unless sf_set_write_buffer() was called
+    long dataOffset;    // SFM_READ: file offset of the data chunk
 };
 
+static void sf_write_buffer_close(SNDFILE *handle);
+
 static unsigned little2u(unsigned char *ptr)
 {
     return (ptr[1] << 8) + ptr[0];
@@ -62,7 +96,47 @@ static void my_swab(short *ptr, size_t numToSwap)
     }
 }
 
-static SNDFILE *sf_open_read(const char *path, SF_INFO *info)
+// Map the data chunk which starts at file offset dataTell, and release the stream.
+// The frame count is reduced if the file is shorter than the data chunk size.
+static int sf_map_data(SNDFILE *handle, long dataTell)
+{
+    int fd = fileno(handle->stream);
+    struct stat st;
+    if (fstat(fd, &st) < 0 || dataTell < 0 || (off_t) dataTell > st.st_size) {
+#ifdef HAVE_STDERR
+        fprintf(stderr, "fstat failed errno %d\n", errno);
+#endif
+        return -1;
+    }
+    size_t available = (size_t) (st.st_size - dataTell) / handle->bytesPerFrame;
+    if (handle->remaining > available) {
+        handle->remaining = available;
+        handle->info.frames = available;
+    }
+    // the mapping offset must be page aligned
+    long pageSize = sysconf(_SC_PAGESIZE);
+    off_t offset = (off_t) (dataTell - dataTell % pageSize);
+    size_t length = (size_t) (dataTell - offset) + handle->remaining * handle->bytesPerFrame;
+    if (length > 0) {
+        void *map = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, offset);
+        if (map == MAP_FAILED) {
+#ifdef HAVE_STDERR
+            fprintf(stderr, "mmap failed errno %d\n", errno);
+#endif
+            return -1;
+        }
+        (void) madvise(map, length, MADV_SEQUENTIAL);
+        handle->map = map;
+        handle->mapLength = length;
+        handle->data = (const uint8_t *) map + (dataTell - offset);
+    }
+    // the mapping stays valid after the file is closed
+    (void) fclose(handle->stream);
+    handle->stream = NULL;
+    return 0;
+}
+
+static SNDFILE *sf_open_read(const char *path, SF_INFO *info, int useMap)
 {
     FILE *stream = fopen(path, "rb");
     if (stream == NULL) {
@@ -77,6 +151,10 @@ static SNDFILE *sf_open_read(const char *path, SF_INFO *info)
     handle->temp = NULL;
     handle->stream = stream;
     handle->info.format = SF_FORMAT_WAV;
+    handle->map = NULL;
+    handle->mapLength = 0;
+    handle->data = NULL;
+    handle->writeBuffer = NULL;
 
     // don't attempt to parse all valid forms, just the most common ones
     unsigned char wav[12];
@@ -182,7 +260,7 @@ static SNDFILE *sf_open_read(const char *path, SF_INFO *info)
                 fseek(stream, (long) (chunkSize - minSize), SEEK_CUR);
             }
             unsigned channels = little2u(&fmt[2]);
-            if ((channels < 1) || (channels > FCC_8)) {
+            if ((channels < 1) || (channels > SF_MAX_CHANNELS)) {
 #ifdef HAVE_STDERR
                 fprintf(stderr, "unsupported channels %u\n", channels);
 #endif
@@ -276,7 +354,14 @@ static SNDFILE *sf_open_read(const char *path, SF_INFO *info)
 #endif
         goto close;
     }
-    (void) fseek(stream, dataTell, SEEK_SET);
+    handle->dataOffset = dataTell;
+    if (useMap) {
+        if (sf_map_data(handle, dataTell) < 0) {
+            goto close;
+        }
+    } else {
+        (void) fseek(stream, dataTell, SEEK_SET);
+    }
     *info = handle->info;
     return handle;
 
@@ -286,6 +371,12 @@ close:
     return NULL;
 }
 
+static void write2u(unsigned char *ptr, unsigned u)
+{
+    ptr[0] = u;
+    ptr[1] = u >> 8;
+}
+
 static void write4u(unsigned char *ptr, unsigned u)
 {
     ptr[0] = u;
@@ -299,7 +390,7 @@ static SNDFILE *sf_open_write(const char *path, SF_INFO *info)
     int sub = info->format & SF_FORMAT_SUBMASK;
     if (!(
             (info->samplerate > 0) &&
-            (info->channels > 0 && info->channels <= FCC_8) &&
+            (info->channels > 0 && info->channels <= SF_MAX_CHANNELS) &&
             ((info->format & SF_FORMAT_TYPEMASK) == SF_FORMAT_WAV) &&
             (sub == SF_FORMAT_PCM_16 || sub == SF_FORMAT_PCM_U8 || sub == SF_FORMAT_FLOAT ||
                 sub == SF_FORMAT_PCM_24 || sub == SF_FORMAT_PCM_32)
@@ -326,7 +417,7 @@ static SNDFILE *sf_open_write(const char *path, SF_INFO *info)
         wav[16] = 16;   // fmtSize
         wav[20] = WAVE_FORMAT_PCM;
     }
-    wav[22] = info->channels;
+    write2u(&wav[22], info->channels);
     write4u(&wav[24], info->samplerate);
     unsigned bitsPerSample;
     switch (sub) {
@@ -352,7 +443,7 @@ static SNDFILE *sf_open_write(const char *path, SF_INFO *info)
     unsigned blockAlignment = (bitsPerSample >> 3) * info->channels;
     unsigned byteRate = info->samplerate * blockAlignment;
     write4u(&wav[28], byteRate);
-    wav[32] = blockAlignment;
+    write2u(&wav[32], blockAlignment);
     wav[34] = bitsPerSample;
     size_t extra = 0;
     if (sub == SF_FORMAT_FLOAT) {
@@ -371,6 +462,11 @@ static SNDFILE *sf_open_write(const char *path, SF_INFO *info)
     handle->bytesPerFrame = blockAlignment;
     handle->remaining = 0;
     handle->info = *info;
+    handle->map = NULL;
+    handle->mapLength = 0;
+    handle->data = NULL;
+    handle->writeBuffer = NULL;
+    handle->dataOffset = 0;
     return handle;
 }
 
@@ -384,7 +480,8 @@ SNDFILE *sf_open(const char *path, int mode, SF_INFO *info)
     }
     switch (mode) {
     case SFM_READ:
-        return sf_open_read(path, info);
+    case SFM_READ | SFM_MMAP:
+        return sf_open_read(path, info, mode & SFM_MMAP);
     case SFM_WRITE:
         return sf_open_write(path, info);
     default:
@@ -401,6 +498,9 @@ void sf_close(SNDFILE *handle)
         return;
     free(handle->temp);
     if (handle->mode == SFM_WRITE) {
+        if (handle->writeBuffer != NULL) {
+            sf_write_buffer_close(handle);
+        }
         (void) fflush(handle->stream);
         rewind(handle->stream);
         unsigned char wav[58];
@@ -412,10 +512,58 @@ void sf_close(SNDFILE *handle)
         rewind(handle->stream);
         (void) fwrite(wav, 44 + extra, 1, handle->stream);
     }
-    (void) fclose(handle->stream);
+    if (handle->map != NULL) {
+        (void) munmap(handle->map, handle->mapLength);
+    }
+    if (handle->stream != NULL) {
+        (void) fclose(handle->stream);
+    }
     free(handle);
 }
 
+// Return the next desiredBytes of the data chunk and the number of bytes actually available.
+// Mapped data is returned in place; otherwise the data is read from the stream into buffer.
+static const void *sf_read_data(SNDFILE *handle, void *buffer, size_t desiredBytes,
+        size_t *actualBytes)
+{
+    if (handle->map != NULL) {
+        // desiredBytes was already limited to the remaining frames
+        const uint8_t *data =
+                handle->data + (handle->info.frames - handle->remaining) * handle->bytesPerFrame;
+        size_t sampleBytes = handle->bytesPerFrame / handle->info.channels;
+        if (sampleBytes == 3 || ((uintptr_t) data & (sampleBytes - 1)) == 0) {
+            *actualBytes = desiredBytes;
+            return data;
+        }
+        // e.g. the float header is 58 bytes, so samples may need realigning before conversion
+        void *temp = realloc(handle->temp, desiredBytes);
+        if (temp == NULL) {
+            *actualBytes = 0;
+            return NULL;
+        }
+        handle->temp = temp;
+        memcpy(temp, data, desiredBytes);
+        *actualBytes = desiredBytes;
+        return temp;
+    }
+    *actualBytes = fread(buffer, sizeof(char), desiredBytes, handle->stream);
+    return buffer;
+}
+
+sf_count_t sf_readf_view(SNDFILE *handle, const void **ptr, sf_count_t desiredFrames)
+{
+    if (handle == NULL || handle->mode != SFM_READ || handle->map == NULL || ptr == NULL ||
+            !handle->remaining || desiredFrames <= 0 || !isLittleEndian()) {
+        return 0;
+    }
+    if (handle->remaining < (size_t) desiredFrames) {
+        desiredFrames = handle->remaining;
+    }
+    *ptr = handle->data + (handle->info.frames - handle->remaining) * handle->bytesPerFrame;
+    handle->remaining -= desiredFrames;
+    return desiredFrames;
+}
+
 sf_count_t sf_readf_short(SNDFILE *handle, short *ptr, sf_count_t desiredFrames)
 {
     if (handle == NULL || handle->mode != SFM_READ || ptr == NULL || !handle->remaining ||
@@ -428,35 +576,41 @@ sf_count_t sf_readf_short(SNDFILE *handle, short *ptr, sf_count_t desiredFrames)
     // does not check for numeric overflow
     size_t desiredBytes = desiredFrames * handle->bytesPerFrame;
     size_t actualBytes;
-    void *temp = NULL;
+    const void *src;
     unsigned format = handle->info.format & SF_FORMAT_SUBMASK;
-    if (format == SF_FORMAT_PCM_32 || format == SF_FORMAT_FLOAT || format == SF_FORMAT_PCM_24) {
-        temp = malloc(desiredBytes);
-        actualBytes = fread(temp, sizeof(char), desiredBytes, handle->stream);
+    if (handle->map == NULL && (format == SF_FORMAT_PCM_32 || format == SF_FORMAT_FLOAT ||
+            format == SF_FORMAT_PCM_24)) {
+        // the samples are converted from a buffer kept by the handle
+        void *temp = realloc(handle->temp, desiredBytes);
+        if (temp == NULL) {
+            return 0;
+        }
+        handle->temp = temp;
+        src = sf_read_data(handle, temp, desiredBytes, &actualBytes);
     } else {
-        actualBytes = fread(ptr, sizeof(char), desiredBytes, handle->stream);
+        src = sf_read_data(handle, ptr, desiredBytes, &actualBytes);
     }
     size_t actualFrames = actualBytes / handle->bytesPerFrame;
     handle->remaining -= actualFrames;
     switch (format) {
     case SF_FORMAT_PCM_U8:
-        memcpy_to_i16_from_u8(ptr, (unsigned char *) ptr, actualFrames * handle->info.channels);
+        memcpy_to_i16_from_u8(ptr, (const unsigned char *) src,
+                actualFrames * handle->info.channels);
         break;
     case SF_FORMAT_PCM_16:
+        if (src != ptr)
+            memcpy(ptr, src, actualFrames * handle->bytesPerFrame);
         if (!isLittleEndian())
             my_swab(ptr, actualFrames * handle->info.channels);
         break;
     case SF_FORMAT_PCM_32:
-        memcpy_to_i16_from_i32(ptr, (const int *) temp, actualFrames * handle->info.channels);
-        free(temp);
+        memcpy_to_i16_from_i32(ptr, (const int *) src, actualFrames * handle->info.channels);
         break;
     case SF_FORMAT_FLOAT:
-        memcpy_to_i16_from_float(ptr, (const float *) temp, actualFrames * handle->info.channels);
-        free(temp);
+        memcpy_to_i16_from_float(ptr, (const float *) src, actualFrames * handle->info.channels);
         break;
     case SF_FORMAT_PCM_24:
-        memcpy_to_i16_from_p24(ptr, (const uint8_t *) temp, actualFrames * handle->info.channels);
-        free(temp);
+        memcpy_to_i16_from_p24(ptr, (const uint8_t *) src, actualFrames * handle->info.channels);
         break;
     default:
         memset(ptr, 0, actualFrames * handle->info.channels * sizeof(short));
@@ -477,37 +631,39 @@ sf_count_t sf_readf_float(SNDFILE *handle, float *ptr, sf_count_t desiredFrames)
     // does not check for numeric overflow
     size_t desiredBytes = desiredFrames * handle->bytesPerFrame;
     size_t actualBytes;
-    void *temp = NULL;
+    const void *src;
     unsigned format = handle->info.format & SF_FORMAT_SUBMASK;
-    if (format == SF_FORMAT_PCM_16 || format == SF_FORMAT_PCM_U8 || format == SF_FORMAT_PCM_24) {
-        temp = malloc(desiredBytes);
-        actualBytes = fread(temp, sizeof(char), desiredBytes, handle->stream);
+    if (handle->map == NULL && (format == SF_FORMAT_PCM_16 || format == SF_FORMAT_PCM_U8 ||
+            format == SF_FORMAT_PCM_24)) {
+        // the samples are converted from a buffer kept by the handle
+        void *temp = realloc(handle->temp, desiredBytes);
+        if (temp == NULL) {
+            return 0;
+        }
+        handle->temp = temp;
+        src = sf_read_data(handle, temp, desiredBytes, &actualBytes);
     } else {
-        actualBytes = fread(ptr, sizeof(char), desiredBytes, handle->stream);
+        src = sf_read_data(handle, ptr, desiredBytes, &actualBytes);
     }
     size_t actualFrames = actualBytes / handle->bytesPerFrame;
     handle->remaining -= actualFrames;
     switch (format) {
     case SF_FORMAT_PCM_U8:
-#if 0
-        // TODO - implement
-        memcpy_to_float_from_u8(ptr, (const unsigned char *) temp,
+        memcpy_to_float_from_u8(ptr, (const unsigned char *) src,
                 actualFrames * handle->info.channels);
-#endif
-        free(temp);
         break;
     case SF_FORMAT_PCM_16:
-        memcpy_to_float_from_i16(ptr, (const short *) temp, actualFrames * handle->info.channels);
-        free(temp);
+        memcpy_to_float_from_i16(ptr, (const short *) src, actualFrames * handle->info.channels);
         break;
     case SF_FORMAT_PCM_32:
-        memcpy_to_float_from_i32(ptr, (const int *) ptr, actualFrames * handle->info.channels);
+        memcpy_to_float_from_i32(ptr, (const int *) src, actualFrames * handle->info.channels);
         break;
     case SF_FORMAT_FLOAT:
+        if (src != ptr)
+            memcpy(ptr, src, actualFrames * handle->bytesPerFrame);
         break;
     case SF_FORMAT_PCM_24:
-        memcpy_to_float_from_p24(ptr, (const uint8_t *) temp, actualFrames * handle->info.channels);
-        free(temp);
+        memcpy_to_float_from_p24(ptr, (const uint8_t *) src, actualFrames * handle->info.channels);
         break;
     default:
         memset(ptr, 0, actualFrames * handle->info.channels * sizeof(float));
@@ -527,14 +683,20 @@ sf_count_t sf_readf_int(SNDFILE *handle, int *ptr, sf_count_t desiredFrames)
     }
     // does not check for numeric overflow
     size_t desiredBytes = desiredFrames * handle->bytesPerFrame;
-    void *temp = NULL;
+    const void *src;
     unsigned format = handle->info.format & SF_FORMAT_SUBMASK;
     size_t actualBytes;
-    if (format == SF_FORMAT_PCM_16 || format == SF_FORMAT_PCM_U8 || format == SF_FORMAT_PCM_24) {
-        temp = malloc(desiredBytes);
-        actualBytes = fread(temp, sizeof(char), desiredBytes, handle->stream);
+    if (handle->map == NULL && (format == SF_FORMAT_PCM_16 || format == SF_FORMAT_PCM_U8 ||
+            format == SF_FORMAT_PCM_24)) {
+        // the samples are converted from a buffer kept by the handle
+        void *temp = realloc(handle->temp, desiredBytes);
+        if (temp == NULL) {
+            return 0;
+        }
+        handle->temp = temp;
+        src = sf_read_data(handle, temp, desiredBytes, &actualBytes);
     } else {
-        actualBytes = fread(ptr, sizeof(char), desiredBytes, handle->stream);
+        src = sf_read_data(handle, ptr, desiredBytes, &actualBytes);
     }
     size_t actualFrames = actualBytes / handle->bytesPerFrame;
     handle->remaining -= actualFrames;
@@ -542,23 +704,22 @@ sf_count_t sf_readf_int(SNDFILE *handle, int *ptr, sf_count_t desiredFrames)
     case SF_FORMAT_PCM_U8:
 #if 0
         // TODO - implement
-        memcpy_to_i32_from_u8(ptr, (const unsigned char *) temp,
+        memcpy_to_i32_from_u8(ptr, (const unsigned char *) src,
                 actualFrames * handle->info.channels);
 #endif
-        free(temp);
         break;
     case SF_FORMAT_PCM_16:
-        memcpy_to_i32_from_i16(ptr, (const short *) temp, actualFrames * handle->info.channels);
-        free(temp);
+        memcpy_to_i32_from_i16(ptr, (const short *) src, actualFrames * handle->info.channels);
         break;
     case SF_FORMAT_PCM_32:
+        if (src != ptr)
+            memcpy(ptr, src, actualFrames * handle->bytesPerFrame);
         break;
     case SF_FORMAT_FLOAT:
-        memcpy_to_i32_from_float(ptr, (const float *) ptr, actualFrames * handle->info.channels);
+        memcpy_to_i32_from_float(ptr, (const float *) src, actualFrames * handle->info.channels);
         break;
     case SF_FORMAT_PCM_24:
-        memcpy_to_i32_from_p24(ptr, (const uint8_t *) temp, actualFrames * handle->info.channels);
-        free(temp);
+        memcpy_to_i32_from_p24(ptr, (const uint8_t *) src, actualFrames * handle->info.channels);
         break;
     default:
         memset(ptr, 0, actualFrames * handle->info.channels * sizeof(int));
@@ -567,82 +728,478 @@ sf_count_t sf_readf_int(SNDFILE *handle, int *ptr, sf_count_t desiredFrames)
     return actualFrames;
 }
 
-sf_count_t sf_writef_short(SNDFILE *handle, const short *ptr, sf_count_t desiredFrames)
+sf_count_t sf_seek(SNDFILE *handle, sf_count_t frames, int whence)
 {
-    if (handle == NULL || handle->mode != SFM_WRITE || ptr == NULL || desiredFrames <= 0)
-        return 0;
-    size_t desiredBytes = desiredFrames * handle->bytesPerFrame;
-    size_t actualBytes = 0;
-    switch (handle->info.format & SF_FORMAT_SUBMASK) {
-    case SF_FORMAT_PCM_U8:
-        handle->temp = realloc(handle->temp, desiredBytes);
-        memcpy_to_u8_from_i16(handle->temp, ptr, desiredBytes);
-        actualBytes = fwrite(handle->temp, sizeof(char), desiredBytes, handle->stream);
+    if (handle == NULL || handle->mode != SFM_READ) {
+        return -1;
+    }
+    sf_count_t position = handle->info.frames - handle->remaining;
+    switch (whence) {
+    case SEEK_SET:
+        position = frames;
         break;
-    case SF_FORMAT_PCM_16:
+    case SEEK_CUR:
+        position += frames;
+        break;
+    case SEEK_END:
+        position = handle->info.frames + frames;
+        break;
+    default:
+        return -1;
+    }
+    if (position < 0 || position > handle->info.frames) {
+        return -1;
+    }
+    if (handle->map == NULL && fseek(handle->stream,
+            handle->dataOffset + (long) (position * handle->bytesPerFrame), SEEK_SET) != 0) {
+        return -1;
+    }
+    handle->remaining = handle->info.frames - position;
+    return position;
+}
+
+sf_count_t sf_preadf_short(SNDFILE *handle, short *ptr, sf_count_t frames, sf_count_t offset)
+{
+    if (sf_seek(handle, offset, SEEK_SET) < 0) {
+        return 0;
+    }
+    return sf_readf_short(handle, ptr, frames);
+}
+
+sf_count_t sf_preadf_float(SNDFILE *handle, float *ptr, sf_count_t frames, sf_count_t offset)
+{
+    if (sf_seek(handle, offset, SEEK_SET) < 0) {
+        return 0;
+    }
+    return sf_readf_float(handle, ptr, frames);
+}
+
+sf_count_t sf_preadf_int(SNDFILE *handle, int *ptr, sf_count_t frames, sf_count_t offset)
+{
+    if (sf_seek(handle, offset, SEEK_SET) < 0) {
+        return 0;
+    }
+    return sf_readf_int(handle, ptr, frames);
+}
+
+// Conversions from the client's samples to the file's samples, for sf_writef()
+typedef void (*sf_convert_t)(void *dst, const void *src, size_t count);
+
+static void convert_u8_from_i16(void *dst, const void *src, size_t count)
+{
+    memcpy_to_u8_from_i16((uint8_t *) dst, (const int16_t *) src, count);
+}
+
+static void convert_swab_i16(void *dst, const void *src, size_t count)
+{
+    memcpy(dst, src, count * sizeof(short));
+    my_swab((short *) dst, count);
+}
+
+static void convert_float_from_i16(void *dst, const void *src, size_t count)
+{
+    memcpy_to_float_from_i16((float *) dst, (const int16_t *) src, count);
+}
+
+static void convert_i16_from_float(void *dst, const void *src, size_t count)
+{
+    memcpy_to_i16_from_float((int16_t *) dst, (const float *) src, count);
+}
+
+static void convert_p24_from_i16(void *dst, const void *src, size_t count)
+{
+    memcpy_to_p24_from_i16((uint8_t *) dst, (const int16_t *) src, count);
+}
+
+static void convert_i32_from_i16(void *dst, const void *src, size_t count)
+{
+    memcpy_to_i32_from_i16((int32_t *) dst, (const int16_t *) src, count);
+}
+
+static void convert_u8_from_float(void *dst, const void *src, size_t count)
+{
+    memcpy_to_u8_from_float((uint8_t *) dst, (const float *) src, count);
+}
+
+static void convert_p24_from_float(void *dst, const void *src, size_t count)
+{
+    memcpy_to_p24_from_float((uint8_t *) dst, (const float *) src, count);
+}
+
+static void convert_i32_from_float(void *dst, const void *src, size_t count)
+{
+    memcpy_to_i32_from_float((int32_t *) dst, (const float *) src, count);
+}
+
+static void convert_i16_from_i32(void *dst, const void *src, size_t count)
+{
+    memcpy_to_i16_from_i32((int16_t *) dst, (const int32_t *) src, count);
+}
+
+static void convert_p24_from_i32(void *dst, const void *src, size_t count)
+{
+    memcpy_to_p24_from_i32((uint8_t *) dst, (const int32_t *) src, count);
+}
+
+static void convert_float_from_i32(void *dst, const void *src, size_t count)
+{
+    memcpy_to_float_from_i32((float *) dst, (const int32_t *) src, count);
+}
+
+// Write all of bytes at offset, retrying partial writes.
+// Return 0 on success or a negative errno.
+static int sf_pwrite_all(int fd, const uint8_t *data, size_t bytes, off_t offset)
+{
+    while (bytes > 0) {
+        ssize_t ret = pwrite(fd, data, bytes, offset);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -errno;
+        }
+        data += ret;
+        bytes -= ret;
+        offset += ret;
+    }
+    return 0;
+}
+
+static void *sf_write_thread(void *arg)
+{
+    struct sf_write_buffer *wb = (struct sf_write_buffer *) arg;
+    pthread_mutex_lock(&wb->lock);
+    for (;;) {
+        while (wb->pending < 0 && !wb->exiting) {
+            pthread_cond_wait(&wb->cond, &wb->lock);
+        }
+        if (wb->pending < 0) {
+            break;
+        }
+        const uint8_t *data = wb->buffers[wb->pending];
+        size_t bytes = wb->pendingBytes;
+        off_t offset = wb->pendingOffset;
+        pthread_mutex_unlock(&wb->lock);
+        int ret = sf_pwrite_all(wb->fd, data, bytes, offset);
+        pthread_mutex_lock(&wb->lock);
+        if (ret < 0 && wb->error == 0) {
+            wb->error = ret;
+        }
+        wb->pending = -1;
+        pthread_cond_broadcast(&wb->cond);
+    }
+    pthread_mutex_unlock(&wb->lock);
+    return NULL;
+}
+
+// Wait until the background thread has written the pending buffer, if any.
+static void sf_write_wait(struct sf_write_buffer *wb)
+{
+    if (wb->flags & SF_WRITE_BACKGROUND) {
+        pthread_mutex_lock(&wb->lock);
+        while (wb->pending >= 0) {
+            pthread_cond_wait(&wb->cond, &wb->lock);
+        }
+        pthread_mutex_unlock(&wb->lock);
+    }
+}
+
+// Return the first write error, which the background thread sets under the lock.
+static int sf_write_error(struct sf_write_buffer *wb)
+{
+    if (!(wb->flags & SF_WRITE_BACKGROUND)) {
+        return wb->error;
+    }
+    pthread_mutex_lock(&wb->lock);
+    int error = wb->error;
+    pthread_mutex_unlock(&wb->lock);
+    return error;
+}
+
+// Write the filled part of the current buffer, in the background if configured,
+// and start filling the other buffer.  Return 0 or the first write error.
+static int sf_write_flush(struct sf_write_buffer *wb)
+{
+    if (wb->fill == 0) {
+        return sf_write_error(wb);
+    }
+    if (wb->flags & SF_WRITE_BACKGROUND) {
+        pthread_mutex_lock(&wb->lock);
+        while (wb->pending >= 0) {
+            pthread_cond_wait(&wb->cond, &wb->lock);
+        }
+        wb->pending = wb->current;
+        wb->pendingBytes = wb->fill;
+        wb->pendingOffset = wb->offset;
+        pthread_cond_broadcast(&wb->cond);
+        pthread_mutex_unlock(&wb->lock);
+        wb->current ^= 1;
+    } else {
+        int ret = sf_pwrite_all(wb->fd, wb->buffers[wb->current], wb->fill, wb->offset);
+        if (ret < 0 && wb->error == 0) {
+            wb->error = ret;
+        }
+    }
+    wb->offset += wb->fill;
+    wb->fill = 0;
+    return sf_write_error(wb);
+}
+
+// Flush everything and release the buffers, leaving the stream usable for the header update.
+static void sf_write_buffer_close(SNDFILE *handle)
+{
+    struct sf_write_buffer *wb = handle->writeBuffer;
+    sf_write_wait(wb);
+#ifdef O_DIRECT
+    if (wb->flags & SF_WRITE_DIRECT) {
+        // the last block is partial, and the header is patched with stdio
+        int fl = fcntl(wb->fd, F_GETFL);
+        (void) fcntl(wb->fd, F_SETFL, fl & ~O_DIRECT);
+    }
+#endif
+    (void) sf_write_flush(wb);
+    if (wb->flags & SF_WRITE_BACKGROUND) {
+        pthread_mutex_lock(&wb->lock);
+        wb->exiting = 1;
+        pthread_cond_broadcast(&wb->cond);
+        pthread_mutex_unlock(&wb->lock);
+        pthread_join(wb->thread, NULL);
+        pthread_cond_destroy(&wb->cond);
+        pthread_mutex_destroy(&wb->lock);
+    }
+    free(wb->buffers[0]);
+    free(wb->buffers[1]);
+    free(wb);
+    handle->writeBuffer = NULL;
+}
+
+int sf_set_write_buffer(SNDFILE *handle, sf_count_t bufferFrames, int flags)
+{
+    if (handle == NULL || handle->mode != SFM_WRITE || handle->writeBuffer != NULL ||
+            handle->remaining != 0 || bufferFrames <= 0 ||
+            (flags & ~(SF_WRITE_BACKGROUND | SF_WRITE_DIRECT)) != 0) {
+        return -EINVAL;
+    }
+    struct sf_write_buffer *wb = (struct sf_write_buffer *) calloc(1, sizeof(*wb));
+    if (wb == NULL) {
+        return -ENOMEM;
+    }
+    if (fflush(handle->stream) != 0) {
+        free(wb);
+        return -errno;
+    }
+    wb->fd = fileno(handle->stream);
+    wb->flags = flags;
+    wb->pending = -1;
+    // the header is at most 58 bytes, see sf_open_write()
+    unsigned char header[58];
+    size_t headerSize = (size_t) ftell(handle->stream);
+    if (headerSize > sizeof(header) ||
+            pread(wb->fd, header, headerSize, 0) != (ssize_t) headerSize) {
+        free(wb);
+        return -EIO;
+    }
+    size_t alignment = 1;
+#ifdef O_DIRECT
+    if (flags & SF_WRITE_DIRECT) {
+        int fl = fcntl(wb->fd, F_GETFL);
+        if (fl >= 0 && fcntl(wb->fd, F_SETFL, fl | O_DIRECT) == 0) {
+            alignment = SF_WRITE_DIRECT_ALIGNMENT;
+        } else {
+            // not supported by this file system
+            wb->flags &= ~SF_WRITE_DIRECT;
+        }
+    }
+#else
+    wb->flags &= ~SF_WRITE_DIRECT;
+#endif
+    // direct I/O needs aligned sizes, offsets and memory; the header is included in the first
+    // buffer so that every data write starts on an aligned offset
+    size_t bytes = bufferFrames * handle->bytesPerFrame;
+    wb->size = (bytes + alignment - 1) / alignment * alignment;
+    int ret = 0;
+    for (int i = 0; i < 2 && ret == 0; ++i) {
+        void *buffer = NULL;
+        if (alignment > 1) {
+            ret = -posix_memalign(&buffer, alignment, wb->size);
+        } else if ((buffer = malloc(wb->size)) == NULL) {
+            ret = -ENOMEM;
+        }
+        wb->buffers[i] = (uint8_t *) buffer;
+    }
+    if (ret == 0 && alignment > 1) {
+        memcpy(wb->buffers[0], header, headerSize);
+        wb->fill = headerSize;
+        wb->offset = 0;
+    } else {
+        wb->offset = headerSize;
+    }
+    // room to convert a frame which straddles the two buffers, see sf_writef()
+    if (ret == 0) {
+        uint8_t *temp = (uint8_t *) realloc(handle->temp, handle->bytesPerFrame);
+        if (temp != NULL) {
+            handle->temp = temp;
+        } else {
+            ret = -ENOMEM;
+        }
+    }
+    if (ret == 0 && (flags & SF_WRITE_BACKGROUND)) {
+        pthread_mutex_init(&wb->lock, NULL);
+        pthread_cond_init(&wb->cond, NULL);
+        ret = -pthread_create(&wb->thread, NULL, sf_write_thread, wb);
+        if (ret < 0) {
+            pthread_cond_destroy(&wb->cond);
+            pthread_mutex_destroy(&wb->lock);
+        }
+    }
+    if (ret < 0) {
+#ifdef O_DIRECT
+        if (alignment > 1) {
+            int fl = fcntl(wb->fd, F_GETFL);
+            (void) fcntl(wb->fd, F_SETFL, fl & ~O_DIRECT);
+        }
+#endif
+        free(wb->buffers[0]);
+        free(wb->buffers[1]);
+        free(wb);
+        return ret;
+    }
+    handle->writeBuffer = wb;
+    return 0;
+}
+
+// Write desiredFrames of client samples of sampleSize bytes, converted by convert,
+// or copied as is if convert is NULL.
+static sf_count_t sf_writef(SNDFILE *handle, const void *ptr, size_t sampleSize,
+        sf_convert_t convert, sf_count_t desiredFrames)
+{
+    size_t channels = handle->info.channels;
+    struct sf_write_buffer *wb = handle->writeBuffer;
+    if (wb == NULL) {
         // does not check for numeric overflow
-        if (isLittleEndian()) {
+        size_t desiredBytes = desiredFrames * handle->bytesPerFrame;
+        size_t actualBytes;
+        if (convert == NULL) {
             actualBytes = fwrite(ptr, sizeof(char), desiredBytes, handle->stream);
         } else {
             handle->temp = realloc(handle->temp, desiredBytes);
-            memcpy(handle->temp, ptr, desiredBytes);
-            my_swab((short *) handle->temp, desiredFrames * handle->info.channels);
+            convert(handle->temp, ptr, desiredFrames * channels);
             actualBytes = fwrite(handle->temp, sizeof(char), desiredBytes, handle->stream);
         }
-        break;
-    case SF_FORMAT_FLOAT:
-        handle->temp = realloc(handle->temp, desiredBytes);
-        memcpy_to_float_from_i16((float *) handle->temp, ptr,
-                desiredFrames * handle->info.channels);
-        actualBytes = fwrite(handle->temp, sizeof(char), desiredBytes, handle->stream);
-        break;
-    default:
-        break;
+        size_t actualFrames = actualBytes / handle->bytesPerFrame;
+        handle->remaining += actualFrames;
+        return actualFrames;
     }
-    size_t actualFrames = actualBytes / handle->bytesPerFrame;
+
+    // convert directly into the buffer; frames may straddle buffers, as the buffer size
+    // is only aligned for direct I/O
+    const uint8_t *src = (const uint8_t *) ptr;
+    size_t remainingBytes = desiredFrames * handle->bytesPerFrame;
+    size_t srcBytesPerFrame = sampleSize * channels;
+    if (sf_write_error(wb) < 0) {
+        return 0;
+    }
+    while (remainingBytes > 0) {
+        size_t available = wb->size - wb->fill;
+        uint8_t *dst = wb->buffers[wb->current] + wb->fill;
+        size_t frames = available / handle->bytesPerFrame;
+        if (frames == 0) {
+            // convert one frame aside and split it over the two buffers
+            uint8_t *frame = handle->temp;
+            if (convert == NULL) {
+                memcpy(frame, src, handle->bytesPerFrame);
+            } else {
+                convert(frame, src, channels);
+            }
+            memcpy(dst, frame, available);
+            wb->fill = wb->size;
+            if (sf_write_flush(wb) < 0) {
+                break;
+            }
+            memcpy(wb->buffers[wb->current], frame + available,
+                    handle->bytesPerFrame - available);
+            wb->fill = handle->bytesPerFrame - available;
+            frames = 1;
+        } else {
+            if (frames * handle->bytesPerFrame > remainingBytes) {
+                frames = remainingBytes / handle->bytesPerFrame;
+            }
+            if (convert == NULL) {
+                memcpy(dst, src, frames * handle->bytesPerFrame);
+            } else {
+                convert(dst, src, frames * channels);
+            }
+            wb->fill += frames * handle->bytesPerFrame;
+            if (wb->fill == wb->size && sf_write_flush(wb) < 0) {
+                src += frames * srcBytesPerFrame;
+                remainingBytes -= frames * handle->bytesPerFrame;
+                break;
+            }
+        }
+        src += frames * srcBytesPerFrame;
+        remainingBytes -= frames * handle->bytesPerFrame;
+    }
+    size_t actualFrames = desiredFrames - remainingBytes / handle->bytesPerFrame;
     handle->remaining += actualFrames;
     return actualFrames;
 }
 
+sf_count_t sf_writef_short(SNDFILE *handle, const short *ptr, sf_count_t desiredFrames)
+{
+    if (handle == NULL || handle->mode != SFM_WRITE || ptr == NULL || desiredFrames <= 0)
+        return 0;
+    switch (handle->info.format & SF_FORMAT_SUBMASK) {
+    case SF_FORMAT_PCM_U8:
+        return sf_writef(handle, ptr, sizeof(short), convert_u8_from_i16, desiredFrames);
+    case SF_FORMAT_PCM_16:
+        return sf_writef(handle, ptr, sizeof(short),
+                isLittleEndian() ? NULL : convert_swab_i16, desiredFrames);
+    case SF_FORMAT_FLOAT:
+        return sf_writef(handle, ptr, sizeof(short), convert_float_from_i16, desiredFrames);
+    case SF_FORMAT_PCM_24:
+        return sf_writef(handle, ptr, sizeof(short), convert_p24_from_i16, desiredFrames);
+    case SF_FORMAT_PCM_32:
+        return sf_writef(handle, ptr, sizeof(short), convert_i32_from_i16, desiredFrames);
+    default:
+        return 0;
+    }
+}
+
 sf_count_t sf_writef_float(SNDFILE *handle, const float *ptr, sf_count_t desiredFrames)
 {
     if (handle == NULL || handle->mode != SFM_WRITE || ptr == NULL || desiredFrames <= 0)
         return 0;
-    size_t desiredBytes = desiredFrames * handle->bytesPerFrame;
-    size_t actualBytes = 0;
     switch (handle->info.format & SF_FORMAT_SUBMASK) {
     case SF_FORMAT_FLOAT:
-        actualBytes = fwrite(ptr, sizeof(char), desiredBytes, handle->stream);
-        break;
+        return sf_writef(handle, ptr, sizeof(float), NULL, desiredFrames);
     case SF_FORMAT_PCM_16:
-        handle->temp = realloc(handle->temp, desiredBytes);
-        memcpy_to_i16_from_float((short *) handle->temp, ptr,
-                desiredFrames * handle->info.channels);
-        actualBytes = fwrite(handle->temp, sizeof(char), desiredBytes, handle->stream);
-        break;
-    case SF_FORMAT_PCM_U8:  // transcoding from float to byte not yet implemented
+        return sf_writef(handle, ptr, sizeof(float), convert_i16_from_float, desiredFrames);
+    case SF_FORMAT_PCM_U8:
+        return sf_writef(handle, ptr, sizeof(float), convert_u8_from_float, desiredFrames);
+    case SF_FORMAT_PCM_24:
+        return sf_writef(handle, ptr, sizeof(float), convert_p24_from_float, desiredFrames);
+    case SF_FORMAT_PCM_32:
+        return sf_writef(handle, ptr, sizeof(float), convert_i32_from_float, desiredFrames);
     default:
-        break;
+        return 0;
     }
-    size_t actualFrames = actualBytes / handle->bytesPerFrame;
-    handle->remaining += actualFrames;
-    return actualFrames;
 }
 
 sf_count_t sf_writef_int(SNDFILE *handle, const int *ptr, sf_count_t desiredFrames)
 {
     if (handle == NULL || handle->mode != SFM_WRITE || ptr == NULL || desiredFrames <= 0)
         return 0;
-    size_t desiredBytes = desiredFrames * handle->bytesPerFrame;
-    size_t actualBytes = 0;
     switch (handle->info.format & SF_FORMAT_SUBMASK) {
     case SF_FORMAT_PCM_32:
-        actualBytes = fwrite(ptr, sizeof(char), desiredBytes, handle->stream);
-        break;
-    default:    // transcoding from other formats not yet implemented
-        break;
+        return sf_writef(handle, ptr, sizeof(int), NULL, desiredFrames);
+    case SF_FORMAT_PCM_16:
+        return sf_writef(handle, ptr, sizeof(int), convert_i16_from_i32, desiredFrames);
+    case SF_FORMAT_PCM_24:
+        return sf_writef(handle, ptr, sizeof(int), convert_p24_from_i32, desiredFrames);
+    case SF_FORMAT_FLOAT:
+        return sf_writef(handle, ptr, sizeof(int), convert_float_from_i32, desiredFrames);
+    case SF_FORMAT_PCM_U8:  // transcoding from int to byte not yet implemented
+    default:
+        return 0;
     }
-    size_t actualFrames = actualBytes / handle->bytesPerFrame;
-    handle->remaining += actualFrames;
-    return actualFrames;
 }
@@ -0,0 +1,359 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "audio_utils_trace"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#endif
+#include <audio_utils/trace.h>
+#include <cutils/atomic.h>
+#include <cutils/log.h>
+
+#define RING_MASK (AUDIO_UTILS_TRACE_RING_EVENTS - 1)
+
+#if (AUDIO_UTILS_TRACE_RING_EVENTS & RING_MASK) != 0
+#error AUDIO_UTILS_TRACE_RING_EVENTS must be a power of 2
+#endif
+
+// dump_json() keeps a bit per ring
+#if AUDIO_UTILS_TRACE_MAX_THREADS > 32
+#error AUDIO_UTILS_TRACE_MAX_THREADS must be at most 32
+#endif
+
+enum {
+    EVENT_BEGIN,
+    EVENT_END,
+    EVENT_COUNTER,
+};
+
+struct trace_event {
+    int64_t time_ns;        // CLOCK_MONOTONIC
+    const char *name;       // NULL for EVENT_END
+    int32_t value;          // for EVENT_COUNTER
+    int32_t type;
+};
+
+// Written only by the owning thread; the dump reads the events published by mWritten,
+// and then re-reads mWritten to know which of them may have been overwritten meanwhile.
+struct trace_ring {
+    volatile int32_t mInUse;    // non-zero while owned by a thread
+    volatile int32_t mWritten;  // number of events ever written, modulo 2^32
+    volatile int32_t mStart;    // value of mWritten when the ring was claimed or reset
+    int32_t mTid;
+    char mThreadName[16];
+    struct trace_event mEvents[AUDIO_UTILS_TRACE_RING_EVENTS];
+};
+
+// Statically allocated so that the first event of a thread does not allocate memory.
+// The pages of a ring are only touched once a thread uses it.
+static struct trace_ring sRings[AUDIO_UTILS_TRACE_MAX_THREADS];
+
+// Events dropped because all rings were in use
+static volatile int32_t sDropped;
+
+static pthread_once_t sKeyOnce = PTHREAD_ONCE_INIT;
+static pthread_key_t sKey;
+// Thread specific value of a thread which could not get a ring
+static char sNoRing;
+
+static void trace_thread_exit(void *specific)
+{
+    if (specific != &sNoRing) {
+        android_atomic_release_store(0, &((struct trace_ring *) specific)->mInUse);
+    }
+}
+
+static void trace_key_init(void)
+{
+    pthread_key_create(&sKey, trace_thread_exit);
+}
+
+static struct trace_ring *trace_claim_ring(void)
+{
+    size_t i;
+    for (i = 0; i < AUDIO_UTILS_TRACE_MAX_THREADS; ++i) {
+        struct trace_ring *ring = &sRings[i];
+        if (android_atomic_acquire_load(&ring->mInUse) == 0 &&
+                android_atomic_cas(0, 1, &ring->mInUse) == 0) {
+#ifdef __linux__
+            ring->mTid = (int32_t) syscall(__NR_gettid);
+            prctl(PR_GET_NAME, ring->mThreadName, 0, 0, 0);
+            ring->mThreadName[sizeof(ring->mThreadName) - 1] = '\0';
+#else
+            ring->mTid = (int32_t) i;
+            strcpy(ring->mThreadName, "thread");
+#endif
+            // events of a previous owner are not attributed to this thread
+            android_atomic_release_store(ring->mWritten, &ring->mStart);
+            return ring;
+        }
+    }
+    return NULL;
+}
+
+static struct trace_ring *trace_get_ring(void)
+{
+    pthread_once(&sKeyOnce, trace_key_init);
+    void *specific = pthread_getspecific(sKey);
+    if (specific == NULL) {
+        specific = trace_claim_ring();
+        if (specific == NULL) {
+            ALOGW("no trace ring left, dropping the events of this thread");
+            specific = &sNoRing;
+        }
+        pthread_setspecific(sKey, specific);
+    }
+    if (specific == &sNoRing) {
+        android_atomic_inc(&sDropped);
+        return NULL;
+    }
+    return (struct trace_ring *) specific;
+}
+
+static void trace_record(int32_t type, const char *name, int32_t value)
+{
+    struct trace_ring *ring = trace_get_ring();
+    if (ring == NULL) {
+        return;
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    const uint32_t written = (uint32_t) ring->mWritten;
+    struct trace_event *event = &ring->mEvents[written & RING_MASK];
+    event->time_ns = (int64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+    event->name = name;
+    event->value = value;
+    event->type = type;
+    android_atomic_release_store((int32_t) (written + 1), &ring->mWritten);
+}
+
+void audio_utils_trace_begin(const char *name)
+{
+    trace_record(EVENT_BEGIN, name, 0);
+}
+
+void audio_utils_trace_end(void)
+{
+    trace_record(EVENT_END, NULL, 0);
+}
+
+void audio_utils_trace_counter(const char *name, int32_t value)
+{
+    trace_record(EVENT_COUNTER, name, value);
+}
+
+void audio_utils_trace_scope_end(int *scope __unused)
+{
+    audio_utils_trace_end();
+}
+
+void audio_utils_trace_reset(void)
+{
+    size_t i;
+    for (i = 0; i < AUDIO_UTILS_TRACE_MAX_THREADS; ++i) {
+        android_atomic_release_store(android_atomic_acquire_load(&sRings[i].mWritten),
+                &sRings[i].mStart);
+    }
+    android_atomic_release_store(0, &sDropped);
+}
+
+struct dump_event {
+    struct trace_event mEvent;
+    const struct trace_ring *mRing;
+    uint32_t mIndex;        // for a stable order of events with the same timestamp
+};
+
+static int dump_event_compare(const void *a, const void *b)
+{
+    const struct dump_event *ea = (const struct dump_event *) a;
+    const struct dump_event *eb = (const struct dump_event *) b;
+    if (ea->mEvent.time_ns != eb->mEvent.time_ns) {
+        return ea->mEvent.time_ns < eb->mEvent.time_ns ? -1 : 1;
+    }
+    if (ea->mRing != eb->mRing) {
+        return ea->mRing < eb->mRing ? -1 : 1;
+    }
+    return (int32_t) (ea->mIndex - eb->mIndex) < 0 ? -1 : 1;
+}
+
+// Copy the events of one ring which are still valid after the copy, and return their number.
+static size_t dump_collect_ring(const struct trace_ring *ring, struct dump_event *out)
+{
+    const uint32_t written = (uint32_t) android_atomic_acquire_load(&ring->mWritten);
+    const uint32_t start = (uint32_t) android_atomic_acquire_load(&ring->mStart);
+    uint32_t count = written - start;
+    if (count > AUDIO_UTILS_TRACE_RING_EVENTS) {
+        count = AUDIO_UTILS_TRACE_RING_EVENTS;
+    }
+    uint32_t i;
+    for (i = 0; i < count; ++i) {
+        const uint32_t index = written - count + i;
+        out[i].mEvent = ring->mEvents[index & RING_MASK];
+        out[i].mRing = ring;
+        out[i].mIndex = index;
+    }
+    // the copies must be complete before checking whether the writer lapped them
+    android_memory_barrier();
+    const uint32_t lapped = (uint32_t) android_atomic_acquire_load(&ring->mWritten) -
+            AUDIO_UTILS_TRACE_RING_EVENTS;
+    size_t valid = 0;
+    for (i = 0; i < count; ++i) {
+        // (index - lapped) wraps for the indices which may have been overwritten
+        if ((int32_t) (out[i].mIndex - lapped) >= 0) {
+            out[valid++] = out[i];
+        }
+    }
+    return valid;
+}
+
+// Thread names end up in the output and must not break its syntax.
+static void dump_sanitize_name(char *dst, const char *src, size_t size)
+{
+    size_t i;
+    for (i = 0; i + 1 < size && src[i] != '\0'; ++i) {
+        dst[i] = src[i] == '"' || src[i] == '\\' || src[i] == '|' || src[i] == ' ' ?
+                '_' : src[i];
+    }
+    dst[i] = '\0';
+}
+
+static int dump_systrace(int fd, const struct dump_event *events, size_t count)
+{
+    const int pid = getpid();
+    if (dprintf(fd, "# tracer: nop\n#\n") < 0) {
+        return -errno;
+    }
+    size_t i;
+    for (i = 0; i < count; ++i) {
+        const struct trace_event *event = &events[i].mEvent;
+        char name[sizeof(events[i].mRing->mThreadName)];
+        dump_sanitize_name(name, events[i].mRing->mThreadName, sizeof(name));
+        int ret = dprintf(fd, "%s-%d [000] .... %" PRId64 ".%06d: tracing_mark_write: ",
+                name, events[i].mRing->mTid, event->time_ns / 1000000000,
+                (int) (event->time_ns % 1000000000 / 1000));
+        if (ret >= 0) {
+            switch (event->type) {
+            case EVENT_BEGIN:
+                ret = dprintf(fd, "B|%d|%s\n", pid, event->name);
+                break;
+            case EVENT_END:
+                ret = dprintf(fd, "E|%d\n", pid);
+                break;
+            default:
+                ret = dprintf(fd, "C|%d|%s|%d\n", pid, event->name, event->value);
+                break;
+            }
+        }
+        if (ret < 0) {
+            return -errno;
+        }
+    }
+    return 0;
+}
+
+static int dump_json(int fd, const struct dump_event *events, size_t count)
+{
+    const int pid = getpid();
+    if (dprintf(fd, "{\"traceEvents\":[") < 0) {
+        return -errno;
+    }
+    const char *separator = "\n";
+    size_t i;
+    // thread names as metadata events, once for each ring with events
+    uint32_t named = 0;
+    for (i = 0; i < count; ++i) {
+        const struct trace_ring *ring = events[i].mRing;
+        const uint32_t bit = 1u << (ring - sRings);
+        if (named & bit) {
+            continue;
+        }
+        named |= bit;
+        char name[sizeof(ring->mThreadName)];
+        dump_sanitize_name(name, ring->mThreadName, sizeof(name));
+        if (dprintf(fd, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,"
+                "\"args\":{\"name\":\"%s\"}}", separator, pid, ring->mTid, name) < 0) {
+            return -errno;
+        }
+        separator = ",\n";
+    }
+    for (i = 0; i < count; ++i) {
+        const struct trace_event *event = &events[i].mEvent;
+        const int tid = events[i].mRing->mTid;
+        // timestamps are in microseconds
+        const int64_t us = event->time_ns / 1000;
+        const int ns = (int) (event->time_ns % 1000);
+        int ret;
+        switch (event->type) {
+        case EVENT_BEGIN:
+            ret = dprintf(fd, "%s{\"name\":\"%s\",\"ph\":\"B\",\"ts\":%" PRId64 ".%03d,"
+                    "\"pid\":%d,\"tid\":%d}", separator, event->name, us, ns, pid, tid);
+            break;
+        case EVENT_END:
+            ret = dprintf(fd, "%s{\"ph\":\"E\",\"ts\":%" PRId64 ".%03d,\"pid\":%d,\"tid\":%d}",
+                    separator, us, ns, pid, tid);
+            break;
+        default:
+            ret = dprintf(fd, "%s{\"name\":\"%s\",\"ph\":\"C\",\"ts\":%" PRId64 ".%03d,"
+                    "\"pid\":%d,\"tid\":%d,\"args\":{\"value\":%d}}",
+                    separator, event->name, us, ns, pid, tid, event->value);
+            break;
+        }
+        if (ret < 0) {
+            return -errno;
+        }
+        separator = ",\n";
+    }
+    if (dprintf(fd, "\n],\"displayTimeUnit\":\"ns\"}\n") < 0) {
+        return -errno;
+    }
+    return 0;
+}
+
+int audio_utils_trace_dump(int fd, enum audio_utils_trace_format format)
+{
+    if (format != AUDIO_UTILS_TRACE_FORMAT_SYSTRACE && format != AUDIO_UTILS_TRACE_FORMAT_JSON) {
+        return -EINVAL;
+    }
+    struct dump_event *events = (struct dump_event *) malloc(sizeof(struct dump_event) *
+            AUDIO_UTILS_TRACE_RING_EVENTS * AUDIO_UTILS_TRACE_MAX_THREADS);
+    if (events == NULL) {
+        return -ENOMEM;
+    }
+    size_t count = 0;
+    size_t i;
+    for (i = 0; i < AUDIO_UTILS_TRACE_MAX_THREADS; ++i) {
+        count += dump_collect_ring(&sRings[i], events + count);
+    }
+    qsort(events, count, sizeof(events[0]), dump_event_compare);
+    const int32_t dropped = android_atomic_acquire_load(&sDropped);
+    ALOGW_IF(dropped != 0, "%d events dropped for lack of a trace ring", dropped);
+
+    int status = format == AUDIO_UTILS_TRACE_FORMAT_SYSTRACE ?
+            dump_systrace(fd, events, count) : dump_json(fd, events, count);
+    free(events);
+    return status;
+}
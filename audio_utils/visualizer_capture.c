@@ -0,0 +1,216 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "audio_utils_visualizer_capture"
+
+#include <math.h>
+#include <stdlib.h>
+
+#include <audio_utils/fixedfft.h>
+#include <audio_utils/roundup.h>
+#include <audio_utils/trace.h>
+#include <audio_utils/visualizer_capture.h>
+
+/* The mono samples are kept in a ring large enough for both the capture and the meter window,
+ * indexed by the count of samples written so that the index of a sample never changes.
+ * The RMS is kept as the exact sum of the squares of the window, adding each new sample and
+ * subtracting the one leaving the window.  The peak is the front of a deque of the window samples
+ * which are larger than all later ones, so that each sample is pushed and popped at most once.
+ */
+struct visualizer_capture {
+    uint32_t capture_size;
+    uint32_t meter_window;
+    uint32_t ring_mask;         // ring size - 1, the ring size being a power of 2
+    uint32_t written;           // samples written, modulo 2^32
+    uint32_t window_count;      // min(written, meter_window)
+    int16_t *ring;              // latest samples, sample i at ring[i & ring_mask]
+    int64_t sum_squares;        // sum of the squares of the latest window_count samples
+    uint32_t *peaks;            // deque of indices of samples, ring_mask + 1 entries
+    uint32_t peak_front;        // count of indices popped from the front, modulo 2^32
+    uint32_t peak_back;         // count of indices pushed to the back, modulo 2^32
+    struct fixed_fft_plan *plan;    // for capture_size / 2 complex values
+    int32_t *workspace;         // capture_size / 2 values
+};
+
+struct visualizer_capture *visualizer_capture_create(size_t capture_size, size_t meter_window)
+{
+    if (capture_size < VISUALIZER_CAPTURE_MIN_SIZE || capture_size > VISUALIZER_CAPTURE_MAX_SIZE ||
+            (capture_size & (capture_size - 1)) != 0 ||
+            meter_window < 1 || meter_window > VISUALIZER_CAPTURE_MAX_METER_WINDOW) {
+        return NULL;
+    }
+    struct visualizer_capture *capture =
+            (struct visualizer_capture *) calloc(1, sizeof(*capture));
+    if (capture == NULL) {
+        return NULL;
+    }
+    capture->capture_size = capture_size;
+    capture->meter_window = meter_window;
+    const uint32_t ring_size = roundup(meter_window > capture_size ? meter_window : capture_size);
+    capture->ring_mask = ring_size - 1;
+    capture->ring = (int16_t *) malloc(ring_size * sizeof(int16_t));
+    capture->peaks = (uint32_t *) malloc(ring_size * sizeof(uint32_t));
+    capture->plan = fixed_fft_plan_create(capture_size / 2);
+    capture->workspace = (int32_t *) malloc((capture_size / 2) * sizeof(int32_t));
+    if (capture->ring == NULL || capture->peaks == NULL || capture->plan == NULL ||
+            capture->workspace == NULL) {
+        visualizer_capture_destroy(capture);
+        return NULL;
+    }
+    visualizer_capture_reset(capture);
+    return capture;
+}
+
+void visualizer_capture_destroy(struct visualizer_capture *capture)
+{
+    if (capture == NULL) {
+        return;
+    }
+    free(capture->ring);
+    free(capture->peaks);
+    fixed_fft_plan_destroy(capture->plan);
+    free(capture->workspace);
+    free(capture);
+}
+
+void visualizer_capture_reset(struct visualizer_capture *capture)
+{
+    capture->written = 0;
+    capture->window_count = 0;
+    capture->sum_squares = 0;
+    capture->peak_front = 0;
+    capture->peak_back = 0;
+}
+
+static inline int32_t magnitude(int16_t sample)
+{
+    return sample < 0 ? -(int32_t) sample : sample;
+}
+
+static inline void write_sample(struct visualizer_capture *capture, int16_t sample)
+{
+    const uint32_t mask = capture->ring_mask;
+    const uint32_t index = capture->written;
+
+    // the sample leaving the window is still in the ring, as the ring is at least as large
+    if (capture->window_count == capture->meter_window) {
+        const int32_t old = capture->ring[(index - capture->meter_window) & mask];
+        capture->sum_squares -= old * old;
+        if (capture->peaks[capture->peak_front & mask] == index - capture->meter_window) {
+            ++capture->peak_front;
+        }
+    } else {
+        ++capture->window_count;
+    }
+    capture->ring[index & mask] = sample;
+    capture->sum_squares += (int32_t) sample * sample;
+
+    const int32_t m = magnitude(sample);
+    while (capture->peak_back != capture->peak_front &&
+            magnitude(capture->ring[capture->peaks[(capture->peak_back - 1) & mask] & mask]) <= m) {
+        --capture->peak_back;
+    }
+    capture->peaks[capture->peak_back++ & mask] = index;
+    capture->written = index + 1;
+}
+
+void visualizer_capture_write(struct visualizer_capture *capture, const int16_t *buffer,
+        size_t frames, uint32_t channel_count)
+{
+    AUDIO_UTILS_TRACE_SCOPE("visualizer_capture_write");
+    switch (channel_count) {
+    case 1:
+        for (size_t i = 0; i < frames; ++i) {
+            write_sample(capture, buffer[i]);
+        }
+        break;
+    case 2:
+        for (size_t i = 0; i < frames; ++i, buffer += 2) {
+            write_sample(capture, (int16_t) (((int32_t) buffer[0] + buffer[1]) >> 1));
+        }
+        break;
+    default:
+        for (size_t i = 0; i < frames; ++i, buffer += channel_count) {
+            int32_t sum = 0;
+            for (uint32_t c = 0; c < channel_count; ++c) {
+                sum += buffer[c];
+            }
+            write_sample(capture, (int16_t) (sum / (int32_t) channel_count));
+        }
+        break;
+    }
+}
+
+static int32_t to_millibels(double level)
+{
+    return level > 0 ? (int32_t) (2000 * log10(level / 32767.)) : VISUALIZER_CAPTURE_SILENCE_MB;
+}
+
+void visualizer_capture_measure(const struct visualizer_capture *capture, int32_t *peak_mb,
+        int32_t *rms_mb)
+{
+    const uint32_t mask = capture->ring_mask;
+    if (peak_mb != NULL) {
+        *peak_mb = capture->peak_back == capture->peak_front ? VISUALIZER_CAPTURE_SILENCE_MB :
+                to_millibels(magnitude(
+                        capture->ring[capture->peaks[capture->peak_front & mask] & mask]));
+    }
+    if (rms_mb != NULL) {
+        *rms_mb = capture->window_count == 0 ? VISUALIZER_CAPTURE_SILENCE_MB :
+                to_millibels(sqrt((double) capture->sum_squares / capture->window_count));
+    }
+}
+
+// Return sample i of the latest capture, or 0 if it has not been written yet
+static inline int16_t capture_sample(const struct visualizer_capture *capture, uint32_t i)
+{
+    const uint32_t missing = capture->written < capture->capture_size ?
+            capture->capture_size - capture->written : 0;
+    return i < missing ? 0 :
+            capture->ring[(capture->written - capture->capture_size + i) & capture->ring_mask];
+}
+
+void visualizer_capture_waveform(const struct visualizer_capture *capture, uint8_t *waveform)
+{
+    for (uint32_t i = 0; i < capture->capture_size; ++i) {
+        waveform[i] = (uint8_t) ((capture_sample(capture, i) >> 8) ^ 0x80);
+    }
+}
+
+static inline int8_t clamp_fft(int16_t value)
+{
+    // as Visualizer::doFft(), halve rather than saturate out of range values
+    while (value > 127 || value < -128) {
+        value >>= 1;
+    }
+    return (int8_t) value;
+}
+
+void visualizer_capture_fft(struct visualizer_capture *capture, int8_t *fft)
+{
+    AUDIO_UTILS_TRACE_SCOPE("visualizer_capture_fft");
+    int32_t *workspace = capture->workspace;
+    for (uint32_t i = 0; i < capture->capture_size; i += 2) {
+        workspace[i >> 1] = ((uint32_t) (uint16_t) capture_sample(capture, i) << 16) |
+                (uint16_t) capture_sample(capture, i + 1);
+    }
+    fixed_fft_real_plan(capture->plan, workspace);
+    for (uint32_t i = 0; i < capture->capture_size; i += 2) {
+        fft[i] = clamp_fft((int16_t) (workspace[i >> 1] >> 21));
+        fft[i + 1] = clamp_fft((int16_t) ((int16_t) workspace[i >> 1] >> 5));
+    }
+}
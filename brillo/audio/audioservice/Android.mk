@@ -15,14 +15,20 @@
 LOCAL_PATH := $(call my-dir)
 
 audio_service_shared_libraries := \
+  libalsautils \
   libbinderwrapper \
   libbrillo \
   libbrillo-binder \
   libc \
   libchrome \
   libmedia \
+  libtinyalsa \
   libutils
 
+audio_service_c_includes := \
+  external/tinyalsa/include \
+  system/media/alsa_utils/include
+
 # Audio service.
 # =============================================================================
 include $(CLEAR_VARS)
@@ -31,6 +37,7 @@ LOCAL_SRC_FILES := \
   audio_daemon.cpp \
   audio_device_handler.cpp \
   main_audio_service.cpp
+LOCAL_C_INCLUDES := $(audio_service_c_includes)
 LOCAL_SHARED_LIBRARIES := $(audio_service_shared_libraries)
 LOCAL_CFLAGS := -Werror -Wall
 LOCAL_INIT_RC := brilloaudioserv.rc
@@ -43,10 +50,13 @@ LOCAL_MODULE := brilloaudioservice_test
 LOCAL_SRC_FILES := \
   audio_device_handler.cpp \
   test/audio_device_handler_test.cpp
-LOCAL_C_INCLUDES := external/gtest/include
+LOCAL_C_INCLUDES := \
+  $(audio_service_c_includes) \
+  external/gtest/include
 LOCAL_SHARED_LIBRARIES := $(audio_service_shared_libraries)
 LOCAL_STATIC_LIBRARIES := \
   libBionicGtestMain \
+  libbrillo-test-helpers \
   libchrome_test_helpers \
   libgmock
 LOCAL_CFLAGS := -Werror -Wall
@@ -17,25 +17,48 @@
 
 #include "audio_daemon.h"
 
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
 #include <sysexits.h>
 
+#include <algorithm>
+
 #include <base/bind.h>
 #include <base/files/file_enumerator.h>
 #include <base/files/file_path.h>
 #include <base/time/time.h>
 #include <binderwrapper/binder_wrapper.h>
 #include <linux/input.h>
+#include <linux/netlink.h>
 
 namespace brillo {
 
 static const char kAPSServiceName[] = "media.audio_policy";
 static const char kInputDeviceDir[] = "/dev/input";
+// Bounds of the delay between attempts to connect to the audio policy service.
+static const int kAPSRetryDelayMinMs = 20;
+static const int kAPSRetryDelayMaxMs = 500;
+// Time a jack state change must be stable for before it is applied.
+static const int kDebounceDelayMs = 50;
+// Time to wait for the node of a USB audio device before probing it again.
+static const int kUsbProbeRetryDelayMs = 100;
+// Maximum number of input events read at once.
+static const size_t kInputEventBatchSize = 64;
+// Size of the buffer a single uevent is received in.
+static const size_t kUeventBufferSize = 2048;
 
 void AudioDaemon::InitializeHandler() {
   // Start and initialize the audio device handler.
   audio_device_handler_ =
       std::unique_ptr<AudioDeviceHandler>(new AudioDeviceHandler());
-  audio_device_handler_->Init(aps_);
+  audio_device_handler_->SetDebounceDelay(
+      base::TimeDelta::FromMilliseconds(kDebounceDelayMs));
+  audio_device_handler_->SetUsbProbeRetryDelay(
+      base::TimeDelta::FromMilliseconds(kUsbProbeRetryDelayMs));
+  // Read the jack state now, it will be reported when the audio policy service
+  // is connected.
+  audio_device_handler_->LoadInitialState();
 
   // Poll on all files in kInputDeviceDir.
   base::FileEnumerator fenum(base::FilePath(kInputDeviceDir),
@@ -58,20 +81,47 @@ void AudioDaemon::InitializeHandler() {
                    << base::File::ErrorToString(file.error_details()) << ")";
     }
   }
-  handler_initialized_ = true;
+  InitializeUeventSocket();
+}
+
+void AudioDaemon::InitializeUeventSocket() {
+  uevent_fd_.reset(socket(PF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK,
+                          NETLINK_KOBJECT_UEVENT));
+  if (!uevent_fd_.is_valid()) {
+    PLOG(WARNING) << "Could not open uevent socket.";
+    return;
+  }
+  struct sockaddr_nl addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.nl_family = AF_NETLINK;
+  addr.nl_groups = 1;  // kernel uevents
+  if (bind(uevent_fd_.get(), reinterpret_cast<struct sockaddr*>(&addr),
+           sizeof(addr)) < 0) {
+    PLOG(WARNING) << "Could not bind uevent socket.";
+    uevent_fd_.reset();
+    return;
+  }
+  MessageLoop::current()->WatchFileDescriptor(
+      uevent_fd_.get(), MessageLoop::kWatchRead, true /*persistent*/,
+      base::Bind(&AudioDaemon::UeventCallback,
+                 weak_ptr_factory_.GetWeakPtr()));
 }
 
 void AudioDaemon::ConnectToAPS() {
   android::BinderWrapper* binder_wrapper = android::BinderWrapper::Get();
   auto binder = binder_wrapper->GetService(kAPSServiceName);
-  // If we didn't get the audio policy service, try again in 500 ms.
+  // If we didn't get the audio policy service, try again. The service is
+  // usually starting at the same time as us, so retry quickly at first.
   if (!binder.get()) {
     LOG(INFO) << "Could not connect to audio policy service. Trying again...";
     brillo::MessageLoop::current()->PostDelayedTask(
         base::Bind(&AudioDaemon::ConnectToAPS, weak_ptr_factory_.GetWeakPtr()),
-        base::TimeDelta::FromMilliseconds(500));
+        base::TimeDelta::FromMilliseconds(aps_retry_delay_ms_));
+    aps_retry_delay_ms_ =
+        std::min(aps_retry_delay_ms_ * 2, kAPSRetryDelayMaxMs);
     return;
   }
+  aps_retry_delay_ms_ = kAPSRetryDelayMinMs;
   LOG(INFO) << "Connected to audio policy service.";
   binder_wrapper->RegisterForDeathNotifications(
       binder,
@@ -79,10 +129,12 @@ void AudioDaemon::ConnectToAPS() {
                  weak_ptr_factory_.GetWeakPtr()));
   VLOG(1) << "Registered death notification.";
   aps_ = android::interface_cast<android::IAudioPolicyService>(binder);
-  if (!handler_initialized_)
-    InitializeHandler();
-  else
+  if (!handler_initialized_) {
+    audio_device_handler_->Init(aps_);
+    handler_initialized_ = true;
+  } else {
     audio_device_handler_->APSConnect(aps_);
+  }
 }
 
 void AudioDaemon::OnAPSDisconnected() {
@@ -93,9 +145,9 @@ void AudioDaemon::OnAPSDisconnected() {
 }
 
 // OnInit, we want to do the following:
+//   - Initialize the audio device handler with the current jack state.
+//   - Set up polling on files in /dev/input and on kernel uevents.
 //   - Get a binder to the audio policy service.
-//   - Initialize the audio device handler.
-//   - Set up polling on files in /dev/input.
 int AudioDaemon::OnInit() {
   int exit_code = Daemon::OnInit();
   if (exit_code != EX_OK) return exit_code;
@@ -103,19 +155,39 @@ int AudioDaemon::OnInit() {
   android::BinderWrapper::Create();
   // Initialize a binder watcher.
   binder_watcher_.Init();
+  InitializeHandler();
+  aps_retry_delay_ms_ = kAPSRetryDelayMinMs;
   ConnectToAPS();
   return EX_OK;
 }
 
 void AudioDaemon::Callback(base::File* file) {
-  input_event event;
-  int bytes_read =
-      file->ReadAtCurrentPos(reinterpret_cast<char*>(&event), sizeof(event));
-  if (bytes_read != sizeof(event)) {
-    LOG(WARNING) << "Couldn't read an input event.";
+  // evdev returns as many whole events as are pending and fit in the buffer.
+  input_event events[kInputEventBatchSize];
+  int bytes_read = file->ReadAtCurrentPosNoBestEffort(
+      reinterpret_cast<char*>(events), sizeof(events));
+  if (bytes_read <= 0 || bytes_read % sizeof(input_event) != 0) {
+    LOG(WARNING) << "Couldn't read input events.";
     return;
   }
-  audio_device_handler_->ProcessEvent(event);
+  audio_device_handler_->ProcessEvents(events,
+                                       bytes_read / sizeof(input_event));
+}
+
+void AudioDaemon::UeventCallback() {
+  char buffer[kUeventBufferSize];
+  // Drain the socket, a hotplug usually comes with a burst of uevents.
+  for (;;) {
+    ssize_t length = recv(uevent_fd_.get(), buffer, sizeof(buffer), 0);
+    if (length < 0) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+        PLOG(WARNING) << "Couldn't read a uevent.";
+      if (errno != EINTR)
+        return;
+      continue;
+    }
+    audio_device_handler_->ProcessUevent(buffer, length);
+  }
 }
 
 }  // namespace brillo
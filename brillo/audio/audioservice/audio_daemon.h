@@ -22,6 +22,7 @@
 #include <stack>
 
 #include <base/files/file.h>
+#include <base/files/scoped_file.h>
 #include <base/memory/weak_ptr.h>
 #include <brillo/binder_watcher.h>
 #include <brillo/daemons/daemon.h>
@@ -41,10 +42,18 @@ class AudioDaemon : public Daemon {
   int OnInit() override;
 
  private:
-  // Callback function for input events. Events are handled by the audio device
-  // handler.
+  // Callback function for input events. All the events available on |file|
+  // are read at once and handled as a batch by the audio device handler.
   void Callback(base::File* file);
 
+  // Callback function for the uevent socket. All pending uevents are read and
+  // handled by the audio device handler.
+  void UeventCallback();
+
+  // Open a netlink socket for kernel uevents and start polling it. Failure is
+  // not fatal, input events are still handled.
+  void InitializeUeventSocket();
+
   // Callback function for audio policy service death notification.
   void OnAPSDisconnected();
 
@@ -52,24 +61,28 @@ class AudioDaemon : public Daemon {
   // if the audio policy service dies.
   void ConnectToAPS();
 
-  // Initialize the audio_device_handler_.
-  //
-  // Note: This can only occur after we have connected to the audio policy
-  // service.
+  // Initialize the audio_device_handler_: read the initial jack state and
+  // start polling for jack events. This does not wait for the audio policy
+  // service, which is informed of the state once connected.
   void InitializeHandler();
 
   // Store the file objects that are created during initialization for the files
   // being polled. This is done so these objects can be freed when the
   // AudioDaemon object is destroyed.
   std::stack<base::File> files_;
+  // Netlink socket receiving kernel uevents.
+  base::ScopedFD uevent_fd_;
   // Handler for audio device input events.
   std::unique_ptr<AudioDeviceHandler> audio_device_handler_;
   // Used to generate weak_ptr to AudioDaemon for use in base::Bind.
   base::WeakPtrFactory<AudioDaemon> weak_ptr_factory_{this};
   // Pointer to the audio policy service.
   android::sp<android::IAudioPolicyService> aps_;
-  // Flag to indicate whether the handler has been initialized.
+  // Flag to indicate whether the handler has been initialized with the audio
+  // policy service.
   bool handler_initialized_ = false;
+  // Delay before the next attempt to connect to the audio policy service.
+  int aps_retry_delay_ms_ = 0;
   // Binder watcher to watch for binder messages.
   brillo::BinderWatcher binder_watcher_;
 };
@@ -17,13 +17,75 @@
 
 #include "audio_device_handler.h"
 
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <base/bind.h>
 #include <base/files/file.h>
+#include <base/files/file_enumerator.h>
+#include <base/files/file_util.h>
 #include <base/logging.h>
+#include <base/strings/stringprintf.h>
+#include <brillo/message_loops/message_loop.h>
 #include <media/AudioSystem.h>
 
+extern "C" {
+#include <alsa_device_profile.h>
+}
+
 namespace brillo {
 
 static const char kH2WStateFile[] = "/sys/class/switch/h2w/state";
+static const char kH2WSwitchName[] = "h2w";
+static const char kHdmiStateFile[] = "/sys/class/switch/hdmi/state";
+// Names of the HDMI switch used by different kernels.
+static const char* const kHdmiSwitchNames[] = {"hdmi", "hdmi_audio"};
+static const char kSoundClassDir[] = "/sys/class/sound";
+// Profiles of the USB devices seen before, so that they can be connected
+// without opening them again.
+static const char kUsbProfileCacheDir[] = "/data/misc/brilloaudioservice";
+// Number of times a USB device is probed before giving up on it.
+static const int kUsbProbeAttempts = 5;
+static const int kHeadPhoneMask = 0x1;
+static const int kMicrophoneMask = 0x2;
+
+// Returns true if |device| is one of the devices of the headset jack.
+static bool IsJackDevice(audio_devices_t device) {
+  return device == AUDIO_DEVICE_IN_WIRED_HEADSET ||
+         device == AUDIO_DEVICE_OUT_WIRED_HEADSET ||
+         device == AUDIO_DEVICE_OUT_WIRED_HEADPHONE;
+}
+
+// Returns true if a switch state file or uevent with |name| reports HDMI.
+static bool IsHdmiSwitch(const char* name) {
+  for (auto hdmi_name : kHdmiSwitchNames) {
+    if (!strcmp(name, hdmi_name))
+      return true;
+  }
+  return false;
+}
+
+// Parse the name of an ALSA PCM device node, e.g. "pcmC1D0p". Returns false if
+// |name| is not a PCM device.
+static bool ParsePcmName(const char* name, int* card, int* device,
+                         int* direction) {
+  char suffix;
+  if (sscanf(name, "pcmC%dD%d%c", card, device, &suffix) != 3)
+    return false;
+  if (suffix == 'p')
+    *direction = PCM_OUT;
+  else if (suffix == 'c')
+    *direction = PCM_IN;
+  else
+    return false;
+  return true;
+}
+
+// Returns the address the audio policy service knows a USB device by.
+static std::string UsbAddress(int card, int device) {
+  return base::StringPrintf("card=%d;device=%d", card, device);
+}
 
 AudioDeviceHandler::AudioDeviceHandler() {
   headphone_ = false;
@@ -32,6 +94,14 @@ AudioDeviceHandler::AudioDeviceHandler() {
 
 AudioDeviceHandler::~AudioDeviceHandler() {}
 
+void AudioDeviceHandler::SetDebounceDelay(base::TimeDelta delay) {
+  debounce_delay_ = delay;
+}
+
+void AudioDeviceHandler::SetUsbProbeRetryDelay(base::TimeDelta delay) {
+  usb_probe_retry_delay_ = delay;
+}
+
 void AudioDeviceHandler::APSDisconnect() {
   aps_.clear();
 }
@@ -43,8 +113,31 @@ void AudioDeviceHandler::APSConnect(
   connected_input_devices_.clear();
   connected_output_devices_.clear();
   // Inform audio policy service about the currently connected devices.
-  VLOG(1) << "Calling GetInitialAudioDeviceState on APSConnect.";
+  VLOG(1) << "Calling ReportAudioState on APSConnect.";
+  ReportAudioState();
+}
+
+void AudioDeviceHandler::LoadInitialState() {
   GetInitialAudioDeviceState(base::FilePath(kH2WStateFile));
+  GetInitialHdmiState(base::FilePath(kHdmiStateFile));
+  GetInitialUsbDevices();
+}
+
+void AudioDeviceHandler::ReportAudioState() {
+  if (state_cached_)
+    ApplyAudioState(cached_headphone_, cached_microphone_);
+  else
+    GetInitialAudioDeviceState(base::FilePath(kH2WStateFile));
+  if (hdmi_state_cached_)
+    ApplyHdmiState(cached_hdmi_);
+  else
+    GetInitialHdmiState(base::FilePath(kHdmiStateFile));
+  // USB devices are tracked by uevents, the policy service only needs to be
+  // told again.
+  for (const auto& usb_device : connected_usb_devices_) {
+    NotifyUsbDeviceState(usb_device.first, AUDIO_POLICY_DEVICE_STATE_AVAILABLE,
+                         usb_device.second);
+  }
 }
 
 void AudioDeviceHandler::Init(android::sp<android::IAudioPolicyService> aps) {
@@ -56,8 +149,8 @@ void AudioDeviceHandler::Init(android::sp<android::IAudioPolicyService> aps) {
   DisconnectAllSupportedDevices();
 
   // Get headphone jack state and update audio policy service with new state.
-  VLOG(1) << "Calling ReadInitialAudioDeviceState.";
-  GetInitialAudioDeviceState(base::FilePath(kH2WStateFile));
+  VLOG(1) << "Calling ReportAudioState.";
+  ReportAudioState();
 }
 
 void AudioDeviceHandler::GetInitialAudioDeviceState(
@@ -77,12 +170,154 @@ void AudioDeviceHandler::GetInitialAudioDeviceState(
     return;
   }
   VLOG(1) << "Initial audio jack state is " << state;
-  static const int kHeadPhoneMask = 0x1;
   bool headphone = state & kHeadPhoneMask;
-  static const int kMicrophoneMask = 0x2;
   bool microphone = (state & kMicrophoneMask) >> 1;
 
-  UpdateAudioSystem(headphone, microphone);
+  // The state file is not subject to contact bounce. Supersede any deferred
+  // update so that a stale one does not override this state.
+  debounce_generation_++;
+  ApplyAudioState(headphone, microphone);
+}
+
+void AudioDeviceHandler::GetInitialHdmiState(const base::FilePath& path) {
+  std::string state;
+  if (!base::ReadFileToString(path, &state) || state.empty()) {
+    VLOG(1) << "No HDMI switch state in " << path.value();
+    return;
+  }
+  ApplyHdmiState(state[0] != '0');
+}
+
+void AudioDeviceHandler::ApplyHdmiState(bool connected) {
+  hdmi_state_cached_ = true;
+  cached_hdmi_ = connected;
+  bool was_connected =
+      connected_output_devices_.find(AUDIO_DEVICE_OUT_AUX_DIGITAL) !=
+      connected_output_devices_.end();
+  if (connected && !was_connected)
+    ConnectAudioDevice(AUDIO_DEVICE_OUT_AUX_DIGITAL);
+  else if (!connected && was_connected)
+    DisconnectAudioDevice(AUDIO_DEVICE_OUT_AUX_DIGITAL);
+}
+
+void AudioDeviceHandler::GetInitialUsbDevices() {
+  // The entries of the sound class are links to the devices, whose path tells
+  // which bus they are on.
+  base::FileEnumerator fenum(
+      base::FilePath(kSoundClassDir), false /*recursive*/,
+      base::FileEnumerator::FILES | base::FileEnumerator::DIRECTORIES);
+  for (base::FilePath name = fenum.Next(); !name.empty(); name = fenum.Next()) {
+    int card, device, direction;
+    if (!ParsePcmName(name.BaseName().value().c_str(), &card, &device,
+                      &direction))
+      continue;
+    base::FilePath devpath = base::MakeAbsoluteFilePath(name);
+    if (devpath.value().find("/usb") == std::string::npos)
+      continue;
+    ConnectUsbDevice(card, device, direction);
+  }
+}
+
+void AudioDeviceHandler::ProcessSoundUevent(const char* action,
+                                            const char* devname,
+                                            const char* devpath) {
+  static const char kSoundDevPrefix[] = "snd/";
+  if (strncmp(devname, kSoundDevPrefix, sizeof(kSoundDevPrefix) - 1))
+    return;
+  int card, device, direction;
+  if (!ParsePcmName(devname + sizeof(kSoundDevPrefix) - 1, &card, &device,
+                    &direction))
+    return;
+  if (!strstr(devpath, "/usb"))
+    return;
+  if (!strcmp(action, "add"))
+    ConnectUsbDevice(card, device, direction);
+  else if (!strcmp(action, "remove"))
+    DisconnectUsbDevice(card, device, direction);
+}
+
+bool AudioDeviceHandler::ProbeUsbDevice(int card, int device, int direction) {
+  alsa_device_profile profile;
+  profile_init(&profile, direction);
+  profile.card = card;
+  profile.device = device;
+  if (!profile_read_device_info_cached(&profile, kUsbProfileCacheDir))
+    return false;
+  VLOG(1) << "USB device " << UsbAddress(card, device) << " rates "
+          << profile.sample_rate_strs << " formats " << profile.format_strs
+          << " channels " << profile.channel_count_strs;
+  return true;
+}
+
+void AudioDeviceHandler::NotifyUsbDeviceState(audio_devices_t device,
+                                              audio_policy_dev_state_t state,
+                                              const std::string& address) {
+  if (aps_ == nullptr) {
+    LOG(INFO) << "Audio device handler cannot call audio policy service. Will "
+              << "try again later.";
+    return;
+  }
+  VLOG(1) << "Calling Audio Policy Service to change " << device << " at "
+          << address << " to state " << state;
+  aps_->setDeviceConnectionState(device, state, address.c_str(), "");
+}
+
+void AudioDeviceHandler::ConnectUsbDevice(int card, int device,
+                                          int direction) {
+  audio_devices_t audio_device = direction == PCM_OUT
+                                     ? AUDIO_DEVICE_OUT_USB_DEVICE
+                                     : AUDIO_DEVICE_IN_USB_DEVICE;
+  auto usb_device = std::make_pair(audio_device, UsbAddress(card, device));
+  // A device waiting for a retry is already being connected.
+  if (pending_usb_devices_.find(usb_device) != pending_usb_devices_.end())
+    return;
+  pending_usb_devices_.insert(usb_device);
+  RetryConnectUsbDevice(card, device, direction, 1);
+}
+
+void AudioDeviceHandler::RetryConnectUsbDevice(int card, int device,
+                                               int direction, int attempt) {
+  audio_devices_t audio_device = direction == PCM_OUT
+                                     ? AUDIO_DEVICE_OUT_USB_DEVICE
+                                     : AUDIO_DEVICE_IN_USB_DEVICE;
+  auto usb_device = std::make_pair(audio_device, UsbAddress(card, device));
+  // The device was removed since the previous attempt.
+  if (pending_usb_devices_.erase(usb_device) == 0)
+    return;
+  if (connected_usb_devices_.find(usb_device) != connected_usb_devices_.end())
+    return;
+  if (!ProbeUsbDevice(card, device, direction)) {
+    if (usb_probe_retry_delay_.is_zero() || attempt >= kUsbProbeAttempts) {
+      LOG(WARNING) << "Could not read the profile of USB device "
+                   << usb_device.second;
+      return;
+    }
+    VLOG(1) << "Probing USB device " << usb_device.second << " again.";
+    pending_usb_devices_.insert(usb_device);
+    MessageLoop::current()->PostDelayedTask(
+        base::Bind(&AudioDeviceHandler::RetryConnectUsbDevice,
+                   weak_ptr_factory_.GetWeakPtr(), card, device, direction,
+                   attempt + 1),
+        usb_probe_retry_delay_);
+    return;
+  }
+  NotifyUsbDeviceState(audio_device, AUDIO_POLICY_DEVICE_STATE_AVAILABLE,
+                       usb_device.second);
+  connected_usb_devices_.insert(usb_device);
+}
+
+void AudioDeviceHandler::DisconnectUsbDevice(int card, int device,
+                                             int direction) {
+  audio_devices_t audio_device = direction == PCM_OUT
+                                     ? AUDIO_DEVICE_OUT_USB_DEVICE
+                                     : AUDIO_DEVICE_IN_USB_DEVICE;
+  auto usb_device = std::make_pair(audio_device, UsbAddress(card, device));
+  // Cancel the retry of a device that was never read.
+  pending_usb_devices_.erase(usb_device);
+  if (connected_usb_devices_.erase(usb_device) == 0)
+    return;
+  NotifyUsbDeviceState(audio_device, AUDIO_POLICY_DEVICE_STATE_UNAVAILABLE,
+                       usb_device.second);
 }
 
 void AudioDeviceHandler::NotifyAudioPolicyService(
@@ -136,41 +371,152 @@ void AudioDeviceHandler::DisconnectAllConnectedDevices() {
 }
 
 void AudioDeviceHandler::UpdateAudioSystem(bool headphone, bool microphone) {
+  if (debounce_delay_.is_zero()) {
+    ApplyAudioState(headphone, microphone);
+    return;
+  }
+  // Restart the debounce window, only the last state reported in it counts.
+  pending_headphone_ = headphone;
+  pending_microphone_ = microphone;
+  MessageLoop::current()->PostDelayedTask(
+      base::Bind(&AudioDeviceHandler::OnDebounceTimeout,
+                 weak_ptr_factory_.GetWeakPtr(), ++debounce_generation_),
+      debounce_delay_);
+}
+
+void AudioDeviceHandler::OnDebounceTimeout(uint64_t generation) {
+  if (generation != debounce_generation_)
+    return;
+  ApplyAudioState(pending_headphone_, pending_microphone_);
+}
+
+void AudioDeviceHandler::ApplyAudioState(bool headphone, bool microphone) {
+  state_cached_ = true;
+  cached_headphone_ = headphone;
+  cached_microphone_ = microphone;
+
+  std::set<audio_devices_t> input_devices;
+  std::set<audio_devices_t> output_devices;
   if (microphone) {
-    ConnectAudioDevice(AUDIO_DEVICE_IN_WIRED_HEADSET);
+    input_devices.insert(AUDIO_DEVICE_IN_WIRED_HEADSET);
   }
   if (headphone && microphone) {
-    ConnectAudioDevice(AUDIO_DEVICE_OUT_WIRED_HEADSET);
+    output_devices.insert(AUDIO_DEVICE_OUT_WIRED_HEADSET);
   } else if (headphone) {
-    ConnectAudioDevice(AUDIO_DEVICE_OUT_WIRED_HEADPHONE);
-  } else if (!microphone) {
-    // No devices are connected. Inform the audio policy service that all
-    // connected devices have been disconnected.
-    DisconnectAllConnectedDevices();
+    output_devices.insert(AUDIO_DEVICE_OUT_WIRED_HEADPHONE);
+  }
+
+  // Disconnect the devices that went away before connecting the new ones, so
+  // that the policy does not route to both during a headset/headphone swap.
+  std::vector<audio_devices_t> removed;
+  for (auto device : connected_input_devices_) {
+    if (IsJackDevice(device) &&
+        input_devices.find(device) == input_devices.end())
+      removed.push_back(device);
+  }
+  for (auto device : connected_output_devices_) {
+    if (IsJackDevice(device) &&
+        output_devices.find(device) == output_devices.end())
+      removed.push_back(device);
+  }
+  for (auto device : removed) {
+    DisconnectAudioDevice(device);
+  }
+  for (auto device : input_devices) {
+    if (connected_input_devices_.find(device) == connected_input_devices_.end())
+      ConnectAudioDevice(device);
+  }
+  for (auto device : output_devices) {
+    if (connected_output_devices_.find(device) ==
+        connected_output_devices_.end())
+      ConnectAudioDevice(device);
   }
 }
 
 void AudioDeviceHandler::ProcessEvent(const struct input_event& event) {
-  VLOG(1) << event.type << " " << event.code << " " << event.value;
-  if (event.type == EV_SW) {
-    switch (event.code) {
-      case SW_HEADPHONE_INSERT:
-        headphone_ = event.value;
-        break;
-      case SW_MICROPHONE_INSERT:
-        microphone_ = event.value;
-        break;
-      default:
-        // This event code is not supported by this handler.
-        break;
+  ProcessEvents(&event, 1);
+}
+
+void AudioDeviceHandler::ProcessEvents(const struct input_event* events,
+                                       size_t count) {
+  bool report_complete = false;
+  bool headphone = false;
+  bool microphone = false;
+  for (size_t i = 0; i < count; i++) {
+    const struct input_event& event = events[i];
+    VLOG(1) << event.type << " " << event.code << " " << event.value;
+    if (event.type == EV_SW) {
+      switch (event.code) {
+        case SW_HEADPHONE_INSERT:
+          headphone_ = event.value;
+          break;
+        case SW_MICROPHONE_INSERT:
+          microphone_ = event.value;
+          break;
+        default:
+          // This event code is not supported by this handler.
+          break;
+      }
+    } else if (event.type == EV_SYN) {
+      // We have received all input events of a report. Keep its state until
+      // the end of the batch, later reports replace it.
+      report_complete = true;
+      headphone = headphone_;
+      microphone = microphone_;
+      // Reset the headphone and microphone flags that are used to track
+      // information across multiple calls to ProcessEvent.
+      headphone_ = false;
+      microphone_ = false;
     }
-  } else if (event.type == EV_SYN) {
-    // We have received all input events. Update the audio system.
-    UpdateAudioSystem(headphone_, microphone_);
-    // Reset the headphone and microphone flags that are used to track
-    // information across multiple calls to ProcessEvent.
-    headphone_ = false;
-    microphone_ = false;
+  }
+  if (report_complete)
+    UpdateAudioSystem(headphone, microphone);
+}
+
+void AudioDeviceHandler::ProcessUevent(const char* buffer, size_t length) {
+  const char* action = nullptr;
+  const char* devname = nullptr;
+  const char* devpath = nullptr;
+  const char* subsystem = nullptr;
+  const char* switch_name = nullptr;
+  const char* switch_state = nullptr;
+  // Values are used as C strings, so the buffer has to be NUL terminated.
+  if (length == 0 || buffer[length - 1] != '\0')
+    return;
+  // Skip the "action@devpath" header, then walk the KEY=value pairs.
+  const char* end = buffer + length;
+  for (const char* field = buffer + strnlen(buffer, length) + 1; field < end;
+       field += strnlen(field, end - field) + 1) {
+    if (!strncmp(field, "ACTION=", 7))
+      action = field + 7;
+    else if (!strncmp(field, "DEVNAME=", 8))
+      devname = field + 8;
+    else if (!strncmp(field, "DEVPATH=", 8))
+      devpath = field + 8;
+    else if (!strncmp(field, "SUBSYSTEM=", 10))
+      subsystem = field + 10;
+    else if (!strncmp(field, "SWITCH_NAME=", 12))
+      switch_name = field + 12;
+    else if (!strncmp(field, "SWITCH_STATE=", 13))
+      switch_state = field + 13;
+  }
+  if (subsystem == nullptr)
+    return;
+  if (!strcmp(subsystem, "sound")) {
+    if (action != nullptr && devname != nullptr && devpath != nullptr)
+      ProcessSoundUevent(action, devname, devpath);
+    return;
+  }
+  if (strcmp(subsystem, "switch") || switch_name == nullptr ||
+      switch_state == nullptr)
+    return;
+  int state = atoi(switch_state);
+  if (!strcmp(switch_name, kH2WSwitchName)) {
+    VLOG(1) << "Audio jack state changed to " << state;
+    UpdateAudioSystem(state & kHeadPhoneMask, (state & kMicrophoneMask) >> 1);
+  } else if (IsHdmiSwitch(switch_name)) {
+    VLOG(1) << "HDMI state changed to " << state;
+    ApplyHdmiState(state != 0);
   }
 }
 
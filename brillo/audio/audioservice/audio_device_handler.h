@@ -13,17 +13,22 @@
 // limitations under the License.
 //
 
-// Handler for input events in /dev/input. AudioDeviceHandler handles events
-// only for audio devices being plugged in/removed from the system. Implements
-// some of the functionality present in WiredAccessoryManager.java.
+// Handler for input events in /dev/input and kernel uevents. AudioDeviceHandler
+// handles events only for audio devices being plugged in/removed from the
+// system: the headset jack, HDMI and USB audio devices. Implements some of the
+// functionality present in WiredAccessoryManager.java and UsbAlsaManager.java.
 
 #ifndef BRILLO_AUDIO_AUDIOSERVICE_AUDIO_DEVICE_HANDLER_H_
 #define BRILLO_AUDIO_AUDIOSERVICE_AUDIO_DEVICE_HANDLER_H_
 
 #include <set>
+#include <string>
+#include <utility>
 #include <vector>
 
 #include <base/files/file_path.h>
+#include <base/memory/weak_ptr.h>
+#include <base/time/time.h>
 #include <gtest/gtest_prod.h>
 #include <linux/input.h>
 #include <media/IAudioPolicyService.h>
@@ -37,8 +42,15 @@ class AudioDeviceHandler {
   AudioDeviceHandler();
   virtual ~AudioDeviceHandler();
 
+  // Read the current state of the headset jack and HDMI, and probe the USB
+  // audio devices already present, without waiting for the audio policy
+  // service. Jack events received afterwards keep the state up to
+  // date, so that Init() and APSConnect() do not need to read it again.
+  void LoadInitialState();
+
   // Get the current state of the headset jack and update AudioSystem based on
-  // the initial state.
+  // the initial state. The state cached by LoadInitialState() or by later jack
+  // events is used if there is one.
   //
   // |aps| is a pointer to the binder object.
   void Init(android::sp<android::IAudioPolicyService> aps);
@@ -51,6 +63,37 @@ class AudioDeviceHandler {
   // provided by this class.
   void ProcessEvent(const struct input_event& event);
 
+  // Process a batch of input events read at once. Only the last complete
+  // report (terminated by EV_SYN) in the batch updates the audio policy
+  // service, since it supersedes the earlier ones.
+  //
+  // |events| is an array of |count| input events.
+  void ProcessEvents(const struct input_event* events, size_t count);
+
+  // Process a kernel uevent. Switch state changes of the wired headset jack and
+  // of HDMI, and USB audio PCM devices being added or removed update the audio
+  // policy service, other uevents are ignored.
+  //
+  // |buffer| holds the |length| bytes of the uevent as received from the
+  // netlink socket: a header followed by NUL separated KEY=value pairs.
+  void ProcessUevent(const char* buffer, size_t length);
+
+  // Set the time jack state changes must be stable for before the audio policy
+  // service is updated. Contact bounce while plugging produces bursts of
+  // reports, of which only the last one is applied. A zero delay (the
+  // default) applies every change immediately.
+  //
+  // |delay| is the debounce window. A non zero delay requires a MessageLoop.
+  void SetDebounceDelay(base::TimeDelta delay);
+
+  // Set the time to wait before probing a USB PCM device again when it could
+  // not be read. The add uevent of a device can arrive before ueventd has
+  // created its node in /dev/snd, so it is probed a few times. A zero delay
+  // (the default) probes it only once.
+  //
+  // |delay| is the retry delay. A non zero delay requires a MessageLoop.
+  void SetUsbProbeRetryDelay(base::TimeDelta delay);
+
   // Inform the handler that the audio policy service has been disconnected.
   void APSDisconnect();
 
@@ -64,6 +107,8 @@ class AudioDeviceHandler {
   FRIEND_TEST(AudioDeviceHandlerTest,
               DisconnectAllSupportedDevicesCallsDisconnect);
   FRIEND_TEST(AudioDeviceHandlerTest, InitCallsDisconnectAllSupportedDevices);
+  FRIEND_TEST(AudioDeviceHandlerTest, InitUsesCachedState);
+  FRIEND_TEST(AudioDeviceHandlerTest, APSConnectUsesCachedState);
   FRIEND_TEST(AudioDeviceHandlerTest, InitialAudioStateMic);
   FRIEND_TEST(AudioDeviceHandlerTest, InitialAudioStateHeadphone);
   FRIEND_TEST(AudioDeviceHandlerTest, InitialAudioStateHeadset);
@@ -75,6 +120,18 @@ class AudioDeviceHandler {
   FRIEND_TEST(AudioDeviceHandlerTest, ProcessEventMicrophoneNotPresent);
   FRIEND_TEST(AudioDeviceHandlerTest, ProcessEventHeadphoneNotPresent);
   FRIEND_TEST(AudioDeviceHandlerTest, ProcessEventInvalid);
+  FRIEND_TEST(AudioDeviceHandlerTest, ProcessEventsCoalescesReports);
+  FRIEND_TEST(AudioDeviceHandlerTest, ProcessEventsPartialReport);
+  FRIEND_TEST(AudioDeviceHandlerTest, ProcessUeventH2WState);
+  FRIEND_TEST(AudioDeviceHandlerTest, ProcessUeventOtherSwitch);
+  FRIEND_TEST(AudioDeviceHandlerTest, ProcessUeventHdmi);
+  FRIEND_TEST(AudioDeviceHandlerTest, ProcessUeventUsbAddRemove);
+  FRIEND_TEST(AudioDeviceHandlerTest, ProcessUeventUsbProbeFails);
+  FRIEND_TEST(AudioDeviceHandlerTest, ProcessUeventUsbProbeRetries);
+  FRIEND_TEST(AudioDeviceHandlerTest, ProcessUeventUsbProbeGivesUp);
+  FRIEND_TEST(AudioDeviceHandlerTest, ProcessUeventUsbRemovedBeforeRetry);
+  FRIEND_TEST(AudioDeviceHandlerTest, ProcessUeventNotUsb);
+  FRIEND_TEST(AudioDeviceHandlerTest, APSConnectReportsUsbDevices);
   FRIEND_TEST(AudioDeviceHandlerTest, UpdateAudioSystemNone);
   FRIEND_TEST(AudioDeviceHandlerTest, UpdateAudioSystemConnectMic);
   FRIEND_TEST(AudioDeviceHandlerTest, UpdateAudioSystemConnectHeadphone);
@@ -82,6 +139,10 @@ class AudioDeviceHandler {
   FRIEND_TEST(AudioDeviceHandlerTest, UpdateAudioSystemDisconnectMic);
   FRIEND_TEST(AudioDeviceHandlerTest, UpdateAudioSystemDisconnectHeadphone);
   FRIEND_TEST(AudioDeviceHandlerTest, UpdateAudioSystemDisconnectHeadset);
+  FRIEND_TEST(AudioDeviceHandlerTest, UpdateAudioSystemNoChange);
+  FRIEND_TEST(AudioDeviceHandlerTest, UpdateAudioSystemHeadsetToHeadphone);
+  FRIEND_TEST(AudioDeviceHandlerTest, UpdateAudioSystemDebouncesBurst);
+  FRIEND_TEST(AudioDeviceHandlerTest, InitialAudioStateSupersedesDebounce);
   FRIEND_TEST(AudioDeviceHandlerTest, ConnectAudioDeviceInput);
   FRIEND_TEST(AudioDeviceHandlerTest, ConnectAudioDeviceOutput);
   FRIEND_TEST(AudioDeviceHandlerTest, DisconnectAudioDeviceInput);
@@ -93,12 +154,88 @@ class AudioDeviceHandler {
   // |path| is the file that contains the initial audio jack state.
   void GetInitialAudioDeviceState(const base::FilePath& path);
 
-  // Update the audio policy service once an input_event has completed.
+  // Update the audio policy service once an input_event has completed. The
+  // update is deferred by the debounce delay, see SetDebounceDelay().
   //
   // |headphone| is true is headphones are connected.
   // |microphone| is true is microphones are connected.
   void UpdateAudioSystem(bool headphone, bool microphone);
 
+  // Bring the connected devices in line with the jack state. Only the devices
+  // whose state differs from connected_input_devices_ and
+  // connected_output_devices_ are notified to the audio policy service.
+  //
+  // |headphone| is true is headphones are connected.
+  // |microphone| is true is microphones are connected.
+  void ApplyAudioState(bool headphone, bool microphone);
+
+  // Inform the audio policy service of the cached jack, HDMI and USB state, or
+  // of the state in the switch state files if none is cached.
+  void ReportAudioState();
+
+  // Read the initial state of HDMI and update the audio policy service.
+  //
+  // |path| is the file that contains the HDMI switch state.
+  void GetInitialHdmiState(const base::FilePath& path);
+
+  // Connect or disconnect the HDMI output.
+  //
+  // |connected| is true if an HDMI sink is connected.
+  void ApplyHdmiState(bool connected);
+
+  // Probe and connect the USB audio PCM devices listed in /sys/class/sound.
+  void GetInitialUsbDevices();
+
+  // Handle the add or remove uevent of an ALSA PCM device. Only USB devices
+  // are handled.
+  //
+  // |action| is the uevent action.
+  // |devname| is the device node name, e.g. "snd/pcmC1D0p".
+  // |devpath| is the sysfs path of the device.
+  void ProcessSoundUevent(const char* action, const char* devname,
+                          const char* devpath);
+
+  // Read the capabilities of a USB PCM device through the alsa_device_profile
+  // cache. Returns true if the device is usable.
+  //
+  // |card| and |device| are the ALSA card and device numbers.
+  // |direction| is PCM_OUT or PCM_IN.
+  virtual bool ProbeUsbDevice(int card, int device, int direction);
+
+  // Notify the audio policy service of the state of a USB device.
+  //
+  // |device| is AUDIO_DEVICE_OUT_USB_DEVICE or AUDIO_DEVICE_IN_USB_DEVICE.
+  // |state| is the current state of |device|.
+  // |address| is the "card=X;device=Y" address of |device|.
+  virtual void NotifyUsbDeviceState(audio_devices_t device,
+                                    audio_policy_dev_state_t state,
+                                    const std::string& address);
+
+  // Probe a USB PCM device and connect it if it is usable. A device that cannot
+  // be read is probed again later, see SetUsbProbeRetryDelay().
+  //
+  // |card| and |device| are the ALSA card and device numbers.
+  // |direction| is PCM_OUT or PCM_IN.
+  void ConnectUsbDevice(int card, int device, int direction);
+
+  // Probe a USB PCM device again if it was not removed since the previous
+  // attempt, and connect it if it is usable.
+  //
+  // |card| and |device| are the ALSA card and device numbers.
+  // |direction| is PCM_OUT or PCM_IN.
+  // |attempt| is the number of this attempt, starting at 1.
+  void RetryConnectUsbDevice(int card, int device, int direction, int attempt);
+
+  // Disconnect a USB PCM device if it is connected.
+  //
+  // |card| and |device| are the ALSA card and device numbers.
+  // |direction| is PCM_OUT or PCM_IN.
+  void DisconnectUsbDevice(int card, int device, int direction);
+
+  // Apply the pending jack state if no change was reported since the update
+  // numbered |generation| was scheduled.
+  void OnDebounceTimeout(uint64_t generation);
+
   // Notify the audio policy service that this device has been removed.
   //
   // |device| is the audio device whose state is to be changed.
@@ -125,12 +262,15 @@ class AudioDeviceHandler {
   // Disconnect all supported audio devices.
   void DisconnectAllSupportedDevices();
 
-  // All input devices currently supported by AudioDeviceHandler.
+  // All input devices currently supported by AudioDeviceHandler, except USB
+  // devices which are connected by address.
   std::vector<audio_devices_t> kSupportedInputDevices_{
       AUDIO_DEVICE_IN_WIRED_HEADSET};
-  // All output devices currently supported by AudioDeviceHandler.
+  // All output devices currently supported by AudioDeviceHandler, except USB
+  // devices which are connected by address.
   std::vector<audio_devices_t> kSupportedOutputDevices_{
-      AUDIO_DEVICE_OUT_WIRED_HEADSET, AUDIO_DEVICE_OUT_WIRED_HEADPHONE};
+      AUDIO_DEVICE_OUT_WIRED_HEADSET, AUDIO_DEVICE_OUT_WIRED_HEADPHONE,
+      AUDIO_DEVICE_OUT_AUX_DIGITAL};
   // Pointer to the audio policy service.
   android::sp<android::IAudioPolicyService> aps_;
 
@@ -139,12 +279,34 @@ class AudioDeviceHandler {
   std::set<audio_devices_t> connected_input_devices_;
   // Set of connected output devices.
   std::set<audio_devices_t> connected_output_devices_;
+  // Set of connected USB devices and their addresses.
+  std::set<std::pair<audio_devices_t, std::string>> connected_usb_devices_;
+  // Set of USB devices waiting to be probed again, and their addresses.
+  std::set<std::pair<audio_devices_t, std::string>> pending_usb_devices_;
   // Keeps track of whether a headphone has been connected. Used by ProcessEvent
   // and UpdateAudioSystem.
   bool headphone_;
   // Keeps track of whether a microphone has been connected. Used by
   // ProcessEvent and UpdateAudioSystem.
   bool microphone_;
+  // Last jack state applied, valid if state_cached_ is true.
+  bool state_cached_ = false;
+  bool cached_headphone_ = false;
+  bool cached_microphone_ = false;
+  // Last HDMI state applied, valid if hdmi_state_cached_ is true.
+  bool hdmi_state_cached_ = false;
+  bool cached_hdmi_ = false;
+  // Debounce window for jack state changes.
+  base::TimeDelta debounce_delay_;
+  // Delay between the probes of a USB device that could not be read.
+  base::TimeDelta usb_probe_retry_delay_;
+  // Number of the latest deferred update. Earlier scheduled updates are stale.
+  uint64_t debounce_generation_ = 0;
+  // Jack state to apply at the end of the debounce window.
+  bool pending_headphone_ = false;
+  bool pending_microphone_ = false;
+  // Used to generate weak_ptr to AudioDeviceHandler for use in base::Bind.
+  base::WeakPtrFactory<AudioDeviceHandler> weak_ptr_factory_{this};
 };
 
 }  // namespace brillo
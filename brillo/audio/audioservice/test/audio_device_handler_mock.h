@@ -18,6 +18,8 @@
 #ifndef BRILLO_AUDIO_AUDIOSERVICE_TEST_AUDIO_DEVICE_HANDLER_MOCK_H_
 #define BRILLO_AUDIO_AUDIOSERVICE_TEST_AUDIO_DEVICE_HANDLER_MOCK_H_
 
+#include <string>
+
 #include <base/files/file_path.h>
 #include <gmock/gmock.h>
 #include <gtest/gtest_prod.h>
@@ -37,8 +39,12 @@ class AudioDeviceHandlerMock : public AudioDeviceHandler {
   void Reset() {
     connected_input_devices_.clear();
     connected_output_devices_.clear();
+    connected_usb_devices_.clear();
+    pending_usb_devices_.clear();
     headphone_ = false;
     microphone_ = false;
+    state_cached_ = false;
+    hdmi_state_cached_ = false;
   }
 
  private:
@@ -46,6 +52,8 @@ class AudioDeviceHandlerMock : public AudioDeviceHandler {
   FRIEND_TEST(AudioDeviceHandlerTest,
               DisconnectAllSupportedDevicesCallsDisconnect);
   FRIEND_TEST(AudioDeviceHandlerTest, InitCallsDisconnectAllSupportedDevices);
+  FRIEND_TEST(AudioDeviceHandlerTest, InitUsesCachedState);
+  FRIEND_TEST(AudioDeviceHandlerTest, APSConnectUsesCachedState);
   FRIEND_TEST(AudioDeviceHandlerTest, InitialAudioStateMic);
   FRIEND_TEST(AudioDeviceHandlerTest, InitialAudioStateHeadphone);
   FRIEND_TEST(AudioDeviceHandlerTest, InitialAudioStateHeadset);
@@ -58,6 +66,18 @@ class AudioDeviceHandlerMock : public AudioDeviceHandler {
   FRIEND_TEST(AudioDeviceHandlerTest, ProcessEventMicrophoneNotPresent);
   FRIEND_TEST(AudioDeviceHandlerTest, ProcessEventHeadphoneNotPresent);
   FRIEND_TEST(AudioDeviceHandlerTest, ProcessEventInvalid);
+  FRIEND_TEST(AudioDeviceHandlerTest, ProcessEventsCoalescesReports);
+  FRIEND_TEST(AudioDeviceHandlerTest, ProcessEventsPartialReport);
+  FRIEND_TEST(AudioDeviceHandlerTest, ProcessUeventH2WState);
+  FRIEND_TEST(AudioDeviceHandlerTest, ProcessUeventOtherSwitch);
+  FRIEND_TEST(AudioDeviceHandlerTest, ProcessUeventHdmi);
+  FRIEND_TEST(AudioDeviceHandlerTest, ProcessUeventUsbAddRemove);
+  FRIEND_TEST(AudioDeviceHandlerTest, ProcessUeventUsbProbeFails);
+  FRIEND_TEST(AudioDeviceHandlerTest, ProcessUeventUsbProbeRetries);
+  FRIEND_TEST(AudioDeviceHandlerTest, ProcessUeventUsbProbeGivesUp);
+  FRIEND_TEST(AudioDeviceHandlerTest, ProcessUeventUsbRemovedBeforeRetry);
+  FRIEND_TEST(AudioDeviceHandlerTest, ProcessUeventNotUsb);
+  FRIEND_TEST(AudioDeviceHandlerTest, APSConnectReportsUsbDevices);
   FRIEND_TEST(AudioDeviceHandlerTest, UpdateAudioSystemNone);
   FRIEND_TEST(AudioDeviceHandlerTest, UpdateAudioSystemConnectMic);
   FRIEND_TEST(AudioDeviceHandlerTest, UpdateAudioSystemConnectHeadphone);
@@ -65,6 +85,10 @@ class AudioDeviceHandlerMock : public AudioDeviceHandler {
   FRIEND_TEST(AudioDeviceHandlerTest, UpdateAudioSystemDisconnectMic);
   FRIEND_TEST(AudioDeviceHandlerTest, UpdateAudioSystemDisconnectHeadphone);
   FRIEND_TEST(AudioDeviceHandlerTest, UpdateAudioSystemDisconnectHeadset);
+  FRIEND_TEST(AudioDeviceHandlerTest, UpdateAudioSystemNoChange);
+  FRIEND_TEST(AudioDeviceHandlerTest, UpdateAudioSystemHeadsetToHeadphone);
+  FRIEND_TEST(AudioDeviceHandlerTest, UpdateAudioSystemDebouncesBurst);
+  FRIEND_TEST(AudioDeviceHandlerTest, InitialAudioStateSupersedesDebounce);
   FRIEND_TEST(AudioDeviceHandlerTest, ConnectAudioDeviceInput);
   FRIEND_TEST(AudioDeviceHandlerTest, ConnectAudioDeviceOutput);
   FRIEND_TEST(AudioDeviceHandlerTest, DisconnectAudioDeviceInput);
@@ -72,6 +96,10 @@ class AudioDeviceHandlerMock : public AudioDeviceHandler {
 
   MOCK_METHOD2(NotifyAudioPolicyService,
                void(audio_devices_t device, audio_policy_dev_state_t state));
+  MOCK_METHOD3(ProbeUsbDevice, bool(int card, int device, int direction));
+  MOCK_METHOD3(NotifyUsbDeviceState,
+               void(audio_devices_t device, audio_policy_dev_state_t state,
+                    const std::string& address));
 };
 
 }  // namespace brillo
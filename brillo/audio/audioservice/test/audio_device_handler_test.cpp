@@ -23,8 +23,10 @@
 #include <base/files/file_util.h>
 #include <base/files/scoped_temp_dir.h>
 #include <base/strings/string_number_conversions.h>
+#include <brillo/message_loops/fake_message_loop.h>
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
+#include <tinyalsa/asoundlib.h>
 
 using base::FilePath;
 using base::IntToString;
@@ -41,6 +43,7 @@ class AudioDeviceHandlerTest : public testing::Test {
   void SetUp() override {
     EXPECT_TRUE(temp_dir_.CreateUniqueTempDir());
     h2w_file_path_ = temp_dir_.path().Append("h2wstate");
+    loop_.SetAsCurrent();
   }
 
   void TearDown() override { handler_.Reset(); }
@@ -53,6 +56,13 @@ class AudioDeviceHandlerTest : public testing::Test {
     WriteFile(h2w_file_path_, value_string.c_str(), value_string.length());
   }
 
+  // Run the posted tasks, including the delayed ones, until none is left.
+  void RunLoop() {
+    while (loop_.RunOnce(false /* may_block */)) {
+    }
+  }
+
+  FakeMessageLoop loop_{nullptr};
   AudioDeviceHandlerMock handler_;
   FilePath h2w_file_path_;
 
@@ -65,7 +75,7 @@ class AudioDeviceHandlerTest : public testing::Test {
 TEST_F(AudioDeviceHandlerTest, DisconnectAllSupportedDevicesCallsDisconnect) {
   EXPECT_CALL(handler_,
               NotifyAudioPolicyService(
-                  _, AUDIO_POLICY_DEVICE_STATE_UNAVAILABLE)).Times(3);
+                  _, AUDIO_POLICY_DEVICE_STATE_UNAVAILABLE)).Times(4);
   handler_.DisconnectAllSupportedDevices();
 }
 
@@ -73,13 +83,47 @@ TEST_F(AudioDeviceHandlerTest, DisconnectAllSupportedDevicesCallsDisconnect) {
 TEST_F(AudioDeviceHandlerTest, InitCallsDisconnectAllSupportedDevices) {
   EXPECT_CALL(handler_,
               NotifyAudioPolicyService(
-                  _, AUDIO_POLICY_DEVICE_STATE_UNAVAILABLE)).Times(3);
+                  _, AUDIO_POLICY_DEVICE_STATE_UNAVAILABLE)).Times(4);
   EXPECT_CALL(handler_,
               NotifyAudioPolicyService(
                   _, AUDIO_POLICY_DEVICE_STATE_AVAILABLE)).Times(AnyNumber());
   handler_.Init(nullptr);
 }
 
+// Test that Init() reports the state read before it was called.
+TEST_F(AudioDeviceHandlerTest, InitUsesCachedState) {
+  WriteToH2WFile(1);
+  EXPECT_CALL(handler_,
+              NotifyAudioPolicyService(
+                  _, AUDIO_POLICY_DEVICE_STATE_UNAVAILABLE)).Times(4);
+  EXPECT_CALL(handler_,
+              NotifyAudioPolicyService(AUDIO_DEVICE_OUT_WIRED_HEADPHONE,
+                                       AUDIO_POLICY_DEVICE_STATE_AVAILABLE))
+      .Times(2);
+  handler_.GetInitialAudioDeviceState(h2w_file_path_);
+  handler_.Init(nullptr);
+  EXPECT_EQ(handler_.connected_input_devices_.size(), 0);
+  EXPECT_NE(
+      handler_.connected_output_devices_.find(AUDIO_DEVICE_OUT_WIRED_HEADPHONE),
+      handler_.connected_output_devices_.end());
+}
+
+// Test that APSConnect() reports the state of the last jack event again.
+TEST_F(AudioDeviceHandlerTest, APSConnectUsesCachedState) {
+  EXPECT_CALL(handler_,
+              NotifyAudioPolicyService(AUDIO_DEVICE_IN_WIRED_HEADSET,
+                                       AUDIO_POLICY_DEVICE_STATE_AVAILABLE))
+      .Times(2);
+  EXPECT_CALL(handler_,
+              NotifyAudioPolicyService(AUDIO_DEVICE_OUT_WIRED_HEADSET,
+                                       AUDIO_POLICY_DEVICE_STATE_AVAILABLE))
+      .Times(2);
+  handler_.UpdateAudioSystem(true, true);
+  handler_.APSConnect(nullptr);
+  EXPECT_EQ(handler_.connected_input_devices_.size(), 1);
+  EXPECT_EQ(handler_.connected_output_devices_.size(), 1);
+}
+
 // Test GetInitialAudioDeviceState() with just a microphone.
 TEST_F(AudioDeviceHandlerTest, InitialAudioStateMic) {
   WriteToH2WFile(2);
@@ -210,6 +254,221 @@ TEST_F(AudioDeviceHandlerTest, ProcessEventInvalid) {
   EXPECT_FALSE(handler_.microphone_);
 }
 
+// Test that ProcessEvents() only updates the audio system for the last
+// complete report of a batch.
+TEST_F(AudioDeviceHandlerTest, ProcessEventsCoalescesReports) {
+  struct input_event events[] = {
+      {{0, 0}, EV_SW, SW_HEADPHONE_INSERT, 1},
+      {{0, 0}, EV_SW, SW_MICROPHONE_INSERT, 1},
+      {{0, 0}, EV_SYN, SYN_REPORT, 0},
+      {{0, 0}, EV_SW, SW_HEADPHONE_INSERT, 1},
+      {{0, 0}, EV_SW, SW_MICROPHONE_INSERT, 0},
+      {{0, 0}, EV_SYN, SYN_REPORT, 0},
+  };
+  EXPECT_CALL(handler_,
+              NotifyAudioPolicyService(AUDIO_DEVICE_OUT_WIRED_HEADPHONE,
+                                       AUDIO_POLICY_DEVICE_STATE_AVAILABLE));
+  handler_.ProcessEvents(events, sizeof(events) / sizeof(events[0]));
+  EXPECT_EQ(handler_.connected_input_devices_.size(), 0);
+  EXPECT_EQ(handler_.connected_output_devices_.size(), 1);
+  EXPECT_FALSE(handler_.headphone_);
+  EXPECT_FALSE(handler_.microphone_);
+}
+
+// Test that ProcessEvents() keeps the state of a report that continues in the
+// next batch.
+TEST_F(AudioDeviceHandlerTest, ProcessEventsPartialReport) {
+  struct input_event events[] = {
+      {{0, 0}, EV_SW, SW_MICROPHONE_INSERT, 1},
+  };
+  EXPECT_CALL(handler_, NotifyAudioPolicyService(_, _)).Times(0);
+  handler_.ProcessEvents(events, sizeof(events) / sizeof(events[0]));
+  EXPECT_TRUE(handler_.microphone_);
+}
+
+// Test ProcessUevent() with a headset jack switch uevent.
+TEST_F(AudioDeviceHandlerTest, ProcessUeventH2WState) {
+  static const char kUevent[] =
+      "change@/devices/virtual/switch/h2w\0ACTION=change\0"
+      "DEVPATH=/devices/virtual/switch/h2w\0SUBSYSTEM=switch\0"
+      "SWITCH_NAME=h2w\0SWITCH_STATE=3";
+  EXPECT_CALL(handler_,
+              NotifyAudioPolicyService(AUDIO_DEVICE_IN_WIRED_HEADSET,
+                                       AUDIO_POLICY_DEVICE_STATE_AVAILABLE));
+  EXPECT_CALL(handler_,
+              NotifyAudioPolicyService(AUDIO_DEVICE_OUT_WIRED_HEADSET,
+                                       AUDIO_POLICY_DEVICE_STATE_AVAILABLE));
+  handler_.ProcessUevent(kUevent, sizeof(kUevent));
+  EXPECT_EQ(handler_.connected_input_devices_.size(), 1);
+  EXPECT_EQ(handler_.connected_output_devices_.size(), 1);
+}
+
+// Test that ProcessUevent() ignores other switches.
+TEST_F(AudioDeviceHandlerTest, ProcessUeventOtherSwitch) {
+  static const char kUevent[] =
+      "change@/devices/virtual/switch/dock\0ACTION=change\0"
+      "SUBSYSTEM=switch\0SWITCH_NAME=dock\0SWITCH_STATE=1";
+  EXPECT_CALL(handler_, NotifyAudioPolicyService(_, _)).Times(0);
+  handler_.ProcessUevent(kUevent, sizeof(kUevent));
+  EXPECT_EQ(handler_.connected_input_devices_.size(), 0);
+  EXPECT_EQ(handler_.connected_output_devices_.size(), 0);
+}
+
+// Test ProcessUevent() with HDMI switch uevents.
+TEST_F(AudioDeviceHandlerTest, ProcessUeventHdmi) {
+  static const char kConnect[] =
+      "change@/devices/virtual/switch/hdmi\0ACTION=change\0"
+      "SUBSYSTEM=switch\0SWITCH_NAME=hdmi\0SWITCH_STATE=1";
+  static const char kDisconnect[] =
+      "change@/devices/virtual/switch/hdmi\0ACTION=change\0"
+      "SUBSYSTEM=switch\0SWITCH_NAME=hdmi\0SWITCH_STATE=0";
+  EXPECT_CALL(handler_,
+              NotifyAudioPolicyService(AUDIO_DEVICE_OUT_AUX_DIGITAL,
+                                       AUDIO_POLICY_DEVICE_STATE_AVAILABLE));
+  handler_.ProcessUevent(kConnect, sizeof(kConnect));
+  EXPECT_EQ(handler_.connected_output_devices_.size(), 1);
+  // A jack update leaves HDMI connected.
+  handler_.UpdateAudioSystem(false, false);
+  EXPECT_EQ(handler_.connected_output_devices_.size(), 1);
+  EXPECT_CALL(handler_,
+              NotifyAudioPolicyService(AUDIO_DEVICE_OUT_AUX_DIGITAL,
+                                       AUDIO_POLICY_DEVICE_STATE_UNAVAILABLE));
+  handler_.ProcessUevent(kDisconnect, sizeof(kDisconnect));
+  EXPECT_EQ(handler_.connected_output_devices_.size(), 0);
+}
+
+// Test ProcessUevent() with a USB playback device being added and removed.
+TEST_F(AudioDeviceHandlerTest, ProcessUeventUsbAddRemove) {
+  static const char kAdd[] =
+      "add@/devices/platform/xhci/usb1/1-1/1-1:1.0/sound/card1/pcmC1D0p\0"
+      "ACTION=add\0"
+      "DEVPATH=/devices/platform/xhci/usb1/1-1/1-1:1.0/sound/card1/pcmC1D0p\0"
+      "SUBSYSTEM=sound\0DEVNAME=snd/pcmC1D0p";
+  static const char kRemove[] =
+      "remove@/devices/platform/xhci/usb1/1-1/1-1:1.0/sound/card1/pcmC1D0p\0"
+      "ACTION=remove\0"
+      "DEVPATH=/devices/platform/xhci/usb1/1-1/1-1:1.0/sound/card1/pcmC1D0p\0"
+      "SUBSYSTEM=sound\0DEVNAME=snd/pcmC1D0p";
+  EXPECT_CALL(handler_, ProbeUsbDevice(1, 0, PCM_OUT))
+      .WillOnce(testing::Return(true));
+  EXPECT_CALL(handler_,
+              NotifyUsbDeviceState(AUDIO_DEVICE_OUT_USB_DEVICE,
+                                   AUDIO_POLICY_DEVICE_STATE_AVAILABLE,
+                                   "card=1;device=0"));
+  handler_.ProcessUevent(kAdd, sizeof(kAdd));
+  EXPECT_EQ(handler_.connected_usb_devices_.size(), 1);
+  EXPECT_CALL(handler_,
+              NotifyUsbDeviceState(AUDIO_DEVICE_OUT_USB_DEVICE,
+                                   AUDIO_POLICY_DEVICE_STATE_UNAVAILABLE,
+                                   "card=1;device=0"));
+  handler_.ProcessUevent(kRemove, sizeof(kRemove));
+  EXPECT_EQ(handler_.connected_usb_devices_.size(), 0);
+}
+
+// Test that a USB device whose profile cannot be read is not connected.
+TEST_F(AudioDeviceHandlerTest, ProcessUeventUsbProbeFails) {
+  static const char kAdd[] =
+      "add@/devices/platform/xhci/usb1/1-1/1-1:1.0/sound/card1/pcmC1D0c\0"
+      "ACTION=add\0"
+      "DEVPATH=/devices/platform/xhci/usb1/1-1/1-1:1.0/sound/card1/pcmC1D0c\0"
+      "SUBSYSTEM=sound\0DEVNAME=snd/pcmC1D0c";
+  EXPECT_CALL(handler_, ProbeUsbDevice(1, 0, PCM_IN))
+      .WillOnce(testing::Return(false));
+  EXPECT_CALL(handler_, NotifyUsbDeviceState(_, _, _)).Times(0);
+  handler_.ProcessUevent(kAdd, sizeof(kAdd));
+  EXPECT_EQ(handler_.connected_usb_devices_.size(), 0);
+}
+
+// Test that a USB device whose node is not there yet is probed again.
+TEST_F(AudioDeviceHandlerTest, ProcessUeventUsbProbeRetries) {
+  static const char kAdd[] =
+      "add@/devices/platform/xhci/usb1/1-1/1-1:1.0/sound/card1/pcmC1D0p\0"
+      "ACTION=add\0"
+      "DEVPATH=/devices/platform/xhci/usb1/1-1/1-1:1.0/sound/card1/pcmC1D0p\0"
+      "SUBSYSTEM=sound\0DEVNAME=snd/pcmC1D0p";
+  handler_.SetUsbProbeRetryDelay(base::TimeDelta::FromMilliseconds(100));
+  EXPECT_CALL(handler_, ProbeUsbDevice(1, 0, PCM_OUT))
+      .WillOnce(testing::Return(false))
+      .WillOnce(testing::Return(true));
+  EXPECT_CALL(handler_,
+              NotifyUsbDeviceState(AUDIO_DEVICE_OUT_USB_DEVICE,
+                                   AUDIO_POLICY_DEVICE_STATE_AVAILABLE,
+                                   "card=1;device=0"));
+  handler_.ProcessUevent(kAdd, sizeof(kAdd));
+  EXPECT_EQ(handler_.connected_usb_devices_.size(), 0);
+  RunLoop();
+  EXPECT_EQ(handler_.connected_usb_devices_.size(), 1);
+  EXPECT_EQ(handler_.pending_usb_devices_.size(), 0);
+}
+
+// Test that a USB device that cannot be read is probed a bounded number of
+// times.
+TEST_F(AudioDeviceHandlerTest, ProcessUeventUsbProbeGivesUp) {
+  static const char kAdd[] =
+      "add@/devices/platform/xhci/usb1/1-1/1-1:1.0/sound/card1/pcmC1D0p\0"
+      "ACTION=add\0"
+      "DEVPATH=/devices/platform/xhci/usb1/1-1/1-1:1.0/sound/card1/pcmC1D0p\0"
+      "SUBSYSTEM=sound\0DEVNAME=snd/pcmC1D0p";
+  handler_.SetUsbProbeRetryDelay(base::TimeDelta::FromMilliseconds(100));
+  EXPECT_CALL(handler_, ProbeUsbDevice(1, 0, PCM_OUT))
+      .Times(5)
+      .WillRepeatedly(testing::Return(false));
+  EXPECT_CALL(handler_, NotifyUsbDeviceState(_, _, _)).Times(0);
+  handler_.ProcessUevent(kAdd, sizeof(kAdd));
+  RunLoop();
+  EXPECT_EQ(handler_.connected_usb_devices_.size(), 0);
+  EXPECT_EQ(handler_.pending_usb_devices_.size(), 0);
+}
+
+// Test that a USB device removed before it could be read is not probed again.
+TEST_F(AudioDeviceHandlerTest, ProcessUeventUsbRemovedBeforeRetry) {
+  static const char kAdd[] =
+      "add@/devices/platform/xhci/usb1/1-1/1-1:1.0/sound/card1/pcmC1D0c\0"
+      "ACTION=add\0"
+      "DEVPATH=/devices/platform/xhci/usb1/1-1/1-1:1.0/sound/card1/pcmC1D0c\0"
+      "SUBSYSTEM=sound\0DEVNAME=snd/pcmC1D0c";
+  static const char kRemove[] =
+      "remove@/devices/platform/xhci/usb1/1-1/1-1:1.0/sound/card1/pcmC1D0c\0"
+      "ACTION=remove\0"
+      "DEVPATH=/devices/platform/xhci/usb1/1-1/1-1:1.0/sound/card1/pcmC1D0c\0"
+      "SUBSYSTEM=sound\0DEVNAME=snd/pcmC1D0c";
+  handler_.SetUsbProbeRetryDelay(base::TimeDelta::FromMilliseconds(100));
+  EXPECT_CALL(handler_, ProbeUsbDevice(1, 0, PCM_IN))
+      .WillOnce(testing::Return(false));
+  EXPECT_CALL(handler_, NotifyUsbDeviceState(_, _, _)).Times(0);
+  handler_.ProcessUevent(kAdd, sizeof(kAdd));
+  handler_.ProcessUevent(kRemove, sizeof(kRemove));
+  RunLoop();
+  EXPECT_EQ(handler_.connected_usb_devices_.size(), 0);
+  EXPECT_EQ(handler_.pending_usb_devices_.size(), 0);
+}
+
+// Test that PCM devices which are not on USB are ignored.
+TEST_F(AudioDeviceHandlerTest, ProcessUeventNotUsb) {
+  static const char kAdd[] =
+      "add@/devices/platform/soc-audio/sound/card0/pcmC0D0p\0ACTION=add\0"
+      "DEVPATH=/devices/platform/soc-audio/sound/card0/pcmC0D0p\0"
+      "SUBSYSTEM=sound\0DEVNAME=snd/pcmC0D0p";
+  EXPECT_CALL(handler_, ProbeUsbDevice(_, _, _)).Times(0);
+  handler_.ProcessUevent(kAdd, sizeof(kAdd));
+  EXPECT_EQ(handler_.connected_usb_devices_.size(), 0);
+}
+
+// Test that APSConnect() reports the connected USB devices again.
+TEST_F(AudioDeviceHandlerTest, APSConnectReportsUsbDevices) {
+  EXPECT_CALL(handler_, ProbeUsbDevice(2, 1, PCM_IN))
+      .WillOnce(testing::Return(true));
+  EXPECT_CALL(handler_,
+              NotifyUsbDeviceState(AUDIO_DEVICE_IN_USB_DEVICE,
+                                   AUDIO_POLICY_DEVICE_STATE_AVAILABLE,
+                                   "card=2;device=1"))
+      .Times(2);
+  EXPECT_CALL(handler_, NotifyAudioPolicyService(_, _)).Times(AnyNumber());
+  handler_.ConnectUsbDevice(2, 1, PCM_IN);
+  handler_.APSConnect(nullptr);
+  EXPECT_EQ(handler_.connected_usb_devices_.size(), 1);
+}
+
 // Test UpdateAudioSystem() without any devices connected.
 TEST_F(AudioDeviceHandlerTest, UpdateAudioSystemNone) {
   EXPECT_CALL(handler_,
@@ -261,6 +520,75 @@ TEST_F(AudioDeviceHandlerTest, UpdateAudioSystemDisconnectHeadset) {
   EXPECT_EQ(handler_.connected_output_devices_.size(), 0);
 }
 
+// Test that UpdateAudioSystem() does not notify devices whose state did not
+// change.
+TEST_F(AudioDeviceHandlerTest, UpdateAudioSystemNoChange) {
+  handler_.connected_output_devices_.insert(AUDIO_DEVICE_OUT_WIRED_HEADPHONE);
+  EXPECT_CALL(handler_, NotifyAudioPolicyService(_, _)).Times(0);
+  handler_.UpdateAudioSystem(true, false);
+  EXPECT_EQ(handler_.connected_input_devices_.size(), 0);
+  EXPECT_EQ(handler_.connected_output_devices_.size(), 1);
+}
+
+// Test that only the last state of a burst of jack changes within the debounce
+// window is applied.
+TEST_F(AudioDeviceHandlerTest, UpdateAudioSystemDebouncesBurst) {
+  handler_.SetDebounceDelay(base::TimeDelta::FromMilliseconds(50));
+  EXPECT_CALL(handler_, NotifyAudioPolicyService(_, _)).Times(0);
+  EXPECT_CALL(handler_,
+              NotifyAudioPolicyService(AUDIO_DEVICE_OUT_WIRED_HEADPHONE,
+                                       AUDIO_POLICY_DEVICE_STATE_AVAILABLE));
+  handler_.UpdateAudioSystem(true, true);
+  handler_.UpdateAudioSystem(false, false);
+  handler_.UpdateAudioSystem(true, false);
+  EXPECT_EQ(handler_.connected_output_devices_.size(), 0);
+  RunLoop();
+  EXPECT_EQ(handler_.connected_input_devices_.size(), 0);
+  EXPECT_NE(
+      handler_.connected_output_devices_.find(AUDIO_DEVICE_OUT_WIRED_HEADPHONE),
+      handler_.connected_output_devices_.end());
+}
+
+// Test that the state file read by GetInitialAudioDeviceState() is not
+// overridden by a jack change still in its debounce window.
+TEST_F(AudioDeviceHandlerTest, InitialAudioStateSupersedesDebounce) {
+  handler_.SetDebounceDelay(base::TimeDelta::FromMilliseconds(50));
+  WriteToH2WFile(1);
+  EXPECT_CALL(handler_, NotifyAudioPolicyService(_, _)).Times(0);
+  EXPECT_CALL(handler_,
+              NotifyAudioPolicyService(AUDIO_DEVICE_OUT_WIRED_HEADPHONE,
+                                       AUDIO_POLICY_DEVICE_STATE_AVAILABLE));
+  handler_.UpdateAudioSystem(true, true);
+  handler_.GetInitialAudioDeviceState(h2w_file_path_);
+  RunLoop();
+  EXPECT_EQ(handler_.connected_input_devices_.size(), 0);
+  EXPECT_EQ(handler_.connected_output_devices_.size(), 1);
+  EXPECT_TRUE(handler_.cached_headphone_);
+  EXPECT_FALSE(handler_.cached_microphone_);
+}
+
+// Test UpdateAudioSystem() when a headset is replaced by headphones. Only the
+// devices that changed are notified.
+TEST_F(AudioDeviceHandlerTest, UpdateAudioSystemHeadsetToHeadphone) {
+  handler_.connected_input_devices_.insert(AUDIO_DEVICE_IN_WIRED_HEADSET);
+  handler_.connected_output_devices_.insert(AUDIO_DEVICE_OUT_WIRED_HEADSET);
+  EXPECT_CALL(handler_,
+              NotifyAudioPolicyService(AUDIO_DEVICE_IN_WIRED_HEADSET,
+                                       AUDIO_POLICY_DEVICE_STATE_UNAVAILABLE));
+  EXPECT_CALL(handler_,
+              NotifyAudioPolicyService(AUDIO_DEVICE_OUT_WIRED_HEADSET,
+                                       AUDIO_POLICY_DEVICE_STATE_UNAVAILABLE));
+  EXPECT_CALL(handler_,
+              NotifyAudioPolicyService(AUDIO_DEVICE_OUT_WIRED_HEADPHONE,
+                                       AUDIO_POLICY_DEVICE_STATE_AVAILABLE));
+  handler_.UpdateAudioSystem(true, false);
+  EXPECT_EQ(handler_.connected_input_devices_.size(), 0);
+  EXPECT_NE(
+      handler_.connected_output_devices_.find(AUDIO_DEVICE_OUT_WIRED_HEADPHONE),
+      handler_.connected_output_devices_.end());
+  EXPECT_EQ(handler_.connected_output_devices_.size(), 1);
+}
+
 // Test UpdateAudioSystem() when connecting a microphone.
 TEST_F(AudioDeviceHandlerTest, UpdateAudioSystemConnectMic) {
   handler_.microphone_ = true;
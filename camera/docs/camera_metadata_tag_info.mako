@@ -61,6 +61,33 @@ tag_info_t *tag_info[ANDROID_SECTION_COUNT] = {
   % endfor
 };
 
+<%
+  tag_entries = [entry for sec in find_all_sections(metadata)
+                 for entry in remove_synthetic(find_unique_entries(sec))]
+  tag_name_displacements, tag_name_slots = \
+      perfect_hash([entry.name for entry in tag_entries])
+%>
+/**
+ * Minimal perfect hash from full tag name to tag, used by
+ * get_camera_metadata_tag_by_name(). See perfect_hash() in metadata_helpers.py.
+ */
+#define CAMERA_METADATA_TAG_NAME_BUCKET_COUNT ${len(tag_name_displacements)}
+#define CAMERA_METADATA_TAG_NAME_SLOT_COUNT ${len(tag_name_slots)}
+
+static const int32_t camera_metadata_tag_name_displacements[
+        CAMERA_METADATA_TAG_NAME_BUCKET_COUNT] = {
+  % for d in tag_name_displacements:
+    ${d},
+  % endfor
+};
+
+static const uint32_t camera_metadata_tag_name_slots[
+        CAMERA_METADATA_TAG_NAME_SLOT_COUNT] = {
+  % for i in tag_name_slots:
+    ${tag_entries[i].name | csym},
+  % endfor
+};
+
 int camera_metadata_enum_snprint(uint32_t tag,
                                  uint32_t value,
                                  char *dst,
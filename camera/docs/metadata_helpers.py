@@ -1243,6 +1243,78 @@ def filter_ndk_visible(entries):
   """
   return (e for e in entries if e.applied_ndk_visible == 'true')
 
+def perfect_hash_name(name, seed):
+  """
+  Hash a name with 32-bit FNV-1a, starting from the offset basis xor seed.
+
+  Must stay in sync with the C implementation in camera_metadata.c.
+
+  Args:
+    name: A string to hash
+    seed: A 32-bit unsigned integer selecting the hash function
+
+  Returns:
+    A 32-bit unsigned integer
+  """
+  h = 0x811c9dc5 ^ seed
+  for c in name:
+    h = ((h ^ ord(c)) * 0x01000193) & 0xffffffff
+  return h
+
+def perfect_hash(names):
+  """
+  Build a minimal perfect hash of distinct names, with the hash and displace
+  method: the names are grouped into buckets by perfect_hash_name(name, 0), and
+  for each bucket, largest first, a seed is searched for which
+  perfect_hash_name(name, seed) places all of its names into free slots.
+  Buckets of a single name are then put directly into the remaining slots.
+
+  A name is looked up by d = displacements[perfect_hash_name(name, 0) %
+  len(displacements)]: its slot is -d - 1 if d < 0, and otherwise
+  perfect_hash_name(name, d) % len(slots). The name in the slot must then be
+  compared, as any other string also maps to some slot.
+
+  Args:
+    names: A list of distinct strings
+
+  Returns:
+    A (displacements, slots) tuple of lists, where slots[i] is the index into
+    names of the name in slot i.
+  """
+  n = len(names)
+  bucket_count = max(1, (n + 1) // 2)
+  buckets = [[] for i in range(bucket_count)]
+  for i, name in enumerate(names):
+    buckets[perfect_hash_name(name, 0) % bucket_count].append(i)
+
+  displacements = [0] * bucket_count
+  slots = [None] * n
+  order = sorted(range(bucket_count), key=lambda b: (-len(buckets[b]), b))
+  for b in order:
+    bucket = buckets[b]
+    if len(bucket) < 2:
+      break
+    seed = 1
+    while True:
+      placed = [perfect_hash_name(names[i], seed) % n for i in bucket]
+      if len(set(placed)) == len(placed) and \
+          all(slots[slot] is None for slot in placed):
+        break
+      seed += 1
+    for i, slot in zip(bucket, placed):
+      slots[slot] = i
+    displacements[b] = seed
+
+  free = [slot for slot in range(n) if slots[slot] is None]
+  free.reverse()
+  for b in order:
+    if len(buckets[b]) == 1:
+      slot = free.pop()
+      slots[slot] = buckets[b][0]
+      displacements[b] = -slot - 1
+
+  return displacements, slots
+
 def wbr(text):
   """
   Insert word break hints for the browser in the form of <wbr> HTML tags.
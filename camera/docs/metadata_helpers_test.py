@@ -213,5 +213,19 @@ If the path foo/android.testOuter1.testSection1.control1/bar.txt exists, then oh
     # Remove some whitespace from 2nd line, all whitespace from other lines
     self.assertEquals("bar\n  line1\nline2", dedent(" bar\n    line1\n  line2"))
 
+  def test_perfect_hash(self):
+    names = ["android.%s.entry%d" %(section, i)
+             for section in ["control", "lens", "sensor.info"]
+             for i in range(50)]
+    displacements, slots = perfect_hash(names)
+    # minimal: one slot per name
+    self.assertEquals(sorted(slots), range(len(names)))
+    for i, name in enumerate(names):
+      d = displacements[perfect_hash_name(name, 0) % len(displacements)]
+      slot = -d - 1 if d < 0 else perfect_hash_name(name, d) % len(slots)
+      self.assertEquals(i, slots[slot])
+
+    self.assertEquals(([-1], [0]), perfect_hash(["android.control.mode"]))
+
 if __name__ == '__main__':
     unittest.main()
@@ -296,15 +296,68 @@ ANDROID_API
 int validate_camera_metadata_structure(const camera_metadata_t *metadata,
                                        const size_t *expected_size);
 
+/**
+ * Validate only the header of a metadata: its alignment, and that its counts,
+ * capacities and offsets are consistent with each other and with
+ * expected_size, if given. This is O(1), and meant for buffers from trusted
+ * in-process producers; the entries themselves are not checked. Buffers from
+ * untrusted sources must use validate_camera_metadata_structure().
+ *
+ * Returns 0 on success. A non-0 value is returned on error.
+ */
+ANDROID_API
+int validate_camera_metadata_header(const camera_metadata_t *metadata,
+                                    const size_t *expected_size);
+
+/**
+ * The result of a previous validate_camera_metadata_cached() call. Zero
+ * initialize before first use.
+ */
+typedef struct camera_metadata_validation {
+    const camera_metadata_t *metadata;
+    uint32_t size;
+    uint32_t checksum;
+} camera_metadata_validation_t;
+
+/**
+ * As validate_camera_metadata_structure(), but skips the per-entry checks if
+ * the header and entries of metadata are unchanged since it last passed them
+ * with the same cache, as determined by a checksum. This suits buffers that are
+ * validated repeatedly while mostly unchanged; the header is always checked.
+ * The checksum is not cryptographic, so it does not protect against a buffer
+ * being deliberately altered to match.
+ *
+ * Returns 0 on success. A non-0 value is returned on error.
+ */
+ANDROID_API
+int validate_camera_metadata_cached(const camera_metadata_t *metadata,
+                                    const size_t *expected_size,
+                                    camera_metadata_validation_t *cache);
+
 /**
  * Append camera metadata in src to an existing metadata structure in dst.  This
  * does not resize the destination structure, so if it is too small, a non-zero
- * value is returned. On success, 0 is returned. Appending onto a sorted
- * structure results in a non-sorted combined structure.
+ * value is returned. On success, 0 is returned. If both structures are sorted,
+ * their entries are merged in linear time and the result stays sorted, with
+ * entries from dst ahead of those from src for the same tag. Otherwise,
+ * appending onto a non-empty structure results in a non-sorted combined
+ * structure.
  */
 ANDROID_API
 int append_camera_metadata(camera_metadata_t *dst, const camera_metadata_t *src);
 
+/**
+ * Merge camera metadata in src into dst, replacing all entries in dst whose tag
+ * appears in src, for example to layer a request over its defaults. dst is
+ * sorted if needed, as is a temporary copy of src if it is not sorted; for
+ * sorted inputs this is a linear merge. The result is sorted. Like
+ * append_camera_metadata(), this does not resize dst, and returns a non-zero
+ * value without changing its entries if the result does not fit.
+ */
+ANDROID_API
+int append_camera_metadata_override(camera_metadata_t *dst,
+        const camera_metadata_t *src);
+
 /**
  * Clone an existing metadata buffer, compacting along the way. This is
  * equivalent to allocating a new buffer of the minimum needed size, then
@@ -314,6 +367,138 @@ int append_camera_metadata(camera_metadata_t *dst, const camera_metadata_t *src)
 ANDROID_API
 camera_metadata_t *clone_camera_metadata(const camera_metadata_t *src);
 
+/**
+ * A pool of metadata buffers, recycled by power-of-two size class to avoid a
+ * malloc and free per buffer on high-rate paths such as capture results. A pool
+ * may be shared between threads.
+ */
+typedef struct camera_metadata_pool camera_metadata_pool_t;
+
+/**
+ * Allocate an empty pool, which keeps up to max_cached_per_class released
+ * buffers of each size class for reuse. Returns NULL on failure.
+ */
+ANDROID_API
+camera_metadata_pool_t *allocate_camera_metadata_pool(
+        size_t max_cached_per_class);
+
+/**
+ * Free a pool and the buffers cached in it. All buffers allocated from the pool
+ * must have been released with release_camera_metadata_pooled() first.
+ */
+ANDROID_API
+void free_camera_metadata_pool(camera_metadata_pool_t *pool);
+
+/**
+ * As allocate_camera_metadata(), reusing a released buffer from the pool when
+ * one of the right size class is available. The memory is laid out with
+ * place_camera_metadata(), and must be freed with
+ * release_camera_metadata_pooled() rather than free_camera_metadata().
+ */
+ANDROID_API
+camera_metadata_t *allocate_camera_metadata_pooled(camera_metadata_pool_t *pool,
+        size_t entry_capacity,
+        size_t data_capacity);
+
+/**
+ * As clone_camera_metadata(), allocating the clone from the pool. The clone
+ * must be freed with release_camera_metadata_pooled().
+ */
+ANDROID_API
+camera_metadata_t *clone_camera_metadata_pooled(camera_metadata_pool_t *pool,
+        const camera_metadata_t *src);
+
+/**
+ * Return a buffer allocated from a pool to that pool, or free it if the pool
+ * already holds enough buffers of its size class. NULL is ignored.
+ */
+ANDROID_API
+void release_camera_metadata_pooled(camera_metadata_t *metadata);
+
+/**
+ * Write a compact, sorted copy of src to fd, which should be an empty file or
+ * memfd, for mapping with map_camera_metadata(). This suits large immutable
+ * packets such as static characteristics, which can then be shared between
+ * processes instead of cloned into each. If fd is a memfd that allows sealing,
+ * it is sealed against writes and resizing afterwards.
+ */
+ANDROID_API
+int write_camera_metadata_to_fd(const camera_metadata_t *src, int fd);
+
+/**
+ * Map a packet written by write_camera_metadata_to_fd() read-only, and validate
+ * it with validate_camera_metadata_structure(). Read-only functions such as
+ * find_camera_metadata_ro_entry() work directly on the mapping. The file must
+ * hold exactly one packet. Unless the file is sealed, the caller must trust
+ * everyone who can write it not to change it while it is mapped. Returns NULL
+ * on failure. The mapping must be released with unmap_camera_metadata().
+ */
+ANDROID_API
+const camera_metadata_t *map_camera_metadata(int fd);
+
+/**
+ * Release a mapping returned by map_camera_metadata().
+ */
+ANDROID_API
+void unmap_camera_metadata(const camera_metadata_t *metadata);
+
+/**
+ * The differences between two metadata packets, as a single contiguous,
+ * relocatable block of memory of get_camera_metadata_delta_size() bytes that
+ * can be copied like a camera_metadata_t. For each tag whose entries differ, a
+ * delta holds all of the tag's entries in the newer packet, or none if the tag
+ * was removed.
+ */
+typedef struct camera_metadata_delta camera_metadata_delta_t;
+
+/**
+ * Compute the delta that turns prev into next, with a linear merge of the two
+ * packets by tag; unsorted packets are sorted into a temporary copy first. A
+ * NULL prev is treated as an empty packet. The result can be freed with
+ * free_camera_metadata_delta(). Returns NULL on failure.
+ */
+ANDROID_API
+camera_metadata_delta_t *diff_camera_metadata(const camera_metadata_t *prev,
+        const camera_metadata_t *next);
+
+/**
+ * Apply a delta from diff_camera_metadata() to the packet it was computed
+ * against, returning a new sorted packet of the minimum needed size which can
+ * be freed with free_camera_metadata(). The delta is validated first. Returns
+ * NULL on failure.
+ */
+ANDROID_API
+camera_metadata_t *apply_camera_metadata_delta(const camera_metadata_t *prev,
+        const camera_metadata_delta_t *delta);
+
+/**
+ * Get the total size in bytes of a delta.
+ */
+ANDROID_API
+size_t get_camera_metadata_delta_size(const camera_metadata_delta_t *delta);
+
+/**
+ * Get the number of tags that are changed, added or removed by a delta. A delta
+ * between identical packets has none.
+ */
+ANDROID_API
+size_t get_camera_metadata_delta_tag_count(const camera_metadata_delta_t *delta);
+
+/**
+ * Check that a delta received from elsewhere is well formed, as
+ * validate_camera_metadata_structure() does for packets. If expected_size is
+ * not NULL, the delta must fit in that many bytes.
+ */
+ANDROID_API
+int validate_camera_metadata_delta(const camera_metadata_delta_t *delta,
+        const size_t *expected_size);
+
+/**
+ * Free a delta allocated by diff_camera_metadata().
+ */
+ANDROID_API
+void free_camera_metadata_delta(camera_metadata_delta_t *delta);
+
 /**
  * Calculate the number of bytes of extra data a given metadata entry will take
  * up. That is, if entry of 'type' with a payload of 'data_count' values is
@@ -376,6 +561,40 @@ int get_camera_metadata_ro_entry(const camera_metadata_t *src,
         size_t index,
         camera_metadata_ro_entry_t *entry);
 
+/**
+ * State for walking the entries of a metadata buffer in order with
+ * next_camera_metadata_entry(). The fields are private to the implementation.
+ */
+typedef struct camera_metadata_iterator {
+    const camera_metadata_t *metadata;
+    size_t                   index;
+    size_t                   end;
+    int                      section;
+} camera_metadata_iterator_t;
+
+/**
+ * Start an iteration over the entries of src, optionally only those in the
+ * given tag section (a camera_metadata_section_t value or a vendor section).
+ * A negative section iterates over all entries. If src is sorted, the entries
+ * of the section are found with a binary search; otherwise each entry is
+ * checked as it is reached. The buffer must not be modified during the
+ * iteration.
+ */
+ANDROID_API
+int init_camera_metadata_iterator(camera_metadata_iterator_t *iterator,
+        const camera_metadata_t *src,
+        int section);
+
+/**
+ * Get the next entry of an iteration, with its data pointing into the buffer as
+ * for get_camera_metadata_ro_entry(). Returns -ENOENT when there are no more
+ * entries. This walks the entry array directly, so iterating over a whole
+ * buffer is a single linear pass.
+ */
+ANDROID_API
+int next_camera_metadata_entry(camera_metadata_iterator_t *iterator,
+        camera_metadata_ro_entry_t *entry);
+
 /**
  * Find an entry with given tag value. If not found, returns -ENOENT. Otherwise,
  * returns entry contents like get_camera_metadata_entry.
@@ -397,6 +616,58 @@ int find_camera_metadata_ro_entry(const camera_metadata_t *src,
         uint32_t tag,
         camera_metadata_ro_entry_t *entry);
 
+/**
+ * An index of a metadata packet by tag, for finding entries of the Android
+ * sections in constant time, without sorting the packet. It has one slot per
+ * tag defined in camera_metadata_tags.h; vendor tags are searched for in the
+ * packet as by find_camera_metadata_entry().
+ *
+ * The index refers to entries by position, so it must be rebuilt after the
+ * packet is modified in any way but updating entry data.  As a safeguard,
+ * lookups search the packet instead if its entry count has changed.
+ */
+typedef struct camera_metadata_index camera_metadata_index_t;
+
+/**
+ * Allocate an empty index, which finds nothing until
+ * build_camera_metadata_index() is called. Free it with
+ * free_camera_metadata_index().
+ */
+ANDROID_API
+camera_metadata_index_t *allocate_camera_metadata_index();
+
+ANDROID_API
+void free_camera_metadata_index(camera_metadata_index_t *index);
+
+/**
+ * Index the entries of src. Where a tag has several entries, the first one is
+ * indexed.
+ *
+ * Returns 0 on success. A non-0 value is returned on error, and lookups then
+ * search the packet.
+ */
+ANDROID_API
+int build_camera_metadata_index(camera_metadata_index_t *index,
+        const camera_metadata_t *src);
+
+/**
+ * As find_camera_metadata_entry(), using an index built for src.
+ */
+ANDROID_API
+int find_camera_metadata_entry_indexed(const camera_metadata_index_t *index,
+        camera_metadata_t *src,
+        uint32_t tag,
+        camera_metadata_entry_t *entry);
+
+/**
+ * As find_camera_metadata_ro_entry(), using an index built for src.
+ */
+ANDROID_API
+int find_camera_metadata_ro_entry_indexed(const camera_metadata_index_t *index,
+        const camera_metadata_t *src,
+        uint32_t tag,
+        camera_metadata_ro_entry_t *entry);
+
 /**
  * Delete an entry at given index. This is an expensive operation, since it
  * requires repacking entries and possibly entry data. This also invalidates any
@@ -423,6 +694,49 @@ int update_camera_metadata_entry(camera_metadata_t *dst,
         size_t data_count,
         camera_metadata_entry_t *updated_entry);
 
+/**
+ * A single change for update_camera_metadata_entries(): replace the data of the
+ * entry at index with data_count values from data.
+ */
+typedef struct camera_metadata_entry_update {
+    size_t      index;
+    const void *data;
+    size_t      data_count;
+} camera_metadata_entry_update_t;
+
+/**
+ * Applies a batch of updates as by update_camera_metadata_entry(), repacking
+ * the data array at most once for the whole batch, so that it is O(N) rather
+ * than O(N) per update. Returns a non-zero value without changing dst if an
+ * index is out of range or appears more than once, or the new data does not
+ * fit.
+ */
+ANDROID_API
+int update_camera_metadata_entries(camera_metadata_t *dst,
+        const camera_metadata_entry_update_t *updates,
+        size_t update_count);
+
+/**
+ * Enables or disables deferred compaction on a metadata buffer. While enabled,
+ * delete_camera_metadata_entry() and size-changing calls to
+ * update_camera_metadata_entry() leave the old data in place as an unused hole
+ * instead of repacking the data array, making them O(1) apart from the entry
+ * shift on delete. The holes are reclaimed by compact_camera_metadata(), when
+ * an update would otherwise run out of room, or when deferred compaction is
+ * disabled. Holes count towards get_camera_metadata_data_count().
+ */
+ANDROID_API
+int set_camera_metadata_deferred_compaction(camera_metadata_t *dst,
+        int defer);
+
+/**
+ * Repacks the data array of a metadata buffer, removing any holes left by
+ * deferred compaction. O(N) in the number of entries and data bytes. Invalidates
+ * existing camera_metadata_entry.data pointers to this buffer.
+ */
+ANDROID_API
+int compact_camera_metadata(camera_metadata_t *dst);
+
 /**
  * Retrieve human-readable name of section the tag is in. Returns NULL if
  * no such tag is defined. Returns NULL for tags in the vendor section, unless
@@ -447,6 +761,15 @@ const char *get_camera_metadata_tag_name(uint32_t tag);
 ANDROID_API
 int get_camera_metadata_tag_type(uint32_t tag);
 
+/**
+ * Look up an Android-defined tag by its full name, such as
+ * "android.control.aeMode", through a perfect hash generated from
+ * metadata_properties.xml. Returns 0 and sets *tag on success, or a non-zero
+ * value if no Android tag has that name. Vendor tags are not looked up.
+ */
+ANDROID_API
+int get_camera_metadata_tag_by_name(const char *name, uint32_t *tag);
+
 /**
  * Set up vendor-specific tag query methods. These are needed to properly add
  * entries with vendor-specified tags and to use the
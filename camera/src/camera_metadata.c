@@ -24,7 +24,13 @@
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #define OK              0
 #define ERROR           1
@@ -126,13 +132,14 @@ typedef union camera_metadata_data {
  */
 #define MAX_ALIGNMENT(A, B) (((A) > (B)) ? (A) : (B))
 #define METADATA_PACKET_ALIGNMENT \
-    MAX_ALIGNMENT(MAX_ALIGNMENT(DATA_ALIGNMENT, METADATA_ALIGNMENT), ENTRY_ALIGNMENT);
+    MAX_ALIGNMENT(MAX_ALIGNMENT(DATA_ALIGNMENT, METADATA_ALIGNMENT), ENTRY_ALIGNMENT)
 
 /** Versioning information */
 #define CURRENT_METADATA_VERSION 1
 
 /** Flag definitions */
 #define FLAG_SORTED 0x00000001
+#define FLAG_DEFER_COMPACTION 0x00000002
 
 /** Tag information */
 
@@ -333,8 +340,8 @@ size_t calculate_camera_metadata_entry_data_size(uint8_t type,
     return data_bytes <= 4 ? 0 : ALIGN_TO(data_bytes, DATA_ALIGNMENT);
 }
 
-int validate_camera_metadata_structure(const camera_metadata_t *metadata,
-                                       const size_t *expected_size) {
+int validate_camera_metadata_header(const camera_metadata_t *metadata,
+                                    const size_t *expected_size) {
 
     if (metadata == NULL) {
         ALOGE("%s: metadata is null!", __FUNCTION__);
@@ -425,6 +432,16 @@ int validate_camera_metadata_structure(const camera_metadata_t *metadata,
         return ERROR;
     }
 
+    return OK;
+}
+
+int validate_camera_metadata_structure(const camera_metadata_t *metadata,
+                                       const size_t *expected_size) {
+
+    if (validate_camera_metadata_header(metadata, expected_size) != OK) {
+        return ERROR;
+    }
+
     // Validate each entry
     const metadata_size_t entry_count = metadata->entry_count;
     camera_metadata_buffer_entry_t *entries = get_entries(metadata);
@@ -501,6 +518,54 @@ int validate_camera_metadata_structure(const camera_metadata_t *metadata,
     return OK;
 }
 
+// FNV-1a over the header and used entries, a word at a time
+static uint32_t get_camera_metadata_checksum(const camera_metadata_t *metadata) {
+    const uint32_t *words = (const uint32_t*)metadata;
+    size_t word_count = (metadata->entries_start +
+            sizeof(camera_metadata_buffer_entry_t[metadata->entry_count])) /
+            sizeof(uint32_t);
+    uint32_t checksum = 2166136261u;
+    for (size_t i = 0; i < word_count; i++) {
+        checksum = (checksum ^ words[i]) * 16777619u;
+    }
+    return checksum;
+}
+
+int validate_camera_metadata_cached(const camera_metadata_t *metadata,
+                                    const size_t *expected_size,
+                                    camera_metadata_validation_t *cache) {
+    if (cache == NULL) {
+        return validate_camera_metadata_structure(metadata, expected_size);
+    }
+    if (validate_camera_metadata_header(metadata, expected_size) != OK) {
+        return ERROR;
+    }
+
+    if (metadata->entries_start % sizeof(uint32_t) != 0 ||
+            metadata->entries_start > metadata->size ||
+            (metadata->size - metadata->entries_start) /
+                    sizeof(camera_metadata_buffer_entry_t) <
+                    metadata->entry_count) {
+        // Not safe to checksum, so leave it to the full check
+        cache->metadata = NULL;
+        return validate_camera_metadata_structure(metadata, expected_size);
+    }
+
+    uint32_t checksum = get_camera_metadata_checksum(metadata);
+    if (cache->metadata == metadata && cache->size == metadata->size &&
+            cache->checksum == checksum) {
+        return OK;
+    }
+    if (validate_camera_metadata_structure(metadata, expected_size) != OK) {
+        cache->metadata = NULL;
+        return ERROR;
+    }
+    cache->metadata = metadata;
+    cache->size = metadata->size;
+    cache->checksum = checksum;
+    return OK;
+}
+
 int append_camera_metadata(camera_metadata_t *dst,
         const camera_metadata_t *src) {
     if (dst == NULL || src == NULL ) return ERROR;
@@ -512,6 +577,35 @@ int append_camera_metadata(camera_metadata_t *dst,
     if (dst->entry_capacity < src->entry_count + dst->entry_count) return ERROR;
     if (dst->data_capacity < src->data_count + dst->data_count) return ERROR;
 
+    if ((dst->flags & src->flags & FLAG_SORTED) &&
+            dst->entry_count != 0 && src->entry_count != 0) {
+        // Both sorted, so merge the entries from the end to keep them sorted,
+        // with dst entries ahead of src entries of the same tag
+        camera_metadata_buffer_entry_t *dst_entries = get_entries(dst);
+        const camera_metadata_buffer_entry_t *src_entries = get_entries(src);
+        size_t i = dst->entry_count;
+        size_t j = src->entry_count;
+        camera_metadata_buffer_entry_t *out = dst_entries + i + j;
+        while (j > 0) {
+            if (i > 0 && dst_entries[i - 1].tag > src_entries[j - 1].tag) {
+                *--out = dst_entries[--i];
+            } else {
+                *--out = src_entries[--j];
+                if (calculate_camera_metadata_entry_data_size(out->type,
+                        out->count) > 0) {
+                    out->data.offset += dst->data_count;
+                }
+            }
+        }
+        memcpy(get_data(dst) + dst->data_count, get_data(src),
+                sizeof(uint8_t[src->data_count]));
+        dst->entry_count += src->entry_count;
+        dst->data_count += src->data_count;
+
+        assert(validate_camera_metadata_structure(dst, NULL) == OK);
+        return OK;
+    }
+
     memcpy(get_entries(dst) + dst->entry_count, get_entries(src),
             sizeof(camera_metadata_buffer_entry_t[src->entry_count]));
     memcpy(get_data(dst) + dst->data_count, get_data(src),
@@ -558,6 +652,225 @@ camera_metadata_t *clone_camera_metadata(const camera_metadata_t *src) {
     return clone;
 }
 
+/**
+ * Pooled buffers are preceded by a header naming the pool and size class, which
+ * also links the buffer into the free list of its class while cached. Classes
+ * are powers of two from POOL_MIN_CLASS_SIZE; larger buffers are allocated and
+ * freed directly.
+ */
+#define POOL_MIN_CLASS_SHIFT 8
+#define POOL_CLASS_COUNT 15
+#define POOL_UNPOOLED POOL_CLASS_COUNT
+
+typedef struct pool_buffer_header {
+    camera_metadata_pool_t *pool;
+    struct pool_buffer_header *next;
+    uint32_t size_class;
+} pool_buffer_header_t;
+
+#define POOL_HEADER_SIZE \
+        ALIGN_TO(sizeof(pool_buffer_header_t), METADATA_PACKET_ALIGNMENT)
+
+struct camera_metadata_pool {
+    pthread_mutex_t lock;
+    size_t max_cached_per_class;
+    size_t cached_count[POOL_CLASS_COUNT];
+    pool_buffer_header_t *free_list[POOL_CLASS_COUNT];
+};
+
+static uint32_t get_pool_size_class(size_t size) {
+    uint32_t size_class = 0;
+    while (size_class < POOL_CLASS_COUNT &&
+            ((size_t)1 << (size_class + POOL_MIN_CLASS_SHIFT)) < size) {
+        size_class++;
+    }
+    return size_class;
+}
+
+static pool_buffer_header_t *get_pool_header(const camera_metadata_t *metadata) {
+    return (pool_buffer_header_t*)((uint8_t*)metadata - POOL_HEADER_SIZE);
+}
+
+camera_metadata_pool_t *allocate_camera_metadata_pool(
+        size_t max_cached_per_class) {
+    camera_metadata_pool_t *pool = calloc(1, sizeof(camera_metadata_pool_t));
+    if (pool == NULL) return NULL;
+
+    if (pthread_mutex_init(&pool->lock, NULL) != 0) {
+        free(pool);
+        return NULL;
+    }
+    pool->max_cached_per_class = max_cached_per_class;
+    return pool;
+}
+
+void free_camera_metadata_pool(camera_metadata_pool_t *pool) {
+    if (pool == NULL) return;
+
+    for (size_t i = 0; i < POOL_CLASS_COUNT; i++) {
+        pool_buffer_header_t *header = pool->free_list[i];
+        while (header != NULL) {
+            pool_buffer_header_t *next = header->next;
+            free(header);
+            header = next;
+        }
+    }
+    pthread_mutex_destroy(&pool->lock);
+    free(pool);
+}
+
+camera_metadata_t *allocate_camera_metadata_pooled(camera_metadata_pool_t *pool,
+        size_t entry_capacity,
+        size_t data_capacity) {
+    if (pool == NULL) return NULL;
+
+    size_t memory_needed = calculate_camera_metadata_size(entry_capacity,
+                                                          data_capacity);
+    uint32_t size_class = get_pool_size_class(memory_needed);
+    pool_buffer_header_t *header = NULL;
+    size_t buffer_size = memory_needed;
+
+    if (size_class != POOL_UNPOOLED) {
+        buffer_size = (size_t)1 << (size_class + POOL_MIN_CLASS_SHIFT);
+        pthread_mutex_lock(&pool->lock);
+        header = pool->free_list[size_class];
+        if (header != NULL) {
+            pool->free_list[size_class] = header->next;
+            pool->cached_count[size_class]--;
+        }
+        pthread_mutex_unlock(&pool->lock);
+    }
+    if (header == NULL) {
+        header = malloc(POOL_HEADER_SIZE + buffer_size);
+        if (header == NULL) return NULL;
+        header->pool = pool;
+        header->size_class = size_class;
+    }
+    header->next = NULL;
+
+    return place_camera_metadata((uint8_t*)header + POOL_HEADER_SIZE,
+                                 buffer_size,
+                                 entry_capacity,
+                                 data_capacity);
+}
+
+camera_metadata_t *clone_camera_metadata_pooled(camera_metadata_pool_t *pool,
+        const camera_metadata_t *src) {
+    int res;
+    if (src == NULL) return NULL;
+    camera_metadata_t *clone = allocate_camera_metadata_pooled(pool,
+        get_camera_metadata_entry_count(src),
+        get_camera_metadata_data_count(src));
+    if (clone != NULL) {
+        res = append_camera_metadata(clone, src);
+        if (res != OK) {
+            release_camera_metadata_pooled(clone);
+            clone = NULL;
+        }
+    }
+    assert(clone == NULL ||
+            validate_camera_metadata_structure(clone, NULL) == OK);
+    return clone;
+}
+
+void release_camera_metadata_pooled(camera_metadata_t *metadata) {
+    if (metadata == NULL) return;
+
+    pool_buffer_header_t *header = get_pool_header(metadata);
+    camera_metadata_pool_t *pool = header->pool;
+    uint32_t size_class = header->size_class;
+
+    if (size_class != POOL_UNPOOLED) {
+        pthread_mutex_lock(&pool->lock);
+        if (pool->cached_count[size_class] < pool->max_cached_per_class) {
+            header->next = pool->free_list[size_class];
+            pool->free_list[size_class] = header;
+            pool->cached_count[size_class]++;
+            header = NULL;
+        }
+        pthread_mutex_unlock(&pool->lock);
+    }
+    free(header);
+}
+
+int write_camera_metadata_to_fd(const camera_metadata_t *src, int fd) {
+    if (src == NULL || fd < 0) return ERROR;
+
+    // Write a compact, sorted copy, so lookups in the mapping are binary
+    // searches
+    camera_metadata_t *copy = clone_camera_metadata(src);
+    if (copy == NULL) return ERROR;
+    int res = compact_camera_metadata(copy);
+    if (res == OK) {
+        res = sort_camera_metadata(copy);
+    }
+
+    const uint8_t *bytes = (const uint8_t*)copy;
+    size_t remaining = copy->size;
+    while (res == OK && remaining > 0) {
+        ssize_t written = write(fd, bytes, remaining);
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) {
+            ALOGE("%s: Unable to write metadata: %s", __FUNCTION__,
+                  written < 0 ? strerror(errno) : "no progress");
+            res = ERROR;
+            break;
+        }
+        bytes += written;
+        remaining -= written;
+    }
+    free_camera_metadata(copy);
+
+#if defined(F_ADD_SEALS) && defined(F_SEAL_WRITE)
+    // Best effort: only memfds created with sealing allowed can be sealed
+    if (res == OK) {
+        fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE);
+    }
+#endif
+    return res;
+}
+
+const camera_metadata_t *map_camera_metadata(int fd) {
+    if (fd < 0) return NULL;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        ALOGE("%s: Unable to stat fd %d: %s", __FUNCTION__, fd,
+              strerror(errno));
+        return NULL;
+    }
+    if (st.st_size < (off_t)sizeof(camera_metadata_t) ||
+            (uint64_t)st.st_size > UINT32_MAX) {
+        ALOGE("%s: File size %lld can't hold a metadata packet", __FUNCTION__,
+              (long long)st.st_size);
+        return NULL;
+    }
+    size_t size = st.st_size;
+
+    void *mapping = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (mapping == MAP_FAILED) {
+        ALOGE("%s: Unable to map fd %d: %s", __FUNCTION__, fd,
+              strerror(errno));
+        return NULL;
+    }
+
+    const camera_metadata_t *metadata = (const camera_metadata_t*)mapping;
+    if (validate_camera_metadata_structure(metadata, &size) != OK ||
+            metadata->size != size) {
+        ALOGE("%s: fd %d does not hold exactly one valid metadata packet",
+              __FUNCTION__, fd);
+        munmap(mapping, size);
+        return NULL;
+    }
+    return metadata;
+}
+
+void unmap_camera_metadata(const camera_metadata_t *metadata) {
+    if (metadata == NULL) return;
+
+    munmap((void*)metadata, metadata->size);
+}
+
 static int add_camera_metadata_entry_raw(camera_metadata_t *dst,
         uint32_t tag,
         uint8_t  type,
@@ -662,6 +975,72 @@ int get_camera_metadata_ro_entry(const camera_metadata_t *src,
             (camera_metadata_entry_t*)entry);
 }
 
+// Returns the position of the first of the sorted entries with a tag >= tag
+static size_t lower_bound_entry_tag(const camera_metadata_buffer_entry_t *entries,
+        size_t count,
+        uint32_t tag) {
+    size_t low = 0;
+    size_t high = count;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (entries[mid].tag < tag) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+int init_camera_metadata_iterator(camera_metadata_iterator_t *iterator,
+        const camera_metadata_t *src,
+        int section) {
+    if (iterator == NULL || src == NULL) return ERROR;
+
+    iterator->metadata = src;
+    iterator->index = 0;
+    iterator->end = src->entry_count;
+    iterator->section = section < 0 ? -1 : section;
+    if (section >= 0 && (src->flags & FLAG_SORTED)) {
+        const camera_metadata_buffer_entry_t *entries = get_entries(src);
+        uint32_t start = (uint32_t)section << 16;
+        iterator->index = lower_bound_entry_tag(entries, src->entry_count,
+                start);
+        iterator->end = start + (1 << 16) < start ? src->entry_count :
+                lower_bound_entry_tag(entries, src->entry_count,
+                        start + (1 << 16));
+        iterator->section = -1;
+    }
+    return OK;
+}
+
+int next_camera_metadata_entry(camera_metadata_iterator_t *iterator,
+        camera_metadata_ro_entry_t *entry) {
+    if (iterator == NULL || entry == NULL) return ERROR;
+
+    const camera_metadata_t *src = iterator->metadata;
+    const camera_metadata_buffer_entry_t *buffer_entry =
+            get_entries(src) + iterator->index;
+    for (; iterator->index < iterator->end; iterator->index++, buffer_entry++) {
+        if (iterator->section >= 0 &&
+                (buffer_entry->tag >> 16) != (uint32_t)iterator->section) {
+            continue;
+        }
+        entry->index = iterator->index++;
+        entry->tag = buffer_entry->tag;
+        entry->type = buffer_entry->type;
+        entry->count = buffer_entry->count;
+        if (buffer_entry->count *
+                camera_metadata_type_size[buffer_entry->type] > 4) {
+            entry->data.u8 = get_data(src) + buffer_entry->data.offset;
+        } else {
+            entry->data.u8 = buffer_entry->data.value;
+        }
+        return OK;
+    }
+    return NOT_FOUND;
+}
+
 int find_camera_metadata_entry(camera_metadata_t *src,
         uint32_t tag,
         camera_metadata_entry_t *entry) {
@@ -702,6 +1081,159 @@ int find_camera_metadata_ro_entry(const camera_metadata_t *src,
             (camera_metadata_entry_t*)entry);
 }
 
+/**
+ * The index has a slot per Android tag, holding the position of its entry
+ * plus one, or 0 if the tag has no entry. The slots of each section start at
+ * section_start[section].
+ */
+#define INDEX_INVALID UINT32_MAX
+#define INDEX_MAX_ENTRIES UINT16_MAX
+struct camera_metadata_index {
+    uint32_t entry_count;   // of the indexed packet, or INDEX_INVALID
+    uint32_t section_start[ANDROID_SECTION_COUNT];
+    uint16_t slots[];
+};
+
+camera_metadata_index_t *allocate_camera_metadata_index() {
+    uint32_t slot_count = 0;
+    uint32_t section_start[ANDROID_SECTION_COUNT];
+    for (size_t i = 0; i < ANDROID_SECTION_COUNT; i++) {
+        section_start[i] = slot_count;
+        slot_count += camera_metadata_section_bounds[i][1] -
+                camera_metadata_section_bounds[i][0];
+    }
+
+    camera_metadata_index_t *index = malloc(sizeof(camera_metadata_index_t) +
+            sizeof(uint16_t[slot_count]));
+    if (index == NULL) return NULL;
+    index->entry_count = INDEX_INVALID;
+    memcpy(index->section_start, section_start, sizeof(section_start));
+    memset(index->slots, 0, sizeof(uint16_t[slot_count]));
+    return index;
+}
+
+void free_camera_metadata_index(camera_metadata_index_t *index) {
+    free(index);
+}
+
+// Returns the position of the slot of a tag in the index, or -1 if it has none
+static int get_index_slot(const camera_metadata_index_t *index, uint32_t tag) {
+    uint32_t tag_section = tag >> 16;
+    if (tag_section >= ANDROID_SECTION_COUNT ||
+            tag >= camera_metadata_section_bounds[tag_section][1]) {
+        return -1;
+    }
+    return index->section_start[tag_section] + (tag & 0xFFFF);
+}
+
+int build_camera_metadata_index(camera_metadata_index_t *index,
+        const camera_metadata_t *src) {
+    if (index == NULL) return ERROR;
+
+    uint32_t last_section = ANDROID_SECTION_COUNT - 1;
+    size_t slot_count = index->section_start[last_section] +
+            camera_metadata_section_bounds[last_section][1] -
+            camera_metadata_section_bounds[last_section][0];
+    memset(index->slots, 0, sizeof(uint16_t[slot_count]));
+    index->entry_count = INDEX_INVALID;
+    if (src == NULL || src->entry_count >= INDEX_MAX_ENTRIES) return ERROR;
+
+    const camera_metadata_buffer_entry_t *entry = get_entries(src);
+    for (size_t i = 0; i < src->entry_count; i++, entry++) {
+        int slot = get_index_slot(index, entry->tag);
+        if (slot >= 0 && index->slots[slot] == 0) {
+            index->slots[slot] = i + 1;
+        }
+    }
+    index->entry_count = src->entry_count;
+    return OK;
+}
+
+int find_camera_metadata_entry_indexed(const camera_metadata_index_t *index,
+        camera_metadata_t *src,
+        uint32_t tag,
+        camera_metadata_entry_t *entry) {
+    if (src == NULL) return ERROR;
+
+    if (index != NULL && index->entry_count == src->entry_count) {
+        int slot = get_index_slot(index, tag);
+        if (slot >= 0) {
+            uint32_t position = index->slots[slot];
+            if (position == 0) return NOT_FOUND;
+            // the entry count can't tell an index is out of date after a
+            // delete and an add, but this usually can
+            if (get_entries(src)[position - 1].tag == tag) {
+                return get_camera_metadata_entry(src, position - 1, entry);
+            }
+        }
+    }
+    return find_camera_metadata_entry(src, tag, entry);
+}
+
+int find_camera_metadata_ro_entry_indexed(const camera_metadata_index_t *index,
+        const camera_metadata_t *src,
+        uint32_t tag,
+        camera_metadata_ro_entry_t *entry) {
+    return find_camera_metadata_entry_indexed(index, (camera_metadata_t*)src,
+            tag, (camera_metadata_entry_t*)entry);
+}
+
+
+// Returns the bytes of data used by entries, excluding any holes left by
+// deferred compaction
+static size_t get_live_data_bytes(const camera_metadata_t *metadata) {
+    const camera_metadata_buffer_entry_t *e = get_entries(metadata);
+    size_t bytes = 0;
+    for (size_t i = 0; i < metadata->entry_count; i++, e++) {
+        bytes += calculate_camera_metadata_entry_data_size(e->type, e->count);
+    }
+    return bytes;
+}
+
+int set_camera_metadata_deferred_compaction(camera_metadata_t *dst,
+        int defer) {
+    if (dst == NULL) return ERROR;
+
+    if (defer) {
+        dst->flags |= FLAG_DEFER_COMPACTION;
+        return OK;
+    }
+    dst->flags &= ~FLAG_DEFER_COMPACTION;
+    return compact_camera_metadata(dst);
+}
+
+int compact_camera_metadata(camera_metadata_t *dst) {
+    if (dst == NULL) return ERROR;
+
+    size_t live_bytes = get_live_data_bytes(dst);
+    if (live_bytes == dst->data_count) return OK;
+
+    // Copy the data of each entry in turn, which also orders it by entry
+    uint8_t *packed = NULL;
+    if (live_bytes != 0) {
+        packed = malloc(live_bytes);
+        if (packed == NULL) return ERROR;
+    }
+    camera_metadata_buffer_entry_t *e = get_entries(dst);
+    size_t offset = 0;
+    for (size_t i = 0; i < dst->entry_count; i++, e++) {
+        size_t data_bytes = calculate_camera_metadata_entry_data_size(e->type,
+                e->count);
+        if (data_bytes > 0) {
+            memcpy(packed + offset, get_data(dst) + e->data.offset, data_bytes);
+            e->data.offset = offset;
+            offset += data_bytes;
+        }
+    }
+    if (live_bytes != 0) {
+        memcpy(get_data(dst), packed, live_bytes);
+    }
+    free(packed);
+    dst->data_count = live_bytes;
+
+    assert(validate_camera_metadata_structure(dst, NULL) == OK);
+    return OK;
+}
 
 int delete_camera_metadata_entry(camera_metadata_t *dst,
         size_t index) {
@@ -712,7 +1244,8 @@ int delete_camera_metadata_entry(camera_metadata_t *dst,
     size_t data_bytes = calculate_camera_metadata_entry_data_size(entry->type,
             entry->count);
 
-    if (data_bytes > 0) {
+    // With deferred compaction, the data is left as a hole
+    if (data_bytes > 0 && !(dst->flags & FLAG_DEFER_COMPACTION)) {
         // Shift data buffer to overwrite deleted data
         uint8_t *start = get_data(dst) + entry->data.offset;
         uint8_t *end = start + data_bytes;
@@ -738,17 +1271,15 @@ int delete_camera_metadata_entry(camera_metadata_t *dst,
             (dst->entry_count - index - 1) );
     dst->entry_count -= 1;
 
-    assert(validate_camera_metadata_structure(dst, NULL) == OK);
+    assert(validate_camera_metadata_header(dst, NULL) == OK);
     return OK;
 }
 
-int update_camera_metadata_entry(camera_metadata_t *dst,
+static int update_entry(camera_metadata_t *dst,
         size_t index,
         const void *data,
         size_t data_count,
-        camera_metadata_entry_t *updated_entry) {
-    if (dst == NULL) return ERROR;
-    if (index >= dst->entry_count) return ERROR;
+        int defer_compaction) {
 
     camera_metadata_buffer_entry_t *entry = get_entries(dst) + index;
 
@@ -761,7 +1292,29 @@ int update_camera_metadata_entry(camera_metadata_t *dst,
     size_t entry_bytes =
             calculate_camera_metadata_entry_data_size(entry->type,
                     entry->count);
-    if (data_bytes != entry_bytes) {
+    if (data_bytes != entry_bytes && defer_compaction) {
+        // Leave any old data as a hole, and append the new data, compacting
+        // first if there's no room at the end
+        if (data_bytes > dst->data_capacity - dst->data_count) {
+            if (dst->data_capacity <
+                    get_live_data_bytes(dst) + data_bytes - entry_bytes) {
+                // No room
+                return ERROR;
+            }
+            entry->count = 0;
+            entry->data.offset = 0;
+            if (compact_camera_metadata(dst) != OK) {
+                return ERROR;
+            }
+        }
+        if (data_bytes != 0) {
+            entry->data.offset = dst->data_count;
+            memcpy(get_data(dst) + entry->data.offset, data, data_payload_bytes);
+            dst->data_count += data_bytes;
+        } else {
+            entry->data.offset = 0;
+        }
+    } else if (data_bytes != entry_bytes) {
         // May need to shift/add to data array
         if (dst->data_capacity < dst->data_count + data_bytes - entry_bytes) {
             // No room
@@ -800,13 +1353,27 @@ int update_camera_metadata_entry(camera_metadata_t *dst,
         memcpy(get_data(dst) + entry->data.offset, data, data_payload_bytes);
     }
 
-    if (data_bytes == 0) {
+    if (data_bytes == 0 && data_payload_bytes != 0) {
         // Data fits into entry
         memcpy(entry->data.value, data,
                 data_payload_bytes);
     }
 
     entry->count = data_count;
+    return OK;
+}
+
+int update_camera_metadata_entry(camera_metadata_t *dst,
+        size_t index,
+        const void *data,
+        size_t data_count,
+        camera_metadata_entry_t *updated_entry) {
+    if (dst == NULL) return ERROR;
+    if (index >= dst->entry_count) return ERROR;
+
+    int res = update_entry(dst, index, data, data_count,
+            dst->flags & FLAG_DEFER_COMPACTION);
+    if (res != OK) return res;
 
     if (updated_entry != NULL) {
         get_camera_metadata_entry(dst,
@@ -814,18 +1381,587 @@ int update_camera_metadata_entry(camera_metadata_t *dst,
                 updated_entry);
     }
 
+    assert(validate_camera_metadata_header(dst, NULL) == OK);
+    return OK;
+}
+
+static const uint8_t *get_entry_data(const camera_metadata_t *metadata,
+        const camera_metadata_buffer_entry_t *entry) {
+    if (calculate_camera_metadata_entry_data_size(entry->type,
+            entry->count) == 0) {
+        return entry->data.value;
+    }
+    return get_data(metadata) + entry->data.offset;
+}
+
+// Rebuilds the data array with the updates in slots applied, where slots[i] is
+// one past the index in updates of the update of entry i, or 0 if it has none.
+static int repack_with_updates(camera_metadata_t *dst,
+        const camera_metadata_entry_update_t *updates,
+        const size_t *slots,
+        size_t live_bytes) {
+    uint8_t *packed = NULL;
+    if (live_bytes != 0) {
+        packed = malloc(live_bytes);
+        if (packed == NULL) return ERROR;
+    }
+    camera_metadata_buffer_entry_t *e = get_entries(dst);
+    size_t offset = 0;
+    for (size_t i = 0; i < dst->entry_count; i++, e++) {
+        size_t count = e->count;
+        const uint8_t *src = get_entry_data(dst, e);
+        if (slots[i] != 0) {
+            count = updates[slots[i] - 1].data_count;
+            src = updates[slots[i] - 1].data;
+        }
+        size_t payload_bytes = count * camera_metadata_type_size[e->type];
+        if (calculate_camera_metadata_entry_data_size(e->type, count) > 0) {
+            memcpy(packed + offset, src, payload_bytes);
+            e->data.offset = offset;
+            offset += calculate_camera_metadata_entry_data_size(e->type, count);
+        } else if (payload_bytes != 0) {
+            memmove(e->data.value, src, payload_bytes);
+        }
+        e->count = count;
+    }
+    if (live_bytes != 0) {
+        memcpy(get_data(dst), packed, live_bytes);
+    }
+    free(packed);
+    dst->data_count = live_bytes;
+    return OK;
+}
+
+int update_camera_metadata_entries(camera_metadata_t *dst,
+        const camera_metadata_entry_update_t *updates,
+        size_t update_count) {
+    if (dst == NULL || (update_count != 0 && updates == NULL)) return ERROR;
+    if (update_count == 0) return OK;
+
+    size_t *slots = calloc(dst->entry_count, sizeof(size_t));
+    if (slots == NULL) return ERROR;
+
+    // Check everything fits, and that no entry is updated twice, before
+    // changing anything
+    camera_metadata_buffer_entry_t *entries = get_entries(dst);
+    size_t live_bytes = get_live_data_bytes(dst);
+    size_t append_bytes = 0;
+    for (size_t i = 0; i < update_count; i++) {
+        if (updates[i].index >= dst->entry_count ||
+                slots[updates[i].index] != 0 ||
+                (updates[i].data_count != 0 && updates[i].data == NULL)) {
+            free(slots);
+            return ERROR;
+        }
+        slots[updates[i].index] = i + 1;
+        const camera_metadata_buffer_entry_t *e = entries + updates[i].index;
+        size_t data_bytes = calculate_camera_metadata_entry_data_size(e->type,
+                updates[i].data_count);
+        size_t entry_bytes = calculate_camera_metadata_entry_data_size(e->type,
+                e->count);
+        live_bytes += data_bytes;
+        live_bytes -= entry_bytes;
+        if (data_bytes != entry_bytes) append_bytes += data_bytes;
+    }
+    if (live_bytes > dst->data_capacity) {
+        free(slots);
+        return ERROR;
+    }
+
+    int res = OK;
+    if (append_bytes <= dst->data_capacity - dst->data_count) {
+        // All the resized data goes after the end, leaving holes that are
+        // packed once at the end unless compaction is deferred
+        for (size_t i = 0; i < update_count && res == OK; i++) {
+            res = update_entry(dst, updates[i].index, updates[i].data,
+                    updates[i].data_count, /*defer_compaction*/ 1);
+        }
+        if (res == OK && !(dst->flags & FLAG_DEFER_COMPACTION)) {
+            res = compact_camera_metadata(dst);
+        }
+    } else {
+        // No room to append, so pack the data once with the updates applied
+        res = repack_with_updates(dst, updates, slots, live_bytes);
+    }
+    free(slots);
+    if (res != OK) return res;
+
     assert(validate_camera_metadata_structure(dst, NULL) == OK);
     return OK;
 }
 
+/**
+ * A delta holds, for each tag whose entries differ between two packets, the tag
+ * in the sorted replaced_tags array and the tag's entries in the new packet in
+ * the sorted changes packet at changes_start. A replaced tag without entries in
+ * changes was removed.
+ */
+struct camera_metadata_delta {
+    uint32_t size;
+    uint32_t replaced_count;
+    uint32_t changes_start;
+    uint32_t reserved;
+    uint32_t replaced_tags[];
+};
+
+static camera_metadata_t *get_delta_changes(
+        const camera_metadata_delta_t *delta) {
+    return (camera_metadata_t*)((uint8_t*)delta + delta->changes_start);
+}
+
+static int entries_equal(const camera_metadata_t *a,
+        const camera_metadata_buffer_entry_t *entry_a,
+        const camera_metadata_t *b,
+        const camera_metadata_buffer_entry_t *entry_b) {
+    return entry_a->type == entry_b->type &&
+            entry_a->count == entry_b->count &&
+            memcmp(get_entry_data(a, entry_a), get_entry_data(b, entry_b),
+                    entry_a->count * camera_metadata_type_size[entry_a->type])
+                    == 0;
+}
+
+// Returns src if it is sorted; otherwise stores a sorted clone in *sorted, to
+// be freed by the caller. A NULL src is treated as an empty packet.
+static const camera_metadata_t *get_sorted_camera_metadata(
+        const camera_metadata_t *src, camera_metadata_t **sorted) {
+    *sorted = NULL;
+    if (src != NULL && (src->flags & FLAG_SORTED)) return src;
+
+    *sorted = src != NULL ? clone_camera_metadata(src) :
+            allocate_camera_metadata(0, 0);
+    if (*sorted == NULL || sort_camera_metadata(*sorted) != OK) return NULL;
+    return *sorted;
+}
+
+// Adds an entry of src to dst if dst is not NULL, and counts its size
+static void merge_entry(camera_metadata_t *dst,
+        const camera_metadata_t *src,
+        const camera_metadata_buffer_entry_t *entry,
+        size_t *entry_count,
+        size_t *data_count) {
+    if (dst != NULL) {
+        add_camera_metadata_entry_raw(dst, entry->tag, entry->type,
+                get_entry_data(src, entry), entry->count);
+    }
+    (*entry_count)++;
+    *data_count += calculate_camera_metadata_entry_data_size(entry->type,
+            entry->count);
+}
+
+// Merges two sorted packets by tag, counting the replaced tags and the entries
+// and data of their changes. If delta is not NULL, also fills it in.
+static void diff_sorted_camera_metadata(const camera_metadata_t *prev,
+        const camera_metadata_t *next,
+        camera_metadata_delta_t *delta,
+        size_t *replaced_count,
+        size_t *entry_count,
+        size_t *data_count) {
+    const camera_metadata_buffer_entry_t *a = get_entries(prev);
+    const camera_metadata_buffer_entry_t *b = get_entries(next);
+    camera_metadata_t *changes = delta != NULL ? get_delta_changes(delta) : NULL;
+    size_t i = 0;
+    size_t j = 0;
+
+    *replaced_count = 0;
+    *entry_count = 0;
+    *data_count = 0;
+    while (i < prev->entry_count || j < next->entry_count) {
+        uint32_t tag;
+        if (i < prev->entry_count &&
+                (j == next->entry_count || a[i].tag <= b[j].tag)) {
+            tag = a[i].tag;
+        } else {
+            tag = b[j].tag;
+        }
+        size_t i_end = i;
+        size_t j_end = j;
+        while (i_end < prev->entry_count && a[i_end].tag == tag) i_end++;
+        while (j_end < next->entry_count && b[j_end].tag == tag) j_end++;
+
+        int same = i_end - i == j_end - j;
+        for (size_t k = 0; same && k < i_end - i; k++) {
+            same = entries_equal(prev, a + i + k, next, b + j + k);
+        }
+        if (!same) {
+            if (delta != NULL) {
+                delta->replaced_tags[*replaced_count] = tag;
+            }
+            (*replaced_count)++;
+            for (; j < j_end; j++) {
+                merge_entry(changes, next, b + j, entry_count, data_count);
+            }
+        }
+        i = i_end;
+        j = j_end;
+    }
+    if (changes != NULL) {
+        changes->flags |= FLAG_SORTED;
+    }
+}
+
+camera_metadata_delta_t *diff_camera_metadata(const camera_metadata_t *prev,
+        const camera_metadata_t *next) {
+    if (next == NULL) return NULL;
+
+    camera_metadata_t *sorted_prev;
+    camera_metadata_t *sorted_next;
+    const camera_metadata_t *a = get_sorted_camera_metadata(prev, &sorted_prev);
+    const camera_metadata_t *b = get_sorted_camera_metadata(next, &sorted_next);
+    camera_metadata_delta_t *delta = NULL;
+
+    if (a != NULL && b != NULL) {
+        size_t replaced_count, entry_count, data_count;
+        diff_sorted_camera_metadata(a, b, NULL,
+                &replaced_count, &entry_count, &data_count);
+
+        size_t changes_start = ALIGN_TO(sizeof(camera_metadata_delta_t) +
+                sizeof(uint32_t[replaced_count]), METADATA_PACKET_ALIGNMENT);
+        size_t changes_size = calculate_camera_metadata_size(entry_count,
+                data_count);
+        delta = malloc(changes_start + changes_size);
+        if (delta != NULL) {
+            delta->size = changes_start + changes_size;
+            delta->replaced_count = replaced_count;
+            delta->changes_start = changes_start;
+            delta->reserved = 0;
+            place_camera_metadata(get_delta_changes(delta), changes_size,
+                    entry_count, data_count);
+            diff_sorted_camera_metadata(a, b, delta,
+                    &replaced_count, &entry_count, &data_count);
+        }
+    }
+
+    free_camera_metadata(sorted_prev);
+    free_camera_metadata(sorted_next);
+    assert(delta == NULL || validate_camera_metadata_delta(delta, NULL) == OK);
+    return delta;
+}
+
+size_t get_camera_metadata_delta_size(const camera_metadata_delta_t *delta) {
+    if (delta == NULL) return 0;
+
+    return delta->size;
+}
+
+size_t get_camera_metadata_delta_tag_count(const camera_metadata_delta_t *delta) {
+    if (delta == NULL) return 0;
+
+    return delta->replaced_count;
+}
+
+int validate_camera_metadata_delta(const camera_metadata_delta_t *delta,
+        const size_t *expected_size) {
+    if (delta == NULL) {
+        ALOGE("%s: delta is null!", __FUNCTION__);
+        return ERROR;
+    }
+    if (expected_size != NULL && delta->size > *expected_size) {
+        ALOGE("%s: Delta size (%" PRIu32 ") should be <= expected size (%zu)",
+              __FUNCTION__, delta->size, *expected_size);
+        return ERROR;
+    }
+    if (delta->changes_start % METADATA_PACKET_ALIGNMENT != 0 ||
+            delta->changes_start < sizeof(camera_metadata_delta_t) ||
+            (delta->changes_start - sizeof(camera_metadata_delta_t)) /
+                    sizeof(uint32_t) < delta->replaced_count ||
+            delta->changes_start > delta->size ||
+            delta->size - delta->changes_start < sizeof(camera_metadata_t)) {
+        ALOGE("%s: Delta changes start (%" PRIu32 ") is invalid for %" PRIu32
+              " replaced tags in %" PRIu32 " bytes", __FUNCTION__,
+              delta->changes_start, delta->replaced_count, delta->size);
+        return ERROR;
+    }
+
+    const camera_metadata_t *changes = get_delta_changes(delta);
+    size_t changes_size = delta->size - delta->changes_start;
+    if (validate_camera_metadata_structure(changes, &changes_size) != OK) {
+        return ERROR;
+    }
+
+    // Replaced tags ascend, and every change belongs to one of them
+    const camera_metadata_buffer_entry_t *entries = get_entries(changes);
+    size_t j = 0;
+    for (size_t i = 0; i < delta->replaced_count; i++) {
+        uint32_t tag = delta->replaced_tags[i];
+        if (i > 0 && tag <= delta->replaced_tags[i - 1]) {
+            ALOGE("%s: Replaced tag %zu (%" PRIu32 ") is out of order",
+                  __FUNCTION__, i, tag);
+            return ERROR;
+        }
+        while (j < changes->entry_count && entries[j].tag == tag) j++;
+    }
+    if (j != changes->entry_count) {
+        ALOGE("%s: Change %zu (tag %" PRIu32 ") is not a replaced tag",
+              __FUNCTION__, j, entries[j].tag);
+        return ERROR;
+    }
+    return OK;
+}
+
+// Merges a sorted packet with a delta by tag, counting the entries and data of
+// the result. If dst is not NULL, also adds the entries to it.
+static void apply_sorted_camera_metadata_delta(const camera_metadata_t *prev,
+        const camera_metadata_delta_t *delta,
+        camera_metadata_t *dst,
+        size_t *entry_count,
+        size_t *data_count) {
+    const camera_metadata_t *changes = get_delta_changes(delta);
+    const camera_metadata_buffer_entry_t *a = get_entries(prev);
+    const camera_metadata_buffer_entry_t *c = get_entries(changes);
+    size_t i = 0;
+    size_t j = 0;
+    size_t k = 0;
+
+    *entry_count = 0;
+    *data_count = 0;
+    while (i < prev->entry_count || k < delta->replaced_count) {
+        if (k < delta->replaced_count &&
+                (i == prev->entry_count ||
+                        delta->replaced_tags[k] <= a[i].tag)) {
+            uint32_t tag = delta->replaced_tags[k++];
+            while (i < prev->entry_count && a[i].tag == tag) i++;
+            for (; j < changes->entry_count && c[j].tag == tag; j++) {
+                merge_entry(dst, changes, c + j, entry_count, data_count);
+            }
+        } else {
+            merge_entry(dst, prev, a + i++, entry_count, data_count);
+        }
+    }
+    if (dst != NULL) {
+        dst->flags |= FLAG_SORTED;
+    }
+}
+
+camera_metadata_t *apply_camera_metadata_delta(const camera_metadata_t *prev,
+        const camera_metadata_delta_t *delta) {
+    if (validate_camera_metadata_delta(delta, NULL) != OK) return NULL;
+
+    camera_metadata_t *sorted_prev;
+    const camera_metadata_t *a = get_sorted_camera_metadata(prev, &sorted_prev);
+    camera_metadata_t *result = NULL;
+
+    if (a != NULL) {
+        size_t entry_count, data_count;
+        apply_sorted_camera_metadata_delta(a, delta, NULL,
+                &entry_count, &data_count);
+        result = allocate_camera_metadata(entry_count, data_count);
+        if (result != NULL) {
+            apply_sorted_camera_metadata_delta(a, delta, result,
+                    &entry_count, &data_count);
+        }
+    }
+
+    free_camera_metadata(sorted_prev);
+    assert(result == NULL ||
+            validate_camera_metadata_structure(result, NULL) == OK);
+    return result;
+}
+
+void free_camera_metadata_delta(camera_metadata_delta_t *delta) {
+    free(delta);
+}
+
+int append_camera_metadata_override(camera_metadata_t *dst,
+        const camera_metadata_t *src) {
+    if (dst == NULL || src == NULL) return ERROR;
+    if (sort_camera_metadata(dst) != OK) return ERROR;
+
+    camera_metadata_t *sorted_src;
+    const camera_metadata_t *b = get_sorted_camera_metadata(src, &sorted_src);
+    if (b == NULL) {
+        free_camera_metadata(sorted_src);
+        return ERROR;
+    }
+
+    // Find the dst entries that src overrides
+    camera_metadata_buffer_entry_t *a = get_entries(dst);
+    const camera_metadata_buffer_entry_t *entries = get_entries(b);
+    size_t kept_count = 0;
+    size_t dropped_bytes = 0;
+    for (size_t i = 0, j = 0; i < dst->entry_count; i++) {
+        while (j < b->entry_count && entries[j].tag < a[i].tag) j++;
+        if (j < b->entry_count && entries[j].tag == a[i].tag) {
+            dropped_bytes += calculate_camera_metadata_entry_data_size(
+                    a[i].type, a[i].count);
+        } else {
+            kept_count++;
+        }
+    }
+
+    int res = ERROR;
+    if (dst->entry_capacity - kept_count >= b->entry_count &&
+            dst->data_capacity + dropped_bytes >=
+                    get_live_data_bytes(dst) + b->data_count) {
+        // Drop the overridden entries, leaving holes in the data
+        size_t kept = 0;
+        for (size_t i = 0, j = 0; i < dst->entry_count; i++) {
+            while (j < b->entry_count && entries[j].tag < a[i].tag) j++;
+            if (j == b->entry_count || entries[j].tag != a[i].tag) {
+                a[kept++] = a[i];
+            }
+        }
+        dst->entry_count = kept;
+
+        res = OK;
+        if (dst->data_capacity - dst->data_count < b->data_count ||
+                (dropped_bytes > 0 &&
+                        !(dst->flags & FLAG_DEFER_COMPACTION))) {
+            res = compact_camera_metadata(dst);
+        }
+        if (res == OK) {
+            res = append_camera_metadata(dst, b);
+        }
+    }
+
+    free_camera_metadata(sorted_src);
+    return res;
+}
+
 static const vendor_tag_ops_t *vendor_tag_ops = NULL;
 
+/**
+ * Snapshot of the vendor tags, taken when the vendor tag ops are set, so that
+ * vendor tag queries are table lookups like those for Android tags. Sections are
+ * indexed from VENDOR_SECTION, and each covers the tags from its first to its
+ * last supported tag. If the ops can't enumerate their tags, or the tags are
+ * too sparse to tabulate, queries call through the ops instead.
+ */
+#define VENDOR_CACHE_MAX_SECTIONS 256
+#define VENDOR_CACHE_MAX_SECTION_SPAN 4096
+
+typedef struct vendor_tag_cache_info {
+    const char *tag_name;
+    int         tag_type;
+} vendor_tag_cache_info_t;
+
+typedef struct vendor_section_cache {
+    const char              *section_name;
+    uint32_t                 start;
+    uint32_t                 end;
+    vendor_tag_cache_info_t *tags;
+} vendor_section_cache_t;
+
+typedef struct vendor_tag_cache {
+    struct vendor_tag_cache *next_retired;
+    uint32_t                 section_count;
+    vendor_section_cache_t   sections[];
+} vendor_tag_cache_t;
+
+/**
+ * Queries may run concurrently with set_camera_metadata_vendor_ops(), so they
+ * load the cache once with acquire semantics, and a replaced cache is never
+ * freed: it is kept on the retired list instead. The ops are set rarely,
+ * typically once per process, so this only costs the few replaced caches.
+ */
+static vendor_tag_cache_t *vendor_tag_cache = NULL;
+static vendor_tag_cache_t *retired_vendor_tag_caches = NULL;
+
+static const vendor_tag_cache_t *load_vendor_tag_cache(void) {
+    return __atomic_load_n(&vendor_tag_cache, __ATOMIC_ACQUIRE);
+}
+
+static vendor_tag_cache_t *build_vendor_tag_cache(const vendor_tag_ops_t *ops) {
+    if (ops == NULL || ops->get_tag_count == NULL ||
+            ops->get_all_tags == NULL) {
+        return NULL;
+    }
+    int tag_count = ops->get_tag_count(ops);
+    if (tag_count <= 0) return NULL;
+    uint32_t *tags = malloc(sizeof(uint32_t[tag_count]));
+    if (tags == NULL) return NULL;
+    ops->get_all_tags(ops, tags);
+
+    uint32_t section_count = 0;
+    uint32_t bounds[VENDOR_CACHE_MAX_SECTIONS][2];
+    for (int i = 0; i < tag_count; i++) {
+        uint32_t section = (tags[i] >> 16) - VENDOR_SECTION;
+        if ((tags[i] >> 16) < VENDOR_SECTION ||
+                section >= VENDOR_CACHE_MAX_SECTIONS) {
+            free(tags);
+            return NULL;
+        }
+        for (; section_count <= section; section_count++) {
+            bounds[section_count][0] = UINT32_MAX;
+            bounds[section_count][1] = 0;
+        }
+        if (tags[i] < bounds[section][0]) bounds[section][0] = tags[i];
+        if (tags[i] >= bounds[section][1]) bounds[section][1] = tags[i] + 1;
+    }
+    size_t total_span = 0;
+    for (uint32_t i = 0; i < section_count; i++) {
+        if (bounds[i][1] == 0) continue;
+        if (bounds[i][1] - bounds[i][0] > VENDOR_CACHE_MAX_SECTION_SPAN) {
+            free(tags);
+            return NULL;
+        }
+        total_span += bounds[i][1] - bounds[i][0];
+    }
+
+    vendor_tag_cache_t *cache = calloc(1, sizeof(vendor_tag_cache_t) +
+            sizeof(vendor_section_cache_t[section_count]) +
+            sizeof(vendor_tag_cache_info_t[total_span]));
+    if (cache == NULL) {
+        free(tags);
+        return NULL;
+    }
+    cache->section_count = section_count;
+    vendor_tag_cache_info_t *info =
+            (vendor_tag_cache_info_t*)(cache->sections + section_count);
+    for (uint32_t i = 0; i < section_count; i++) {
+        vendor_section_cache_t *section = cache->sections + i;
+        if (bounds[i][1] == 0) continue;
+        section->section_name = ops->get_section_name(ops, bounds[i][0]);
+        section->start = bounds[i][0];
+        section->end = bounds[i][1];
+        section->tags = info;
+        for (uint32_t tag = section->start; tag < section->end; tag++, info++) {
+            info->tag_type = -1;
+        }
+    }
+    for (int i = 0; i < tag_count; i++) {
+        vendor_section_cache_t *section =
+                cache->sections + (tags[i] >> 16) - VENDOR_SECTION;
+        info = section->tags + (tags[i] - section->start);
+        info->tag_name = ops->get_tag_name(ops, tags[i]);
+        info->tag_type = ops->get_tag_type(ops, tags[i]);
+    }
+
+    free(tags);
+    return cache;
+}
+
+// Returns the cached section of a vendor tag, or NULL if it has none
+static const vendor_section_cache_t *get_vendor_section_cache(
+        const vendor_tag_cache_t *cache, uint32_t tag) {
+    uint32_t section = (tag >> 16) - VENDOR_SECTION;
+    if (section >= cache->section_count ||
+            cache->sections[section].tags == NULL) {
+        return NULL;
+    }
+    return cache->sections + section;
+}
+
+// Returns the cached info of a vendor tag, or NULL if it is not supported
+static const vendor_tag_cache_info_t *get_vendor_tag_cache_info(
+        const vendor_tag_cache_t *cache, uint32_t tag) {
+    const vendor_section_cache_t *section = get_vendor_section_cache(cache, tag);
+    if (section == NULL || tag < section->start || tag >= section->end) {
+        return NULL;
+    }
+    return section->tags + (tag - section->start);
+}
+
 const char *get_camera_metadata_section_name(uint32_t tag) {
     uint32_t tag_section = tag >> 16;
-    if (tag_section >= VENDOR_SECTION && vendor_tag_ops != NULL) {
-        return vendor_tag_ops->get_section_name(
-            vendor_tag_ops,
-            tag);
+    const vendor_tag_cache_t *cache =
+            tag_section >= VENDOR_SECTION ? load_vendor_tag_cache() : NULL;
+    if (cache != NULL) {
+        const vendor_section_cache_t *section = get_vendor_section_cache(cache, tag);
+        return section != NULL ? section->section_name : NULL;
+    }
+    const vendor_tag_ops_t *ops = vendor_tag_ops;
+    if (tag_section >= VENDOR_SECTION && ops != NULL) {
+        return ops->get_section_name(ops, tag);
     }
     if (tag_section >= ANDROID_SECTION_COUNT) {
         return NULL;
@@ -835,10 +1971,15 @@ const char *get_camera_metadata_section_name(uint32_t tag) {
 
 const char *get_camera_metadata_tag_name(uint32_t tag) {
     uint32_t tag_section = tag >> 16;
-    if (tag_section >= VENDOR_SECTION && vendor_tag_ops != NULL) {
-        return vendor_tag_ops->get_tag_name(
-            vendor_tag_ops,
-            tag);
+    const vendor_tag_cache_t *cache =
+            tag_section >= VENDOR_SECTION ? load_vendor_tag_cache() : NULL;
+    if (cache != NULL) {
+        const vendor_tag_cache_info_t *info = get_vendor_tag_cache_info(cache, tag);
+        return info != NULL ? info->tag_name : NULL;
+    }
+    const vendor_tag_ops_t *ops = vendor_tag_ops;
+    if (tag_section >= VENDOR_SECTION && ops != NULL) {
+        return ops->get_tag_name(ops, tag);
     }
     if (tag_section >= ANDROID_SECTION_COUNT ||
         tag >= camera_metadata_section_bounds[tag_section][1] ) {
@@ -850,10 +1991,15 @@ const char *get_camera_metadata_tag_name(uint32_t tag) {
 
 int get_camera_metadata_tag_type(uint32_t tag) {
     uint32_t tag_section = tag >> 16;
-    if (tag_section >= VENDOR_SECTION && vendor_tag_ops != NULL) {
-        return vendor_tag_ops->get_tag_type(
-            vendor_tag_ops,
-            tag);
+    const vendor_tag_cache_t *cache =
+            tag_section >= VENDOR_SECTION ? load_vendor_tag_cache() : NULL;
+    if (cache != NULL) {
+        const vendor_tag_cache_info_t *info = get_vendor_tag_cache_info(cache, tag);
+        return info != NULL ? info->tag_type : -1;
+    }
+    const vendor_tag_ops_t *ops = vendor_tag_ops;
+    if (tag_section >= VENDOR_SECTION && ops != NULL) {
+        return ops->get_tag_type(ops, tag);
     }
     if (tag_section >= ANDROID_SECTION_COUNT ||
             tag >= camera_metadata_section_bounds[tag_section][1] ) {
@@ -863,6 +2009,37 @@ int get_camera_metadata_tag_type(uint32_t tag) {
     return tag_info[tag_section][tag_index].tag_type;
 }
 
+// 32-bit FNV-1a, kept in sync with perfect_hash_name() in metadata_helpers.py
+static uint32_t hash_tag_name(const char *name, uint32_t seed) {
+    uint32_t hash = 0x811c9dc5 ^ seed;
+    for (; *name != '\0'; name++) {
+        hash = (hash ^ (uint8_t)*name) * 0x01000193;
+    }
+    return hash;
+}
+
+int get_camera_metadata_tag_by_name(const char *name, uint32_t *tag) {
+    if (name == NULL || tag == NULL) return ERROR;
+
+    int32_t d = camera_metadata_tag_name_displacements[
+            hash_tag_name(name, 0) % CAMERA_METADATA_TAG_NAME_BUCKET_COUNT];
+    uint32_t slot = d < 0 ? (uint32_t)(-d - 1) :
+            hash_tag_name(name, d) % CAMERA_METADATA_TAG_NAME_SLOT_COUNT;
+    uint32_t candidate = camera_metadata_tag_name_slots[slot];
+
+    // Every name hashes to some slot, so check it names the candidate tag
+    const char *section_name = camera_metadata_section_names[candidate >> 16];
+    size_t section_length = strlen(section_name);
+    if (strncmp(name, section_name, section_length) != 0 ||
+            name[section_length] != '.' ||
+            strcmp(name + section_length + 1,
+                    tag_info[candidate >> 16][candidate & 0xFFFF].tag_name) != 0) {
+        return ERROR;
+    }
+    *tag = candidate;
+    return OK;
+}
+
 int set_camera_metadata_vendor_tag_ops(const vendor_tag_query_ops_t* ops) {
     // **DEPRECATED**
     (void) ops;
@@ -872,7 +2049,14 @@ int set_camera_metadata_vendor_tag_ops(const vendor_tag_query_ops_t* ops) {
 
 // Declared in system/media/private/camera/include/camera_metadata_hidden.h
 int set_camera_metadata_vendor_ops(const vendor_tag_ops_t* ops) {
+    vendor_tag_cache_t *new_cache = build_vendor_tag_cache(ops);
     vendor_tag_ops = ops;
+    vendor_tag_cache_t *old_cache =
+            __atomic_exchange_n(&vendor_tag_cache, new_cache, __ATOMIC_ACQ_REL);
+    if (old_cache != NULL) {
+        old_cache->next_retired = retired_vendor_tag_caches;
+        retired_vendor_tag_caches = old_cache;
+    }
     return OK;
 }
 
@@ -703,6 +703,350 @@ tag_info_t *tag_info[ANDROID_SECTION_COUNT] = {
     android_depth,
 };
 
+/**
+ * Minimal perfect hash from full tag name to tag, used by
+ * get_camera_metadata_tag_by_name(). See perfect_hash() in metadata_helpers.py.
+ */
+#define CAMERA_METADATA_TAG_NAME_BUCKET_COUNT 110
+#define CAMERA_METADATA_TAG_NAME_SLOT_COUNT 219
+
+static const int32_t camera_metadata_tag_name_displacements[
+        CAMERA_METADATA_TAG_NAME_BUCKET_COUNT] = {
+    -2,
+    2,
+    1,
+    0,
+    -22,
+    1,
+    -28,
+    -29,
+    1,
+    1,
+    -34,
+    5,
+    1,
+    20,
+    -45,
+    1,
+    1,
+    10,
+    20,
+    6,
+    -54,
+    -68,
+    1,
+    13,
+    -70,
+    0,
+    2,
+    0,
+    1,
+    11,
+    10,
+    -78,
+    1,
+    -80,
+    1,
+    11,
+    2,
+    7,
+    0,
+    4,
+    -81,
+    2,
+    -86,
+    -90,
+    6,
+    13,
+    1,
+    -92,
+    2,
+    10,
+    6,
+    -102,
+    25,
+    -116,
+    18,
+    1,
+    0,
+    2,
+    3,
+    11,
+    -120,
+    -124,
+    0,
+    4,
+    2,
+    -128,
+    -139,
+    -149,
+    19,
+    2,
+    3,
+    3,
+    -152,
+    1,
+    4,
+    2,
+    -154,
+    6,
+    1,
+    -161,
+    13,
+    -167,
+    -170,
+    2,
+    -171,
+    14,
+    7,
+    0,
+    1,
+    -181,
+    6,
+    1,
+    -185,
+    2,
+    13,
+    -187,
+    1,
+    6,
+    9,
+    -193,
+    14,
+    7,
+    0,
+    -197,
+    -198,
+    13,
+    13,
+    -209,
+    14,
+    -214,
+};
+
+static const uint32_t camera_metadata_tag_name_slots[
+        CAMERA_METADATA_TAG_NAME_SLOT_COUNT] = {
+    ANDROID_REQUEST_AVAILABLE_RESULT_KEYS,
+    ANDROID_CONTROL_MAX_REGIONS,
+    ANDROID_QUIRKS_USE_PARTIAL_RESULT,
+    ANDROID_REQUEST_OUTPUT_STREAMS,
+    ANDROID_NOISE_REDUCTION_STRENGTH,
+    ANDROID_SENSOR_NEUTRAL_COLOR_POINT,
+    ANDROID_SENSOR_AVAILABLE_TEST_PATTERN_MODES,
+    ANDROID_SCALER_AVAILABLE_RAW_MIN_DURATIONS,
+    ANDROID_JPEG_ORIENTATION,
+    ANDROID_SENSOR_OPTICAL_BLACK_REGIONS,
+    ANDROID_DEPTH_AVAILABLE_DEPTH_MIN_FRAME_DURATIONS,
+    ANDROID_SCALER_AVAILABLE_PROCESSED_SIZES,
+    ANDROID_CONTROL_AE_MODE,
+    ANDROID_BLACK_LEVEL_LOCK,
+    ANDROID_SCALER_AVAILABLE_PROCESSED_MIN_DURATIONS,
+    ANDROID_CONTROL_AWB_REGIONS,
+    ANDROID_SENSOR_INFO_TIMESTAMP_SOURCE,
+    ANDROID_SCALER_AVAILABLE_FORMATS,
+    ANDROID_COLOR_CORRECTION_MODE,
+    ANDROID_REQUEST_METADATA_MODE,
+    ANDROID_STATISTICS_FACE_DETECT_MODE,
+    ANDROID_LENS_FACING,
+    ANDROID_SENSOR_ROLLING_SHUTTER_SKEW,
+    ANDROID_CONTROL_AVAILABLE_EFFECTS,
+    ANDROID_SENSOR_TEST_PATTERN_DATA,
+    ANDROID_HOT_PIXEL_MODE,
+    ANDROID_REPROCESS_EFFECTIVE_EXPOSURE_FACTOR,
+    ANDROID_STATISTICS_INFO_MAX_HISTOGRAM_COUNT,
+    ANDROID_SENSOR_FRAME_DURATION,
+    ANDROID_CONTROL_AWB_STATE,
+    ANDROID_JPEG_THUMBNAIL_SIZE,
+    ANDROID_STATISTICS_INFO_SHARPNESS_MAP_SIZE,
+    ANDROID_CONTROL_MODE,
+    ANDROID_SCALER_AVAILABLE_STALL_DURATIONS,
+    ANDROID_SENSOR_INFO_PIXEL_ARRAY_SIZE,
+    ANDROID_REQUEST_INPUT_STREAMS,
+    ANDROID_NOISE_REDUCTION_AVAILABLE_NOISE_REDUCTION_MODES,
+    ANDROID_REQUEST_FRAME_COUNT,
+    ANDROID_STATISTICS_INFO_AVAILABLE_FACE_DETECT_MODES,
+    ANDROID_FLASH_COLOR_TEMPERATURE,
+    ANDROID_STATISTICS_PREDICTED_COLOR_TRANSFORM,
+    ANDROID_SENSOR_INFO_MAX_FRAME_DURATION,
+    ANDROID_SENSOR_CALIBRATION_TRANSFORM2,
+    ANDROID_STATISTICS_PREDICTED_COLOR_GAINS,
+    ANDROID_FLASH_FIRING_TIME,
+    ANDROID_CONTROL_AE_LOCK,
+    ANDROID_CONTROL_AE_STATE,
+    ANDROID_FLASH_INFO_AVAILABLE,
+    ANDROID_CONTROL_CAPTURE_INTENT,
+    ANDROID_REQUEST_AVAILABLE_CHARACTERISTICS_KEYS,
+    ANDROID_SENSOR_SENSITIVITY,
+    ANDROID_STATISTICS_INFO_HISTOGRAM_BUCKET_COUNT,
+    ANDROID_JPEG_GPS_PROCESSING_METHOD,
+    ANDROID_SENSOR_EXPOSURE_TIME,
+    ANDROID_STATISTICS_SHARPNESS_MAP,
+    ANDROID_SCALER_AVAILABLE_JPEG_MIN_DURATIONS,
+    ANDROID_CONTROL_AWB_MODE,
+    ANDROID_LENS_OPTICAL_STABILIZATION_MODE,
+    ANDROID_REPROCESS_MAX_CAPTURE_STALL,
+    ANDROID_LENS_INFO_AVAILABLE_APERTURES,
+    ANDROID_COLOR_CORRECTION_AVAILABLE_ABERRATION_MODES,
+    ANDROID_SENSOR_OPAQUE_RAW_SIZE,
+    ANDROID_REQUEST_PARTIAL_RESULT_COUNT,
+    ANDROID_SENSOR_INFO_LENS_SHADING_APPLIED,
+    ANDROID_CONTROL_AF_TRIGGER,
+    ANDROID_CONTROL_AF_REGIONS,
+    ANDROID_CONTROL_VIDEO_STABILIZATION_MODE,
+    ANDROID_LENS_INTRINSIC_CALIBRATION,
+    ANDROID_SENSOR_INFO_WHITE_LEVEL,
+    ANDROID_CONTROL_AWB_LOCK,
+    ANDROID_SENSOR_FORWARD_MATRIX1,
+    ANDROID_LENS_APERTURE,
+    ANDROID_FLASH_MAX_ENERGY,
+    ANDROID_STATISTICS_HISTOGRAM,
+    ANDROID_CONTROL_AVAILABLE_HIGH_SPEED_VIDEO_CONFIGURATIONS,
+    ANDROID_CONTROL_AF_STATE,
+    ANDROID_REQUEST_MAX_NUM_INPUT_STREAMS,
+    ANDROID_SCALER_AVAILABLE_RAW_SIZES,
+    ANDROID_CONTROL_AE_PRECAPTURE_ID,
+    ANDROID_FLASH_MODE,
+    ANDROID_SENSOR_INFO_ACTIVE_ARRAY_SIZE,
+    ANDROID_SENSOR_TIMESTAMP,
+    ANDROID_STATISTICS_INFO_AVAILABLE_HOT_PIXEL_MAP_MODES,
+    ANDROID_CONTROL_AF_TRIGGER_ID,
+    ANDROID_JPEG_AVAILABLE_THUMBNAIL_SIZES,
+    ANDROID_REQUEST_AVAILABLE_CAPABILITIES,
+    ANDROID_COLOR_CORRECTION_ABERRATION_MODE,
+    ANDROID_SCALER_AVAILABLE_INPUT_OUTPUT_FORMATS_MAP,
+    ANDROID_SYNC_MAX_LATENCY,
+    ANDROID_CONTROL_AE_COMPENSATION_STEP,
+    ANDROID_LENS_INFO_HYPERFOCAL_DISTANCE,
+    ANDROID_SENSOR_COLOR_TRANSFORM2,
+    ANDROID_DEMOSAIC_MODE,
+    ANDROID_LENS_FOCAL_LENGTH,
+    ANDROID_SENSOR_FORWARD_MATRIX2,
+    ANDROID_CONTROL_AE_COMPENSATION_RANGE,
+    ANDROID_LENS_INFO_AVAILABLE_OPTICAL_STABILIZATION,
+    ANDROID_SHADING_AVAILABLE_MODES,
+    ANDROID_SHADING_STRENGTH,
+    ANDROID_CONTROL_SCENE_MODE,
+    ANDROID_CONTROL_AE_AVAILABLE_TARGET_FPS_RANGES,
+    ANDROID_CONTROL_AE_AVAILABLE_ANTIBANDING_MODES,
+    ANDROID_SENSOR_BASE_GAIN_FACTOR,
+    ANDROID_QUIRKS_USE_ZSL_FORMAT,
+    ANDROID_SENSOR_REFERENCE_ILLUMINANT2,
+    ANDROID_CONTROL_SCENE_MODE_OVERRIDES,
+    ANDROID_CONTROL_AE_AVAILABLE_MODES,
+    ANDROID_LED_TRANSMIT,
+    ANDROID_CONTROL_AVAILABLE_VIDEO_STABILIZATION_MODES,
+    ANDROID_CONTROL_AF_MODE,
+    ANDROID_SENSOR_DYNAMIC_WHITE_LEVEL,
+    ANDROID_REQUEST_AVAILABLE_REQUEST_KEYS,
+    ANDROID_SCALER_CROP_REGION,
+    ANDROID_JPEG_MAX_SIZE,
+    ANDROID_STATISTICS_LENS_SHADING_CORRECTION_MAP,
+    ANDROID_LENS_FOCUS_RANGE,
+    ANDROID_EDGE_MODE,
+    ANDROID_DEPTH_DEPTH_IS_EXCLUSIVE,
+    ANDROID_JPEG_GPS_TIMESTAMP,
+    ANDROID_SCALER_AVAILABLE_STREAM_CONFIGURATIONS,
+    ANDROID_LENS_INFO_SHADING_MAP_SIZE,
+    ANDROID_FLASH_FIRING_POWER,
+    ANDROID_REQUEST_PIPELINE_DEPTH,
+    ANDROID_HOT_PIXEL_AVAILABLE_HOT_PIXEL_MODES,
+    ANDROID_TONEMAP_MAX_CURVE_POINTS,
+    ANDROID_SENSOR_MAX_ANALOG_SENSITIVITY,
+    ANDROID_CONTROL_AWB_AVAILABLE_MODES,
+    ANDROID_CONTROL_AE_LOCK_AVAILABLE,
+    ANDROID_LENS_INFO_AVAILABLE_FOCAL_LENGTHS,
+    ANDROID_SENSOR_INFO_EXPOSURE_TIME_RANGE,
+    ANDROID_STATISTICS_FACE_SCORES,
+    ANDROID_SENSOR_REFERENCE_ILLUMINANT1,
+    ANDROID_LED_AVAILABLE_LEDS,
+    ANDROID_STATISTICS_FACE_LANDMARKS,
+    ANDROID_FLASH_INFO_CHARGE_DURATION,
+    ANDROID_SCALER_AVAILABLE_MAX_DIGITAL_ZOOM,
+    ANDROID_STATISTICS_FACE_RECTANGLES,
+    ANDROID_CONTROL_AWB_LOCK_AVAILABLE,
+    ANDROID_SENSOR_TEMPERATURE,
+    ANDROID_TONEMAP_CURVE_RED,
+    ANDROID_REQUEST_MAX_NUM_OUTPUT_STREAMS,
+    ANDROID_CONTROL_AF_AVAILABLE_MODES,
+    ANDROID_LENS_INFO_AVAILABLE_FILTER_DENSITIES,
+    ANDROID_SENSOR_PROFILE_HUE_SAT_MAP,
+    ANDROID_STATISTICS_INFO_AVAILABLE_LENS_SHADING_MAP_MODES,
+    ANDROID_SENSOR_DYNAMIC_BLACK_LEVEL,
+    ANDROID_REQUEST_ID,
+    ANDROID_LENS_RADIAL_DISTORTION,
+    ANDROID_COLOR_CORRECTION_TRANSFORM,
+    ANDROID_QUIRKS_PARTIAL_RESULT,
+    ANDROID_REQUEST_MAX_NUM_REPROCESS_STREAMS,
+    ANDROID_CONTROL_AE_REGIONS,
+    ANDROID_LENS_STATE,
+    ANDROID_LENS_FILTER_DENSITY,
+    ANDROID_TONEMAP_GAMMA,
+    ANDROID_SYNC_FRAME_NUMBER,
+    ANDROID_INFO_SUPPORTED_HARDWARE_LEVEL,
+    ANDROID_LENS_INFO_FOCUS_DISTANCE_CALIBRATION,
+    ANDROID_SENSOR_INFO_PHYSICAL_SIZE,
+    ANDROID_SCALER_AVAILABLE_JPEG_SIZES,
+    ANDROID_JPEG_QUALITY,
+    ANDROID_SHADING_MODE,
+    ANDROID_CONTROL_AVAILABLE_SCENE_MODES,
+    ANDROID_SENSOR_ORIENTATION,
+    ANDROID_STATISTICS_SCENE_FLICKER,
+    ANDROID_STATISTICS_HOT_PIXEL_MAP_MODE,
+    ANDROID_CONTROL_AE_ANTIBANDING_MODE,
+    ANDROID_SENSOR_PROFILE_HUE_SAT_MAP_DIMENSIONS,
+    ANDROID_CONTROL_POST_RAW_SENSITIVITY_BOOST,
+    ANDROID_LENS_POSE_TRANSLATION,
+    ANDROID_STATISTICS_LENS_SHADING_MAP_MODE,
+    ANDROID_EDGE_STRENGTH,
+    ANDROID_SENSOR_TEST_PATTERN_MODE,
+    ANDROID_CONTROL_AVAILABLE_MODES,
+    ANDROID_SENSOR_GREEN_SPLIT,
+    ANDROID_TONEMAP_MODE,
+    ANDROID_DEPTH_AVAILABLE_DEPTH_STREAM_CONFIGURATIONS,
+    ANDROID_QUIRKS_METERING_CROP_REGION,
+    ANDROID_NOISE_REDUCTION_MODE,
+    ANDROID_LENS_FOCUS_DISTANCE,
+    ANDROID_STATISTICS_LENS_SHADING_MAP,
+    ANDROID_SENSOR_PROFILE_TONE_CURVE,
+    ANDROID_DEPTH_MAX_DEPTH_SAMPLES,
+    ANDROID_FLASH_STATE,
+    ANDROID_CONTROL_AE_TARGET_FPS_RANGE,
+    ANDROID_TONEMAP_CURVE_BLUE,
+    ANDROID_JPEG_GPS_COORDINATES,
+    ANDROID_CONTROL_EFFECT_MODE,
+    ANDROID_SENSOR_INFO_PRE_CORRECTION_ACTIVE_ARRAY_SIZE,
+    ANDROID_JPEG_SIZE,
+    ANDROID_TONEMAP_CURVE_GREEN,
+    ANDROID_CONTROL_AE_PRECAPTURE_TRIGGER,
+    ANDROID_TONEMAP_AVAILABLE_TONE_MAP_MODES,
+    ANDROID_JPEG_THUMBNAIL_QUALITY,
+    ANDROID_REQUEST_PIPELINE_MAX_DEPTH,
+    ANDROID_SENSOR_COLOR_TRANSFORM1,
+    ANDROID_SENSOR_BLACK_LEVEL_PATTERN,
+    ANDROID_TONEMAP_PRESET_CURVE,
+    ANDROID_STATISTICS_HISTOGRAM_MODE,
+    ANDROID_SENSOR_INFO_SENSITIVITY_RANGE,
+    ANDROID_SENSOR_INFO_COLOR_FILTER_ARRANGEMENT,
+    ANDROID_REQUEST_TYPE,
+    ANDROID_EDGE_AVAILABLE_EDGE_MODES,
+    ANDROID_QUIRKS_TRIGGER_AF_WITH_AUTO,
+    ANDROID_CONTROL_POST_RAW_SENSITIVITY_BOOST_RANGE,
+    ANDROID_SENSOR_CALIBRATION_TRANSFORM1,
+    ANDROID_STATISTICS_HOT_PIXEL_MAP,
+    ANDROID_STATISTICS_INFO_MAX_SHARPNESS_MAP_VALUE,
+    ANDROID_STATISTICS_INFO_MAX_FACE_COUNT,
+    ANDROID_SCALER_AVAILABLE_MIN_FRAME_DURATIONS,
+    ANDROID_STATISTICS_SHARPNESS_MAP_MODE,
+    ANDROID_DEPTH_AVAILABLE_DEPTH_STALL_DURATIONS,
+    ANDROID_SCALER_CROPPING_TYPE,
+    ANDROID_SENSOR_NOISE_PROFILE,
+    ANDROID_CONTROL_AE_EXPOSURE_COMPENSATION,
+    ANDROID_LENS_POSE_ROTATION,
+    ANDROID_COLOR_CORRECTION_GAINS,
+    ANDROID_LENS_INFO_MINIMUM_FOCUS_DISTANCE,
+    ANDROID_STATISTICS_FACE_IDS,
+};
+
 int camera_metadata_enum_snprint(uint32_t tag,
                                  uint32_t value,
                                  char *dst,
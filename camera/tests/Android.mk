@@ -23,3 +23,23 @@ LOCAL_MODULE_STEM_64 := camera_metadata_tests64
 LOCAL_MULTILIB := both
 
 include $(BUILD_NATIVE_TEST)
+
+# Build the benchmark.
+include $(CLEAR_VARS)
+
+LOCAL_SHARED_LIBRARIES := \
+	libcamera_metadata
+
+LOCAL_C_INCLUDES := \
+	system/media/camera/include \
+	system/media/private/camera/include
+
+LOCAL_SRC_FILES := \
+	camera_metadata_benchmark.cpp
+
+LOCAL_CFLAGS += -Wall -Wextra -Werror -O2
+
+LOCAL_MODULE := camera_metadata_benchmark
+LOCAL_MODULE_TAGS := tests
+
+include $(BUILD_EXECUTABLE)
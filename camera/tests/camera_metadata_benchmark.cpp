@@ -0,0 +1,292 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Benchmark for the camera_metadata library.
+// Packets of request and result sizes are built from the tags in camera_metadata_tags.h, and the
+// operations on the per-frame path are timed on them.  For each operation and packet size this
+// reports the best mean time per operation over several repeats, and the heap growth per operation
+// for those that allocate.  Compare the results before and after a change, on an otherwise idle
+// device.
+
+#include <malloc.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <functional>
+#include <vector>
+#include <system/camera_metadata.h>
+
+static inline int64_t systemTimeNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static size_t heapBytes()
+{
+    return mallinfo().uordblks;
+}
+
+// Number of packets worked on per repeat, so that each timing covers many operations
+static const size_t kBatch = 64;
+static const int kRepeats = 7;
+// Largest payload of any entry, in values
+static const size_t kMaxCount = 16;
+
+// The entries of a packet, in the order they are added
+struct Template {
+    std::vector<uint32_t> mTags;
+    std::vector<size_t> mCounts;
+    size_t mDataCapacity;
+};
+
+static const uint8_t sValues[kMaxCount * sizeof(double) + 2 * sizeof(double)] = {};
+
+// Take entryCount tags across all sections in a scrambled order, so the packet is not sorted.
+// Tags repeat once all of the defined tags are used.  Every fifth entry holds several values,
+// like the region and matrix tags of real requests.
+static Template makeTemplate(size_t entryCount)
+{
+    std::vector<uint32_t> tags;
+    for (int section = 0; section < ANDROID_SECTION_COUNT; section++) {
+        for (uint32_t tag = camera_metadata_section_bounds[section][0];
+                tag < camera_metadata_section_bounds[section][1]; tag++) {
+            if (get_camera_metadata_tag_type(tag) >= 0) {
+                tags.push_back(tag);
+            }
+        }
+    }
+    Template t;
+    t.mDataCapacity = 0;
+    for (size_t i = 0; i < entryCount; i++) {
+        uint32_t tag = tags[(i * 7919) % tags.size()];
+        size_t count = i % 5 == 0 ? kMaxCount : 1;
+        t.mTags.push_back(tag);
+        t.mCounts.push_back(count);
+        t.mDataCapacity += calculate_camera_metadata_entry_data_size(
+                get_camera_metadata_tag_type(tag), count);
+    }
+    return t;
+}
+
+static void fill(camera_metadata_t *m, const Template &t)
+{
+    for (size_t i = 0; i < t.mTags.size(); i++) {
+        add_camera_metadata_entry(m, t.mTags[i], sValues, t.mCounts[i]);
+    }
+}
+
+// Run setup() then time run() kRepeats times, and print the best time per operation, and for
+// the best repeat the heap growth per operation measured before cleanup().
+static void measure(const char *name, size_t entries, size_t ops,
+        const std::function<void()> &setup, const std::function<void()> &run,
+        const std::function<void()> &cleanup)
+{
+    int64_t bestNs = INT64_MAX;
+    size_t bestBytes = 0;
+    for (int repeat = 0; repeat < kRepeats; repeat++) {
+        setup();
+        size_t heapBefore = heapBytes();
+        int64_t before = systemTimeNs();
+        run();
+        int64_t elapsedNs = systemTimeNs() - before;
+        size_t heapAfter = heapBytes();
+        cleanup();
+        if (elapsedNs < bestNs) {
+            bestNs = elapsedNs;
+            bestBytes = heapAfter > heapBefore ? heapAfter - heapBefore : 0;
+        }
+    }
+    printf("%-22s %5zu %10.1f %10.1f\n", name, entries, (double) bestNs / ops,
+            (double) bestBytes / ops);
+}
+
+static void runAll(size_t entryCount)
+{
+    const Template t = makeTemplate(entryCount);
+    const size_t entries = t.mTags.size();
+    // room for every entry to grow by two values during updates
+    const size_t dataCapacity = t.mDataCapacity + entries * 2 * sizeof(double);
+    auto none = [] {};
+
+    camera_metadata_t *unsorted = allocate_camera_metadata(entries, dataCapacity);
+    fill(unsorted, t);
+    camera_metadata_t *sorted = clone_camera_metadata(unsorted);
+    sort_camera_metadata(sorted);
+    const size_t size = get_camera_metadata_size(unsorted);
+
+    std::vector<camera_metadata_t *> batch(kBatch);
+    std::vector<char> memory(kBatch * size + get_camera_metadata_alignment());
+    char *aligned = &memory[0] + (get_camera_metadata_alignment() -
+            (uintptr_t) &memory[0] % get_camera_metadata_alignment()) %
+            get_camera_metadata_alignment();
+    auto place = [&] {
+        for (size_t b = 0; b < kBatch; b++) {
+            batch[b] = place_camera_metadata(aligned + b * size, size, entries, dataCapacity);
+        }
+    };
+    // unlike copy_camera_metadata(), this keeps the spare capacity
+    auto copyFrom = [&](const camera_metadata_t *src) {
+        place();
+        for (size_t b = 0; b < kBatch; b++) {
+            append_camera_metadata(batch[b], src);
+        }
+    };
+
+    measure("add", entries, kBatch * entries, place, [&] {
+        for (size_t b = 0; b < kBatch; b++) {
+            fill(batch[b], t);
+        }
+    }, none);
+
+    auto findAll = [&](camera_metadata_t *m) {
+        camera_metadata_entry_t entry;
+        for (size_t b = 0; b < kBatch; b++) {
+            for (size_t i = 0; i < entries; i++) {
+                find_camera_metadata_entry(m, t.mTags[i], &entry);
+            }
+        }
+    };
+    measure("find unsorted", entries, kBatch * entries, none, [&] { findAll(unsorted); }, none);
+    measure("find sorted", entries, kBatch * entries, none, [&] { findAll(sorted); }, none);
+
+    camera_metadata_index_t *index = allocate_camera_metadata_index();
+    build_camera_metadata_index(index, unsorted);
+    measure("find indexed", entries, kBatch * entries, none, [&] {
+        camera_metadata_ro_entry_t entry;
+        for (size_t b = 0; b < kBatch; b++) {
+            for (size_t i = 0; i < entries; i++) {
+                find_camera_metadata_ro_entry_indexed(index, unsorted, t.mTags[i], &entry);
+            }
+        }
+    }, none);
+    free_camera_metadata_index(index);
+
+    measure("iterate", entries, kBatch * entries, none, [&] {
+        camera_metadata_iterator_t iterator;
+        camera_metadata_ro_entry_t entry;
+        for (size_t b = 0; b < kBatch; b++) {
+            init_camera_metadata_iterator(&iterator, unsorted, -1);
+            while (next_camera_metadata_entry(&iterator, &entry) == 0) {
+            }
+        }
+    }, none);
+
+    // each entry grows by two values, then shrinks back
+    auto resizeAll = [&] {
+        for (size_t b = 0; b < kBatch; b++) {
+            for (size_t i = 0; i < entries; i++) {
+                update_camera_metadata_entry(batch[b], i, sValues, t.mCounts[i] + 2, NULL);
+            }
+            for (size_t i = 0; i < entries; i++) {
+                update_camera_metadata_entry(batch[b], i, sValues, t.mCounts[i], NULL);
+            }
+        }
+    };
+    measure("update resize", entries, 2 * kBatch * entries, [&] { copyFrom(unsorted); },
+            resizeAll, none);
+    measure("update deferred", entries, 2 * kBatch * entries, [&] {
+        copyFrom(unsorted);
+        for (size_t b = 0; b < kBatch; b++) {
+            set_camera_metadata_deferred_compaction(batch[b], 1);
+        }
+    }, resizeAll, none);
+
+    std::vector<camera_metadata_entry_update_t> updates(entries);
+    for (size_t i = 0; i < entries; i++) {
+        updates[i].index = i;
+        updates[i].data = sValues;
+        updates[i].data_count = t.mCounts[i] + 2;
+    }
+    measure("update batch", entries, kBatch * entries, [&] { copyFrom(unsorted); }, [&] {
+        for (size_t b = 0; b < kBatch; b++) {
+            update_camera_metadata_entries(batch[b], &updates[0], entries);
+        }
+    }, none);
+
+    measure("delete", entries, kBatch * entries, [&] { copyFrom(unsorted); }, [&] {
+        for (size_t b = 0; b < kBatch; b++) {
+            while (get_camera_metadata_entry_count(batch[b]) > 0) {
+                delete_camera_metadata_entry(batch[b],
+                        get_camera_metadata_entry_count(batch[b]) / 2);
+            }
+        }
+    }, none);
+
+    std::vector<camera_metadata_t *> clones(kBatch);
+    measure("clone", entries, kBatch, none, [&] {
+        for (size_t b = 0; b < kBatch; b++) {
+            clones[b] = clone_camera_metadata(unsorted);
+        }
+    }, [&] {
+        for (size_t b = 0; b < kBatch; b++) {
+            free_camera_metadata(clones[b]);
+        }
+    });
+
+    camera_metadata_pool_t *pool = allocate_camera_metadata_pool(kBatch);
+    measure("clone pooled", entries, kBatch, none, [&] {
+        for (size_t b = 0; b < kBatch; b++) {
+            clones[b] = clone_camera_metadata_pooled(pool, unsorted);
+        }
+    }, [&] {
+        for (size_t b = 0; b < kBatch; b++) {
+            release_camera_metadata_pooled(clones[b]);
+        }
+    });
+    free_camera_metadata_pool(pool);
+
+    measure("append", entries, kBatch, place, [&] {
+        for (size_t b = 0; b < kBatch; b++) {
+            append_camera_metadata(batch[b], unsorted);
+        }
+    }, none);
+
+    measure("sort", entries, kBatch, [&] { copyFrom(unsorted); }, [&] {
+        for (size_t b = 0; b < kBatch; b++) {
+            sort_camera_metadata(batch[b]);
+        }
+    }, none);
+
+    free_camera_metadata(sorted);
+    free_camera_metadata(unsorted);
+}
+
+int main(int argc, char **argv)
+{
+    std::vector<size_t> entryCounts;
+    for (int i = 1; i < argc; i++) {
+        int count = atoi(argv[i]);
+        if (count <= 0) {
+            fprintf(stderr, "usage: %s [entry count]...\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+        entryCounts.push_back(count);
+    }
+    if (entryCounts.empty()) {
+        // a typical request, and small and large results
+        entryCounts = {200, 500, 1000};
+    }
+
+    printf("%-22s %5s %10s %10s\n", "operation", "tags", "ns/op", "bytes/op");
+    for (size_t count : entryCounts) {
+        runAll(count);
+    }
+    return EXIT_SUCCESS;
+}
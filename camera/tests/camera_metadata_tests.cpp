@@ -20,6 +20,8 @@
 
 #include <errno.h>
 
+#include <atomic>
+#include <thread>
 #include <vector>
 #include <algorithm>
 #include "gtest/gtest.h"
@@ -1868,3 +1870,690 @@ TEST(camera_metadata, data_alignment) {
         }
     }
 }
+
+TEST(camera_metadata, find_indexed) {
+    camera_metadata_t *m = allocate_camera_metadata(100, 1000);
+    ASSERT_NE((void*)NULL, (void*)m);
+    camera_metadata_index_t *index = allocate_camera_metadata_index();
+    ASSERT_NE((void*)NULL, (void*)index);
+
+    // an index which was never built finds nothing by itself
+    camera_metadata_entry_t entry;
+    EXPECT_EQ(NOT_FOUND, find_camera_metadata_entry_indexed(index, m,
+            ANDROID_SENSOR_SENSITIVITY, &entry));
+
+    // unsorted, with a duplicate, and a tag at the end of a section
+    int32_t sensitivity = 800;
+    int64_t exposure_time = 1000000000;
+    float focus_distance = 0.5f;
+    uint8_t shading_map_mode = ANDROID_STATISTICS_LENS_SHADING_MAP_MODE_ON;
+    ASSERT_EQ(OK, add_camera_metadata_entry(m, ANDROID_SENSOR_SENSITIVITY,
+            &sensitivity, 1));
+    ASSERT_EQ(OK, add_camera_metadata_entry(m, ANDROID_SENSOR_EXPOSURE_TIME,
+            &exposure_time, 1));
+    ASSERT_EQ(OK, add_camera_metadata_entry(m, ANDROID_LENS_FOCUS_DISTANCE,
+            &focus_distance, 1));
+    ASSERT_EQ(OK, add_camera_metadata_entry(m, ANDROID_SENSOR_SENSITIVITY,
+            &sensitivity, 1));
+    ASSERT_EQ(OK, add_camera_metadata_entry(m,
+            ANDROID_STATISTICS_LENS_SHADING_MAP_MODE, &shading_map_mode, 1));
+    ASSERT_EQ(OK, build_camera_metadata_index(index, m));
+
+    // every Android tag gives the same result as a search
+    for (int i = 0; i < ANDROID_SECTION_COUNT; i++) {
+        for (uint32_t tag = camera_metadata_section_bounds[i][0];
+                tag < camera_metadata_section_bounds[i][1]; tag++) {
+            camera_metadata_entry_t expected;
+            int result = find_camera_metadata_entry(m, tag, &expected);
+            ASSERT_EQ(result, find_camera_metadata_entry_indexed(index, m, tag,
+                    &entry)) << "tag " << tag;
+            if (result == OK) {
+                EXPECT_EQ(expected.index, entry.index);
+                EXPECT_EQ(expected.data.u8, entry.data.u8);
+            }
+        }
+    }
+    EXPECT_EQ(OK, find_camera_metadata_entry_indexed(index, m,
+            ANDROID_SENSOR_SENSITIVITY, &entry));
+    EXPECT_EQ((size_t)0, entry.index);
+
+    // tags outside the index are searched for
+    EXPECT_EQ(NOT_FOUND, find_camera_metadata_entry_indexed(index, m,
+            ANDROID_SECTION_COUNT << 16, &entry));
+
+    // after a delete, the stale index is not trusted
+    ASSERT_EQ(OK, delete_camera_metadata_entry(m, 0));
+    camera_metadata_ro_entry_t ro_entry;
+    EXPECT_EQ(OK, find_camera_metadata_ro_entry_indexed(index, m,
+            ANDROID_LENS_FOCUS_DISTANCE, &ro_entry));
+    EXPECT_EQ((size_t)1, ro_entry.index);
+    EXPECT_EQ(focus_distance, *ro_entry.data.f);
+
+    // after sorting and rebuilding, the index is used again
+    ASSERT_EQ(OK, sort_camera_metadata(m));
+    ASSERT_EQ(OK, build_camera_metadata_index(index, m));
+    EXPECT_EQ(OK, find_camera_metadata_ro_entry_indexed(index, m,
+            ANDROID_LENS_FOCUS_DISTANCE, &ro_entry));
+    EXPECT_EQ((size_t)0, ro_entry.index);
+    EXPECT_EQ(NOT_FOUND, find_camera_metadata_ro_entry_indexed(index, m,
+            ANDROID_LENS_APERTURE, &ro_entry));
+
+    EXPECT_EQ(ERROR, build_camera_metadata_index(index, NULL));
+    free_camera_metadata_index(index);
+    FINISH_USING_CAMERA_METADATA(m);
+}
+
+TEST(camera_metadata, deferred_compaction) {
+    const size_t entry_capacity = 5;
+    const size_t data_capacity = 4 * entry_capacity * sizeof(int64_t);
+    camera_metadata_t *m = allocate_camera_metadata(entry_capacity,
+            data_capacity);
+    ASSERT_NE((void*)NULL, (void*)m);
+    add_test_metadata(m, entry_capacity);
+    ASSERT_EQ(OK, set_camera_metadata_deferred_compaction(m, 1));
+
+    // resizes append the new data and leave a hole behind
+    int64_t exposure_times[3] = { 1000, 2000, 3000 };
+    camera_metadata_entry_t entry;
+    size_t data_count = get_camera_metadata_data_count(m);
+    ASSERT_EQ(OK, update_camera_metadata_entry(m, 1, exposure_times, 2,
+            &entry));
+    EXPECT_EQ(data_count + 2 * sizeof(int64_t),
+            get_camera_metadata_data_count(m));
+    EXPECT_EQ(2000, entry.data.i64[1]);
+
+    // deletes leave their data in place
+    data_count = get_camera_metadata_data_count(m);
+    ASSERT_EQ(OK, delete_camera_metadata_entry(m, 0));
+    EXPECT_EQ(data_count, get_camera_metadata_data_count(m));
+    EXPECT_EQ(OK, validate_camera_metadata_structure(m, NULL));
+
+    // running out of room at the end compacts first
+    for (int i = 0; i < 10; i++) {
+        ASSERT_EQ(OK, update_camera_metadata_entry(m, 3, exposure_times,
+                (i % 3) + 1, NULL)) << "i " << i;
+        EXPECT_LE(get_camera_metadata_data_count(m), data_capacity);
+    }
+    int64_t too_many[4 * entry_capacity] = {};
+    EXPECT_EQ(ERROR, update_camera_metadata_entry(m, 0, too_many,
+            sizeof(too_many) / sizeof(too_many[0]), NULL));
+
+    // explicit compaction removes the holes and keeps the values
+    ASSERT_EQ(OK, compact_camera_metadata(m));
+    EXPECT_EQ(5 * sizeof(int64_t), get_camera_metadata_data_count(m));
+    ASSERT_EQ(OK, get_camera_metadata_entry(m, 0, &entry));
+    ASSERT_EQ((size_t)2, entry.count);
+    EXPECT_EQ(1000, entry.data.i64[0]);
+    EXPECT_EQ(2000, entry.data.i64[1]);
+    ASSERT_EQ(OK, get_camera_metadata_entry(m, 1, &entry));
+    EXPECT_EQ(300, entry.data.i64[0]);
+    ASSERT_EQ(OK, get_camera_metadata_entry(m, 3, &entry));
+    ASSERT_EQ((size_t)1, entry.count);
+    EXPECT_EQ(1000, entry.data.i64[0]);
+
+    FINISH_USING_CAMERA_METADATA(m);
+}
+
+TEST(camera_metadata, update_metadata_batch) {
+    const size_t entry_capacity = 5;
+    const size_t data_capacity = 2 * entry_capacity * sizeof(int64_t);
+    camera_metadata_t *m = allocate_camera_metadata(entry_capacity,
+            data_capacity);
+    ASSERT_NE((void*)NULL, (void*)m);
+    add_test_metadata(m, entry_capacity);
+
+    int64_t exposure_times[2] = { 1000, 2000 };
+    camera_metadata_entry_update_t updates[] = {
+        { 0, exposure_times, 2 },
+        { 2, NULL, 0 },
+        { 4, exposure_times + 1, 1 },
+    };
+    ASSERT_EQ(OK, update_camera_metadata_entries(m, updates,
+            sizeof(updates) / sizeof(updates[0])));
+    // without deferred compaction, no holes are left behind
+    EXPECT_EQ(5 * sizeof(int64_t), get_camera_metadata_data_count(m));
+    EXPECT_EQ(OK, validate_camera_metadata_structure(m, NULL));
+
+    camera_metadata_entry_t entry;
+    ASSERT_EQ(OK, get_camera_metadata_entry(m, 0, &entry));
+    ASSERT_EQ((size_t)2, entry.count);
+    EXPECT_EQ(2000, entry.data.i64[1]);
+    ASSERT_EQ(OK, get_camera_metadata_entry(m, 2, &entry));
+    EXPECT_EQ((size_t)0, entry.count);
+    ASSERT_EQ(OK, get_camera_metadata_entry(m, 4, &entry));
+    EXPECT_EQ(2000, entry.data.i64[0]);
+    ASSERT_EQ(OK, get_camera_metadata_entry(m, 3, &entry));
+    EXPECT_EQ(400, entry.data.i64[0]);
+
+    // a batch that does not fit, or names a bad index, changes nothing
+    int64_t too_many[2 * entry_capacity] = {};
+    camera_metadata_entry_update_t bad_updates[] = {
+        { 1, exposure_times, 1 },
+        { 3, too_many, sizeof(too_many) / sizeof(too_many[0]) },
+    };
+    EXPECT_EQ(ERROR, update_camera_metadata_entries(m, bad_updates, 2));
+    bad_updates[1].index = entry_capacity;
+    bad_updates[1].data_count = 1;
+    EXPECT_EQ(ERROR, update_camera_metadata_entries(m, bad_updates, 2));
+    bad_updates[1].index = 1;
+    EXPECT_EQ(ERROR, update_camera_metadata_entries(m, bad_updates, 2));
+    ASSERT_EQ(OK, get_camera_metadata_entry(m, 1, &entry));
+    EXPECT_EQ(200, entry.data.i64[0]);
+
+    // with deferred compaction, a batch with no room to append is packed once
+    ASSERT_EQ(OK, set_camera_metadata_deferred_compaction(m, 1));
+    int64_t frame_durations[3] = { 10, 20, 30 };
+    camera_metadata_entry_update_t grow_updates[] = {
+        { 1, frame_durations, 3 },
+        { 3, frame_durations, 3 },
+    };
+    ASSERT_EQ(OK, update_camera_metadata_entries(m, grow_updates, 2));
+    EXPECT_EQ(9 * sizeof(int64_t), get_camera_metadata_data_count(m));
+    EXPECT_EQ(OK, validate_camera_metadata_structure(m, NULL));
+    ASSERT_EQ(OK, get_camera_metadata_entry(m, 0, &entry));
+    EXPECT_EQ(1000, entry.data.i64[0]);
+    EXPECT_EQ(2000, entry.data.i64[1]);
+    ASSERT_EQ(OK, get_camera_metadata_entry(m, 3, &entry));
+    ASSERT_EQ((size_t)3, entry.count);
+    EXPECT_EQ(30, entry.data.i64[2]);
+    ASSERT_EQ(OK, get_camera_metadata_entry(m, 4, &entry));
+    EXPECT_EQ(2000, entry.data.i64[0]);
+
+    FINISH_USING_CAMERA_METADATA(m);
+}
+
+TEST(camera_metadata, pool) {
+    camera_metadata_pool_t *pool = allocate_camera_metadata_pool(2);
+    ASSERT_NE((void*)NULL, (void*)pool);
+
+    camera_metadata_t *m = allocate_camera_metadata_pooled(pool, 5, 80);
+    ASSERT_NE((void*)NULL, (void*)m);
+    EXPECT_EQ((uintptr_t)0,
+            (uintptr_t)m % get_camera_metadata_alignment());
+    EXPECT_EQ(calculate_camera_metadata_size(5, 80),
+            get_camera_metadata_size(m));
+    add_test_metadata(m, 5);
+
+    // a clone of the same size class reuses the released buffer
+    camera_metadata_t *clone = clone_camera_metadata_pooled(pool, m);
+    ASSERT_NE((void*)NULL, (void*)clone);
+    EXPECT_EQ(get_camera_metadata_compact_size(m),
+            get_camera_metadata_size(clone));
+    EXPECT_EQ(OK, validate_camera_metadata_structure(clone, NULL));
+    camera_metadata_t *released = m;
+    release_camera_metadata_pooled(m);
+    m = allocate_camera_metadata_pooled(pool, 4, 64);
+    EXPECT_EQ(released, m);
+    EXPECT_EQ((size_t)0, get_camera_metadata_entry_count(m));
+    EXPECT_EQ((size_t)4, get_camera_metadata_entry_capacity(m));
+
+    // requests of a larger class get new memory
+    camera_metadata_t *large = allocate_camera_metadata_pooled(pool, 100, 4000);
+    ASSERT_NE((void*)NULL, (void*)large);
+    EXPECT_NE(released, large);
+    add_test_metadata(large, 100);
+
+    // too big to pool, but still allocated and released
+    camera_metadata_t *huge = allocate_camera_metadata_pooled(pool, 1, 8 << 20);
+    ASSERT_NE((void*)NULL, (void*)huge);
+
+    release_camera_metadata_pooled(m);
+    release_camera_metadata_pooled(clone);
+    release_camera_metadata_pooled(large);
+    release_camera_metadata_pooled(huge);
+    release_camera_metadata_pooled(NULL);
+    free_camera_metadata_pool(pool);
+    free_camera_metadata_pool(NULL);
+}
+
+TEST(camera_metadata, diff_apply) {
+    camera_metadata_t *prev = allocate_camera_metadata(10, 200);
+    camera_metadata_t *next = allocate_camera_metadata(10, 200);
+    ASSERT_NE((void*)NULL, (void*)prev);
+    ASSERT_NE((void*)NULL, (void*)next);
+
+    int32_t sensitivity = 100;
+    int64_t exposure_time = 1000000;
+    int64_t frame_durations[2] = { 33333333, 16666666 };
+    float focus_distance = 0.5f;
+    uint8_t control_mode = ANDROID_CONTROL_MODE_AUTO;
+    ASSERT_EQ(OK, add_camera_metadata_entry(prev, ANDROID_SENSOR_SENSITIVITY,
+            &sensitivity, 1));
+    ASSERT_EQ(OK, add_camera_metadata_entry(prev, ANDROID_SENSOR_EXPOSURE_TIME,
+            &exposure_time, 1));
+    ASSERT_EQ(OK, add_camera_metadata_entry(prev, ANDROID_LENS_FOCUS_DISTANCE,
+            &focus_distance, 1));
+    ASSERT_EQ(OK, add_camera_metadata_entry(prev, ANDROID_CONTROL_MODE,
+            &control_mode, 1));
+
+    // identical packets, one unsorted, give an empty delta
+    camera_metadata_delta_t *delta = diff_camera_metadata(prev, prev);
+    ASSERT_NE((void*)NULL, (void*)delta);
+    EXPECT_EQ((size_t)0, get_camera_metadata_delta_tag_count(delta));
+    free_camera_metadata_delta(delta);
+
+    // next changes one tag, resizes one, removes one and adds one
+    exposure_time = 2000000;
+    ASSERT_EQ(OK, add_camera_metadata_entry(next, ANDROID_CONTROL_MODE,
+            &control_mode, 1));
+    ASSERT_EQ(OK, add_camera_metadata_entry(next, ANDROID_SENSOR_EXPOSURE_TIME,
+            &exposure_time, 1));
+    ASSERT_EQ(OK, add_camera_metadata_entry(next, ANDROID_SENSOR_SENSITIVITY,
+            &sensitivity, 1));
+    ASSERT_EQ(OK, add_camera_metadata_entry(next, ANDROID_SENSOR_FRAME_DURATION,
+            frame_durations, 2));
+    ASSERT_EQ(OK, sort_camera_metadata(next));
+
+    delta = diff_camera_metadata(prev, next);
+    ASSERT_NE((void*)NULL, (void*)delta);
+    EXPECT_EQ((size_t)3, get_camera_metadata_delta_tag_count(delta));
+    EXPECT_LT(get_camera_metadata_delta_size(delta),
+            get_camera_metadata_size(next));
+    size_t delta_size = get_camera_metadata_delta_size(delta);
+    EXPECT_EQ(OK, validate_camera_metadata_delta(delta, &delta_size));
+    delta_size--;
+    EXPECT_EQ(ERROR, validate_camera_metadata_delta(delta, &delta_size));
+
+    camera_metadata_t *result = apply_camera_metadata_delta(prev, delta);
+    ASSERT_NE((void*)NULL, (void*)result);
+    ASSERT_EQ(get_camera_metadata_entry_count(next),
+            get_camera_metadata_entry_count(result));
+    for (size_t i = 0; i < get_camera_metadata_entry_count(next); i++) {
+        camera_metadata_entry_t expected, entry;
+        ASSERT_EQ(OK, get_camera_metadata_entry(next, i, &expected));
+        ASSERT_EQ(OK, get_camera_metadata_entry(result, i, &entry));
+        EXPECT_EQ(expected.tag, entry.tag);
+        ASSERT_EQ(expected.count, entry.count);
+        EXPECT_EQ(0, memcmp(expected.data.u8, entry.data.u8, entry.count *
+                camera_metadata_type_size[entry.type]));
+    }
+    EXPECT_EQ(get_camera_metadata_compact_size(next),
+            get_camera_metadata_size(result));
+    free_camera_metadata(result);
+
+    // a delta from nothing holds everything
+    free_camera_metadata_delta(delta);
+    delta = diff_camera_metadata(NULL, next);
+    ASSERT_NE((void*)NULL, (void*)delta);
+    EXPECT_EQ((size_t)4, get_camera_metadata_delta_tag_count(delta));
+    result = apply_camera_metadata_delta(NULL, delta);
+    ASSERT_NE((void*)NULL, (void*)result);
+    EXPECT_EQ(get_camera_metadata_entry_count(next),
+            get_camera_metadata_entry_count(result));
+    free_camera_metadata(result);
+    free_camera_metadata_delta(delta);
+
+    EXPECT_EQ((void*)NULL, (void*)diff_camera_metadata(prev, NULL));
+    EXPECT_EQ((void*)NULL, (void*)apply_camera_metadata_delta(prev, NULL));
+
+    FINISH_USING_CAMERA_METADATA(prev);
+    FINISH_USING_CAMERA_METADATA(next);
+}
+
+TEST(camera_metadata, append_sorted) {
+    camera_metadata_t *m = allocate_camera_metadata(10, 100);
+    camera_metadata_t *m2 = allocate_camera_metadata(10, 100);
+    ASSERT_NE((void*)NULL, (void*)m);
+    ASSERT_NE((void*)NULL, (void*)m2);
+
+    int64_t exposure_time = 1000;
+    int32_t sensitivity = 100;
+    float focus_distance = 0.5f;
+    uint8_t control_mode = ANDROID_CONTROL_MODE_AUTO;
+    ASSERT_EQ(OK, add_camera_metadata_entry(m, ANDROID_SENSOR_EXPOSURE_TIME,
+            &exposure_time, 1));
+    ASSERT_EQ(OK, add_camera_metadata_entry(m, ANDROID_CONTROL_MODE,
+            &control_mode, 1));
+    ASSERT_EQ(OK, sort_camera_metadata(m));
+    exposure_time = 2000;
+    ASSERT_EQ(OK, add_camera_metadata_entry(m2, ANDROID_SENSOR_SENSITIVITY,
+            &sensitivity, 1));
+    ASSERT_EQ(OK, add_camera_metadata_entry(m2, ANDROID_SENSOR_EXPOSURE_TIME,
+            &exposure_time, 1));
+    ASSERT_EQ(OK, add_camera_metadata_entry(m2, ANDROID_LENS_FOCUS_DISTANCE,
+            &focus_distance, 1));
+    ASSERT_EQ(OK, sort_camera_metadata(m2));
+
+    // merging sorted packets keeps them sorted, dst first for equal tags
+    camera_metadata_t *merged = allocate_camera_metadata(10, 100);
+    ASSERT_EQ(OK, append_camera_metadata(merged, m));
+    ASSERT_EQ(OK, append_camera_metadata(merged, m2));
+    ASSERT_EQ((size_t)5, get_camera_metadata_entry_count(merged));
+    const uint32_t merged_tags[] = { ANDROID_CONTROL_MODE,
+            ANDROID_LENS_FOCUS_DISTANCE, ANDROID_SENSOR_EXPOSURE_TIME,
+            ANDROID_SENSOR_EXPOSURE_TIME, ANDROID_SENSOR_SENSITIVITY };
+    camera_metadata_entry_t entry;
+    for (size_t i = 0; i < 5; i++) {
+        ASSERT_EQ(OK, get_camera_metadata_entry(merged, i, &entry));
+        EXPECT_EQ(merged_tags[i], entry.tag) << "entry " << i;
+    }
+    ASSERT_EQ(OK, get_camera_metadata_entry(merged, 2, &entry));
+    EXPECT_EQ(1000, *entry.data.i64);
+    ASSERT_EQ(OK, get_camera_metadata_entry(merged, 3, &entry));
+    EXPECT_EQ(2000, *entry.data.i64);
+
+    // already sorted, so the binary search finds the entries
+    ASSERT_EQ(OK, find_camera_metadata_entry(merged, ANDROID_LENS_FOCUS_DISTANCE,
+            &entry));
+    EXPECT_EQ(focus_distance, *entry.data.f);
+    FINISH_USING_CAMERA_METADATA(merged);
+
+    // overriding replaces every entry of the overridden tags
+    ASSERT_EQ(OK, append_camera_metadata(m, m2));
+    ASSERT_EQ(OK, append_camera_metadata_override(m, m2));
+    EXPECT_EQ((size_t)4, get_camera_metadata_entry_count(m));
+    EXPECT_EQ(calculate_camera_metadata_entry_data_size(TYPE_INT64, 1),
+            get_camera_metadata_data_count(m));
+    ASSERT_EQ(OK, find_camera_metadata_entry(m, ANDROID_SENSOR_EXPOSURE_TIME,
+            &entry));
+    EXPECT_EQ(2000, *entry.data.i64);
+    ASSERT_EQ(OK, find_camera_metadata_entry(m, ANDROID_CONTROL_MODE, &entry));
+    EXPECT_EQ(ANDROID_CONTROL_MODE_AUTO, *entry.data.u8);
+
+    // an unsorted src, onto a full dst that only fits once entries are dropped
+    camera_metadata_t *small = allocate_camera_metadata(4, 8);
+    ASSERT_EQ(OK, add_camera_metadata_entry(small, ANDROID_SENSOR_EXPOSURE_TIME,
+            &exposure_time, 1));
+    ASSERT_EQ(OK, add_camera_metadata_entry(small, ANDROID_SENSOR_SENSITIVITY,
+            &sensitivity, 1));
+    ASSERT_EQ(OK, append_camera_metadata_override(small, m2));
+    EXPECT_EQ((size_t)3, get_camera_metadata_entry_count(small));
+    camera_metadata_t *too_big = allocate_camera_metadata(5, 16);
+    ASSERT_EQ(OK, append_camera_metadata(too_big, m2));
+    ASSERT_EQ(OK, add_camera_metadata_entry(too_big, ANDROID_SENSOR_FRAME_DURATION,
+            &exposure_time, 1));
+    EXPECT_EQ(ERROR, append_camera_metadata_override(small, too_big));
+    EXPECT_EQ((size_t)3, get_camera_metadata_entry_count(small));
+
+    FINISH_USING_CAMERA_METADATA(too_big);
+    FINISH_USING_CAMERA_METADATA(small);
+    FINISH_USING_CAMERA_METADATA(m2);
+    FINISH_USING_CAMERA_METADATA(m);
+}
+
+TEST(camera_metadata, validate_tiers) {
+    camera_metadata_t *m = allocate_camera_metadata(6, 80);
+    ASSERT_NE((void*)NULL, (void*)m);
+    add_test_metadata(m, 5);
+    int32_t sensitivity = 100;
+    ASSERT_EQ(OK, add_camera_metadata_entry(m, ANDROID_SENSOR_SENSITIVITY,
+            &sensitivity, 1));
+    size_t size = get_camera_metadata_size(m);
+
+    EXPECT_EQ(OK, validate_camera_metadata_header(m, &size));
+    EXPECT_EQ(ERROR, validate_camera_metadata_header(NULL, NULL));
+    size_t too_small = size - 1;
+    EXPECT_EQ(ERROR, validate_camera_metadata_header(m, &too_small));
+
+    camera_metadata_validation_t cache = {};
+    EXPECT_EQ(OK, validate_camera_metadata_cached(m, &size, &cache));
+    EXPECT_EQ(m, cache.metadata);
+    uint32_t checksum = cache.checksum;
+    EXPECT_EQ(OK, validate_camera_metadata_cached(m, &size, &cache));
+    EXPECT_EQ(checksum, cache.checksum);
+    EXPECT_EQ(ERROR, validate_camera_metadata_cached(m, &too_small, &cache));
+
+    // a changed entry is checked again, and caught by the full check
+    camera_metadata_t *copy = copy_camera_metadata(malloc(size), size, m);
+    ASSERT_NE((void*)NULL, (void*)copy);
+    int64_t exposure_time = 1234;
+    ASSERT_EQ(OK, update_camera_metadata_entry(copy, 2, &exposure_time, 1,
+            NULL));
+    EXPECT_EQ(OK, validate_camera_metadata_cached(copy, &size, &cache));
+    EXPECT_EQ(copy, cache.metadata);
+    EXPECT_NE(checksum, cache.checksum);
+
+    // inline data points into the entry itself, just ahead of its type
+    camera_metadata_entry_t entry;
+    ASSERT_EQ(OK, get_camera_metadata_entry(copy, 5, &entry));
+    ASSERT_EQ((size_t)1, entry.count);
+    entry.data.u8[sizeof(int32_t)] = TYPE_BYTE;
+    EXPECT_EQ(OK, validate_camera_metadata_header(copy, &size));
+    EXPECT_EQ(ERROR, validate_camera_metadata_cached(copy, &size, &cache));
+    EXPECT_EQ((void*)NULL, cache.metadata);
+
+    free(copy);
+    FINISH_USING_CAMERA_METADATA(m);
+}
+
+static int vendor_query_count = 0;
+
+static const char *counting_section_name(const vendor_tag_ops_t *, uint32_t tag) {
+    vendor_query_count++;
+    return fakevendor_ops.get_section_name(&fakevendor_ops, tag);
+}
+
+static const char *counting_tag_name(const vendor_tag_ops_t *, uint32_t tag) {
+    vendor_query_count++;
+    return fakevendor_ops.get_tag_name(&fakevendor_ops, tag);
+}
+
+static int counting_tag_type(const vendor_tag_ops_t *, uint32_t tag) {
+    vendor_query_count++;
+    return fakevendor_ops.get_tag_type(&fakevendor_ops, tag);
+}
+
+static int counting_tag_count(const vendor_tag_ops_t *) {
+    return fakevendor_ops.get_tag_count(&fakevendor_ops);
+}
+
+static void counting_all_tags(const vendor_tag_ops_t *, uint32_t *tag_array) {
+    fakevendor_ops.get_all_tags(&fakevendor_ops, tag_array);
+}
+
+TEST(camera_metadata, vendor_tags_cached) {
+    vendor_tag_ops_t counting_ops = {};
+    counting_ops.get_tag_count = counting_tag_count;
+    counting_ops.get_all_tags = counting_all_tags;
+    counting_ops.get_section_name = counting_section_name;
+    counting_ops.get_tag_name = counting_tag_name;
+    counting_ops.get_tag_type = counting_tag_type;
+    set_camera_metadata_vendor_ops(&counting_ops);
+
+    // the queries below are answered from the snapshot
+    vendor_query_count = 0;
+    for (int i = 0; i < FAKEVENDOR_SECTION_COUNT; i++) {
+        for (uint32_t tag = fakevendor_section_bounds[i][0];
+                tag <= fakevendor_section_bounds[i][1]; tag++) {
+            EXPECT_EQ(fakevendor_ops.get_tag_type(&fakevendor_ops, tag),
+                    get_camera_metadata_tag_type(tag)) << "tag " << tag;
+            EXPECT_EQ(fakevendor_ops.get_tag_name(&fakevendor_ops, tag),
+                    get_camera_metadata_tag_name(tag)) << "tag " << tag;
+            EXPECT_STREQ(fakevendor_section_names[i],
+                    get_camera_metadata_section_name(tag)) << "tag " << tag;
+        }
+    }
+    EXPECT_EQ(0, vendor_query_count);
+    EXPECT_EQ(-1, get_camera_metadata_tag_type(FAKEVENDOR_SECTION_END << 16));
+    EXPECT_NULL(get_camera_metadata_section_name(FAKEVENDOR_SECTION_END << 16));
+    EXPECT_EQ(TYPE_BYTE, get_camera_metadata_tag_type(ANDROID_CONTROL_MODE));
+
+    camera_metadata_t *m = allocate_camera_metadata(1, 0);
+    uint8_t superMode = 5;
+    EXPECT_EQ(OK, add_camera_metadata_entry(m, FAKEVENDOR_SENSOR_SUPERMODE,
+            &superMode, 1));
+    EXPECT_EQ(0, vendor_query_count);
+    FINISH_USING_CAMERA_METADATA(m);
+
+    // ops which can't list their tags are still called directly
+    counting_ops.get_tag_count = NULL;
+    set_camera_metadata_vendor_ops(&counting_ops);
+    EXPECT_EQ(TYPE_BYTE, get_camera_metadata_tag_type(FAKEVENDOR_SENSOR_SUPERMODE));
+    EXPECT_EQ(1, vendor_query_count);
+
+    set_camera_metadata_vendor_ops(NULL);
+    EXPECT_EQ(-1, get_camera_metadata_tag_type(FAKEVENDOR_SENSOR_SUPERMODE));
+}
+
+TEST(camera_metadata, vendor_tags_concurrent_update) {
+    // queries racing with a change of vendor ops see the previous or the new tags
+    std::atomic<int> passes(0);
+    std::atomic<bool> done(false);
+    std::thread reader([&passes, &done] {
+        while (!done) {
+            for (uint32_t tag = fakevendor_section_bounds[0][0];
+                    tag <= fakevendor_section_bounds[0][1]; tag++) {
+                const char *name = get_camera_metadata_tag_name(tag);
+                if (name != NULL) {
+                    EXPECT_EQ(fakevendor_ops.get_tag_name(&fakevendor_ops, tag), name);
+                }
+                int type = get_camera_metadata_tag_type(tag);
+                if (type != -1) {
+                    EXPECT_EQ(fakevendor_ops.get_tag_type(&fakevendor_ops, tag), type);
+                }
+                get_camera_metadata_section_name(tag);
+            }
+            passes++;
+        }
+    });
+    for (int i = 0; passes < 1000; i++) {
+        set_camera_metadata_vendor_ops(i % 2 == 0 ? NULL : &fakevendor_ops);
+    }
+    done = true;
+    reader.join();
+    set_camera_metadata_vendor_ops(NULL);
+}
+
+TEST(camera_metadata, iterator) {
+    camera_metadata_t *m = allocate_camera_metadata(10, 100);
+    ASSERT_NE((void*)NULL, (void*)m);
+
+    int64_t exposure_time = 1000;
+    int32_t sensitivity = 100;
+    float focus_distance = 0.5f;
+    uint8_t control_mode = ANDROID_CONTROL_MODE_AUTO;
+    ASSERT_EQ(OK, add_camera_metadata_entry(m, ANDROID_SENSOR_EXPOSURE_TIME,
+            &exposure_time, 1));
+    ASSERT_EQ(OK, add_camera_metadata_entry(m, ANDROID_LENS_FOCUS_DISTANCE,
+            &focus_distance, 1));
+    ASSERT_EQ(OK, add_camera_metadata_entry(m, ANDROID_SENSOR_SENSITIVITY,
+            &sensitivity, 1));
+    ASSERT_EQ(OK, add_camera_metadata_entry(m, ANDROID_CONTROL_MODE,
+            &control_mode, 1));
+
+    for (int sorted = 0; sorted <= 1; sorted++) {
+        // every entry, matching get_camera_metadata_ro_entry
+        camera_metadata_iterator_t iterator;
+        camera_metadata_ro_entry_t entry, expected;
+        ASSERT_EQ(OK, init_camera_metadata_iterator(&iterator, m, -1));
+        size_t count = 0;
+        while (next_camera_metadata_entry(&iterator, &entry) == OK) {
+            ASSERT_EQ(OK, get_camera_metadata_ro_entry(m, count, &expected));
+            EXPECT_EQ(expected.index, entry.index);
+            EXPECT_EQ(expected.tag, entry.tag);
+            EXPECT_EQ(expected.type, entry.type);
+            EXPECT_EQ(expected.count, entry.count);
+            EXPECT_EQ(expected.data.u8, entry.data.u8);
+            count++;
+        }
+        EXPECT_EQ(get_camera_metadata_entry_count(m), count);
+        EXPECT_EQ(NOT_FOUND, next_camera_metadata_entry(&iterator, &entry));
+
+        // one section
+        ASSERT_EQ(OK, init_camera_metadata_iterator(&iterator, m,
+                ANDROID_SENSOR));
+        ASSERT_EQ(OK, next_camera_metadata_entry(&iterator, &entry));
+        EXPECT_EQ(ANDROID_SENSOR, (int)(entry.tag >> 16));
+        uint32_t first_tag = entry.tag;
+        ASSERT_EQ(OK, next_camera_metadata_entry(&iterator, &entry));
+        EXPECT_EQ(ANDROID_SENSOR, (int)(entry.tag >> 16));
+        EXPECT_NE(first_tag, entry.tag);
+        EXPECT_EQ(NOT_FOUND, next_camera_metadata_entry(&iterator, &entry));
+
+        ASSERT_EQ(OK, init_camera_metadata_iterator(&iterator, m,
+                ANDROID_FLASH));
+        EXPECT_EQ(NOT_FOUND, next_camera_metadata_entry(&iterator, &entry));
+        ASSERT_EQ(OK, init_camera_metadata_iterator(&iterator, m,
+                ANDROID_CONTROL));
+        ASSERT_EQ(OK, next_camera_metadata_entry(&iterator, &entry));
+        EXPECT_EQ(ANDROID_CONTROL_MODE_AUTO, *entry.data.u8);
+        EXPECT_EQ(NOT_FOUND, next_camera_metadata_entry(&iterator, &entry));
+
+        ASSERT_EQ(OK, sort_camera_metadata(m));
+    }
+
+    camera_metadata_iterator_t iterator;
+    EXPECT_EQ(ERROR, init_camera_metadata_iterator(&iterator, NULL, -1));
+    FINISH_USING_CAMERA_METADATA(m);
+}
+
+TEST(camera_metadata, map_from_fd) {
+    camera_metadata_t *m = allocate_camera_metadata(10, 100);
+    ASSERT_NE((void*)NULL, (void*)m);
+    add_test_metadata(m, 5);
+    int32_t sensitivity = 100;
+    ASSERT_EQ(OK, add_camera_metadata_entry(m, ANDROID_SENSOR_SENSITIVITY,
+            &sensitivity, 1));
+    ASSERT_EQ(OK, delete_camera_metadata_entry(m, 1));
+
+    FILE *file = tmpfile();
+    ASSERT_NE((void*)NULL, (void*)file);
+    int fd = fileno(file);
+    ASSERT_EQ(OK, write_camera_metadata_to_fd(m, fd));
+
+    // the mapping is compact and sorted, and read in place
+    const camera_metadata_t *mapped = map_camera_metadata(fd);
+    ASSERT_NE((void*)NULL, (void*)mapped);
+    EXPECT_EQ(get_camera_metadata_compact_size(m),
+            get_camera_metadata_size(mapped));
+    EXPECT_EQ(get_camera_metadata_entry_count(m),
+            get_camera_metadata_entry_count(mapped));
+    camera_metadata_ro_entry_t entry;
+    ASSERT_EQ(OK, find_camera_metadata_ro_entry(mapped,
+            ANDROID_SENSOR_SENSITIVITY, &entry));
+    EXPECT_EQ(100, *entry.data.i32);
+    EXPECT_EQ(get_camera_metadata_entry_count(mapped) - 1, entry.index);
+    ASSERT_EQ(OK, find_camera_metadata_ro_entry(mapped,
+            ANDROID_SENSOR_EXPOSURE_TIME, &entry));
+    EXPECT_GE((uint8_t*)entry.data.u8, (uint8_t*)mapped);
+    EXPECT_LT((uint8_t*)entry.data.u8,
+            (uint8_t*)mapped + get_camera_metadata_size(mapped));
+    unmap_camera_metadata(mapped);
+    unmap_camera_metadata(NULL);
+
+    // a truncated or padded file is rejected
+    ASSERT_EQ(0, ftruncate(fd, get_camera_metadata_compact_size(m) - 1));
+    EXPECT_EQ((void*)NULL, (void*)map_camera_metadata(fd));
+    ASSERT_EQ(0, ftruncate(fd, get_camera_metadata_compact_size(m) + 1));
+    EXPECT_EQ((void*)NULL, (void*)map_camera_metadata(fd));
+    ASSERT_EQ(0, ftruncate(fd, 0));
+    EXPECT_EQ((void*)NULL, (void*)map_camera_metadata(fd));
+    EXPECT_EQ((void*)NULL, (void*)map_camera_metadata(-1));
+    EXPECT_EQ(ERROR, write_camera_metadata_to_fd(NULL, fd));
+
+    fclose(file);
+    FINISH_USING_CAMERA_METADATA(m);
+}
+
+TEST(camera_metadata, tag_by_name) {
+    uint32_t tag = 0;
+    EXPECT_EQ(OK, get_camera_metadata_tag_by_name("android.control.mode", &tag));
+    EXPECT_EQ(ANDROID_CONTROL_MODE, tag);
+    EXPECT_EQ(OK, get_camera_metadata_tag_by_name(
+            "android.sensor.info.activeArraySize", &tag));
+    EXPECT_EQ(ANDROID_SENSOR_INFO_ACTIVE_ARRAY_SIZE, tag);
+
+    // every Android tag round-trips through its full name
+    char name[256];
+    for (uint32_t section = 0; section < ANDROID_SECTION_COUNT; section++) {
+        for (uint32_t t = camera_metadata_section_bounds[section][0];
+                t < camera_metadata_section_bounds[section][1]; t++) {
+            const char *tag_name = get_camera_metadata_tag_name(t);
+            if (tag_name == NULL) continue;
+            snprintf(name, sizeof(name), "%s.%s",
+                    get_camera_metadata_section_name(t), tag_name);
+            tag = 0;
+            EXPECT_EQ(OK, get_camera_metadata_tag_by_name(name, &tag)) << name;
+            EXPECT_EQ(t, tag) << name;
+        }
+    }
+
+    tag = 0;
+    EXPECT_EQ(ERROR, get_camera_metadata_tag_by_name("android.control.bogus", &tag));
+    EXPECT_EQ(ERROR, get_camera_metadata_tag_by_name("android.control", &tag));
+    EXPECT_EQ(ERROR, get_camera_metadata_tag_by_name("mode", &tag));
+    EXPECT_EQ(ERROR, get_camera_metadata_tag_by_name("", &tag));
+    EXPECT_EQ(0u, tag);
+    EXPECT_EQ(ERROR, get_camera_metadata_tag_by_name(NULL, &tag));
+    EXPECT_EQ(ERROR, get_camera_metadata_tag_by_name("android.control.mode", NULL));
+}
@@ -38,6 +38,12 @@ extern "C" {
  * Set the global vendor tag operations object used to define vendor tag
  * structure when parsing camera metadata with functions defined in
  * system/media/camera/include/camera_metadata.h.
+ *
+ * If the ops can enumerate their tags, the name and type of every vendor tag
+ * are recorded in a lookup table here, so the ops must describe a fixed set of
+ * tags for as long as they are set. The names are not copied: the strings
+ * returned by the ops must remain valid after the ops are replaced, as queries
+ * running concurrently with this call may still return them.
  */
 ANDROID_API
 int set_camera_metadata_vendor_ops(const vendor_tag_ops_t *query_ops);
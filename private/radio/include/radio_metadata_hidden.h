@@ -47,6 +47,9 @@ typedef struct radio_metadata_entry {
 *   | size_int                  | total size in 32 bit units including header and index
 *   |---------------------------|
 *   | count                     | number of entries
+*   |---------------------------|
+*   | key_index[key]            | offset of the first entry for each key, 0 if none
+*   |     :                     |
 *   |---------------------------|<--+
 *   | first entry               |   |
 *   |                           |   |
@@ -73,12 +76,21 @@ typedef struct radio_metadata_entry {
 *   by radio_metadata_allocate() and reallocated if needed by radio_metadata_add_xxx()
 */
 
-/* Radio meta data buffer header */
+/* number of slots in the key index, one per key */
+#define RADIO_METADATA_KEY_COUNT (RADIO_METADATA_KEY_MAX - RADIO_METADATA_KEY_MIN + 1)
+
+/* Radio meta data buffer header.
+ * The key index changed the layout of the header, and so of buffers exchanged between a radio
+ * HAL and the framework: both must be built with the same version of this header.
+ * radio_metadata_check() rejects buffers with the previous layout, as their first entry starts
+ * within the key index. */
 typedef struct radio_metadata_buffer {
     unsigned int channel;       /* channel (frequency) this meta data is associated with */
     unsigned int sub_channel;   /* sub channel this meta data is associated with */
     unsigned int size_int;      /* Total size in 32 bit word units */
     unsigned int count;         /* number of meta data entries */
+    unsigned int key_index[RADIO_METADATA_KEY_COUNT]; /* offset in 32 bit word units of the
+                                                         first entry with each key, 0 if none */
 } radio_metadata_buffer_t;
 
 
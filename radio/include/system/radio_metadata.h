@@ -55,6 +55,9 @@ enum {
                                                 RADIO_METADATA_TEXT_LEN_MAX length including NUL. */
     RADIO_METADATA_TYPE_RAW        = 2,      /* raw binary data (icon or art) */
     RADIO_METADATA_TYPE_CLOCK      = 3,      /* clock data, see radio_metadata_clock_t */
+    RADIO_METADATA_TYPE_RAW_REF    = 4,      /* reference to raw binary data held outside of the
+                                                meta data buffer, for raw keys only.
+                                                see radio_metadata_raw_ref_t */
 };
 typedef int radio_metadata_type_t;
 
@@ -63,6 +66,21 @@ typedef struct radio_metadata_clock {
     int32_t timezone_offset_in_minutes;       /* Minutes offset from the GMT. */
 } radio_metadata_clock_t;
 
+/* Raw data (icon, album art or slideshow image) held in shared memory or a file rather than
+ * copied into the meta data buffer. The file descriptor is owned by the producer of the meta
+ * data and must remain valid until all meta data buffers referencing it are de-allocated.
+ * Only the reference is copied when meta data buffers are merged.
+ * Entry values are only 4 byte aligned in the buffer, so the 64 bit offset and size are held as
+ * 32 bit halves. */
+typedef struct radio_metadata_raw_ref {
+    int32_t fd;                 /* file descriptor of the shared memory region or file */
+    uint32_t reserved;          /* must be 0 */
+    uint32_t offset_hi;         /* offset of the data in bytes from the start of the region */
+    uint32_t offset_lo;
+    uint32_t size_hi;           /* size of the data in bytes */
+    uint32_t size_lo;
+} radio_metadata_raw_ref_t;
+
 /*
  * Return the type of the meta data corresponding to the key specified
  *
@@ -93,6 +111,28 @@ int radio_metadata_allocate(radio_metadata_t **metadata,
                             const unsigned int channel,
                             const unsigned int sub_channel);
 
+/*
+ * Allocate a meta data buffer large enough for the expected meta data, so that adding entries
+ * does not re-allocate it. A HAL refreshing the meta data of a station can pass the size of the
+ * previous buffer as returned by radio_metadata_get_size().
+ *
+ * arguments:
+ * - metadata: the address where the allocate meta data buffer should be returned.
+ * - channel: channel (frequency) this meta data is associated with.
+ * - sub_channel: sub channel this meta data is associated with.
+ * - size: the expected size of the buffer in bytes. 0 allocates the default size.
+ *
+ * returns:
+ *  0 if successfully allocated
+ *  -EINVAL if the size exceeds the maximum meta data buffer size
+ *  -ENOMEM if meta data buffer cannot be allocated
+ */
+ANDROID_API
+int radio_metadata_allocate_with_size(radio_metadata_t **metadata,
+                                      const unsigned int channel,
+                                      const unsigned int sub_channel,
+                                      const size_t size);
+
 /*
  * De-allocate a meta data buffer.
  *
@@ -161,6 +201,27 @@ int radio_metadata_add_raw(radio_metadata_t **metadata,
                            const unsigned char *value,
                            const unsigned int size);
 
+/*
+ * Add a reference to raw meta data held outside of the buffer. The entry has type
+ * RADIO_METADATA_TYPE_RAW_REF and its value is the radio_metadata_raw_ref_t.
+ *
+ * arguments:
+ * - metadata: the address of the meta data buffer. I/O. the meta data can be modified if the
+ * buffer is re-allocated
+ * - key: the meta data key.
+ * - ref: the location of the raw data.
+ *
+ * returns:
+ *  0 if successfully added
+ *  -EINVAL if the buffer passed is invalid, the key does not match a raw type or the reference
+ *  is invalid
+ *  -ENOMEM if meta data buffer cannot be re-allocated
+ */
+ANDROID_API
+int radio_metadata_add_raw_ref(radio_metadata_t **metadata,
+                               const radio_metadata_key_t key,
+                               const radio_metadata_raw_ref_t *ref);
+
 /*
  * Add a clock meta data to the buffer.
  *
@@ -180,6 +241,49 @@ int radio_metadata_add_clock(radio_metadata_t **metadata,
                              const radio_metadata_key_t key,
                              const radio_metadata_clock_t *clock);
 
+/*
+ * Update meta data in the buffer: all entries with the key are replaced by a single entry with
+ * the new value, or the entry is added if the key is not present.
+ * If the key has a single entry and the new value is not larger than the space it occupies,
+ * the entry is rewritten in place and the buffer is not re-allocated.
+ *
+ * arguments:
+ * - metadata: the address of the meta data buffer. I/O. the meta data can be modified if the
+ * buffer is re-allocated.
+ * - key: the meta data key.
+ * - value, size, clock, ref: as for the corresponding radio_metadata_add_xxx() function.
+ *
+ * returns:
+ *  0 if successfully updated
+ *  -EINVAL as for the corresponding radio_metadata_add_xxx() function
+ *  -ENOMEM if meta data buffer cannot be re-allocated
+ */
+ANDROID_API
+int radio_metadata_update_int(radio_metadata_t **metadata,
+                              const radio_metadata_key_t key,
+                              const int value);
+
+ANDROID_API
+int radio_metadata_update_text(radio_metadata_t **metadata,
+                               const radio_metadata_key_t key,
+                               const char *value);
+
+ANDROID_API
+int radio_metadata_update_raw(radio_metadata_t **metadata,
+                              const radio_metadata_key_t key,
+                              const unsigned char *value,
+                              const unsigned int size);
+
+ANDROID_API
+int radio_metadata_update_raw_ref(radio_metadata_t **metadata,
+                                  const radio_metadata_key_t key,
+                                  const radio_metadata_raw_ref_t *ref);
+
+ANDROID_API
+int radio_metadata_update_clock(radio_metadata_t **metadata,
+                                const radio_metadata_key_t key,
+                                const radio_metadata_clock_t *clock);
+
 /*
  * add all meta data in source buffer to destinaiton buffer.
  *
@@ -196,6 +300,24 @@ ANDROID_API
 int radio_metadata_add_metadata(radio_metadata_t **dst_metadata,
                            radio_metadata_t *src_metadata);
 
+/*
+ * add all meta data in source buffer to destination buffer, replacing all meta data in the
+ * destination buffer with a key present in the source buffer.
+ *
+ * arguments:
+ * - dst_metadata: the address of the destination meta data buffer. if *dst_metadata is NULL,
+ * a new buffer is created.
+ * - src_metadata: the source meta data buffer.
+ *
+ * returns:
+ *  0 if successfully added
+ *  -EINVAL if the buffers passed are invalid
+ *  -ENOMEM if meta data buffer cannot be re-allocated
+ */
+ANDROID_API
+int radio_metadata_add_metadata_override(radio_metadata_t **dst_metadata,
+                                         const radio_metadata_t *src_metadata);
+
 /*
  * Perform sanity check on a meta data buffer.
  *
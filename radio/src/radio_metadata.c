@@ -54,6 +54,19 @@ bool is_valid_metadata_key(const radio_metadata_key_t key)
     return true;
 }
 
+bool is_valid_raw_ref(const radio_metadata_raw_ref_t *ref)
+{
+    if (ref == NULL || ref->fd < 0 || ref->reserved != 0) {
+        return false;
+    }
+    uint64_t offset = ((uint64_t)ref->offset_hi << 32) | ref->offset_lo;
+    uint64_t size = ((uint64_t)ref->size_hi << 32) | ref->size_lo;
+    if (offset + size < offset) {
+        return false;
+    }
+    return true;
+}
+
 int check_size(radio_metadata_buffer_t **metadata_ptr, const unsigned int size_int)
 {
     radio_metadata_buffer_t *metadata = *metadata_ptr;
@@ -124,6 +137,10 @@ int add_metadata(radio_metadata_buffer_t **metadata_ptr,
     entry->size = size;
     memcpy(entry->data, value, size);
 
+    if (metadata->key_index[key - RADIO_METADATA_KEY_MIN] == 0) {
+        metadata->key_index[key - RADIO_METADATA_KEY_MIN] = data_offset;
+    }
+
     data_offset += entry_size_int;
     *((unsigned int *)metadata + index_offset -1) = data_offset;
     metadata->count++;
@@ -160,6 +177,98 @@ radio_metadata_entry_t *get_entry_at_index(
     return (radio_metadata_entry_t *)((unsigned int *)metadata + data_offset);
 }
 
+/* returns the bit for a key in a key mask */
+unsigned int key_bit(const radio_metadata_key_t key)
+{
+    return 1u << (key - RADIO_METADATA_KEY_MIN);
+}
+
+/* removes all entries with a key in key_mask, moving down the entries that follow and
+ * rebuilding the index table and key index in the same pass */
+void remove_metadata(radio_metadata_buffer_t *metadata, const unsigned int key_mask)
+{
+    unsigned int *index_table = (unsigned int *)metadata + metadata->size_int - 1;
+    unsigned int write_offset = *index_table;
+    unsigned int write_index = 0;
+    unsigned int read_index;
+
+    memset(metadata->key_index, 0, sizeof(metadata->key_index));
+    for (read_index = 0; read_index < metadata->count; read_index++) {
+        unsigned int data_offset = *(index_table - read_index);
+        unsigned int next_offset = *(index_table - read_index - 1);
+        radio_metadata_entry_t *entry =
+                (radio_metadata_entry_t *)((unsigned int *)metadata + data_offset);
+
+        if (key_mask & key_bit(entry->key)) {
+            continue;
+        }
+        if (metadata->key_index[entry->key - RADIO_METADATA_KEY_MIN] == 0) {
+            metadata->key_index[entry->key - RADIO_METADATA_KEY_MIN] = write_offset;
+        }
+        /* slots at or below write_index have been read already */
+        if (write_offset != data_offset) {
+            memmove((unsigned int *)metadata + write_offset, entry,
+                    (next_offset - data_offset) * sizeof(unsigned int));
+        }
+        *(index_table - write_index) = write_offset;
+        write_offset += next_offset - data_offset;
+        write_index++;
+    }
+    *(index_table - write_index) = write_offset;
+    metadata->count = write_index;
+}
+
+/* replaces all entries with the given key by a single entry holding the new value.
+ * If the key has one entry and the new value fits in the space it occupies, the entry is
+ * rewritten in place without moving the buffer or the other entries.
+ * checks on size and key validity are done before calling this function */
+int update_metadata(radio_metadata_buffer_t **metadata_ptr,
+                    const radio_metadata_key_t key,
+                    const radio_metadata_type_t type,
+                    const void *value,
+                    const unsigned int size)
+{
+    radio_metadata_buffer_t *metadata = *metadata_ptr;
+    unsigned int *index_table = (unsigned int *)metadata + metadata->size_int - 1;
+    unsigned int first_offset = metadata->key_index[key - RADIO_METADATA_KEY_MIN];
+    unsigned int entry_size_int;
+    unsigned int slot_size_int = 0;
+    unsigned int matches = 0;
+    unsigned int index;
+
+    if (first_offset == 0) {
+        return add_metadata(metadata_ptr, key, type, value, size);
+    }
+
+    for (index = 0; index < metadata->count; index++) {
+        unsigned int data_offset = *(index_table - index);
+        radio_metadata_entry_t *entry =
+                (radio_metadata_entry_t *)((unsigned int *)metadata + data_offset);
+        if (entry->key == key) {
+            if (data_offset == first_offset) {
+                slot_size_int = *(index_table - index - 1) - data_offset;
+            }
+            matches++;
+        }
+    }
+
+    entry_size_int = size + sizeof(radio_metadata_entry_t);
+    entry_size_int = (entry_size_int + sizeof(unsigned int) - 1) / sizeof(unsigned int);
+
+    if (matches == 1 && entry_size_int <= slot_size_int) {
+        radio_metadata_entry_t *entry =
+                (radio_metadata_entry_t *)((unsigned int *)metadata + first_offset);
+        /* raw entries can become references to raw data and back */
+        entry->type = type;
+        entry->size = size;
+        memcpy(entry->data, value, size);
+        return 0;
+    }
+
+    remove_metadata(metadata, key_bit(key));
+    return add_metadata(metadata_ptr, key, type, value, size);
+}
+
 /**
  * metadata API functions
  */
@@ -176,16 +285,34 @@ int radio_metadata_allocate(radio_metadata_t **metadata,
                             const unsigned int channel,
                             const unsigned int sub_channel)
 {
-    radio_metadata_buffer_t *metadata_buf =
-            (radio_metadata_buffer_t *)calloc(RADIO_METADATA_DEFAULT_SIZE, sizeof(unsigned int));
+    return radio_metadata_allocate_with_size(metadata, channel, sub_channel, 0);
+}
+
+int radio_metadata_allocate_with_size(radio_metadata_t **metadata,
+                                      const unsigned int channel,
+                                      const unsigned int sub_channel,
+                                      const size_t size)
+{
+    radio_metadata_buffer_t *metadata_buf;
+    unsigned int size_int = RADIO_METADATA_DEFAULT_SIZE;
+
+    if (size > RADIO_METADATA_MAX_SIZE * sizeof(unsigned int)) {
+        return -EINVAL;
+    }
+    /* keep the buffer size a power of 2 multiple of the default, as check_size() grows it */
+    while (size_int * sizeof(unsigned int) < size) {
+        size_int *= 2;
+    }
+
+    metadata_buf = (radio_metadata_buffer_t *)calloc(size_int, sizeof(unsigned int));
     if (metadata_buf == NULL) {
         return -ENOMEM;
     }
 
     metadata_buf->channel = channel;
     metadata_buf->sub_channel = sub_channel;
-    metadata_buf->size_int = RADIO_METADATA_DEFAULT_SIZE;
-    *((unsigned int *)metadata_buf + RADIO_METADATA_DEFAULT_SIZE - 1) =
+    metadata_buf->size_int = size_int;
+    *((unsigned int *)metadata_buf + size_int - 1) =
             (sizeof(radio_metadata_buffer_t) + sizeof(unsigned int) - 1) /
                 sizeof(unsigned int);
     *metadata = (radio_metadata_t *)metadata_buf;
@@ -233,6 +360,18 @@ int radio_metadata_add_raw(radio_metadata_t **metadata,
     return add_metadata((radio_metadata_buffer_t **)metadata, key, type, value, size);
 }
 
+int radio_metadata_add_raw_ref(radio_metadata_t **metadata,
+                               const radio_metadata_key_t key,
+                               const radio_metadata_raw_ref_t *ref)
+{
+    if (metadata == NULL || *metadata == NULL ||
+            radio_metadata_type_of_key(key) != RADIO_METADATA_TYPE_RAW || !is_valid_raw_ref(ref)) {
+        return -EINVAL;
+    }
+    return add_metadata((radio_metadata_buffer_t **)metadata, key, RADIO_METADATA_TYPE_RAW_REF,
+                        ref, sizeof(radio_metadata_raw_ref_t));
+}
+
 int radio_metadata_add_clock(radio_metadata_t **metadata,
                              const radio_metadata_key_t key,
                              const radio_metadata_clock_t *clock) {
@@ -246,20 +385,94 @@ int radio_metadata_add_clock(radio_metadata_t **metadata,
         (radio_metadata_buffer_t **)metadata, key, type, clock, sizeof(radio_metadata_clock_t));
 }
 
-int radio_metadata_add_metadata(radio_metadata_t **dst_metadata,
-                           radio_metadata_t *src_metadata)
+int radio_metadata_update_int(radio_metadata_t **metadata,
+                              const radio_metadata_key_t key,
+                              const int value)
+{
+    radio_metadata_type_t type = radio_metadata_type_of_key(key);
+    if (metadata == NULL || *metadata == NULL || type != RADIO_METADATA_TYPE_INT) {
+        return -EINVAL;
+    }
+    return update_metadata((radio_metadata_buffer_t **)metadata,
+                           key, type, &value, sizeof(int));
+}
+
+int radio_metadata_update_text(radio_metadata_t **metadata,
+                               const radio_metadata_key_t key,
+                               const char *value)
 {
-    radio_metadata_buffer_t *src_metadata_buf = (radio_metadata_buffer_t *)src_metadata;
+    radio_metadata_type_t type = radio_metadata_type_of_key(key);
+    if (metadata == NULL || *metadata == NULL || type != RADIO_METADATA_TYPE_TEXT ||
+            value == NULL || strlen(value) >= RADIO_METADATA_TEXT_LEN_MAX) {
+        return -EINVAL;
+    }
+    return update_metadata((radio_metadata_buffer_t **)metadata,
+                           key, type, value, strlen(value) + 1);
+}
+
+int radio_metadata_update_raw(radio_metadata_t **metadata,
+                              const radio_metadata_key_t key,
+                              const unsigned char *value,
+                              const unsigned int size)
+{
+    radio_metadata_type_t type = radio_metadata_type_of_key(key);
+    if (metadata == NULL || *metadata == NULL || type != RADIO_METADATA_TYPE_RAW || value == NULL) {
+        return -EINVAL;
+    }
+    return update_metadata((radio_metadata_buffer_t **)metadata, key, type, value, size);
+}
+
+int radio_metadata_update_raw_ref(radio_metadata_t **metadata,
+                                  const radio_metadata_key_t key,
+                                  const radio_metadata_raw_ref_t *ref)
+{
+    if (metadata == NULL || *metadata == NULL ||
+            radio_metadata_type_of_key(key) != RADIO_METADATA_TYPE_RAW || !is_valid_raw_ref(ref)) {
+        return -EINVAL;
+    }
+    return update_metadata((radio_metadata_buffer_t **)metadata, key, RADIO_METADATA_TYPE_RAW_REF,
+                           ref, sizeof(radio_metadata_raw_ref_t));
+}
+
+int radio_metadata_update_clock(radio_metadata_t **metadata,
+                                const radio_metadata_key_t key,
+                                const radio_metadata_clock_t *clock) {
+    radio_metadata_type_t type = radio_metadata_type_of_key(key);
+    if (metadata == NULL || *metadata == NULL || type != RADIO_METADATA_TYPE_CLOCK ||
+        clock == NULL || clock->timezone_offset_in_minutes < (-12 * 60) ||
+        clock->timezone_offset_in_minutes > (14 * 60)) {
+        return -EINVAL;
+    }
+    return update_metadata(
+        (radio_metadata_buffer_t **)metadata, key, type, clock, sizeof(radio_metadata_clock_t));
+}
+
+/* appends all entries of src_metadata to dst_metadata, after removing from dst_metadata the
+ * keys present in src_metadata if override is true.
+ * The entries and their index are contiguous in both buffers, so they are copied as two blocks
+ * after growing the destination at most once. */
+int merge_metadata(radio_metadata_t **dst_metadata,
+                   const radio_metadata_t *src_metadata,
+                   const bool override)
+{
+    const radio_metadata_buffer_t *src_metadata_buf = (const radio_metadata_buffer_t *)src_metadata;
     radio_metadata_buffer_t *dst_metadata_buf;
-    int status;
+    const unsigned int *src_index_table;
+    unsigned int *dst_index_table;
+    unsigned int src_first_offset;
+    unsigned int src_data_size_int;
+    unsigned int dst_data_offset;
+    unsigned int key_mask = 0;
     unsigned int index;
+    int status;
 
-    if (dst_metadata == NULL || src_metadata == NULL) {
+    if (dst_metadata == NULL || src_metadata == NULL || *dst_metadata == src_metadata) {
         return -EINVAL;
     }
     if (*dst_metadata == NULL) {
-        status = radio_metadata_allocate(dst_metadata, src_metadata_buf->channel,
-                                src_metadata_buf->sub_channel);
+        status = radio_metadata_allocate_with_size(dst_metadata, src_metadata_buf->channel,
+                                src_metadata_buf->sub_channel,
+                                radio_metadata_get_size(src_metadata));
         if (status != 0) {
             return status;
         }
@@ -269,19 +482,64 @@ int radio_metadata_add_metadata(radio_metadata_t **dst_metadata,
     dst_metadata_buf->channel = src_metadata_buf->channel;
     dst_metadata_buf->sub_channel = src_metadata_buf->sub_channel;
 
-    for (index = 0; index < src_metadata_buf->count; index++) {
-        radio_metadata_key_t key;
-        radio_metadata_type_t type;
-        void *value;
-        unsigned int size;
-        status = radio_metadata_get_at_index(src_metadata, index, &key, &type, &value, &size);
-        if (status != 0)
-            continue;
-        status = add_metadata((radio_metadata_buffer_t **)dst_metadata, key, type, value, size);
-        if (status != 0)
-            break;
+    if (src_metadata_buf->count == 0) {
+        return 0;
     }
-    return status;
+
+    if (override) {
+        for (index = 0; index < RADIO_METADATA_KEY_COUNT; index++) {
+            if (src_metadata_buf->key_index[index] != 0) {
+                key_mask |= 1u << index;
+            }
+        }
+        remove_metadata(dst_metadata_buf, key_mask);
+    }
+
+    src_index_table = (const unsigned int *)src_metadata_buf + src_metadata_buf->size_int - 1;
+    src_first_offset = *src_index_table;
+    src_data_size_int = *(src_index_table - src_metadata_buf->count) - src_first_offset;
+
+    /* check_size() accounts for one more index entry */
+    status = check_size((radio_metadata_buffer_t **)dst_metadata,
+                        src_data_size_int + src_metadata_buf->count - 1);
+    if (status != 0) {
+        return status;
+    }
+    dst_metadata_buf = (radio_metadata_buffer_t *)*dst_metadata;
+    dst_index_table = (unsigned int *)dst_metadata_buf + dst_metadata_buf->size_int - 1 -
+            dst_metadata_buf->count;
+    dst_data_offset = *dst_index_table;
+
+    memcpy((unsigned int *)dst_metadata_buf + dst_data_offset,
+           (const unsigned int *)src_metadata_buf + src_first_offset,
+           src_data_size_int * sizeof(unsigned int));
+
+    /* index entries, including the free slot following the last one */
+    for (index = 1; index <= src_metadata_buf->count; index++) {
+        *(dst_index_table - index) =
+                *(src_index_table - index) - src_first_offset + dst_data_offset;
+    }
+
+    for (index = 0; index < RADIO_METADATA_KEY_COUNT; index++) {
+        if (dst_metadata_buf->key_index[index] == 0 && src_metadata_buf->key_index[index] != 0) {
+            dst_metadata_buf->key_index[index] =
+                    src_metadata_buf->key_index[index] - src_first_offset + dst_data_offset;
+        }
+    }
+    dst_metadata_buf->count += src_metadata_buf->count;
+    return 0;
+}
+
+int radio_metadata_add_metadata(radio_metadata_t **dst_metadata,
+                           radio_metadata_t *src_metadata)
+{
+    return merge_metadata(dst_metadata, src_metadata, false);
+}
+
+int radio_metadata_add_metadata_override(radio_metadata_t **dst_metadata,
+                                         const radio_metadata_t *src_metadata)
+{
+    return merge_metadata(dst_metadata, src_metadata, true);
 }
 
 int radio_metadata_check(const radio_metadata_t *metadata)
@@ -290,6 +548,7 @@ int radio_metadata_check(const radio_metadata_t *metadata)
             (radio_metadata_buffer_t *)metadata;
     unsigned int count;
     unsigned int min_entry_size_int;
+    unsigned int key_index[RADIO_METADATA_KEY_COUNT];
 
     if (metadata_buf == NULL) {
         return -EINVAL;
@@ -309,7 +568,15 @@ int radio_metadata_check(const radio_metadata_t *metadata)
         return -EINVAL;
     }
 
+    /* entries start right after the header. This rejects buffers with the header layout
+     * preceding the key index, whose entries start within the key index */
+    if (*((unsigned int *)metadata_buf + metadata_buf->size_int - 1) !=
+            (sizeof(radio_metadata_buffer_t) + sizeof(unsigned int) - 1) / sizeof(unsigned int)) {
+        return -EINVAL;
+    }
+
     /* sanity check on each entry */
+    memset(key_index, 0, sizeof(key_index));
     for (count = 0; count < metadata_buf->count; count++) {
         radio_metadata_entry_t *entry = get_entry_at_index(metadata_buf, count, true);
         radio_metadata_entry_t *next_entry;
@@ -319,7 +586,17 @@ int radio_metadata_check(const radio_metadata_t *metadata)
         if (!is_valid_metadata_key(entry->key)) {
             return -EINVAL;
         }
-        if (entry->type != radio_metadata_type_of_key(entry->key)) {
+        if (entry->type == RADIO_METADATA_TYPE_RAW_REF) {
+            radio_metadata_raw_ref_t ref;
+            if (radio_metadata_type_of_key(entry->key) != RADIO_METADATA_TYPE_RAW ||
+                    entry->size != sizeof(radio_metadata_raw_ref_t)) {
+                return -EINVAL;
+            }
+            memcpy(&ref, entry->data, sizeof(ref));
+            if (!is_valid_raw_ref(&ref)) {
+                return -EINVAL;
+            }
+        } else if (entry->type != radio_metadata_type_of_key(entry->key)) {
             return -EINVAL;
         }
 
@@ -328,6 +605,16 @@ int radio_metadata_check(const radio_metadata_t *metadata)
         if ((char *)entry->data + entry->size > (char *)next_entry) {
             return -EINVAL;
         }
+
+        if (key_index[entry->key - RADIO_METADATA_KEY_MIN] == 0) {
+            key_index[entry->key - RADIO_METADATA_KEY_MIN] =
+                    (unsigned int *)entry - (unsigned int *)metadata_buf;
+        }
+    }
+
+    /* the key index must point at the first entry for each key */
+    if (memcmp(key_index, metadata_buf->key_index, sizeof(key_index)) != 0) {
+        return -EINVAL;
     }
 
     return 0;
@@ -389,8 +676,8 @@ int radio_metadata_get_from_key(const radio_metadata_t *metadata,
                                 void **value,
                                 unsigned int *size)
 {
-    unsigned int count;
-    radio_metadata_entry_t *entry = NULL;
+    unsigned int data_offset;
+    radio_metadata_entry_t *entry;
     radio_metadata_buffer_t *metadata_buf =
             (radio_metadata_buffer_t *)metadata;
 
@@ -401,15 +688,11 @@ int radio_metadata_get_from_key(const radio_metadata_t *metadata,
         return -EINVAL;
     }
 
-    for (count = 0; count < metadata_buf->count; entry = NULL, count++) {
-        entry = get_entry_at_index(metadata_buf, count, false);
-        if (entry->key == key) {
-            break;
-        }
-    }
-    if (entry == NULL) {
+    data_offset = metadata_buf->key_index[key - RADIO_METADATA_KEY_MIN];
+    if (data_offset == 0) {
         return -ENOENT;
     }
+    entry = (radio_metadata_entry_t *)((unsigned int *)metadata_buf + data_offset);
     *type = entry->type;
     *value = (void *)entry->data;
     *size = entry->size;
@@ -0,0 +1,21 @@
+# Build the unit tests.
+LOCAL_PATH:= $(call my-dir)
+include $(CLEAR_VARS)
+LOCAL_ADDITIONAL_DEPENDENCIES := $(LOCAL_PATH)/Android.mk
+
+LOCAL_SHARED_LIBRARIES := \
+	libradio_metadata
+
+LOCAL_C_INCLUDES := \
+	system/media/radio/include \
+	system/media/private/radio/include
+
+LOCAL_SRC_FILES := \
+	radio_metadata_tests.cpp
+
+LOCAL_CFLAGS += -Wall -Wextra -Werror
+
+LOCAL_MODULE := radio_metadata_tests
+LOCAL_MODULE_TAGS := tests
+
+include $(BUILD_NATIVE_TEST)
@@ -0,0 +1,373 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include <string>
+#include "gtest/gtest.h"
+#include "system/radio_metadata.h"
+#include "radio_metadata_hidden.h"
+
+#define HEADER_SIZE_INT \
+    ((sizeof(radio_metadata_buffer_t) + sizeof(unsigned int) - 1) / sizeof(unsigned int))
+
+// offset in 32 bit words of the entry holding a value returned by radio_metadata_get_xxx()
+static unsigned int entry_offset(const radio_metadata_t *metadata, const void *value)
+{
+    return ((const unsigned char *)value - offsetof(radio_metadata_entry_t, data) -
+            (const unsigned char *)metadata) / sizeof(unsigned int);
+}
+
+// the key index must point at the first entry with each key
+static void expect_key_index(const radio_metadata_t *metadata)
+{
+    const radio_metadata_buffer_t *buffer = (const radio_metadata_buffer_t *)metadata;
+    for (radio_metadata_key_t key = RADIO_METADATA_KEY_MIN; key <= RADIO_METADATA_KEY_MAX;
+            key++) {
+        unsigned int expected = 0;
+        for (int index = 0; index < radio_metadata_get_count(metadata); index++) {
+            radio_metadata_key_t entry_key;
+            radio_metadata_type_t type;
+            void *value;
+            unsigned int size;
+            ASSERT_EQ(0, radio_metadata_get_at_index(metadata, index, &entry_key, &type, &value,
+                    &size));
+            if (entry_key == key) {
+                expected = entry_offset(metadata, value);
+                break;
+            }
+        }
+        EXPECT_EQ(expected, buffer->key_index[key - RADIO_METADATA_KEY_MIN]) << "key " << key;
+    }
+    EXPECT_EQ(0, radio_metadata_check(metadata));
+}
+
+TEST(radio_metadata, key_index) {
+    radio_metadata_t *metadata = NULL;
+    ASSERT_EQ(0, radio_metadata_allocate(&metadata, 88500, 0));
+    expect_key_index(metadata);
+
+    ASSERT_EQ(0, radio_metadata_add_text(&metadata, RADIO_METADATA_KEY_TITLE, "first"));
+    ASSERT_EQ(0, radio_metadata_add_int(&metadata, RADIO_METADATA_KEY_RDS_PTY, 5));
+    ASSERT_EQ(0, radio_metadata_add_text(&metadata, RADIO_METADATA_KEY_TITLE, "second"));
+    // enough entries to grow the buffer
+    for (int i = 0; i < 20; i++) {
+        ASSERT_EQ(0, radio_metadata_add_text(&metadata, RADIO_METADATA_KEY_RDS_RT,
+                "some radio text"));
+    }
+    EXPECT_LT((size_t)(RADIO_METADATA_DEFAULT_SIZE * sizeof(unsigned int)),
+            radio_metadata_get_size(metadata));
+    expect_key_index(metadata);
+
+    // the first entry of a key is returned
+    radio_metadata_type_t type;
+    void *value;
+    unsigned int size;
+    ASSERT_EQ(0, radio_metadata_get_from_key(metadata, RADIO_METADATA_KEY_TITLE, &type, &value,
+            &size));
+    EXPECT_EQ(RADIO_METADATA_TYPE_TEXT, type);
+    EXPECT_STREQ("first", (const char *)value);
+    ASSERT_EQ(0, radio_metadata_get_from_key(metadata, RADIO_METADATA_KEY_RDS_PTY, &type, &value,
+            &size));
+    EXPECT_EQ(5, *(int *)value);
+    EXPECT_EQ(-ENOENT, radio_metadata_get_from_key(metadata, RADIO_METADATA_KEY_ARTIST, &type,
+            &value, &size));
+
+    // a key index which does not match the entries is rejected
+    radio_metadata_buffer_t *buffer = (radio_metadata_buffer_t *)metadata;
+    unsigned int *slot = &buffer->key_index[RADIO_METADATA_KEY_TITLE - RADIO_METADATA_KEY_MIN];
+    const unsigned int saved = *slot;
+    *slot = buffer->key_index[RADIO_METADATA_KEY_RDS_PTY - RADIO_METADATA_KEY_MIN];
+    EXPECT_EQ(-EINVAL, radio_metadata_check(metadata));
+    *slot = 0;
+    EXPECT_EQ(-EINVAL, radio_metadata_check(metadata));
+    *slot = saved;
+    EXPECT_EQ(0, radio_metadata_check(metadata));
+
+    radio_metadata_deallocate(metadata);
+}
+
+TEST(radio_metadata, previous_layout) {
+    // buffers laid out without the key index: a header of 4 words followed by the entries
+    const unsigned int size_int = RADIO_METADATA_DEFAULT_SIZE;
+    unsigned int old_buffer[size_int];
+    memset(old_buffer, 0, sizeof(old_buffer));
+    old_buffer[0] = 88500;                      // channel
+    old_buffer[2] = size_int;
+    old_buffer[size_int - 1] = 4;               // free space
+    EXPECT_EQ(-EINVAL, radio_metadata_check((radio_metadata_t *)old_buffer));
+
+    radio_metadata_entry_t *entry = (radio_metadata_entry_t *)&old_buffer[4];
+    entry->key = RADIO_METADATA_KEY_RDS_PTY;
+    entry->type = RADIO_METADATA_TYPE_INT;
+    entry->size = sizeof(int);
+    old_buffer[3] = 1;                          // count
+    old_buffer[size_int - 2] = 4 + 4;           // free space after the entry
+    EXPECT_EQ(-EINVAL, radio_metadata_check((radio_metadata_t *)old_buffer));
+
+    radio_metadata_t *metadata = NULL;
+    ASSERT_EQ(0, radio_metadata_allocate(&metadata, 88500, 0));
+    EXPECT_EQ(0, radio_metadata_check(metadata));
+    EXPECT_EQ(HEADER_SIZE_INT, *((unsigned int *)metadata + size_int - 1));
+    radio_metadata_deallocate(metadata);
+}
+
+TEST(radio_metadata, update) {
+    radio_metadata_t *metadata = NULL;
+    ASSERT_EQ(0, radio_metadata_allocate_with_size(&metadata, 88500, 0, 4096));
+    EXPECT_EQ((size_t)4096, radio_metadata_get_size(metadata));
+
+    // a missing key is added
+    ASSERT_EQ(0, radio_metadata_update_text(&metadata, RADIO_METADATA_KEY_TITLE, "a long title"));
+    ASSERT_EQ(0, radio_metadata_add_text(&metadata, RADIO_METADATA_KEY_ARTIST, "artist"));
+    ASSERT_EQ(0, radio_metadata_add_int(&metadata, RADIO_METADATA_KEY_RDS_PTY, 1));
+    ASSERT_EQ(3, radio_metadata_get_count(metadata));
+    expect_key_index(metadata);
+
+    // a value which fits is rewritten in place
+    radio_metadata_type_t type;
+    void *before;
+    void *after;
+    unsigned int size;
+    ASSERT_EQ(0, radio_metadata_get_from_key(metadata, RADIO_METADATA_KEY_TITLE, &type, &before,
+            &size));
+    ASSERT_EQ(0, radio_metadata_update_text(&metadata, RADIO_METADATA_KEY_TITLE, "short"));
+    ASSERT_EQ(0, radio_metadata_get_from_key(metadata, RADIO_METADATA_KEY_TITLE, &type, &after,
+            &size));
+    EXPECT_EQ(before, after);
+    EXPECT_STREQ("short", (const char *)after);
+    EXPECT_EQ(sizeof("short"), size);
+    ASSERT_EQ(3, radio_metadata_get_count(metadata));
+    expect_key_index(metadata);
+
+    // a larger value moves the entry after the others, which are compacted
+    ASSERT_EQ(0, radio_metadata_update_text(&metadata, RADIO_METADATA_KEY_TITLE,
+            "a title longer than the first one"));
+    ASSERT_EQ(3, radio_metadata_get_count(metadata));
+    radio_metadata_key_t key;
+    void *value;
+    ASSERT_EQ(0, radio_metadata_get_at_index(metadata, 0, &key, &type, &value, &size));
+    EXPECT_EQ(RADIO_METADATA_KEY_ARTIST, key);
+    EXPECT_EQ(HEADER_SIZE_INT, entry_offset(metadata, value));
+    ASSERT_EQ(0, radio_metadata_get_at_index(metadata, 2, &key, &type, &value, &size));
+    EXPECT_EQ(RADIO_METADATA_KEY_TITLE, key);
+    EXPECT_STREQ("a title longer than the first one", (const char *)value);
+    expect_key_index(metadata);
+
+    // several entries with the key are replaced by a single one
+    ASSERT_EQ(0, radio_metadata_add_int(&metadata, RADIO_METADATA_KEY_RDS_PTY, 2));
+    ASSERT_EQ(0, radio_metadata_add_text(&metadata, RADIO_METADATA_KEY_GENRE, "genre"));
+    ASSERT_EQ(0, radio_metadata_add_int(&metadata, RADIO_METADATA_KEY_RDS_PTY, 3));
+    ASSERT_EQ(6, radio_metadata_get_count(metadata));
+    ASSERT_EQ(0, radio_metadata_update_int(&metadata, RADIO_METADATA_KEY_RDS_PTY, 4));
+    ASSERT_EQ(4, radio_metadata_get_count(metadata));
+    int pty_count = 0;
+    for (int index = 0; index < radio_metadata_get_count(metadata); index++) {
+        ASSERT_EQ(0, radio_metadata_get_at_index(metadata, index, &key, &type, &value, &size));
+        if (key == RADIO_METADATA_KEY_RDS_PTY) {
+            EXPECT_EQ(4, *(int *)value);
+            pty_count++;
+        }
+    }
+    EXPECT_EQ(1, pty_count);
+    expect_key_index(metadata);
+
+    // a value which does not fit in the buffer grows it
+    unsigned char raw[8000];
+    memset(raw, 0x5a, sizeof(raw));
+    ASSERT_EQ(0, radio_metadata_update_raw(&metadata, RADIO_METADATA_KEY_ART, raw, sizeof(raw)));
+    EXPECT_LT((size_t)4096, radio_metadata_get_size(metadata));
+    ASSERT_EQ(0, radio_metadata_get_from_key(metadata, RADIO_METADATA_KEY_ART, &type, &value,
+            &size));
+    EXPECT_EQ(sizeof(raw), size);
+    EXPECT_EQ(0, memcmp(raw, value, sizeof(raw)));
+    ASSERT_EQ(0, radio_metadata_get_from_key(metadata, RADIO_METADATA_KEY_GENRE, &type, &value,
+            &size));
+    EXPECT_STREQ("genre", (const char *)value);
+    expect_key_index(metadata);
+
+    EXPECT_EQ(-EINVAL, radio_metadata_update_int(&metadata, RADIO_METADATA_KEY_TITLE, 1));
+    EXPECT_EQ(-EINVAL, radio_metadata_allocate_with_size(&metadata, 0, 0,
+            RADIO_METADATA_MAX_SIZE * sizeof(unsigned int) + 1));
+    radio_metadata_deallocate(metadata);
+}
+
+TEST(radio_metadata, raw_ref) {
+    radio_metadata_t *metadata = NULL;
+    ASSERT_EQ(0, radio_metadata_allocate(&metadata, 88500, 0));
+    radio_metadata_raw_ref_t ref;
+    memset(&ref, 0, sizeof(ref));
+    ref.fd = 3;
+    ref.offset_lo = 4096;
+    ref.size_lo = 100000;
+
+    EXPECT_EQ(-EINVAL, radio_metadata_add_raw_ref(&metadata, RADIO_METADATA_KEY_TITLE, &ref));
+    ref.fd = -1;
+    EXPECT_EQ(-EINVAL, radio_metadata_add_raw_ref(&metadata, RADIO_METADATA_KEY_ART, &ref));
+    ref.fd = 3;
+    ref.reserved = 1;
+    EXPECT_EQ(-EINVAL, radio_metadata_add_raw_ref(&metadata, RADIO_METADATA_KEY_ART, &ref));
+    ref.reserved = 0;
+    ref.offset_hi = 0xffffffff;
+    ref.size_hi = 1;
+    EXPECT_EQ(-EINVAL, radio_metadata_add_raw_ref(&metadata, RADIO_METADATA_KEY_ART, &ref));
+    ref.size_hi = 0;
+    ASSERT_EQ(0, radio_metadata_add_raw_ref(&metadata, RADIO_METADATA_KEY_ICON, &ref));
+
+    // a raw entry large enough to hold a reference is updated to one in place, and back
+    unsigned char raw[32];
+    memset(raw, 0x5a, sizeof(raw));
+    ASSERT_EQ(0, radio_metadata_add_raw(&metadata, RADIO_METADATA_KEY_ART, raw, sizeof(raw)));
+    ASSERT_EQ(0, radio_metadata_update_raw_ref(&metadata, RADIO_METADATA_KEY_ART, &ref));
+    ASSERT_EQ(2, radio_metadata_get_count(metadata));
+    radio_metadata_key_t key;
+    radio_metadata_type_t type;
+    void *value;
+    unsigned int size;
+    ASSERT_EQ(0, radio_metadata_get_at_index(metadata, 1, &key, &type, &value, &size));
+    EXPECT_EQ(RADIO_METADATA_KEY_ART, key);
+    EXPECT_EQ(RADIO_METADATA_TYPE_RAW_REF, type);
+    ASSERT_EQ(sizeof(ref), size);
+    EXPECT_EQ(0, memcmp(&ref, value, sizeof(ref)));
+    EXPECT_EQ(0, radio_metadata_check(metadata));
+
+    ASSERT_EQ(0, radio_metadata_update_raw(&metadata, RADIO_METADATA_KEY_ART, raw, 16));
+    ASSERT_EQ(2, radio_metadata_get_count(metadata));
+    ASSERT_EQ(0, radio_metadata_get_at_index(metadata, 1, &key, &type, &value, &size));
+    EXPECT_EQ(RADIO_METADATA_TYPE_RAW, type);
+    EXPECT_EQ(16u, size);
+    EXPECT_EQ(0, radio_metadata_check(metadata));
+
+    // a reference with an invalid file descriptor is rejected
+    ASSERT_EQ(0, radio_metadata_get_from_key(metadata, RADIO_METADATA_KEY_ICON, &type, &value,
+            &size));
+    EXPECT_EQ(RADIO_METADATA_TYPE_RAW_REF, type);
+    ref.fd = -1;
+    memcpy(value, &ref, sizeof(ref));
+    EXPECT_EQ(-EINVAL, radio_metadata_check(metadata));
+
+    radio_metadata_deallocate(metadata);
+}
+
+// count of entries with a key, and the integer or text value of the last one
+static int count_key(const radio_metadata_t *metadata, radio_metadata_key_t key,
+        std::string *text = NULL, int *integer = NULL)
+{
+    int count = 0;
+    for (int index = 0; index < radio_metadata_get_count(metadata); index++) {
+        radio_metadata_key_t entry_key;
+        radio_metadata_type_t type;
+        void *value;
+        unsigned int size;
+        if (radio_metadata_get_at_index(metadata, index, &entry_key, &type, &value, &size) != 0 ||
+                entry_key != key) {
+            continue;
+        }
+        if (type == RADIO_METADATA_TYPE_TEXT && text != NULL) {
+            *text = (const char *)value;
+        } else if (type == RADIO_METADATA_TYPE_INT && integer != NULL) {
+            *integer = *(int *)value;
+        }
+        count++;
+    }
+    return count;
+}
+
+TEST(radio_metadata, merge) {
+    radio_metadata_t *src = NULL;
+    ASSERT_EQ(0, radio_metadata_allocate(&src, 101100, 1));
+    ASSERT_EQ(0, radio_metadata_add_text(&src, RADIO_METADATA_KEY_TITLE, "new title"));
+    ASSERT_EQ(0, radio_metadata_add_int(&src, RADIO_METADATA_KEY_RDS_PTY, 7));
+    ASSERT_EQ(0, radio_metadata_add_text(&src, RADIO_METADATA_KEY_GENRE, "new genre"));
+
+    // into a new buffer
+    radio_metadata_t *dst = NULL;
+    ASSERT_EQ(0, radio_metadata_add_metadata(&dst, src));
+    ASSERT_TRUE(dst != NULL);
+    EXPECT_EQ(3, radio_metadata_get_count(dst));
+    expect_key_index(dst);
+    radio_metadata_deallocate(dst);
+
+    // without override, the entries of both buffers are kept and those of dst come first
+    dst = NULL;
+    ASSERT_EQ(0, radio_metadata_allocate(&dst, 88500, 0));
+    ASSERT_EQ(0, radio_metadata_add_text(&dst, RADIO_METADATA_KEY_TITLE, "old title"));
+    ASSERT_EQ(0, radio_metadata_add_text(&dst, RADIO_METADATA_KEY_ARTIST, "old artist"));
+    ASSERT_EQ(0, radio_metadata_add_int(&dst, RADIO_METADATA_KEY_RDS_PTY, 3));
+    radio_metadata_t *dst_override = NULL;
+    ASSERT_EQ(0, radio_metadata_add_metadata(&dst_override, dst));
+
+    ASSERT_EQ(0, radio_metadata_add_metadata(&dst, src));
+    EXPECT_EQ(6, radio_metadata_get_count(dst));
+    expect_key_index(dst);
+    EXPECT_EQ(2, count_key(dst, RADIO_METADATA_KEY_TITLE));
+    EXPECT_EQ(1, count_key(dst, RADIO_METADATA_KEY_GENRE));
+    radio_metadata_type_t type;
+    void *value;
+    unsigned int size;
+    ASSERT_EQ(0, radio_metadata_get_from_key(dst, RADIO_METADATA_KEY_TITLE, &type, &value,
+            &size));
+    EXPECT_STREQ("old title", (const char *)value);
+    // the channel is that of the source
+    EXPECT_EQ(101100u, ((radio_metadata_buffer_t *)dst)->channel);
+    EXPECT_EQ(1u, ((radio_metadata_buffer_t *)dst)->sub_channel);
+
+    // with override, the keys of the source replace those of the destination
+    ASSERT_EQ(0, radio_metadata_add_metadata_override(&dst_override, src));
+    EXPECT_EQ(4, radio_metadata_get_count(dst_override));
+    expect_key_index(dst_override);
+    std::string text;
+    int integer = 0;
+    EXPECT_EQ(1, count_key(dst_override, RADIO_METADATA_KEY_TITLE, &text));
+    EXPECT_EQ("new title", text);
+    EXPECT_EQ(1, count_key(dst_override, RADIO_METADATA_KEY_RDS_PTY, NULL, &integer));
+    EXPECT_EQ(7, integer);
+    EXPECT_EQ(1, count_key(dst_override, RADIO_METADATA_KEY_ARTIST, &text));
+    EXPECT_EQ("old artist", text);
+    // the remaining entry of the destination was moved to the start
+    ASSERT_EQ(0, radio_metadata_get_from_key(dst_override, RADIO_METADATA_KEY_ARTIST, &type,
+            &value, &size));
+    EXPECT_EQ(HEADER_SIZE_INT, entry_offset(dst_override, value));
+
+    // merging a large source grows the destination once, and an empty source changes nothing
+    radio_metadata_t *large = NULL;
+    ASSERT_EQ(0, radio_metadata_allocate(&large, 101100, 1));
+    for (int i = 0; i < 50; i++) {
+        ASSERT_EQ(0, radio_metadata_add_text(&large, RADIO_METADATA_KEY_RDS_RT, "radio text"));
+    }
+    ASSERT_EQ(0, radio_metadata_add_metadata_override(&dst_override, large));
+    EXPECT_EQ(54, radio_metadata_get_count(dst_override));
+    expect_key_index(dst_override);
+    radio_metadata_t *empty = NULL;
+    ASSERT_EQ(0, radio_metadata_allocate(&empty, 101100, 1));
+    ASSERT_EQ(0, radio_metadata_add_metadata_override(&dst_override, empty));
+    EXPECT_EQ(54, radio_metadata_get_count(dst_override));
+    expect_key_index(dst_override);
+
+    // a buffer cannot be merged into itself
+    EXPECT_EQ(-EINVAL, radio_metadata_add_metadata(&dst, dst));
+    EXPECT_EQ(-EINVAL, radio_metadata_add_metadata_override(&dst, dst));
+    EXPECT_EQ(-EINVAL, radio_metadata_add_metadata(&dst, NULL));
+    EXPECT_EQ(-EINVAL, radio_metadata_add_metadata(NULL, src));
+    EXPECT_EQ(6, radio_metadata_get_count(dst));
+
+    radio_metadata_deallocate(empty);
+    radio_metadata_deallocate(large);
+    radio_metadata_deallocate(dst_override);
+    radio_metadata_deallocate(dst);
+    radio_metadata_deallocate(src);
+}